@@ -0,0 +1,477 @@
+/*
+ * Benchmark harness for the StormLib-compatible API
+ *
+ * Measures archive open latency, small-file open/read/close throughput,
+ * large-file streaming, enumeration and multi-threaded scaling using only
+ * functions that StormLib and storm-ffi have in common, and prints the
+ * results as JSON. Building it once against each library gives directly
+ * comparable numbers for the same archive.
+ *
+ * Build against storm-ffi (from the repository root, after
+ * `cargo build --release -p storm-ffi`):
+ *   g++ -O2 -std=c++17 -pthread -Iffi/storm-ffi/include \
+ *       ffi/storm-ffi/examples/storm_bench.cpp -Ltarget/release -lstorm \
+ *       -Wl,-rpath,target/release -o storm_bench
+ *
+ * Build against StormLib:
+ *   g++ -O2 -std=c++17 -pthread -DBENCH_STORMLIB -I/path/to/StormLib/src \
+ *       ffi/storm-ffi/examples/storm_bench.cpp -L/path/to/StormLib/build \
+ *       -lstorm -lz -lbz2 -o storm_bench_stormlib
+ *
+ * Usage:
+ *   storm_bench <archive.mpq> [--iterations N] [--threads N]
+ *               [--small-max BYTES] [--map] [--output FILE]
+ */
+
+#include <StormLib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef BENCH_STORMLIB
+#define BENCH_LIBRARY "stormlib"
+static DWORD LastError() { return GetLastError(); }
+#else
+#define BENCH_LIBRARY "storm-ffi"
+static DWORD LastError() { return SFileGetLastError(); }
+#endif
+
+#ifndef BASE_PROVIDER_MAP
+#define BASE_PROVIDER_MAP 0x00000001
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+// Chunk size used when streaming large files
+static const DWORD STREAM_CHUNK = 64 * 1024;
+
+struct Options
+{
+    std::string archive;
+    std::string output;
+    int iterations = 5;
+    unsigned max_threads = 0;
+    DWORD small_max = 64 * 1024;
+    bool map = false;
+};
+
+struct Entry
+{
+    std::string name;
+    DWORD size;
+};
+
+// Latency distribution in microseconds
+struct Summary
+{
+    double mean_us = 0;
+    double p50_us = 0;
+    double p95_us = 0;
+    double min_us = 0;
+};
+
+static double SecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static Summary Summarize(std::vector<double> samples)
+{
+    Summary summary;
+    if (samples.empty())
+        return summary;
+
+    std::sort(samples.begin(), samples.end());
+    double total = 0;
+    for (double sample : samples)
+        total += sample;
+
+    summary.mean_us = total / samples.size();
+    summary.p50_us = samples[samples.size() / 2];
+    summary.p95_us = samples[std::min(samples.size() - 1, samples.size() * 95 / 100)];
+    summary.min_us = samples.front();
+    return summary;
+}
+
+static std::string JsonString(const std::string &value)
+{
+    std::string out = "\"";
+    for (char c : value)
+    {
+        switch (c)
+        {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                out += escaped;
+            }
+            else
+            {
+                out += c;
+            }
+        }
+    }
+    return out + "\"";
+}
+
+static std::string JsonSummary(const Summary &summary)
+{
+    std::ostringstream out;
+    out << "{\"mean_us\": " << summary.mean_us << ", \"p50_us\": " << summary.p50_us
+        << ", \"p95_us\": " << summary.p95_us << ", \"min_us\": " << summary.min_us << "}";
+    return out.str();
+}
+
+static HANDLE OpenArchive(const Options &options)
+{
+    HANDLE archive = nullptr;
+    DWORD flags = options.map ? BASE_PROVIDER_MAP : 0;
+    if (!SFileOpenArchive(options.archive.c_str(), 0, flags, &archive))
+        return nullptr;
+    return archive;
+}
+
+// Full listing of the archive, without special files such as (listfile)
+static std::vector<Entry> ListFiles(HANDLE archive)
+{
+    std::vector<Entry> entries;
+    SFILE_FIND_DATA find_data;
+    HANDLE find = SFileFindFirstFile(archive, "*", &find_data, nullptr);
+    if (find == nullptr)
+        return entries;
+
+    do
+    {
+        if (find_data.cFileName[0] != '(')
+            entries.push_back({find_data.cFileName, find_data.dwFileSize});
+    } while (SFileFindNextFile(find, &find_data));
+
+    SFileFindClose(find);
+    return entries;
+}
+
+// Open, read in chunks of at most `chunk` bytes, and close one file
+static bool ReadWholeFile(HANDLE archive, const Entry &entry, std::vector<char> &buffer, DWORD chunk,
+                          uint64_t &bytes)
+{
+    HANDLE file = nullptr;
+    if (!SFileOpenFileEx(archive, entry.name.c_str(), 0, &file))
+        return false;
+
+    DWORD size = SFileGetFileSize(file, nullptr);
+    if (buffer.size() < std::min(size, chunk))
+        buffer.resize(std::min(size, chunk));
+
+    DWORD remaining = size;
+    bool ok = true;
+    while (remaining > 0)
+    {
+        DWORD to_read = std::min(remaining, chunk);
+        DWORD read = 0;
+        // StormLib reports short reads at EOF as failures, so go by the count
+        SFileReadFile(file, buffer.data(), to_read, &read, nullptr);
+        if (read == 0)
+        {
+            ok = false;
+            break;
+        }
+        remaining -= read;
+        bytes += read;
+    }
+
+    SFileCloseFile(file);
+    return ok;
+}
+
+static std::string BenchOpen(const Options &options)
+{
+    int count = std::max(20, options.iterations * 20);
+    std::vector<double> samples;
+    for (int i = 0; i < count; i++)
+    {
+        Clock::time_point start = Clock::now();
+        HANDLE archive = OpenArchive(options);
+        double elapsed = SecondsSince(start);
+        if (archive == nullptr)
+        {
+            std::cerr << "open failed (error " << LastError() << ")\n";
+            break;
+        }
+        samples.push_back(elapsed * 1e6);
+        SFileCloseArchive(archive);
+    }
+
+    std::ostringstream out;
+    out << "{\"count\": " << samples.size() << ", \"latency\": " << JsonSummary(Summarize(samples)) << "}";
+    return out.str();
+}
+
+static std::string BenchSmallFiles(HANDLE archive, const std::vector<Entry> &files, const Options &options)
+{
+    std::vector<char> buffer;
+    std::vector<double> samples;
+    uint64_t bytes = 0;
+    uint64_t errors = 0;
+
+    // Untimed pass so both libraries start from the same page cache state
+    uint64_t warmup = 0;
+    for (const Entry &entry : files)
+        ReadWholeFile(archive, entry, buffer, options.small_max, warmup);
+
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < options.iterations; i++)
+    {
+        for (const Entry &entry : files)
+        {
+            Clock::time_point file_start = Clock::now();
+            if (!ReadWholeFile(archive, entry, buffer, options.small_max, bytes))
+                errors++;
+            samples.push_back(SecondsSince(file_start) * 1e6);
+        }
+    }
+    double elapsed = SecondsSince(start);
+
+    std::ostringstream out;
+    out << "{\"files\": " << files.size() << ", \"reads\": " << samples.size() << ", \"errors\": " << errors
+        << ", \"files_per_sec\": " << (elapsed > 0 ? samples.size() / elapsed : 0)
+        << ", \"mb_per_sec\": " << (elapsed > 0 ? bytes / elapsed / 1e6 : 0)
+        << ", \"open_read_close\": " << JsonSummary(Summarize(samples)) << "}";
+    return out.str();
+}
+
+static std::string BenchLargeFile(HANDLE archive, const std::vector<Entry> &entries, const Options &options)
+{
+    if (entries.empty())
+        return "null";
+
+    const Entry &largest = *std::max_element(entries.begin(), entries.end(),
+                                             [](const Entry &a, const Entry &b) { return a.size < b.size; });
+
+    std::vector<char> buffer;
+    uint64_t warmup = 0;
+    ReadWholeFile(archive, largest, buffer, STREAM_CHUNK, warmup);
+
+    double best = 0;
+    double total_rate = 0;
+    uint64_t errors = 0;
+    for (int i = 0; i < options.iterations; i++)
+    {
+        uint64_t bytes = 0;
+        Clock::time_point start = Clock::now();
+        if (!ReadWholeFile(archive, largest, buffer, STREAM_CHUNK, bytes))
+            errors++;
+        double elapsed = SecondsSince(start);
+        double rate = elapsed > 0 ? bytes / elapsed / 1e6 : 0;
+        best = std::max(best, rate);
+        total_rate += rate;
+    }
+
+    std::ostringstream out;
+    out << "{\"name\": " << JsonString(largest.name) << ", \"size\": " << largest.size
+        << ", \"chunk\": " << STREAM_CHUNK << ", \"errors\": " << errors
+        << ", \"mean_mb_per_sec\": " << total_rate / options.iterations << ", \"best_mb_per_sec\": " << best
+        << "}";
+    return out.str();
+}
+
+static std::string BenchEnumeration(HANDLE archive, const Options &options)
+{
+    std::vector<double> samples;
+    size_t found = 0;
+    for (int i = 0; i < options.iterations; i++)
+    {
+        Clock::time_point start = Clock::now();
+        found = ListFiles(archive).size();
+        samples.push_back(SecondsSince(start) * 1e6);
+    }
+
+    Summary summary = Summarize(samples);
+    std::ostringstream out;
+    out << "{\"files\": " << found
+        << ", \"files_per_sec\": " << (summary.mean_us > 0 ? found / (summary.mean_us / 1e6) : 0)
+        << ", \"pass\": " << JsonSummary(summary) << "}";
+    return out.str();
+}
+
+// Read the small-file set `iterations` times, split across `threads` workers.
+// Each worker opens its own archive handle since StormLib handles must not be
+// shared between threads.
+static bool RunScalingPass(const Options &options, const std::vector<Entry> &files, unsigned threads,
+                           double &elapsed, uint64_t &bytes)
+{
+    size_t total = files.size() * options.iterations;
+    std::vector<uint64_t> worker_bytes(threads, 0);
+    std::vector<HANDLE> archives(threads, nullptr);
+    for (unsigned t = 0; t < threads; t++)
+    {
+        archives[t] = OpenArchive(options);
+        if (archives[t] == nullptr)
+        {
+            for (unsigned i = 0; i < t; i++)
+                SFileCloseArchive(archives[i]);
+            return false;
+        }
+    }
+
+    Clock::time_point start = Clock::now();
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t]() {
+            std::vector<char> buffer;
+            for (size_t i = t; i < total; i += threads)
+                ReadWholeFile(archives[t], files[i % files.size()], buffer, options.small_max, worker_bytes[t]);
+        });
+    }
+    for (std::thread &worker : workers)
+        worker.join();
+    elapsed = SecondsSince(start);
+
+    bytes = 0;
+    for (unsigned t = 0; t < threads; t++)
+    {
+        bytes += worker_bytes[t];
+        SFileCloseArchive(archives[t]);
+    }
+    return true;
+}
+
+static std::string BenchScaling(const std::vector<Entry> &files, const Options &options)
+{
+    std::ostringstream out;
+    out << "[";
+    double baseline = 0;
+    bool first = true;
+    for (unsigned threads = 1; threads <= options.max_threads; threads *= 2)
+    {
+        double elapsed = 0;
+        uint64_t bytes = 0;
+        if (!RunScalingPass(options, files, threads, elapsed, bytes))
+        {
+            std::cerr << "scaling: open failed (error " << LastError() << ")\n";
+            break;
+        }
+
+        double files_per_sec = elapsed > 0 ? files.size() * options.iterations / elapsed : 0;
+        if (threads == 1)
+            baseline = files_per_sec;
+
+        out << (first ? "" : ", ") << "{\"threads\": " << threads << ", \"files_per_sec\": " << files_per_sec
+            << ", \"mb_per_sec\": " << (elapsed > 0 ? bytes / elapsed / 1e6 : 0)
+            << ", \"speedup\": " << (baseline > 0 ? files_per_sec / baseline : 0) << "}";
+        first = false;
+    }
+    out << "]";
+    return out.str();
+}
+
+static void Usage(const char *program)
+{
+    std::cerr << "usage: " << program
+              << " <archive.mpq> [--iterations N] [--threads N] [--small-max BYTES] [--map] [--output FILE]\n";
+}
+
+static bool ParseArgs(int argc, char **argv, Options &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--iterations" && has_value)
+            options.iterations = std::max(1, atoi(argv[++i]));
+        else if (arg == "--threads" && has_value)
+            options.max_threads = static_cast<unsigned>(std::max(1, atoi(argv[++i])));
+        else if (arg == "--small-max" && has_value)
+            options.small_max = static_cast<DWORD>(std::max(1L, atol(argv[++i])));
+        else if (arg == "--output" && has_value)
+            options.output = argv[++i];
+        else if (arg == "--map")
+            options.map = true;
+        else if (arg[0] != '-' && options.archive.empty())
+            options.archive = arg;
+        else
+            return false;
+    }
+
+    if (options.max_threads == 0)
+        options.max_threads = std::min(8u, std::max(1u, std::thread::hardware_concurrency()));
+    return !options.archive.empty();
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!ParseArgs(argc, argv, options))
+    {
+        Usage(argv[0]);
+        return 2;
+    }
+
+    HANDLE archive = OpenArchive(options);
+    if (archive == nullptr)
+    {
+        std::cerr << "failed to open " << options.archive << " (error " << LastError() << ")\n";
+        return 1;
+    }
+
+    std::vector<Entry> entries = ListFiles(archive);
+    std::vector<Entry> small;
+    for (const Entry &entry : entries)
+    {
+        if (entry.size > 0 && entry.size <= options.small_max)
+            small.push_back(entry);
+    }
+
+    std::ostringstream json;
+    json << "{\n";
+    json << "  \"library\": " << JsonString(BENCH_LIBRARY) << ",\n";
+    json << "  \"archive\": " << JsonString(options.archive) << ",\n";
+    json << "  \"memory_mapped\": " << (options.map ? "true" : "false") << ",\n";
+    json << "  \"iterations\": " << options.iterations << ",\n";
+    json << "  \"files\": " << entries.size() << ",\n";
+    json << "  \"open\": " << BenchOpen(options) << ",\n";
+    json << "  \"enumeration\": " << BenchEnumeration(archive, options) << ",\n";
+    json << "  \"small_files\": " << (small.empty() ? "null" : BenchSmallFiles(archive, small, options)) << ",\n";
+    json << "  \"large_file\": " << BenchLargeFile(archive, entries, options) << ",\n";
+    json << "  \"scaling\": " << (small.empty() ? "[]" : BenchScaling(small, options)) << "\n";
+    json << "}\n";
+
+    SFileCloseArchive(archive);
+
+    if (options.output.empty())
+    {
+        std::cout << json.str();
+    }
+    else
+    {
+        std::ofstream out(options.output);
+        if (!out)
+        {
+            std::cerr << "failed to write " << options.output << "\n";
+            return 1;
+        }
+        out << json.str();
+    }
+    return 0;
+}
@@ -15,30 +15,183 @@ typedef uint32_t DWORD;
 typedef int32_t LONG;
 typedef uint32_t LCID;
 
+/* Archive open flags */
+#define BASE_PROVIDER_MAP 0x00000001 /* Memory-map the archive file */
+#define MPQ_OPEN_NO_LISTFILE   0x00010000 /* Enumerate table entries only, ignoring (listfile) */
+#define MPQ_OPEN_NO_ATTRIBUTES 0x00020000 /* Never parse (attributes) */
+#define MPQ_OPEN_LAZY_TABLES   0x01000000 /* Read only the header; load tables on first lookup */
+
+/* SFileGetFileInfo extension classes (archive handles, 64-bit values) */
+#define SFILE_INFO_LOOKUP_CACHE_HITS    0x100
+#define SFILE_INFO_LOOKUP_CACHE_MISSES  0x101
+#define SFILE_INFO_LOOKUP_CACHE_ENTRIES 0x102
+/* SFileGetFileInfo extension classes (file handles, 64-bit values) */
+#define SFILE_INFO_READ_COUNT           0x105
+#define SFILE_INFO_BYTES_DELIVERED      0x106
+#define SFILE_INFO_READ_TIME            0x107 /* Nanoseconds spent in reads */
+
+/* SFileGetFileInfo extension classes (archive handles, 64-bit values) */
+#define SFILE_INFO_SECTOR_CACHE_HITS    0x108
+#define SFILE_INFO_SECTOR_CACHE_MISSES  0x109
+#define SFILE_INFO_SECTOR_CACHE_BYTES   0x10A /* Decoded bytes this archive holds in the cache */
+
+/* SFileExtractFiles flags */
+#define SFILE_EXTRACT_REQUEST_ORDER 0x00000001 /* Read files one at a time in request order, not in on-disk order */
+
 /* Archive operations */
 bool SFileOpenArchive(const char* archive_name, DWORD priority, DWORD flags, HANDLE* archive);
+/* Opens every MPQ in data_path and its locale folders (only locale if not NULL) as one handle for
+   SFileOpenFileEx, SFileHasFile and SFileCloseArchive; lookups probe one index merged in client load order */
+bool SFileOpenDataFolder(const char* data_path, const char* locale, DWORD flags, HANDLE* archive);
 bool SFileCreateArchive(const char* archive_name, DWORD flags, DWORD max_file_count, HANDLE* archive);
 bool SFileCloseArchive(HANDLE archive);
+/* Archives opened after this call reuse decrypted tables and listings cached in directory (NULL disables) */
+bool SFileSetIndexCacheDirectory(const char* directory);
+/* Archives opened after this call look files up in read-only mappings of index entries in directory, shared between processes (NULL disables) */
+bool SFileSetSharedIndexDirectory(const char* directory);
+/* Archives opened while budget > 0 share decoded sectors in one LRU cache of budget bytes (0 = off, the default) */
+bool SFileSetSectorCacheSize(uint64_t budget);
+
+/* Adding files; tables are written by SFileFlushArchive or SFileCloseArchive */
+#define MPQ_FILE_ENCRYPTED       0x00010000
+#define MPQ_FILE_FIX_KEY         0x00020000
+#define MPQ_FILE_REPLACEEXISTING 0x80000000
+bool SFileAddFileEx(HANDLE archive, const char* filename, const char* archived_name, DWORD flags, DWORD compression, DWORD compression_next);
+/* Compresses on thread_count workers (0 = one per CPU) and writes in array order */
+bool SFileAddFiles(HANDLE archive, const char** filenames, const char** archived_names, DWORD count, DWORD flags, DWORD compression, DWORD thread_count);
+bool SFileFlushArchive(HANDLE archive);
+
+/* Compaction streams live files into a new archive file; callbacks get a CCB_* stage and its bytes done/total */
+#define CCB_CHECKING_FILES       1
+#define CCB_CHECKING_HASH_TABLE  2
+#define CCB_COPYING_NON_MPQ_DATA 3
+#define CCB_COMPACTING_FILES     4
+#define CCB_CLOSING_ARCHIVE      5
+typedef void (*SFILE_COMPACT_CALLBACK)(void* user_data, DWORD work_type, uint64_t bytes_processed, uint64_t total_bytes);
+bool SFileSetCompactCallback(HANDLE archive, SFILE_COMPACT_CALLBACK callback, void* user_data);
+bool SFileCompactArchive(HANDLE archive, const char* listfile, bool reserved);
+/* Compacts on a background thread; SFileWaitForCompact returns the result (0xFFFFFFFF waits indefinitely) */
+bool SFileCompactArchiveAsync(HANDLE archive);
+bool SFileWaitForCompact(HANDLE archive, DWORD timeout_ms);
+
+/* Patch archives */
+bool SFileOpenPatchArchive(HANDLE archive, const char* patch_archive_name, const char* patch_prefix, DWORD flags);
+bool SFileIsPatchedArchive(HANDLE archive);
 
 /* File operations */
 bool SFileOpenFileEx(HANDLE archive, const char* filename, DWORD search_scope, HANDLE* file);
 bool SFileCloseFile(HANDLE file);
 bool SFileReadFile(HANDLE file, void* buffer, DWORD to_read, DWORD* read, void* overlapped);
+bool SFileMapFile(HANDLE file, const void** data, DWORD* size, DWORD* size_high);
 DWORD SFileGetFileSize(HANDLE file, DWORD* file_size_high);
 DWORD SFileSetFilePointer(HANDLE file, LONG distance, LONG* distance_high, DWORD method);
 DWORD SFileGetFilePointer(HANDLE file, LONG* file_pos_high);
+bool SFileGetFileSize64(HANDLE file, uint64_t* size);
+bool SFileSeek64(HANDLE file, int64_t offset, DWORD method, uint64_t* new_position);
+bool SFileReadFileEx64(HANDLE file, void* buffer, uint64_t to_read, uint64_t* read);
+bool SFileReadFileAt(HANDLE file, uint64_t offset, void* buffer, uint64_t to_read, uint64_t* read);
 bool SFileHasFile(HANDLE archive, const char* filename);
+/* Look up count names at once; block_indices receives 0xFFFFFFFF for missing names */
+bool SFileFindFilesBatch(HANDLE archive, const char** names, DWORD count, DWORD* block_indices, DWORD* found_count);
 bool SFileExtractFile(HANDLE archive, const char* filename, const char* local_filename, DWORD search_scope);
+bool SFileExtractFiles(HANDLE archive, const char** filenames, const char** local_filenames, DWORD count, DWORD thread_count, DWORD flags, DWORD* extracted);
+
+/* Asynchronous reads, completed on a background I/O pool */
+typedef void (*SFILE_READ_CALLBACK)(HANDLE file, void* buffer, DWORD bytes_read, DWORD error, void* user_data);
+typedef struct {
+    DWORD queued;        /* Reads waiting for a pool thread */
+    DWORD in_flight;     /* Reads currently being decoded */
+    DWORD peak_pending;  /* Highest queued + in-flight count seen */
+    DWORD threads;       /* Pool threads */
+    uint64_t completed;
+    uint64_t failed;
+} SFILE_ASYNC_STATS;
+bool SFileReadFileAsync(HANDLE file, void* buffer, DWORD to_read, SFILE_READ_CALLBACK callback, void* user_data);
+bool SFileGetAsyncReadStats(SFILE_ASYNC_STATS* stats);
+bool SFileWaitAsyncReads(DWORD timeout_ms);
+
+/* Process-wide performance counters; latency bucket 0 is < 1 us, bucket i is 2^(i-1) to 2^i us */
+#define SFILE_STATS_ALGORITHMS      9  /* Huffman, zlib, implode, PKWare, bzip2, sparse, ADPCM mono, ADPCM stereo, LZMA */
+#define SFILE_STATS_LATENCY_BUCKETS 32
+typedef struct {
+    uint64_t disk_bytes_read;
+    uint64_t disk_reads;
+    uint64_t mapped_bytes_read;
+    uint64_t bytes_delivered;      /* Returned by SFileReadFile and SFileReadFileAsync */
+    uint64_t sector_cache_hits;
+    uint64_t sector_cache_misses;
+    uint64_t buffer_pool_hits;
+    uint64_t buffer_pool_misses;
+    uint64_t decompress_calls[SFILE_STATS_ALGORITHMS];
+    uint64_t decompress_bytes_in[SFILE_STATS_ALGORITHMS];
+    uint64_t decompress_bytes_out[SFILE_STATS_ALGORITHMS];
+    uint64_t decompress_nanos[SFILE_STATS_ALGORITHMS];
+    uint64_t lock_waits;           /* Handle table and handle lock acquisitions that blocked */
+    uint64_t lock_wait_nanos;
+    uint64_t open_count;
+    uint64_t open_nanos;
+    uint64_t open_latency[SFILE_STATS_LATENCY_BUCKETS];
+    uint64_t read_count;
+    uint64_t read_nanos;
+    uint64_t read_latency[SFILE_STATS_LATENCY_BUCKETS];
+} SFILE_STATISTICS;
+bool SFileGetStatistics(SFILE_STATISTICS* statistics);
+void SFileResetStatistics(void);
 
 /* Information functions */
 bool SFileGetArchiveName(HANDLE archive, char* buffer, DWORD buffer_size);
 bool SFileGetFileName(HANDLE file, char* buffer);
 DWORD SFileGetFileInfo(HANDLE file_or_archive, DWORD info_class, void* buffer, DWORD buffer_size, DWORD* length_needed);
 
+/* Bulk metadata from the archive tables and (attributes), without opening files */
+#define MPQ_ATTRIBUTE_CRC32    0x00000001
+#define MPQ_ATTRIBUTE_FILETIME 0x00000002
+#define MPQ_ATTRIBUTE_MD5      0x00000004
+typedef struct {
+    uint64_t name_hash;       /* Hash table name_1 << 32 | name_2, or the BET hash */
+    uint64_t file_pos;
+    uint64_t file_size;
+    uint64_t compressed_size;
+    uint64_t file_time;       /* 0 if not in (attributes) */
+    DWORD hash_index;         /* 0xFFFFFFFF for HET/BET archives */
+    DWORD block_index;
+    DWORD file_flags;
+    DWORD crc32;              /* 0 if not in (attributes) */
+    DWORD locale;
+    DWORD attribute_flags;    /* MPQ_ATTRIBUTE_* bits that are set */
+    uint8_t md5[16];
+} SFILE_METADATA;
+bool SFileGetFileMetadata(HANDLE archive, SFILE_METADATA* entries, DWORD max_entries, DWORD* entry_count);
+
+/* Lookup cache */
+bool SFileSetLookupCacheSize(HANDLE archive, DWORD max_entries);
+bool SFilePrewarmLookupCache(HANDLE archive, const char* listfile, DWORD* found);
+
 /* Enumeration */
 typedef bool (*SFILE_ENUM_CALLBACK)(const char* filename, void* user_data);
 bool SFileEnumFiles(HANDLE archive, const char* search_mask, const char* list_file, SFILE_ENUM_CALLBACK callback, void* user_data);
 
+#ifndef MAX_PATH
+#define MAX_PATH 260
+#endif
+
+typedef struct {
+    char cFileName[MAX_PATH];
+    char* szPlainName;
+    DWORD dwHashIndex;
+    DWORD dwBlockIndex;
+    DWORD dwFileSize;
+    DWORD dwFileFlags;
+    DWORD dwCompSize;
+    DWORD dwFileTimeLo;
+    DWORD dwFileTimeHi;
+    LCID lcLocale;
+} SFILE_FIND_DATA;
+
+HANDLE SFileFindFirstFile(HANDLE archive, const char* mask, SFILE_FIND_DATA* find_data, const char* list_file);
+bool SFileFindNextFile(HANDLE find, SFILE_FIND_DATA* find_data);
+bool SFileFindClose(HANDLE find);
+
 /* Utility functions */
 LCID SFileSetLocale(LCID locale);
 LCID SFileGetLocale(void);
@@ -46,11 +199,123 @@ DWORD SFileGetLastError(void);
 void SFileSetLastError(DWORD error);
 
 /* Verification functions */
+#define SFILE_VERIFY_SECTOR_CRC 0x01
+#define SFILE_VERIFY_FILE_CRC   0x02
+#define SFILE_VERIFY_FILE_MD5   0x04
+#define SFILE_VERIFY_SIGNATURE  0x10
+#define SFILE_VERIFY_ALL_FILES  0x20
+#define SFILE_VERIFY_ALL        0xFF
+
+/* SFILE_VERIFY_FAILURE::failure */
+#define SFILE_VERIFY_FAILED_SECTOR_CRC 1
+#define SFILE_VERIFY_FAILED_FILE_CRC   2
+#define SFILE_VERIFY_FAILED_FILE_MD5   3
+#define SFILE_VERIFY_FAILED_READ       4
+
+typedef void (*SFILE_VERIFY_PROGRESS)(DWORD files_done, DWORD files_total, void* user_data);
+typedef struct {
+    char file_name[260];
+    DWORD block_index;   /* 0xFFFFFFFF if unknown */
+    DWORD failure;       /* SFILE_VERIFY_FAILED_* */
+} SFILE_VERIFY_FAILURE;
+
 bool SFileVerifyFile(HANDLE archive, const char* filename, DWORD flags);
-DWORD SFileVerifyArchive(HANDLE archive);
+bool SFileVerifyArchive(HANDLE archive, DWORD flags);
+bool SFileVerifyArchiveEx(HANDLE archive, DWORD flags, DWORD thread_count, SFILE_VERIFY_PROGRESS progress, void* user_data, SFILE_VERIFY_FAILURE* failures, DWORD max_failures, DWORD* failure_count);
 bool SFileSignArchive(HANDLE archive, DWORD signature_type);
 bool SFileGetAttributes(HANDLE archive);
 
+/* DBC/DB2 tables read in place from a memory-mapped file or an open MPQ file; pointers stay valid until SDbcClose */
+#define SDBC_NO_KEY 0xFFFFFFFF /* key_field that skips building the ID index */
+typedef struct {
+    uint8_t magic[4];          /* "WDBC", "WDB2", ... */
+    DWORD record_count;
+    DWORD field_count;
+    DWORD record_size;         /* Stride between records; WDB2 records may not be 4-byte aligned */
+    DWORD string_block_size;
+    DWORD indexed_ids;         /* 0 if opened with SDBC_NO_KEY */
+    const void* records;
+    const char* string_block;  /* String fields are offsets into this block */
+} SDBC_INFO;
+
+bool SDbcOpen(const char* path, DWORD key_field, HANDLE* dbc);
+bool SDbcOpenFromFile(HANDLE file, DWORD key_field, HANDLE* dbc);
+bool SDbcClose(HANDLE dbc);
+bool SDbcGetInfo(HANDLE dbc, SDBC_INFO* info);
+const void* SDbcGetRecord(HANDLE dbc, DWORD row);
+/* O(1) lookup through the ID index built on open from 32-bit column key_field */
+bool SDbcFindRecord(HANDLE dbc, DWORD id, DWORD* row);
+/* Field getters read 32-bit column field; they return 0 (or NULL) and set the last error when out of range */
+uint32_t SDbcGetUInt32(HANDLE dbc, DWORD row, DWORD field);
+int32_t SDbcGetInt32(HANDLE dbc, DWORD row, DWORD field);
+float SDbcGetFloat(HANDLE dbc, DWORD row, DWORD field);
+const char* SDbcGetString(HANDLE dbc, DWORD row, DWORD field);
+
+/* BLP textures decoded from an archive or data folder handle straight into caller buffers */
+#define SBLP_DECODE_KEEP_DXT 0x01  /* Copy DXT levels out compressed */
+
+#define SBLP_FORMAT_RGBA8 0
+#define SBLP_FORMAT_DXT1  1
+#define SBLP_FORMAT_DXT3  2
+#define SBLP_FORMAT_DXT5  3
+
+typedef struct {
+    const char* file_name;     /* Set by the caller */
+    void* buffer;              /* Set by the caller; NULL queries the size */
+    DWORD buffer_size;         /* Set by the caller */
+    DWORD mip_level;           /* Level decoded, clamped to the smallest stored mipmap */
+    DWORD width;
+    DWORD height;
+    DWORD format;              /* SBLP_FORMAT_* */
+    DWORD bytes_written;       /* Or bytes needed on ERROR_INSUFFICIENT_BUFFER */
+    DWORD error;               /* ERROR_SUCCESS or why this texture failed */
+} SBLP_DECODE;
+
+/* Decode one mip level of each texture on thread_count workers (0 = one per CPU) */
+bool SBlpDecodeBatch(HANDLE archive, SBLP_DECODE* requests, DWORD count, DWORD mip_level, DWORD flags, DWORD thread_count);
+
+/* ADT terrain tiles around a moving position, loaded in the background from an archive or data folder handle */
+#define SADT_CHUNKS_PER_TILE   256
+#define SADT_HEIGHTS_PER_CHUNK 145  /* 9x9 outer and 8x8 inner vertices, rows interleaved */
+
+#define SADT_TILE_HAS_TEX0 0x01
+#define SADT_TILE_HAS_OBJ0 0x02
+#define SADT_TILE_HAS_LOD  0x04
+
+typedef struct {
+    DWORD tile_x;              /* First number of Map_X_Y.adt */
+    DWORD tile_y;              /* Second number of Map_X_Y.adt */
+    DWORD flags;               /* SADT_TILE_HAS_* */
+    DWORD chunk_count;
+    DWORD texture_count;
+    DWORD doodad_count;        /* M2 placements */
+    DWORD wmo_count;           /* WMO placements */
+    DWORD file_size;           /* Combined size of the tile's files */
+    float min_height;
+    float max_height;
+} SADT_TILE_INFO;
+
+typedef struct {
+    DWORD resident_tiles;
+    DWORD pending_tiles;       /* Queued or being loaded */
+    uint64_t resident_bytes;   /* Compared against memory_budget */
+    uint64_t loaded;
+    uint64_t evicted;
+    uint64_t failed;
+} SADT_STREAMER_STATS;
+
+/* Keeps tiles within radius of the current one loaded on thread_count workers (0 = two) */
+bool SAdtOpenStreamer(HANDLE archive, const char* map_name, DWORD radius, uint64_t memory_budget, DWORD thread_count, HANDLE* streamer);
+bool SAdtCloseStreamer(HANDLE streamer);
+bool SAdtUpdatePosition(HANDLE streamer, float x, float y, DWORD* tile_x, DWORD* tile_y);
+bool SAdtGetStreamerStats(HANDLE streamer, SADT_STREAMER_STATS* stats);
+/* timeout_ms of 0 only checks the cache, 0xFFFFFFFF waits indefinitely; tile handles outlive the streamer */
+bool SAdtGetTile(HANDLE streamer, DWORD tile_x, DWORD tile_y, DWORD timeout_ms, HANDLE* tile);
+bool SAdtCloseTile(HANDLE tile);
+bool SAdtGetTileInfo(HANDLE tile, SADT_TILE_INFO* info);
+/* Absolute heights, SADT_HEIGHTS_PER_CHUNK per chunk in row-major chunk order */
+bool SAdtGetTileHeights(HANDLE tile, float* heights, DWORD count, DWORD* written);
+
 #ifdef __cplusplus
 }
 #endif
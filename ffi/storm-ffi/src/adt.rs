@@ -0,0 +1,583 @@
+//! Streaming ADT terrain tiles
+//!
+//! `SAdtOpenStreamer` reads a map's WDT from an archive or data folder
+//! handle and starts a [`TileStreamer`] over the tiles it lists. Each
+//! `SAdtUpdatePosition` queues the tiles around the new position, which
+//! background threads read from the handle and parse together with their
+//! `_tex0`, `_obj0` and `_lod` split files. Parsed tiles are cached within a
+//! byte budget, least recently used tiles outside the window going first.
+//!
+//! `SAdtGetTile` hands out a tile handle that keeps its tile alive even after
+//! the streamer evicts it, until `SAdtCloseTile`. Tiles are immutable, so the
+//! getters need no lock.
+
+use crate::handles::HandleTable;
+use crate::{
+    handle_to_id, id_to_handle, set_last_error, FileSource, ERROR_FILE_CORRUPT,
+    ERROR_FILE_NOT_FOUND, ERROR_INSUFFICIENT_BUFFER, ERROR_INVALID_HANDLE, ERROR_INVALID_PARAMETER,
+    ERROR_SUCCESS, ERROR_TIMEOUT, HANDLE,
+};
+use libc::c_char;
+use std::ffi::CStr;
+use std::io::{self, Cursor, Read};
+use std::sync::{Arc, LazyLock};
+use std::time::Duration;
+use wow_adt::tile_stream::{StreamedTile, StreamerConfig, TileCoord, TileSource, TileStreamer};
+use wow_adt::McvtChunk;
+use wow_wdt::version::WowVersion;
+use wow_wdt::WdtReader;
+
+// Streamers opened with SAdtOpenStreamer and tiles returned by SAdtGetTile
+static STREAMERS: LazyLock<HandleTable<TileStreamer>> = LazyLock::new(HandleTable::new);
+static TILES: LazyLock<HandleTable<Arc<StreamedTile>>> = LazyLock::new(HandleTable::new);
+
+/// Terrain chunks per tile
+pub const SADT_CHUNKS_PER_TILE: u32 = 256;
+/// Height values per terrain chunk, 9x9 outer and 8x8 inner vertices
+pub const SADT_HEIGHTS_PER_CHUNK: u32 = McvtChunk::VERTEX_COUNT as u32;
+
+/// The tile has a `_tex0` texture file
+pub const SADT_TILE_HAS_TEX0: u32 = 0x01;
+/// The tile has an `_obj0` object file
+pub const SADT_TILE_HAS_OBJ0: u32 = 0x02;
+/// The tile has a `_lod` file
+pub const SADT_TILE_HAS_LOD: u32 = 0x04;
+
+/// Summary of a loaded tile, see `SAdtGetTileInfo`
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct SADT_TILE_INFO {
+    /// Column of the tile, the first number of `Map_X_Y.adt`
+    pub tile_x: u32,
+    /// Row of the tile, the second number of `Map_X_Y.adt`
+    pub tile_y: u32,
+    /// `SADT_TILE_HAS_*` flags for the split files that were found
+    pub flags: u32,
+    /// Number of MCNK terrain chunks
+    pub chunk_count: u32,
+    /// Number of texture file names
+    pub texture_count: u32,
+    /// Number of M2 doodad placements
+    pub doodad_count: u32,
+    /// Number of WMO placements
+    pub wmo_count: u32,
+    /// Combined size of the tile's files in bytes
+    pub file_size: u32,
+    /// Lowest absolute terrain height
+    pub min_height: f32,
+    /// Highest absolute terrain height
+    pub max_height: f32,
+}
+
+/// Streamer counters, see `SAdtGetStreamerStats`
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct SADT_STREAMER_STATS {
+    /// Tiles currently cached
+    pub resident_tiles: u32,
+    /// Tiles queued or being loaded
+    pub pending_tiles: u32,
+    /// File bytes of the cached tiles, compared against the budget
+    pub resident_bytes: u64,
+    /// Tiles loaded since the streamer was opened
+    pub loaded: u64,
+    /// Tiles evicted to stay within the budget
+    pub evicted: u64,
+    /// Tiles that failed to load
+    pub failed: u64,
+}
+
+impl TileSource for FileSource {
+    fn read_file(&self, path: &str) -> io::Result<Option<Vec<u8>>> {
+        let mut stream = match self.open_file_stream(path) {
+            Ok(stream) => stream,
+            Err(wow_mpq::Error::FileNotFound(_)) => return Ok(None),
+            Err(e) => return Err(io::Error::other(e)),
+        };
+        let mut data = Vec::new();
+        stream.read_to_end(&mut data)?;
+        Ok(Some(data))
+    }
+}
+
+/// Look up a streamer handle, setting the last error if it is invalid
+fn lookup_streamer(streamer: HANDLE) -> Option<Arc<TileStreamer>> {
+    let streamer = handle_to_id(streamer).and_then(|id| STREAMERS.get(id));
+    if streamer.is_none() {
+        set_last_error(ERROR_INVALID_HANDLE);
+    }
+    streamer
+}
+
+/// Look up a tile handle, setting the last error if it is invalid
+fn lookup_tile(tile: HANDLE) -> Option<Arc<Arc<StreamedTile>>> {
+    let tile = handle_to_id(tile).and_then(|id| TILES.get(id));
+    if tile.is_none() {
+        set_last_error(ERROR_INVALID_HANDLE);
+    }
+    tile
+}
+
+/// Tiles with an ADT according to a map's WDT
+fn read_wdt_tiles(source: &FileSource, map_dir: &str) -> Result<Vec<TileCoord>, u32> {
+    let data = source
+        .read_file(&format!("{map_dir}.wdt"))
+        .map_err(|_| ERROR_FILE_CORRUPT)?
+        .ok_or(ERROR_FILE_NOT_FOUND)?;
+    // The version is only a hint, the reader detects it from the chunks
+    let wdt = WdtReader::new(Cursor::new(data), WowVersion::WotLK)
+        .read()
+        .map_err(|_| ERROR_FILE_CORRUPT)?;
+
+    let tiles = (0..64)
+        .flat_map(|y| (0..64).map(move |x| (x, y)))
+        .filter(|&(x, y)| wdt.get_tile(x, y).is_some_and(|tile| tile.has_adt))
+        .map(|(x, y)| TileCoord::new(x as u32, y as u32))
+        .collect();
+    Ok(tiles)
+}
+
+/// Open a streamer over the terrain tiles of a map
+///
+/// The map's files are read from `World\Maps\<map_name>\` in the archive or
+/// data folder `archive`, starting with its WDT, which lists the tiles that
+/// exist. Tiles within `radius` of the current one are kept loaded (1 is a
+/// 3x3 window) by `thread_count` background threads (0 uses two), and up to
+/// `memory_budget` bytes of tile files stay cached. Tiles inside the window
+/// are never evicted, so a window larger than the budget still loads.
+///
+/// Nothing is loaded until `SAdtUpdatePosition` or `SAdtGetTile`. The
+/// streamer keeps the archive open until it is closed itself.
+///
+/// # Safety
+///
+/// - `map_name` must be a valid null-terminated C string
+/// - `streamer` must be a valid pointer to write the output handle
+#[no_mangle]
+pub unsafe extern "C" fn SAdtOpenStreamer(
+    archive: HANDLE,
+    map_name: *const c_char,
+    radius: u32,
+    memory_budget: u64,
+    thread_count: u32,
+    streamer: *mut HANDLE,
+) -> bool {
+    if map_name.is_null() || streamer.is_null() {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+    let Ok(map_name) = CStr::from_ptr(map_name).to_str() else {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    };
+    let Some(archive_id) = handle_to_id(archive) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
+    };
+    let Some(source) = FileSource::lookup(archive_id) else {
+        return false;
+    };
+
+    let map_dir = format!("World\\Maps\\{map_name}\\{map_name}");
+    let tiles = match read_wdt_tiles(&source, &map_dir) {
+        Ok(tiles) => tiles,
+        Err(code) => {
+            set_last_error(code);
+            return false;
+        }
+    };
+
+    let config = StreamerConfig {
+        radius,
+        memory_budget: usize::try_from(memory_budget).unwrap_or(usize::MAX),
+        worker_threads: match thread_count {
+            0 => StreamerConfig::default().worker_threads,
+            n => n as usize,
+        },
+    };
+    let tile_streamer = TileStreamer::new(source, map_dir, tiles, config);
+    *streamer = id_to_handle(STREAMERS.insert(tile_streamer));
+    set_last_error(ERROR_SUCCESS);
+    true
+}
+
+/// Close a streamer, stopping its threads
+///
+/// Tile handles obtained from it stay valid until closed.
+#[no_mangle]
+pub extern "C" fn SAdtCloseStreamer(streamer: HANDLE) -> bool {
+    if handle_to_id(streamer)
+        .and_then(|id| STREAMERS.remove(id))
+        .is_some()
+    {
+        set_last_error(ERROR_SUCCESS);
+        true
+    } else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        false
+    }
+}
+
+/// Move the streaming window to a world position
+///
+/// Queues the tiles within the radius of the tile containing (`x`, `y`),
+/// nearest first, and drops queued tiles that left the window. Returns
+/// immediately; the tile coordinates of the new center are written to
+/// `tile_x` and `tile_y` if they are not null.
+///
+/// # Safety
+///
+/// - `tile_x` and `tile_y` must each be null or valid for writes
+#[no_mangle]
+pub unsafe extern "C" fn SAdtUpdatePosition(
+    streamer: HANDLE,
+    x: f32,
+    y: f32,
+    tile_x: *mut u32,
+    tile_y: *mut u32,
+) -> bool {
+    let Some(tile_streamer) = lookup_streamer(streamer) else {
+        return false;
+    };
+    let center = tile_streamer.update_position(x, y);
+    if !tile_x.is_null() {
+        *tile_x = center.x;
+    }
+    if !tile_y.is_null() {
+        *tile_y = center.y;
+    }
+    set_last_error(ERROR_SUCCESS);
+    true
+}
+
+/// Get a loaded tile, waiting up to `timeout_ms` for it
+///
+/// A tile that is not loaded yet is moved to the front of the queue.
+/// `timeout_ms` of 0 only checks the cache and `0xFFFFFFFF` waits
+/// indefinitely. Fails with `ERROR_FILE_NOT_FOUND` if the map has no such
+/// tile, `ERROR_TIMEOUT` if it is still loading, and `ERROR_FILE_CORRUPT` if
+/// it could not be read or parsed. Close the handle with `SAdtCloseTile`.
+///
+/// # Safety
+///
+/// - `tile` must be a valid pointer to write the output handle
+#[no_mangle]
+pub unsafe extern "C" fn SAdtGetTile(
+    streamer: HANDLE,
+    tile_x: u32,
+    tile_y: u32,
+    timeout_ms: u32,
+    tile: *mut HANDLE,
+) -> bool {
+    if tile.is_null() {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+    let Some(tile_streamer) = lookup_streamer(streamer) else {
+        return false;
+    };
+    let coord = TileCoord::new(tile_x, tile_y);
+    if !tile_streamer.has_tile(coord) {
+        set_last_error(ERROR_FILE_NOT_FOUND);
+        return false;
+    }
+
+    let timeout = match timeout_ms {
+        u32::MAX => None,
+        ms => Some(Duration::from_millis(u64::from(ms))),
+    };
+    let loaded = match tile_streamer.get(coord) {
+        Some(loaded) => Some(loaded),
+        None => match tile_streamer.wait(coord, timeout) {
+            Ok(loaded) => loaded,
+            Err(_) => {
+                set_last_error(ERROR_FILE_CORRUPT);
+                return false;
+            }
+        },
+    };
+    match loaded {
+        Some(loaded) => {
+            *tile = id_to_handle(TILES.insert(loaded));
+            set_last_error(ERROR_SUCCESS);
+            true
+        }
+        None => {
+            set_last_error(ERROR_TIMEOUT);
+            false
+        }
+    }
+}
+
+/// Release a tile handle returned by `SAdtGetTile`
+#[no_mangle]
+pub extern "C" fn SAdtCloseTile(tile: HANDLE) -> bool {
+    if handle_to_id(tile).and_then(|id| TILES.remove(id)).is_some() {
+        set_last_error(ERROR_SUCCESS);
+        true
+    } else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        false
+    }
+}
+
+/// Get the coordinates, contents and height range of a tile
+///
+/// Counts come from the split files when the tile has them.
+///
+/// # Safety
+///
+/// - `info` must be a valid pointer to an `SADT_TILE_INFO`
+#[no_mangle]
+pub unsafe extern "C" fn SAdtGetTileInfo(tile: HANDLE, info: *mut SADT_TILE_INFO) -> bool {
+    if info.is_null() {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+    let Some(loaded) = lookup_tile(tile) else {
+        return false;
+    };
+    let adt = &loaded.adt;
+
+    let mut flags = 0;
+    if adt.texture.is_some() {
+        flags |= SADT_TILE_HAS_TEX0;
+    }
+    if adt.object.is_some() {
+        flags |= SADT_TILE_HAS_OBJ0;
+    }
+    if adt.lod.is_some() {
+        flags |= SADT_TILE_HAS_LOD;
+    }
+    let texture_count = adt
+        .texture
+        .as_ref()
+        .map_or(adt.root.textures.len(), |tex| tex.textures.len());
+    let (doodad_count, wmo_count) = match &adt.object {
+        Some(obj) => (obj.doodad_placements.len(), obj.wmo_placements.len()),
+        None => (
+            adt.root.doodad_placements.len(),
+            adt.root.wmo_placements.len(),
+        ),
+    };
+
+    let (mut min_height, mut max_height) = (f32::INFINITY, f32::NEG_INFINITY);
+    for chunk in &adt.root.mcnk_chunks {
+        let base = chunk.header.position[0];
+        let heights = chunk.heights.as_ref();
+        let low = heights.and_then(McvtChunk::min_height).unwrap_or(0.0);
+        let high = heights.and_then(McvtChunk::max_height).unwrap_or(0.0);
+        min_height = min_height.min(base + low);
+        max_height = max_height.max(base + high);
+    }
+    if adt.root.mcnk_chunks.is_empty() {
+        (min_height, max_height) = (0.0, 0.0);
+    }
+
+    *info = SADT_TILE_INFO {
+        tile_x: loaded.coord.x,
+        tile_y: loaded.coord.y,
+        flags,
+        chunk_count: adt.root.mcnk_chunks.len() as u32,
+        texture_count: texture_count as u32,
+        doodad_count: doodad_count as u32,
+        wmo_count: wmo_count as u32,
+        file_size: loaded.file_size.min(u32::MAX as usize) as u32,
+        min_height,
+        max_height,
+    };
+    set_last_error(ERROR_SUCCESS);
+    true
+}
+
+/// Copy the absolute terrain heights of a tile
+///
+/// Writes `SADT_CHUNKS_PER_TILE * SADT_HEIGHTS_PER_CHUNK` floats: for each
+/// chunk, in row-major order of its index in the tile, the 145 MCVT heights
+/// in file order (rows of 9 outer and 8 inner vertices alternating) with the
+/// chunk's base height added. Chunks without heights are flat at their base.
+/// With `heights` null or `count` too small, fails with
+/// `ERROR_INSUFFICIENT_BUFFER` and writes the required count to `written`.
+///
+/// # Safety
+///
+/// - `heights` must be null or valid for writes of `count` floats
+/// - `written` must be null or valid for writes
+#[no_mangle]
+pub unsafe extern "C" fn SAdtGetTileHeights(
+    tile: HANDLE,
+    heights: *mut f32,
+    count: u32,
+    written: *mut u32,
+) -> bool {
+    let Some(loaded) = lookup_tile(tile) else {
+        return false;
+    };
+    let needed = SADT_CHUNKS_PER_TILE * SADT_HEIGHTS_PER_CHUNK;
+    if !written.is_null() {
+        *written = needed;
+    }
+    if heights.is_null() || count < needed {
+        set_last_error(ERROR_INSUFFICIENT_BUFFER);
+        return false;
+    }
+
+    let out = std::slice::from_raw_parts_mut(heights, needed as usize);
+    out.fill(0.0);
+    let per_chunk = SADT_HEIGHTS_PER_CHUNK as usize;
+    for (i, chunk) in loaded.adt.root.mcnk_chunks.iter().enumerate() {
+        let (x, y) = (chunk.header.index_x, chunk.header.index_y);
+        let slot = if x < 16 && y < 16 {
+            (y * 16 + x) as usize
+        } else {
+            i
+        };
+        let Some(dst) = out.get_mut(slot * per_chunk..(slot + 1) * per_chunk) else {
+            continue;
+        };
+        let base = chunk.header.position[0];
+        dst.fill(base);
+        if let Some(mcvt) = &chunk.heights {
+            for (dst, height) in dst.iter_mut().zip(&mcvt.heights) {
+                *dst = base + height;
+            }
+        }
+    }
+    set_last_error(ERROR_SUCCESS);
+    true
+}
+
+/// Get the cache and loading counters of a streamer
+///
+/// # Safety
+///
+/// - `stats` must be a valid pointer to an `SADT_STREAMER_STATS`
+#[no_mangle]
+pub unsafe extern "C" fn SAdtGetStreamerStats(
+    streamer: HANDLE,
+    stats: *mut SADT_STREAMER_STATS,
+) -> bool {
+    if stats.is_null() {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+    let Some(tile_streamer) = lookup_streamer(streamer) else {
+        return false;
+    };
+    let counters = tile_streamer.stats();
+    *stats = SADT_STREAMER_STATS {
+        resident_tiles: counters.resident_tiles as u32,
+        pending_tiles: counters.pending_tiles as u32,
+        resident_bytes: counters.resident_bytes as u64,
+        loaded: counters.loaded,
+        evicted: counters.evicted,
+        failed: counters.failed,
+    };
+    set_last_error(ERROR_SUCCESS);
+    true
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::{SFileCloseArchive, SFileGetLastError, SFileOpenArchive};
+    use std::ptr;
+    use wow_adt::AdtBuilder;
+    use wow_mpq::ArchiveBuilder;
+    use wow_wdt::{WdtFile, WdtWriter};
+
+    fn create_wdt(tiles: &[(usize, usize)]) -> Vec<u8> {
+        let mut wdt = WdtFile::new(WowVersion::WotLK);
+        for &(x, y) in tiles {
+            wdt.main.get_mut(x, y).unwrap().set_has_adt(true);
+        }
+        let mut data = Vec::new();
+        WdtWriter::new(&mut data).write(&wdt).unwrap();
+        data
+    }
+
+    fn create_adt() -> Vec<u8> {
+        AdtBuilder::new()
+            .add_texture("tileset\\grass.blp")
+            .build()
+            .unwrap()
+            .to_bytes()
+            .unwrap()
+    }
+
+    #[test]
+    fn test_stream_tiles() {
+        let temp_dir = tempfile::TempDir::new().unwrap();
+        let path = temp_dir.path().join("terrain.mpq");
+        ArchiveBuilder::new()
+            .add_file_data(
+                create_wdt(&[(30, 30), (31, 30)]),
+                "World\\Maps\\Test\\Test.wdt",
+            )
+            .add_file_data(create_adt(), "World\\Maps\\Test\\Test_30_30.adt")
+            .add_file_data(create_adt(), "World\\Maps\\Test\\Test_31_30.adt")
+            .build(&path)
+            .unwrap();
+        let path_c = std::ffi::CString::new(path.to_str().unwrap()).unwrap();
+
+        unsafe {
+            let mut archive = ptr::null_mut();
+            assert!(SFileOpenArchive(path_c.as_ptr(), 0, 0, &mut archive));
+
+            let mut streamer = ptr::null_mut();
+            assert!(SAdtOpenStreamer(
+                archive,
+                c"Test".as_ptr(),
+                1,
+                1 << 20,
+                1,
+                &mut streamer
+            ));
+            assert!(SFileCloseArchive(archive));
+
+            // Tile 30_30 spans world X and Y from ~533 to ~1066
+            let (mut tile_x, mut tile_y) = (0, 0);
+            let world = 32.0 * 533.333_3 - 30.5 * 533.333_3;
+            assert!(SAdtUpdatePosition(
+                streamer,
+                world,
+                world,
+                &mut tile_x,
+                &mut tile_y
+            ));
+            assert_eq!((tile_x, tile_y), (30, 30));
+
+            let mut tile = ptr::null_mut();
+            assert!(SAdtGetTile(streamer, 31, 30, u32::MAX, &mut tile));
+            let mut info: SADT_TILE_INFO = std::mem::zeroed();
+            assert!(SAdtGetTileInfo(tile, &mut info));
+            assert_eq!((info.tile_x, info.tile_y), (31, 30));
+            assert_eq!(info.flags, 0);
+            assert_eq!(info.texture_count, 1);
+            assert!(info.chunk_count > 0);
+
+            let mut needed = 0;
+            assert!(!SAdtGetTileHeights(tile, ptr::null_mut(), 0, &mut needed));
+            assert_eq!(SFileGetLastError(), ERROR_INSUFFICIENT_BUFFER);
+            assert_eq!(needed, 256 * 145);
+            let mut heights = vec![1.0f32; needed as usize];
+            assert!(SAdtGetTileHeights(
+                tile,
+                heights.as_mut_ptr(),
+                needed,
+                &mut needed
+            ));
+
+            // Tiles the WDT does not list are reported missing
+            let mut missing = ptr::null_mut();
+            assert!(!SAdtGetTile(streamer, 0, 0, 0, &mut missing));
+            assert_eq!(SFileGetLastError(), ERROR_FILE_NOT_FOUND);
+
+            // The tile handle outlives the streamer
+            assert!(SAdtCloseStreamer(streamer));
+            assert!(SAdtGetTileInfo(tile, &mut info));
+            assert!(SAdtCloseTile(tile));
+            assert!(!SAdtCloseTile(tile));
+        }
+    }
+}
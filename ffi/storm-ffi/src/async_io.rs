@@ -0,0 +1,221 @@
+//! Background pool for asynchronous file reads
+//!
+//! `SFileReadFileAsync` hands its reads to a [`ReadPool`] instead of decoding
+//! on the caller's thread. A fixed set of worker threads takes jobs from a
+//! shared channel, so reads on different files and archives run in parallel
+//! while the caller keeps submitting. The pool counts jobs that are waiting
+//! for a worker and jobs that are running, which callers can use to tune how
+//! many reads they keep outstanding.
+
+use std::panic::{self, AssertUnwindSafe};
+use std::sync::atomic::{AtomicU64, AtomicUsize, Ordering};
+use std::sync::mpsc::{self, Receiver, Sender};
+use std::sync::{Arc, Condvar, Mutex};
+use std::thread;
+use std::time::Duration;
+
+/// A queued read; returns whether it succeeded
+type Job = Box<dyn FnOnce() -> bool + Send + 'static>;
+
+/// Snapshot of the pool's counters
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub(crate) struct ReadPoolStats {
+    /// Jobs waiting for a worker
+    pub(crate) queued: usize,
+    /// Jobs currently running
+    pub(crate) in_flight: usize,
+    /// Highest number of queued plus running jobs seen
+    pub(crate) peak_pending: usize,
+    /// Number of worker threads
+    pub(crate) threads: usize,
+    /// Jobs that finished successfully
+    pub(crate) completed: u64,
+    /// Jobs that finished with an error
+    pub(crate) failed: u64,
+}
+
+/// State shared between the pool and its workers
+#[derive(Default)]
+struct Shared {
+    queued: AtomicUsize,
+    in_flight: AtomicUsize,
+    peak_pending: AtomicUsize,
+    completed: AtomicU64,
+    failed: AtomicU64,
+    /// Queued plus running jobs, guarded for [`ReadPool::wait_idle`]
+    pending: Mutex<usize>,
+    idle: Condvar,
+}
+
+/// Fixed-size pool of worker threads for file reads
+pub(crate) struct ReadPool {
+    sender: Sender<Job>,
+    shared: Arc<Shared>,
+    threads: usize,
+}
+
+impl ReadPool {
+    /// Start a pool with `threads` workers
+    pub(crate) fn new(threads: usize) -> Self {
+        let threads = threads.max(1);
+        let (sender, receiver) = mpsc::channel::<Job>();
+        let receiver = Arc::new(Mutex::new(receiver));
+        let shared = Arc::new(Shared::default());
+
+        for i in 0..threads {
+            let receiver = Arc::clone(&receiver);
+            let shared = Arc::clone(&shared);
+            thread::Builder::new()
+                .name(format!("storm-io-{i}"))
+                .spawn(move || worker(&receiver, &shared))
+                .expect("failed to spawn I/O worker thread");
+        }
+
+        Self {
+            sender,
+            shared,
+            threads,
+        }
+    }
+
+    /// Default worker count: one per core, between 2 and 8
+    pub(crate) fn default_threads() -> usize {
+        thread::available_parallelism()
+            .map_or(4, |n| n.get())
+            .clamp(2, 8)
+    }
+
+    /// Queue a job
+    pub(crate) fn submit(&self, job: impl FnOnce() -> bool + Send + 'static) {
+        {
+            let mut pending = self.shared.pending.lock().unwrap();
+            *pending += 1;
+            self.shared
+                .peak_pending
+                .fetch_max(*pending, Ordering::Relaxed);
+        }
+        self.shared.queued.fetch_add(1, Ordering::Relaxed);
+
+        // Workers never exit while the pool is alive, so sending cannot fail
+        let _ = self.sender.send(Box::new(job));
+    }
+
+    /// Block until every queued job has finished
+    ///
+    /// Returns false if `timeout` elapsed first.
+    pub(crate) fn wait_idle(&self, timeout: Option<Duration>) -> bool {
+        let pending = self.shared.pending.lock().unwrap();
+        match timeout {
+            None => {
+                let _idle = self.shared.idle.wait_while(pending, |n| *n > 0).unwrap();
+                true
+            }
+            Some(timeout) => {
+                let (_idle, result) = self
+                    .shared
+                    .idle
+                    .wait_timeout_while(pending, timeout, |n| *n > 0)
+                    .unwrap();
+                !result.timed_out()
+            }
+        }
+    }
+
+    /// Current counters
+    pub(crate) fn stats(&self) -> ReadPoolStats {
+        ReadPoolStats {
+            queued: self.shared.queued.load(Ordering::Relaxed),
+            in_flight: self.shared.in_flight.load(Ordering::Relaxed),
+            peak_pending: self.shared.peak_pending.load(Ordering::Relaxed),
+            threads: self.threads,
+            completed: self.shared.completed.load(Ordering::Relaxed),
+            failed: self.shared.failed.load(Ordering::Relaxed),
+        }
+    }
+}
+
+fn worker(receiver: &Mutex<Receiver<Job>>, shared: &Shared) {
+    loop {
+        // Only hold the receiver lock while waiting for the next job
+        let job = match receiver.lock().unwrap().recv() {
+            Ok(job) => job,
+            Err(_) => return,
+        };
+
+        shared.queued.fetch_sub(1, Ordering::Relaxed);
+        shared.in_flight.fetch_add(1, Ordering::Relaxed);
+
+        // A panicking job must not take the worker or the pending count with it
+        let succeeded = panic::catch_unwind(AssertUnwindSafe(job)).unwrap_or(false);
+
+        shared.in_flight.fetch_sub(1, Ordering::Relaxed);
+        if succeeded {
+            shared.completed.fetch_add(1, Ordering::Relaxed);
+        } else {
+            shared.failed.fetch_add(1, Ordering::Relaxed);
+        }
+
+        let mut pending = shared.pending.lock().unwrap();
+        *pending -= 1;
+        if *pending == 0 {
+            shared.idle.notify_all();
+        }
+    }
+}
+
+/// A pointer owned by the C caller, moved to a worker thread
+///
+/// The caller of `SFileReadFileAsync` guarantees the buffer and user data stay
+/// valid until the completion callback has run.
+pub(crate) struct CallerPtr(*mut libc::c_void);
+
+// SAFETY: the pointee is only touched by the single job the pointer was moved
+// into, under the contract above.
+unsafe impl Send for CallerPtr {}
+
+impl CallerPtr {
+    pub(crate) fn new(ptr: *mut libc::c_void) -> Self {
+        Self(ptr)
+    }
+
+    /// The wrapped pointer; a method so closures capture the whole wrapper
+    pub(crate) fn get(&self) -> *mut libc::c_void {
+        self.0
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_pool_counts_and_waits() {
+        let pool = ReadPool::new(2);
+        let gate = Arc::new((Mutex::new(false), Condvar::new()));
+
+        for i in 0..6 {
+            let gate = Arc::clone(&gate);
+            pool.submit(move || {
+                let (open, cvar) = &*gate;
+                let _open = cvar.wait_while(open.lock().unwrap(), |o| !*o).unwrap();
+                i % 3 != 0
+            });
+        }
+
+        // Both workers are blocked on the gate
+        assert!(!pool.wait_idle(Some(Duration::from_millis(20))));
+        let stats = pool.stats();
+        assert_eq!(stats.queued + stats.in_flight, 6);
+        assert!(stats.in_flight <= 2);
+        assert_eq!(stats.peak_pending, 6);
+
+        *gate.0.lock().unwrap() = true;
+        gate.1.notify_all();
+        assert!(pool.wait_idle(None));
+
+        let stats = pool.stats();
+        assert_eq!((stats.queued, stats.in_flight), (0, 0));
+        assert_eq!(stats.completed, 4);
+        assert_eq!(stats.failed, 2);
+    }
+}
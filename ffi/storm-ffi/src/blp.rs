@@ -0,0 +1,411 @@
+//! Batch BLP texture decoding
+//!
+//! `SBlpDecodeBatch` reads a list of textures from an archive or data folder
+//! handle and decodes one mipmap level of each into buffers the caller owns,
+//! spread over a thread pool. Only the selected level is decoded, straight
+//! from the file bytes through [`BlpMipmaps`]: stored files of mapped
+//! archives are not copied at all, and other files are read into a buffer
+//! each worker reuses. DXT levels can be handed back still compressed.
+
+use crate::async_io::CallerPtr;
+use crate::{
+    extract_error_code, handle_to_id, set_last_error, FileSource, ERROR_FILE_CORRUPT,
+    ERROR_INSUFFICIENT_BUFFER, ERROR_INVALID_HANDLE, ERROR_INVALID_PARAMETER,
+    ERROR_NOT_ENOUGH_MEMORY, ERROR_NOT_SUPPORTED, ERROR_SUCCESS, HANDLE,
+};
+use libc::{c_char, c_void};
+use rayon::prelude::*;
+use std::ffi::CStr;
+use std::io::Read;
+use wow_blp::decode::{self, BlpMipmaps, DecodedMipmap, OutputFormat, PixelFormat};
+use wow_blp::DxtnFormat;
+
+/// Copy DXT levels out compressed instead of decoding them to RGBA
+pub const SBLP_DECODE_KEEP_DXT: u32 = 0x01;
+
+/// 8-bit RGBA, `width * height * 4` bytes
+pub const SBLP_FORMAT_RGBA8: u32 = 0;
+/// DXT1 blocks, 8 bytes per 4x4 block
+pub const SBLP_FORMAT_DXT1: u32 = 1;
+/// DXT3 blocks, 16 bytes per 4x4 block
+pub const SBLP_FORMAT_DXT3: u32 = 2;
+/// DXT5 blocks, 16 bytes per 4x4 block
+pub const SBLP_FORMAT_DXT5: u32 = 3;
+
+/// One texture of `SBlpDecodeBatch`
+///
+/// `file_name`, `buffer` and `buffer_size` are set by the caller; the other
+/// fields are filled in by the call.
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct SBLP_DECODE {
+    /// Name of the texture in the archive
+    pub file_name: *const c_char,
+    /// Buffer receiving the decoded level, may be null to query its size
+    pub buffer: *mut c_void,
+    /// Size of `buffer` in bytes
+    pub buffer_size: u32,
+    /// Mipmap level that was decoded
+    pub mip_level: u32,
+    /// Width of that level in pixels
+    pub width: u32,
+    /// Height of that level in pixels
+    pub height: u32,
+    /// One of the `SBLP_FORMAT_*` values
+    pub format: u32,
+    /// Bytes written, or the bytes needed if the buffer is too small
+    pub bytes_written: u32,
+    /// `ERROR_SUCCESS` or why this texture failed
+    pub error: u32,
+}
+
+/// A request with its file name checked, ready to move to a worker
+struct Job<'a> {
+    name: &'a str,
+    buffer: CallerPtr,
+    buffer_size: usize,
+}
+
+/// What happened to one texture
+struct Outcome {
+    error: u32,
+    /// Level, size and format, known once the header was read
+    decoded: Option<DecodedMipmap>,
+}
+
+impl Outcome {
+    fn failed(error: u32) -> Self {
+        Self {
+            error,
+            decoded: None,
+        }
+    }
+}
+
+/// Map a decoding failure to a Windows error code
+fn decode_error_code(error: &decode::Error) -> u32 {
+    match error {
+        decode::Error::ExternalMipmaps => ERROR_NOT_SUPPORTED,
+        decode::Error::BufferTooSmall { .. } => ERROR_INSUFFICIENT_BUFFER,
+        _ => ERROR_FILE_CORRUPT,
+    }
+}
+
+fn format_code(format: PixelFormat) -> u32 {
+    match format {
+        PixelFormat::Rgba8 => SBLP_FORMAT_RGBA8,
+        PixelFormat::Dxtn(DxtnFormat::Dxt1) => SBLP_FORMAT_DXT1,
+        PixelFormat::Dxtn(DxtnFormat::Dxt3) => SBLP_FORMAT_DXT3,
+        PixelFormat::Dxtn(DxtnFormat::Dxt5) => SBLP_FORMAT_DXT5,
+    }
+}
+
+/// Read one texture and decode `level` of it into the job's buffer
+///
+/// Files that are not resident in memory are read into `scratch`, which the
+/// worker keeps between textures.
+fn decode_texture(
+    source: &FileSource,
+    job: Job<'_>,
+    level: usize,
+    format: OutputFormat,
+    scratch: &mut Vec<u8>,
+) -> Outcome {
+    let mut stream = match source.open_file_stream(job.name) {
+        Ok(stream) => stream,
+        Err(e) => return Outcome::failed(extract_error_code(e)),
+    };
+    if stream.as_slice().is_none() {
+        scratch.clear();
+        if stream.read_to_end(scratch).is_err() {
+            return Outcome::failed(ERROR_FILE_CORRUPT);
+        }
+    }
+    let data = stream.as_slice().unwrap_or(scratch.as_slice());
+
+    let mipmaps = match BlpMipmaps::new(data) {
+        Ok(mipmaps) => mipmaps,
+        Err(e) => return Outcome::failed(decode_error_code(&e)),
+    };
+    let level = mipmaps.select_level(level);
+    let (width, height) = mipmaps.level_size(level);
+    let needed = mipmaps.output_size(level, format);
+    if job.buffer.get().is_null() || job.buffer_size < needed {
+        return Outcome {
+            error: ERROR_INSUFFICIENT_BUFFER,
+            decoded: Some(DecodedMipmap {
+                level,
+                width,
+                height,
+                format: mipmaps.pixel_format(format),
+                len: needed,
+            }),
+        };
+    }
+
+    // SAFETY: the caller guarantees `buffer` holds `buffer_size` bytes, and
+    // each buffer belongs to this job alone
+    let out =
+        unsafe { std::slice::from_raw_parts_mut(job.buffer.get() as *mut u8, job.buffer_size) };
+    match mipmaps.decode_into(level, format, out) {
+        Ok(decoded) => Outcome {
+            error: ERROR_SUCCESS,
+            decoded: Some(decoded),
+        },
+        Err(e) => Outcome::failed(decode_error_code(&e)),
+    }
+}
+
+/// Decode one mipmap level of many BLP textures in parallel
+///
+/// `requests` points to `count` entries naming the textures and the buffers
+/// to decode them into. Each texture is decoded at `mip_level`, or at its
+/// smallest stored mipmap if it has fewer levels; the other levels are
+/// skipped. Levels are written as 8-bit RGBA unless `flags` has
+/// `SBLP_DECODE_KEEP_DXT`, which copies DXT blocks out unchanged.
+///
+/// Textures are spread over `thread_count` workers (0 uses one worker per
+/// CPU) and every entry is attempted even if an earlier one fails; each
+/// entry's `error` tells how it went. An entry whose buffer is null or too
+/// small gets `ERROR_INSUFFICIENT_BUFFER`, with the dimensions, format and
+/// `bytes_written` set to what the level needs, so a first pass with null
+/// buffers sizes the outputs.
+///
+/// Returns true only if every texture was decoded. On failure the last error
+/// is that of the first failing entry.
+///
+/// # Safety
+///
+/// - `requests` must point to `count` valid entries
+/// - Each `file_name` must be a valid null-terminated C string
+/// - Each non-null `buffer` must be valid for writes of `buffer_size` bytes
+///   and must not overlap another entry's buffer
+#[no_mangle]
+pub unsafe extern "C" fn SBlpDecodeBatch(
+    archive: HANDLE,
+    requests: *mut SBLP_DECODE,
+    count: u32,
+    mip_level: u32,
+    flags: u32,
+    thread_count: u32,
+) -> bool {
+    if count > 0 && requests.is_null() {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+
+    let Some(archive_id) = handle_to_id(archive) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
+    };
+
+    let requests: &mut [SBLP_DECODE] = if count == 0 {
+        &mut []
+    } else {
+        std::slice::from_raw_parts_mut(requests, count as usize)
+    };
+
+    let mut jobs = Vec::with_capacity(requests.len());
+    for request in requests.iter() {
+        if request.file_name.is_null() {
+            set_last_error(ERROR_INVALID_PARAMETER);
+            return false;
+        }
+        let Ok(name) = CStr::from_ptr(request.file_name).to_str() else {
+            set_last_error(ERROR_INVALID_PARAMETER);
+            return false;
+        };
+        jobs.push(Job {
+            name,
+            buffer: CallerPtr::new(request.buffer),
+            buffer_size: request.buffer_size as usize,
+        });
+    }
+
+    let Some(source) = FileSource::lookup(archive_id) else {
+        return false;
+    };
+
+    let format = if flags & SBLP_DECODE_KEEP_DXT != 0 {
+        OutputFormat::KeepDxtn
+    } else {
+        OutputFormat::Rgba8
+    };
+    let level = mip_level as usize;
+    let run = || -> Vec<Outcome> {
+        jobs.into_par_iter()
+            .map_init(Vec::new, |scratch, job| {
+                decode_texture(&source, job, level, format, scratch)
+            })
+            .collect()
+    };
+    let outcomes = if thread_count == 0 {
+        run()
+    } else {
+        match rayon::ThreadPoolBuilder::new()
+            .num_threads(thread_count as usize)
+            .build()
+        {
+            Ok(pool) => pool.install(run),
+            Err(_) => {
+                set_last_error(ERROR_NOT_ENOUGH_MEMORY);
+                return false;
+            }
+        }
+    };
+
+    let mut first_error = None;
+    for (request, outcome) in requests.iter_mut().zip(outcomes) {
+        request.error = outcome.error;
+        if let Some(decoded) = outcome.decoded {
+            request.mip_level = decoded.level as u32;
+            request.width = decoded.width;
+            request.height = decoded.height;
+            request.format = format_code(decoded.format);
+            request.bytes_written = u32::try_from(decoded.len).unwrap_or(u32::MAX);
+        } else {
+            request.mip_level = 0;
+            request.width = 0;
+            request.height = 0;
+            request.format = SBLP_FORMAT_RGBA8;
+            request.bytes_written = 0;
+        }
+        if outcome.error != ERROR_SUCCESS && first_error.is_none() {
+            first_error = Some(outcome.error);
+        }
+    }
+
+    match first_error {
+        Some(error_code) => {
+            set_last_error(error_code);
+            false
+        }
+        None => {
+            set_last_error(ERROR_SUCCESS);
+            true
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::{SFileCloseArchive, SFileOpenArchive, ERROR_FILE_NOT_FOUND};
+    use std::ptr;
+    use wow_mpq::ArchiveBuilder;
+
+    /// DXT1 block of a single 565 color
+    fn solid_block(color: u16) -> [u8; 8] {
+        let mut block = [0u8; 8];
+        block[0..2].copy_from_slice(&color.to_le_bytes());
+        block
+    }
+
+    /// 8x8 DXT1 texture with a different solid color on each of its 4 levels
+    fn create_blp() -> Vec<u8> {
+        let levels: [&[u8]; 4] = [
+            &solid_block(0xFFFF).repeat(4),
+            &solid_block(0xF800),
+            &solid_block(0x07E0),
+            &solid_block(0x001F),
+        ];
+
+        let mut data = b"BLP2".to_vec();
+        data.extend_from_slice(&1u32.to_le_bytes()); // direct content
+        data.extend_from_slice(&[2, 0, 0, 1]); // DXTC, no alpha, has mipmaps
+        data.extend_from_slice(&8u32.to_le_bytes());
+        data.extend_from_slice(&8u32.to_le_bytes());
+        let mut offset = 148 + 256 * 4;
+        let (mut offsets, mut sizes) = (vec![0u32; 16], vec![0u32; 16]);
+        for (i, level) in levels.iter().enumerate() {
+            offsets[i] = offset as u32;
+            sizes[i] = level.len() as u32;
+            offset += level.len();
+        }
+        for value in offsets.iter().chain(&sizes) {
+            data.extend_from_slice(&value.to_le_bytes());
+        }
+        data.extend_from_slice(&[0; 256 * 4]);
+        for level in levels {
+            data.extend_from_slice(level);
+        }
+        data
+    }
+
+    fn request(file_name: &CStr, buffer: &mut [u8]) -> SBLP_DECODE {
+        SBLP_DECODE {
+            file_name: file_name.as_ptr(),
+            buffer: buffer.as_mut_ptr() as *mut c_void,
+            buffer_size: buffer.len() as u32,
+            mip_level: 0,
+            width: 0,
+            height: 0,
+            format: 0,
+            bytes_written: 0,
+            error: 0,
+        }
+    }
+
+    #[test]
+    fn test_decode_batch() {
+        let temp_dir = tempfile::TempDir::new().unwrap();
+        let path = temp_dir.path().join("textures.mpq");
+        ArchiveBuilder::new()
+            .add_file_data(create_blp(), "Textures\\a.blp")
+            .add_file_data(create_blp(), "Textures\\b.blp")
+            .build(&path)
+            .unwrap();
+        let path_c = std::ffi::CString::new(path.to_str().unwrap()).unwrap();
+
+        unsafe {
+            let mut archive = ptr::null_mut();
+            assert!(SFileOpenArchive(path_c.as_ptr(), 0, 0, &mut archive));
+
+            // Level 1 is 4x4 red
+            let mut first = vec![0u8; 4 * 4 * 4];
+            let mut second = vec![0u8; 4 * 4 * 4];
+            let mut requests = [
+                request(c"Textures\\a.blp", &mut first),
+                request(c"Textures\\b.blp", &mut second),
+            ];
+            assert!(SBlpDecodeBatch(archive, requests.as_mut_ptr(), 2, 1, 0, 2));
+            for request in &requests {
+                assert_eq!(request.error, ERROR_SUCCESS);
+                assert_eq!((request.width, request.height), (4, 4));
+                assert_eq!(request.format, SBLP_FORMAT_RGBA8);
+                assert_eq!(request.bytes_written, 64);
+            }
+            assert!(first.chunks(4).all(|pixel| pixel == [255, 0, 0, 255]));
+            assert_eq!(first, second);
+
+            // Levels past the last select the 1x1 blue mipmap
+            let mut blocks = vec![0u8; 8];
+            let mut requests = [request(c"Textures\\b.blp", &mut blocks)];
+            assert!(SBlpDecodeBatch(
+                archive,
+                requests.as_mut_ptr(),
+                1,
+                10,
+                SBLP_DECODE_KEEP_DXT,
+                0
+            ));
+            assert_eq!(requests[0].mip_level, 3);
+            assert_eq!(requests[0].format, SBLP_FORMAT_DXT1);
+            assert_eq!(blocks, solid_block(0x001F));
+
+            // A null buffer reports the size needed; a missing file fails alone
+            let mut requests = [
+                request(c"Textures\\missing.blp", &mut []),
+                request(c"Textures\\a.blp", &mut []),
+            ];
+            requests[1].buffer = ptr::null_mut();
+            assert!(!SBlpDecodeBatch(archive, requests.as_mut_ptr(), 2, 0, 0, 0));
+            assert_eq!(crate::SFileGetLastError(), ERROR_FILE_NOT_FOUND);
+            assert_eq!(requests[0].error, ERROR_FILE_NOT_FOUND);
+            assert_eq!(requests[1].error, ERROR_INSUFFICIENT_BUFFER);
+            assert_eq!(requests[1].bytes_written, 8 * 8 * 4);
+
+            assert!(SFileCloseArchive(archive));
+        }
+    }
+}
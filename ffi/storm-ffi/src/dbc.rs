@@ -0,0 +1,478 @@
+//! Zero-copy C API for DBC and DB2 tables
+//!
+//! A table is opened from a path, which memory-maps the file, or from a file
+//! handle returned by `SFileOpenFileEx`. Stored files of mapped archives are
+//! borrowed straight from the archive mapping and other files are decoded
+//! once into a buffer the table owns. Either way records, fields and strings
+//! are read in place through [`DbcView`], and the pointers handed out stay
+//! valid until `SDbcClose`. An ID index is built when the table is opened, so
+//! `SDbcFindRecord` is a single array or hash lookup.
+//!
+//! Tables are immutable once opened and need no lock; the getters only look
+//! the handle up.
+
+use crate::handles::HandleTable;
+use crate::{
+    handle_to_id, id_to_handle, set_last_error, stats, ERROR_FILE_CORRUPT, ERROR_FILE_NOT_FOUND,
+    ERROR_INVALID_HANDLE, ERROR_INVALID_PARAMETER, ERROR_NOT_SUPPORTED, ERROR_SUCCESS, FILES,
+    HANDLE,
+};
+use libc::{c_char, c_void};
+use std::ffi::CStr;
+use std::io::Read;
+use std::ptr;
+use std::sync::{Arc, LazyLock};
+use wow_cdbc::{DbcLayout, DbcView, IdIndex, MmapDbcFile};
+use wow_mpq::FileStream;
+
+// Tables opened with SDbcOpen and SDbcOpenFromFile
+static TABLES: LazyLock<HandleTable<DbcTable>> = LazyLock::new(HandleTable::new);
+
+/// Key field value that skips building the ID index
+pub const SDBC_NO_KEY: u32 = 0xFFFF_FFFF;
+
+/// Where a table's bytes live
+enum DbcData {
+    /// A memory-mapped file on disk
+    Mapped(MmapDbcFile),
+    /// A file stream whose contents are resident (stored in a mapped
+    /// archive, or decoded in full when it was opened)
+    Stream(FileStream),
+    /// Contents decoded from a compressed archive file
+    Owned(Vec<u8>),
+}
+
+impl DbcData {
+    fn bytes(&self) -> &[u8] {
+        match self {
+            DbcData::Mapped(file) => file.as_slice(),
+            DbcData::Stream(stream) => stream.as_slice().unwrap_or_default(),
+            DbcData::Owned(data) => data,
+        }
+    }
+}
+
+struct DbcTable {
+    data: DbcData,
+    layout: DbcLayout,
+    index: Option<IdIndex>,
+}
+
+impl DbcTable {
+    fn view(&self) -> DbcView<'_> {
+        // The layout was checked against these bytes when the table was opened
+        DbcView::with_layout(self.data.bytes(), self.layout).unwrap()
+    }
+}
+
+/// Table properties and pointers into its data, see `SDbcGetInfo`
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct SDBC_INFO {
+    /// File signature (`WDBC`, `WDB2`, ...) as it appears in the file
+    pub magic: [u8; 4],
+    /// Number of records
+    pub record_count: u32,
+    /// Number of fields per record
+    pub field_count: u32,
+    /// Size of each record in bytes, the stride between records
+    pub record_size: u32,
+    /// Size of the string block in bytes
+    pub string_block_size: u32,
+    /// Distinct IDs in the ID index, 0 if the table was opened without one
+    pub indexed_ids: u32,
+    /// First record, `record_count * record_size` bytes
+    pub records: *const c_void,
+    /// Start of the string block; string fields are offsets into it
+    pub string_block: *const c_char,
+}
+
+/// Check the table in `data`, index it by `key_field` and write its handle
+unsafe fn insert_table(data: DbcData, key_field: u32, handle: *mut HANDLE) -> bool {
+    let Ok(view) = DbcView::new(data.bytes()) else {
+        set_last_error(ERROR_FILE_CORRUPT);
+        return false;
+    };
+    let index = if key_field == SDBC_NO_KEY {
+        None
+    } else {
+        match IdIndex::build(&view, key_field) {
+            Ok(index) => Some(index),
+            Err(_) => {
+                set_last_error(ERROR_INVALID_PARAMETER);
+                return false;
+            }
+        }
+    };
+
+    let table = DbcTable {
+        layout: *view.layout(),
+        data,
+        index,
+    };
+    *handle = id_to_handle(TABLES.insert(table));
+    set_last_error(ERROR_SUCCESS);
+    true
+}
+
+/// Look up a table handle, setting the last error if it is invalid
+fn lookup_table(dbc: HANDLE) -> Option<Arc<DbcTable>> {
+    let table = handle_to_id(dbc).and_then(|id| TABLES.get(id));
+    if table.is_none() {
+        set_last_error(ERROR_INVALID_HANDLE);
+    }
+    table
+}
+
+/// Open a DBC or DB2 file from disk
+///
+/// The file is memory-mapped and read in place. With `key_field` other than
+/// `SDBC_NO_KEY`, an index from the value of that 32-bit column (usually 0,
+/// the ID) to the row is built for `SDbcFindRecord`.
+///
+/// # Safety
+///
+/// - `path` must be a valid null-terminated C string
+/// - `dbc` must be a valid pointer to write the output handle
+#[no_mangle]
+pub unsafe extern "C" fn SDbcOpen(path: *const c_char, key_field: u32, dbc: *mut HANDLE) -> bool {
+    if path.is_null() || dbc.is_null() {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+    let Ok(path) = CStr::from_ptr(path).to_str() else {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    };
+
+    match MmapDbcFile::open(path) {
+        Ok(file) => insert_table(DbcData::Mapped(file), key_field, dbc),
+        Err(wow_cdbc::Error::Io(ref io)) if io.kind() == std::io::ErrorKind::NotFound => {
+            set_last_error(ERROR_FILE_NOT_FOUND);
+            false
+        }
+        Err(_) => {
+            set_last_error(ERROR_FILE_CORRUPT);
+            false
+        }
+    }
+}
+
+/// Open a DBC or DB2 file from a file opened with `SFileOpenFileEx`
+///
+/// Stored files in archives opened with `BASE_PROVIDER_MAP` are read in
+/// place from the archive mapping; other files are decoded once into memory
+/// owned by the table. The table does not depend on `file` afterwards, which
+/// can be closed. `key_field` is as for `SDbcOpen`.
+///
+/// # Safety
+///
+/// - `dbc` must be a valid pointer to write the output handle
+#[no_mangle]
+pub unsafe extern "C" fn SDbcOpenFromFile(file: HANDLE, key_field: u32, dbc: *mut HANDLE) -> bool {
+    if dbc.is_null() {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+    let Some(file_lock) = handle_to_id(file).and_then(|id| FILES.get(id)) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
+    };
+
+    // An independent stream reads from the start without moving the
+    // caller's file position
+    let stream = stats::lock(&file_lock.file).stream.try_clone();
+    let data = match stream {
+        Ok(stream) if stream.as_slice().is_some() => DbcData::Stream(stream),
+        Ok(mut stream) => {
+            let mut data = Vec::with_capacity(stream.len() as usize);
+            if stream.read_to_end(&mut data).is_err() {
+                set_last_error(ERROR_FILE_CORRUPT);
+                return false;
+            }
+            DbcData::Owned(data)
+        }
+        Err(_) => {
+            set_last_error(ERROR_FILE_CORRUPT);
+            return false;
+        }
+    };
+    insert_table(data, key_field, dbc)
+}
+
+/// Close a table opened with `SDbcOpen` or `SDbcOpenFromFile`
+///
+/// Pointers returned for the table are invalid afterwards.
+#[no_mangle]
+pub extern "C" fn SDbcClose(dbc: HANDLE) -> bool {
+    if handle_to_id(dbc).and_then(|id| TABLES.remove(id)).is_some() {
+        set_last_error(ERROR_SUCCESS);
+        true
+    } else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        false
+    }
+}
+
+/// Get a table's record count, stride and pointers to its records and strings
+///
+/// C callers can walk the records directly from `records`, `record_size`
+/// bytes apart, without further calls. Records in WDB2 files may not be
+/// 4-byte aligned.
+///
+/// # Safety
+///
+/// - `info` must be a valid pointer to an `SDBC_INFO`
+#[no_mangle]
+pub unsafe extern "C" fn SDbcGetInfo(dbc: HANDLE, info: *mut SDBC_INFO) -> bool {
+    if info.is_null() {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+    let Some(table) = lookup_table(dbc) else {
+        return false;
+    };
+
+    let view = table.view();
+    let layout = view.layout();
+    *info = SDBC_INFO {
+        magic: layout.version.magic(),
+        record_count: layout.record_count,
+        field_count: layout.field_count,
+        record_size: layout.record_size,
+        string_block_size: layout.string_block_size,
+        indexed_ids: table.index.as_ref().map_or(0, |index| index.len() as u32),
+        records: view.records().as_ptr() as *const c_void,
+        string_block: view.string_block().as_ptr() as *const c_char,
+    };
+    set_last_error(ERROR_SUCCESS);
+    true
+}
+
+/// Get a pointer to the record at `row`, or null if `row` is out of range
+#[no_mangle]
+pub extern "C" fn SDbcGetRecord(dbc: HANDLE, row: u32) -> *const c_void {
+    let Some(table) = lookup_table(dbc) else {
+        return ptr::null();
+    };
+    match table.view().record(row) {
+        Some(record) => record.as_ptr() as *const c_void,
+        None => {
+            set_last_error(ERROR_INVALID_PARAMETER);
+            ptr::null()
+        }
+    }
+}
+
+/// Find the row of the record with `id` through the ID index
+///
+/// Fails with `ERROR_FILE_NOT_FOUND` if no record has the ID, and with
+/// `ERROR_NOT_SUPPORTED` if the table was opened with `SDBC_NO_KEY`.
+///
+/// # Safety
+///
+/// - `row` must be a valid pointer to write the row
+#[no_mangle]
+pub unsafe extern "C" fn SDbcFindRecord(dbc: HANDLE, id: u32, row: *mut u32) -> bool {
+    if row.is_null() {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+    let Some(table) = lookup_table(dbc) else {
+        return false;
+    };
+    let Some(index) = &table.index else {
+        set_last_error(ERROR_NOT_SUPPORTED);
+        return false;
+    };
+    match index.get(id) {
+        Some(found) => {
+            *row = found;
+            set_last_error(ERROR_SUCCESS);
+            true
+        }
+        None => {
+            set_last_error(ERROR_FILE_NOT_FOUND);
+            false
+        }
+    }
+}
+
+/// Read a 32-bit column, setting the last error if `row` or `field` is out of range
+fn read_field(dbc: HANDLE, row: u32, field: u32) -> Option<u32> {
+    let value = lookup_table(dbc)?.view().get_u32(row, field);
+    if value.is_none() {
+        set_last_error(ERROR_INVALID_PARAMETER);
+    }
+    value
+}
+
+/// Read the 32-bit column `field` of the record at `row` as unsigned
+///
+/// Returns 0 and sets the last error if the handle, row or field is invalid.
+#[no_mangle]
+pub extern "C" fn SDbcGetUInt32(dbc: HANDLE, row: u32, field: u32) -> u32 {
+    read_field(dbc, row, field).unwrap_or(0)
+}
+
+/// Read the 32-bit column `field` of the record at `row` as signed
+///
+/// Returns 0 and sets the last error if the handle, row or field is invalid.
+#[no_mangle]
+pub extern "C" fn SDbcGetInt32(dbc: HANDLE, row: u32, field: u32) -> i32 {
+    read_field(dbc, row, field).map_or(0, |value| value as i32)
+}
+
+/// Read the 32-bit column `field` of the record at `row` as a float
+///
+/// Returns 0.0 and sets the last error if the handle, row or field is invalid.
+#[no_mangle]
+pub extern "C" fn SDbcGetFloat(dbc: HANDLE, row: u32, field: u32) -> f32 {
+    read_field(dbc, row, field).map_or(0.0, f32::from_bits)
+}
+
+/// Get the NUL-terminated string referenced by column `field` of the record at `row`
+///
+/// The pointer points into the table's string block. Returns null and sets
+/// the last error if the handle, row or field is invalid or the offset lies
+/// outside the string block.
+#[no_mangle]
+pub extern "C" fn SDbcGetString(dbc: HANDLE, row: u32, field: u32) -> *const c_char {
+    let Some(table) = lookup_table(dbc) else {
+        return ptr::null();
+    };
+    let view = table.view();
+    let strings = view.string_block();
+    match view.get_u32(row, field) {
+        // Strings are NUL-terminated in the block; a final string without
+        // one is not handed out
+        Some(offset)
+            if strings
+                .get(offset as usize..)
+                .is_some_and(|tail| tail.contains(&0)) =>
+        {
+            strings[offset as usize..].as_ptr() as *const c_char
+        }
+        _ => {
+            set_last_error(ERROR_INVALID_PARAMETER);
+            ptr::null()
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::{
+        SFileCloseArchive, SFileCloseFile, SFileGetLastError, SFileOpenArchive, SFileOpenFileEx,
+    };
+    use wow_mpq::ArchiveBuilder;
+
+    fn create_dbc() -> Vec<u8> {
+        let strings = b"\0Fireball\0Frostbolt\0";
+        let mut data = Vec::new();
+        data.extend_from_slice(b"WDBC");
+        data.extend_from_slice(&2u32.to_le_bytes());
+        data.extend_from_slice(&3u32.to_le_bytes());
+        data.extend_from_slice(&12u32.to_le_bytes());
+        data.extend_from_slice(&(strings.len() as u32).to_le_bytes());
+        for (id, name, speed) in [(133u32, 1u32, 1.5f32), (116, 10, -2.0)] {
+            data.extend_from_slice(&id.to_le_bytes());
+            data.extend_from_slice(&name.to_le_bytes());
+            data.extend_from_slice(&speed.to_bits().to_le_bytes());
+        }
+        data.extend_from_slice(strings);
+        data
+    }
+
+    unsafe fn check_table(dbc: HANDLE) {
+        let mut info = std::mem::zeroed::<SDBC_INFO>();
+        assert!(SDbcGetInfo(dbc, &mut info));
+        assert_eq!(&info.magic, b"WDBC");
+        assert_eq!(info.record_count, 2);
+        assert_eq!(info.record_size, 12);
+        assert_eq!(info.indexed_ids, 2);
+        assert_eq!(SDbcGetRecord(dbc, 1), info.records.add(12));
+
+        let mut row = u32::MAX;
+        assert!(SDbcFindRecord(dbc, 116, &mut row));
+        assert_eq!(row, 1);
+        assert!(!SDbcFindRecord(dbc, 117, &mut row));
+        assert_eq!(SFileGetLastError(), ERROR_FILE_NOT_FOUND);
+
+        assert_eq!(SDbcGetUInt32(dbc, 0, 0), 133);
+        assert_eq!(SDbcGetFloat(dbc, 0, 2), 1.5);
+        assert_eq!(SDbcGetInt32(dbc, 1, 2), (-2.0f32).to_bits() as i32);
+        assert_eq!(
+            CStr::from_ptr(SDbcGetString(dbc, row, 1)).to_bytes(),
+            b"Frostbolt"
+        );
+        assert_eq!(SDbcGetString(dbc, 0, 1), info.string_block.add(1));
+
+        assert_eq!(SDbcGetUInt32(dbc, 2, 0), 0);
+        assert_eq!(SFileGetLastError(), ERROR_INVALID_PARAMETER);
+        assert!(SDbcGetRecord(dbc, 2).is_null());
+        assert!(SDbcGetString(dbc, 0, 3).is_null());
+    }
+
+    #[test]
+    fn test_open_from_path() {
+        let temp_dir = tempfile::TempDir::new().unwrap();
+        let path = temp_dir.path().join("Spell.dbc");
+        std::fs::write(&path, create_dbc()).unwrap();
+        let path_c = std::ffi::CString::new(path.to_str().unwrap()).unwrap();
+
+        unsafe {
+            let mut dbc = ptr::null_mut();
+            assert!(SDbcOpen(path_c.as_ptr(), 0, &mut dbc));
+            check_table(dbc);
+            assert!(SDbcClose(dbc));
+            assert!(!SDbcClose(dbc));
+            assert_eq!(SDbcGetUInt32(dbc, 0, 0), 0);
+            assert_eq!(SFileGetLastError(), ERROR_INVALID_HANDLE);
+
+            // The key field has to lie inside the records
+            assert!(!SDbcOpen(path_c.as_ptr(), 3, &mut dbc));
+            assert_eq!(SFileGetLastError(), ERROR_INVALID_PARAMETER);
+
+            assert!(SDbcOpen(path_c.as_ptr(), SDBC_NO_KEY, &mut dbc));
+            let mut row = 0;
+            assert!(!SDbcFindRecord(dbc, 133, &mut row));
+            assert!(SDbcClose(dbc));
+
+            assert!(!SDbcOpen(c"does-not-exist.dbc".as_ptr(), 0, &mut dbc));
+            assert_eq!(SFileGetLastError(), ERROR_FILE_NOT_FOUND);
+        }
+    }
+
+    #[test]
+    fn test_open_from_archive_file() {
+        let temp_dir = tempfile::TempDir::new().unwrap();
+        let path = temp_dir.path().join("dbc.mpq");
+        ArchiveBuilder::new()
+            .add_file_data(create_dbc(), "DBFilesClient\\Spell.dbc")
+            .build(&path)
+            .unwrap();
+        let path_c = std::ffi::CString::new(path.to_str().unwrap()).unwrap();
+
+        unsafe {
+            let mut archive = ptr::null_mut();
+            assert!(SFileOpenArchive(path_c.as_ptr(), 0, 0, &mut archive));
+            let mut file = ptr::null_mut();
+            assert!(SFileOpenFileEx(
+                archive,
+                c"DBFilesClient\\Spell.dbc".as_ptr(),
+                0,
+                &mut file
+            ));
+
+            let mut dbc = ptr::null_mut();
+            assert!(SDbcOpenFromFile(file, 0, &mut dbc));
+            // The table outlives the file and archive handles
+            assert!(SFileCloseFile(file));
+            assert!(SFileCloseArchive(archive));
+            check_table(dbc);
+            assert!(SDbcClose(dbc));
+        }
+    }
+}
@@ -0,0 +1,123 @@
+//! Concurrent handle registry
+//!
+//! Handles returned to C callers are small integers allocated from a single
+//! atomic counter, so an ID is unique across archives, files and find handles.
+//! Each [`HandleTable`] spreads its entries over a fixed number of shards so
+//! that lookups on unrelated handles do not contend on one lock. Entries are
+//! stored behind an [`Arc`], which lets callers drop the shard lock before
+//! doing any real work and keeps an object alive until the last in-flight
+//! call using it has finished, even if the handle is closed concurrently.
+//! Time spent waiting for a shard lock is added to the lock-wait counters
+//! reported by `SFileGetStatistics`.
+
+use crate::stats;
+use std::collections::HashMap;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::{Arc, RwLock};
+
+/// Number of shards per table (power of two)
+const SHARD_COUNT: usize = 32;
+
+/// Next handle ID; 0 is never issued since it maps to a null handle
+static NEXT_HANDLE: AtomicUsize = AtomicUsize::new(1);
+
+/// Allocate a new, process-wide unique handle ID
+fn next_handle_id() -> usize {
+    NEXT_HANDLE.fetch_add(1, Ordering::Relaxed)
+}
+
+/// A sharded map from handle ID to a shared object
+pub(crate) struct HandleTable<T> {
+    shards: Vec<RwLock<HashMap<usize, Arc<T>>>>,
+}
+
+impl<T> HandleTable<T> {
+    /// Create an empty table
+    pub(crate) fn new() -> Self {
+        Self {
+            shards: (0..SHARD_COUNT)
+                .map(|_| RwLock::new(HashMap::new()))
+                .collect(),
+        }
+    }
+
+    fn shard(&self, id: usize) -> &RwLock<HashMap<usize, Arc<T>>> {
+        &self.shards[id & (SHARD_COUNT - 1)]
+    }
+
+    /// Store `value` under a newly allocated handle ID and return the ID
+    pub(crate) fn insert(&self, value: T) -> usize {
+        let id = next_handle_id();
+        stats::write(self.shard(id)).insert(id, Arc::new(value));
+        id
+    }
+
+    /// Look up a handle
+    pub(crate) fn get(&self, id: usize) -> Option<Arc<T>> {
+        stats::read(self.shard(id)).get(&id).cloned()
+    }
+
+    /// Remove a handle, returning its object if it existed
+    pub(crate) fn remove(&self, id: usize) -> Option<Arc<T>> {
+        stats::write(self.shard(id)).remove(&id)
+    }
+
+    /// Remove every entry for which `keep` returns false
+    pub(crate) fn retain(&self, mut keep: impl FnMut(&T) -> bool) {
+        for shard in &self.shards {
+            stats::write(shard).retain(|_, value| keep(value));
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::thread;
+
+    #[test]
+    fn test_insert_get_remove() {
+        let table = HandleTable::new();
+        let a = table.insert("a");
+        let b = table.insert("b");
+        assert_ne!(a, b);
+        assert_ne!(a, 0);
+
+        assert_eq!(table.get(a).as_deref(), Some(&"a"));
+        assert_eq!(table.remove(a).as_deref(), Some(&"a"));
+        assert!(table.get(a).is_none());
+        assert!(table.remove(a).is_none());
+        assert_eq!(table.get(b).as_deref(), Some(&"b"));
+    }
+
+    #[test]
+    fn test_retain() {
+        let table = HandleTable::new();
+        let ids: Vec<usize> = (0..100).map(|i| table.insert(i)).collect();
+        table.retain(|value| value % 2 == 0);
+
+        for (i, id) in ids.iter().enumerate() {
+            assert_eq!(table.get(*id).is_some(), i % 2 == 0);
+        }
+    }
+
+    #[test]
+    fn test_concurrent_inserts_are_unique() {
+        let table = Arc::new(HandleTable::new());
+        let handles: Vec<_> = (0..8)
+            .map(|_| {
+                let table = Arc::clone(&table);
+                thread::spawn(move || (0..1000).map(|i| table.insert(i)).collect::<Vec<_>>())
+            })
+            .collect();
+
+        let mut ids: Vec<usize> = handles
+            .into_iter()
+            .flat_map(|h| h.join().unwrap())
+            .collect();
+        let count = ids.len();
+        ids.sort_unstable();
+        ids.dedup();
+        assert_eq!(ids.len(), count);
+    }
+}
@@ -5,13 +5,21 @@ use std::cell::RefCell;
 use std::collections::HashMap;
 use std::ffi::{CStr, CString};
 use std::fs;
+use std::io::Read;
 use std::path::Path;
 use std::ptr;
-use std::sync::{LazyLock, Mutex};
+use std::sync::atomic::Ordering;
+use std::sync::{Arc, Condvar, LazyLock, Mutex, RwLock};
 
+use wow_mpq::single_archive_parallel::{extract_archive_to_disk, ParallelConfig};
+use wow_mpq::verify::verify_file;
+#[cfg(feature = "mmap")]
+use wow_mpq::SharedIndex;
 use wow_mpq::{
-    AddFileOptions, Archive, ArchiveBuilder, AttributesOption, FileEntry, FormatVersion,
-    ListfileOption, MutableArchive,
+    verify_files, AddFileOptions, Archive, ArchiveBuilder, AttributesOption, CompactPhase,
+    DataFolder, FailedFile, FileEntry, FileMetadata, FileStream, FileVerification, FormatVersion,
+    Glob, IndexCache, ListfileOption, MutableArchive, NameIndex, OpenOptions, PatchChain,
+    SectorCache, VerifyFailure, VerifyOptions,
 };
 
 /// Archive handle type
@@ -20,14 +28,47 @@ pub type HANDLE = *mut c_void;
 /// Invalid handle value
 pub const INVALID_HANDLE_VALUE: HANDLE = ptr::null_mut();
 
-// Thread-safe handle management with lazy initialization
-static NEXT_HANDLE: LazyLock<Mutex<usize>> = LazyLock::new(|| Mutex::new(1));
-static ARCHIVES: LazyLock<Mutex<HashMap<usize, ArchiveHandle>>> =
-    LazyLock::new(|| Mutex::new(HashMap::new()));
-static FILES: LazyLock<Mutex<HashMap<usize, FileHandle>>> =
-    LazyLock::new(|| Mutex::new(HashMap::new()));
-static FIND_HANDLES: LazyLock<Mutex<HashMap<usize, FindHandle>>> =
-    LazyLock::new(|| Mutex::new(HashMap::new()));
+mod adt;
+mod async_io;
+mod blp;
+mod dbc;
+mod handles;
+mod stats;
+
+use async_io::{CallerPtr, ReadPool};
+use handles::HandleTable;
+
+// Thread-safe handle management with lazy initialization. Each archive has its
+// own read/write lock and each open file or search its own mutex, so calls on
+// independent handles do not serialize on a global lock.
+static ARCHIVES: LazyLock<HandleTable<RwLock<ArchiveHandle>>> = LazyLock::new(HandleTable::new);
+static FILES: LazyLock<HandleTable<OpenFile>> = LazyLock::new(HandleTable::new);
+static FIND_HANDLES: LazyLock<HandleTable<Mutex<FindHandle>>> = LazyLock::new(HandleTable::new);
+// Data folders opened with SFileOpenDataFolder. Lookups only read the merged
+// index, so these need no lock of their own.
+static DATA_FOLDERS: LazyLock<HandleTable<DataFolder>> = LazyLock::new(HandleTable::new);
+
+// Worker threads for SFileReadFileAsync, started on first use
+static READ_POOL: LazyLock<ReadPool> = LazyLock::new(|| ReadPool::new(ReadPool::default_threads()));
+
+// On-disk index cache used by SFileOpenArchive, set with SFileSetIndexCacheDirectory
+static INDEX_CACHE: RwLock<Option<IndexCache>> = RwLock::new(None);
+
+// Shared-memory index used by SFileOpenArchive, set with SFileSetSharedIndexDirectory
+#[cfg(feature = "mmap")]
+static SHARED_INDEX: RwLock<Option<SharedIndex>> = RwLock::new(None);
+
+// Decoded sectors shared by all archives opened while its budget, set with
+// SFileSetSectorCacheSize, is non-zero
+static SECTOR_CACHE: LazyLock<Arc<SectorCache>> = LazyLock::new(|| Arc::new(SectorCache::new(0)));
+
+// Callbacks set with SFileSetCompactCallback and compactions started with
+// SFileCompactArchiveAsync, by archive id. Both are dropped when the archive
+// is closed; a job also when SFileWaitForCompact has returned its result.
+static COMPACT_CALLBACKS: LazyLock<Mutex<HashMap<usize, (CompactCallback, CallerPtr)>>> =
+    LazyLock::new(Default::default);
+static COMPACT_JOBS: LazyLock<Mutex<HashMap<usize, Arc<CompactJob>>>> =
+    LazyLock::new(Default::default);
 
 // Thread-local error storage
 thread_local! {
@@ -41,6 +82,12 @@ enum ArchiveHandle {
     ReadOnly {
         archive: Archive,
         path: String,
+        /// Patch chain attached with `SFileOpenPatchArchive`
+        patches: Option<PatchChain>,
+        /// Sorted file listing, built on first enumeration
+        names: Option<Arc<NameIndex>>,
+        /// Flags passed to `SFileOpenArchive`
+        flags: u32,
     },
     Mutable {
         archive: MutableArchive,
@@ -48,12 +95,40 @@ enum ArchiveHandle {
     },
 }
 
-struct FileHandle {
+/// An open file and the archive or data folder it was opened from
+///
+/// The owner never changes, so it is kept outside the file's mutex and
+/// closing an archive finds its files without locking each of them.
+struct OpenFile {
     archive_handle: usize,
+    file: Mutex<FileHandle>,
+}
+
+struct FileHandle {
     filename: String,
-    data: Vec<u8>,
-    position: usize,
+    stream: FileStream,
+    position: u64,
     size: u64,
+    /// Read calls, bytes returned and time spent reading through this handle
+    reads: u64,
+    bytes_delivered: u64,
+    read_nanos: u64,
+    /// Streams kept for reuse by `SFileReadFileAt`
+    spare_streams: Vec<FileStream>,
+}
+
+/// Most streams a file handle keeps for positioned reads
+const MAX_SPARE_STREAMS: usize = 8;
+
+impl FileHandle {
+    /// Count a read of `bytes` that took `elapsed`, here and in the global counters
+    fn record_read(&mut self, elapsed: std::time::Duration, bytes: usize) {
+        self.reads += 1;
+        self.bytes_delivered += bytes as u64;
+        self.read_nanos += elapsed.as_nanos() as u64;
+        stats::READ_LATENCY.record(elapsed);
+        stats::BYTES_DELIVERED.fetch_add(bytes as u64, Ordering::Relaxed);
+    }
 }
 
 impl ArchiveHandle {
@@ -73,6 +148,53 @@ impl ArchiveHandle {
         }
     }
 
+    /// Get the attached patch chain (if any)
+    fn patch_chain(&self) -> Option<&PatchChain> {
+        match self {
+            ArchiveHandle::ReadOnly { patches, .. } => patches.as_ref(),
+            ArchiveHandle::Mutable { .. } => None,
+        }
+    }
+
+    /// Open a stream on a file with shared access to the handle
+    ///
+    /// Files of a patch chain are resolved through the chain's index and
+    /// streamed from the archive holding them. Returns `Ok(None)` when the
+    /// file needs exclusive access: files of mutable archives, which may
+    /// have pending changes, and files the patch chain has to patch, whose
+    /// results go into the chain's cache. Read those with
+    /// `read_file_exclusive`.
+    fn open_file_stream_shared(&self, name: &str) -> wow_mpq::Result<Option<FileStream>> {
+        match self {
+            ArchiveHandle::ReadOnly {
+                patches: Some(chain),
+                ..
+            } => chain.open_file_stream(name),
+            ArchiveHandle::ReadOnly { archive, .. } => archive.open_file_stream(name).map(Some),
+            ArchiveHandle::Mutable { .. } => Ok(None),
+        }
+    }
+
+    /// Read a whole file, resolving it through the patch chain if present
+    fn read_file_exclusive(&mut self, name: &str) -> wow_mpq::Result<Vec<u8>> {
+        match self {
+            ArchiveHandle::ReadOnly {
+                patches: Some(chain),
+                ..
+            } => chain.read_file(name),
+            ArchiveHandle::ReadOnly { archive, .. } => archive.read_file(name),
+            ArchiveHandle::Mutable { archive, .. } => archive.read_file(name),
+        }
+    }
+
+    /// Check whether a file exists, including files only present in patches
+    fn has_file(&self, name: &str) -> bool {
+        match self.patch_chain() {
+            Some(chain) => chain.contains_file(name),
+            None => matches!(self.archive().find_file(name), Ok(Some(_))),
+        }
+    }
+
     /// Get the path
     fn path(&self) -> &str {
         match self {
@@ -82,17 +204,146 @@ impl ArchiveHandle {
     }
 }
 
+/// Read a whole file from an archive handle
+///
+/// Read-only archives only hold the archive lock while the file is located;
+/// the file is decoded through its own stream afterwards, so concurrent reads
+/// from the same archive do not serialize. Mutable archives need exclusive
+/// access to read, as do files that a patch chain has to patch.
+fn read_archive_file(archive_lock: &RwLock<ArchiveHandle>, name: &str) -> wow_mpq::Result<Vec<u8>> {
+    let stream = archive_lock.read().unwrap().open_file_stream_shared(name)?;
+    let Some(mut stream) = stream else {
+        return archive_lock.write().unwrap().read_file_exclusive(name);
+    };
+
+    let mut data = Vec::with_capacity(stream.len() as usize);
+    stream.read_to_end(&mut data)?;
+    Ok(data)
+}
+
+/// Where the files of an archive or data folder handle are read from
+enum FileSource {
+    Folder(Arc<DataFolder>),
+    Archive(Arc<RwLock<ArchiveHandle>>),
+}
+
+impl FileSource {
+    /// Resolve an archive or data folder handle
+    ///
+    /// Sets the last error and returns `None` if the handle is invalid.
+    fn lookup(archive_id: usize) -> Option<Self> {
+        match DATA_FOLDERS.get(archive_id) {
+            Some(folder) => Some(FileSource::Folder(folder)),
+            None => lookup_archive(archive_id).map(FileSource::Archive),
+        }
+    }
+
+    /// Open a stream on a file
+    ///
+    /// Read-only archives stream sectors on demand and only need shared
+    /// access while the stream is set up, as do the unpatched files of a
+    /// patch chain. Mutable archives are read in full since they may have
+    /// pending changes that are not yet on disk, and so are files the patch
+    /// chain has to patch. Data folders look the file up in their merged
+    /// index.
+    fn open_file_stream(&self, name: &str) -> wow_mpq::Result<FileStream> {
+        match self {
+            FileSource::Folder(folder) => folder.open_file_stream(name),
+            FileSource::Archive(archive_lock) => {
+                let stream = stats::read(archive_lock).open_file_stream_shared(name)?;
+                match stream {
+                    Some(stream) => Ok(stream),
+                    None => stats::write(archive_lock)
+                        .read_file_exclusive(name)
+                        .map(|data| FileStream::from_vec(name, data)),
+                }
+            }
+        }
+    }
+}
+
+/// Get the sorted file listing of an archive handle
+///
+/// Read-only archives build the index once and keep it until a patch is
+/// added; the listing of a mutable archive is rebuilt on every call since it
+/// changes as files are added or removed.
+fn archive_name_index(archive_lock: &RwLock<ArchiveHandle>) -> wow_mpq::Result<Arc<NameIndex>> {
+    if let ArchiveHandle::ReadOnly {
+        names: Some(index), ..
+    } = &*archive_lock.read().unwrap()
+    {
+        return Ok(Arc::clone(index));
+    }
+
+    let mut archive_guard = archive_lock.write().unwrap();
+    match &mut *archive_guard {
+        ArchiveHandle::ReadOnly {
+            archive,
+            patches,
+            names,
+            flags,
+            ..
+        } => {
+            // Another thread may have built it while we waited for the lock
+            if let Some(index) = names {
+                return Ok(Arc::clone(index));
+            }
+            let entries = match patches {
+                Some(chain) => chain.list()?,
+                // Without (listfile) only the table entries are known
+                None if *flags & MPQ_OPEN_NO_LISTFILE != 0 => archive.list_all()?,
+                None => archive.list().or_else(|_| archive.list_all())?,
+            };
+            let index = Arc::new(NameIndex::new(entries));
+            *names = Some(Arc::clone(&index));
+            Ok(index)
+        }
+        ArchiveHandle::Mutable { archive, .. } => Ok(Arc::new(NameIndex::new(archive.list()?))),
+    }
+}
+
+/// Get an archive handle ready for file lookups
+///
+/// Archives opened with `MPQ_OPEN_LAZY_TABLES` only read their header; the
+/// first call that needs the hash and block tables loads them here. Sets the
+/// last error and returns `None` if the handle is invalid or the tables cannot
+/// be read.
+fn lookup_archive(archive_id: usize) -> Option<Arc<RwLock<ArchiveHandle>>> {
+    let Some(archive_lock) = ARCHIVES.get(archive_id) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return None;
+    };
+    if archive_lock.read().unwrap().archive().tables_loaded() {
+        return Some(archive_lock);
+    }
+
+    if let ArchiveHandle::ReadOnly { archive, .. } = &mut *archive_lock.write().unwrap() {
+        // Another thread may have loaded them while we waited for the lock
+        if !archive.tables_loaded() {
+            if let Err(e) = archive.load_tables() {
+                log::warn!("Failed to load tables of {}: {e}", archive.path().display());
+                set_last_error(ERROR_FILE_CORRUPT);
+                return None;
+            }
+        }
+    }
+    Some(archive_lock)
+}
+
 // Error codes (matching Windows/StormLib error codes)
 const ERROR_SUCCESS: u32 = 0;
 const ERROR_FILE_NOT_FOUND: u32 = 2;
 const ERROR_ACCESS_DENIED: u32 = 5;
 const ERROR_INVALID_HANDLE: u32 = 6;
-const _ERROR_NOT_ENOUGH_MEMORY: u32 = 8;
+const ERROR_NOT_ENOUGH_MEMORY: u32 = 8;
 const ERROR_INVALID_PARAMETER: u32 = 87;
+const ERROR_DISK_FULL: u32 = 112;
 const ERROR_INSUFFICIENT_BUFFER: u32 = 122;
+const ERROR_BUSY: u32 = 170;
 const ERROR_ALREADY_EXISTS: u32 = 183;
 const ERROR_FILE_CORRUPT: u32 = 1392;
 const ERROR_NOT_SUPPORTED: u32 = 50;
+const ERROR_TIMEOUT: u32 = 1460;
 
 // Locale constants
 const LOCALE_NEUTRAL: u32 = 0;
@@ -109,6 +360,12 @@ const SFILE_VERIFY_SIGNATURE: u32 = 0x10;
 const SFILE_VERIFY_ALL_FILES: u32 = 0x20;
 const SFILE_VERIFY_ALL: u32 = 0xFF;
 
+// Failure codes reported in SFILE_VERIFY_FAILURE
+const SFILE_VERIFY_FAILED_SECTOR_CRC: u32 = 1;
+const SFILE_VERIFY_FAILED_FILE_CRC: u32 = 2;
+const SFILE_VERIFY_FAILED_FILE_MD5: u32 = 3;
+const SFILE_VERIFY_FAILED_READ: u32 = 4;
+
 // Info classes for SFileGetFileInfo
 const SFILE_INFO_ARCHIVE_SIZE: u32 = 1;
 const SFILE_INFO_HASH_TABLE_SIZE: u32 = 2;
@@ -117,17 +374,34 @@ const SFILE_INFO_SECTOR_SIZE: u32 = 4;
 const _SFILE_INFO_NUM_FILES: u32 = 5;
 const _SFILE_INFO_STREAM_FLAGS: u32 = 6;
 const SFILE_INFO_FILE_SIZE: u32 = 7;
-const _SFILE_INFO_COMPRESSED_SIZE: u32 = 8;
-const _SFILE_INFO_FLAGS: u32 = 9;
+const SFILE_INFO_COMPRESSED_SIZE: u32 = 8;
+const SFILE_INFO_FLAGS: u32 = 9;
 const SFILE_INFO_POSITION: u32 = 10;
-const _SFILE_INFO_KEY: u32 = 11;
+const SFILE_INFO_KEY: u32 = 11;
 const _SFILE_INFO_KEY_UNFIXED: u32 = 12;
 
+// Info classes for SFileGetFileInfo (extensions)
+const SFILE_INFO_LOOKUP_CACHE_HITS: u32 = 0x100;
+const SFILE_INFO_LOOKUP_CACHE_MISSES: u32 = 0x101;
+const SFILE_INFO_LOOKUP_CACHE_ENTRIES: u32 = 0x102;
+const SFILE_INFO_READ_COUNT: u32 = 0x105;
+const SFILE_INFO_BYTES_DELIVERED: u32 = 0x106;
+const SFILE_INFO_READ_TIME: u32 = 0x107;
+const SFILE_INFO_SECTOR_CACHE_HITS: u32 = 0x108;
+const SFILE_INFO_SECTOR_CACHE_MISSES: u32 = 0x109;
+const SFILE_INFO_SECTOR_CACHE_BYTES: u32 = 0x10A;
+
+// Extraction flags (for SFileExtractFiles)
+const SFILE_EXTRACT_REQUEST_ORDER: u32 = 0x00000001;
+
 // Archive open flags
-const _MPQ_OPEN_NO_LISTFILE: u32 = 0x0001;
-const _MPQ_OPEN_NO_ATTRIBUTES: u32 = 0x0002;
-const _MPQ_OPEN_FORCE_MPQ_V1: u32 = 0x0004;
-const _MPQ_OPEN_CHECK_SECTOR_CRC: u32 = 0x0008;
+const BASE_PROVIDER_MAP: u32 = 0x00000001;
+const MPQ_OPEN_NO_LISTFILE: u32 = 0x00010000;
+const MPQ_OPEN_NO_ATTRIBUTES: u32 = 0x00020000;
+const _MPQ_OPEN_FORCE_MPQ_V1: u32 = 0x00040000;
+const _MPQ_OPEN_CHECK_SECTOR_CRC: u32 = 0x00080000;
+/// Read only the header; tables are loaded by the first call that needs them
+const MPQ_OPEN_LAZY_TABLES: u32 = 0x01000000;
 
 // Archive creation flags (for SFileCreateArchive)
 const CREATE_NEW: u32 = 1;
@@ -161,6 +435,10 @@ fn id_to_handle(id: usize) -> HANDLE {
 
 /// Open an MPQ archive
 ///
+/// The archive's tables are flattened into a lookup-optimized copy when
+/// they are loaded, so `SFileHasFile` and `SFileOpenFileEx` probe contiguous
+/// name hash arrays and read pre-unpacked block information.
+///
 /// # Safety
 ///
 /// - `filename` must be a valid null-terminated C string
@@ -168,8 +446,8 @@ fn id_to_handle(id: usize) -> HANDLE {
 #[no_mangle]
 pub unsafe extern "C" fn SFileOpenArchive(
     filename: *const c_char,
-    _priority: u32, // Ignored - StormLib legacy parameter
-    _flags: u32,    // Archive open flags
+    _priority: u32, // Ignored - see SFileOpenDataFolder for ordered lookups
+    flags: u32,     // Archive open flags
     handle: *mut HANDLE,
 ) -> bool {
     // Validate parameters
@@ -187,21 +465,19 @@ pub unsafe extern "C" fn SFileOpenArchive(
         }
     };
 
-    // Open the archive
-    match Archive::open(filename_str) {
+    // Open the archive; handles from SFileOpenArchive are never modified
+    let options = archive_open_options(flags).flatten_tables(true);
+    match shared_index_options(options).open(filename_str) {
         Ok(archive) => {
-            // Generate new handle ID
-            let mut next_id = NEXT_HANDLE.lock().unwrap();
-            let handle_id = *next_id;
-            *next_id += 1;
-            drop(next_id);
-
             // Store archive
             let archive_handle = ArchiveHandle::ReadOnly {
                 archive,
                 path: filename_str.to_string(),
+                patches: None,
+                names: None,
+                flags,
             };
-            ARCHIVES.lock().unwrap().insert(handle_id, archive_handle);
+            let handle_id = ARCHIVES.insert(RwLock::new(archive_handle));
 
             // Return handle
             *handle = id_to_handle(handle_id);
@@ -222,6 +498,218 @@ pub unsafe extern "C" fn SFileOpenArchive(
     }
 }
 
+/// Open options for the archive open `flags`, with the process-wide caches
+fn archive_open_options(flags: u32) -> OpenOptions {
+    // BASE_PROVIDER_MAP backs the archive with a memory mapping
+    let options = if flags & BASE_PROVIDER_MAP != 0 {
+        map_archive_options()
+    } else {
+        OpenOptions::new()
+    };
+    let options = options
+        .load_tables(flags & MPQ_OPEN_LAZY_TABLES == 0)
+        .load_attributes(flags & MPQ_OPEN_NO_ATTRIBUTES == 0);
+    let options = match INDEX_CACHE.read().unwrap().clone() {
+        Some(cache) => options.index_cache(cache),
+        None => options,
+    };
+    if SECTOR_CACHE.budget() > 0 {
+        options.sector_cache(Arc::clone(&SECTOR_CACHE))
+    } else {
+        options
+    }
+}
+
+/// Open a client data folder as one archive handle
+///
+/// Opens every MPQ archive in `data_path` and in its locale folders (or only
+/// in the folder named by `locale`, if not null) in parallel, then merges
+/// their hash tables into one index following the client's load order: base
+/// archives, locale archives, patches, then locale patches, each overriding
+/// the ones before. The returned handle can be passed to `SFileOpenFileEx`,
+/// `SFileHasFile` and `SFileCloseArchive`; each lookup is a single probe of
+/// the merged index instead of one per archive. C callers that ordered their
+/// archives by hand with the `priority` of `SFileOpenArchive`, which this
+/// implementation ignores like StormLib does, can use this instead.
+///
+/// `flags` takes the same values as `SFileOpenArchive`, applied to each
+/// archive. Files stored as PTCH patches are not applied to their base
+/// files; attach those with `SFileOpenPatchArchive`.
+///
+/// # Safety
+///
+/// - `data_path` must be a valid null-terminated C string
+/// - `locale` if not null, must be a valid null-terminated C string
+/// - `handle` must be a valid pointer to write the output handle
+#[no_mangle]
+pub unsafe extern "C" fn SFileOpenDataFolder(
+    data_path: *const c_char,
+    locale: *const c_char,
+    flags: u32,
+    handle: *mut HANDLE,
+) -> bool {
+    if data_path.is_null() || handle.is_null() {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+
+    let Ok(data_path) = CStr::from_ptr(data_path).to_str() else {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    };
+    let locale = if locale.is_null() {
+        None
+    } else {
+        match CStr::from_ptr(locale).to_str() {
+            Ok(s) => Some(s),
+            Err(_) => {
+                set_last_error(ERROR_INVALID_PARAMETER);
+                return false;
+            }
+        }
+    };
+
+    match DataFolder::open_with_options(data_path, locale, archive_open_options(flags)) {
+        Ok(folder) => {
+            *handle = id_to_handle(DATA_FOLDERS.insert(folder));
+            set_last_error(ERROR_SUCCESS);
+            true
+        }
+        Err(e) => {
+            let error_code = match e {
+                wow_mpq::Error::FileNotFound(_) => ERROR_FILE_NOT_FOUND,
+                wow_mpq::Error::Io(ref io) if io.kind() == std::io::ErrorKind::NotFound => {
+                    ERROR_FILE_NOT_FOUND
+                }
+                wow_mpq::Error::Io(_) => ERROR_ACCESS_DENIED,
+                _ => ERROR_FILE_CORRUPT,
+            };
+            set_last_error(error_code);
+            false
+        }
+    }
+}
+
+/// Add the shared index set with `SFileSetSharedIndexDirectory` to `options`
+#[cfg(feature = "mmap")]
+fn shared_index_options(options: OpenOptions) -> OpenOptions {
+    match SHARED_INDEX.read().unwrap().clone() {
+        Some(index) => options.shared_index(index),
+        None => options,
+    }
+}
+
+/// Shared indexes need the `mmap` feature; options are left unchanged
+#[cfg(not(feature = "mmap"))]
+fn shared_index_options(options: OpenOptions) -> OpenOptions {
+    options
+}
+
+/// Open options for a memory-mapped archive
+#[cfg(feature = "mmap")]
+fn map_archive_options() -> OpenOptions {
+    OpenOptions::new().enable_memory_mapping()
+}
+
+/// Open options for a memory-mapped archive (mapping not compiled in)
+#[cfg(not(feature = "mmap"))]
+fn map_archive_options() -> OpenOptions {
+    OpenOptions::new()
+}
+
+/// Set the directory of the on-disk index cache
+///
+/// Archives opened by `SFileOpenArchive` after this call restore their
+/// decrypted hash and block tables and their sorted listing from a cache
+/// entry in `directory` when it is still valid for the archive, and write
+/// one when it is not. Entries are invalidated by any change to the archive's
+/// size, modification time or header. Passing null disables the cache, which
+/// is the default.
+///
+/// # Safety
+///
+/// - `directory` if not null, must be a valid null-terminated C string
+#[no_mangle]
+pub unsafe extern "C" fn SFileSetIndexCacheDirectory(directory: *const c_char) -> bool {
+    let cache = if directory.is_null() {
+        None
+    } else {
+        match CStr::from_ptr(directory).to_str() {
+            Ok(dir) if !dir.is_empty() => Some(IndexCache::new(dir)),
+            _ => {
+                set_last_error(ERROR_INVALID_PARAMETER);
+                return false;
+            }
+        }
+    };
+
+    *INDEX_CACHE.write().unwrap() = cache;
+    set_last_error(ERROR_SUCCESS);
+    true
+}
+
+/// Set the directory of the shared-memory lookup index
+///
+/// Archives opened by `SFileOpenArchive` after this call map the entry for
+/// the archive in `directory` read-only and look files up in it instead of
+/// reading and decrypting their tables; the first process to open an
+/// archive writes the entry. Worker processes opening the same archives
+/// thus share one copy of their lookup tables and listing through the page
+/// cache, and a directory on `/dev/shm` keeps it in shared memory. Entries
+/// are invalidated like index cache entries. Enumeration without a listfile
+/// and `SFileGetFileMetadata` walk the mapped tables. Passing null disables
+/// the shared index, which is the default.
+///
+/// Fails with `ERROR_NOT_SUPPORTED` if the library was built without the
+/// `mmap` feature.
+///
+/// # Safety
+///
+/// - `directory` if not null, must be a valid null-terminated C string
+#[no_mangle]
+pub unsafe extern "C" fn SFileSetSharedIndexDirectory(directory: *const c_char) -> bool {
+    let dir = if directory.is_null() {
+        None
+    } else {
+        match CStr::from_ptr(directory).to_str() {
+            Ok(dir) if !dir.is_empty() => Some(dir),
+            _ => {
+                set_last_error(ERROR_INVALID_PARAMETER);
+                return false;
+            }
+        }
+    };
+
+    #[cfg(feature = "mmap")]
+    {
+        *SHARED_INDEX.write().unwrap() = dir.map(SharedIndex::new);
+        set_last_error(ERROR_SUCCESS);
+        true
+    }
+    #[cfg(not(feature = "mmap"))]
+    {
+        let _ = dir;
+        set_last_error(ERROR_NOT_SUPPORTED);
+        false
+    }
+}
+
+/// Set the byte budget of the process-wide decoded sector cache
+///
+/// Archives opened by `SFileOpenArchive` while the budget is non-zero share
+/// one cache of decoded sectors and single-unit files, keyed by archive,
+/// block and sector, so files opened repeatedly or from several threads are
+/// decompressed once and kept in memory once. Least recently used entries
+/// are evicted to stay within `budget` bytes. A budget of 0, the default,
+/// empties the cache and leaves archives opened afterwards without one.
+/// Per-archive counters are available through `SFileGetFileInfo`.
+#[no_mangle]
+pub extern "C" fn SFileSetSectorCacheSize(budget: u64) -> bool {
+    SECTOR_CACHE.set_budget(usize::try_from(budget).unwrap_or(usize::MAX));
+    set_last_error(ERROR_SUCCESS);
+    true
+}
+
 /// Create a new MPQ archive
 ///
 /// # Safety
@@ -329,13 +817,12 @@ pub unsafe extern "C" fn SFileCreateArchive(
 pub extern "C" fn SFileCloseArchive(handle: HANDLE) -> bool {
     if let Some(handle_id) = handle_to_id(handle) {
         // Remove any open files from this archive
-        FILES
-            .lock()
-            .unwrap()
-            .retain(|_, file| file.archive_handle != handle_id);
+        FILES.retain(|file| file.archive_handle != handle_id);
+        COMPACT_CALLBACKS.lock().unwrap().remove(&handle_id);
+        COMPACT_JOBS.lock().unwrap().remove(&handle_id);
 
         // Close the archive
-        if ARCHIVES.lock().unwrap().remove(&handle_id).is_some() {
+        if ARCHIVES.remove(handle_id).is_some() || DATA_FOLDERS.remove(handle_id).is_some() {
             set_last_error(ERROR_SUCCESS);
             true
         } else {
@@ -348,21 +835,32 @@ pub extern "C" fn SFileCloseArchive(handle: HANDLE) -> bool {
     }
 }
 
-/// Open a file in the archive
+/// Attach a patch archive to an open archive
+///
+/// Files read from `archive` afterwards are resolved through a patch chain:
+/// the highest-priority version of a file wins, and PTCH patch files are
+/// applied on top of the base file. Patch archives opened later override
+/// earlier ones. The chain's merged file index is updated here, so lookups
+/// do not have to probe every archive. Files no patch modifies are streamed
+/// from the archive and block found in the index, as in unpatched archives;
+/// only patched files are decoded in full, and their results are cached for
+/// subsequent opens of the same file.
+///
+/// `patch_prefix` is accepted for StormLib compatibility but ignored; patch
+/// files are looked up by their plain names.
 ///
 /// # Safety
 ///
-/// - `filename` must be a valid null-terminated C string
-/// - `file_handle` must be a valid pointer to write the output handle
+/// - `patch_archive_name` must be a valid null-terminated C string
+/// - `patch_prefix` if not null, must be a valid null-terminated C string
 #[no_mangle]
-pub unsafe extern "C" fn SFileOpenFileEx(
+pub unsafe extern "C" fn SFileOpenPatchArchive(
     archive: HANDLE,
-    filename: *const c_char,
-    _search_scope: u32,
-    file_handle: *mut HANDLE,
+    patch_archive_name: *const c_char,
+    _patch_prefix: *const c_char, // Ignored - patch files use plain names
+    _flags: u32,
 ) -> bool {
-    // Validate parameters
-    if filename.is_null() || file_handle.is_null() {
+    if patch_archive_name.is_null() {
         set_last_error(ERROR_INVALID_PARAMETER);
         return false;
     }
@@ -372,8 +870,7 @@ pub unsafe extern "C" fn SFileOpenFileEx(
         return false;
     };
 
-    // Convert filename
-    let filename_str = match CStr::from_ptr(filename).to_str() {
+    let patch_path = match CStr::from_ptr(patch_archive_name).to_str() {
         Ok(s) => s,
         Err(_) => {
             set_last_error(ERROR_INVALID_PARAMETER);
@@ -381,594 +878,707 @@ pub unsafe extern "C" fn SFileOpenFileEx(
         }
     };
 
-    // Get the archive
-    let mut archives = ARCHIVES.lock().unwrap();
-    let Some(archive_handle) = archives.get_mut(&archive_id) else {
+    let Some(archive_lock) = ARCHIVES.get(archive_id) else {
         set_last_error(ERROR_INVALID_HANDLE);
         return false;
     };
-
-    // Try to find and read the file
-    let (file_info_opt, read_result) = match archive_handle {
-        ArchiveHandle::ReadOnly { archive, .. } => match archive.find_file(filename_str) {
-            Ok(Some(file_info)) => {
-                let read_result = archive.read_file(filename_str);
-                (Some(file_info), read_result)
-            }
-            Ok(None) => (
-                None,
-                Err(wow_mpq::Error::FileNotFound(filename_str.to_string())),
-            ),
-            Err(e) => (None, Err(e)),
-        },
-        ArchiveHandle::Mutable { archive, .. } => match archive.find_file(filename_str) {
-            Ok(Some(file_info)) => {
-                let read_result = archive.read_file(filename_str);
-                (Some(file_info), read_result)
-            }
-            Ok(None) => (
-                None,
-                Err(wow_mpq::Error::FileNotFound(filename_str.to_string())),
-            ),
-            Err(e) => (None, Err(e)),
-        },
+    let mut archive_guard = archive_lock.write().unwrap();
+
+    // Like StormLib, archives opened for writing cannot be patched
+    let ArchiveHandle::ReadOnly {
+        path,
+        patches,
+        names,
+        ..
+    } = &mut *archive_guard
+    else {
+        set_last_error(ERROR_ACCESS_DENIED);
+        return false;
     };
 
-    if let Some(file_info) = file_info_opt {
-        match read_result {
-            Ok(data) => {
-                // Generate file handle
-                let mut next_id = NEXT_HANDLE.lock().unwrap();
-                let file_id = *next_id;
-                *next_id += 1;
-                drop(next_id);
-
-                // Create file handle
-                let file = FileHandle {
-                    archive_handle: archive_id,
-                    filename: filename_str.to_string(),
-                    data,
-                    position: 0,
-                    size: file_info.file_size,
-                };
-
-                // Store file handle
-                FILES.lock().unwrap().insert(file_id, file);
-
-                // Return handle
-                *file_handle = id_to_handle(file_id);
-                set_last_error(ERROR_SUCCESS);
-                true
-            }
-            Err(_) => {
+    // Patches can add files, so the listing has to be rebuilt
+    *names = None;
+
+    // The first patch turns the archive into the base of a new chain
+    let mut chain = match patches.take() {
+        Some(chain) => chain,
+        None => {
+            let mut chain = PatchChain::new();
+            if chain.add_archive(path.as_str(), 0).is_err() {
                 set_last_error(ERROR_FILE_CORRUPT);
-                false
+                return false;
             }
+            chain
         }
-    } else {
-        set_last_error(ERROR_FILE_NOT_FOUND);
-        false
+    };
+
+    let priority = chain.archive_count() as i32;
+    let result = chain.add_archive(patch_path, priority);
+
+    // A chain holding only the base archive is not worth keeping
+    if chain.archive_count() > 1 {
+        *patches = Some(chain);
     }
-}
 
-/// Close a file
-#[no_mangle]
-pub extern "C" fn SFileCloseFile(file: HANDLE) -> bool {
-    if let Some(file_id) = handle_to_id(file) {
-        if FILES.lock().unwrap().remove(&file_id).is_some() {
+    match result {
+        Ok(()) => {
             set_last_error(ERROR_SUCCESS);
             true
-        } else {
-            set_last_error(ERROR_INVALID_HANDLE);
+        }
+        Err(e) => {
+            let error_code = match e {
+                wow_mpq::Error::FileNotFound(_) => ERROR_FILE_NOT_FOUND,
+                wow_mpq::Error::Io(ref io) if io.kind() == std::io::ErrorKind::NotFound => {
+                    ERROR_FILE_NOT_FOUND
+                }
+                _ => ERROR_FILE_CORRUPT,
+            };
+            set_last_error(error_code);
             false
         }
-    } else {
-        set_last_error(ERROR_INVALID_HANDLE);
-        false
     }
 }
 
-/// Read from a file
+/// Check whether an archive has patch archives attached
+#[no_mangle]
+pub extern "C" fn SFileIsPatchedArchive(archive: HANDLE) -> bool {
+    let Some(archive_lock) = handle_to_id(archive).and_then(|id| ARCHIVES.get(id)) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
+    };
+
+    set_last_error(ERROR_SUCCESS);
+    let is_patched = archive_lock.read().unwrap().patch_chain().is_some();
+    is_patched
+}
+
+/// Open a file in the archive
 ///
 /// # Safety
 ///
-/// - `buffer` must be a valid pointer with at least `to_read` bytes available
-/// - `read` if not null, must be a valid pointer to write the bytes read
+/// - `filename` must be a valid null-terminated C string
+/// - `file_handle` must be a valid pointer to write the output handle
 #[no_mangle]
-pub unsafe extern "C" fn SFileReadFile(
-    file: HANDLE,
-    buffer: *mut c_void,
-    to_read: u32,
-    read: *mut u32,
-    _overlapped: *mut c_void, // Ignored - no async I/O support
+pub unsafe extern "C" fn SFileOpenFileEx(
+    archive: HANDLE,
+    filename: *const c_char,
+    _search_scope: u32,
+    file_handle: *mut HANDLE,
 ) -> bool {
     // Validate parameters
-    if buffer.is_null() {
+    if filename.is_null() || file_handle.is_null() {
         set_last_error(ERROR_INVALID_PARAMETER);
         return false;
     }
 
-    let Some(file_id) = handle_to_id(file) else {
+    let Some(archive_id) = handle_to_id(archive) else {
         set_last_error(ERROR_INVALID_HANDLE);
         return false;
     };
 
-    // Get file handle
-    let mut files = FILES.lock().unwrap();
-    let Some(file_handle) = files.get_mut(&file_id) else {
-        set_last_error(ERROR_INVALID_HANDLE);
-        return false;
-    };
+    // Convert filename
+    let filename_str = match CStr::from_ptr(filename).to_str() {
+        Ok(s) => s,
+        Err(_) => {
+            set_last_error(ERROR_INVALID_PARAMETER);
+            return false;
+        }
+    };
 
-    // Calculate how much we can read
-    let remaining = file_handle.data.len().saturating_sub(file_handle.position);
-    let bytes_to_read = (to_read as usize).min(remaining);
+    let started = std::time::Instant::now();
+    let Some(source) = FileSource::lookup(archive_id) else {
+        return false;
+    };
+    let stream_result = source.open_file_stream(filename_str);
+    stats::OPEN_LATENCY.record(started.elapsed());
+
+    match stream_result {
+        Ok(stream) => {
+            // Create file handle
+            let file = FileHandle {
+                filename: filename_str.to_string(),
+                size: stream.len(),
+                stream,
+                position: 0,
+                reads: 0,
+                bytes_delivered: 0,
+                read_nanos: 0,
+                spare_streams: Vec::new(),
+            };
+
+            // Store file handle
+            let file_id = FILES.insert(OpenFile {
+                archive_handle: archive_id,
+                file: Mutex::new(file),
+            });
 
-    if bytes_to_read == 0 {
-        if !read.is_null() {
-            *read = 0;
+            // Return handle
+            *file_handle = id_to_handle(file_id);
+            set_last_error(ERROR_SUCCESS);
+            true
         }
-        set_last_error(ERROR_SUCCESS);
-        return true;
+        Err(wow_mpq::Error::FileNotFound(_)) => {
+            set_last_error(ERROR_FILE_NOT_FOUND);
+            false
+        }
+        Err(_) => {
+            set_last_error(ERROR_FILE_CORRUPT);
+            false
+        }
+    }
+}
+
+/// Close a file
+#[no_mangle]
+pub extern "C" fn SFileCloseFile(file: HANDLE) -> bool {
+    if let Some(file_id) = handle_to_id(file) {
+        if FILES.remove(file_id).is_some() {
+            set_last_error(ERROR_SUCCESS);
+            true
+        } else {
+            set_last_error(ERROR_INVALID_HANDLE);
+            false
+        }
+    } else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        false
+    }
+}
+
+/// Read from a file
+///
+/// # Safety
+///
+/// - `buffer` must be a valid pointer with at least `to_read` bytes available
+/// - `read` if not null, must be a valid pointer to write the bytes read
+#[no_mangle]
+pub unsafe extern "C" fn SFileReadFile(
+    file: HANDLE,
+    buffer: *mut c_void,
+    to_read: u32,
+    read: *mut u32,
+    _overlapped: *mut c_void, // Ignored - use SFileReadFileAsync instead
+) -> bool {
+    let mut bytes_read = 0u64;
+    let ok = SFileReadFileEx64(file, buffer, u64::from(to_read), &mut bytes_read);
+    if !read.is_null() {
+        *read = bytes_read as u32;
+    }
+    ok
+}
+
+/// Read from a file at its current position, with a 64-bit length
+///
+/// Like `SFileReadFile`, but `to_read` and the count written to `read` are
+/// 64-bit, so large files can be read in one call.
+///
+/// # Safety
+///
+/// - `buffer` must be a valid pointer with at least `to_read` bytes available
+/// - `read` if not null, must be a valid pointer to write the bytes read
+#[no_mangle]
+pub unsafe extern "C" fn SFileReadFileEx64(
+    file: HANDLE,
+    buffer: *mut c_void,
+    to_read: u64,
+    read: *mut u64,
+) -> bool {
+    if !read.is_null() {
+        *read = 0;
+    }
+    // Validate parameters
+    let Ok(to_read) = usize::try_from(to_read) else {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    };
+    if buffer.is_null() {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
     }
 
-    // Copy data to buffer
-    let src = &file_handle.data[file_handle.position..file_handle.position + bytes_to_read];
-    std::ptr::copy_nonoverlapping(src.as_ptr(), buffer as *mut u8, bytes_to_read);
+    let Some(file_id) = handle_to_id(file) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
+    };
+
+    // Get file handle
+    let Some(file_lock) = FILES.get(file_id) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
+    };
+    let mut file_guard = stats::lock(&file_lock.file);
+    let file_handle = &mut *file_guard;
+
+    // Decode only the sectors covering the requested range
+    let dest = std::slice::from_raw_parts_mut(buffer as *mut u8, to_read);
+    let started = std::time::Instant::now();
+    let result = file_handle.stream.read_at(file_handle.position, dest);
+    file_handle.record_read(started.elapsed(), result.as_ref().map_or(0, |n| *n));
+    let bytes_read = match result {
+        Ok(n) => n,
+        Err(_) => {
+            set_last_error(ERROR_FILE_CORRUPT);
+            return false;
+        }
+    };
 
     // Update position
-    file_handle.position += bytes_to_read;
+    file_handle.position += bytes_read as u64;
 
     // Set bytes read
     if !read.is_null() {
-        *read = bytes_to_read as u32;
+        *read = bytes_read as u64;
     }
 
     set_last_error(ERROR_SUCCESS);
     true
 }
 
-/// Get file size
+/// Read from a file at `offset` without using or moving its position
+///
+/// Several threads may read disjoint (or overlapping) ranges of the same
+/// handle at once: each read borrows a private stream over the file, so they
+/// do not wait for each other's decoding or share a cursor. The handle keeps
+/// up to a few such streams for reuse. Reads at or past the end of the file
+/// succeed with 0 bytes.
 ///
 /// # Safety
 ///
-/// - `high` if not null, must be a valid pointer to write the high 32 bits
+/// - `buffer` must be a valid pointer with at least `to_read` bytes available
+/// - `read` if not null, must be a valid pointer to write the bytes read
 #[no_mangle]
-pub unsafe extern "C" fn SFileGetFileSize(file: HANDLE, high: *mut u32) -> u32 {
+pub unsafe extern "C" fn SFileReadFileAt(
+    file: HANDLE,
+    offset: u64,
+    buffer: *mut c_void,
+    to_read: u64,
+    read: *mut u64,
+) -> bool {
+    if !read.is_null() {
+        *read = 0;
+    }
+    let Ok(to_read) = usize::try_from(to_read) else {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    };
+    if buffer.is_null() {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+
     let Some(file_id) = handle_to_id(file) else {
         set_last_error(ERROR_INVALID_HANDLE);
-        return 0xFFFFFFFF; // INVALID_FILE_SIZE
+        return false;
     };
-
-    let files = FILES.lock().unwrap();
-    let Some(file_handle) = files.get(&file_id) else {
+    let Some(file_lock) = FILES.get(file_id) else {
         set_last_error(ERROR_INVALID_HANDLE);
-        return 0xFFFFFFFF;
+        return false;
     };
 
-    let size = file_handle.size;
+    // Only hold the handle's lock to take and return a stream
+    let spare = stats::lock(&file_lock.file).spare_streams.pop();
+    let mut stream = match spare {
+        Some(stream) => stream,
+        None => match stats::lock(&file_lock.file).stream.try_clone() {
+            Ok(stream) => stream,
+            Err(_) => {
+                set_last_error(ERROR_FILE_CORRUPT);
+                return false;
+            }
+        },
+    };
 
-    // Split 64-bit size into high and low parts
-    if !high.is_null() {
-        *high = (size >> 32) as u32;
+    let dest = std::slice::from_raw_parts_mut(buffer as *mut u8, to_read);
+    let started = std::time::Instant::now();
+    let result = stream.read_at(offset, dest);
+    let elapsed = started.elapsed();
+
+    let mut file_handle = stats::lock(&file_lock.file);
+    file_handle.record_read(elapsed, result.as_ref().map_or(0, |n| *n));
+    if file_handle.spare_streams.len() < MAX_SPARE_STREAMS {
+        file_handle.spare_streams.push(stream);
     }
+    drop(file_handle);
 
-    set_last_error(ERROR_SUCCESS);
-    (size & 0xFFFFFFFF) as u32
+    match result {
+        Ok(n) => {
+            if !read.is_null() {
+                *read = n as u64;
+            }
+            set_last_error(ERROR_SUCCESS);
+            true
+        }
+        Err(_) => {
+            set_last_error(ERROR_FILE_CORRUPT);
+            false
+        }
+    }
 }
 
-/// Set file position
+/// Queue a read from a file on the background I/O pool
+///
+/// Reads `to_read` bytes starting at the file's current position and returns
+/// immediately. The position advances when the read is queued, so several
+/// reads queued on one handle cover consecutive parts of the file. Reads on
+/// one file run one at a time; reads on different files run in parallel.
+///
+/// When the read finishes, `callback` is called on a pool thread with the
+/// file handle, the buffer, the number of bytes read, an error code
+/// (`ERROR_SUCCESS` or `ERROR_FILE_CORRUPT`) and `user_data`. Closing the file
+/// before then is allowed; the pending read still completes.
 ///
 /// # Safety
 ///
-/// - `file_pos_high` if not null, must be a valid pointer to read/write the high 32 bits
+/// - `buffer` must be a valid pointer with at least `to_read` bytes available,
+///   and must not be accessed by the caller until `callback` has been called
+/// - `callback` must be safe to call from another thread
+/// - `user_data` must stay valid until `callback` has been called
 #[no_mangle]
-pub unsafe extern "C" fn SFileSetFilePointer(
+pub unsafe extern "C" fn SFileReadFileAsync(
     file: HANDLE,
-    file_pos: i32,
-    file_pos_high: *mut i32,
-    move_method: u32, // 0=FILE_BEGIN, 1=FILE_CURRENT, 2=FILE_END
-) -> u32 {
+    buffer: *mut c_void,
+    to_read: u32,
+    callback: Option<extern "C" fn(HANDLE, *mut c_void, u32, u32, *mut c_void)>,
+    user_data: *mut c_void,
+) -> bool {
+    // Validate parameters
+    if buffer.is_null() {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+    let Some(callback_fn) = callback else {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    };
+
     let Some(file_id) = handle_to_id(file) else {
         set_last_error(ERROR_INVALID_HANDLE);
-        return 0xFFFFFFFF; // INVALID_SET_FILE_POINTER
+        return false;
     };
 
-    let mut files = FILES.lock().unwrap();
-    let Some(file_handle) = files.get_mut(&file_id) else {
+    // Get file handle; the job keeps it alive if the file is closed meanwhile
+    let Some(file_lock) = FILES.get(file_id) else {
         set_last_error(ERROR_INVALID_HANDLE);
-        return 0xFFFFFFFF;
+        return false;
     };
 
-    // Combine high and low parts into 64-bit offset
-    let mut offset = file_pos as i64;
-    if !file_pos_high.is_null() {
-        let high = *file_pos_high as i64;
-        offset |= high << 32;
-    }
-
-    // Calculate new position
-    let new_pos = match move_method {
-        0 => offset as usize,                                   // FILE_BEGIN
-        1 => (file_handle.position as i64 + offset) as usize,   // FILE_CURRENT
-        2 => (file_handle.data.len() as i64 + offset) as usize, // FILE_END
-        _ => {
-            set_last_error(ERROR_INVALID_PARAMETER);
-            return 0xFFFFFFFF;
-        }
+    // Reserve the range now so that queue order decides file order
+    let offset = {
+        let mut file_handle = file_lock.file.lock().unwrap();
+        let offset = file_handle.position;
+        let remaining = file_handle.size.saturating_sub(offset);
+        file_handle.position += u64::from(to_read).min(remaining);
+        offset
     };
 
-    // Clamp to file size
-    file_handle.position = new_pos.min(file_handle.data.len());
+    let buffer = CallerPtr::new(buffer);
+    let user_data = CallerPtr::new(user_data);
+    READ_POOL.submit(move || {
+        let dest = std::slice::from_raw_parts_mut(buffer.get() as *mut u8, to_read as usize);
+        let mut file_handle = stats::lock(&file_lock.file);
+        let started = std::time::Instant::now();
+        let result = file_handle.stream.read_at(offset, dest);
+        file_handle.record_read(started.elapsed(), result.as_ref().map_or(0, |n| *n));
+        drop(file_handle);
+        let (bytes_read, error) = match result {
+            Ok(n) => (n as u32, ERROR_SUCCESS),
+            Err(_) => (0, ERROR_FILE_CORRUPT),
+        };
 
-    // Return new position
-    let pos = file_handle.position as u64;
-    if !file_pos_high.is_null() {
-        *file_pos_high = (pos >> 32) as i32;
-    }
+        // Let the callback query the result with SFileGetLastError too
+        set_last_error(error);
+        callback_fn(
+            id_to_handle(file_id),
+            buffer.get(),
+            bytes_read,
+            error,
+            user_data.get(),
+        );
+        error == ERROR_SUCCESS
+    });
 
     set_last_error(ERROR_SUCCESS);
-    (pos & 0xFFFFFFFF) as u32
+    true
 }
 
-/// Check if file exists in archive
+/// Asynchronous read queue counters, see `SFileGetAsyncReadStats`
+#[repr(C)]
+#[derive(Debug, Default)]
+pub struct SFILE_ASYNC_STATS {
+    /// Reads waiting for a pool thread
+    pub queued: u32,
+    /// Reads currently being decoded
+    pub in_flight: u32,
+    /// Highest number of queued plus running reads seen
+    pub peak_pending: u32,
+    /// Number of pool threads
+    pub threads: u32,
+    /// Reads that completed successfully
+    pub completed: u64,
+    /// Reads that completed with an error
+    pub failed: u64,
+}
+
+/// Get the counters of the asynchronous read queue
 ///
 /// # Safety
 ///
-/// - `filename` must be a valid null-terminated C string
+/// - `stats` must be a valid pointer to an `SFILE_ASYNC_STATS`
 #[no_mangle]
-pub unsafe extern "C" fn SFileHasFile(archive: HANDLE, filename: *const c_char) -> bool {
-    if filename.is_null() {
+pub unsafe extern "C" fn SFileGetAsyncReadStats(stats: *mut SFILE_ASYNC_STATS) -> bool {
+    if stats.is_null() {
+        set_last_error(ERROR_INVALID_PARAMETER);
         return false;
     }
 
-    let Some(archive_id) = handle_to_id(archive) else {
-        return false;
+    let pool = READ_POOL.stats();
+    *stats = SFILE_ASYNC_STATS {
+        queued: pool.queued as u32,
+        in_flight: pool.in_flight as u32,
+        peak_pending: pool.peak_pending as u32,
+        threads: pool.threads as u32,
+        completed: pool.completed,
+        failed: pool.failed,
     };
 
-    let filename_str = match CStr::from_ptr(filename).to_str() {
-        Ok(s) => s,
-        Err(_) => return false,
+    set_last_error(ERROR_SUCCESS);
+    true
+}
+
+/// Wait until every read queued with `SFileReadFileAsync` has completed
+///
+/// `timeout_ms` of `0xFFFFFFFF` waits indefinitely. Returns false with
+/// `ERROR_TIMEOUT` if reads are still pending when the timeout elapses.
+#[no_mangle]
+pub extern "C" fn SFileWaitAsyncReads(timeout_ms: u32) -> bool {
+    let timeout = match timeout_ms {
+        u32::MAX => None,
+        ms => Some(std::time::Duration::from_millis(u64::from(ms))),
     };
 
-    let archives = ARCHIVES.lock().unwrap();
-    if let Some(archive_handle) = archives.get(&archive_id) {
-        matches!(
-            archive_handle.archive().find_file(filename_str),
-            Ok(Some(_))
-        )
+    if READ_POOL.wait_idle(timeout) {
+        set_last_error(ERROR_SUCCESS);
+        true
     } else {
+        set_last_error(ERROR_TIMEOUT);
         false
     }
 }
 
-/// Get file information
+/// Number of decompression algorithms in `SFILE_STATISTICS`
+///
+/// Entries are ordered Huffman, zlib, implode, PKWare, bzip2, sparse,
+/// ADPCM mono, ADPCM stereo, LZMA.
+pub const SFILE_STATS_ALGORITHMS: usize = wow_mpq::stats::ALGORITHM_COUNT;
+
+/// Number of buckets in the `SFILE_STATISTICS` latency histograms
+///
+/// Bucket 0 counts calls under 1 µs, bucket `i` calls of `2^(i-1)` to `2^i`
+/// µs, and the last bucket everything slower.
+pub const SFILE_STATS_LATENCY_BUCKETS: usize = stats::LATENCY_BUCKETS;
+
+/// Process-wide performance counters, see `SFileGetStatistics`
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct SFILE_STATISTICS {
+    /// Bytes read from archive files
+    pub disk_bytes_read: u64,
+    /// Read calls issued on archive files
+    pub disk_reads: u64,
+    /// Bytes copied out of memory-mapped archives
+    pub mapped_bytes_read: u64,
+    /// Bytes returned to callers by `SFileReadFile` and `SFileReadFileAsync`
+    pub bytes_delivered: u64,
+    /// Sectors served from a file's decoded-sector cache
+    pub sector_cache_hits: u64,
+    /// Sectors that had to be read and decoded
+    pub sector_cache_misses: u64,
+    /// Decompression buffers reused from the shared pool
+    pub buffer_pool_hits: u64,
+    /// Decompression buffers that had to be allocated
+    pub buffer_pool_misses: u64,
+    /// Sectors (or single-unit files) decompressed, per algorithm
+    pub decompress_calls: [u64; SFILE_STATS_ALGORITHMS],
+    /// Compressed bytes consumed, per algorithm
+    pub decompress_bytes_in: [u64; SFILE_STATS_ALGORITHMS],
+    /// Decompressed bytes produced, per algorithm
+    pub decompress_bytes_out: [u64; SFILE_STATS_ALGORITHMS],
+    /// Time spent decompressing in nanoseconds, per algorithm
+    pub decompress_nanos: [u64; SFILE_STATS_ALGORITHMS],
+    /// Handle table and handle lock acquisitions that had to wait
+    pub lock_waits: u64,
+    /// Time spent waiting for those locks in nanoseconds
+    pub lock_wait_nanos: u64,
+    /// Calls to `SFileOpenFileEx` on a valid archive
+    pub open_count: u64,
+    /// Total time spent in those calls in nanoseconds
+    pub open_nanos: u64,
+    /// Histogram of `SFileOpenFileEx` latencies
+    pub open_latency: [u64; SFILE_STATS_LATENCY_BUCKETS],
+    /// File reads performed
+    pub read_count: u64,
+    /// Total time spent in those reads in nanoseconds
+    pub read_nanos: u64,
+    /// Histogram of file read latencies
+    pub read_latency: [u64; SFILE_STATS_LATENCY_BUCKETS],
+}
+
+/// Get the process-wide performance counters
+///
+/// Counters cover every archive opened in the process and start at zero, or
+/// at the last `SFileResetStatistics`. Per-file counters are available through
+/// `SFileGetFileInfo` with `SFILE_INFO_READ_COUNT`, `SFILE_INFO_BYTES_DELIVERED`
+/// and `SFILE_INFO_READ_TIME`.
 ///
 /// # Safety
 ///
-/// - `buffer` if not null, must be a valid pointer with at least `buffer_size` bytes
-/// - `size_needed` if not null, must be a valid pointer to write the required size
+/// - `statistics` must be a valid pointer to an `SFILE_STATISTICS`
 #[no_mangle]
-pub unsafe extern "C" fn SFileGetFileInfo(
-    file_or_archive: HANDLE,
-    info_class: u32,
-    buffer: *mut c_void,
-    buffer_size: u32,
-    size_needed: *mut u32,
-) -> bool {
-    if buffer.is_null() && buffer_size > 0 {
+pub unsafe extern "C" fn SFileGetStatistics(statistics: *mut SFILE_STATISTICS) -> bool {
+    if statistics.is_null() {
         set_last_error(ERROR_INVALID_PARAMETER);
         return false;
     }
 
-    // Check if this is a file or archive handle
-    let handle_id = match handle_to_id(file_or_archive) {
-        Some(id) => id,
-        None => {
-            set_last_error(ERROR_INVALID_HANDLE);
-            return false;
-        }
+    let library = wow_mpq::stats::snapshot();
+    let pool = wow_mpq::buffer_pool::global().statistics();
+    let open = stats::OPEN_LATENCY.snapshot();
+    let read = stats::READ_LATENCY.snapshot();
+    let per_algorithm = |field: fn(&wow_mpq::stats::AlgorithmStats) -> u64| {
+        library.decompression.map(|a| field(&a))
+    };
+    *statistics = SFILE_STATISTICS {
+        disk_bytes_read: library.disk_bytes_read,
+        disk_reads: library.disk_reads,
+        mapped_bytes_read: library.mapped_bytes_read,
+        bytes_delivered: stats::BYTES_DELIVERED.load(Ordering::Relaxed),
+        sector_cache_hits: library.sector_cache_hits,
+        sector_cache_misses: library.sector_cache_misses,
+        buffer_pool_hits: pool.hits.load(Ordering::Relaxed),
+        buffer_pool_misses: pool.misses.load(Ordering::Relaxed),
+        decompress_calls: per_algorithm(|a| a.calls),
+        decompress_bytes_in: per_algorithm(|a| a.bytes_in),
+        decompress_bytes_out: per_algorithm(|a| a.bytes_out),
+        decompress_nanos: per_algorithm(|a| a.nanos),
+        lock_waits: stats::LOCK_WAITS.load(Ordering::Relaxed),
+        lock_wait_nanos: stats::LOCK_WAIT_NANOS.load(Ordering::Relaxed),
+        open_count: open.count,
+        open_nanos: open.total_nanos,
+        open_latency: open.buckets,
+        read_count: read.count,
+        read_nanos: read.total_nanos,
+        read_latency: read.buckets,
     };
 
-    // Try as file first
-    if let Some(file_handle) = FILES.lock().unwrap().get(&handle_id) {
-        return get_file_info(file_handle, info_class, buffer, buffer_size, size_needed);
-    }
-
-    // Try as archive
-    if let Some(archive_handle) = ARCHIVES.lock().unwrap().get(&handle_id) {
-        return get_archive_info(archive_handle, info_class, buffer, buffer_size, size_needed);
-    }
+    set_last_error(ERROR_SUCCESS);
+    true
+}
 
-    set_last_error(ERROR_INVALID_HANDLE);
-    false
+/// Reset the counters reported by `SFileGetStatistics`
+///
+/// Buffer pool counters and the per-file counters of open handles are not
+/// affected.
+#[no_mangle]
+pub extern "C" fn SFileResetStatistics() {
+    wow_mpq::stats::reset();
+    stats::reset();
 }
 
-// Helper function for file info
-unsafe fn get_file_info(
-    file_handle: &FileHandle,
-    info_class: u32,
-    buffer: *mut c_void,
-    buffer_size: u32,
-    size_needed: *mut u32,
-) -> bool {
-    match info_class {
-        SFILE_INFO_FILE_SIZE => {
-            let needed = 8u32;
-            if !size_needed.is_null() {
-                *size_needed = needed;
-            }
-            if buffer_size >= needed {
-                *(buffer as *mut u64) = file_handle.size;
-                set_last_error(ERROR_SUCCESS);
-                true
-            } else {
-                set_last_error(ERROR_INSUFFICIENT_BUFFER);
-                false
-            }
-        }
-        SFILE_INFO_POSITION => {
-            let needed = 8u32;
-            if !size_needed.is_null() {
-                *size_needed = needed;
-            }
-            if buffer_size >= needed {
-                *(buffer as *mut u64) = file_handle.position as u64;
-                set_last_error(ERROR_SUCCESS);
-                true
-            } else {
-                set_last_error(ERROR_INSUFFICIENT_BUFFER);
-                false
-            }
-        }
-        _ => {
-            set_last_error(ERROR_NOT_SUPPORTED);
-            false
-        }
-    }
-}
-
-// Helper function for archive info
-unsafe fn get_archive_info(
-    archive_handle: &ArchiveHandle,
-    info_class: u32,
-    buffer: *mut c_void,
-    buffer_size: u32,
-    size_needed: *mut u32,
-) -> bool {
-    let header = archive_handle.archive().header();
-
-    match info_class {
-        SFILE_INFO_ARCHIVE_SIZE => {
-            let needed = 8u32;
-            if !size_needed.is_null() {
-                *size_needed = needed;
-            }
-            if buffer_size >= needed {
-                *(buffer as *mut u64) = header.get_archive_size();
-                set_last_error(ERROR_SUCCESS);
-                true
-            } else {
-                set_last_error(ERROR_INSUFFICIENT_BUFFER);
-                false
-            }
-        }
-        SFILE_INFO_HASH_TABLE_SIZE => {
-            let needed = 4u32;
-            if !size_needed.is_null() {
-                *size_needed = needed;
-            }
-            if buffer_size >= needed {
-                *(buffer as *mut u32) = header.hash_table_size;
-                set_last_error(ERROR_SUCCESS);
-                true
-            } else {
-                set_last_error(ERROR_INSUFFICIENT_BUFFER);
-                false
-            }
-        }
-        SFILE_INFO_BLOCK_TABLE_SIZE => {
-            let needed = 4u32;
-            if !size_needed.is_null() {
-                *size_needed = needed;
-            }
-            if buffer_size >= needed {
-                *(buffer as *mut u32) = header.block_table_size;
-                set_last_error(ERROR_SUCCESS);
-                true
-            } else {
-                set_last_error(ERROR_INSUFFICIENT_BUFFER);
-                false
-            }
-        }
-        SFILE_INFO_SECTOR_SIZE => {
-            let needed = 4u32;
-            if !size_needed.is_null() {
-                *size_needed = needed;
-            }
-            if buffer_size >= needed {
-                *(buffer as *mut u32) = header.sector_size() as u32;
-                set_last_error(ERROR_SUCCESS);
-                true
-            } else {
-                set_last_error(ERROR_INSUFFICIENT_BUFFER);
-                false
-            }
-        }
-        _ => {
-            set_last_error(ERROR_NOT_SUPPORTED);
-            false
-        }
-    }
-}
-
-/// Get archive name from handle
+/// Borrow the contents of an open file without copying
+///
+/// Succeeds for stored (uncompressed, unencrypted) files in an archive opened
+/// with `BASE_PROVIDER_MAP`, which are returned straight from the mapping, and
+/// for files whose contents were decoded in full when they were opened.
+/// Compressed sectored files fail with `ERROR_NOT_SUPPORTED`; read them with
+/// `SFileReadFile` instead.
+///
+/// The returned pointer stays valid until the file handle is closed with
+/// `SFileCloseFile`.
 ///
 /// # Safety
 ///
-/// - `buffer` must be a valid pointer with at least `buffer_size` bytes available
+/// - `data` must be a valid pointer to write the data pointer
+/// - `size` must be a valid pointer to write the low 32 bits of the size
+/// - `size_high` if not null, must be a valid pointer to write the high 32 bits
 #[no_mangle]
-pub unsafe extern "C" fn SFileGetArchiveName(
-    archive: HANDLE,
-    buffer: *mut c_char,
-    buffer_size: u32,
+pub unsafe extern "C" fn SFileMapFile(
+    file: HANDLE,
+    data: *mut *const c_void,
+    size: *mut u32,
+    size_high: *mut u32,
 ) -> bool {
-    if buffer.is_null() || buffer_size == 0 {
+    // Validate parameters
+    if data.is_null() || size.is_null() {
         set_last_error(ERROR_INVALID_PARAMETER);
         return false;
     }
 
-    let Some(archive_id) = handle_to_id(archive) else {
+    let Some(file_id) = handle_to_id(file) else {
         set_last_error(ERROR_INVALID_HANDLE);
         return false;
     };
 
-    let archives = ARCHIVES.lock().unwrap();
-    let Some(archive_handle) = archives.get(&archive_id) else {
+    let Some(file_lock) = FILES.get(file_id) else {
         set_last_error(ERROR_INVALID_HANDLE);
         return false;
     };
+    let file_handle = file_lock.file.lock().unwrap();
 
-    // Convert path to C string
-    let c_path = match CString::new(archive_handle.path()) {
-        Ok(s) => s,
-        Err(_) => {
-            set_last_error(ERROR_INVALID_PARAMETER);
-            return false;
-        }
+    // The slice lives in the handle's stream (or the archive mapping it
+    // holds), so it is not moved or freed until SFileCloseFile
+    let Some(contents) = file_handle.stream.as_slice() else {
+        set_last_error(ERROR_NOT_SUPPORTED);
+        return false;
     };
 
-    let path_bytes = c_path.as_bytes_with_nul();
-    if path_bytes.len() > buffer_size as usize {
-        set_last_error(ERROR_INSUFFICIENT_BUFFER);
-        return false;
+    let len = contents.len() as u64;
+    *data = contents.as_ptr() as *const c_void;
+    *size = len as u32;
+    if !size_high.is_null() {
+        *size_high = (len >> 32) as u32;
     }
 
-    // Copy to buffer
-    std::ptr::copy_nonoverlapping(path_bytes.as_ptr(), buffer as *mut u8, path_bytes.len());
-
     set_last_error(ERROR_SUCCESS);
     true
 }
 
-/// Enumerate files in archive
+/// Get file size
 ///
 /// # Safety
 ///
-/// - `search_mask` if not null, must be a valid null-terminated C string
-/// - `_list_file` if not null, must be a valid null-terminated C string (ignored)
-/// - `callback` function pointer must be valid for the duration of enumeration
+/// - `high` if not null, must be a valid pointer to write the high 32 bits
 #[no_mangle]
-pub unsafe extern "C" fn SFileEnumFiles(
-    archive: HANDLE,
-    search_mask: *const c_char,
-    _list_file: *const c_char, // Path to external listfile (ignored for now)
-    callback: Option<extern "C" fn(*const c_char, *mut c_void) -> bool>,
-    user_data: *mut c_void,
-) -> bool {
-    let Some(callback_fn) = callback else {
-        set_last_error(ERROR_INVALID_PARAMETER);
-        return false;
-    };
-
-    let Some(archive_id) = handle_to_id(archive) else {
+pub unsafe extern "C" fn SFileGetFileSize(file: HANDLE, high: *mut u32) -> u32 {
+    let Some(file_id) = handle_to_id(file) else {
         set_last_error(ERROR_INVALID_HANDLE);
-        return false;
-    };
-
-    // Get search pattern
-    let pattern = if search_mask.is_null() {
-        "*".to_string()
-    } else {
-        match CStr::from_ptr(search_mask).to_str() {
-            Ok(s) => s.to_string(),
-            Err(_) => {
-                set_last_error(ERROR_INVALID_PARAMETER);
-                return false;
-            }
-        }
+        return 0xFFFFFFFF; // INVALID_FILE_SIZE
     };
 
-    // Get archive
-    let mut archives = ARCHIVES.lock().unwrap();
-    let Some(archive_handle) = archives.get_mut(&archive_id) else {
+    let Some(file_lock) = FILES.get(file_id) else {
         set_last_error(ERROR_INVALID_HANDLE);
-        return false;
-    };
-
-    // List files
-    let file_list = match archive_handle {
-        ArchiveHandle::ReadOnly { archive, .. } => archive.list(),
-        ArchiveHandle::Mutable { archive, .. } => archive.list(),
+        return 0xFFFFFFFF;
     };
+    let file_handle = file_lock.file.lock().unwrap();
 
-    match file_list {
-        Ok(entries) => {
-            for entry in entries {
-                // Simple pattern matching (just * for now)
-                if pattern == "*" || entry.name.contains(&pattern.replace("*", "")) {
-                    let c_name = match CString::new(entry.name.as_str()) {
-                        Ok(s) => s,
-                        Err(_) => continue,
-                    };
+    let size = file_handle.size;
 
-                    // Call the callback
-                    if !callback_fn(c_name.as_ptr(), user_data) {
-                        // Callback returned false, stop enumeration
-                        break;
-                    }
-                }
-            }
-            set_last_error(ERROR_SUCCESS);
-            true
-        }
-        Err(_) => {
-            // No listfile, but that's okay
-            set_last_error(ERROR_SUCCESS);
-            true
-        }
+    // Split 64-bit size into high and low parts
+    if !high.is_null() {
+        *high = (size >> 32) as u32;
     }
-}
-
-/// Set locale for file operations
-#[no_mangle]
-pub extern "C" fn SFileSetLocale(locale: u32) -> u32 {
-    let old_locale = LOCALE.with(|l| {
-        let old = *l.borrow();
-        *l.borrow_mut() = locale;
-        old
-    });
-    old_locale
-}
-
-/// Get current locale
-#[no_mangle]
-pub extern "C" fn SFileGetLocale() -> u32 {
-    LOCALE.with(|l| *l.borrow())
-}
-
-/// Get last error
-#[no_mangle]
-pub extern "C" fn SFileGetLastError() -> u32 {
-    LAST_ERROR.with(|e| *e.borrow())
-}
 
-/// Set last error
-#[no_mangle]
-pub extern "C" fn SFileSetLastError(error: u32) {
-    set_last_error(error);
+    set_last_error(ERROR_SUCCESS);
+    (size & 0xFFFFFFFF) as u32
 }
 
-// Additional utility functions
-
-/// Get file name from handle
+/// Get file size as a single 64-bit value
 ///
 /// # Safety
 ///
-/// - `buffer` must be a valid pointer with sufficient space for the filename
+/// - `size` must be a valid pointer to write the file size
 #[no_mangle]
-pub unsafe extern "C" fn SFileGetFileName(file: HANDLE, buffer: *mut c_char) -> bool {
-    if buffer.is_null() {
+pub unsafe extern "C" fn SFileGetFileSize64(file: HANDLE, size: *mut u64) -> bool {
+    if size.is_null() {
         set_last_error(ERROR_INVALID_PARAMETER);
         return false;
     }
@@ -978,636 +1588,769 @@ pub unsafe extern "C" fn SFileGetFileName(file: HANDLE, buffer: *mut c_char) ->
         return false;
     };
 
-    let files = FILES.lock().unwrap();
-    let Some(file_handle) = files.get(&file_id) else {
+    let Some(file_lock) = FILES.get(file_id) else {
         set_last_error(ERROR_INVALID_HANDLE);
         return false;
     };
-
-    let c_name = match CString::new(file_handle.filename.as_str()) {
-        Ok(s) => s,
-        Err(_) => {
-            set_last_error(ERROR_INVALID_PARAMETER);
-            return false;
-        }
-    };
-
-    std::ptr::copy_nonoverlapping(c_name.as_ptr(), buffer, c_name.as_bytes_with_nul().len());
+    *size = file_lock.file.lock().unwrap().size;
 
     set_last_error(ERROR_SUCCESS);
     true
 }
 
-/// Extract a file from archive to disk
+/// Set file position
 ///
 /// # Safety
 ///
-/// - `filename` must be a valid null-terminated C string
-/// - `local_filename` must be a valid null-terminated C string
+/// - `file_pos_high` if not null, must be a valid pointer to read/write the high 32 bits
 #[no_mangle]
-pub unsafe extern "C" fn SFileExtractFile(
-    archive: HANDLE,
-    filename: *const c_char,
-    local_filename: *const c_char,
-    _search_scope: u32, // Ignored - StormLib legacy parameter
-) -> bool {
-    // Validate parameters
-    if filename.is_null() || local_filename.is_null() {
-        set_last_error(ERROR_INVALID_PARAMETER);
-        return false;
-    }
+pub unsafe extern "C" fn SFileSetFilePointer(
+    file: HANDLE,
+    file_pos: i32,
+    file_pos_high: *mut i32,
+    move_method: u32, // 0=FILE_BEGIN, 1=FILE_CURRENT, 2=FILE_END
+) -> u32 {
+    // Combine high and low parts into 64-bit offset; without a high part the
+    // low part is a signed distance
+    let offset = if file_pos_high.is_null() {
+        i64::from(file_pos)
+    } else {
+        (i64::from(*file_pos_high) << 32) | i64::from(file_pos as u32)
+    };
 
-    let Some(archive_id) = handle_to_id(archive) else {
+    let mut pos = 0u64;
+    if !SFileSeek64(file, offset, move_method, &mut pos) {
+        return 0xFFFFFFFF;
+    }
+
+    // Return new position
+    if !file_pos_high.is_null() {
+        *file_pos_high = (pos >> 32) as i32;
+    }
+
+    set_last_error(ERROR_SUCCESS);
+    (pos & 0xFFFFFFFF) as u32
+}
+
+/// Move a file's position by a 64-bit offset
+///
+/// `move_method` is 0 (from the start), 1 (from the current position) or
+/// 2 (from the end). The result is clamped to the file, and written to
+/// `new_position` if it is not null.
+///
+/// # Safety
+///
+/// - `new_position` if not null, must be a valid pointer to write the new position
+#[no_mangle]
+pub unsafe extern "C" fn SFileSeek64(
+    file: HANDLE,
+    offset: i64,
+    move_method: u32,
+    new_position: *mut u64,
+) -> bool {
+    let Some(file_id) = handle_to_id(file) else {
         set_last_error(ERROR_INVALID_HANDLE);
         return false;
     };
 
-    // Convert filenames from C strings
-    let source_filename = match CStr::from_ptr(filename).to_str() {
-        Ok(s) => s,
-        Err(_) => {
-            set_last_error(ERROR_INVALID_PARAMETER);
-            return false;
-        }
+    let Some(file_lock) = FILES.get(file_id) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
     };
+    let mut file_guard = stats::lock(&file_lock.file);
+    let file_handle = &mut *file_guard;
 
-    let dest_filename = match CStr::from_ptr(local_filename).to_str() {
-        Ok(s) => s,
-        Err(_) => {
+    // Calculate new position
+    let file_len = file_handle.stream.len();
+    let base = match move_method {
+        0 => 0,                    // FILE_BEGIN
+        1 => file_handle.position, // FILE_CURRENT
+        2 => file_len,             // FILE_END
+        _ => {
             set_last_error(ERROR_INVALID_PARAMETER);
             return false;
         }
     };
+    let new_pos = base.saturating_add_signed(offset);
 
-    // Get the archive
-    let mut archives = ARCHIVES.lock().unwrap();
-    let Some(archive_handle) = archives.get_mut(&archive_id) else {
+    // Clamp to file size
+    file_handle.position = new_pos.min(file_len);
+
+    if !new_position.is_null() {
+        *new_position = file_handle.position;
+    }
+
+    set_last_error(ERROR_SUCCESS);
+    true
+}
+
+/// Get a file's current position
+///
+/// # Safety
+///
+/// - `file_pos_high` if not null, must be a valid pointer to write the high 32 bits
+#[no_mangle]
+pub unsafe extern "C" fn SFileGetFilePointer(file: HANDLE, file_pos_high: *mut i32) -> u32 {
+    let Some(file_id) = handle_to_id(file) else {
         set_last_error(ERROR_INVALID_HANDLE);
-        return false;
+        return 0xFFFFFFFF; // INVALID_SET_FILE_POINTER
     };
 
-    // Try to read the file from the archive
-    let file_data = match archive_handle {
-        ArchiveHandle::ReadOnly { archive, .. } => archive.read_file(source_filename),
-        ArchiveHandle::Mutable { archive, .. } => archive.read_file(source_filename),
+    let Some(file_lock) = FILES.get(file_id) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return 0xFFFFFFFF;
     };
+    let pos = file_lock.file.lock().unwrap().position;
 
-    match file_data {
-        Ok(data) => {
-            // Create parent directories if they don't exist
-            let dest_path = Path::new(dest_filename);
-            if let Some(parent) = dest_path.parent() {
-                if fs::create_dir_all(parent).is_err() {
-                    set_last_error(ERROR_ACCESS_DENIED);
-                    return false;
-                }
-            }
-
-            // Write the file data to disk
-            match fs::write(dest_path, data) {
-                Ok(_) => {
-                    set_last_error(ERROR_SUCCESS);
-                    true
-                }
-                Err(_) => {
-                    set_last_error(ERROR_ACCESS_DENIED);
-                    false
-                }
-            }
-        }
-        Err(e) => {
-            // Map wow_mpq errors to Windows error codes
-            let error_code = match e {
-                wow_mpq::Error::FileNotFound(_) => ERROR_FILE_NOT_FOUND,
-                wow_mpq::Error::InvalidFormat(_) => ERROR_FILE_CORRUPT,
-                wow_mpq::Error::Io(_) => ERROR_ACCESS_DENIED,
-                _ => ERROR_FILE_CORRUPT,
-            };
-            set_last_error(error_code);
-            false
-        }
+    if !file_pos_high.is_null() {
+        *file_pos_high = (pos >> 32) as i32;
     }
+
+    set_last_error(ERROR_SUCCESS);
+    (pos & 0xFFFFFFFF) as u32
 }
 
-/// Verify file integrity
+/// Check if file exists in archive
 ///
 /// # Safety
 ///
 /// - `filename` must be a valid null-terminated C string
 #[no_mangle]
-pub unsafe extern "C" fn SFileVerifyFile(
-    archive: HANDLE,
-    filename: *const c_char,
-    flags: u32,
-) -> bool {
-    // Validate parameters
+pub unsafe extern "C" fn SFileHasFile(archive: HANDLE, filename: *const c_char) -> bool {
     if filename.is_null() {
-        set_last_error(ERROR_INVALID_PARAMETER);
         return false;
     }
 
     let Some(archive_id) = handle_to_id(archive) else {
-        set_last_error(ERROR_INVALID_HANDLE);
         return false;
     };
 
-    // Convert filename from C string
     let filename_str = match CStr::from_ptr(filename).to_str() {
         Ok(s) => s,
-        Err(_) => {
-            set_last_error(ERROR_INVALID_PARAMETER);
-            return false;
-        }
+        Err(_) => return false,
     };
 
-    // Get the archive
-    let mut archives = ARCHIVES.lock().unwrap();
-    let Some(archive_handle) = archives.get_mut(&archive_id) else {
+    if let Some(folder) = DATA_FOLDERS.get(archive_id) {
+        return folder.contains_file(filename_str);
+    }
+    if let Some(archive_lock) = lookup_archive(archive_id) {
+        archive_lock.read().unwrap().has_file(filename_str)
+    } else {
+        false
+    }
+}
+
+/// Look up many files at once
+///
+/// Writes the block index of each of the `count` names to `block_indices`,
+/// or 0xFFFFFFFF for names that are not found. Names are hashed in one batch
+/// and the hash table is probed in bucket order, which suits resolving a
+/// whole listfile; HET/BET archives look names up one by one. For data
+/// folder handles the index is the block within the archive serving the
+/// file, and for patched archives the block within the highest priority
+/// archive that has it.
+///
+/// `found_count`, if not null, receives the number of names found.
+///
+/// # Safety
+///
+/// - `names` must point to `count` valid null-terminated C strings
+/// - `block_indices` must be a valid pointer to `count` writable DWORDs
+/// - `found_count` if not null, must be a valid pointer to write the count
+#[no_mangle]
+pub unsafe extern "C" fn SFileFindFilesBatch(
+    archive: HANDLE,
+    names: *const *const c_char,
+    count: u32,
+    block_indices: *mut u32,
+    found_count: *mut u32,
+) -> bool {
+    if !found_count.is_null() {
+        *found_count = 0;
+    }
+
+    if count > 0 && (names.is_null() || block_indices.is_null()) {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+
+    let Some(archive_id) = handle_to_id(archive) else {
         set_last_error(ERROR_INVALID_HANDLE);
         return false;
     };
 
-    // Find the file first to get file info
-    let file_info = match archive_handle.archive().find_file(filename_str) {
-        Ok(Some(info)) => info,
-        Ok(None) => {
-            set_last_error(ERROR_FILE_NOT_FOUND);
-            return false;
-        }
-        Err(_) => {
-            set_last_error(ERROR_FILE_CORRUPT);
+    let mut name_strs = Vec::with_capacity(count as usize);
+    for i in 0..count as usize {
+        let name = *names.add(i);
+        if name.is_null() {
+            set_last_error(ERROR_INVALID_PARAMETER);
             return false;
         }
-    };
-
-    // If no flags specified, verify everything available
-    let verify_flags = if flags == 0 { SFILE_VERIFY_ALL } else { flags };
-
-    // Verify sector CRC (if requested and available)
-    if (verify_flags & SFILE_VERIFY_SECTOR_CRC) != 0 && file_info.has_sector_crc() {
-        // Reading the file automatically validates sector CRCs
-        let read_result = match archive_handle {
-            ArchiveHandle::ReadOnly { archive, .. } => archive.read_file(filename_str),
-            ArchiveHandle::Mutable { archive, .. } => archive.read_file(filename_str),
-        };
-        match read_result {
-            Ok(_) => {
-                // File read successfully, CRCs validated automatically
-            }
-            Err(wow_mpq::Error::ChecksumMismatch { .. }) => {
-                set_last_error(ERROR_FILE_CORRUPT);
-                return false;
-            }
+        match CStr::from_ptr(name).to_str() {
+            Ok(name) => name_strs.push(name),
             Err(_) => {
-                set_last_error(ERROR_FILE_CORRUPT);
+                set_last_error(ERROR_INVALID_PARAMETER);
                 return false;
             }
         }
     }
 
-    // Verify file CRC32 from attributes (if requested and available)
-    if (verify_flags & SFILE_VERIFY_FILE_CRC) != 0 {
-        // Load attributes if not already loaded
-        // Load attributes if possible
-        match archive_handle {
-            ArchiveHandle::ReadOnly { archive, .. } => {
-                let _ = archive.load_attributes();
-            }
-            ArchiveHandle::Mutable { archive, .. } => {
-                let _ = archive.load_attributes();
-            }
-        }
-
-        if let Some(attrs) = archive_handle
+    let mut blocks: Vec<Option<usize>> = Vec::with_capacity(name_strs.len());
+    if let Some(folder) = DATA_FOLDERS.get(archive_id) {
+        let mut locations = Vec::with_capacity(name_strs.len());
+        folder.locate_batch(&name_strs, &mut locations);
+        blocks.extend(locations.iter().map(|location| location.map(|l| l.block)));
+    } else {
+        let Some(archive_lock) = lookup_archive(archive_id) else {
+            return false;
+        };
+        let archive_guard = archive_lock.read().unwrap();
+        if let Some(chain) = archive_guard.patch_chain() {
+            blocks.extend(
+                name_strs
+                    .iter()
+                    .map(|name| chain.find_file(name).map(|info| info.block_index)),
+            );
+        } else if let Err(e) = archive_guard
             .archive()
-            .get_file_attributes(file_info.block_index)
+            .find_files_batch(&name_strs, &mut blocks)
         {
-            if let Some(expected_crc) = attrs.crc32 {
-                // Read file data to calculate CRC
-                let read_result = match archive_handle {
-                    ArchiveHandle::ReadOnly { archive, .. } => archive.read_file(filename_str),
-                    ArchiveHandle::Mutable { archive, .. } => archive.read_file(filename_str),
-                };
-                match read_result {
-                    Ok(data) => {
-                        let actual_crc = crc32fast::hash(&data);
-                        if actual_crc != expected_crc {
-                            set_last_error(ERROR_FILE_CORRUPT);
-                            return false;
-                        }
-                    }
-                    Err(_) => {
-                        set_last_error(ERROR_FILE_CORRUPT);
-                        return false;
-                    }
-                }
-            }
+            set_last_error(extract_error_code(e));
+            return false;
         }
     }
 
-    // Verify file MD5 from attributes (if requested and available)
-    if (verify_flags & SFILE_VERIFY_FILE_MD5) != 0 {
-        // Load attributes if not already loaded
-        // Load attributes if possible
-        match archive_handle {
-            ArchiveHandle::ReadOnly { archive, .. } => {
-                let _ = archive.load_attributes();
-            }
-            ArchiveHandle::Mutable { archive, .. } => {
-                let _ = archive.load_attributes();
-            }
-        }
-
-        if let Some(attrs) = archive_handle
-            .archive()
-            .get_file_attributes(file_info.block_index)
-        {
-            if let Some(expected_md5) = attrs.md5 {
-                // Read file data to calculate MD5
-                let read_result = match archive_handle {
-                    ArchiveHandle::ReadOnly { archive, .. } => archive.read_file(filename_str),
-                    ArchiveHandle::Mutable { archive, .. } => archive.read_file(filename_str),
-                };
-                match read_result {
-                    Ok(data) => {
-                        use md5::{Digest, Md5};
-                        let mut hasher = Md5::new();
-                        hasher.update(&data);
-                        let actual_md5: [u8; 16] = hasher.finalize().into();
-                        if actual_md5 != expected_md5 {
-                            set_last_error(ERROR_FILE_CORRUPT);
-                            return false;
-                        }
-                    }
-                    Err(_) => {
-                        set_last_error(ERROR_FILE_CORRUPT);
-                        return false;
-                    }
-                }
+    let out = std::slice::from_raw_parts_mut(block_indices, blocks.len());
+    let mut found = 0;
+    for (slot, block) in out.iter_mut().zip(&blocks) {
+        *slot = match block {
+            Some(block) => {
+                found += 1;
+                *block as u32
             }
-        }
+            None => 0xFFFFFFFF,
+        };
+    }
+    if !found_count.is_null() {
+        *found_count = found;
     }
 
     set_last_error(ERROR_SUCCESS);
     true
 }
 
-/// Verify archive integrity
+/// Get file information
 ///
 /// # Safety
 ///
-/// This function is unsafe because it:
-/// - Dereferences raw pointers passed as HANDLE arguments
-/// - Calls other unsafe functions that manipulate raw pointers
-/// - Must be called with valid archive handles obtained from `SFileOpenArchive`
+/// - `buffer` if not null, must be a valid pointer with at least `buffer_size` bytes
+/// - `size_needed` if not null, must be a valid pointer to write the required size
 #[no_mangle]
-pub unsafe extern "C" fn SFileVerifyArchive(archive: HANDLE, flags: u32) -> bool {
-    let Some(archive_id) = handle_to_id(archive) else {
-        set_last_error(ERROR_INVALID_HANDLE);
-        return false;
-    };
-
-    // Get the archive
-    let mut archives = ARCHIVES.lock().unwrap();
-    let Some(archive_handle) = archives.get_mut(&archive_id) else {
-        set_last_error(ERROR_INVALID_HANDLE);
+pub unsafe extern "C" fn SFileGetFileInfo(
+    file_or_archive: HANDLE,
+    info_class: u32,
+    buffer: *mut c_void,
+    buffer_size: u32,
+    size_needed: *mut u32,
+) -> bool {
+    if buffer.is_null() && buffer_size > 0 {
+        set_last_error(ERROR_INVALID_PARAMETER);
         return false;
-    };
+    }
 
-    // If no flags specified, verify signature by default
-    let verify_flags = if flags == 0 {
-        SFILE_VERIFY_SIGNATURE
-    } else {
-        flags
+    // Check if this is a file or archive handle
+    let handle_id = match handle_to_id(file_or_archive) {
+        Some(id) => id,
+        None => {
+            set_last_error(ERROR_INVALID_HANDLE);
+            return false;
+        }
     };
 
-    // Verify digital signature (if requested)
-    if (verify_flags & SFILE_VERIFY_SIGNATURE) != 0 {
-        // Verify signature
-        let signature_result = match archive_handle {
-            ArchiveHandle::ReadOnly { archive, .. } => archive.verify_signature(),
-            ArchiveHandle::Mutable { archive, .. } => archive.verify_signature(),
-        };
-
-        match signature_result {
-            Ok(wow_mpq::SignatureStatus::WeakValid) | Ok(wow_mpq::SignatureStatus::StrongValid) => {
-                // Valid signature found
-            }
-            Ok(wow_mpq::SignatureStatus::None) => {
-                // No signature is acceptable for some archives
-            }
-            Ok(wow_mpq::SignatureStatus::WeakInvalid)
-            | Ok(wow_mpq::SignatureStatus::StrongInvalid) => {
-                set_last_error(ERROR_FILE_CORRUPT);
-                return false;
-            }
-            Ok(wow_mpq::SignatureStatus::StrongNoKey) => {
-                // Strong signature present but no key - treat as warning, continue
-            }
-            Err(_) => {
-                set_last_error(ERROR_FILE_CORRUPT);
-                return false;
-            }
-        }
+    // Try as file first
+    if let Some(file_lock) = FILES.get(handle_id) {
+        let file_handle = stats::lock(&file_lock.file);
+        return get_file_info(&file_handle, info_class, buffer, buffer_size, size_needed);
     }
 
-    // Verify all files in the archive (if requested)
-    if (verify_flags & SFILE_VERIFY_ALL_FILES) != 0 {
-        // Get list of all files in the archive
-        let file_list = match archive_handle {
-            ArchiveHandle::ReadOnly { archive, .. } => archive.list(),
-            ArchiveHandle::Mutable { archive, .. } => archive.list(),
-        };
-        let file_list = file_list.unwrap_or_default();
-
-        // Verify each file individually
-        for file_entry in file_list {
-            // Skip special files and directories
-            if file_entry.name.starts_with('(') && file_entry.name.ends_with(')') {
-                continue;
-            }
-            if file_entry.name.ends_with('/') || file_entry.name.ends_with('\\') {
-                continue;
-            }
-
-            // Determine what verification to perform based on file flags
-            let file_verify_flags = if file_entry.has_sector_crc() {
-                SFILE_VERIFY_SECTOR_CRC
-            } else {
-                0
-            };
+    // Try as archive
+    if let Some(archive_lock) = ARCHIVES.get(handle_id) {
+        let archive_handle = archive_lock.read().unwrap();
+        return get_archive_info(
+            &archive_handle,
+            info_class,
+            buffer,
+            buffer_size,
+            size_needed,
+        );
+    }
 
-            // Add CRC/MD5 verification if attributes are available
-            let all_verify_flags =
-                file_verify_flags | SFILE_VERIFY_FILE_CRC | SFILE_VERIFY_FILE_MD5;
+    set_last_error(ERROR_INVALID_HANDLE);
+    false
+}
 
-            // Use our own SFileVerifyFile function for consistency
-            unsafe {
-                let filename_cstr = match std::ffi::CString::new(file_entry.name.as_str()) {
-                    Ok(s) => s,
-                    Err(_) => continue, // Skip files with invalid names
-                };
-
-                if !SFileVerifyFile(
-                    id_to_handle(archive_id),
-                    filename_cstr.as_ptr(),
-                    all_verify_flags,
-                ) {
-                    let last_error = SFileGetLastError();
-                    // Only fail on corruption, not missing attributes
-                    if last_error == ERROR_FILE_CORRUPT {
-                        return false;
-                    }
+// Helper function for file info
+unsafe fn get_file_info(
+    file_handle: &FileHandle,
+    info_class: u32,
+    buffer: *mut c_void,
+    buffer_size: u32,
+    size_needed: *mut u32,
+) -> bool {
+    match info_class {
+        SFILE_INFO_FILE_SIZE => {
+            let needed = 8u32;
+            if !size_needed.is_null() {
+                *size_needed = needed;
+            }
+            if buffer_size >= needed {
+                *(buffer as *mut u64) = file_handle.size;
+                set_last_error(ERROR_SUCCESS);
+                true
+            } else {
+                set_last_error(ERROR_INSUFFICIENT_BUFFER);
+                false
+            }
+        }
+        SFILE_INFO_POSITION => {
+            let needed = 8u32;
+            if !size_needed.is_null() {
+                *size_needed = needed;
+            }
+            if buffer_size >= needed {
+                *(buffer as *mut u64) = file_handle.position;
+                set_last_error(ERROR_SUCCESS);
+                true
+            } else {
+                set_last_error(ERROR_INSUFFICIENT_BUFFER);
+                false
+            }
+        }
+        SFILE_INFO_READ_COUNT | SFILE_INFO_BYTES_DELIVERED | SFILE_INFO_READ_TIME => {
+            let value = match info_class {
+                SFILE_INFO_READ_COUNT => file_handle.reads,
+                SFILE_INFO_BYTES_DELIVERED => file_handle.bytes_delivered,
+                _ => file_handle.read_nanos,
+            };
+
+            let needed = 8u32;
+            if !size_needed.is_null() {
+                *size_needed = needed;
+            }
+            if buffer_size >= needed {
+                *(buffer as *mut u64) = value;
+                set_last_error(ERROR_SUCCESS);
+                true
+            } else {
+                set_last_error(ERROR_INSUFFICIENT_BUFFER);
+                false
+            }
+        }
+        SFILE_INFO_COMPRESSED_SIZE | SFILE_INFO_FLAGS | SFILE_INFO_KEY => {
+            // The table entry the stream was opened from, which for data
+            // folders may be in any of their archives
+            let (Some(file_info), Some(key)) =
+                (file_handle.stream.file_info(), file_handle.stream.key())
+            else {
+                // Files served from a patch chain or pending changes
+                set_last_error(ERROR_NOT_SUPPORTED);
+                return false;
+            };
+
+            let needed = match info_class {
+                SFILE_INFO_COMPRESSED_SIZE => 8u32,
+                _ => 4u32,
+            };
+            if !size_needed.is_null() {
+                *size_needed = needed;
+            }
+            if buffer_size >= needed {
+                match info_class {
+                    SFILE_INFO_COMPRESSED_SIZE => {
+                        *(buffer as *mut u64) = file_info.compressed_size;
+                    }
+                    SFILE_INFO_FLAGS => *(buffer as *mut u32) = file_info.flags,
+                    _ => *(buffer as *mut u32) = key,
                 }
+                set_last_error(ERROR_SUCCESS);
+                true
+            } else {
+                set_last_error(ERROR_INSUFFICIENT_BUFFER);
+                false
             }
         }
+        _ => {
+            set_last_error(ERROR_NOT_SUPPORTED);
+            false
+        }
     }
+}
 
-    set_last_error(ERROR_SUCCESS);
-    true
+// Helper function for archive info
+unsafe fn get_archive_info(
+    archive_handle: &ArchiveHandle,
+    info_class: u32,
+    buffer: *mut c_void,
+    buffer_size: u32,
+    size_needed: *mut u32,
+) -> bool {
+    let header = archive_handle.archive().header();
+
+    match info_class {
+        SFILE_INFO_ARCHIVE_SIZE => {
+            let needed = 8u32;
+            if !size_needed.is_null() {
+                *size_needed = needed;
+            }
+            if buffer_size >= needed {
+                *(buffer as *mut u64) = header.get_archive_size();
+                set_last_error(ERROR_SUCCESS);
+                true
+            } else {
+                set_last_error(ERROR_INSUFFICIENT_BUFFER);
+                false
+            }
+        }
+        SFILE_INFO_HASH_TABLE_SIZE => {
+            let needed = 4u32;
+            if !size_needed.is_null() {
+                *size_needed = needed;
+            }
+            if buffer_size >= needed {
+                *(buffer as *mut u32) = header.hash_table_size;
+                set_last_error(ERROR_SUCCESS);
+                true
+            } else {
+                set_last_error(ERROR_INSUFFICIENT_BUFFER);
+                false
+            }
+        }
+        SFILE_INFO_BLOCK_TABLE_SIZE => {
+            let needed = 4u32;
+            if !size_needed.is_null() {
+                *size_needed = needed;
+            }
+            if buffer_size >= needed {
+                *(buffer as *mut u32) = header.block_table_size;
+                set_last_error(ERROR_SUCCESS);
+                true
+            } else {
+                set_last_error(ERROR_INSUFFICIENT_BUFFER);
+                false
+            }
+        }
+        SFILE_INFO_SECTOR_SIZE => {
+            let needed = 4u32;
+            if !size_needed.is_null() {
+                *size_needed = needed;
+            }
+            if buffer_size >= needed {
+                *(buffer as *mut u32) = header.sector_size() as u32;
+                set_last_error(ERROR_SUCCESS);
+                true
+            } else {
+                set_last_error(ERROR_INSUFFICIENT_BUFFER);
+                false
+            }
+        }
+        SFILE_INFO_LOOKUP_CACHE_HITS
+        | SFILE_INFO_LOOKUP_CACHE_MISSES
+        | SFILE_INFO_LOOKUP_CACHE_ENTRIES
+        | SFILE_INFO_SECTOR_CACHE_HITS
+        | SFILE_INFO_SECTOR_CACHE_MISSES
+        | SFILE_INFO_SECTOR_CACHE_BYTES => {
+            // All counters read as zero while the caches are disabled
+            let stats = archive_handle
+                .archive()
+                .lookup_cache_stats()
+                .unwrap_or_default();
+            let sectors = archive_handle
+                .archive()
+                .sector_cache_stats()
+                .unwrap_or_default();
+            let value = match info_class {
+                SFILE_INFO_LOOKUP_CACHE_HITS => stats.hits,
+                SFILE_INFO_LOOKUP_CACHE_MISSES => stats.misses,
+                SFILE_INFO_LOOKUP_CACHE_ENTRIES => stats.entries as u64,
+                SFILE_INFO_SECTOR_CACHE_HITS => sectors.hits,
+                SFILE_INFO_SECTOR_CACHE_MISSES => sectors.misses,
+                _ => sectors.bytes as u64,
+            };
+
+            let needed = 8u32;
+            if !size_needed.is_null() {
+                *size_needed = needed;
+            }
+            if buffer_size >= needed {
+                *(buffer as *mut u64) = value;
+                set_last_error(ERROR_SUCCESS);
+                true
+            } else {
+                set_last_error(ERROR_INSUFFICIENT_BUFFER);
+                false
+            }
+        }
+        _ => {
+            set_last_error(ERROR_NOT_SUPPORTED);
+            false
+        }
+    }
 }
 
-/// Add a file to an archive from disk with extended options
+/// Metadata of one stored file, see `SFileGetFileMetadata`
+#[repr(C)]
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq)]
+pub struct SFILE_METADATA {
+    /// Hash table name hashes (`name_1` high, `name_2` low), or the BET hash
+    pub name_hash: u64,
+    /// Absolute file position in the archive file
+    pub file_pos: u64,
+    /// Uncompressed file size
+    pub file_size: u64,
+    /// Compressed file size
+    pub compressed_size: u64,
+    /// File time from (attributes), 0 if not present
+    pub file_time: u64,
+    /// Hash table index (0xFFFFFFFF for HET/BET archives)
+    pub hash_index: u32,
+    /// Block table index
+    pub block_index: u32,
+    /// File flags from block table
+    pub file_flags: u32,
+    /// CRC32 from (attributes), 0 if not present
+    pub crc32: u32,
+    /// File locale
+    pub locale: u32,
+    /// `MPQ_ATTRIBUTE_*` bits telling which of crc32, file_time and md5 are set
+    pub attribute_flags: u32,
+    /// MD5 from (attributes), zero if not present
+    pub md5: [u8; 16],
+}
+
+impl From<&FileMetadata> for SFILE_METADATA {
+    fn from(entry: &FileMetadata) -> Self {
+        let mut attribute_flags = 0;
+        if entry.crc32.is_some() {
+            attribute_flags |= MPQ_ATTRIBUTE_CRC32;
+        }
+        if entry.filetime.is_some() {
+            attribute_flags |= MPQ_ATTRIBUTE_FILETIME;
+        }
+        if entry.md5.is_some() {
+            attribute_flags |= MPQ_ATTRIBUTE_MD5;
+        }
+
+        Self {
+            name_hash: entry.name_hash,
+            file_pos: entry.file_pos,
+            file_size: entry.file_size,
+            compressed_size: entry.compressed_size,
+            file_time: entry.filetime.unwrap_or(0),
+            hash_index: entry.hash_index.map_or(u32::MAX, |i| i as u32),
+            block_index: entry.block_index as u32,
+            file_flags: entry.flags,
+            crc32: entry.crc32.unwrap_or(0),
+            locale: u32::from(entry.locale),
+            attribute_flags,
+            md5: entry.md5.unwrap_or_default(),
+        }
+    }
+}
+
+/// Get the metadata of every stored file without opening any of them
+///
+/// Fills `entries` with up to `max_entries` records read straight from the
+/// archive tables and `(attributes)`, ordered by block index; no file data is
+/// read or decompressed. `entry_count` receives the number of stored files.
+/// If `max_entries` is too small the first `max_entries` records are still
+/// written and the call fails with `ERROR_INSUFFICIENT_BUFFER`, so passing
+/// null and 0 queries the required count. Mutable archives report their
+/// tables as last written to disk.
 ///
 /// # Safety
 ///
 /// - `archive` must be a valid archive handle
-/// - `filename` and `archived_name` must be valid null-terminated C strings
+/// - `entries` must be null or point to `max_entries` writable records
+/// - `entry_count` must be null or a valid pointer
 #[no_mangle]
-pub unsafe extern "C" fn SFileAddFileEx(
+pub unsafe extern "C" fn SFileGetFileMetadata(
     archive: HANDLE,
-    filename: *const c_char,
-    archived_name: *const c_char,
-    flags: u32,
-    compression: u32,
-    _compression_next: u32,
+    entries: *mut SFILE_METADATA,
+    max_entries: u32,
+    entry_count: *mut u32,
 ) -> bool {
-    // Validate parameters
-    if archive.is_null() || filename.is_null() || archived_name.is_null() {
+    if entries.is_null() && max_entries != 0 {
         set_last_error(ERROR_INVALID_PARAMETER);
         return false;
     }
 
-    // Convert handle
-    let archive_id = match handle_to_id(archive) {
-        Some(id) => id,
-        None => {
-            set_last_error(ERROR_INVALID_HANDLE);
-            return false;
-        }
+    let Some(archive_id) = handle_to_id(archive) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
     };
-
-    // Convert strings
-    let filename_str = match CStr::from_ptr(filename).to_str() {
-        Ok(s) => s,
-        Err(_) => {
-            set_last_error(ERROR_INVALID_PARAMETER);
-            return false;
-        }
+    let Some(archive_lock) = lookup_archive(archive_id) else {
+        return false;
     };
 
-    let archived_name_str = match CStr::from_ptr(archived_name).to_str() {
-        Ok(s) => s,
-        Err(_) => {
-            set_last_error(ERROR_INVALID_PARAMETER);
-            return false;
-        }
+    // Attributes are loaded once; afterwards only the read lock is needed
+    ensure_attributes_loaded(&archive_lock);
+    let metadata = archive_lock.read().unwrap().archive().file_metadata();
+
+    for (i, entry) in metadata.iter().take(max_entries as usize).enumerate() {
+        entries.add(i).write(SFILE_METADATA::from(entry));
+    }
+    if !entry_count.is_null() {
+        *entry_count = metadata.len() as u32;
+    }
+
+    if metadata.len() > max_entries as usize {
+        set_last_error(ERROR_INSUFFICIENT_BUFFER);
+        return false;
+    }
+
+    set_last_error(ERROR_SUCCESS);
+    true
+}
+
+/// Set the size of an archive's file lookup cache
+///
+/// The cache remembers resolved names (including missing ones) so repeated
+/// `SFileHasFile` and `SFileOpenFileEx` calls skip hashing and table probes.
+/// `max_entries` of 0 disables it. Hit and miss counters are available through
+/// `SFileGetFileInfo`. Only supported on read-only archives.
+#[no_mangle]
+pub extern "C" fn SFileSetLookupCacheSize(archive: HANDLE, max_entries: u32) -> bool {
+    let Some(archive_id) = handle_to_id(archive) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
     };
 
-    // Get mutable archive handle
-    let mut archives = ARCHIVES.lock().unwrap();
-    let archive_handle = match archives.get_mut(&archive_id) {
-        Some(handle) => handle,
-        None => {
-            set_last_error(ERROR_INVALID_HANDLE);
-            return false;
-        }
+    let Some(archive_lock) = ARCHIVES.get(archive_id) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
     };
+    let mut archive_guard = archive_lock.write().unwrap();
 
-    let mutable_archive = match archive_handle.mutable_archive() {
-        Some(archive) => archive,
-        None => {
+    match &mut *archive_guard {
+        ArchiveHandle::ReadOnly { archive, .. } => {
+            archive.set_lookup_cache_capacity(max_entries as usize);
+            set_last_error(ERROR_SUCCESS);
+            true
+        }
+        ArchiveHandle::Mutable { .. } => {
             set_last_error(ERROR_ACCESS_DENIED);
-            return false;
+            false
         }
-    };
+    }
+}
 
-    // Configure options based on flags and compression
-    let mut options = AddFileOptions::new();
+/// Pre-warm an archive's lookup cache from a listfile
+///
+/// `listfile` is the path of a listfile on disk; if null, the archive's own
+/// `(listfile)` is used. The cache is enabled if necessary, sized to hold every
+/// listed name. `found`, if not null, receives how many of the names exist.
+///
+/// # Safety
+///
+/// - `listfile` if not null, must be a valid null-terminated C string
+/// - `found` if not null, must be a valid pointer to write the count
+#[no_mangle]
+pub unsafe extern "C" fn SFilePrewarmLookupCache(
+    archive: HANDLE,
+    listfile: *const c_char,
+    found: *mut u32,
+) -> bool {
+    let Some(archive_id) = handle_to_id(archive) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
+    };
 
-    // Set compression method
-    use wow_mpq::compression::CompressionMethod;
-    let compression_method = match compression {
-        0 => CompressionMethod::None,
-        0x02 => CompressionMethod::Zlib,
-        0x08 => CompressionMethod::PKWare,
-        0x10 => CompressionMethod::BZip2,
-        0x20 => CompressionMethod::Sparse,
-        0x40 => CompressionMethod::AdpcmMono,
-        0x80 => CompressionMethod::AdpcmStereo,
-        0x12 => CompressionMethod::Lzma,
-        _ => CompressionMethod::Zlib, // Default fallback
-    };
-    options = options.compression(compression_method);
-
-    // Handle flags
-    const MPQ_FILE_ENCRYPTED: u32 = 0x00010000;
-    const MPQ_FILE_FIX_KEY: u32 = 0x00020000;
-    const MPQ_FILE_REPLACEEXISTING: u32 = 0x80000000;
-
-    if (flags & MPQ_FILE_ENCRYPTED) != 0 {
-        options = options.encrypt();
-    }
-    if (flags & MPQ_FILE_FIX_KEY) != 0 {
-        options = options.fix_key();
-    }
-    if (flags & MPQ_FILE_REPLACEEXISTING) != 0 {
-        options = options.replace_existing(true);
-    }
-
-    // Add the file
-    match mutable_archive.add_file(filename_str, archived_name_str, options) {
-        Ok(()) => {
-            set_last_error(ERROR_SUCCESS);
-            true
-        }
-        Err(e) => {
-            let error_code = match e {
-                wow_mpq::Error::FileNotFound(_) => ERROR_FILE_NOT_FOUND,
-                wow_mpq::Error::FileExists(_) => ERROR_ALREADY_EXISTS,
-                wow_mpq::Error::Io(_) => ERROR_ACCESS_DENIED,
-                _ => ERROR_ACCESS_DENIED,
-            };
-            set_last_error(error_code);
-            false
+    let listfile_path = if listfile.is_null() {
+        None
+    } else {
+        match CStr::from_ptr(listfile).to_str() {
+            Ok(s) => Some(s),
+            Err(_) => {
+                set_last_error(ERROR_INVALID_PARAMETER);
+                return false;
+            }
         }
-    }
-}
-
-/// Add a file to an archive from disk
-///
-/// # Safety
-///
-/// - `archive` must be a valid archive handle
-/// - `filename` and `archived_name` must be valid null-terminated C strings
-#[no_mangle]
-pub unsafe extern "C" fn SFileAddFile(
-    archive: HANDLE,
-    filename: *const c_char,
-    archived_name: *const c_char,
-    flags: u32,
-) -> bool {
-    SFileAddFileEx(archive, filename, archived_name, flags, 0x02, 0) // Use ZLIB compression by default
-}
+    };
 
-/// Remove a file from an archive
-///
-/// # Safety
-///
-/// - `archive` must be a valid archive handle
-/// - `filename` must be a valid null-terminated C string
-#[no_mangle]
-pub unsafe extern "C" fn SFileRemoveFile(
-    archive: HANDLE,
-    filename: *const c_char,
-    _search_scope: u32,
-) -> bool {
-    // Validate parameters
-    if archive.is_null() || filename.is_null() {
-        set_last_error(ERROR_INVALID_PARAMETER);
+    let Some(archive_lock) = lookup_archive(archive_id) else {
         return false;
-    }
-
-    // Convert handle
-    let archive_id = match handle_to_id(archive) {
-        Some(id) => id,
-        None => {
-            set_last_error(ERROR_INVALID_HANDLE);
-            return false;
-        }
     };
+    let mut archive_guard = archive_lock.write().unwrap();
 
-    // Convert filename
-    let filename_str = match CStr::from_ptr(filename).to_str() {
-        Ok(s) => s,
-        Err(_) => {
-            set_last_error(ERROR_INVALID_PARAMETER);
+    let archive = match &mut *archive_guard {
+        ArchiveHandle::ReadOnly { archive, .. } => archive,
+        ArchiveHandle::Mutable { .. } => {
+            set_last_error(ERROR_ACCESS_DENIED);
             return false;
         }
     };
 
-    // Get mutable archive handle
-    let mut archives = ARCHIVES.lock().unwrap();
-    let archive_handle = match archives.get_mut(&archive_id) {
-        Some(handle) => handle,
-        None => {
-            set_last_error(ERROR_INVALID_HANDLE);
-            return false;
-        }
+    let listfile_data = match listfile_path {
+        Some(path) => fs::read(path).map_err(|_| ERROR_FILE_NOT_FOUND),
+        None => archive.read_file("(listfile)").map_err(|e| match e {
+            wow_mpq::Error::FileNotFound(_) => ERROR_FILE_NOT_FOUND,
+            _ => ERROR_FILE_CORRUPT,
+        }),
     };
-
-    let mutable_archive = match archive_handle.mutable_archive() {
-        Some(archive) => archive,
-        None => {
-            set_last_error(ERROR_ACCESS_DENIED);
+    let names = match listfile_data.and_then(|data| {
+        wow_mpq::special_files::parse_listfile(&data).map_err(|_| ERROR_FILE_CORRUPT)
+    }) {
+        Ok(names) => names,
+        Err(error_code) => {
+            set_last_error(error_code);
             return false;
         }
     };
 
-    // Remove the file
-    match mutable_archive.remove_file(filename_str) {
-        Ok(()) => {
+    match archive.prewarm_lookup_cache(&names) {
+        Ok(count) => {
+            if !found.is_null() {
+                *found = count as u32;
+            }
             set_last_error(ERROR_SUCCESS);
             true
         }
-        Err(e) => {
-            let error_code = match e {
-                wow_mpq::Error::FileNotFound(_) => ERROR_FILE_NOT_FOUND,
-                _ => ERROR_ACCESS_DENIED,
-            };
-            set_last_error(error_code);
+        Err(_) => {
+            set_last_error(ERROR_FILE_CORRUPT);
             false
         }
     }
 }
 
-/// Rename a file in an archive
+/// Get archive name from handle
 ///
 /// # Safety
 ///
-/// - `archive` must be a valid archive handle
-/// - `old_filename` and `new_filename` must be valid null-terminated C strings
+/// - `buffer` must be a valid pointer with at least `buffer_size` bytes available
 #[no_mangle]
-pub unsafe extern "C" fn SFileRenameFile(
+pub unsafe extern "C" fn SFileGetArchiveName(
     archive: HANDLE,
-    old_filename: *const c_char,
-    new_filename: *const c_char,
+    buffer: *mut c_char,
+    buffer_size: u32,
 ) -> bool {
-    // Validate parameters
-    if archive.is_null() || old_filename.is_null() || new_filename.is_null() {
+    if buffer.is_null() || buffer_size == 0 {
         set_last_error(ERROR_INVALID_PARAMETER);
         return false;
     }
 
-    // Convert handle
-    let archive_id = match handle_to_id(archive) {
-        Some(id) => id,
-        None => {
-            set_last_error(ERROR_INVALID_HANDLE);
-            return false;
-        }
+    let Some(archive_id) = handle_to_id(archive) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
     };
 
-    // Convert filenames
-    let old_filename_str = match CStr::from_ptr(old_filename).to_str() {
-        Ok(s) => s,
-        Err(_) => {
-            set_last_error(ERROR_INVALID_PARAMETER);
-            return false;
-        }
+    let Some(archive_lock) = ARCHIVES.get(archive_id) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
     };
+    let archive_handle = archive_lock.read().unwrap();
 
-    let new_filename_str = match CStr::from_ptr(new_filename).to_str() {
+    // Convert path to C string
+    let c_path = match CString::new(archive_handle.path()) {
         Ok(s) => s,
         Err(_) => {
             set_last_error(ERROR_INVALID_PARAMETER);
@@ -1615,210 +2358,1419 @@ pub unsafe extern "C" fn SFileRenameFile(
         }
     };
 
-    // Get mutable archive handle
-    let mut archives = ARCHIVES.lock().unwrap();
-    let archive_handle = match archives.get_mut(&archive_id) {
-        Some(handle) => handle,
-        None => {
-            set_last_error(ERROR_INVALID_HANDLE);
-            return false;
-        }
-    };
+    let path_bytes = c_path.as_bytes_with_nul();
+    if path_bytes.len() > buffer_size as usize {
+        set_last_error(ERROR_INSUFFICIENT_BUFFER);
+        return false;
+    }
 
-    let mutable_archive = match archive_handle.mutable_archive() {
-        Some(archive) => archive,
-        None => {
-            set_last_error(ERROR_ACCESS_DENIED);
-            return false;
-        }
-    };
+    // Copy to buffer
+    std::ptr::copy_nonoverlapping(path_bytes.as_ptr(), buffer as *mut u8, path_bytes.len());
 
-    // Rename the file
-    match mutable_archive.rename_file(old_filename_str, new_filename_str) {
-        Ok(()) => {
-            set_last_error(ERROR_SUCCESS);
-            true
-        }
-        Err(e) => {
-            let error_code = match e {
-                wow_mpq::Error::FileNotFound(_) => ERROR_FILE_NOT_FOUND,
-                wow_mpq::Error::FileExists(_) => ERROR_ALREADY_EXISTS,
-                _ => ERROR_ACCESS_DENIED,
-            };
-            set_last_error(error_code);
-            false
-        }
-    }
+    set_last_error(ERROR_SUCCESS);
+    true
 }
 
-/// Flush pending changes to an archive
+/// Enumerate files in archive
 ///
 /// # Safety
 ///
-/// - `archive` must be a valid archive handle
+/// - `search_mask` if not null, must be a valid null-terminated C string
+/// - `_list_file` if not null, must be a valid null-terminated C string (ignored)
+/// - `callback` function pointer must be valid for the duration of enumeration
 #[no_mangle]
-pub unsafe extern "C" fn SFileFlushArchive(archive: HANDLE) -> bool {
-    // Validate parameters
-    if archive.is_null() {
+pub unsafe extern "C" fn SFileEnumFiles(
+    archive: HANDLE,
+    search_mask: *const c_char,
+    _list_file: *const c_char, // Path to external listfile (ignored for now)
+    callback: Option<extern "C" fn(*const c_char, *mut c_void) -> bool>,
+    user_data: *mut c_void,
+) -> bool {
+    let Some(callback_fn) = callback else {
         set_last_error(ERROR_INVALID_PARAMETER);
         return false;
-    }
+    };
 
-    // Convert handle
-    let archive_id = match handle_to_id(archive) {
-        Some(id) => id,
-        None => {
-            set_last_error(ERROR_INVALID_HANDLE);
-            return false;
-        }
+    let Some(archive_id) = handle_to_id(archive) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
     };
 
-    // Get mutable archive handle
-    let mut archives = ARCHIVES.lock().unwrap();
-    let archive_handle = match archives.get_mut(&archive_id) {
-        Some(handle) => handle,
-        None => {
-            set_last_error(ERROR_INVALID_HANDLE);
-            return false;
+    // Get search pattern
+    let glob = if search_mask.is_null() {
+        Glob::new("*")
+    } else {
+        match CStr::from_ptr(search_mask).to_str() {
+            Ok(s) => Glob::new(s),
+            Err(_) => {
+                set_last_error(ERROR_INVALID_PARAMETER);
+                return false;
+            }
         }
     };
 
-    let mutable_archive = match archive_handle.mutable_archive() {
-        Some(archive) => archive,
-        None => {
-            set_last_error(ERROR_SUCCESS); // Read-only archives don't need flushing
-            return true;
-        }
+    // Get archive
+    let Some(archive_lock) = lookup_archive(archive_id) else {
+        return false;
     };
 
-    // Flush the archive
-    match mutable_archive.flush() {
-        Ok(()) => {
+    // The index is shared, so no archive lock is held while callbacks run and
+    // callbacks may use the archive handle themselves
+    match archive_name_index(&archive_lock) {
+        Ok(index) => {
+            // One buffer holds each null-terminated name in turn
+            let mut c_name = Vec::new();
+            for entry in index.matching(&glob) {
+                if entry.name.as_bytes().contains(&0) {
+                    continue;
+                }
+                c_name.clear();
+                c_name.extend_from_slice(entry.name.as_bytes());
+                c_name.push(0);
+
+                // Callback returned false, stop enumeration
+                if !callback_fn(c_name.as_ptr() as *const c_char, user_data) {
+                    break;
+                }
+            }
             set_last_error(ERROR_SUCCESS);
             true
         }
         Err(_) => {
-            set_last_error(ERROR_ACCESS_DENIED);
-            false
+            // No listfile, but that's okay
+            set_last_error(ERROR_SUCCESS);
+            true
         }
     }
 }
 
-/// Compact an archive to remove deleted files
+/// Set locale for file operations
+#[no_mangle]
+pub extern "C" fn SFileSetLocale(locale: u32) -> u32 {
+    let old_locale = LOCALE.with(|l| {
+        let old = *l.borrow();
+        *l.borrow_mut() = locale;
+        old
+    });
+    old_locale
+}
+
+/// Get current locale
+#[no_mangle]
+pub extern "C" fn SFileGetLocale() -> u32 {
+    LOCALE.with(|l| *l.borrow())
+}
+
+/// Get last error
+#[no_mangle]
+pub extern "C" fn SFileGetLastError() -> u32 {
+    LAST_ERROR.with(|e| *e.borrow())
+}
+
+/// Set last error
+#[no_mangle]
+pub extern "C" fn SFileSetLastError(error: u32) {
+    set_last_error(error);
+}
+
+// Additional utility functions
+
+/// Get file name from handle
 ///
 /// # Safety
 ///
-/// - `archive` must be a valid archive handle  
-/// - `listfile` can be null
+/// - `buffer` must be a valid pointer with sufficient space for the filename
 #[no_mangle]
-pub unsafe extern "C" fn SFileCompactArchive(
+pub unsafe extern "C" fn SFileGetFileName(file: HANDLE, buffer: *mut c_char) -> bool {
+    if buffer.is_null() {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+
+    let Some(file_id) = handle_to_id(file) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
+    };
+
+    let Some(file_lock) = FILES.get(file_id) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
+    };
+    let file_handle = file_lock.file.lock().unwrap();
+
+    let c_name = match CString::new(file_handle.filename.as_str()) {
+        Ok(s) => s,
+        Err(_) => {
+            set_last_error(ERROR_INVALID_PARAMETER);
+            return false;
+        }
+    };
+
+    std::ptr::copy_nonoverlapping(c_name.as_ptr(), buffer, c_name.as_bytes_with_nul().len());
+
+    set_last_error(ERROR_SUCCESS);
+    true
+}
+
+/// Extract a file from archive to disk
+///
+/// # Safety
+///
+/// - `filename` must be a valid null-terminated C string
+/// - `local_filename` must be a valid null-terminated C string
+#[no_mangle]
+pub unsafe extern "C" fn SFileExtractFile(
     archive: HANDLE,
-    _listfile: *const c_char,
-    _reserved: bool,
+    filename: *const c_char,
+    local_filename: *const c_char,
+    _search_scope: u32, // Ignored - StormLib legacy parameter
 ) -> bool {
     // Validate parameters
-    if archive.is_null() {
+    if filename.is_null() || local_filename.is_null() {
         set_last_error(ERROR_INVALID_PARAMETER);
         return false;
     }
 
-    // Convert handle
-    let archive_id = match handle_to_id(archive) {
-        Some(id) => id,
-        None => {
-            set_last_error(ERROR_INVALID_HANDLE);
+    let Some(archive_id) = handle_to_id(archive) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
+    };
+
+    // Convert filenames from C strings
+    let source_filename = match CStr::from_ptr(filename).to_str() {
+        Ok(s) => s,
+        Err(_) => {
+            set_last_error(ERROR_INVALID_PARAMETER);
             return false;
         }
     };
 
-    // Get mutable archive handle
-    let mut archives = ARCHIVES.lock().unwrap();
-    let archive_handle = match archives.get_mut(&archive_id) {
-        Some(handle) => handle,
-        None => {
-            set_last_error(ERROR_INVALID_HANDLE);
+    let dest_filename = match CStr::from_ptr(local_filename).to_str() {
+        Ok(s) => s,
+        Err(_) => {
+            set_last_error(ERROR_INVALID_PARAMETER);
             return false;
         }
     };
 
-    let mutable_archive = match archive_handle.mutable_archive() {
-        Some(archive) => archive,
-        None => {
-            set_last_error(ERROR_ACCESS_DENIED);
+    // Get the archive
+    let Some(archive_lock) = lookup_archive(archive_id) else {
+        return false;
+    };
+
+    // Try to read the file from the archive
+    let file_data = read_archive_file(&archive_lock, source_filename);
+
+    match file_data {
+        Ok(data) => {
+            // Create parent directories if they don't exist
+            let dest_path = Path::new(dest_filename);
+            if let Some(parent) = dest_path.parent() {
+                if fs::create_dir_all(parent).is_err() {
+                    set_last_error(ERROR_ACCESS_DENIED);
+                    return false;
+                }
+            }
+
+            // Write the file data to disk
+            match fs::write(dest_path, data) {
+                Ok(_) => {
+                    set_last_error(ERROR_SUCCESS);
+                    true
+                }
+                Err(_) => {
+                    set_last_error(ERROR_ACCESS_DENIED);
+                    false
+                }
+            }
+        }
+        Err(e) => {
+            // Map wow_mpq errors to Windows error codes
+            let error_code = match e {
+                wow_mpq::Error::FileNotFound(_) => ERROR_FILE_NOT_FOUND,
+                wow_mpq::Error::InvalidFormat(_) => ERROR_FILE_CORRUPT,
+                wow_mpq::Error::Io(_) => ERROR_ACCESS_DENIED,
+                _ => ERROR_FILE_CORRUPT,
+            };
+            set_last_error(error_code);
+            false
+        }
+    }
+}
+
+/// Extract many files from an archive to disk in parallel
+///
+/// `filenames` and `local_filenames` are parallel arrays of `count` entries.
+/// The archive is read in on-disk order, in large reads that each cover many
+/// files, and a pool of `thread_count` workers (0 uses one worker per CPU)
+/// sharing the archive's parsed tables decodes the files; decoding pauses
+/// while too many decoded files wait to be written in order. With
+/// `SFILE_EXTRACT_REQUEST_ORDER` in `flags` the workers read their files one
+/// at a time instead, which suits storage without seek costs. Patched and
+/// writable archives are extracted one file at a time. Every entry is
+/// attempted even if an earlier one fails.
+///
+/// Returns true only if every file was extracted. On failure the last error
+/// is that of the first failing entry. `extracted`, if not null, receives the
+/// number of files written successfully.
+///
+/// # Safety
+///
+/// - `filenames` and `local_filenames` must point to `count` valid
+///   null-terminated C strings each
+/// - `extracted` if not null, must be a valid pointer to write the count
+#[no_mangle]
+pub unsafe extern "C" fn SFileExtractFiles(
+    archive: HANDLE,
+    filenames: *const *const c_char,
+    local_filenames: *const *const c_char,
+    count: u32,
+    thread_count: u32,
+    flags: u32,
+    extracted: *mut u32,
+) -> bool {
+    if !extracted.is_null() {
+        *extracted = 0;
+    }
+
+    // Validate parameters
+    if count > 0 && (filenames.is_null() || local_filenames.is_null()) {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+
+    let Some(archive_id) = handle_to_id(archive) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
+    };
+
+    // Convert filenames from C strings
+    let mut jobs = Vec::with_capacity(count as usize);
+    for i in 0..count as usize {
+        let source = *filenames.add(i);
+        let dest = *local_filenames.add(i);
+        if source.is_null() || dest.is_null() {
+            set_last_error(ERROR_INVALID_PARAMETER);
             return false;
         }
+        match (
+            CStr::from_ptr(source).to_str(),
+            CStr::from_ptr(dest).to_str(),
+        ) {
+            (Ok(source), Ok(dest)) => jobs.push((source, Path::new(dest))),
+            _ => {
+                set_last_error(ERROR_INVALID_PARAMETER);
+                return false;
+            }
+        }
+    }
+
+    let Some(archive_lock) = lookup_archive(archive_id) else {
+        return false;
     };
 
-    // Compact the archive
-    match mutable_archive.compact() {
-        Ok(()) => {
-            set_last_error(ERROR_SUCCESS);
-            true
+    let results: Vec<Result<(), u32>> = {
+        let archive_guard = archive_lock.read().unwrap();
+        if matches!(*archive_guard, ArchiveHandle::Mutable { .. })
+            || archive_guard.patch_chain().is_some()
+        {
+            drop(archive_guard);
+            jobs.iter()
+                .map(|&(source, dest)| {
+                    let data =
+                        read_archive_file(&archive_lock, source).map_err(extract_error_code)?;
+                    write_extracted_file(dest, &data)
+                })
+                .collect()
+        } else {
+            let mut config = ParallelConfig::new()
+                .skip_errors(true)
+                .sequential_io(flags & SFILE_EXTRACT_REQUEST_ORDER == 0);
+            if thread_count > 0 {
+                config = config.threads(thread_count as usize);
+            }
+            match extract_archive_to_disk(archive_guard.archive(), &jobs, &config) {
+                Ok(results) => results
+                    .into_iter()
+                    .map(|(_, result)| result.map(|_| ()).map_err(extract_error_code))
+                    .collect(),
+                Err(_) => {
+                    set_last_error(ERROR_NOT_ENOUGH_MEMORY);
+                    return false;
+                }
+            }
         }
-        Err(_) => {
-            set_last_error(ERROR_NOT_SUPPORTED); // compact() currently returns NotImplemented
+    };
+
+    let succeeded = results.iter().filter(|result| result.is_ok()).count();
+    if !extracted.is_null() {
+        *extracted = succeeded as u32;
+    }
+
+    match results.into_iter().find_map(Result::err) {
+        Some(error_code) => {
+            set_last_error(error_code);
             false
         }
+        None => {
+            set_last_error(ERROR_SUCCESS);
+            true
+        }
     }
 }
 
-/// Extended MPQ creation info structure for SFileCreateArchive2
-#[repr(C)]
-pub struct SFILE_CREATE_MPQ {
-    /// Size of this structure, in bytes
-    pub cb_size: u32,
-    /// Version of the MPQ to be created (1-4)
-    pub mpq_version: u32,
-    /// Reserved, must be NULL
-    pub user_data: *mut c_void,
-    /// Reserved, must be 0
-    pub cb_user_data: u32,
-    /// Stream flags for creating the MPQ
-    pub stream_flags: u32,
-    /// File flags for (listfile). Use MPQ_FILE_DEFAULT_INTERNAL to set default flags
-    pub file_flags_1: u32,
-    /// File flags for (attributes). Use MPQ_FILE_DEFAULT_INTERNAL to set default flags
-    pub file_flags_2: u32,
-    /// File flags for (signature). Use MPQ_FILE_DEFAULT_INTERNAL to set default flags
-    pub file_flags_3: u32,
-    /// Flags for the (attributes) file. If 0, no attributes will be created
-    pub attr_flags: u32,
-    /// Sector size (expressed as power of two). If 0, default sector size is 4096 bytes
-    pub sector_size: u32,
-    /// Size of raw data chunk for MD5
-    pub raw_chunk_size: u32,
-    /// File limit for the MPQ
-    pub max_file_count: u32,
+/// Map an extraction failure to a Windows error code
+fn extract_error_code(e: wow_mpq::Error) -> u32 {
+    match e {
+        wow_mpq::Error::FileNotFound(_) => ERROR_FILE_NOT_FOUND,
+        wow_mpq::Error::InvalidFormat(_) => ERROR_FILE_CORRUPT,
+        wow_mpq::Error::Io(_) => ERROR_ACCESS_DENIED,
+        _ => ERROR_FILE_CORRUPT,
+    }
 }
 
-// Default internal file flags
-const _MPQ_FILE_DEFAULT_INTERNAL: u32 = 0xFFFFFFFF;
+/// Write extracted data to disk, creating parent directories as needed
+fn write_extracted_file(dest: &Path, data: &[u8]) -> Result<(), u32> {
+    if let Some(parent) = dest.parent() {
+        fs::create_dir_all(parent).map_err(|_| ERROR_ACCESS_DENIED)?;
+    }
+    fs::write(dest, data).map_err(|_| ERROR_ACCESS_DENIED)
+}
 
-// Attribute flags for (attributes) file
-const MPQ_ATTRIBUTE_CRC32: u32 = 0x00000001;
-const _MPQ_ATTRIBUTE_FILETIME: u32 = 0x00000002;
-const MPQ_ATTRIBUTE_MD5: u32 = 0x00000004;
-const _MPQ_ATTRIBUTE_PATCH_BIT: u32 = 0x00000008;
-const _MPQ_ATTRIBUTE_ALL: u32 = 0x0000000F;
+/// Map `SFILE_VERIFY_*` flags to the per-file checks they request
+fn verify_options(flags: u32, num_threads: Option<usize>) -> VerifyOptions {
+    VerifyOptions {
+        sector_crc: flags & SFILE_VERIFY_SECTOR_CRC != 0,
+        file_crc: flags & SFILE_VERIFY_FILE_CRC != 0,
+        file_md5: flags & SFILE_VERIFY_FILE_MD5 != 0,
+        num_threads,
+    }
+}
 
-// File find data structure
-#[repr(C)]
-pub struct SFILE_FIND_DATA {
-    /// Full name of the found file
-    pub c_file_name: [c_char; 260], // MAX_PATH = 260
-    /// Plain name of the found file (pointer into cFileName)
-    pub sz_plain_name: *mut c_char,
-    /// Hash index of the file
-    pub hash_index: u32,
-    /// Block table index of the file
-    pub block_index: u32,
-    /// File size in bytes
-    pub file_size: u32,
-    /// File flags from block table
-    pub file_flags: u32,
-    /// Compressed file size
-    pub comp_size: u32,
-    /// Low 32-bits of the file time
+/// Load `(attributes)` so CRC32, MD5 and file times are available
+fn load_attributes_if_present(archive_handle: &mut ArchiveHandle) {
+    // Archives without (attributes) simply skip those checks
+    let _ = match archive_handle {
+        ArchiveHandle::ReadOnly { flags, .. } if *flags & MPQ_OPEN_NO_ATTRIBUTES != 0 => return,
+        ArchiveHandle::ReadOnly { archive, .. } => archive.load_attributes(),
+        ArchiveHandle::Mutable { archive, .. } => archive.load_attributes(),
+    };
+}
+
+/// Load `(attributes)` unless it is already loaded, absent or not wanted
+///
+/// The write lock is only taken while the attributes still have to be
+/// loaded, so later calls do not serialize with the archive's readers.
+fn ensure_attributes_loaded(archive_lock: &RwLock<ArchiveHandle>) {
+    let missing = match &*archive_lock.read().unwrap() {
+        ArchiveHandle::ReadOnly { flags, .. } if *flags & MPQ_OPEN_NO_ATTRIBUTES != 0 => false,
+        archive_handle => {
+            let archive = archive_handle.archive();
+            archive.attributes().is_none()
+                && matches!(archive.find_file("(attributes)"), Ok(Some(_)))
+        }
+    };
+    if missing {
+        load_attributes_if_present(&mut archive_lock.write().unwrap());
+    }
+}
+
+/// Verify file integrity
+///
+/// The file is streamed once, checking sector checksums as sectors are
+/// decoded and hashing the contents for the `(attributes)` CRC32 and MD5.
+///
+/// # Safety
+///
+/// - `filename` must be a valid null-terminated C string
+#[no_mangle]
+pub unsafe extern "C" fn SFileVerifyFile(
+    archive: HANDLE,
+    filename: *const c_char,
+    flags: u32,
+) -> bool {
+    // Validate parameters
+    if filename.is_null() {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+
+    let Some(archive_id) = handle_to_id(archive) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
+    };
+
+    // Convert filename from C string
+    let filename_str = match CStr::from_ptr(filename).to_str() {
+        Ok(s) => s,
+        Err(_) => {
+            set_last_error(ERROR_INVALID_PARAMETER);
+            return false;
+        }
+    };
+
+    // Get the archive
+    let Some(archive_lock) = lookup_archive(archive_id) else {
+        return false;
+    };
+    ensure_attributes_loaded(&archive_lock);
+    let archive_guard = archive_lock.read().unwrap();
+    let archive = archive_guard.archive();
+
+    match archive.find_file(filename_str) {
+        Ok(Some(_)) => {}
+        Ok(None) => {
+            set_last_error(ERROR_FILE_NOT_FOUND);
+            return false;
+        }
+        Err(_) => {
+            set_last_error(ERROR_FILE_CORRUPT);
+            return false;
+        }
+    }
+
+    // If no flags specified, verify everything available
+    let verify_flags = if flags == 0 { SFILE_VERIFY_ALL } else { flags };
+    let options = verify_options(verify_flags, None);
+    if let FileVerification::Failed(_) = verify_file(archive, filename_str, &options) {
+        set_last_error(ERROR_FILE_CORRUPT);
+        return false;
+    }
+
+    set_last_error(ERROR_SUCCESS);
+    true
+}
+
+/// A file that failed `SFileVerifyArchiveEx`
+#[repr(C)]
+pub struct SFILE_VERIFY_FAILURE {
+    /// Name of the file
+    pub file_name: [c_char; 260], // MAX_PATH = 260
+    /// Block table index of the file (0xFFFFFFFF if unknown)
+    pub block_index: u32,
+    /// One of the `SFILE_VERIFY_FAILED_*` codes
+    pub failure: u32,
+}
+
+impl SFILE_VERIFY_FAILURE {
+    fn new(failed: &FailedFile) -> Self {
+        // Truncate to MAX_PATH - 1 so the name stays NUL-terminated
+        let mut file_name = [0 as c_char; 260];
+        for (dst, &byte) in file_name.iter_mut().zip(failed.name.as_bytes()) {
+            *dst = byte as c_char;
+        }
+        file_name[259] = 0;
+
+        Self {
+            file_name,
+            block_index: failed.block_index.map_or(u32::MAX, |i| i as u32),
+            failure: match failed.failure {
+                VerifyFailure::SectorChecksum => SFILE_VERIFY_FAILED_SECTOR_CRC,
+                VerifyFailure::Crc32 { .. } => SFILE_VERIFY_FAILED_FILE_CRC,
+                VerifyFailure::Md5 { .. } => SFILE_VERIFY_FAILED_FILE_MD5,
+                VerifyFailure::Unreadable(_) => SFILE_VERIFY_FAILED_READ,
+            },
+        }
+    }
+}
+
+/// Verify archive integrity
+///
+/// Same as `SFileVerifyArchiveEx` with default threads and no progress or
+/// failure reporting.
+///
+/// # Safety
+///
+/// This function is unsafe because it:
+/// - Dereferences raw pointers passed as HANDLE arguments
+/// - Calls other unsafe functions that manipulate raw pointers
+/// - Must be called with valid archive handles obtained from `SFileOpenArchive`
+#[no_mangle]
+pub unsafe extern "C" fn SFileVerifyArchive(archive: HANDLE, flags: u32) -> bool {
+    SFileVerifyArchiveEx(
+        archive,
+        flags,
+        0,
+        None,
+        ptr::null_mut(),
+        ptr::null_mut(),
+        0,
+        ptr::null_mut(),
+    )
+}
+
+/// Verify archive integrity, checking files on a thread pool
+///
+/// With `SFILE_VERIFY_ALL_FILES`, every file in the block table is checked,
+/// named from the listfile where possible, against the per-file checks in `flags` (`SFILE_VERIFY_SECTOR_CRC`, `FILE_CRC`,
+/// `FILE_MD5`; all of them if none is given). Files are streamed rather than
+/// read into memory and spread over `thread_count` threads (0 = one per
+/// core). `progress` is called once per file, never concurrently, with the
+/// number of files done and the total.
+///
+/// Up to `max_failures` failed files are written to `failures`, and
+/// `failure_count` receives the total number of failures. Returns false with
+/// `ERROR_FILE_CORRUPT` if the signature or any file failed.
+///
+/// # Safety
+///
+/// - `archive` must be a valid archive handle
+/// - `failures` must be null or point to `max_failures` writable entries
+/// - `failure_count` must be null or a valid pointer
+#[no_mangle]
+#[allow(clippy::too_many_arguments)]
+pub unsafe extern "C" fn SFileVerifyArchiveEx(
+    archive: HANDLE,
+    flags: u32,
+    thread_count: u32,
+    progress: Option<extern "C" fn(u32, u32, *mut c_void)>,
+    user_data: *mut c_void,
+    failures: *mut SFILE_VERIFY_FAILURE,
+    max_failures: u32,
+    failure_count: *mut u32,
+) -> bool {
+    if failures.is_null() && max_failures != 0 {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+    if !failure_count.is_null() {
+        *failure_count = 0;
+    }
+
+    let Some(archive_id) = handle_to_id(archive) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
+    };
+
+    // Get the archive
+    let Some(archive_lock) = lookup_archive(archive_id) else {
+        return false;
+    };
+    // If no flags specified, verify signature by default
+    let verify_flags = if flags == 0 {
+        SFILE_VERIFY_SIGNATURE
+    } else {
+        flags
+    };
+
+    // Verify digital signature (if requested)
+    if (verify_flags & SFILE_VERIFY_SIGNATURE) != 0 {
+        // Verify signature; it is read through its own file handle
+        let signature_result = archive_lock.read().unwrap().archive().verify_signature();
+
+        match signature_result {
+            Ok(wow_mpq::SignatureStatus::WeakValid) | Ok(wow_mpq::SignatureStatus::StrongValid) => {
+                // Valid signature found
+            }
+            Ok(wow_mpq::SignatureStatus::None) => {
+                // No signature is acceptable for some archives
+            }
+            Ok(wow_mpq::SignatureStatus::WeakInvalid)
+            | Ok(wow_mpq::SignatureStatus::StrongInvalid) => {
+                set_last_error(ERROR_FILE_CORRUPT);
+                return false;
+            }
+            Ok(wow_mpq::SignatureStatus::StrongNoKey) => {
+                // Strong signature present but no key - treat as warning, continue
+            }
+            Err(_) => {
+                set_last_error(ERROR_FILE_CORRUPT);
+                return false;
+            }
+        }
+    }
+
+    if (verify_flags & SFILE_VERIFY_ALL_FILES) == 0 {
+        set_last_error(ERROR_SUCCESS);
+        return true;
+    }
+
+    ensure_attributes_loaded(&archive_lock);
+
+    // Read-only archives keep their listing, so only the first call writes
+    let listed_once = matches!(
+        &*archive_lock.read().unwrap(),
+        ArchiveHandle::ReadOnly { patches: None, flags, .. } if *flags & MPQ_OPEN_NO_LISTFILE == 0
+    );
+    let file_list = if listed_once {
+        archive_name_index(&archive_lock)
+            .map(|index| index.entries().to_vec())
+            .unwrap_or_default()
+    } else {
+        match &mut *archive_lock.write().unwrap() {
+            ArchiveHandle::ReadOnly { archive, .. } => archive.list(),
+            ArchiveHandle::Mutable { archive, .. } => archive.list(),
+        }
+        .unwrap_or_default()
+    };
+
+    // Workers only need shared access
+    let archive_guard = archive_lock.read().unwrap();
+
+    let file_flags = SFILE_VERIFY_SECTOR_CRC | SFILE_VERIFY_FILE_CRC | SFILE_VERIFY_FILE_MD5;
+    let file_flags = match verify_flags & file_flags {
+        0 => file_flags,
+        requested => requested,
+    };
+    let threads = (thread_count != 0).then_some(thread_count as usize);
+    let options = verify_options(file_flags, threads);
+
+    // Workers finish files concurrently; report them one at a time and in order
+    let progress_state = Mutex::new((CallerPtr::new(user_data), 0u32));
+    let report = verify_files(archive_guard.archive(), &file_list, &options, |_, total| {
+        if let Some(callback) = progress {
+            let mut state = progress_state.lock().unwrap();
+            state.1 += 1;
+            callback(state.1, total as u32, state.0.get());
+        }
+    });
+    let report = match report {
+        Ok(report) => report,
+        Err(_) => {
+            set_last_error(ERROR_NOT_ENOUGH_MEMORY);
+            return false;
+        }
+    };
+
+    for (i, failed) in report
+        .failures
+        .iter()
+        .take(max_failures as usize)
+        .enumerate()
+    {
+        failures.add(i).write(SFILE_VERIFY_FAILURE::new(failed));
+    }
+    if !failure_count.is_null() {
+        *failure_count = report.failures.len() as u32;
+    }
+
+    if !report.is_ok() {
+        set_last_error(ERROR_FILE_CORRUPT);
+        return false;
+    }
+
+    set_last_error(ERROR_SUCCESS);
+    true
+}
+
+/// Add a file to an archive from disk with extended options
+///
+/// # Safety
+///
+/// - `archive` must be a valid archive handle
+/// - `filename` and `archived_name` must be valid null-terminated C strings
+#[no_mangle]
+pub unsafe extern "C" fn SFileAddFileEx(
+    archive: HANDLE,
+    filename: *const c_char,
+    archived_name: *const c_char,
+    flags: u32,
+    compression: u32,
+    _compression_next: u32,
+) -> bool {
+    // Validate parameters
+    if archive.is_null() || filename.is_null() || archived_name.is_null() {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+
+    // Convert handle
+    let archive_id = match handle_to_id(archive) {
+        Some(id) => id,
+        None => {
+            set_last_error(ERROR_INVALID_HANDLE);
+            return false;
+        }
+    };
+
+    // Convert strings
+    let filename_str = match CStr::from_ptr(filename).to_str() {
+        Ok(s) => s,
+        Err(_) => {
+            set_last_error(ERROR_INVALID_PARAMETER);
+            return false;
+        }
+    };
+
+    let archived_name_str = match CStr::from_ptr(archived_name).to_str() {
+        Ok(s) => s,
+        Err(_) => {
+            set_last_error(ERROR_INVALID_PARAMETER);
+            return false;
+        }
+    };
+
+    // Get mutable archive handle
+    let Some(archive_lock) = ARCHIVES.get(archive_id) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
+    };
+    let mut archive_guard = archive_lock.write().unwrap();
+    let archive_handle = &mut *archive_guard;
+
+    let mutable_archive = match archive_handle.mutable_archive() {
+        Some(archive) => archive,
+        None => {
+            set_last_error(ERROR_ACCESS_DENIED);
+            return false;
+        }
+    };
+
+    // Add the file
+    match mutable_archive.add_file(
+        filename_str,
+        archived_name_str,
+        add_file_options(flags, compression),
+    ) {
+        Ok(()) => {
+            set_last_error(ERROR_SUCCESS);
+            true
+        }
+        Err(e) => {
+            set_last_error(add_file_error_code(&e));
+            false
+        }
+    }
+}
+
+/// Add options for `SFileAddFileEx` flags and compression
+fn add_file_options(flags: u32, compression: u32) -> AddFileOptions {
+    let mut options = AddFileOptions::new();
+
+    // Set compression method
+    use wow_mpq::compression::CompressionMethod;
+    let compression_method = match compression {
+        0 => CompressionMethod::None,
+        0x02 => CompressionMethod::Zlib,
+        0x08 => CompressionMethod::PKWare,
+        0x10 => CompressionMethod::BZip2,
+        0x20 => CompressionMethod::Sparse,
+        0x40 => CompressionMethod::AdpcmMono,
+        0x80 => CompressionMethod::AdpcmStereo,
+        0x12 => CompressionMethod::Lzma,
+        _ => CompressionMethod::Zlib, // Default fallback
+    };
+    options = options.compression(compression_method);
+
+    // Handle flags
+    const MPQ_FILE_ENCRYPTED: u32 = 0x00010000;
+    const MPQ_FILE_FIX_KEY: u32 = 0x00020000;
+    const MPQ_FILE_REPLACEEXISTING: u32 = 0x80000000;
+
+    if (flags & MPQ_FILE_ENCRYPTED) != 0 {
+        options = options.encrypt();
+    }
+    if (flags & MPQ_FILE_FIX_KEY) != 0 {
+        options = options.fix_key();
+    }
+    if (flags & MPQ_FILE_REPLACEEXISTING) != 0 {
+        options = options.replace_existing(true);
+    }
+    options
+}
+
+/// Map an error from adding a file to a Windows error code
+fn add_file_error_code(error: &wow_mpq::Error) -> u32 {
+    match error {
+        wow_mpq::Error::FileNotFound(_) => ERROR_FILE_NOT_FOUND,
+        wow_mpq::Error::FileExists(_) => ERROR_ALREADY_EXISTS,
+        wow_mpq::Error::HashTable(_) => ERROR_DISK_FULL,
+        wow_mpq::Error::Io(_) => ERROR_ACCESS_DENIED,
+        _ => ERROR_ACCESS_DENIED,
+    }
+}
+
+/// Add many files to an archive from disk, compressing them in parallel
+///
+/// `filenames` (files on disk) and `archived_names` are parallel arrays of
+/// `count` entries; `flags` and `compression` apply to every file as in
+/// `SFileAddFileEx`. Files are read and compressed by `thread_count` workers
+/// (0 uses one worker per CPU) and written in array order, so the archive is
+/// the same for any thread count. The `(listfile)` is updated once, and the
+/// tables are written once by `SFileFlushArchive` or `SFileCloseArchive`.
+///
+/// Name conflicts and hash table capacity are checked before any file is
+/// written; a full hash table fails with `ERROR_DISK_FULL`.
+///
+/// # Safety
+///
+/// - `archive` must be a valid archive handle
+/// - `filenames` and `archived_names` must point to `count` valid
+///   null-terminated C strings each
+#[no_mangle]
+pub unsafe extern "C" fn SFileAddFiles(
+    archive: HANDLE,
+    filenames: *const *const c_char,
+    archived_names: *const *const c_char,
+    count: u32,
+    flags: u32,
+    compression: u32,
+    thread_count: u32,
+) -> bool {
+    // Validate parameters
+    if count > 0 && (filenames.is_null() || archived_names.is_null()) {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+
+    let Some(archive_id) = handle_to_id(archive) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
+    };
+
+    // Convert filenames from C strings
+    let options = add_file_options(flags, compression);
+    let mut files = Vec::with_capacity(count as usize);
+    for i in 0..count as usize {
+        let source = *filenames.add(i);
+        let name = *archived_names.add(i);
+        if source.is_null() || name.is_null() {
+            set_last_error(ERROR_INVALID_PARAMETER);
+            return false;
+        }
+        match (
+            CStr::from_ptr(source).to_str(),
+            CStr::from_ptr(name).to_str(),
+        ) {
+            (Ok(source), Ok(name)) => files.push((Path::new(source), name, options.clone())),
+            _ => {
+                set_last_error(ERROR_INVALID_PARAMETER);
+                return false;
+            }
+        }
+    }
+
+    let Some(archive_lock) = ARCHIVES.get(archive_id) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
+    };
+    let mut archive_guard = archive_lock.write().unwrap();
+    let Some(mutable_archive) = archive_guard.mutable_archive() else {
+        set_last_error(ERROR_ACCESS_DENIED);
+        return false;
+    };
+
+    let mut config = ParallelConfig::new();
+    if thread_count > 0 {
+        config = config.threads(thread_count as usize);
+    }
+    match mutable_archive.add_files(&files, &config) {
+        Ok(()) => {
+            set_last_error(ERROR_SUCCESS);
+            true
+        }
+        Err(e) => {
+            set_last_error(add_file_error_code(&e));
+            false
+        }
+    }
+}
+
+/// Add a file to an archive from disk
+///
+/// # Safety
+///
+/// - `archive` must be a valid archive handle
+/// - `filename` and `archived_name` must be valid null-terminated C strings
+#[no_mangle]
+pub unsafe extern "C" fn SFileAddFile(
+    archive: HANDLE,
+    filename: *const c_char,
+    archived_name: *const c_char,
+    flags: u32,
+) -> bool {
+    SFileAddFileEx(archive, filename, archived_name, flags, 0x02, 0) // Use ZLIB compression by default
+}
+
+/// Remove a file from an archive
+///
+/// # Safety
+///
+/// - `archive` must be a valid archive handle
+/// - `filename` must be a valid null-terminated C string
+#[no_mangle]
+pub unsafe extern "C" fn SFileRemoveFile(
+    archive: HANDLE,
+    filename: *const c_char,
+    _search_scope: u32,
+) -> bool {
+    // Validate parameters
+    if archive.is_null() || filename.is_null() {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+
+    // Convert handle
+    let archive_id = match handle_to_id(archive) {
+        Some(id) => id,
+        None => {
+            set_last_error(ERROR_INVALID_HANDLE);
+            return false;
+        }
+    };
+
+    // Convert filename
+    let filename_str = match CStr::from_ptr(filename).to_str() {
+        Ok(s) => s,
+        Err(_) => {
+            set_last_error(ERROR_INVALID_PARAMETER);
+            return false;
+        }
+    };
+
+    // Get mutable archive handle
+    let Some(archive_lock) = ARCHIVES.get(archive_id) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
+    };
+    let mut archive_guard = archive_lock.write().unwrap();
+    let archive_handle = &mut *archive_guard;
+
+    let mutable_archive = match archive_handle.mutable_archive() {
+        Some(archive) => archive,
+        None => {
+            set_last_error(ERROR_ACCESS_DENIED);
+            return false;
+        }
+    };
+
+    // Remove the file
+    match mutable_archive.remove_file(filename_str) {
+        Ok(()) => {
+            set_last_error(ERROR_SUCCESS);
+            true
+        }
+        Err(e) => {
+            let error_code = match e {
+                wow_mpq::Error::FileNotFound(_) => ERROR_FILE_NOT_FOUND,
+                _ => ERROR_ACCESS_DENIED,
+            };
+            set_last_error(error_code);
+            false
+        }
+    }
+}
+
+/// Rename a file in an archive
+///
+/// # Safety
+///
+/// - `archive` must be a valid archive handle
+/// - `old_filename` and `new_filename` must be valid null-terminated C strings
+#[no_mangle]
+pub unsafe extern "C" fn SFileRenameFile(
+    archive: HANDLE,
+    old_filename: *const c_char,
+    new_filename: *const c_char,
+) -> bool {
+    // Validate parameters
+    if archive.is_null() || old_filename.is_null() || new_filename.is_null() {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+
+    // Convert handle
+    let archive_id = match handle_to_id(archive) {
+        Some(id) => id,
+        None => {
+            set_last_error(ERROR_INVALID_HANDLE);
+            return false;
+        }
+    };
+
+    // Convert filenames
+    let old_filename_str = match CStr::from_ptr(old_filename).to_str() {
+        Ok(s) => s,
+        Err(_) => {
+            set_last_error(ERROR_INVALID_PARAMETER);
+            return false;
+        }
+    };
+
+    let new_filename_str = match CStr::from_ptr(new_filename).to_str() {
+        Ok(s) => s,
+        Err(_) => {
+            set_last_error(ERROR_INVALID_PARAMETER);
+            return false;
+        }
+    };
+
+    // Get mutable archive handle
+    let Some(archive_lock) = ARCHIVES.get(archive_id) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
+    };
+    let mut archive_guard = archive_lock.write().unwrap();
+    let archive_handle = &mut *archive_guard;
+
+    let mutable_archive = match archive_handle.mutable_archive() {
+        Some(archive) => archive,
+        None => {
+            set_last_error(ERROR_ACCESS_DENIED);
+            return false;
+        }
+    };
+
+    // Rename the file
+    match mutable_archive.rename_file(old_filename_str, new_filename_str) {
+        Ok(()) => {
+            set_last_error(ERROR_SUCCESS);
+            true
+        }
+        Err(e) => {
+            let error_code = match e {
+                wow_mpq::Error::FileNotFound(_) => ERROR_FILE_NOT_FOUND,
+                wow_mpq::Error::FileExists(_) => ERROR_ALREADY_EXISTS,
+                _ => ERROR_ACCESS_DENIED,
+            };
+            set_last_error(error_code);
+            false
+        }
+    }
+}
+
+/// Flush pending changes to an archive
+///
+/// # Safety
+///
+/// - `archive` must be a valid archive handle
+#[no_mangle]
+pub unsafe extern "C" fn SFileFlushArchive(archive: HANDLE) -> bool {
+    // Validate parameters
+    if archive.is_null() {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+
+    // Convert handle
+    let archive_id = match handle_to_id(archive) {
+        Some(id) => id,
+        None => {
+            set_last_error(ERROR_INVALID_HANDLE);
+            return false;
+        }
+    };
+
+    // Get mutable archive handle
+    let Some(archive_lock) = ARCHIVES.get(archive_id) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
+    };
+    let mut archive_guard = archive_lock.write().unwrap();
+    let archive_handle = &mut *archive_guard;
+
+    let mutable_archive = match archive_handle.mutable_archive() {
+        Some(archive) => archive,
+        None => {
+            set_last_error(ERROR_SUCCESS); // Read-only archives don't need flushing
+            return true;
+        }
+    };
+
+    // Flush the archive
+    match mutable_archive.flush() {
+        Ok(()) => {
+            set_last_error(ERROR_SUCCESS);
+            true
+        }
+        Err(_) => {
+            set_last_error(ERROR_ACCESS_DENIED);
+            false
+        }
+    }
+}
+
+/// Compaction stages passed to compact callbacks as `work_type`
+const CCB_CHECKING_FILES: u32 = 1;
+const CCB_CHECKING_HASH_TABLE: u32 = 2;
+const CCB_COPYING_NON_MPQ_DATA: u32 = 3;
+const CCB_COMPACTING_FILES: u32 = 4;
+const CCB_CLOSING_ARCHIVE: u32 = 5;
+
+/// Compaction progress callback: user data, `CCB_*` work type, bytes
+/// processed and total bytes of the current stage
+type CompactCallback = extern "C" fn(*mut c_void, u32, u64, u64);
+
+/// Result of a compaction started by `SFileCompactArchiveAsync`
+#[derive(Default)]
+struct CompactJob {
+    /// Error code, set once the compaction has finished
+    result: Mutex<Option<u32>>,
+    done: Condvar,
+}
+
+/// Map a compaction failure to a Windows error code
+fn compact_error_code(error: &wow_mpq::Error) -> u32 {
+    match error {
+        wow_mpq::Error::CapacityExceeded(_) => ERROR_DISK_FULL,
+        wow_mpq::Error::Crypto(_) | wow_mpq::Error::UnsupportedFeature(_) => ERROR_NOT_SUPPORTED,
+        wow_mpq::Error::Io(_) => ERROR_ACCESS_DENIED,
+        _ => ERROR_FILE_CORRUPT,
+    }
+}
+
+/// Compact the archive with id `archive_id`, returning a Windows error code
+fn compact_archive(archive_id: usize, archive_lock: &RwLock<ArchiveHandle>) -> u32 {
+    let callback = COMPACT_CALLBACKS
+        .lock()
+        .unwrap()
+        .get(&archive_id)
+        .map(|(callback, user_data)| (*callback, CallerPtr::new(user_data.get())));
+
+    let mut archive_guard = archive_lock.write().unwrap();
+    let Some(mutable_archive) = archive_guard.mutable_archive() else {
+        return ERROR_ACCESS_DENIED;
+    };
+
+    let result = mutable_archive.compact_with_progress(|progress| {
+        if let Some((callback, user_data)) = &callback {
+            let work_type = match progress.phase {
+                CompactPhase::CheckingFiles => CCB_CHECKING_FILES,
+                CompactPhase::CheckingHashTable => CCB_CHECKING_HASH_TABLE,
+                CompactPhase::CopyingNonMpqData => CCB_COPYING_NON_MPQ_DATA,
+                CompactPhase::CompactingFiles => CCB_COMPACTING_FILES,
+                CompactPhase::ClosingArchive => CCB_CLOSING_ARCHIVE,
+            };
+            callback(
+                user_data.get(),
+                work_type,
+                progress.bytes_done,
+                progress.bytes_total,
+            );
+        }
+    });
+
+    match result {
+        Ok(()) => ERROR_SUCCESS,
+        Err(e) => compact_error_code(&e),
+    }
+}
+
+/// Set the callback that reports the progress of compacting an archive
+///
+/// The callback is called by `SFileCompactArchive` and
+/// `SFileCompactArchiveAsync` with a `CCB_*` work type and the bytes done and
+/// total of that stage; for `SFileCompactArchiveAsync` it runs on the
+/// background thread. A null callback removes it.
+///
+/// # Safety
+///
+/// - `archive` must be a valid archive handle
+/// - `user_data` must stay valid while the callback is set
+#[no_mangle]
+pub unsafe extern "C" fn SFileSetCompactCallback(
+    archive: HANDLE,
+    callback: Option<CompactCallback>,
+    user_data: *mut c_void,
+) -> bool {
+    let Some(archive_id) = handle_to_id(archive) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
+    };
+    if ARCHIVES.get(archive_id).is_none() {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
+    }
+
+    let mut callbacks = COMPACT_CALLBACKS.lock().unwrap();
+    match callback {
+        Some(callback) => {
+            callbacks.insert(archive_id, (callback, CallerPtr::new(user_data)));
+        }
+        None => {
+            callbacks.remove(&archive_id);
+        }
+    }
+
+    set_last_error(ERROR_SUCCESS);
+    true
+}
+
+/// Compact an archive to remove deleted files
+///
+/// Live files are streamed into a new archive file in the order they are
+/// stored and their compressed data is copied as-is; only FIX_KEY files are
+/// re-encrypted for their new position. The new file replaces the archive
+/// when it is complete. Progress goes to the callback set with
+/// `SFileSetCompactCallback`.
+///
+/// Fails with `ERROR_ACCESS_DENIED` for archives opened read-only and with
+/// `ERROR_NOT_SUPPORTED` if a FIX_KEY file has to move but its name is not in
+/// `(listfile)`.
+///
+/// # Safety
+///
+/// - `archive` must be a valid archive handle
+/// - `listfile` can be null; it is ignored
+#[no_mangle]
+pub unsafe extern "C" fn SFileCompactArchive(
+    archive: HANDLE,
+    _listfile: *const c_char,
+    _reserved: bool,
+) -> bool {
+    let Some(archive_id) = handle_to_id(archive) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
+    };
+    let Some(archive_lock) = ARCHIVES.get(archive_id) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
+    };
+
+    let error = compact_archive(archive_id, &archive_lock);
+    set_last_error(error);
+    error == ERROR_SUCCESS
+}
+
+/// Start compacting an archive on a background thread
+///
+/// Works like `SFileCompactArchive`, but returns once the compaction has
+/// started. Other calls on the archive wait until it has finished; wait for
+/// the result with `SFileWaitForCompact`. Fails with `ERROR_BUSY` if a
+/// compaction of the archive is already pending.
+///
+/// # Safety
+///
+/// - `archive` must be a valid archive handle
+#[no_mangle]
+pub unsafe extern "C" fn SFileCompactArchiveAsync(archive: HANDLE) -> bool {
+    let Some(archive_id) = handle_to_id(archive) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
+    };
+    let Some(archive_lock) = ARCHIVES.get(archive_id) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
+    };
+    if archive_lock.write().unwrap().mutable_archive().is_none() {
+        set_last_error(ERROR_ACCESS_DENIED);
+        return false;
+    }
+
+    let job = Arc::new(CompactJob::default());
+    {
+        let mut jobs = COMPACT_JOBS.lock().unwrap();
+        if jobs.contains_key(&archive_id) {
+            set_last_error(ERROR_BUSY);
+            return false;
+        }
+        jobs.insert(archive_id, Arc::clone(&job));
+    }
+
+    // The thread keeps the archive alive if it is closed meanwhile
+    std::thread::spawn(move || {
+        let error = compact_archive(archive_id, &archive_lock);
+        *job.result.lock().unwrap() = Some(error);
+        job.done.notify_all();
+    });
+
+    set_last_error(ERROR_SUCCESS);
+    true
+}
+
+/// Wait for a compaction started with `SFileCompactArchiveAsync`
+///
+/// Returns the result of the compaction, with its error code available from
+/// `SFileGetLastError`. `timeout_ms` of `0xFFFFFFFF` waits indefinitely; if
+/// the compaction is still running when the timeout elapses, returns false
+/// with `ERROR_TIMEOUT` and the compaction can be waited for again. Fails
+/// with `ERROR_INVALID_PARAMETER` if no compaction was started, or if its
+/// result was already returned or discarded by closing the archive; a
+/// compaction still running when the archive is closed runs to completion.
+///
+/// # Safety
+///
+/// - `archive` must be the handle passed to `SFileCompactArchiveAsync`
+#[no_mangle]
+pub unsafe extern "C" fn SFileWaitForCompact(archive: HANDLE, timeout_ms: u32) -> bool {
+    let Some(archive_id) = handle_to_id(archive) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
+    };
+    let Some(job) = COMPACT_JOBS.lock().unwrap().get(&archive_id).cloned() else {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    };
+
+    let result = job.result.lock().unwrap();
+    let result = match timeout_ms {
+        u32::MAX => job.done.wait_while(result, |r| r.is_none()).unwrap(),
+        ms => {
+            let timeout = std::time::Duration::from_millis(u64::from(ms));
+            job.done
+                .wait_timeout_while(result, timeout, |r| r.is_none())
+                .unwrap()
+                .0
+        }
+    };
+    let Some(error) = *result else {
+        set_last_error(ERROR_TIMEOUT);
+        return false;
+    };
+    drop(result);
+
+    COMPACT_JOBS.lock().unwrap().remove(&archive_id);
+    set_last_error(error);
+    error == ERROR_SUCCESS
+}
+
+/// Extended MPQ creation info structure for SFileCreateArchive2
+#[repr(C)]
+pub struct SFILE_CREATE_MPQ {
+    /// Size of this structure, in bytes
+    pub cb_size: u32,
+    /// Version of the MPQ to be created (1-4)
+    pub mpq_version: u32,
+    /// Reserved, must be NULL
+    pub user_data: *mut c_void,
+    /// Reserved, must be 0
+    pub cb_user_data: u32,
+    /// Stream flags for creating the MPQ
+    pub stream_flags: u32,
+    /// File flags for (listfile). Use MPQ_FILE_DEFAULT_INTERNAL to set default flags
+    pub file_flags_1: u32,
+    /// File flags for (attributes). Use MPQ_FILE_DEFAULT_INTERNAL to set default flags
+    pub file_flags_2: u32,
+    /// File flags for (signature). Use MPQ_FILE_DEFAULT_INTERNAL to set default flags
+    pub file_flags_3: u32,
+    /// Flags for the (attributes) file. If 0, no attributes will be created
+    pub attr_flags: u32,
+    /// Sector size (expressed as power of two). If 0, default sector size is 4096 bytes
+    pub sector_size: u32,
+    /// Size of raw data chunk for MD5
+    pub raw_chunk_size: u32,
+    /// File limit for the MPQ
+    pub max_file_count: u32,
+}
+
+// Default internal file flags
+const _MPQ_FILE_DEFAULT_INTERNAL: u32 = 0xFFFFFFFF;
+
+// Attribute flags for (attributes) file
+const MPQ_ATTRIBUTE_CRC32: u32 = 0x00000001;
+const MPQ_ATTRIBUTE_FILETIME: u32 = 0x00000002;
+const MPQ_ATTRIBUTE_MD5: u32 = 0x00000004;
+const _MPQ_ATTRIBUTE_PATCH_BIT: u32 = 0x00000008;
+const _MPQ_ATTRIBUTE_ALL: u32 = 0x0000000F;
+
+// File find data structure
+#[repr(C)]
+pub struct SFILE_FIND_DATA {
+    /// Full name of the found file
+    pub c_file_name: [c_char; 260], // MAX_PATH = 260
+    /// Plain name of the found file (pointer into cFileName)
+    pub sz_plain_name: *mut c_char,
+    /// Hash index of the file
+    pub hash_index: u32,
+    /// Block table index of the file
+    pub block_index: u32,
+    /// File size in bytes
+    pub file_size: u32,
+    /// File flags from block table
+    pub file_flags: u32,
+    /// Compressed file size
+    pub comp_size: u32,
+    /// Low 32-bits of the file time
     pub file_time_lo: u32,
     /// High 32-bits of the file time (0 if not present)
     pub file_time_hi: u32,
@@ -1826,620 +3778,1855 @@ pub struct SFILE_FIND_DATA {
     pub lc_locale: u32, // LCID type
 }
 
-// Find handle structure
-struct FindHandle {
-    archive_handle: usize,
-    file_list: Vec<FileEntry>,
-    current_index: usize,
-    search_mask: String,
-}
+// Find handle structure
+struct FindHandle {
+    archive_handle: usize,
+    /// Shared listing of the archive
+    index: Arc<NameIndex>,
+    glob: Glob,
+    /// Remaining index positions sharing the mask's literal prefix
+    remaining: std::ops::Range<usize>,
+}
+
+impl FindHandle {
+    /// Advance to the next entry matching the mask
+    fn next_match(&mut self) -> Option<&FileEntry> {
+        let index = self
+            .remaining
+            .by_ref()
+            .find(|&i| self.index.matches_at(i, &self.glob))?;
+        Some(&self.index.entries()[index])
+    }
+}
+
+/// File finding functions with wildcard support
+///
+/// # Safety
+///
+/// - `h_mpq` must be a valid MPQ archive handle
+/// - `sz_mask` must be a valid null-terminated C string (can be NULL for "*")
+/// - `lp_find_file_data` must be a valid pointer to SFILE_FIND_DATA
+/// - `sz_list_file` can be NULL
+#[no_mangle]
+pub unsafe extern "C" fn SFileFindFirstFile(
+    h_mpq: HANDLE,
+    sz_mask: *const c_char,
+    lp_find_file_data: *mut SFILE_FIND_DATA,
+    _sz_list_file: *const c_char, // Ignored - we use internal listfile
+) -> HANDLE {
+    // Validate parameters
+    if lp_find_file_data.is_null() {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return INVALID_HANDLE_VALUE;
+    }
+
+    let archive_id = match handle_to_id(h_mpq) {
+        Some(id) => id,
+        None => {
+            set_last_error(ERROR_INVALID_HANDLE);
+            return INVALID_HANDLE_VALUE;
+        }
+    };
+
+    // Get search mask
+    let glob = if sz_mask.is_null() {
+        Glob::new("*")
+    } else {
+        match CStr::from_ptr(sz_mask).to_str() {
+            Ok(s) => Glob::new(s),
+            Err(_) => {
+                set_last_error(ERROR_INVALID_PARAMETER);
+                return INVALID_HANDLE_VALUE;
+            }
+        }
+    };
+
+    // Get the archive's sorted listing
+    let index = {
+        let Some(archive_lock) = lookup_archive(archive_id) else {
+            return INVALID_HANDLE_VALUE;
+        };
+        match archive_name_index(&archive_lock) {
+            Ok(index) => index,
+            Err(_) => {
+                set_last_error(ERROR_FILE_NOT_FOUND);
+                return INVALID_HANDLE_VALUE;
+            }
+        }
+    };
+
+    // Only entries sharing the mask's literal prefix are visited
+    let remaining = index.prefix_range(glob.prefix());
+    let mut find_handle = FindHandle {
+        archive_handle: archive_id,
+        index,
+        glob,
+        remaining,
+    };
+
+    // Find first matching file
+    let Some(file) = find_handle.next_match() else {
+        set_last_error(ERROR_FILE_NOT_FOUND);
+        return INVALID_HANDLE_VALUE;
+    };
+    fill_find_data(lp_find_file_data, file, archive_id);
+
+    // Store find handle
+    let handle_id = FIND_HANDLES.insert(Mutex::new(find_handle));
+
+    set_last_error(ERROR_SUCCESS);
+    id_to_handle(handle_id)
+}
+
+/// Find the next file matching the search criteria
+///
+/// # Safety
+///
+/// - `h_find` must be a valid find handle from SFileFindFirstFile
+/// - `lp_find_file_data` must be a valid pointer to SFILE_FIND_DATA
+#[no_mangle]
+pub unsafe extern "C" fn SFileFindNextFile(
+    h_find: HANDLE,
+    lp_find_file_data: *mut SFILE_FIND_DATA,
+) -> bool {
+    if lp_find_file_data.is_null() {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+
+    let handle_id = match handle_to_id(h_find) {
+        Some(id) => id,
+        None => {
+            set_last_error(ERROR_INVALID_HANDLE);
+            return false;
+        }
+    };
+
+    let Some(find_lock) = FIND_HANDLES.get(handle_id) else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        return false;
+    };
+    let mut find_guard = find_lock.lock().unwrap();
+    let find_handle = &mut *find_guard;
+
+    // Find next matching file
+    let archive_id = find_handle.archive_handle;
+    match find_handle.next_match() {
+        Some(file) => {
+            fill_find_data(lp_find_file_data, file, archive_id);
+            set_last_error(ERROR_SUCCESS);
+            true
+        }
+        None => {
+            set_last_error(ERROR_NO_MORE_FILES);
+            false
+        }
+    }
+}
+
+/// Close a find handle
+///
+/// # Safety
+///
+/// - `h_find` must be a valid find handle from SFileFindFirstFile
+#[no_mangle]
+pub unsafe extern "C" fn SFileFindClose(h_find: HANDLE) -> bool {
+    let handle_id = match handle_to_id(h_find) {
+        Some(id) => id,
+        None => {
+            set_last_error(ERROR_INVALID_HANDLE);
+            return false;
+        }
+    };
+
+    if FIND_HANDLES.remove(handle_id).is_some() {
+        set_last_error(ERROR_SUCCESS);
+        true
+    } else {
+        set_last_error(ERROR_INVALID_HANDLE);
+        false
+    }
+}
+
+// Helper function to fill SFILE_FIND_DATA
+unsafe fn fill_find_data(
+    find_data: *mut SFILE_FIND_DATA,
+    file_entry: &FileEntry,
+    archive_id: usize,
+) {
+    let find_data = &mut *find_data;
+
+    // Copy filename
+    let name_bytes = file_entry.name.as_bytes();
+    let copy_len = name_bytes.len().min(259); // Leave room for null terminator
+
+    // Zero the entire buffer first
+    find_data.c_file_name.fill(0);
+
+    // Copy the filename
+    for (i, &byte) in name_bytes.iter().take(copy_len).enumerate() {
+        find_data.c_file_name[i] = byte as c_char;
+    }
+
+    // Set plain name pointer (points to last component after backslash)
+    let plain_name_offset = file_entry.name.rfind('\\').map(|pos| pos + 1).unwrap_or(0);
+    find_data.sz_plain_name = find_data.c_file_name.as_mut_ptr().add(plain_name_offset);
+
+    // Set file information
+    find_data.hash_index = if let Some((hash_idx, _)) = file_entry.table_indices {
+        hash_idx as u32
+    } else {
+        0xFFFFFFFF
+    };
+    find_data.block_index = if let Some((_, Some(block_idx))) = file_entry.table_indices {
+        block_idx as u32
+    } else {
+        0xFFFFFFFF
+    };
+    find_data.file_size = file_entry.size as u32;
+    find_data.file_flags = file_entry.flags;
+    find_data.comp_size = file_entry.compressed_size as u32;
+    find_data.file_time_lo = 0; // Timestamp not available in basic FileEntry
+    find_data.file_time_hi = 0;
+    find_data.lc_locale = 0; // Locale not directly available in FileEntry
+
+    // Try to get additional info from archive if available
+    if let Some(archive_lock) = ARCHIVES.get(archive_id) {
+        let archive_handle = archive_lock.read().unwrap();
+        // Try to get file attributes for timestamp
+        if let Some((_, Some(block_idx))) = file_entry.table_indices {
+            if let Some(attrs) = archive_handle.archive().get_file_attributes(block_idx) {
+                if let Some(filetime) = attrs.filetime {
+                    find_data.file_time_lo = (filetime & 0xFFFFFFFF) as u32;
+                    find_data.file_time_hi = (filetime >> 32) as u32;
+                }
+            }
+        }
+    }
+}
+
+// Error code for no more files
+const ERROR_NO_MORE_FILES: u32 = 18;
+
+/// Create an MPQ archive with extended options
+///
+/// # Safety
+///
+/// - `filename` must be a valid null-terminated C string
+/// - `create_info` must point to a valid SFILE_CREATE_MPQ structure
+/// - `handle` must be a valid pointer to write the output handle
+#[no_mangle]
+pub unsafe extern "C" fn SFileCreateArchive2(
+    filename: *const c_char,
+    create_info: *const SFILE_CREATE_MPQ,
+    handle: *mut HANDLE,
+) -> bool {
+    // Validate parameters
+    if filename.is_null() || create_info.is_null() || handle.is_null() {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+
+    // Validate structure size
+    let info = &*create_info;
+    if info.cb_size != std::mem::size_of::<SFILE_CREATE_MPQ>() as u32 {
+        set_last_error(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+
+    // Convert filename from C string
+    let filename_str = match CStr::from_ptr(filename).to_str() {
+        Ok(s) => s,
+        Err(_) => {
+            set_last_error(ERROR_INVALID_PARAMETER);
+            return false;
+        }
+    };
+
+    // Determine MPQ format version
+    let version = match info.mpq_version {
+        1 => FormatVersion::V1,
+        2 => FormatVersion::V2,
+        3 => FormatVersion::V3,
+        4 => FormatVersion::V4,
+        _ => {
+            set_last_error(ERROR_INVALID_PARAMETER);
+            return false;
+        }
+    };
+
+    // Calculate hash table size from max file count
+    let hash_table_size = if info.max_file_count > 0 {
+        // Round up to next power of 2, minimum 4
+        info.max_file_count.max(4).next_power_of_two()
+    } else {
+        // Default size
+        16
+    };
+
+    // Calculate sector size
+    let sector_size = if info.sector_size > 0 && info.sector_size <= 23 {
+        info.sector_size as u16
+    } else {
+        3 // Default to 4KB sectors (512 << 3)
+    };
+
+    // Create the archive using ArchiveBuilder
+    let mut builder = ArchiveBuilder::new()
+        .version(version)
+        .block_size(sector_size)
+        .hash_table_size(hash_table_size);
+
+    // Configure listfile based on file_flags_1
+    if info.file_flags_1 != 0 {
+        builder = builder.listfile_option(ListfileOption::Generate);
+    } else {
+        builder = builder.listfile_option(ListfileOption::None);
+    }
+
+    // Configure attributes based on attr_flags
+    if info.attr_flags != 0 {
+        if (info.attr_flags & MPQ_ATTRIBUTE_MD5) != 0 {
+            builder = builder.attributes_option(AttributesOption::GenerateFull);
+        } else if (info.attr_flags & MPQ_ATTRIBUTE_CRC32) != 0 {
+            builder = builder.attributes_option(AttributesOption::GenerateCrc32);
+        }
+    }
+
+    // Build the archive
+    match builder.build(filename_str) {
+        Ok(_) => {
+            // Open the created archive for use
+            // Try as mutable first
+            match MutableArchive::open(filename_str) {
+                Ok(mut_archive) => {
+                    // Store archive as mutable
+                    let archive_handle = ArchiveHandle::Mutable {
+                        archive: mut_archive,
+                        path: filename_str.to_string(),
+                    };
+                    let handle_id = ARCHIVES.insert(RwLock::new(archive_handle));
+
+                    // Return handle
+                    *handle = id_to_handle(handle_id);
+                    set_last_error(ERROR_SUCCESS);
+                    true
+                }
+                Err(_) => {
+                    // Fall back to read-only open
+                    SFileOpenArchive(filename, 0, 0, handle)
+                }
+            }
+        }
+        Err(e) => {
+            // Map creation errors to Windows error codes
+            let error_code = match e {
+                wow_mpq::Error::FileNotFound(_) => ERROR_FILE_NOT_FOUND,
+                wow_mpq::Error::InvalidFormat(_) => ERROR_INVALID_PARAMETER,
+                wow_mpq::Error::Io(_) => ERROR_ACCESS_DENIED,
+                _ => ERROR_ACCESS_DENIED,
+            };
+            set_last_error(error_code);
+            false
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_handle_conversion() {
+        let id = 42usize;
+        let handle = id_to_handle(id);
+        assert_eq!(handle_to_id(handle), Some(id));
+        assert_eq!(handle_to_id(ptr::null_mut()), None);
+    }
+
+    #[test]
+    fn test_error_handling() {
+        set_last_error(ERROR_FILE_NOT_FOUND);
+        assert_eq!(SFileGetLastError(), ERROR_FILE_NOT_FOUND);
+
+        SFileSetLastError(ERROR_SUCCESS);
+        assert_eq!(SFileGetLastError(), ERROR_SUCCESS);
+    }
+
+    #[test]
+    fn test_locale() {
+        let old = SFileSetLocale(0x409); // US English
+        assert_eq!(old, LOCALE_NEUTRAL);
+        assert_eq!(SFileGetLocale(), 0x409);
+
+        SFileSetLocale(old); // Restore
+    }
+
+    #[test]
+    fn test_extract_file_invalid_params() {
+        // Test SFileExtractFile with invalid parameters
+        unsafe {
+            // Null filename should fail
+            assert!(!SFileExtractFile(
+                ptr::null_mut(),
+                ptr::null(),
+                c"output.txt".as_ptr(),
+                0
+            ));
+            assert_eq!(SFileGetLastError(), ERROR_INVALID_PARAMETER);
+
+            // Null local filename should fail
+            assert!(!SFileExtractFile(
+                ptr::null_mut(),
+                c"test.txt".as_ptr(),
+                ptr::null(),
+                0
+            ));
+            assert_eq!(SFileGetLastError(), ERROR_INVALID_PARAMETER);
+
+            // Invalid handle should fail
+            assert!(!SFileExtractFile(
+                ptr::null_mut(),
+                c"test.txt".as_ptr(),
+                c"output.txt".as_ptr(),
+                0
+            ));
+            assert_eq!(SFileGetLastError(), ERROR_INVALID_HANDLE);
+        }
+    }
+
+    #[test]
+    fn test_verify_file_invalid_params() {
+        // Test SFileVerifyFile with invalid parameters
+        unsafe {
+            // Null filename should fail
+            assert!(!SFileVerifyFile(
+                ptr::null_mut(),
+                ptr::null(),
+                SFILE_VERIFY_ALL
+            ));
+            assert_eq!(SFileGetLastError(), ERROR_INVALID_PARAMETER);
+
+            // Invalid handle should fail
+            assert!(!SFileVerifyFile(
+                ptr::null_mut(),
+                c"test.txt".as_ptr(),
+                SFILE_VERIFY_ALL
+            ));
+            assert_eq!(SFileGetLastError(), ERROR_INVALID_HANDLE);
+        }
+    }
+
+    #[test]
+    fn test_verify_archive_invalid_params() {
+        // Test SFileVerifyArchive with invalid parameters
+        // Invalid handle should fail
+        unsafe {
+            assert!(!SFileVerifyArchive(ptr::null_mut(), SFILE_VERIFY_SIGNATURE));
+        }
+        assert_eq!(SFileGetLastError(), ERROR_INVALID_HANDLE);
+    }
+
+    #[test]
+    fn test_create_archive_invalid_params() {
+        // Test SFileCreateArchive with invalid parameters
+        unsafe {
+            let mut handle = ptr::null_mut();
+
+            // Null filename should fail
+            assert!(!SFileCreateArchive(
+                ptr::null(),
+                CREATE_ALWAYS,
+                16,
+                &mut handle
+            ));
+            assert_eq!(SFileGetLastError(), ERROR_INVALID_PARAMETER);
+
+            // Null handle should fail
+            assert!(!SFileCreateArchive(
+                c"test.mpq".as_ptr(),
+                CREATE_ALWAYS,
+                16,
+                ptr::null_mut()
+            ));
+            assert_eq!(SFileGetLastError(), ERROR_INVALID_PARAMETER);
+
+            // Invalid hash table size (not power of 2) should fail
+            assert!(!SFileCreateArchive(
+                c"test.mpq".as_ptr(),
+                CREATE_ALWAYS,
+                15, // Not a power of 2
+                &mut handle
+            ));
+            assert_eq!(SFileGetLastError(), ERROR_INVALID_PARAMETER);
+
+            // Hash table size too small should fail
+            assert!(!SFileCreateArchive(
+                c"test.mpq".as_ptr(),
+                CREATE_ALWAYS,
+                2, // Less than minimum of 4
+                &mut handle
+            ));
+            assert_eq!(SFileGetLastError(), ERROR_INVALID_PARAMETER);
+        }
+    }
+
+    #[test]
+    fn test_read_file_streams_sectors() {
+        let temp_dir = tempfile::TempDir::new().unwrap();
+        let path = temp_dir.path().join("stream.mpq");
+        let content: Vec<u8> = (0..100_000u32).map(|i| (i % 251) as u8).collect();
+        ArchiveBuilder::new()
+            .add_file_data(content.clone(), "large.bin")
+            .build(&path)
+            .unwrap();
+
+        let path_c = CString::new(path.to_str().unwrap()).unwrap();
+        unsafe {
+            let mut archive = ptr::null_mut();
+            assert!(SFileOpenArchive(path_c.as_ptr(), 0, 0, &mut archive));
+
+            let mut file = ptr::null_mut();
+            assert!(SFileOpenFileEx(
+                archive,
+                c"large.bin".as_ptr(),
+                0,
+                &mut file
+            ));
+            assert_eq!(
+                SFileGetFileSize(file, ptr::null_mut()),
+                content.len() as u32
+            );
+
+            // Read a range spanning several sectors from the middle of the file
+            let mut buffer = vec![0u8; 20_000];
+            let mut read = 0u32;
+            assert_eq!(SFileSetFilePointer(file, 5_000, ptr::null_mut(), 0), 5_000);
+            assert!(SFileReadFile(
+                file,
+                buffer.as_mut_ptr() as *mut c_void,
+                buffer.len() as u32,
+                &mut read,
+                ptr::null_mut()
+            ));
+            assert_eq!(read as usize, buffer.len());
+            assert_eq!(&buffer[..], &content[5_000..25_000]);
+
+            // Reads are clamped at the end of the file
+            SFileSetFilePointer(file, -10, ptr::null_mut(), 2);
+            assert!(SFileReadFile(
+                file,
+                buffer.as_mut_ptr() as *mut c_void,
+                buffer.len() as u32,
+                &mut read,
+                ptr::null_mut()
+            ));
+            assert_eq!(read, 10);
+            assert_eq!(&buffer[..10], &content[content.len() - 10..]);
+
+            assert!(SFileCloseFile(file));
+            assert!(SFileCloseArchive(archive));
+        }
+    }
+
+    #[test]
+    #[cfg(feature = "mmap")]
+    fn test_map_stored_file() {
+        let temp_dir = tempfile::TempDir::new().unwrap();
+        let path = temp_dir.path().join("mapped.mpq");
+        let stored: Vec<u8> = (0..50_000u32).map(|i| (i % 251) as u8).collect();
+        ArchiveBuilder::new()
+            .add_file_data_with_options(stored.clone(), "stored.blp", 0, false, 0)
+            .add_file_data(stored.clone(), "compressed.bin")
+            .build(&path)
+            .unwrap();
+
+        let path_c = CString::new(path.to_str().unwrap()).unwrap();
+        unsafe {
+            let mut archive = ptr::null_mut();
+            assert!(SFileOpenArchive(
+                path_c.as_ptr(),
+                0,
+                BASE_PROVIDER_MAP,
+                &mut archive
+            ));
+
+            let mut file = ptr::null_mut();
+            assert!(SFileOpenFileEx(
+                archive,
+                c"stored.blp".as_ptr(),
+                0,
+                &mut file
+            ));
+
+            let mut data = ptr::null();
+            let mut size = 0u32;
+            let mut size_high = 0u32;
+            assert!(SFileMapFile(file, &mut data, &mut size, &mut size_high));
+            assert_eq!(size as usize, stored.len());
+            assert_eq!(size_high, 0);
+            let mapped = std::slice::from_raw_parts(data as *const u8, size as usize);
+            assert_eq!(mapped, &stored[..]);
+            assert!(SFileCloseFile(file));
+
+            // Sectored compressed files have to be read
+            assert!(SFileOpenFileEx(
+                archive,
+                c"compressed.bin".as_ptr(),
+                0,
+                &mut file
+            ));
+            assert!(!SFileMapFile(file, &mut data, &mut size, ptr::null_mut()));
+            assert_eq!(SFileGetLastError(), ERROR_NOT_SUPPORTED);
+            assert!(SFileCloseFile(file));
+
+            assert!(SFileCloseArchive(archive));
+        }
+    }
+
+    #[test]
+    fn test_extract_files_batch() {
+        let temp_dir = tempfile::TempDir::new().unwrap();
+        let path = temp_dir.path().join("batch.mpq");
+        let mut builder = ArchiveBuilder::new();
+        for i in 0..8 {
+            let content = format!("batch file {i}").repeat(500);
+            builder = builder.add_file_data(content.into_bytes(), &format!("dir\\file_{i}.txt"));
+        }
+        builder.build(&path).unwrap();
+
+        let names: Vec<CString> = (0..8)
+            .map(|i| CString::new(format!("dir\\file_{i}.txt")).unwrap())
+            .chain(std::iter::once(CString::new("missing.txt").unwrap()))
+            .collect();
+        let dests: Vec<CString> = (0..names.len())
+            .map(|i| {
+                let dest = temp_dir.path().join("out").join(format!("{i}.txt"));
+                CString::new(dest.to_str().unwrap()).unwrap()
+            })
+            .collect();
+        let name_ptrs: Vec<*const c_char> = names.iter().map(|s| s.as_ptr()).collect();
+        let dest_ptrs: Vec<*const c_char> = dests.iter().map(|s| s.as_ptr()).collect();
+
+        let path_c = CString::new(path.to_str().unwrap()).unwrap();
+        unsafe {
+            let mut archive = ptr::null_mut();
+            assert!(SFileOpenArchive(path_c.as_ptr(), 0, 0, &mut archive));
+
+            // All but the missing file are extracted
+            let mut extracted = 0u32;
+            assert!(!SFileExtractFiles(
+                archive,
+                name_ptrs.as_ptr(),
+                dest_ptrs.as_ptr(),
+                name_ptrs.len() as u32,
+                2,
+                0,
+                &mut extracted
+            ));
+            assert_eq!(SFileGetLastError(), ERROR_FILE_NOT_FOUND);
+            assert_eq!(extracted, 8);
+
+            for i in 0..8 {
+                let written =
+                    fs::read(temp_dir.path().join("out").join(format!("{i}.txt"))).unwrap();
+                assert_eq!(written, format!("batch file {i}").repeat(500).into_bytes());
+            }
+
+            assert!(SFileExtractFiles(
+                archive,
+                name_ptrs.as_ptr(),
+                dest_ptrs.as_ptr(),
+                8,
+                0,
+                0,
+                &mut extracted
+            ));
+            assert_eq!(extracted, 8);
+
+            // Request order reads the same files one at a time
+            fs::remove_dir_all(temp_dir.path().join("out")).unwrap();
+            assert!(SFileExtractFiles(
+                archive,
+                name_ptrs.as_ptr(),
+                dest_ptrs.as_ptr(),
+                8,
+                2,
+                SFILE_EXTRACT_REQUEST_ORDER,
+                &mut extracted
+            ));
+            assert_eq!(extracted, 8);
+            for i in 0..8 {
+                let written =
+                    fs::read(temp_dir.path().join("out").join(format!("{i}.txt"))).unwrap();
+                assert_eq!(written, format!("batch file {i}").repeat(500).into_bytes());
+            }
+
+            assert!(SFileCloseArchive(archive));
+        }
+    }
+
+    #[test]
+    fn test_lookup_cache_prewarm_and_stats() {
+        let temp_dir = tempfile::TempDir::new().unwrap();
+        let path = temp_dir.path().join("lookup.mpq");
+        ArchiveBuilder::new()
+            .add_file_data(b"one".to_vec(), "dir\\one.txt")
+            .add_file_data(b"two".to_vec(), "dir\\two.txt")
+            .build(&path)
+            .unwrap();
+
+        let read_counter = |archive: HANDLE, info_class: u32| -> u64 {
+            let mut value = 0u64;
+            unsafe {
+                assert!(SFileGetFileInfo(
+                    archive,
+                    info_class,
+                    &mut value as *mut u64 as *mut c_void,
+                    8,
+                    ptr::null_mut()
+                ));
+            }
+            value
+        };
+
+        let path_c = CString::new(path.to_str().unwrap()).unwrap();
+        unsafe {
+            let mut archive = ptr::null_mut();
+            assert!(SFileOpenArchive(path_c.as_ptr(), 0, 0, &mut archive));
+            assert_eq!(read_counter(archive, SFILE_INFO_LOOKUP_CACHE_ENTRIES), 0);
 
-impl FindHandle {
-    fn matches_mask(&self, filename: &str) -> bool {
-        // Simple wildcard matching supporting * and ?
-        let mask = &self.search_mask;
+            // Warm from the archive's own (listfile)
+            let mut found = 0u32;
+            assert!(SFilePrewarmLookupCache(archive, ptr::null(), &mut found));
+            assert_eq!(found, 2);
 
-        // Handle simple cases first
-        if mask == "*" || mask == "*.*" {
-            return true;
-        }
+            assert!(SFileHasFile(archive, c"DIR/ONE.TXT".as_ptr()));
+            assert!(SFileHasFile(archive, c"dir\\two.txt".as_ptr()));
+            assert!(!SFileHasFile(archive, c"dir\\three.txt".as_ptr()));
+            assert!(!SFileHasFile(archive, c"dir\\three.txt".as_ptr()));
 
-        // Simple wildcard matching without regex
-        wildcard_match(&mask.to_lowercase(), &filename.to_lowercase())
-    }
-}
+            assert_eq!(read_counter(archive, SFILE_INFO_LOOKUP_CACHE_HITS), 3);
+            assert_eq!(read_counter(archive, SFILE_INFO_LOOKUP_CACHE_MISSES), 1);
 
-// Simple wildcard pattern matching
-fn wildcard_match(pattern: &str, text: &str) -> bool {
-    let mut pattern_chars = pattern.chars().peekable();
-    let mut text_chars = text.chars().peekable();
+            assert!(SFileSetLookupCacheSize(archive, 0));
+            assert_eq!(read_counter(archive, SFILE_INFO_LOOKUP_CACHE_HITS), 0);
+            // No sector cache is attached while its budget is 0
+            assert_eq!(read_counter(archive, SFILE_INFO_SECTOR_CACHE_BYTES), 0);
 
-    while let Some(p) = pattern_chars.peek().copied() {
-        match p {
-            '*' => {
-                pattern_chars.next();
-                // If * is at the end, match everything
-                if pattern_chars.peek().is_none() {
-                    return true;
-                }
-                // Try matching rest of pattern at each position
-                let remaining_pattern: String = pattern_chars.collect();
-                let mut remaining_text = text_chars.clone();
-                loop {
-                    let remaining_text_str: String = remaining_text.clone().collect();
-                    if wildcard_match(&remaining_pattern, &remaining_text_str) {
-                        return true;
-                    }
-                    if remaining_text.next().is_none() {
-                        return false;
-                    }
-                }
-            }
-            '?' => {
-                pattern_chars.next();
-                if text_chars.next().is_none() {
-                    return false;
-                }
-            }
-            _ => {
-                pattern_chars.next();
-                match text_chars.next() {
-                    Some(t) if t == p => continue,
-                    _ => return false,
-                }
-            }
+            assert!(SFileCloseArchive(archive));
         }
     }
 
-    // Pattern consumed, text should be too
-    text_chars.next().is_none()
-}
+    #[test]
+    fn test_close_recycles_decompression_buffers() {
+        let temp_dir = tempfile::TempDir::new().unwrap();
+        let path = temp_dir.path().join("pool.mpq");
+        let data = vec![b'x'; 40_000];
+        ArchiveBuilder::new()
+            .add_file_data(data.clone(), "Creature\\Model.m2")
+            .build(&path)
+            .unwrap();
+
+        let path_c = CString::new(path.to_str().unwrap()).unwrap();
+        unsafe {
+            let mut archive = ptr::null_mut();
+            assert!(SFileOpenArchive(path_c.as_ptr(), 0, 0, &mut archive));
+
+            let open_read_close = || {
+                let mut file = ptr::null_mut();
+                assert!(SFileOpenFileEx(
+                    archive,
+                    c"Creature\\Model.m2".as_ptr(),
+                    0,
+                    &mut file
+                ));
+                let mut buffer = vec![0u8; data.len()];
+                let mut read = 0u32;
+                assert!(SFileReadFile(
+                    file,
+                    buffer.as_mut_ptr() as *mut c_void,
+                    buffer.len() as u32,
+                    &mut read,
+                    ptr::null_mut()
+                ));
+                assert_eq!(buffer, data);
+                assert!(SFileCloseFile(file));
+            };
+            // The pool is process-wide, so its counters come with the
+            // process statistics rather than the archive's info classes
+            let pool_hits = || {
+                let mut statistics = std::mem::MaybeUninit::<SFILE_STATISTICS>::uninit();
+                assert!(SFileGetStatistics(statistics.as_mut_ptr()));
+                statistics.assume_init().buffer_pool_hits
+            };
 
-/// File finding functions with wildcard support
-///
-/// # Safety
-///
-/// - `h_mpq` must be a valid MPQ archive handle
-/// - `sz_mask` must be a valid null-terminated C string (can be NULL for "*")
-/// - `lp_find_file_data` must be a valid pointer to SFILE_FIND_DATA
-/// - `sz_list_file` can be NULL
-#[no_mangle]
-pub unsafe extern "C" fn SFileFindFirstFile(
-    h_mpq: HANDLE,
-    sz_mask: *const c_char,
-    lp_find_file_data: *mut SFILE_FIND_DATA,
-    _sz_list_file: *const c_char, // Ignored - we use internal listfile
-) -> HANDLE {
-    // Validate parameters
-    if lp_find_file_data.is_null() {
-        set_last_error(ERROR_INVALID_PARAMETER);
-        return INVALID_HANDLE_VALUE;
-    }
+            // Buffers freed by the first close are reused by the second open
+            open_read_close();
+            let hits = pool_hits();
+            open_read_close();
+            assert!(pool_hits() > hits);
 
-    let archive_id = match handle_to_id(h_mpq) {
-        Some(id) => id,
-        None => {
-            set_last_error(ERROR_INVALID_HANDLE);
-            return INVALID_HANDLE_VALUE;
+            assert!(SFileCloseArchive(archive));
         }
-    };
+    }
 
-    // Get search mask
-    let search_mask = if sz_mask.is_null() {
-        "*".to_string()
-    } else {
-        match CStr::from_ptr(sz_mask).to_str() {
-            Ok(s) => s.to_string(),
-            Err(_) => {
-                set_last_error(ERROR_INVALID_PARAMETER);
-                return INVALID_HANDLE_VALUE;
-            }
+    #[test]
+    fn test_concurrent_reads_on_shared_archive() {
+        let temp_dir = tempfile::TempDir::new().unwrap();
+        let path = temp_dir.path().join("concurrent.mpq");
+        let mut builder = ArchiveBuilder::new();
+        for i in 0..8u8 {
+            builder = builder.add_file_data(vec![i; 50_000], &format!("file_{i}.bin"));
         }
-    };
+        builder.build(&path).unwrap();
 
-    // Get file list from archive
-    let file_list = {
-        let mut archives = ARCHIVES.lock().unwrap();
-        match archives.get_mut(&archive_id) {
-            Some(archive_handle) => {
-                match archive_handle {
-                    ArchiveHandle::ReadOnly { archive, .. } => {
-                        match archive.list() {
-                            Ok(list) => list,
-                            Err(_) => {
-                                // Try list_all if no listfile
-                                match archive.list_all() {
-                                    Ok(list) => list,
-                                    Err(_) => {
-                                        set_last_error(ERROR_FILE_NOT_FOUND);
-                                        return INVALID_HANDLE_VALUE;
-                                    }
-                                }
-                            }
-                        }
-                    }
-                    ArchiveHandle::Mutable { archive, .. } => match archive.list() {
-                        Ok(list) => list,
-                        Err(_) => {
-                            set_last_error(ERROR_FILE_NOT_FOUND);
-                            return INVALID_HANDLE_VALUE;
-                        }
-                    },
-                }
-            }
-            None => {
-                set_last_error(ERROR_INVALID_HANDLE);
-                return INVALID_HANDLE_VALUE;
-            }
+        let path_c = CString::new(path.to_str().unwrap()).unwrap();
+        let mut archive = ptr::null_mut();
+        unsafe {
+            assert!(SFileOpenArchive(path_c.as_ptr(), 0, 0, &mut archive));
         }
-    };
-
-    // Create find handle
-    let mut find_handle = FindHandle {
-        archive_handle: archive_id,
-        file_list,
-        current_index: 0,
-        search_mask,
-    };
-
-    // Find first matching file
-    let found_file = loop {
-        if find_handle.current_index >= find_handle.file_list.len() {
-            set_last_error(ERROR_FILE_NOT_FOUND);
-            return INVALID_HANDLE_VALUE;
+        let archive_id = handle_to_id(archive).unwrap();
+
+        let workers: Vec<_> = (0..8u8)
+            .map(|i| {
+                std::thread::spawn(move || unsafe {
+                    let name = CString::new(format!("file_{i}.bin")).unwrap();
+                    let mut file = ptr::null_mut();
+                    assert!(SFileOpenFileEx(
+                        id_to_handle(archive_id),
+                        name.as_ptr(),
+                        0,
+                        &mut file
+                    ));
+
+                    let mut buffer = vec![0u8; 50_000];
+                    let mut read = 0u32;
+                    assert!(SFileReadFile(
+                        file,
+                        buffer.as_mut_ptr() as *mut c_void,
+                        buffer.len() as u32,
+                        &mut read,
+                        ptr::null_mut()
+                    ));
+                    assert_eq!(read as usize, buffer.len());
+                    assert!(buffer.iter().all(|&b| b == i));
+                    assert!(SFileCloseFile(file));
+                })
+            })
+            .collect();
+
+        for worker in workers {
+            worker.join().unwrap();
         }
 
-        let file = &find_handle.file_list[find_handle.current_index];
-        if find_handle.matches_mask(&file.name) {
-            break Some(file);
-        }
+        assert!(SFileCloseArchive(archive));
+    }
 
-        find_handle.current_index += 1;
-    };
+    #[test]
+    fn test_open_patch_archive() {
+        let temp_dir = tempfile::TempDir::new().unwrap();
+        let base_path = temp_dir.path().join("base.mpq");
+        let patch_path = temp_dir.path().join("patch.mpq");
+        ArchiveBuilder::new()
+            .add_file_data(b"base version".to_vec(), "shared.txt")
+            .add_file_data(b"base only".to_vec(), "base.txt")
+            .build(&base_path)
+            .unwrap();
+        ArchiveBuilder::new()
+            .add_file_data(b"patched version".to_vec(), "shared.txt")
+            .add_file_data(b"patch only".to_vec(), "patch.txt")
+            .build(&patch_path)
+            .unwrap();
+
+        let base_c = CString::new(base_path.to_str().unwrap()).unwrap();
+        let patch_c = CString::new(patch_path.to_str().unwrap()).unwrap();
+
+        unsafe fn read_all(archive: HANDLE, name: &CStr) -> Vec<u8> {
+            let mut file = ptr::null_mut();
+            assert!(SFileOpenFileEx(archive, name.as_ptr(), 0, &mut file));
+            let size = SFileGetFileSize(file, ptr::null_mut());
+            let mut buffer = vec![0u8; size as usize];
+            let mut read = 0u32;
+            assert!(SFileReadFile(
+                file,
+                buffer.as_mut_ptr() as *mut c_void,
+                size,
+                &mut read,
+                ptr::null_mut()
+            ));
+            assert!(SFileCloseFile(file));
+            buffer
+        }
 
-    if let Some(file) = found_file {
-        // Fill find data
-        fill_find_data(lp_find_file_data, file, archive_id);
+        unsafe {
+            let mut archive = ptr::null_mut();
+            assert!(SFileOpenArchive(base_c.as_ptr(), 0, 0, &mut archive));
+            assert!(!SFileIsPatchedArchive(archive));
+            assert!(!SFileHasFile(archive, c"patch.txt".as_ptr()));
 
-        // Store find handle
-        let mut next_id = NEXT_HANDLE.lock().unwrap();
-        let handle_id = *next_id;
-        *next_id += 1;
-        drop(next_id);
+            assert!(SFileOpenPatchArchive(
+                archive,
+                patch_c.as_ptr(),
+                ptr::null(),
+                0
+            ));
+            assert!(SFileIsPatchedArchive(archive));
 
-        find_handle.current_index += 1; // Move to next for SFileFindNextFile
-        FIND_HANDLES.lock().unwrap().insert(handle_id, find_handle);
+            assert_eq!(read_all(archive, c"shared.txt"), b"patched version");
+            assert_eq!(read_all(archive, c"base.txt"), b"base only");
+            assert_eq!(read_all(archive, c"patch.txt"), b"patch only");
+            assert!(SFileHasFile(archive, c"patch.txt".as_ptr()));
 
-        set_last_error(ERROR_SUCCESS);
-        id_to_handle(handle_id)
-    } else {
-        set_last_error(ERROR_FILE_NOT_FOUND);
-        INVALID_HANDLE_VALUE
-    }
-}
+            // A missing patch archive leaves the existing chain intact
+            assert!(!SFileOpenPatchArchive(
+                archive,
+                c"does-not-exist.mpq".as_ptr(),
+                ptr::null(),
+                0
+            ));
+            assert!(SFileIsPatchedArchive(archive));
 
-/// Find the next file matching the search criteria
-///
-/// # Safety
-///
-/// - `h_find` must be a valid find handle from SFileFindFirstFile
-/// - `lp_find_file_data` must be a valid pointer to SFILE_FIND_DATA
-#[no_mangle]
-pub unsafe extern "C" fn SFileFindNextFile(
-    h_find: HANDLE,
-    lp_find_file_data: *mut SFILE_FIND_DATA,
-) -> bool {
-    if lp_find_file_data.is_null() {
-        set_last_error(ERROR_INVALID_PARAMETER);
-        return false;
+            assert!(SFileCloseArchive(archive));
+        }
     }
 
-    let handle_id = match handle_to_id(h_find) {
-        Some(id) => id,
-        None => {
-            set_last_error(ERROR_INVALID_HANDLE);
-            return false;
+    #[test]
+    fn test_glob_enumeration() {
+        let temp_dir = tempfile::TempDir::new().unwrap();
+        let path = temp_dir.path().join("enum.mpq");
+        ArchiveBuilder::new()
+            .add_file_data(b"a".to_vec(), "World\\Maps\\Azeroth\\Azeroth_32_48.adt")
+            .add_file_data(b"b".to_vec(), "World\\Maps\\Azeroth\\Azeroth_32_49.adt")
+            .add_file_data(b"c".to_vec(), "World\\Maps\\Azeroth\\Azeroth.wdt")
+            .add_file_data(b"d".to_vec(), "World\\Maps\\Kalimdor\\Kalimdor_1_1.adt")
+            .add_file_data(b"e".to_vec(), "Interface\\logo.blp")
+            .build(&path)
+            .unwrap();
+
+        extern "C" fn collect(name: *const c_char, user_data: *mut c_void) -> bool {
+            let names = unsafe { &mut *(user_data as *mut Vec<String>) };
+            names.push(
+                unsafe { CStr::from_ptr(name) }
+                    .to_string_lossy()
+                    .into_owned(),
+            );
+            true
         }
-    };
 
-    let mut find_handles = FIND_HANDLES.lock().unwrap();
-    let find_handle = match find_handles.get_mut(&handle_id) {
-        Some(handle) => handle,
-        None => {
-            set_last_error(ERROR_INVALID_HANDLE);
-            return false;
+        let path_c = CString::new(path.to_str().unwrap()).unwrap();
+        let mut archive = ptr::null_mut();
+        unsafe {
+            assert!(SFileOpenArchive(path_c.as_ptr(), 0, 0, &mut archive));
+
+            let mut names: Vec<String> = Vec::new();
+            assert!(SFileEnumFiles(
+                archive,
+                c"world/maps/azeroth/*.ADT".as_ptr(),
+                ptr::null(),
+                Some(collect),
+                &mut names as *mut Vec<String> as *mut c_void
+            ));
+            assert_eq!(
+                names,
+                [
+                    "World\\Maps\\Azeroth\\Azeroth_32_48.adt",
+                    "World\\Maps\\Azeroth\\Azeroth_32_49.adt",
+                ]
+            );
+
+            let mut find_data: SFILE_FIND_DATA = std::mem::zeroed();
+            let find = SFileFindFirstFile(
+                archive,
+                c"World\\Maps\\*_1_?.adt".as_ptr(),
+                &mut find_data,
+                ptr::null(),
+            );
+            assert!(!find.is_null() && find != INVALID_HANDLE_VALUE);
+            let found = CStr::from_ptr(find_data.c_file_name.as_ptr());
+            assert_eq!(
+                found.to_str().unwrap(),
+                "World\\Maps\\Kalimdor\\Kalimdor_1_1.adt"
+            );
+            assert!(!SFileFindNextFile(find, &mut find_data));
+            assert_eq!(SFileGetLastError(), ERROR_NO_MORE_FILES);
+            assert!(SFileFindClose(find));
+
+            let find =
+                SFileFindFirstFile(archive, c"Sound\\*".as_ptr(), &mut find_data, ptr::null());
+            assert_eq!(find, INVALID_HANDLE_VALUE);
+            assert_eq!(SFileGetLastError(), ERROR_FILE_NOT_FOUND);
+
+            assert!(SFileCloseArchive(archive));
         }
-    };
+    }
 
-    // Find next matching file
-    let found_file = loop {
-        if find_handle.current_index >= find_handle.file_list.len() {
-            set_last_error(ERROR_NO_MORE_FILES);
-            return false;
+    #[test]
+    fn test_read_file_async() {
+        let temp_dir = tempfile::TempDir::new().unwrap();
+        let path = temp_dir.path().join("async.mpq");
+        let data: Vec<u8> = (0..100_000u32).map(|i| (i % 251) as u8).collect();
+        ArchiveBuilder::new()
+            .add_file_data(data.clone(), "data.bin")
+            .build(&path)
+            .unwrap();
+
+        extern "C" fn on_read(
+            _file: HANDLE,
+            _buffer: *mut c_void,
+            bytes_read: u32,
+            error: u32,
+            user_data: *mut c_void,
+        ) {
+            assert_eq!(error, ERROR_SUCCESS);
+            let total = unsafe { &*(user_data as *const std::sync::atomic::AtomicU32) };
+            total.fetch_add(bytes_read, std::sync::atomic::Ordering::SeqCst);
         }
 
-        let file = &find_handle.file_list[find_handle.current_index];
-        find_handle.current_index += 1;
+        let path_c = CString::new(path.to_str().unwrap()).unwrap();
+        let mut archive = ptr::null_mut();
+        let mut file = ptr::null_mut();
+        let total = std::sync::atomic::AtomicU32::new(0);
+        let mut buffer = vec![0u8; data.len()];
+        unsafe {
+            assert!(SFileOpenArchive(path_c.as_ptr(), 0, 0, &mut archive));
+            assert!(SFileOpenFileEx(archive, c"data.bin".as_ptr(), 0, &mut file));
+
+            // Back-to-back reads cover consecutive parts of the file
+            for chunk in buffer.chunks_mut(30_000) {
+                assert!(SFileReadFileAsync(
+                    file,
+                    chunk.as_mut_ptr() as *mut c_void,
+                    chunk.len() as u32,
+                    Some(on_read),
+                    &total as *const _ as *mut c_void
+                ));
+            }
+            // The file may be closed while reads are pending
+            assert!(SFileCloseFile(file));
+            assert!(SFileWaitAsyncReads(u32::MAX));
+
+            let mut stats = SFILE_ASYNC_STATS::default();
+            assert!(SFileGetAsyncReadStats(&mut stats));
+            assert!(stats.threads >= 2);
+            assert!(stats.completed >= 4);
 
-        if find_handle.matches_mask(&file.name) {
-            break Some(file);
+            assert!(SFileCloseArchive(archive));
         }
-    };
 
-    if let Some(file) = found_file {
-        fill_find_data(lp_find_file_data, file, find_handle.archive_handle);
-        set_last_error(ERROR_SUCCESS);
-        true
-    } else {
-        set_last_error(ERROR_NO_MORE_FILES);
-        false
+        assert_eq!(total.into_inner() as usize, data.len());
+        assert_eq!(buffer, data);
     }
-}
 
-/// Close a find handle
-///
-/// # Safety
-///
-/// - `h_find` must be a valid find handle from SFileFindFirstFile
-#[no_mangle]
-pub unsafe extern "C" fn SFileFindClose(h_find: HANDLE) -> bool {
-    let handle_id = match handle_to_id(h_find) {
-        Some(id) => id,
-        None => {
-            set_last_error(ERROR_INVALID_HANDLE);
-            return false;
+    #[test]
+    fn test_verify_archive_ex_reports_failures() {
+        let temp_dir = tempfile::TempDir::new().unwrap();
+        let path = temp_dir.path().join("verify.mpq");
+        // Incompressible data, so a flipped byte shows up as a bad sector
+        let mut state = 0x9E37_79B9u32;
+        let mut random = |len: usize| -> Vec<u8> {
+            (0..len)
+                .map(|_| {
+                    state ^= state << 13;
+                    state ^= state >> 17;
+                    state ^= state << 5;
+                    state as u8
+                })
+                .collect()
+        };
+        ArchiveBuilder::new()
+            .generate_crcs(true)
+            .attributes_option(AttributesOption::GenerateFull)
+            .add_file_data(random(50_000), "Textures\\A.blp")
+            .add_file_data(random(50_000), "Textures\\B.blp")
+            .add_file_data(b"readme".to_vec(), "readme.txt")
+            .build(&path)
+            .unwrap();
+
+        extern "C" fn on_progress(done: u32, total: u32, user_data: *mut c_void) {
+            assert!(done <= total);
+            let last = unsafe { &*(user_data as *const std::sync::atomic::AtomicU32) };
+            assert_eq!(last.swap(done, Ordering::Relaxed) + 1, done);
         }
-    };
-
-    if FIND_HANDLES.lock().unwrap().remove(&handle_id).is_some() {
-        set_last_error(ERROR_SUCCESS);
-        true
-    } else {
-        set_last_error(ERROR_INVALID_HANDLE);
-        false
-    }
-}
 
-// Helper function to fill SFILE_FIND_DATA
-unsafe fn fill_find_data(
-    find_data: *mut SFILE_FIND_DATA,
-    file_entry: &FileEntry,
-    archive_id: usize,
-) {
-    let find_data = &mut *find_data;
+        let path_c = CString::new(path.to_str().unwrap()).unwrap();
+        unsafe {
+            let mut archive = ptr::null_mut();
+            assert!(SFileOpenArchive(path_c.as_ptr(), 0, 0, &mut archive));
+            assert!(SFileVerifyArchive(archive, SFILE_VERIFY_ALL_FILES));
+            assert!(SFileCloseArchive(archive));
+        }
 
-    // Copy filename
-    let name_bytes = file_entry.name.as_bytes();
-    let copy_len = name_bytes.len().min(259); // Leave room for null terminator
+        let info = Archive::open(&path)
+            .unwrap()
+            .find_file("Textures\\B.blp")
+            .unwrap()
+            .unwrap();
+        let mut bytes = fs::read(&path).unwrap();
+        bytes[(info.file_pos + info.compressed_size / 2) as usize] ^= 0xFF;
+        fs::write(&path, bytes).unwrap();
+
+        let last = std::sync::atomic::AtomicU32::new(0);
+        let mut failures: Vec<SFILE_VERIFY_FAILURE> = Vec::with_capacity(4);
+        let mut failure_count = 0u32;
+        unsafe {
+            let mut archive = ptr::null_mut();
+            assert!(SFileOpenArchive(path_c.as_ptr(), 0, 0, &mut archive));
+            assert!(!SFileVerifyArchiveEx(
+                archive,
+                SFILE_VERIFY_ALL_FILES,
+                2,
+                Some(on_progress),
+                &last as *const _ as *mut c_void,
+                failures.as_mut_ptr(),
+                4,
+                &mut failure_count
+            ));
+            assert_eq!(SFileGetLastError(), ERROR_FILE_CORRUPT);
+            failures.set_len(failure_count.min(4) as usize);
 
-    // Zero the entire buffer first
-    find_data.c_file_name.fill(0);
+            assert!(!SFileVerifyFile(
+                archive,
+                c"Textures\\B.blp".as_ptr(),
+                SFILE_VERIFY_FILE_CRC
+            ));
+            assert!(SFileVerifyFile(archive, c"Textures\\A.blp".as_ptr(), 0));
+            assert!(SFileCloseArchive(archive));
+        }
 
-    // Copy the filename
-    for (i, &byte) in name_bytes.iter().take(copy_len).enumerate() {
-        find_data.c_file_name[i] = byte as c_char;
+        // Every stored file is reported, including the special files
+        assert!(last.load(Ordering::Relaxed) >= 3);
+        assert_eq!(failure_count, 1);
+        let name = unsafe { CStr::from_ptr(failures[0].file_name.as_ptr()) };
+        assert_eq!(name.to_str().unwrap(), "Textures\\B.blp");
+        assert_eq!(failures[0].block_index, info.block_index as u32);
+        assert_eq!(failures[0].failure, SFILE_VERIFY_FAILED_SECTOR_CRC);
     }
 
-    // Set plain name pointer (points to last component after backslash)
-    let plain_name_offset = file_entry.name.rfind('\\').map(|pos| pos + 1).unwrap_or(0);
-    find_data.sz_plain_name = find_data.c_file_name.as_mut_ptr().add(plain_name_offset);
-
-    // Set file information
-    find_data.hash_index = if let Some((hash_idx, _)) = file_entry.table_indices {
-        hash_idx as u32
-    } else {
-        0xFFFFFFFF
-    };
-    find_data.block_index = if let Some((_, Some(block_idx))) = file_entry.table_indices {
-        block_idx as u32
-    } else {
-        0xFFFFFFFF
-    };
-    find_data.file_size = file_entry.size as u32;
-    find_data.file_flags = file_entry.flags;
-    find_data.comp_size = file_entry.compressed_size as u32;
-    find_data.file_time_lo = 0; // Timestamp not available in basic FileEntry
-    find_data.file_time_hi = 0;
-    find_data.lc_locale = 0; // Locale not directly available in FileEntry
+    #[test]
+    fn test_get_file_metadata() {
+        let temp_dir = tempfile::TempDir::new().unwrap();
+        let path = temp_dir.path().join("metadata.mpq");
+        let data = vec![b'm'; 30_000];
+        ArchiveBuilder::new()
+            .attributes_option(AttributesOption::GenerateFull)
+            .add_file_data(data.clone(), "DBFilesClient\\Map.dbc")
+            .add_file_data(b"tiny".to_vec(), "tiny.txt")
+            .build(&path)
+            .unwrap();
+        let mut expected = Archive::open(&path).unwrap();
+        expected.load_attributes().unwrap();
+        let info = expected
+            .find_file("DBFilesClient\\Map.dbc")
+            .unwrap()
+            .unwrap();
+        let crc32 = expected
+            .get_file_attributes(info.block_index)
+            .and_then(|attrs| attrs.crc32)
+            .unwrap();
 
-    // Try to get additional info from archive if available
-    let mut archives = ARCHIVES.lock().unwrap();
-    if let Some(archive_handle) = archives.get_mut(&archive_id) {
-        match archive_handle {
-            ArchiveHandle::ReadOnly { archive, .. } => {
-                // Try to get file attributes for timestamp
-                if let Some((_, Some(block_idx))) = file_entry.table_indices {
-                    if let Some(attrs) = archive.get_file_attributes(block_idx) {
-                        if let Some(filetime) = attrs.filetime {
-                            find_data.file_time_lo = (filetime & 0xFFFFFFFF) as u32;
-                            find_data.file_time_hi = (filetime >> 32) as u32;
-                        }
-                    }
-                }
-            }
-            ArchiveHandle::Mutable { archive, .. } => {
-                // Try to get file attributes for timestamp
-                if let Some((_, Some(block_idx))) = file_entry.table_indices {
-                    if let Some(attrs) = archive.archive().get_file_attributes(block_idx) {
-                        if let Some(filetime) = attrs.filetime {
-                            find_data.file_time_lo = (filetime & 0xFFFFFFFF) as u32;
-                            find_data.file_time_hi = (filetime >> 32) as u32;
-                        }
-                    }
-                }
-            }
-        }
-    }
-}
+        let path_c = CString::new(path.to_str().unwrap()).unwrap();
+        unsafe {
+            let mut archive = ptr::null_mut();
+            assert!(SFileOpenArchive(path_c.as_ptr(), 0, 0, &mut archive));
 
-// Error code for no more files
-const ERROR_NO_MORE_FILES: u32 = 18;
+            // Layout shared with StormLib.h, without padding
+            assert_eq!(std::mem::size_of::<SFILE_METADATA>(), 80);
 
-/// Create an MPQ archive with extended options
-///
-/// # Safety
-///
-/// - `filename` must be a valid null-terminated C string
-/// - `create_info` must point to a valid SFILE_CREATE_MPQ structure
-/// - `handle` must be a valid pointer to write the output handle
-#[no_mangle]
-pub unsafe extern "C" fn SFileCreateArchive2(
-    filename: *const c_char,
-    create_info: *const SFILE_CREATE_MPQ,
-    handle: *mut HANDLE,
-) -> bool {
-    // Validate parameters
-    if filename.is_null() || create_info.is_null() || handle.is_null() {
-        set_last_error(ERROR_INVALID_PARAMETER);
-        return false;
-    }
+            // Query the count first
+            let mut count = 0u32;
+            assert!(!SFileGetFileMetadata(
+                archive,
+                ptr::null_mut(),
+                0,
+                &mut count
+            ));
+            assert_eq!(SFileGetLastError(), ERROR_INSUFFICIENT_BUFFER);
+            // Two files plus (listfile) and (attributes)
+            assert_eq!(count, 4);
 
-    // Validate structure size
-    let info = &*create_info;
-    if info.cb_size != std::mem::size_of::<SFILE_CREATE_MPQ>() as u32 {
-        set_last_error(ERROR_INVALID_PARAMETER);
-        return false;
+            let mut entries = vec![SFILE_METADATA::default(); count as usize];
+            assert!(SFileGetFileMetadata(
+                archive,
+                entries.as_mut_ptr(),
+                count,
+                &mut count
+            ));
+            let entry = entries
+                .iter()
+                .find(|e| e.block_index == info.block_index as u32)
+                .unwrap();
+            assert_eq!(entry.file_size, data.len() as u64);
+            assert_eq!(entry.compressed_size, info.compressed_size);
+            assert_eq!(entry.file_flags, info.flags);
+            assert_eq!(entry.hash_index, info.hash_index as u32);
+            assert_eq!(entry.crc32, crc32);
+            assert_eq!(
+                entry.attribute_flags,
+                MPQ_ATTRIBUTE_CRC32 | MPQ_ATTRIBUTE_FILETIME | MPQ_ATTRIBUTE_MD5
+            );
+
+            // The same values are available per open file
+            let mut file = ptr::null_mut();
+            assert!(SFileOpenFileEx(
+                archive,
+                c"DBFilesClient\\Map.dbc".as_ptr(),
+                0,
+                &mut file
+            ));
+            let mut compressed_size = 0u64;
+            assert!(SFileGetFileInfo(
+                file,
+                SFILE_INFO_COMPRESSED_SIZE,
+                &mut compressed_size as *mut u64 as *mut c_void,
+                8,
+                ptr::null_mut()
+            ));
+            assert_eq!(compressed_size, info.compressed_size);
+            let mut flags = 0u32;
+            assert!(SFileGetFileInfo(
+                file,
+                SFILE_INFO_FLAGS,
+                &mut flags as *mut u32 as *mut c_void,
+                4,
+                ptr::null_mut()
+            ));
+            assert_eq!(flags, info.flags);
+            let mut key = 1u32;
+            assert!(SFileGetFileInfo(
+                file,
+                SFILE_INFO_KEY,
+                &mut key as *mut u32 as *mut c_void,
+                4,
+                ptr::null_mut()
+            ));
+            assert_eq!(key, 0);
+
+            assert!(SFileCloseFile(file));
+            assert!(SFileCloseArchive(archive));
+        }
     }
 
-    // Convert filename from C string
-    let filename_str = match CStr::from_ptr(filename).to_str() {
-        Ok(s) => s,
-        Err(_) => {
-            set_last_error(ERROR_INVALID_PARAMETER);
-            return false;
+    #[test]
+    fn test_file_info_of_encrypted_file() {
+        let temp_dir = tempfile::TempDir::new().unwrap();
+        let path = temp_dir.path().join("key.mpq");
+        ArchiveBuilder::new()
+            .add_file_data_with_options(
+                b"secret data ".repeat(100),
+                "Interface\\Secret.lua",
+                wow_mpq::compression::flags::ZLIB,
+                true,
+                0,
+            )
+            .build(&path)
+            .unwrap();
+        let info = Archive::open(&path)
+            .unwrap()
+            .find_file("Interface\\Secret.lua")
+            .unwrap()
+            .unwrap();
+
+        let path_c = CString::new(path.to_str().unwrap()).unwrap();
+        unsafe {
+            let mut archive = ptr::null_mut();
+            assert!(SFileOpenArchive(path_c.as_ptr(), 0, 0, &mut archive));
+            let mut file = ptr::null_mut();
+            assert!(SFileOpenFileEx(
+                archive,
+                c"Interface\\Secret.lua".as_ptr(),
+                0,
+                &mut file
+            ));
+
+            let mut key = 0u32;
+            let mut needed = 0u32;
+            assert!(SFileGetFileInfo(
+                file,
+                SFILE_INFO_KEY,
+                &mut key as *mut u32 as *mut c_void,
+                4,
+                &mut needed
+            ));
+            assert_eq!(needed, 4);
+            assert_eq!(
+                key,
+                wow_mpq::hash_string("Interface\\Secret.lua", wow_mpq::hash_type::FILE_KEY)
+            );
+            let mut flags = 0u32;
+            assert!(SFileGetFileInfo(
+                file,
+                SFILE_INFO_FLAGS,
+                &mut flags as *mut u32 as *mut c_void,
+                4,
+                ptr::null_mut()
+            ));
+            assert_eq!(flags, info.flags);
+            assert_ne!(flags & wow_mpq::BlockEntry::FLAG_ENCRYPTED, 0);
+
+            assert!(SFileCloseFile(file));
+            assert!(SFileCloseArchive(archive));
         }
-    };
+    }
 
-    // Determine MPQ format version
-    let version = match info.mpq_version {
-        1 => FormatVersion::V1,
-        2 => FormatVersion::V2,
-        3 => FormatVersion::V3,
-        4 => FormatVersion::V4,
-        _ => {
-            set_last_error(ERROR_INVALID_PARAMETER);
-            return false;
+    #[test]
+    fn test_open_flags_defer_tables_listfile_and_attributes() {
+        let temp_dir = tempfile::TempDir::new().unwrap();
+        let path = temp_dir.path().join("lazy.mpq");
+        ArchiveBuilder::new()
+            .attributes_option(AttributesOption::GenerateFull)
+            .add_file_data(b"version 3.3.5".to_vec(), "version.txt")
+            .build(&path)
+            .unwrap();
+
+        extern "C" fn collect(name: *const c_char, user_data: *mut c_void) -> bool {
+            let names = unsafe { &mut *(user_data as *mut Vec<String>) };
+            names.push(
+                unsafe { CStr::from_ptr(name) }
+                    .to_string_lossy()
+                    .into_owned(),
+            );
+            true
         }
-    };
+        let tables_loaded = |archive: HANDLE| {
+            let archive_lock = ARCHIVES.get(handle_to_id(archive).unwrap()).unwrap();
+            let loaded = archive_lock.read().unwrap().archive().tables_loaded();
+            loaded
+        };
 
-    // Calculate hash table size from max file count
-    let _hash_table_size = if info.max_file_count > 0 {
-        // Round up to next power of 2, minimum 4
-        info.max_file_count.max(4).next_power_of_two()
-    } else {
-        // Default size
-        16
-    };
+        let path_c = CString::new(path.to_str().unwrap()).unwrap();
+        unsafe {
+            let mut archive = ptr::null_mut();
+            let flags = MPQ_OPEN_LAZY_TABLES | MPQ_OPEN_NO_LISTFILE | MPQ_OPEN_NO_ATTRIBUTES;
+            assert!(SFileOpenArchive(path_c.as_ptr(), 0, flags, &mut archive));
+            assert!(!tables_loaded(archive));
+
+            // Header fields do not need the tables
+            let mut hash_table_size = 0u32;
+            assert!(SFileGetFileInfo(
+                archive,
+                SFILE_INFO_HASH_TABLE_SIZE,
+                &mut hash_table_size as *mut u32 as *mut c_void,
+                4,
+                ptr::null_mut()
+            ));
+            assert!(hash_table_size > 0);
+            assert!(!tables_loaded(archive));
 
-    // Calculate sector size
-    let sector_size = if info.sector_size > 0 && info.sector_size <= 23 {
-        info.sector_size as u16
-    } else {
-        3 // Default to 4KB sectors (512 << 3)
-    };
+            // The first lookup loads them
+            assert!(SFileHasFile(archive, c"version.txt".as_ptr()));
+            assert!(tables_loaded(archive));
 
-    // Create the archive using ArchiveBuilder
-    let mut builder = ArchiveBuilder::new()
-        .version(version)
-        .block_size(sector_size);
+            // (listfile) is ignored, so names come from the tables only
+            let mut names: Vec<String> = Vec::new();
+            assert!(SFileEnumFiles(
+                archive,
+                c"*".as_ptr(),
+                ptr::null(),
+                Some(collect),
+                &mut names as *mut Vec<String> as *mut c_void
+            ));
+            assert!(!names.is_empty());
+            assert!(!names.iter().any(|name| name == "version.txt"));
 
-    // Configure listfile based on file_flags_1
-    if info.file_flags_1 != 0 {
-        builder = builder.listfile_option(ListfileOption::Generate);
-    } else {
-        builder = builder.listfile_option(ListfileOption::None);
-    }
+            // (attributes) is never parsed
+            let mut entries = [SFILE_METADATA::default(); 8];
+            let mut count = 0u32;
+            assert!(SFileGetFileMetadata(
+                archive,
+                entries.as_mut_ptr(),
+                8,
+                &mut count
+            ));
+            assert!(entries[..count as usize]
+                .iter()
+                .all(|entry| entry.attribute_flags == 0));
 
-    // Configure attributes based on attr_flags
-    if info.attr_flags != 0 {
-        if (info.attr_flags & MPQ_ATTRIBUTE_MD5) != 0 {
-            builder = builder.attributes_option(AttributesOption::GenerateFull);
-        } else if (info.attr_flags & MPQ_ATTRIBUTE_CRC32) != 0 {
-            builder = builder.attributes_option(AttributesOption::GenerateCrc32);
+            assert!(SFileCloseArchive(archive));
         }
     }
 
-    // Build the archive
-    match builder.build(filename_str) {
-        Ok(_) => {
-            // Open the created archive for use
-            // Try as mutable first
-            match MutableArchive::open(filename_str) {
-                Ok(mut_archive) => {
-                    // Generate new handle ID
-                    let mut next_id = NEXT_HANDLE.lock().unwrap();
-                    let handle_id = *next_id;
-                    *next_id += 1;
-                    drop(next_id);
-
-                    // Store archive as mutable
-                    let archive_handle = ArchiveHandle::Mutable {
-                        archive: mut_archive,
-                        path: filename_str.to_string(),
-                    };
-                    ARCHIVES.lock().unwrap().insert(handle_id, archive_handle);
-
-                    // Return handle
-                    *handle = id_to_handle(handle_id);
-                    set_last_error(ERROR_SUCCESS);
-                    true
-                }
-                Err(_) => {
-                    // Fall back to read-only open
-                    SFileOpenArchive(filename, 0, 0, handle)
-                }
+    #[test]
+    fn test_index_cache_directory() {
+        let temp_dir = tempfile::TempDir::new().unwrap();
+        let path = temp_dir.path().join("indexed.mpq");
+        let cache_dir = temp_dir.path().join("index");
+        ArchiveBuilder::new()
+            .add_file_data(b"cached".to_vec(), "Interface\\cached.txt")
+            .build(&path)
+            .unwrap();
+
+        let path_c = CString::new(path.to_str().unwrap()).unwrap();
+        let cache_dir_c = CString::new(cache_dir.to_str().unwrap()).unwrap();
+        unsafe {
+            assert!(!SFileSetIndexCacheDirectory(c"".as_ptr()));
+            assert_eq!(SFileGetLastError(), ERROR_INVALID_PARAMETER);
+            assert!(SFileSetIndexCacheDirectory(cache_dir_c.as_ptr()));
+
+            // The first open writes the entry, the second one reads it
+            for _ in 0..2 {
+                let mut archive = ptr::null_mut();
+                assert!(SFileOpenArchive(path_c.as_ptr(), 0, 0, &mut archive));
+                assert!(IndexCache::new(&cache_dir).entry_path(&path).exists());
+                assert!(SFileHasFile(archive, c"interface\\CACHED.txt".as_ptr()));
+
+                let mut file = ptr::null_mut();
+                assert!(SFileOpenFileEx(
+                    archive,
+                    c"Interface\\cached.txt".as_ptr(),
+                    0,
+                    &mut file
+                ));
+                let mut buffer = [0u8; 16];
+                let mut read = 0u32;
+                assert!(SFileReadFile(
+                    file,
+                    buffer.as_mut_ptr() as *mut c_void,
+                    buffer.len() as u32,
+                    &mut read,
+                    ptr::null_mut()
+                ));
+                assert_eq!(&buffer[..read as usize], b"cached");
+                assert!(SFileCloseFile(file));
+                assert!(SFileCloseArchive(archive));
             }
-        }
-        Err(e) => {
-            // Map creation errors to Windows error codes
-            let error_code = match e {
-                wow_mpq::Error::FileNotFound(_) => ERROR_FILE_NOT_FOUND,
-                wow_mpq::Error::InvalidFormat(_) => ERROR_INVALID_PARAMETER,
-                wow_mpq::Error::Io(_) => ERROR_ACCESS_DENIED,
-                _ => ERROR_ACCESS_DENIED,
-            };
-            set_last_error(error_code);
-            false
+
+            assert!(SFileSetIndexCacheDirectory(ptr::null()));
         }
     }
-}
-
-#[cfg(test)]
-mod tests {
-    use super::*;
 
+    #[cfg(feature = "mmap")]
     #[test]
-    fn test_handle_conversion() {
-        let id = 42usize;
-        let handle = id_to_handle(id);
-        assert_eq!(handle_to_id(handle), Some(id));
-        assert_eq!(handle_to_id(ptr::null_mut()), None);
+    fn test_shared_index_directory() {
+        // Only the setting itself: enabling it would change how archives
+        // opened by concurrent tests are loaded
+        unsafe {
+            assert!(!SFileSetSharedIndexDirectory(c"".as_ptr()));
+            assert_eq!(SFileGetLastError(), ERROR_INVALID_PARAMETER);
+            assert!(SFileSetSharedIndexDirectory(ptr::null()));
+            assert_eq!(SFileGetLastError(), ERROR_SUCCESS);
+        }
     }
 
     #[test]
-    fn test_error_handling() {
-        set_last_error(ERROR_FILE_NOT_FOUND);
-        assert_eq!(SFileGetLastError(), ERROR_FILE_NOT_FOUND);
+    fn test_add_files_batch() {
+        let temp_dir = tempfile::TempDir::new().unwrap();
+        let path = temp_dir.path().join("bulk.mpq");
+        let sources: Vec<CString> = (0..40)
+            .map(|i| {
+                let source = temp_dir.path().join(format!("src{i}.txt"));
+                fs::write(&source, format!("bulk file {i}\n").repeat(200)).unwrap();
+                CString::new(source.to_str().unwrap()).unwrap()
+            })
+            .collect();
+        let names: Vec<CString> = (0..40)
+            .map(|i| CString::new(format!("bulk\\file_{i}.txt")).unwrap())
+            .collect();
+        let source_ptrs: Vec<*const c_char> = sources.iter().map(|s| s.as_ptr()).collect();
+        let name_ptrs: Vec<*const c_char> = names.iter().map(|s| s.as_ptr()).collect();
+
+        let create_info = SFILE_CREATE_MPQ {
+            cb_size: std::mem::size_of::<SFILE_CREATE_MPQ>() as u32,
+            mpq_version: 2,
+            user_data: ptr::null_mut(),
+            cb_user_data: 0,
+            stream_flags: 0,
+            file_flags_1: 1,
+            file_flags_2: 0,
+            file_flags_3: 0,
+            attr_flags: 0,
+            sector_size: 0,
+            raw_chunk_size: 0,
+            max_file_count: 64,
+        };
+        let path_c = CString::new(path.to_str().unwrap()).unwrap();
+        unsafe {
+            let mut archive = ptr::null_mut();
+            assert!(SFileCreateArchive2(
+                path_c.as_ptr(),
+                &create_info,
+                &mut archive
+            ));
+            assert!(SFileAddFiles(
+                archive,
+                source_ptrs.as_ptr(),
+                name_ptrs.as_ptr(),
+                40,
+                0,
+                0x02,
+                4
+            ));
 
-        SFileSetLastError(ERROR_SUCCESS);
-        assert_eq!(SFileGetLastError(), ERROR_SUCCESS);
+            // A second batch would overflow the 64-entry hash table
+            assert!(!SFileAddFiles(
+                archive,
+                source_ptrs.as_ptr(),
+                source_ptrs.as_ptr(),
+                40,
+                0,
+                0x02,
+                4
+            ));
+            assert_eq!(SFileGetLastError(), ERROR_DISK_FULL);
+            assert!(SFileCloseArchive(archive));
+
+            let mut archive = ptr::null_mut();
+            assert!(SFileOpenArchive(path_c.as_ptr(), 0, 0, &mut archive));
+            let archive_lock = ARCHIVES.get(handle_to_id(archive).unwrap()).unwrap();
+            {
+                let mut guard = archive_lock.write().unwrap();
+                for i in [0, 17, 39] {
+                    let data = guard
+                        .read_file_exclusive(&format!("bulk\\file_{i}.txt"))
+                        .unwrap();
+                    assert_eq!(data, format!("bulk file {i}\n").repeat(200).into_bytes());
+                }
+            }
+            assert!(SFileHasFile(archive, c"BULK\\FILE_39.TXT".as_ptr()));
+            assert!(SFileCloseArchive(archive));
+        }
     }
 
-    #[test]
-    fn test_locale() {
-        let old = SFileSetLocale(0x409); // US English
-        assert_eq!(old, LOCALE_NEUTRAL);
-        assert_eq!(SFileGetLocale(), 0x409);
-
-        SFileSetLocale(old); // Restore
+    extern "C" fn count_compact_progress(
+        user_data: *mut c_void,
+        work_type: u32,
+        done: u64,
+        total: u64,
+    ) {
+        assert!((CCB_CHECKING_FILES..=CCB_CLOSING_ARCHIVE).contains(&work_type));
+        assert!(done <= total);
+        let calls = unsafe { &*(user_data as *const std::sync::atomic::AtomicU32) };
+        calls.fetch_add(1, Ordering::Relaxed);
     }
 
     #[test]
-    fn test_extract_file_invalid_params() {
-        // Test SFileExtractFile with invalid parameters
+    fn test_compact_archive_async() {
+        let temp_dir = tempfile::TempDir::new().unwrap();
+        let path = temp_dir.path().join("compact.mpq");
+        let sources: Vec<CString> = (0..8)
+            .map(|i| {
+                let source = temp_dir.path().join(format!("src{i}.txt"));
+                fs::write(&source, format!("compact file {i}\n").repeat(500)).unwrap();
+                CString::new(source.to_str().unwrap()).unwrap()
+            })
+            .collect();
+        let names: Vec<CString> = (0..8)
+            .map(|i| CString::new(format!("file_{i}.txt")).unwrap())
+            .collect();
+        let source_ptrs: Vec<*const c_char> = sources.iter().map(|s| s.as_ptr()).collect();
+        let name_ptrs: Vec<*const c_char> = names.iter().map(|s| s.as_ptr()).collect();
+
+        let create_info = SFILE_CREATE_MPQ {
+            cb_size: std::mem::size_of::<SFILE_CREATE_MPQ>() as u32,
+            mpq_version: 2,
+            user_data: ptr::null_mut(),
+            cb_user_data: 0,
+            stream_flags: 0,
+            file_flags_1: 1,
+            file_flags_2: 0,
+            file_flags_3: 0,
+            attr_flags: 0,
+            sector_size: 0,
+            raw_chunk_size: 0,
+            max_file_count: 32,
+        };
+        let path_c = CString::new(path.to_str().unwrap()).unwrap();
+        let calls = std::sync::atomic::AtomicU32::new(0);
         unsafe {
-            // Null filename should fail
-            assert!(!SFileExtractFile(
-                ptr::null_mut(),
-                ptr::null(),
-                c"output.txt".as_ptr(),
-                0
+            let mut archive = ptr::null_mut();
+            assert!(SFileCreateArchive2(
+                path_c.as_ptr(),
+                &create_info,
+                &mut archive
+            ));
+            assert!(SFileAddFiles(
+                archive,
+                source_ptrs.as_ptr(),
+                name_ptrs.as_ptr(),
+                8,
+                0,
+                0,
+                2
             ));
+            for i in 0..4 {
+                assert!(SFileRemoveFile(archive, name_ptrs[i], 0));
+            }
+            assert!(SFileFlushArchive(archive));
+            let size_before = fs::metadata(&path).unwrap().len();
+
+            // Nothing to wait for before a compaction is started
+            assert!(!SFileWaitForCompact(archive, 0));
             assert_eq!(SFileGetLastError(), ERROR_INVALID_PARAMETER);
 
-            // Null local filename should fail
-            assert!(!SFileExtractFile(
-                ptr::null_mut(),
-                c"test.txt".as_ptr(),
-                ptr::null(),
-                0
+            assert!(SFileSetCompactCallback(
+                archive,
+                Some(count_compact_progress),
+                &calls as *const _ as *mut c_void
             ));
+            assert!(SFileCompactArchiveAsync(archive));
+            assert!(SFileWaitForCompact(archive, u32::MAX));
+            assert!(calls.load(Ordering::Relaxed) > 0);
+
+            // The result is returned once
+            assert!(!SFileWaitForCompact(archive, 0));
             assert_eq!(SFileGetLastError(), ERROR_INVALID_PARAMETER);
+            assert!(SFileCloseArchive(archive));
+            assert!(fs::metadata(&path).unwrap().len() < size_before);
+
+            let mut archive = ptr::null_mut();
+            assert!(SFileOpenArchive(path_c.as_ptr(), 0, 0, &mut archive));
+            assert!(!SFileHasFile(archive, name_ptrs[0]));
+            let archive_lock = ARCHIVES.get(handle_to_id(archive).unwrap()).unwrap();
+            {
+                let mut guard = archive_lock.write().unwrap();
+                for i in 4..8 {
+                    let data = guard.read_file_exclusive(&format!("file_{i}.txt")).unwrap();
+                    assert_eq!(data, format!("compact file {i}\n").repeat(500).into_bytes());
+                }
+            }
 
-            // Invalid handle should fail
-            assert!(!SFileExtractFile(
-                ptr::null_mut(),
-                c"test.txt".as_ptr(),
-                c"output.txt".as_ptr(),
-                0
-            ));
-            assert_eq!(SFileGetLastError(), ERROR_INVALID_HANDLE);
+            // Read-only handles cannot be compacted
+            assert!(!SFileCompactArchive(archive, ptr::null(), false));
+            assert_eq!(SFileGetLastError(), ERROR_ACCESS_DENIED);
+            assert!(SFileCloseArchive(archive));
         }
     }
 
     #[test]
-    fn test_verify_file_invalid_params() {
-        // Test SFileVerifyFile with invalid parameters
+    fn test_statistics_and_per_file_counters() {
+        let temp_dir = tempfile::TempDir::new().unwrap();
+        let path = temp_dir.path().join("stats.mpq");
+        let data: Vec<u8> = (0..50_000u32).map(|i| (i % 251) as u8).collect();
+        ArchiveBuilder::new()
+            .add_file_data(data.clone(), "stats.bin")
+            .build(&path)
+            .unwrap();
+
+        let path_c = CString::new(path.to_str().unwrap()).unwrap();
         unsafe {
-            // Null filename should fail
-            assert!(!SFileVerifyFile(
-                ptr::null_mut(),
-                ptr::null(),
-                SFILE_VERIFY_ALL
+            let mut before = std::mem::MaybeUninit::<SFILE_STATISTICS>::uninit();
+            assert!(SFileGetStatistics(before.as_mut_ptr()));
+            let before = before.assume_init();
+
+            let mut archive = ptr::null_mut();
+            assert!(SFileOpenArchive(path_c.as_ptr(), 0, 0, &mut archive));
+            let mut file = ptr::null_mut();
+            assert!(SFileOpenFileEx(
+                archive,
+                c"stats.bin".as_ptr(),
+                0,
+                &mut file
             ));
+
+            let mut buffer = vec![0u8; data.len()];
+            let mut read = 0u32;
+            for chunk in buffer.chunks_mut(10_000) {
+                assert!(SFileReadFile(
+                    file,
+                    chunk.as_mut_ptr() as *mut c_void,
+                    chunk.len() as u32,
+                    &mut read,
+                    ptr::null_mut()
+                ));
+            }
+            assert_eq!(buffer, data);
+
+            let file_counter = |info_class: u32| -> u64 {
+                let mut value = 0u64;
+                assert!(SFileGetFileInfo(
+                    file,
+                    info_class,
+                    &mut value as *mut u64 as *mut c_void,
+                    8,
+                    ptr::null_mut()
+                ));
+                value
+            };
+            assert_eq!(file_counter(SFILE_INFO_READ_COUNT), 5);
+            assert_eq!(file_counter(SFILE_INFO_BYTES_DELIVERED), data.len() as u64);
+
+            // Other tests read concurrently, so only check for growth
+            let mut after = std::mem::MaybeUninit::<SFILE_STATISTICS>::uninit();
+            assert!(SFileGetStatistics(after.as_mut_ptr()));
+            let after = after.assume_init();
+            assert!(after.open_count > before.open_count);
+            assert!(after.read_count >= before.read_count + 5);
+            assert!(after.bytes_delivered >= before.bytes_delivered + data.len() as u64);
+            assert!(after.disk_bytes_read > before.disk_bytes_read);
+            let decompressed =
+                |stats: &SFILE_STATISTICS| stats.decompress_calls.iter().sum::<u64>();
+            assert!(decompressed(&after) > decompressed(&before));
+
+            assert!(!SFileGetStatistics(ptr::null_mut()));
             assert_eq!(SFileGetLastError(), ERROR_INVALID_PARAMETER);
 
-            // Invalid handle should fail
-            assert!(!SFileVerifyFile(
-                ptr::null_mut(),
-                c"test.txt".as_ptr(),
-                SFILE_VERIFY_ALL
-            ));
-            assert_eq!(SFileGetLastError(), ERROR_INVALID_HANDLE);
+            assert!(SFileCloseFile(file));
+            assert!(SFileCloseArchive(archive));
         }
     }
 
     #[test]
-    fn test_verify_archive_invalid_params() {
-        // Test SFileVerifyArchive with invalid parameters
-        // Invalid handle should fail
+    fn test_positioned_and_64_bit_reads() {
+        let temp_dir = tempfile::TempDir::new().unwrap();
+        let path = temp_dir.path().join("pread.mpq");
+        let content: Vec<u8> = (0..200_000u32).map(|i| (i % 249) as u8).collect();
+        ArchiveBuilder::new()
+            .add_file_data(content.clone(), "large.bin")
+            .build(&path)
+            .unwrap();
+
+        let path_c = CString::new(path.to_str().unwrap()).unwrap();
         unsafe {
-            assert!(!SFileVerifyArchive(ptr::null_mut(), SFILE_VERIFY_SIGNATURE));
+            let mut archive = ptr::null_mut();
+            assert!(SFileOpenArchive(path_c.as_ptr(), 0, 0, &mut archive));
+            let mut file = ptr::null_mut();
+            assert!(SFileOpenFileEx(
+                archive,
+                c"large.bin".as_ptr(),
+                0,
+                &mut file
+            ));
+
+            let mut size = 0u64;
+            assert!(SFileGetFileSize64(file, &mut size));
+            assert_eq!(size, content.len() as u64);
+
+            // Positioned reads from several threads leave the cursor alone
+            let handle = file as usize;
+            std::thread::scope(|scope| {
+                for chunk in 0..4u64 {
+                    let content = &content;
+                    scope.spawn(move || {
+                        let offset = chunk * 50_000;
+                        let mut buffer = vec![0u8; 50_000];
+                        let mut read = 0u64;
+                        assert!(SFileReadFileAt(
+                            handle as HANDLE,
+                            offset,
+                            buffer.as_mut_ptr() as *mut c_void,
+                            buffer.len() as u64,
+                            &mut read
+                        ));
+                        assert_eq!(read, 50_000);
+                        assert_eq!(&buffer[..], &content[offset as usize..][..50_000]);
+                    });
+                }
+            });
+            assert_eq!(SFileGetFilePointer(file, ptr::null_mut()), 0);
+
+            let mut buffer = vec![0u8; 64];
+            let mut read = 1u64;
+            assert!(SFileReadFileAt(
+                file,
+                size + 100,
+                buffer.as_mut_ptr() as *mut c_void,
+                buffer.len() as u64,
+                &mut read
+            ));
+            assert_eq!(read, 0);
+
+            // 64-bit seeks clamp to the file and drive SFileReadFileEx64
+            let mut pos = 0u64;
+            assert!(SFileSeek64(file, -1, 0, &mut pos));
+            assert_eq!(pos, 0);
+            assert!(SFileSeek64(file, i64::MAX, 1, &mut pos));
+            assert_eq!(pos, size);
+            assert!(SFileSeek64(file, -16, 2, &mut pos));
+            assert!(SFileReadFileEx64(
+                file,
+                buffer.as_mut_ptr() as *mut c_void,
+                buffer.len() as u64,
+                &mut read
+            ));
+            assert_eq!(read, 16);
+            assert_eq!(&buffer[..16], &content[content.len() - 16..]);
+            let mut high = -1i32;
+            assert_eq!(SFileGetFilePointer(file, &mut high), size as u32);
+            assert_eq!(high, 0);
+            assert!(!SFileSeek64(file, 0, 3, ptr::null_mut()));
+
+            // A low part with the top bit set is not sign-extended
+            let mut high = 0i32;
+            assert_eq!(
+                SFileSetFilePointer(file, i32::MIN, &mut high, 0),
+                size as u32
+            );
+            assert_eq!(high, 0);
+
+            assert!(SFileCloseFile(file));
+            assert!(SFileCloseArchive(archive));
         }
-        assert_eq!(SFileGetLastError(), ERROR_INVALID_HANDLE);
     }
 
     #[test]
-    fn test_create_archive_invalid_params() {
-        // Test SFileCreateArchive with invalid parameters
+    fn test_open_data_folder() {
+        let temp_dir = tempfile::TempDir::new().unwrap();
+        let data = temp_dir.path();
+        std::fs::create_dir(data.join("enUS")).unwrap();
+        ArchiveBuilder::new()
+            .add_file_data(b"common".to_vec(), "shared.txt")
+            .add_file_data(b"common".to_vec(), "common.txt")
+            .build(data.join("common.MPQ"))
+            .unwrap();
+        ArchiveBuilder::new()
+            .add_file_data(b"patch".to_vec(), "shared.txt")
+            .build(data.join("patch.MPQ"))
+            .unwrap();
+        ArchiveBuilder::new()
+            .add_file_data(b"patch-enUS".to_vec(), "shared.txt")
+            .build(data.join("enUS").join("patch-enUS.MPQ"))
+            .unwrap();
+
+        let data_c = CString::new(data.to_str().unwrap()).unwrap();
         unsafe {
-            let mut handle = ptr::null_mut();
-
-            // Null filename should fail
-            assert!(!SFileCreateArchive(
-                ptr::null(),
-                CREATE_ALWAYS,
-                16,
-                &mut handle
+            let mut folder = ptr::null_mut();
+            assert!(SFileOpenDataFolder(
+                data_c.as_ptr(),
+                c"enUS".as_ptr(),
+                0,
+                &mut folder
             ));
-            assert_eq!(SFileGetLastError(), ERROR_INVALID_PARAMETER);
-
-            // Null handle should fail
-            assert!(!SFileCreateArchive(
-                c"test.mpq".as_ptr(),
-                CREATE_ALWAYS,
-                16,
+            assert!(SFileHasFile(folder, c"common.txt".as_ptr()));
+            assert!(!SFileHasFile(folder, c"missing.txt".as_ptr()));
+
+            let mut file = ptr::null_mut();
+            assert!(SFileOpenFileEx(
+                folder,
+                c"shared.txt".as_ptr(),
+                0,
+                &mut file
+            ));
+            let mut buffer = [0u8; 16];
+            let mut read = 0u32;
+            assert!(SFileReadFile(
+                file,
+                buffer.as_mut_ptr() as *mut c_void,
+                buffer.len() as u32,
+                &mut read,
                 ptr::null_mut()
             ));
-            assert_eq!(SFileGetLastError(), ERROR_INVALID_PARAMETER);
-
-            // Invalid hash table size (not power of 2) should fail
-            assert!(!SFileCreateArchive(
-                c"test.mpq".as_ptr(),
-                CREATE_ALWAYS,
-                15, // Not a power of 2
-                &mut handle
+            assert_eq!(&buffer[..read as usize], b"patch-enUS");
+            assert!(SFileCloseFile(file));
+
+            assert!(!SFileOpenFileEx(
+                folder,
+                c"missing.txt".as_ptr(),
+                0,
+                &mut file
             ));
-            assert_eq!(SFileGetLastError(), ERROR_INVALID_PARAMETER);
+            assert_eq!(SFileGetLastError(), ERROR_FILE_NOT_FOUND);
 
-            // Hash table size too small should fail
-            assert!(!SFileCreateArchive(
-                c"test.mpq".as_ptr(),
-                CREATE_ALWAYS,
-                2, // Less than minimum of 4
-                &mut handle
+            assert!(SFileCloseArchive(folder));
+            assert!(!SFileHasFile(folder, c"common.txt".as_ptr()));
+
+            let mut missing = ptr::null_mut();
+            assert!(!SFileOpenDataFolder(
+                c"/does/not/exist".as_ptr(),
+                ptr::null(),
+                0,
+                &mut missing
             ));
-            assert_eq!(SFileGetLastError(), ERROR_INVALID_PARAMETER);
+            assert_eq!(SFileGetLastError(), ERROR_FILE_NOT_FOUND);
         }
     }
 }
@@ -0,0 +1,146 @@
+//! Performance counters for the C API
+//!
+//! `wow_mpq::stats` already counts disk reads, sector cache lookups and
+//! decompression work for the whole process. This module adds what only the
+//! FFI layer sees: bytes handed back to callers, how long opens and reads
+//! take, and how long calls wait for a handle table shard or a handle's lock.
+//! Locks are first tried without blocking, so an uncontended acquisition costs
+//! no clock reads.
+//!
+//! Latencies go into log2 histograms: bucket 0 holds calls under 1 µs,
+//! bucket `i` calls of `2^(i-1)` to `2^i` µs, and the last bucket everything
+//! slower.
+
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{
+    LockResult, Mutex, MutexGuard, RwLock, RwLockReadGuard, RwLockWriteGuard, TryLockResult,
+};
+use std::time::{Duration, Instant};
+
+/// Number of buckets in a latency histogram
+pub(crate) const LATENCY_BUCKETS: usize = 32;
+
+/// Call count, total time and log2 latency buckets
+pub(crate) struct Histogram {
+    count: AtomicU64,
+    total_nanos: AtomicU64,
+    buckets: [AtomicU64; LATENCY_BUCKETS],
+}
+
+/// Snapshot of a [`Histogram`]
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub(crate) struct HistogramStats {
+    pub(crate) count: u64,
+    pub(crate) total_nanos: u64,
+    pub(crate) buckets: [u64; LATENCY_BUCKETS],
+}
+
+impl Histogram {
+    const fn new() -> Self {
+        Self {
+            count: AtomicU64::new(0),
+            total_nanos: AtomicU64::new(0),
+            buckets: [const { AtomicU64::new(0) }; LATENCY_BUCKETS],
+        }
+    }
+
+    /// Record one call that took `elapsed`
+    pub(crate) fn record(&self, elapsed: Duration) {
+        let micros = elapsed.as_micros().min(u128::from(u64::MAX)) as u64;
+        let bucket = ((u64::BITS - micros.leading_zeros()) as usize).min(LATENCY_BUCKETS - 1);
+        self.count.fetch_add(1, Ordering::Relaxed);
+        self.total_nanos
+            .fetch_add(elapsed.as_nanos() as u64, Ordering::Relaxed);
+        self.buckets[bucket].fetch_add(1, Ordering::Relaxed);
+    }
+
+    pub(crate) fn snapshot(&self) -> HistogramStats {
+        HistogramStats {
+            count: self.count.load(Ordering::Relaxed),
+            total_nanos: self.total_nanos.load(Ordering::Relaxed),
+            buckets: std::array::from_fn(|i| self.buckets[i].load(Ordering::Relaxed)),
+        }
+    }
+
+    fn reset(&self) {
+        self.count.store(0, Ordering::Relaxed);
+        self.total_nanos.store(0, Ordering::Relaxed);
+        for bucket in &self.buckets {
+            bucket.store(0, Ordering::Relaxed);
+        }
+    }
+}
+
+/// Latency of `SFileOpenFileEx`
+pub(crate) static OPEN_LATENCY: Histogram = Histogram::new();
+/// Latency of synchronous and positioned reads and of reads run for
+/// `SFileReadFileAsync`
+pub(crate) static READ_LATENCY: Histogram = Histogram::new();
+/// Bytes copied into caller buffers by file reads
+pub(crate) static BYTES_DELIVERED: AtomicU64 = AtomicU64::new(0);
+/// Lock acquisitions that had to wait
+pub(crate) static LOCK_WAITS: AtomicU64 = AtomicU64::new(0);
+/// Total time spent waiting for those locks
+pub(crate) static LOCK_WAIT_NANOS: AtomicU64 = AtomicU64::new(0);
+
+/// Set the FFI counters back to zero
+pub(crate) fn reset() {
+    OPEN_LATENCY.reset();
+    READ_LATENCY.reset();
+    BYTES_DELIVERED.store(0, Ordering::Relaxed);
+    LOCK_WAITS.store(0, Ordering::Relaxed);
+    LOCK_WAIT_NANOS.store(0, Ordering::Relaxed);
+}
+
+/// Take a lock, timing the acquisition only if it would block
+///
+/// A poisoned lock panics, like the `lock().unwrap()` calls this replaces.
+fn acquire<G>(
+    try_lock: impl FnOnce() -> TryLockResult<G>,
+    lock: impl FnOnce() -> LockResult<G>,
+) -> G {
+    if let Ok(guard) = try_lock() {
+        return guard;
+    }
+    let start = Instant::now();
+    let guard = lock().unwrap();
+    LOCK_WAITS.fetch_add(1, Ordering::Relaxed);
+    LOCK_WAIT_NANOS.fetch_add(start.elapsed().as_nanos() as u64, Ordering::Relaxed);
+    guard
+}
+
+/// Take a shared lock on `lock`
+pub(crate) fn read<T>(lock: &RwLock<T>) -> RwLockReadGuard<'_, T> {
+    acquire(|| lock.try_read(), || lock.read())
+}
+
+/// Take an exclusive lock on `lock`
+pub(crate) fn write<T>(lock: &RwLock<T>) -> RwLockWriteGuard<'_, T> {
+    acquire(|| lock.try_write(), || lock.write())
+}
+
+/// Lock `mutex`
+pub(crate) fn lock<T>(mutex: &Mutex<T>) -> MutexGuard<'_, T> {
+    acquire(|| mutex.try_lock(), || mutex.lock())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_histogram_buckets() {
+        let histogram = Histogram::new();
+        histogram.record(Duration::from_nanos(500));
+        histogram.record(Duration::from_micros(1));
+        histogram.record(Duration::from_micros(3));
+        histogram.record(Duration::from_secs(1 << 40));
+
+        let stats = histogram.snapshot();
+        assert_eq!(stats.count, 4);
+        assert_eq!(stats.buckets[0], 1);
+        assert_eq!(stats.buckets[1], 1);
+        assert_eq!(stats.buckets[2], 1);
+        assert_eq!(stats.buckets[LATENCY_BUCKETS - 1], 1);
+    }
+}
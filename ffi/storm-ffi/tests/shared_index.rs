@@ -0,0 +1,138 @@
+//! End-to-end tests of archives opened through `SFileOpenArchive` with a
+//! shared index directory set
+//!
+//! The directory is process-wide, so these tests live in their own binary
+//! where setting it cannot change how the library's unit tests open archives.
+
+#![cfg(feature = "mmap")]
+
+use std::ffi::{c_char, c_void, CStr, CString};
+use std::ptr;
+
+use storm::{
+    SFileCloseArchive, SFileCloseFile, SFileEnumFiles, SFileGetFileMetadata, SFileHasFile,
+    SFileOpenArchive, SFileOpenFileEx, SFileReadFile, SFileSetSharedIndexDirectory, HANDLE,
+    SFILE_METADATA,
+};
+use wow_mpq::{ArchiveBuilder, FormatVersion, SharedIndex};
+
+const MPQ_OPEN_NO_LISTFILE: u32 = 0x00010000;
+
+extern "C" fn collect(name: *const c_char, user_data: *mut c_void) -> bool {
+    let names = unsafe { &mut *(user_data as *mut Vec<String>) };
+    names.push(
+        unsafe { CStr::from_ptr(name) }
+            .to_string_lossy()
+            .into_owned(),
+    );
+    true
+}
+
+/// Everything the tests compare between an attached and a plain open
+#[derive(Debug, PartialEq)]
+struct Snapshot {
+    names: Vec<String>,
+    table_names: Vec<String>,
+    metadata: Vec<SFILE_METADATA>,
+    content: Vec<u8>,
+}
+
+unsafe fn open(path: &CStr, flags: u32) -> HANDLE {
+    let mut archive = ptr::null_mut();
+    assert!(SFileOpenArchive(path.as_ptr(), 0, flags, &mut archive));
+    archive
+}
+
+unsafe fn enumerate(archive: HANDLE) -> Vec<String> {
+    let mut names: Vec<String> = Vec::new();
+    assert!(SFileEnumFiles(
+        archive,
+        c"*".as_ptr(),
+        ptr::null(),
+        Some(collect),
+        &mut names as *mut Vec<String> as *mut c_void
+    ));
+    names.sort();
+    names
+}
+
+unsafe fn snapshot(path: &CStr) -> Snapshot {
+    let archive = open(path, 0);
+    let names = enumerate(archive);
+    assert!(SFileHasFile(archive, c"data\\A.TXT".as_ptr()));
+
+    let mut file = ptr::null_mut();
+    assert!(SFileOpenFileEx(
+        archive,
+        c"Data\\a.txt".as_ptr(),
+        0,
+        &mut file
+    ));
+    let mut buffer = [0u8; 64];
+    let mut read = 0u32;
+    assert!(SFileReadFile(
+        file,
+        buffer.as_mut_ptr() as *mut c_void,
+        buffer.len() as u32,
+        &mut read,
+        ptr::null_mut()
+    ));
+    assert!(SFileCloseFile(file));
+
+    let mut entries = [SFILE_METADATA::default(); 16];
+    let mut count = 0u32;
+    assert!(SFileGetFileMetadata(
+        archive,
+        entries.as_mut_ptr(),
+        entries.len() as u32,
+        &mut count
+    ));
+    assert!(SFileCloseArchive(archive));
+
+    // Without the listfile names come from the tables only
+    let archive = open(path, MPQ_OPEN_NO_LISTFILE);
+    let table_names = enumerate(archive);
+    assert!(SFileCloseArchive(archive));
+
+    Snapshot {
+        names,
+        table_names,
+        metadata: entries[..count as usize].to_vec(),
+        content: buffer[..read as usize].to_vec(),
+    }
+}
+
+#[test]
+fn test_open_read_enumerate_with_shared_index() {
+    let temp_dir = tempfile::TempDir::new().unwrap();
+    let shared_dir = temp_dir.path().join("shm");
+    let shared_dir_c = CString::new(shared_dir.to_str().unwrap()).unwrap();
+
+    for version in [FormatVersion::V1, FormatVersion::V3] {
+        let path = temp_dir.path().join(format!("shared_{version:?}.mpq"));
+        ArchiveBuilder::new()
+            .version(version)
+            .add_file_data(b"second file".to_vec(), "Data\\a.txt")
+            .add_file_data(b"first".to_vec(), "Data\\b.txt")
+            .build(&path)
+            .unwrap();
+        let path_c = CString::new(path.to_str().unwrap()).unwrap();
+
+        unsafe {
+            let expected = snapshot(&path_c);
+            assert_eq!(expected.content, b"second file");
+            assert!(expected.names.iter().any(|name| name == "Data\\b.txt"));
+            assert!(!expected.table_names.is_empty());
+            assert!(!expected.metadata.is_empty());
+
+            // The first open writes the entry, later ones attach to it
+            assert!(SFileSetSharedIndexDirectory(shared_dir_c.as_ptr()));
+            let archive = open(&path_c, 0);
+            assert!(SharedIndex::new(&shared_dir).entry_path(&path).exists());
+            assert!(SFileCloseArchive(archive));
+
+            assert_eq!(snapshot(&path_c), expected);
+            assert!(SFileSetSharedIndexDirectory(ptr::null()));
+        }
+    }
+}
@@ -5,7 +5,8 @@
 
 use criterion::{BenchmarkId, Criterion, Throughput, criterion_group, criterion_main};
 use tempfile::TempDir;
-use wow_mpq::{ArchiveBuilder, FormatVersion, compression::flags};
+use wow_mpq::single_archive_parallel::ParallelConfig;
+use wow_mpq::{AddFileOptions, ArchiveBuilder, FormatVersion, MutableArchive, compression::flags};
 
 /// Generate test data with specified characteristics
 fn generate_test_data(size: usize, compressibility: &str) -> Vec<u8> {
@@ -287,6 +288,67 @@ fn bench_block_sizes(c: &mut Criterion) {
     group.finish();
 }
 
+/// Benchmark adding many files to an empty archive, sequentially and in
+/// parallel batches
+fn bench_batched_add(c: &mut Criterion) {
+    let mut group = c.benchmark_group("archive_creation/batched_add");
+    group.sample_size(10);
+
+    let file_count = 2000;
+    let files: Vec<(String, Vec<u8>)> = (0..file_count)
+        .map(|i| {
+            (
+                format!("patch\\file_{i:05}.dat"),
+                generate_test_data(16 * 1024, "medium"),
+            )
+        })
+        .collect();
+    group.throughput(Throughput::Bytes((file_count * 16 * 1024) as u64));
+
+    let temp_dir = TempDir::new().unwrap();
+    let empty_archive = |path: &std::path::Path| {
+        ArchiveBuilder::new()
+            .version(FormatVersion::V2)
+            .hash_table_size(4096)
+            .build(path)
+            .unwrap();
+        MutableArchive::open(path).unwrap()
+    };
+
+    group.bench_function("add_file_data", |b| {
+        b.iter(|| {
+            let mut archive = empty_archive(&temp_dir.path().join("sequential.mpq"));
+            for (name, data) in &files {
+                archive
+                    .add_file_data(data, name, AddFileOptions::new())
+                    .unwrap();
+            }
+            archive.flush().unwrap();
+        });
+    });
+
+    let batch: Vec<(&[u8], &str, AddFileOptions)> = files
+        .iter()
+        .map(|(name, data)| (data.as_slice(), name.as_str(), AddFileOptions::new()))
+        .collect();
+    for threads in [1, 2, 4, 8] {
+        group.bench_with_input(
+            BenchmarkId::new("add_files_data", format!("{threads}_threads")),
+            &threads,
+            |b, &threads| {
+                let config = ParallelConfig::new().threads(threads);
+                b.iter(|| {
+                    let mut archive = empty_archive(&temp_dir.path().join("batched.mpq"));
+                    archive.add_files_data(&batch, &config).unwrap();
+                    archive.flush().unwrap();
+                });
+            },
+        );
+    }
+
+    group.finish();
+}
+
 criterion_group!(
     benches,
     bench_single_file_archive,
@@ -294,6 +356,7 @@ criterion_group!(
     bench_compression_methods,
     bench_archive_versions,
     bench_encrypted_archives,
-    bench_block_sizes
+    bench_block_sizes,
+    bench_batched_add
 );
 criterion_main!(benches);
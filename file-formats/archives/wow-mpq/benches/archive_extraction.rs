@@ -3,10 +3,11 @@
 //! These benchmarks measure the performance of extracting files from MPQ archives
 //! with different configurations to track performance regressions.
 
-use criterion::{BenchmarkId, Criterion, Throughput, criterion_group, criterion_main};
+use criterion::{BatchSize, BenchmarkId, Criterion, Throughput, criterion_group, criterion_main};
 use std::hint::black_box;
-use std::path::Path;
+use std::path::{Path, PathBuf};
 use tempfile::TempDir;
+use wow_mpq::single_archive_parallel::{ParallelConfig, extract_archive_to_disk};
 use wow_mpq::{Archive, ArchiveBuilder, FormatVersion, compression::flags};
 
 /// Generate test data with specified characteristics
@@ -431,6 +432,98 @@ fn bench_metadata_operations(c: &mut Criterion) {
     group.finish();
 }
 
+/// Drop the cached pages of `path`, so the next read goes to storage
+///
+/// Only implemented on Linux; elsewhere the cold-cache cases run warm.
+fn evict_from_page_cache(path: &Path) {
+    #[cfg(target_os = "linux")]
+    if let Ok(file) = std::fs::File::open(path) {
+        use std::os::unix::io::AsRawFd;
+        // Dirty pages are not dropped
+        let _ = file.sync_all();
+        unsafe {
+            libc::posix_fadvise(file.as_raw_fd(), 0, 0, libc::POSIX_FADV_DONTNEED);
+        }
+    }
+    #[cfg(not(target_os = "linux"))]
+    let _ = path;
+}
+
+/// Benchmark extracting many files to disk in listfile order
+///
+/// Compares one read per file in the requested order against reads
+/// coalesced in on-disk order, with the archive in the page cache and
+/// evicted before every iteration. The cold cases are where the ordering
+/// matters; run them on the storage of interest (`TMPDIR` on a spinning
+/// disk or network mount).
+fn bench_sequential_extraction(c: &mut Criterion) {
+    let mut group = c.benchmark_group("archive_extraction/to_disk");
+    group.sample_size(10);
+
+    let temp_dir = TempDir::new().unwrap();
+    let file_count = 512;
+
+    // Mixed sizes from 16 KB to 128 KB, stored in name order
+    let names: Vec<String> = (0..file_count)
+        .map(|i| format!("file_{i:04}.dat"))
+        .collect();
+    let mut total_size = 0;
+    let files: Vec<(&str, Vec<u8>)> = names
+        .iter()
+        .enumerate()
+        .map(|(i, name)| {
+            let size = 16 * 1024 * (1 + i % 8);
+            total_size += size;
+            let compressibility = if i % 2 == 0 { "medium" } else { "low" };
+            (name.as_str(), generate_test_data(size, compressibility))
+        })
+        .collect();
+    let archive_path = create_test_archive(
+        temp_dir.path(),
+        "to_disk",
+        files,
+        flags::ZLIB,
+        FormatVersion::V2,
+    );
+
+    // A listfile order unrelated to the storage order
+    let mut order: Vec<usize> = (0..file_count).collect();
+    let mut seed = 0x9e3779b9u32;
+    for i in (1..order.len()).rev() {
+        seed = seed.wrapping_mul(1664525).wrapping_add(1013904223);
+        order.swap(i, (seed >> 8) as usize % (i + 1));
+    }
+    let out_dir = temp_dir.path().join("out");
+    let dests: Vec<PathBuf> = order.iter().map(|&i| out_dir.join(&names[i])).collect();
+    let jobs: Vec<(&str, &Path)> = order
+        .iter()
+        .zip(&dests)
+        .map(|(&i, dest)| (names[i].as_str(), dest.as_path()))
+        .collect();
+
+    group.throughput(Throughput::Bytes(total_size as u64));
+    let archive = Archive::open(&archive_path).unwrap();
+
+    for sequential in [false, true] {
+        let config = ParallelConfig::new().threads(4).sequential_io(sequential);
+        let name = if sequential { "planned" } else { "per_file" };
+
+        group.bench_function(BenchmarkId::new(name, "warm"), |b| {
+            b.iter(|| black_box(extract_archive_to_disk(&archive, &jobs, &config).unwrap()));
+        });
+
+        group.bench_function(BenchmarkId::new(name, "cold"), |b| {
+            b.iter_batched(
+                || evict_from_page_cache(&archive_path),
+                |()| black_box(extract_archive_to_disk(&archive, &jobs, &config).unwrap()),
+                BatchSize::PerIteration,
+            );
+        });
+    }
+
+    group.finish();
+}
+
 criterion_group!(
     benches,
     bench_single_file_extraction,
@@ -439,6 +532,7 @@ criterion_group!(
     bench_random_access,
     bench_version_extraction,
     bench_parallel_extraction,
-    bench_metadata_operations
+    bench_metadata_operations,
+    bench_sequential_extraction
 );
 criterion_main!(benches);
@@ -1,8 +1,10 @@
 //! ArchiveBuilder benchmarks
 
-use criterion::{BenchmarkId, Criterion, criterion_group, criterion_main};
+use criterion::{BenchmarkId, Criterion, Throughput, criterion_group, criterion_main};
 use std::hint::black_box;
-use wow_mpq::ArchiveBuilder;
+use tempfile::TempDir;
+use wow_mpq::single_archive_parallel::ParallelConfig;
+use wow_mpq::{AddFileOptions, ArchiveBuilder, MutableArchive};
 
 /// Test struct to access the private encrypt_data method
 /// (Alternatively, you could make encrypt_data pub(crate) for testing)
@@ -127,10 +129,66 @@ fn bench_encrypt_data_aligned_vs_unaligned(c: &mut Criterion) {
     group.finish();
 }
 
+/// Compare ArchiveBuilder, which compresses on the calling thread, with
+/// batched adds into an empty archive on a growing number of threads
+fn bench_build_scaling(c: &mut Criterion) {
+    let mut group = c.benchmark_group("build_scaling");
+    group.sample_size(10);
+
+    let files: Vec<(String, Vec<u8>)> = (0..1000)
+        .map(|i| {
+            let data = format!("line {i} of a moderately compressible file\n")
+                .repeat(1000)
+                .into_bytes();
+            (format!("data\\file_{i:04}.txt"), data)
+        })
+        .collect();
+    let total: usize = files.iter().map(|(_, data)| data.len()).sum();
+    group.throughput(Throughput::Bytes(total as u64));
+    let temp_dir = TempDir::new().unwrap();
+
+    group.bench_function("archive_builder", |b| {
+        b.iter(|| {
+            let mut builder = ArchiveBuilder::new();
+            for (name, data) in &files {
+                builder = builder.add_file_data(data.clone(), name);
+            }
+            builder.build(temp_dir.path().join("builder.mpq")).unwrap();
+        });
+    });
+
+    let batch: Vec<(&[u8], &str, AddFileOptions)> = files
+        .iter()
+        .map(|(name, data)| (data.as_slice(), name.as_str(), AddFileOptions::new()))
+        .collect();
+    for threads in [1, 2, 4, 8] {
+        group.bench_with_input(
+            BenchmarkId::new("batched_add", threads),
+            &threads,
+            |b, &threads| {
+                let config = ParallelConfig::new().threads(threads);
+                b.iter(|| {
+                    let path = temp_dir.path().join("batched.mpq");
+                    ArchiveBuilder::new()
+                        .hash_table_size(2048)
+                        .build(&path)
+                        .unwrap();
+                    let mut archive = MutableArchive::open(&path).unwrap();
+                    archive.add_files_data(&batch, &config).unwrap();
+                    archive.flush().unwrap();
+                });
+            },
+        );
+    }
+
+    group.finish();
+}
+
 criterion_group!(
     benches,
     bench_encrypt_data,
     bench_encrypt_data_patterns,
-    bench_encrypt_data_aligned_vs_unaligned
+    bench_encrypt_data_aligned_vs_unaligned,
+    bench_build_scaling
 );
 criterion_main!(benches);
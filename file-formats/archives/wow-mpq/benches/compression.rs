@@ -1,6 +1,6 @@
 //! Compression benchmarks
 
-use criterion::{BenchmarkId, Criterion, criterion_group, criterion_main};
+use criterion::{BenchmarkId, Criterion, Throughput, criterion_group, criterion_main};
 use std::hint::black_box;
 use wow_mpq::compression::{compress, decompress, flags};
 
@@ -154,6 +154,84 @@ fn bench_compression_comparison(c: &mut Criterion) {
     group.finish();
 }
 
+/// 16-bit PCM: a sine wave with some noise on top
+fn create_audio_data(size: usize) -> Vec<u8> {
+    let mut noise = 0x2545_F491u32;
+    (0..size / 2)
+        .flat_map(|i| {
+            noise = noise.wrapping_mul(1_103_515_245).wrapping_add(12_345);
+            let sine = (i as f32 * 0.05).sin() * 12_000.0;
+            (sine as i16)
+                .wrapping_add((noise >> 22) as i16)
+                .to_le_bytes()
+        })
+        .collect()
+}
+
+/// Compress with `method`, without the method byte `compress` prepends
+fn compress_raw(data: &[u8], method: u8) -> Vec<u8> {
+    let compressed = compress(data, method).expect("Compression failed");
+    assert_eq!(compressed[0], method, "data did not compress");
+    compressed[1..].to_vec()
+}
+
+/// A Huffman stream of `compression_type` that decodes to `size` bytes
+///
+/// The crate has no Huffman compressor, so this is pseudo-random bits after
+/// the type byte. Every bit string is a valid code sequence, so decoding it
+/// exercises the same table and tree paths as real data; seeds are tried
+/// until one does not run into the end marker early.
+fn huffman_stream(compression_type: u8, size: usize) -> Vec<u8> {
+    (1..10_000u32)
+        .map(|seed| {
+            let mut state = seed;
+            let mut stream = vec![compression_type];
+            stream.extend((0..size * 2).map(|_| {
+                state = state.wrapping_mul(1_103_515_245).wrapping_add(12_345);
+                (state >> 16) as u8
+            }));
+            stream
+        })
+        .find(|stream| decompress(stream, flags::HUFFMAN, size).is_ok_and(|d| d.len() == size))
+        .expect("No seed decoded to the full size")
+}
+
+/// Decompression throughput per algorithm on 64 KiB of text or audio
+fn bench_decompression_throughput(c: &mut Criterion) {
+    const SIZE: usize = 64 * 1024;
+    const SECTOR_SIZE: usize = 4096;
+    let text = create_test_data(SIZE, "The quick brown fox jumps over the lazy dog. ");
+    let audio = create_audio_data(SIZE);
+
+    let mut group = c.benchmark_group("decompression_throughput");
+    group.throughput(Throughput::Bytes(SIZE as u64));
+
+    let inputs = [
+        ("zlib", flags::ZLIB, &text),
+        ("bzip2", flags::BZIP2, &text),
+        ("pkware", flags::PKWARE, &text),
+        ("adpcm_mono", flags::ADPCM_MONO, &audio),
+        ("adpcm_stereo", flags::ADPCM_STEREO, &audio),
+    ];
+    for (name, method, data) in inputs {
+        let compressed = compress_raw(data, method);
+        group.bench_function(name, |b| {
+            b.iter(|| decompress(black_box(&compressed), method, SIZE));
+        });
+    }
+
+    // Sound files store Huffman per sector; type 0 rebalances after every byte
+    group.throughput(Throughput::Bytes(SECTOR_SIZE as u64));
+    for compression_type in [0u8, 1] {
+        let stream = huffman_stream(compression_type, SECTOR_SIZE);
+        group.bench_function(format!("huffman_type{compression_type}"), |b| {
+            b.iter(|| decompress(black_box(&stream), flags::HUFFMAN, SECTOR_SIZE));
+        });
+    }
+
+    group.finish();
+}
+
 fn bench_round_trip(c: &mut Criterion) {
     let data = create_test_data(4096, "Mixed content with some repetition. ");
 
@@ -172,6 +250,7 @@ criterion_group!(
     bench_bzip2_compression,
     bench_sparse_decompression,
     bench_compression_comparison,
+    bench_decompression_throughput,
     bench_round_trip
 );
 criterion_main!(benches);
@@ -1,9 +1,9 @@
 //! hash benchmarks
 
-use criterion::{Criterion, criterion_group, criterion_main};
+use criterion::{BenchmarkId, Criterion, Throughput, criterion_group, criterion_main};
 use std::hint::black_box;
 use wow_mpq::crypto::het_hash;
-use wow_mpq::{hash_string, hash_type, jenkins_hash};
+use wow_mpq::{NameHashes, hash_names, hash_string, hash_type, jenkins_hash};
 
 fn bench_hash_string_short(c: &mut Criterion) {
     let filename = "file.txt";
@@ -99,6 +99,55 @@ fn bench_het_hash_8bit(c: &mut Criterion) {
     });
 }
 
+fn bench_hash_names_batch(c: &mut Criterion) {
+    let names: Vec<String> = (0..10_000)
+        .map(|i| {
+            format!(
+                "World\\Maps\\Azeroth\\Azeroth_{}_{}_tex{}.blp",
+                i / 64,
+                i % 64,
+                i % 3
+            )
+        })
+        .collect();
+    let names: Vec<&str> = names.iter().map(String::as_str).collect();
+
+    let mut group = c.benchmark_group("hash_names");
+    group.throughput(Throughput::Elements(names.len() as u64));
+
+    // Three separate passes per name, as single lookups do
+    group.bench_with_input(
+        BenchmarkId::new("per_name", names.len()),
+        &names,
+        |b, names| {
+            b.iter(|| {
+                names
+                    .iter()
+                    .map(|name| NameHashes {
+                        offset: hash_string(name, hash_type::TABLE_OFFSET),
+                        name_a: hash_string(name, hash_type::NAME_A),
+                        name_b: hash_string(name, hash_type::NAME_B),
+                    })
+                    .collect::<Vec<_>>()
+            });
+        },
+    );
+
+    let mut out = Vec::with_capacity(names.len());
+    group.bench_with_input(
+        BenchmarkId::new("batch", names.len()),
+        &names,
+        |b, names| {
+            b.iter(|| {
+                hash_names(black_box(names), &mut out);
+                out.len()
+            });
+        },
+    );
+
+    group.finish();
+}
+
 criterion_group!(
     benches,
     bench_hash_string_short,
@@ -111,6 +160,7 @@ criterion_group!(
     bench_hash_case_conversion,
     bench_het_hash_48bit,
     bench_het_hash_64bit,
-    bench_het_hash_8bit
+    bench_het_hash_8bit,
+    bench_hash_names_batch
 );
 criterion_main!(benches);
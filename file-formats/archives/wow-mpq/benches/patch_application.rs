@@ -0,0 +1,233 @@
+//! Patch application benchmarks
+//!
+//! These benchmarks reproduce the scenario of `tests/stormlib_patch_test.cpp`:
+//! one file from a base archive patched by the 15211, 15354 and 15595 updates
+//! of Cataclysm 4.3.4. The synthetic chains build the same three BSD0 steps
+//! in memory, and throughput is the size of the final patched file, so the
+//! numbers compare directly with timed StormLib reads of the same file.
+//!
+//! When `WOW_CATA_DATA` points at a 4.3.4 `Data` directory, the real archives
+//! are read through a `PatchChain` as well.
+
+use criterion::{BenchmarkId, Criterion, Throughput, criterion_group, criterion_main};
+use md5::{Digest, Md5};
+use std::hint::black_box;
+use std::path::PathBuf;
+use wow_mpq::PatchChain;
+use wow_mpq::patch::{PatchFile, apply_patch, apply_patch_chain};
+
+/// Update archives applied on top of the base archive, in order
+const UPDATES: [&str; 3] = [
+    "wow-update-base-15211.MPQ",
+    "wow-update-base-15354.MPQ",
+    "wow-update-base-15595.MPQ",
+];
+
+/// File patched by every update (see `tests/stormlib_patch_test.cpp`)
+const PATCHED_FILE: &str = "Item/ObjectComponents/Head/Helm_Robe_RaidWarlock_F_01_WoF.M2";
+
+/// Deterministic pseudo-random data
+fn generate_data(size: usize, seed: u32) -> Vec<u8> {
+    let mut state = seed;
+    (0..size)
+        .map(|_| {
+            state = state.wrapping_mul(1664525).wrapping_add(1013904223);
+            (state >> 16) as u8
+        })
+        .collect()
+}
+
+/// Next version of a file: a few changed bytes in every 4 KiB, 16 new bytes
+/// after each 4 KiB, like a patched model with edited and inserted records
+fn next_version(old: &[u8], seed: u32) -> Vec<u8> {
+    let extra = generate_data(old.len() / 4096 * 16 + 16, seed);
+    let mut new = Vec::with_capacity(old.len() + extra.len());
+    for (segment, inserted) in old.chunks(4096).zip(extra.chunks(16)) {
+        let start = new.len();
+        new.extend_from_slice(segment);
+        for byte in new[start..].iter_mut().step_by(97) {
+            *byte = byte.wrapping_add(seed as u8 | 1);
+        }
+        new.extend_from_slice(inserted);
+    }
+    new
+}
+
+/// RLE-compress BSD0 data, encoding zero runs as skips
+fn rle_compress(data: &[u8]) -> Vec<u8> {
+    let mut out = (data.len() as u32).to_le_bytes().to_vec();
+    let mut pos = 0;
+    while pos < data.len() {
+        let zeros = data[pos..]
+            .iter()
+            .take(128)
+            .take_while(|&&b| b == 0)
+            .count();
+        if zeros > 0 {
+            out.push((zeros - 1) as u8);
+            pos += zeros;
+            continue;
+        }
+        let literals = data[pos..]
+            .iter()
+            .take(128)
+            .take_while(|&&b| b != 0)
+            .count();
+        out.push(0x80 | (literals - 1) as u8);
+        out.extend_from_slice(&data[pos..pos + literals]);
+        pos += literals;
+    }
+    out
+}
+
+/// Build a PTCH file
+fn build_ptch(old: &[u8], new: &[u8], magic: u32, payload: &[u8], data_size: usize) -> PatchFile {
+    let mut data = Vec::new();
+    data.extend_from_slice(&0x48435450u32.to_le_bytes()); // 'PTCH'
+    data.extend_from_slice(&(data_size as u32).to_le_bytes());
+    data.extend_from_slice(&(old.len() as u32).to_le_bytes());
+    data.extend_from_slice(&(new.len() as u32).to_le_bytes());
+    data.extend_from_slice(&0x5f35444du32.to_le_bytes()); // 'MD5_'
+    data.extend_from_slice(&40u32.to_le_bytes());
+    data.extend_from_slice(&Md5::digest(old));
+    data.extend_from_slice(&Md5::digest(new));
+    data.extend_from_slice(&0x4d524658u32.to_le_bytes()); // 'XFRM'
+    data.extend_from_slice(&(12 + payload.len() as u32).to_le_bytes());
+    data.extend_from_slice(&magic.to_le_bytes());
+    data.extend_from_slice(payload);
+    PatchFile::parse(&data).unwrap()
+}
+
+/// BSD0 patch from `old` to a `new` made by [`next_version`]
+fn bsd0_patch(old: &[u8], new: &[u8]) -> PatchFile {
+    let mut ctrl = Vec::new();
+    let mut diff = Vec::new();
+    let mut extra = Vec::new();
+    let mut new_pos = 0;
+    for segment in old.chunks(4096) {
+        let added = &new[new_pos..new_pos + segment.len()];
+        diff.extend(added.iter().zip(segment).map(|(n, o)| n.wrapping_sub(*o)));
+        new_pos += segment.len();
+        let inserted = (new.len() - new_pos).min(16);
+        extra.extend_from_slice(&new[new_pos..new_pos + inserted]);
+        new_pos += inserted;
+        for value in [segment.len() as u32, inserted as u32, 0] {
+            ctrl.extend_from_slice(&value.to_le_bytes());
+        }
+    }
+
+    let mut bsdiff = Vec::new();
+    bsdiff.extend_from_slice(&0x3034464649445342u64.to_le_bytes()); // 'BSDIFF40'
+    bsdiff.extend_from_slice(&(ctrl.len() as u64).to_le_bytes());
+    bsdiff.extend_from_slice(&(diff.len() as u64).to_le_bytes());
+    bsdiff.extend_from_slice(&(new.len() as u64).to_le_bytes());
+    bsdiff.extend_from_slice(&ctrl);
+    bsdiff.extend_from_slice(&diff);
+    bsdiff.extend_from_slice(&extra);
+
+    build_ptch(old, new, 0x30445342, &rle_compress(&bsdiff), bsdiff.len())
+}
+
+/// COPY patch replacing `old` with `new`
+fn copy_patch(old: &[u8], new: &[u8]) -> PatchFile {
+    build_ptch(old, new, 0x59504f43, new, new.len())
+}
+
+/// Base file and the three BSD0 steps of the 15211 → 15354 → 15595 chain
+fn synthetic_chain(size: usize) -> (Vec<u8>, Vec<PatchFile>, usize) {
+    let base = generate_data(size, 0x15211);
+    let mut versions = vec![base.clone()];
+    for seed in [15211, 15354, 15595] {
+        let next = next_version(versions.last().unwrap(), seed);
+        versions.push(next);
+    }
+    let patches = versions
+        .windows(2)
+        .map(|pair| bsd0_patch(&pair[0], &pair[1]))
+        .collect();
+    let final_size = versions.last().unwrap().len();
+    (base, patches, final_size)
+}
+
+fn bench_synthetic_chain(c: &mut Criterion) {
+    let mut group = c.benchmark_group("patch_chain");
+
+    for size in [256 * 1024, 4 * 1024 * 1024] {
+        let (base, patches, final_size) = synthetic_chain(size);
+        let steps: Vec<&PatchFile> = patches.iter().collect();
+        group.throughput(Throughput::Bytes(final_size as u64));
+
+        // One full allocation and MD5 pass pair per step
+        group.bench_with_input(BenchmarkId::new("sequential", size), &size, |b, _| {
+            b.iter(|| {
+                let mut data = base.clone();
+                for patch in &patches {
+                    data = apply_patch(patch, &data).unwrap();
+                }
+                black_box(data)
+            });
+        });
+
+        group.bench_with_input(BenchmarkId::new("rolling", size), &size, |b, _| {
+            b.iter(|| black_box(apply_patch_chain(&base, &steps, false).unwrap()));
+        });
+
+        group.bench_with_input(BenchmarkId::new("rolling_md5", size), &size, |b, _| {
+            b.iter(|| black_box(apply_patch_chain(&base, &steps, true).unwrap()));
+        });
+
+        // The middle update replaces the file, so only the last step runs
+        let middle = next_version(&base, 15211);
+        let replaced = next_version(&middle, 15354);
+        let last = next_version(&replaced, 15595);
+        let with_copy = [
+            bsd0_patch(&base, &middle),
+            copy_patch(&middle, &replaced),
+            bsd0_patch(&replaced, &last),
+        ];
+        let with_copy: Vec<&PatchFile> = with_copy.iter().collect();
+        group.bench_with_input(BenchmarkId::new("copy_skip", size), &size, |b, _| {
+            b.iter(|| black_box(apply_patch_chain(&base, &with_copy, false).unwrap()));
+        });
+    }
+
+    group.finish();
+}
+
+fn bench_cataclysm_chain(c: &mut Criterion) {
+    let Some(data_dir) = std::env::var_os("WOW_CATA_DATA").map(PathBuf::from) else {
+        return;
+    };
+
+    let mut chain = PatchChain::new();
+    let mut priority = 0;
+    for archive in std::iter::once("art.MPQ").chain(UPDATES) {
+        let path = data_dir.join(archive);
+        if chain.add_archive(&path, priority).is_err() {
+            eprintln!(
+                "Skipping Cataclysm patch chain: cannot open {}",
+                path.display()
+            );
+            return;
+        }
+        priority += 100;
+    }
+
+    // Patched reads are memoized; measure the application every time
+    chain.set_patch_cache_limit(0);
+    let size = chain.read_file(PATCHED_FILE).unwrap().len();
+
+    let mut group = c.benchmark_group("patch_chain_cataclysm");
+    group.throughput(Throughput::Bytes(size as u64));
+    for verify in [false, true] {
+        chain.set_verify_patches(verify);
+        let name = if verify { "read_md5" } else { "read" };
+        group.bench_function(name, |b| {
+            b.iter(|| black_box(chain.read_file(PATCHED_FILE).unwrap()));
+        });
+    }
+    group.finish();
+}
+
+criterion_group!(benches, bench_synthetic_chain, bench_cataclysm_chain);
+criterion_main!(benches);
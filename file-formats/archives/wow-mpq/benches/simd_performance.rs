@@ -1,6 +1,7 @@
 use criterion::{BenchmarkId, Criterion, Throughput, criterion_group, criterion_main};
 use std::hint::black_box;
 use wow_mpq::simd::{CpuFeatures, SimdOps};
+use wow_mpq::{Archive, ArchiveBuilder, OpenOptions, hash_string, hash_type};
 
 /// Benchmark SIMD CRC32 performance vs scalar implementation
 fn bench_crc32_performance(c: &mut Criterion) {
@@ -304,13 +305,93 @@ fn generate_large_archive_filenames() -> Vec<String> {
     filenames
 }
 
+/// Benchmark batch name hashing and batch archive lookups
+fn bench_batch_lookup(c: &mut Criterion) {
+    let simd = SimdOps::new();
+    let filenames = generate_large_archive_filenames();
+    let refs: Vec<&str> = filenames.iter().map(|s| s.as_str()).collect();
+
+    let mut group = c.benchmark_group("batch_lookup");
+    group.throughput(Throughput::Elements(refs.len() as u64));
+
+    let mut hashes = Vec::with_capacity(refs.len());
+    group.bench_function("hash_names_simd", |b| {
+        b.iter(|| {
+            simd.hash_names(black_box(&refs), &mut hashes);
+            hashes.len()
+        })
+    });
+
+    group.bench_function("hash_names_scalar", |b| {
+        b.iter(|| {
+            refs.iter()
+                .map(|name| {
+                    (
+                        hash_string(black_box(name), hash_type::TABLE_OFFSET),
+                        hash_string(name, hash_type::NAME_A),
+                        hash_string(name, hash_type::NAME_B),
+                    )
+                })
+                .collect::<Vec<_>>()
+        })
+    });
+
+    // Resolve a listfile against a real archive: half the names exist
+    let temp_dir = tempfile::TempDir::new().unwrap();
+    let path = temp_dir.path().join("lookup.mpq");
+    let mut builder = ArchiveBuilder::new();
+    for name in refs.iter().step_by(2) {
+        builder = builder.add_file_data(Vec::new(), name);
+    }
+    builder.build(&path).unwrap();
+    let archive = Archive::open(&path).unwrap();
+
+    group.bench_function("find_file", |b| {
+        b.iter(|| {
+            refs.iter()
+                .filter(|name| archive.find_file(black_box(name)).unwrap().is_some())
+                .count()
+        })
+    });
+
+    let mut found = Vec::with_capacity(refs.len());
+    group.bench_function("find_files_batch", |b| {
+        b.iter(|| {
+            archive
+                .find_files_batch(black_box(&refs), &mut found)
+                .unwrap();
+            found.iter().flatten().count()
+        })
+    });
+
+    // Same lookups against the flattened struct-of-arrays tables
+    let flat = OpenOptions::new().flatten_tables(true).open(&path).unwrap();
+    group.bench_function("find_file_flat", |b| {
+        b.iter(|| {
+            refs.iter()
+                .filter(|name| flat.find_file(black_box(name)).unwrap().is_some())
+                .count()
+        })
+    });
+
+    group.bench_function("find_files_batch_flat", |b| {
+        b.iter(|| {
+            flat.find_files_batch(black_box(&refs), &mut found).unwrap();
+            found.iter().flatten().count()
+        })
+    });
+
+    group.finish();
+}
+
 criterion_group!(
     benches,
     bench_cpu_feature_detection,
     bench_crc32_performance,
     bench_hash_performance,
     bench_jenkins_batch_performance,
-    bench_realistic_workload
+    bench_realistic_workload,
+    bench_batch_lookup
 );
 
 criterion_main!(benches);
@@ -3,11 +3,29 @@
 //! This module provides a bounded capacity buffer pool to reduce allocation overhead
 //! during file extraction and decompression operations. Buffers are categorized by size
 //! to optimize memory usage patterns.
+//!
+//! The decompressors and [`FileStream`](crate::FileStream) draw their output and
+//! scratch buffers from the process-wide [`global`] pool and give them back when a
+//! sector is evicted or a stream is dropped, so a steady open/read/close loop reuses
+//! the same allocations. Pooled buffers are rounded up to their size category, so
+//! anything handed to a caller that keeps it passes through
+//! [`BufferPool::detach`] first.
 
 use parking_lot::Mutex;
 use std::collections::VecDeque;
+use std::sync::LazyLock;
 use std::sync::atomic::{AtomicU64, Ordering};
 
+/// Buffers with more capacity than this are freed instead of recycled
+const MAX_RECYCLED_CAPACITY: usize = 4 * BufferSize::Large as usize;
+
+static GLOBAL_POOL: LazyLock<BufferPool> = LazyLock::new(BufferPool::new);
+
+/// Process-wide pool shared by the decompression and streaming read paths
+pub fn global() -> &'static BufferPool {
+    &GLOBAL_POOL
+}
+
 /// Buffer size categories optimized for different MPQ operations
 #[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
 pub enum BufferSize {
@@ -186,6 +204,51 @@ impl BufferPool {
         }
     }
 
+    /// Take an empty buffer with room for at least `capacity` bytes
+    ///
+    /// Unlike [`get_buffer`](Self::get_buffer) the buffer is owned by the caller;
+    /// hand it back with [`recycle`](Self::recycle) once it is no longer needed.
+    pub fn take(&self, capacity: usize) -> Vec<u8> {
+        let mut buffer = self.get_buffer(BufferSize::for_capacity(capacity)).take();
+        buffer.reserve(capacity);
+        buffer
+    }
+
+    /// Prepare a pooled buffer for a caller that keeps it
+    ///
+    /// A buffer whose spare capacity exceeds an eighth of its length is copied
+    /// into an exactly sized allocation and the original is recycled, so a
+    /// 70 KiB result does not pin a 1 MiB buffer for its lifetime.
+    pub fn detach(&self, buffer: Vec<u8>) -> Vec<u8> {
+        if buffer.capacity() - buffer.len() <= buffer.len() / 8 {
+            return buffer;
+        }
+        let exact = buffer.as_slice().to_vec();
+        self.recycle(buffer);
+        exact
+    }
+
+    /// Give a buffer back to the pool for reuse
+    ///
+    /// The buffer is filed under the largest size category its capacity covers.
+    /// Buffers smaller than [`BufferSize::Small`] or much larger than
+    /// [`BufferSize::Large`] are simply freed.
+    pub fn recycle(&self, buffer: Vec<u8>) {
+        let capacity = buffer.capacity();
+        if !(BufferSize::Small.capacity()..=MAX_RECYCLED_CAPACITY).contains(&capacity) {
+            return;
+        }
+
+        let size = if capacity >= BufferSize::Large.capacity() {
+            BufferSize::Large
+        } else if capacity >= BufferSize::Medium.capacity() {
+            BufferSize::Medium
+        } else {
+            BufferSize::Small
+        };
+        self.return_buffer(buffer, size);
+    }
+
     /// Return a buffer to the appropriate pool
     fn return_buffer(&self, buffer: Vec<u8>, size: BufferSize) {
         if self.config.collect_stats {
@@ -417,4 +480,47 @@ mod tests {
         // Should have 50% hit rate (2 hits out of 4 requests)
         assert_eq!(pool.statistics().hit_rate(), 0.5);
     }
+
+    #[test]
+    fn test_take_and_recycle() {
+        let pool = BufferPool::new();
+
+        let mut buffer = pool.take(10_000);
+        assert!(buffer.capacity() >= 10_000);
+        buffer.extend_from_slice(&[7; 10_000]);
+        pool.recycle(buffer);
+        assert_eq!(pool.pool_sizes(), (0, 1, 0));
+
+        // Reused, emptied, and grown if the request is larger than the category
+        let buffer = pool.take(20_000);
+        assert!(buffer.is_empty());
+        assert!(buffer.capacity() >= 20_000);
+        assert_eq!(pool.statistics().hits.load(Ordering::Relaxed), 1);
+
+        // Too small to be worth keeping
+        pool.recycle(Vec::with_capacity(16));
+        assert_eq!(pool.pool_sizes(), (0, 0, 0));
+    }
+
+    #[test]
+    fn test_detach_sizes_exactly() {
+        let pool = BufferPool::new();
+
+        let mut buffer = pool.take(70_000);
+        assert!(buffer.capacity() >= BufferSize::Large.capacity());
+        buffer.extend_from_slice(&[3; 70_000]);
+        let detached = pool.detach(buffer);
+        assert_eq!(detached.len(), 70_000);
+        assert_eq!(detached.capacity(), 70_000);
+        // The oversized original went back to the pool
+        assert_eq!(pool.pool_sizes(), (0, 0, 1));
+
+        // Buffers that are already tight are passed through untouched
+        let mut buffer = pool.take(4096);
+        buffer.extend_from_slice(&[1; 4000]);
+        let ptr = buffer.as_ptr();
+        let detached = pool.detach(buffer);
+        assert_eq!(detached.as_ptr(), ptr);
+        assert_eq!(pool.pool_sizes(), (0, 0, 1));
+    }
 }
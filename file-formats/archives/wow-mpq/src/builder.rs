@@ -176,6 +176,8 @@ pub struct ArchiveBuilder {
     compress_tables: bool,
     /// Compression method for tables
     table_compression: u8,
+    /// Minimum number of hash table entries
+    min_hash_table_size: u32,
 }
 
 impl ArchiveBuilder {
@@ -191,6 +193,7 @@ impl ArchiveBuilder {
             generate_crcs: false,
             compress_tables: false, // Default to uncompressed for compatibility
             table_compression: compression_flags::ZLIB,
+            min_hash_table_size: 0,
         }
     }
 
@@ -353,6 +356,18 @@ impl ArchiveBuilder {
         self
     }
 
+    /// Make the hash table at least `entries` entries large
+    ///
+    /// The hash table is normally sized for the files added to the builder.
+    /// Archives that will be filled later through
+    /// [`MutableArchive`](crate::MutableArchive) need room for those files up
+    /// front, because the table does not grow. The size is rounded up to a
+    /// power of two.
+    pub fn hash_table_size(mut self, entries: u32) -> Self {
+        self.min_hash_table_size = entries;
+        self
+    }
+
     /// Add a file from disk to the archive
     ///
     /// Reads a file from the filesystem and adds it to the archive with default
@@ -572,7 +587,7 @@ impl ArchiveBuilder {
             };
 
         // Use 2x the file count for good performance, minimum 16
-        let optimal_size = (file_count * 2).max(16) as u32;
+        let optimal_size = ((file_count * 2).max(16) as u32).max(self.min_hash_table_size);
 
         // Round up to next power of 2
         optimal_size.next_power_of_two()
@@ -4,6 +4,7 @@
 //! Differential Pulse Code Modulation) compression algorithm used in MPQ archives
 //! for compressing audio data, particularly WAV files.
 
+use crate::buffer_pool;
 use crate::compression::error_helpers::compression_error;
 use crate::error::{Error, Result};
 
@@ -229,77 +230,105 @@ fn decompress_internal(input: &[u8], output_size: usize, channel_count: usize) -
         ));
     }
 
-    // Initialize state for each channel
-    let mut predicted_samples = vec![0i16; channel_count];
-    let mut step_indexes = vec![INITIAL_ADPCM_STEP_INDEX; channel_count];
+    match channel_count {
+        1 => decode_channels::<1>(&input[input_pos..], output_size, bit_shift),
+        _ => decode_channels::<2>(&input[input_pos..], output_size, bit_shift),
+    }
+}
 
-    // Allocate output buffer
-    let mut output = Vec::with_capacity(output_size);
+/// Decode the samples following the header for `CHANNELS` interleaved channels
+///
+/// The channel count is a constant so the per-channel state lives in
+/// registers and switching channels needs no division; the sample update
+/// itself is computed with masks instead of a branch per step bit.
+fn decode_channels<const CHANNELS: usize>(
+    input: &[u8],
+    output_size: usize,
+    bit_shift: u8,
+) -> Result<Vec<u8>> {
+    let Some((initial, encoded)) = input.split_at_checked(CHANNELS * 2) else {
+        return Err(Error::compression("Missing initial sample"));
+    };
 
-    // Read initial samples for each channel
-    for predicted_sample in predicted_samples.iter_mut().take(channel_count) {
-        if input_pos + 2 > input.len() {
-            return Err(Error::compression("Missing initial sample"));
-        }
+    // Allocate output buffer
+    let mut output = buffer_pool::global().take(output_size);
 
-        let initial_sample = read_sample(input, input_pos / 2)?;
-        *predicted_sample = initial_sample;
-        write_sample(&mut output, initial_sample);
-        input_pos += 2;
+    // Initialize state for each channel from its initial sample
+    let mut predicted_samples = [0i32; CHANNELS];
+    let mut step_indexes = [INITIAL_ADPCM_STEP_INDEX; CHANNELS];
+    for (predicted_sample, bytes) in predicted_samples.iter_mut().zip(initial.chunks_exact(2)) {
+        *predicted_sample = i32::from(i16::from_le_bytes([bytes[0], bytes[1]]));
+        output.extend_from_slice(bytes);
     }
 
     // Initialize channel index
-    let mut channel_index = channel_count - 1;
+    let mut channel_index = CHANNELS - 1;
 
     // Decompress remaining data
-    while input_pos < input.len() && output.len() < output_size {
-        let encoded_sample = input[input_pos];
-        input_pos += 1;
+    for &encoded_sample in encoded {
+        if output.len() >= output_size {
+            break;
+        }
 
         // Alternate between channels
-        channel_index = (channel_index + 1) % channel_count;
-
-        if encoded_sample == 0x80 {
-            // Step index decrease marker
-            if step_indexes[channel_index] > 0 {
-                step_indexes[channel_index] -= 1;
+        channel_index = next_channel::<CHANNELS>(channel_index);
+        let step_index = step_indexes[channel_index];
+
+        match encoded_sample {
+            0x80 => {
+                // Step index decrease marker
+                step_indexes[channel_index] = step_index.saturating_sub(1);
+                let sample = predicted_samples[channel_index] as i16;
+                output.extend_from_slice(&sample.to_le_bytes());
             }
-            write_sample(&mut output, predicted_samples[channel_index]);
-        } else if encoded_sample == 0x81 {
-            // Step index increase marker
-            step_indexes[channel_index] += 8;
-            if step_indexes[channel_index] > 0x58 {
-                step_indexes[channel_index] = 0x58;
+            0x81 => {
+                // Step index increase marker
+                step_indexes[channel_index] = (step_index + 8).min(0x58);
+                // For 0x81, we stay on the same channel for next sample
+                channel_index = next_channel::<CHANNELS>(channel_index);
             }
-            // For 0x81, we stay on the same channel for next sample
-            channel_index = (channel_index + channel_count - 1) % channel_count;
-        } else {
-            // Decode the sample
-            let step_size = STEP_SIZE_TABLE[step_indexes[channel_index]];
-            // Safely calculate the shifted step size
-            let shifted_step_size = if bit_shift < 32 {
-                step_size >> bit_shift as i32
-            } else {
-                0 // If shift is too large, result would be 0 anyway
-            };
-            predicted_samples[channel_index] = decode_sample(
-                predicted_samples[channel_index] as i32,
-                encoded_sample,
-                step_size,
-                shifted_step_size,
-            ) as i16;
-
-            write_sample(&mut output, predicted_samples[channel_index]);
+            _ => {
+                let sample = decode_sample(
+                    predicted_samples[channel_index],
+                    encoded_sample,
+                    STEP_SIZE_TABLE[step_index],
+                    bit_shift,
+                );
+                predicted_samples[channel_index] = sample;
+                output.extend_from_slice(&(sample as i16).to_le_bytes());
 
-            // Update step index
-            step_indexes[channel_index] =
-                get_next_step_index(step_indexes[channel_index], encoded_sample);
+                // Update step index
+                step_indexes[channel_index] = get_next_step_index(step_index, encoded_sample);
+            }
         }
     }
 
     Ok(output)
 }
 
+/// The channel after `channel`, cycling through `CHANNELS`
+#[inline(always)]
+fn next_channel<const CHANNELS: usize>(channel: usize) -> usize {
+    if CHANNELS == 1 { 0 } else { channel ^ 1 }
+}
+
+/// Decode a sample using the ADPCM algorithm
+///
+/// Each of the six magnitude bits adds `step_size >> bit` through a mask and
+/// the sign bit negates through two's complement, which keeps the decoder's
+/// inner loop free of hard-to-predict branches on noisy audio.
+#[inline(always)]
+fn decode_sample(predicted_sample: i32, encoded_sample: u8, step_size: i32, bit_shift: u8) -> i32 {
+    let encoded = i32::from(encoded_sample);
+    let mut difference = step_size >> bit_shift;
+    for bit in 0..6 {
+        difference += (step_size >> bit) & -((encoded >> bit) & 1);
+    }
+
+    let sign = -((encoded >> 6) & 1);
+    (predicted_sample + ((difference ^ sign) - sign)).clamp(-32768, 32767)
+}
+
 /// Read a 16-bit sample from the input buffer
 fn read_sample(input: &[u8], sample_index: usize) -> Result<i16> {
     let byte_index = sample_index * 2;
@@ -343,37 +372,6 @@ fn update_predicted_sample(predicted_sample: i32, encoded_sample: u8, difference
     new_sample.clamp(-32768, 32767)
 }
 
-/// Decode a sample using the ADPCM algorithm
-fn decode_sample(
-    predicted_sample: i32,
-    encoded_sample: u8,
-    step_size: i32,
-    base_difference: i32,
-) -> i32 {
-    let mut difference = base_difference;
-
-    if encoded_sample & 0x01 != 0 {
-        difference += step_size;
-    }
-    if encoded_sample & 0x02 != 0 {
-        difference += step_size >> 1;
-    }
-    if encoded_sample & 0x04 != 0 {
-        difference += step_size >> 2;
-    }
-    if encoded_sample & 0x08 != 0 {
-        difference += step_size >> 3;
-    }
-    if encoded_sample & 0x10 != 0 {
-        difference += step_size >> 4;
-    }
-    if encoded_sample & 0x20 != 0 {
-        difference += step_size >> 5;
-    }
-
-    update_predicted_sample(predicted_sample, encoded_sample, difference)
-}
-
 #[cfg(test)]
 mod tests {
     use super::*;
@@ -602,6 +600,44 @@ mod tests {
         );
     }
 
+    #[test]
+    fn test_decode_sample_matches_bitwise_reference() {
+        for &step_size in &STEP_SIZE_TABLE {
+            for bit_shift in [0u8, 2, 4, 31] {
+                for encoded_sample in 0..=0x7Fu8 {
+                    let mut difference = step_size >> bit_shift;
+                    for bit in 0..6 {
+                        if encoded_sample & (1 << bit) != 0 {
+                            difference += step_size >> bit;
+                        }
+                    }
+                    for predicted in [-32768, -1000, 0, 1000, 32767] {
+                        assert_eq!(
+                            decode_sample(predicted, encoded_sample, step_size, bit_shift),
+                            update_predicted_sample(predicted, encoded_sample, difference)
+                        );
+                    }
+                }
+            }
+        }
+    }
+
+    #[test]
+    fn test_stereo_markers_keep_channel() {
+        // Header, two initial samples, then 0x81 (left step up, stay on left),
+        // a left sample, 0x80 on the right channel and another left sample
+        let input = [0, 0, 0x10, 0x00, 0x20, 0x00, 0x81, 0x05, 0x80, 0x45];
+        let output = decompress_stereo(&input, 64).unwrap();
+        let samples = extract_samples(&output);
+        assert_eq!(samples.len(), 5);
+        assert_eq!(&samples[..2], &[0x10, 0x20]);
+        // The right channel repeats its prediction for 0x80
+        assert_eq!(samples[3], 0x20);
+        // The left channel moved up, then back down by the sign bit
+        assert!(samples[2] > 0x10);
+        assert!(samples[4] < samples[2]);
+    }
+
     #[test]
     fn test_max_channels_constant() {
         // This test ensures MAX_ADPCM_CHANNEL_COUNT is used correctly
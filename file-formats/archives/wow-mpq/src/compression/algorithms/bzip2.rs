@@ -1,6 +1,7 @@
 //! BZip2 compression and decompression
 
 use crate::Result;
+use crate::buffer_pool;
 use crate::compression::error_helpers::{compression_error, decompression_error};
 use bzip2::Compression;
 use bzip2::read::BzDecoder;
@@ -10,7 +11,7 @@ use std::io::{Read, Write};
 /// Decompress using BZip2
 pub(crate) fn decompress(data: &[u8], expected_size: usize) -> Result<Vec<u8>> {
     let mut decoder = BzDecoder::new(data);
-    let mut decompressed = Vec::with_capacity(expected_size);
+    let mut decompressed = buffer_pool::global().take(expected_size);
 
     decoder
         .read_to_end(&mut decompressed)
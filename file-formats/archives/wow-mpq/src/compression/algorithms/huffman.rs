@@ -1,14 +1,40 @@
 //! Huffman compression implementation for MPQ archives (StormLib-compatible)
 //!
-//! This is a complete rewrite to match StormLib's linked list approach.
+//! This follows StormLib's adaptive tree: items live in a fixed pool and are
+//! kept in a list sorted by weight, the tree is rebuilt from one of nine
+//! weight tables for each buffer, and it is rebalanced as bytes are decoded.
 //! Based on the algorithm from Ladislav Zezula's StormLib.
-
+//!
+//! Decoding does not walk the tree bit by bit unless it has to. The initial
+//! tree of each compression type is built once and flattened into a table
+//! indexed by the next [`TABLE_BITS`] input bits, whose entries yield up to
+//! two bytes at once. Compression type 0 and the escape symbol reshape the
+//! tree; from then on codes are cached in 7-bit quick links, StormLib's
+//! scheme, which are dropped whenever the tree's shape changes.
+
+use crate::buffer_pool;
 use crate::{Error, Result};
+use std::borrow::Cow;
+use std::sync::OnceLock;
 
 // Huffman tree constants
 const HUFF_ITEM_COUNT: usize = 0x203; // Number of items in the item pool
-const LINK_ITEM_COUNT: usize = 0x80; // Maximum number of quick-link items
-const HUFF_DECOMPRESS_ERROR: u32 = 0x1FF;
+const LINK_ITEM_COUNT: usize = 0x80; // Number of quick-link items
+const LINK_BITS: u32 = 7; // Bits resolved by a quick link
+
+/// Index of the list head, which follows the item pool
+const LIST_HEAD: u16 = HUFF_ITEM_COUNT as u16;
+/// Missing item link
+const NO_ITEM: u16 = u16::MAX;
+
+/// End of stream marker
+const SYMBOL_END: u16 = 0x100;
+/// Escape marker: the next 8 bits are a byte not yet in the tree
+const SYMBOL_ESCAPE: u16 = 0x101;
+
+/// Input bits resolved by one lookup in the table of an initial tree
+const TABLE_BITS: u32 = 11;
+const TABLE_SIZE: usize = 1 << TABLE_BITS;
 
 // All weight tables from StormLib - these define the initial character frequencies
 const BYTE_TO_WEIGHT_00: [u8; 258] = [
@@ -205,10 +231,13 @@ const WEIGHT_TABLES: [&[u8; 258]; 9] = [
 ];
 
 /// Bit stream reader for Huffman decompression
+///
+/// Bits are consumed LSB first. The buffer is refilled a byte at a time up to
+/// 64 bits, so a table lookup never has to touch the input slice.
 struct BitReader<'a> {
     data: &'a [u8],
     position: usize,
-    bit_buffer: u32,
+    bit_buffer: u64,
     bit_count: u32,
 }
 
@@ -222,547 +251,505 @@ impl<'a> BitReader<'a> {
         }
     }
 
-    fn get_bit(&mut self) -> Result<u32> {
-        if self.bit_count == 0 {
-            if self.position >= self.data.len() {
-                return Err(Error::compression("Unexpected end of Huffman data"));
-            }
-            self.bit_buffer = self.data[self.position] as u32;
+    /// Top up the buffer with as many whole bytes as fit
+    #[inline]
+    fn refill(&mut self) {
+        while self.bit_count <= 56 && self.position < self.data.len() {
+            self.bit_buffer |= (self.data[self.position] as u64) << self.bit_count;
             self.position += 1;
-            self.bit_count = 8;
+            self.bit_count += 8;
         }
+    }
 
-        let bit = self.bit_buffer & 1;
-        self.bit_buffer >>= 1;
-        self.bit_count -= 1;
-        Ok(bit)
+    /// Next `count` bits, zero-padded past the end of the input
+    #[inline]
+    fn peek(&self, count: u32) -> usize {
+        (self.bit_buffer & ((1 << count) - 1)) as usize
     }
 
-    fn get_8_bits(&mut self) -> Result<u32> {
-        if self.position >= self.data.len() {
-            return Err(Error::compression("Unexpected end of Huffman data"));
-        }
-        let byte = self.data[self.position] as u32;
-        self.position += 1;
-        Ok(byte)
+    #[inline]
+    fn consume(&mut self, count: u32) {
+        self.bit_buffer >>= count;
+        self.bit_count -= count;
     }
 
-    fn peek_7_bits(&mut self) -> Result<u32> {
-        // Ensure we have enough bits in the buffer
-        while self.bit_count < 7 {
-            if self.position >= self.data.len() {
+    fn get_bit(&mut self) -> Result<u32> {
+        if self.bit_count == 0 {
+            self.refill();
+            if self.bit_count == 0 {
                 return Err(Error::compression("Unexpected end of Huffman data"));
             }
-            self.bit_buffer |= (self.data[self.position] as u32) << self.bit_count;
-            self.position += 1;
-            self.bit_count += 8;
         }
 
-        Ok(self.bit_buffer & 0x7F) // Get lower 7 bits
+        let bit = (self.bit_buffer & 1) as u32;
+        self.consume(1);
+        Ok(bit)
     }
 
-    fn skip_bits(&mut self, count: u32) {
-        if count <= self.bit_count {
-            self.bit_buffer >>= count;
-            self.bit_count -= count;
-        } else {
-            let remaining = count - self.bit_count;
-            self.bit_buffer = 0;
-            self.bit_count = 0;
-            self.position += (remaining / 8) as usize;
-            // Handle remaining bits if any
-            if !remaining.is_multiple_of(8) && self.peek_7_bits().is_ok() {
-                self.skip_bits(remaining % 8);
+    fn get_8_bits(&mut self) -> Result<u32> {
+        if self.bit_count < 8 {
+            self.refill();
+            if self.bit_count < 8 {
+                return Err(Error::compression("Unexpected end of Huffman data"));
             }
         }
+
+        let byte = (self.bit_buffer & 0xFF) as u32;
+        self.consume(8);
+        Ok(byte)
     }
 }
 
 /// Huffman tree node based on StormLib's THTreeItem
-#[derive(Debug, Clone)]
+#[derive(Debug, Clone, Copy)]
 struct HuffmanItem {
     // Linked list pointers
-    next: Option<usize>, // Pointer to lower-weight tree item
-    prev: Option<usize>, // Pointer to higher-weight item
+    next: u16, // Pointer to lower-weight tree item
+    prev: u16, // Pointer to higher-weight item
 
     // Tree structure
-    decompressed_value: u32, // 08 - Decompressed byte value (also index in the array)
-    weight: u32,             // 0C - Weight
-    parent: Option<usize>,   // 10 - Pointer to parent item (NULL if none)
-    child_lo: Option<usize>, // 14 - Pointer to the child with lower-weight child ("left child")
-
-                             // In StormLib, the higher-weight child is accessed via pChildLo->pPrev
+    decompressed_value: u16, // Decompressed byte value
+    weight: u32,
+    parent: u16, // Pointer to parent item (NO_ITEM if none)
+    child_lo: u16, // Pointer to the child with lower-weight child ("left child")
+                 // The higher-weight child is child_lo's prev
 }
 
-impl HuffmanItem {
-    fn new(value: u32, weight: u32) -> Self {
-        Self {
-            next: None,
-            prev: None,
-            decompressed_value: value,
-            weight,
-            parent: None,
-            child_lo: None,
-        }
-    }
-}
-
-/// Quick link structure for optimized decompression
-#[derive(Debug, Clone)]
-struct QuickLink {
-    valid_value: u32,
-    valid_bits: u32,
-    decompressed_value: u32,
-    item_index: Option<usize>,
-}
-
-impl QuickLink {
-    fn new() -> Self {
-        Self {
-            valid_value: 0,
-            valid_bits: 0,
-            decompressed_value: 0,
-            item_index: None,
-        }
-    }
+const EMPTY_ITEM: HuffmanItem = HuffmanItem {
+    next: NO_ITEM,
+    prev: NO_ITEM,
+    decompressed_value: 0,
+    weight: 0,
+    parent: NO_ITEM,
+    child_lo: NO_ITEM,
+};
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+enum InsertPoint {
+    After,
+    Before,
 }
 
-/// Huffman tree based on StormLib
+/// Huffman tree based on StormLib's THuffmannTree
+///
+/// The item list is circular through the head at index [`LIST_HEAD`], whose
+/// `next` is the highest-weight item and `prev` the lowest-weight one.
+#[derive(Clone)]
 struct HuffmanTree {
-    items: Vec<HuffmanItem>,
-    items_by_byte: [Option<usize>; 0x102],
-    quick_links: [QuickLink; LINK_ITEM_COUNT],
-    first: Option<usize>, // Pointer to the highest weight item
-    last: Option<usize>,  // Pointer to the lowest weight item
-    min_valid_value: u32,
+    items: [HuffmanItem; HUFF_ITEM_COUNT + 1],
+    items_used: usize,
+    items_by_byte: [u16; 0x102],
+    /// Bumped whenever the tree's shape, and so some code, changes
+    generation: u32,
 }
 
-// Virtual list head marker
-const LIST_HEAD: Option<usize> = None;
-
 impl HuffmanTree {
-    fn new() -> Self {
-        Self {
-            items: Vec::with_capacity(HUFF_ITEM_COUNT),
-            items_by_byte: [None; 0x102],
-            quick_links: std::array::from_fn(|_| QuickLink::new()),
-            first: LIST_HEAD,
-            last: LIST_HEAD,
-            min_valid_value: 1,
-        }
-    }
-
-    // Link two items in the linked list
-    fn link_two_items(&mut self, item1_idx: usize, item2_idx: usize) {
-        // pItem2->pNext = pItem1->pNext;
-        self.items[item2_idx].next = self.items[item1_idx].next;
+    /// Build the initial tree for a weight table
+    fn build(weight_table: &[u8; 258]) -> Result<Self> {
+        let mut items = [EMPTY_ITEM; HUFF_ITEM_COUNT + 1];
+        items[LIST_HEAD as usize].next = LIST_HEAD;
+        items[LIST_HEAD as usize].prev = LIST_HEAD;
+        let mut tree = Self {
+            items,
+            items_used: 0,
+            items_by_byte: [NO_ITEM; 0x102],
+            generation: 0,
+        };
 
-        // pItem2->pPrev = pItem1->pNext->pPrev;
-        if let Some(next_idx) = self.items[item1_idx].next {
-            self.items[item2_idx].prev = self.items[next_idx].prev;
-            // pItem1->pNext->pPrev = pItem2;
-            self.items[next_idx].prev = Some(item2_idx);
-        } else {
-            // item1 was the last item
-            self.items[item2_idx].prev = Some(item1_idx);
+        // Build the linear list of entries that is sorted by byte weight
+        let mut max_weight = 0;
+        for (i, &weight) in weight_table.iter().enumerate().take(0x100) {
+            if weight != 0 {
+                let item = tree.create_new_item(i as u16, weight as u32, InsertPoint::After)?;
+                tree.items_by_byte[i] = item;
+                max_weight = tree.fixup_item_pos_by_weight(item, max_weight);
+            }
         }
 
-        // pItem1->pNext = pItem2;
-        self.items[item1_idx].next = Some(item2_idx);
-    }
-
-    // Insert item after a given position
-    fn insert_after(&mut self, new_item_idx: usize, after_idx: Option<usize>) {
-        if let Some(idx) = after_idx {
-            self.link_two_items(idx, new_item_idx);
-        } else {
-            // Insert at the beginning of the list
-            self.items[new_item_idx].prev = None;
-            self.items[new_item_idx].next = self.first;
+        // Insert termination entries at the end of the list
+        tree.items_by_byte[0x100] = tree.create_new_item(0x100, 1, InsertPoint::Before)?;
+        tree.items_by_byte[0x101] = tree.create_new_item(0x101, 1, InsertPoint::Before)?;
 
-            if let Some(first_idx) = self.first {
-                self.items[first_idx].prev = Some(new_item_idx);
+        // Pair items from the lowest weight up; each parent is sorted back
+        // into the list and the pairing continues past its children
+        let mut child_lo = tree.last();
+        while child_lo != LIST_HEAD {
+            let child_hi = tree.items[child_lo as usize].prev;
+            if child_hi == LIST_HEAD {
+                break;
             }
 
-            self.first = Some(new_item_idx);
+            let weight =
+                tree.items[child_hi as usize].weight + tree.items[child_lo as usize].weight;
+            let parent = tree.create_new_item(0, weight, InsertPoint::After)?;
+            tree.items[child_lo as usize].parent = parent;
+            tree.items[child_hi as usize].parent = parent;
+            tree.items[parent as usize].child_lo = child_lo;
 
-            if self.last.is_none() {
-                self.last = Some(new_item_idx);
-            }
+            max_weight = tree.fixup_item_pos_by_weight(parent, max_weight);
+            child_lo = tree.items[child_hi as usize].prev;
         }
-    }
-
-    // Insert item before a given position
-    fn insert_before(&mut self, new_item_idx: usize, before_idx: Option<usize>) {
-        if let Some(idx) = before_idx {
-            // Get the previous item
-            let prev_idx = self.items[idx].prev;
-
-            self.items[new_item_idx].next = Some(idx);
-            self.items[new_item_idx].prev = prev_idx;
-            self.items[idx].prev = Some(new_item_idx);
-
-            if let Some(prev) = prev_idx {
-                self.items[prev].next = Some(new_item_idx);
-            } else {
-                // This was the first item
-                self.first = Some(new_item_idx);
-            }
-        } else {
-            // Insert at the end of the list
-            self.items[new_item_idx].next = None;
-            self.items[new_item_idx].prev = self.last;
 
-            if let Some(last_idx) = self.last {
-                self.items[last_idx].next = Some(new_item_idx);
-            }
+        log::debug!("Built Huffman tree with {} items", tree.items_used);
+        Ok(tree)
+    }
 
-            self.last = Some(new_item_idx);
+    /// The highest-weight item, which is the root
+    fn first(&self) -> u16 {
+        self.items[LIST_HEAD as usize].next
+    }
 
-            if self.first.is_none() {
-                self.first = Some(new_item_idx);
-            }
-        }
+    /// The lowest-weight item
+    fn last(&self) -> u16 {
+        self.items[LIST_HEAD as usize].prev
     }
 
-    // Create a new item and add it to the list
-    fn create_new_item(
-        &mut self,
-        decompressed_value: u32,
-        weight: u32,
-        insert_after: bool,
-    ) -> usize {
-        let new_idx = self.items.len();
-        self.items
-            .push(HuffmanItem::new(decompressed_value, weight));
-
-        // For the initial list, just append to the end
-        // The fixup function will move it to the correct position
-        if self.first.is_none() {
-            self.first = Some(new_idx);
-            self.last = Some(new_idx);
-        } else if insert_after {
-            self.insert_after(new_idx, self.last);
-        } else {
-            self.insert_before(new_idx, self.first);
+    // Unlink an item from the list (but keep it in the pool)
+    fn remove_item(&mut self, item: u16) {
+        let HuffmanItem { next, prev, .. } = self.items[item as usize];
+        if next != NO_ITEM {
+            self.items[prev as usize].next = next;
+            self.items[next as usize].prev = prev;
+            self.items[item as usize].next = NO_ITEM;
+            self.items[item as usize].prev = NO_ITEM;
         }
-
-        new_idx
     }
 
-    // Find item with weight >= given weight
-    fn find_higher_or_equal_item(&self, start_idx: Option<usize>, weight: u32) -> Option<usize> {
-        let mut current = start_idx;
+    // Link item2 right after item1
+    fn link_two_items(&mut self, item1: u16, item2: u16) {
+        let next = self.items[item1 as usize].next;
+        self.items[item2 as usize].next = next;
+        self.items[item2 as usize].prev = self.items[next as usize].prev;
+        self.items[next as usize].prev = item2;
+        self.items[item1 as usize].next = item2;
+    }
 
-        while let Some(idx) = current {
-            if self.items[idx].weight >= weight {
-                return Some(idx);
+    fn insert_item(&mut self, item: u16, point: InsertPoint, at: u16) {
+        self.remove_item(item);
+        match point {
+            InsertPoint::After => self.link_two_items(at, item),
+            InsertPoint::Before => {
+                let prev = self.items[at as usize].prev;
+                self.items[item as usize].next = at;
+                self.items[item as usize].prev = prev;
+                self.items[prev as usize].next = item;
+                self.items[at as usize].prev = item;
             }
-            current = self.items[idx].prev;
         }
-
-        None
     }
 
-    // Fix item position by weight (insertion sort)
-    fn fixup_item_pos_by_weight(&mut self, item_idx: usize, mut max_weight: u32) -> u32 {
-        let item_weight = self.items[item_idx].weight;
-
-        // If this item's weight is less than max_weight, we need to move it
-        if item_weight < max_weight {
-            // Find the item with weight >= this item's weight, searching backwards from last
-            if let Some(higher_idx) = self.find_higher_or_equal_item(self.last, item_weight) {
-                // Remove item from its current position
-                self.remove_item_from_list(item_idx);
-
-                // Insert after the found item (LinkTwoItems behavior)
-                self.insert_after(item_idx, Some(higher_idx));
+    // Find an item with weight >= the given one, walking towards higher weights
+    fn find_higher_or_equal_item(&self, start: u16, weight: u32) -> u16 {
+        let mut current = start;
+        if current != NO_ITEM {
+            while current != LIST_HEAD {
+                if self.items[current as usize].weight >= weight {
+                    return current;
+                }
+                current = self.items[current as usize].prev;
             }
-        } else {
-            // This is the new maximum weight
-            max_weight = item_weight;
         }
 
-        max_weight
+        LIST_HEAD
     }
 
-    // Remove item from linked list (but keep in items array)
-    fn remove_item_from_list(&mut self, item_idx: usize) {
-        let prev = self.items[item_idx].prev;
-        let next = self.items[item_idx].next;
-
-        if let Some(prev_idx) = prev {
-            self.items[prev_idx].next = next;
-        } else {
-            // This was the first item
-            self.first = next;
+    // Take an item from the pool and put it at the top or the bottom of the list
+    fn create_new_item(&mut self, value: u16, weight: u32, point: InsertPoint) -> Result<u16> {
+        if self.items_used >= HUFF_ITEM_COUNT {
+            return Err(Error::compression("Huffman tree item pool exhausted"));
         }
+        let item = self.items_used as u16;
+        self.items_used += 1;
+
+        self.items[item as usize] = HuffmanItem {
+            decompressed_value: value,
+            weight,
+            ..EMPTY_ITEM
+        };
+        self.insert_item(item, point, LIST_HEAD);
+        Ok(item)
+    }
 
-        if let Some(next_idx) = next {
-            self.items[next_idx].prev = prev;
+    // Move a new item to its place in the list (insertion sort)
+    fn fixup_item_pos_by_weight(&mut self, item: u16, max_weight: u32) -> u32 {
+        let weight = self.items[item as usize].weight;
+        if weight < max_weight {
+            let higher = self.find_higher_or_equal_item(self.last(), weight);
+            self.remove_item(item);
+            self.link_two_items(higher, item);
+            max_weight
         } else {
-            // This was the last item
-            self.last = prev;
+            weight
         }
-
-        self.items[item_idx].prev = None;
-        self.items[item_idx].next = None;
     }
 
-    fn build_tree(&mut self, compression_type: u32) -> Result<()> {
-        // Clear all items
-        self.items.clear();
-        self.items_by_byte = [None; 0x102];
-        self.first = LIST_HEAD;
-        self.last = LIST_HEAD;
+    /// Increment the weights from `item` up to the root, swapping items that
+    /// overtake a higher-weight one
+    fn inc_weights_and_rebalance(&mut self, mut item: u16) -> Result<()> {
+        while item != NO_ITEM {
+            self.items[item as usize].weight += 1;
+            let weight = self.items[item as usize].weight;
+
+            // Find a previous item with greater or equal weight
+            let higher = self.find_higher_or_equal_item(self.items[item as usize].prev, weight);
+            let child_hi = self.items[higher as usize].next;
+
+            if child_hi != item {
+                // Swap the item with the first item of lower weight
+                self.remove_item(child_hi);
+                self.link_two_items(item, child_hi);
+                self.remove_item(item);
+                self.link_two_items(higher, item);
+
+                let item_parent = self.items[item as usize].parent;
+                let hi_parent = self.items[child_hi as usize].parent;
+                if item_parent == NO_ITEM || hi_parent == NO_ITEM {
+                    return Err(Error::compression("Corrupt Huffman tree"));
+                }
 
-        // Ensure compression type is valid
-        let comp_type = (compression_type & 0x0F) as usize;
-        if comp_type >= WEIGHT_TABLES.len() {
-            return Err(Error::compression("Invalid Huffman compression type"));
-        }
+                // Keep child_lo pointing at the lower-weight child
+                let hi_parent_child_lo = self.items[hi_parent as usize].child_lo;
+                if self.items[item_parent as usize].child_lo == item {
+                    self.items[item_parent as usize].child_lo = child_hi;
+                }
+                if hi_parent_child_lo == child_hi {
+                    self.items[hi_parent as usize].child_lo = item;
+                }
 
-        let weight_table = WEIGHT_TABLES[comp_type];
+                // Swap the parents of the items
+                self.items[item as usize].parent = hi_parent;
+                self.items[child_hi as usize].parent = item_parent;
 
-        // Build the linear list of entries that is sorted by byte weight
-        // First pass: create all items
-        for (i, &weight) in weight_table.iter().enumerate().take(0x100) {
-            if weight != 0 {
-                let item_idx = self.create_new_item(i as u32, weight as u32, true);
-                self.items_by_byte[i] = Some(item_idx);
+                self.generation += 1;
             }
-        }
-
-        // Insert termination entries
-        let end_idx = self.create_new_item(0x100, 1, true);
-        self.items_by_byte[0x100] = Some(end_idx);
 
-        let eof_idx = self.create_new_item(0x101, 1, true);
-        self.items_by_byte[0x101] = Some(eof_idx);
-
-        // Now sort the entire list by weight using insertion sort
-        // Build a temporary sorted list
-        let mut sorted_items: Vec<(usize, u32)> = Vec::new();
-        let mut curr = self.first;
-        while let Some(idx) = curr {
-            sorted_items.push((idx, self.items[idx].weight));
-            curr = self.items[idx].next;
+            item = self.items[item as usize].parent;
         }
+        Ok(())
+    }
 
-        // Sort by weight (DESCENDING - highest weight first)
-        // This matches StormLib's organization where pLast points to lowest weight
-        sorted_items.sort_by_key(|&(_, weight)| std::cmp::Reverse(weight));
+    /// Split the lowest-weight leaf into itself and a new leaf for `value`
+    fn insert_new_branch_and_rebalance(&mut self, value: u16) -> Result<()> {
+        let last = self.last();
+        let last_value = self.items[last as usize].decompressed_value;
+        let last_weight = self.items[last as usize].weight;
 
-        // Rebuild the linked list in sorted order
-        self.first = None;
-        self.last = None;
+        let child_hi = self.create_new_item(last_value, last_weight, InsertPoint::Before)?;
+        self.items[child_hi as usize].parent = last;
+        self.items_by_byte[last_value as usize] = child_hi;
 
-        for &(idx, _) in &sorted_items {
-            // Clear existing links
-            self.items[idx].prev = None;
-            self.items[idx].next = None;
+        let child_lo = self.create_new_item(value, 0, InsertPoint::Before)?;
+        self.items[child_lo as usize].parent = last;
+        self.items[last as usize].child_lo = child_lo;
+        self.items_by_byte[value as usize] = child_lo;
 
-            // Add to the end of the new list
-            if self.first.is_none() {
-                self.first = Some(idx);
-                self.last = Some(idx);
-            } else {
-                self.items[idx].prev = self.last;
-                if let Some(last_idx) = self.last {
-                    self.items[last_idx].next = Some(idx);
-                }
-                self.last = Some(idx);
-            }
-        }
+        self.generation += 1;
+        self.inc_weights_and_rebalance(child_lo)
+    }
 
-        log::debug!("Built initial list with {} leaf nodes", self.items.len());
-
-        // Debug: Print the linked list order
-        if log::log_enabled!(log::Level::Trace) {
-            log::trace!("Initial linked list (first -> last):");
-            let mut curr = self.first;
-            let mut count = 0;
-            while let Some(idx) = curr {
-                if count < 5 || count >= self.items.len() - 5 {
-                    log::trace!(
-                        "  [{}] idx={}, value=0x{:02X}, weight={}",
-                        count,
-                        idx,
-                        self.items[idx].decompressed_value,
-                        self.items[idx].weight
-                    );
-                } else if count == 5 {
-                    log::trace!("  ...");
-                }
-                curr = self.items[idx].next;
-                count += 1;
+    /// Step down the tree from `start` a bit at a time until reaching a leaf
+    ///
+    /// Returns the leaf's value, the bits read and the item reached after
+    /// [`LINK_BITS`] bits ([`NO_ITEM`] if the code was shorter).
+    fn walk(&self, start: u16, reader: &mut BitReader<'_>) -> Result<(u16, u32, u16)> {
+        let mut item = start;
+        let mut bits = 0;
+        let mut link_item = NO_ITEM;
+        loop {
+            if item == LIST_HEAD {
+                return Err(Error::compression("Invalid Huffman tree traversal"));
             }
-        }
-
-        // Now we need to build the tree
-        // IMPORTANT: After reviewing StormLib more carefully:
-        // - The list is sorted DESCENDING (highest weight first, lowest weight last)
-        // - pLast points to the LOWEST weight node
-        // - We start from pLast and use pPrev to go towards higher weights
-        // - This way we pair the lowest weight nodes first (correct for Huffman)
-        let mut child_lo = self.last;
-        let mut internal_nodes = 0;
-        // Max weight is at the beginning of the list (descending order)
-        let mut max_weight = if let Some(first_idx) = self.first {
-            self.items[first_idx].weight
-        } else {
-            0
-        };
-
-        // Work as long as both children are valid
-        while let Some(lo_idx) = child_lo {
-            // Get the previous child (pPrev points to higher weight in descending list)
-            let child_hi = self.items[lo_idx].prev;
-            if child_hi.is_none() {
-                log::debug!(
-                    "Tree building stopped: no more pairs (created {internal_nodes} internal nodes)"
-                );
-                break; // Can't create a parent with only one child
+            let current = &self.items[item as usize];
+            if current.child_lo == NO_ITEM {
+                return Ok((current.decompressed_value, bits, link_item));
             }
-            let hi_idx = child_hi.unwrap();
-
-            log::trace!(
-                "Building parent for children: lo={} (w={}), hi={} (w={})",
-                lo_idx,
-                self.items[lo_idx].weight,
-                hi_idx,
-                self.items[hi_idx].weight
-            );
-
-            // Create new parent item for the children
-            let parent_weight = self.items[hi_idx].weight + self.items[lo_idx].weight;
-            let parent_idx = self.create_new_item(0xFFFFFFFFu32, parent_weight, true);
-            internal_nodes += 1;
 
-            // Link both child items to their new parent
-            self.items[lo_idx].parent = Some(parent_idx);
-            self.items[hi_idx].parent = Some(parent_idx);
-            self.items[parent_idx].child_lo = Some(lo_idx);
-
-            // IMPORTANT: Save the next child BEFORE fixup
-            // In StormLib: pChildLo = pChildHi->pPrev
-            let next_child = self.items[hi_idx].prev;
+            // Bit 1 selects the higher-weight child, child_lo's prev
+            item = if reader.get_bit()? != 0 {
+                self.items[current.child_lo as usize].prev
+            } else {
+                current.child_lo
+            };
+            bits += 1;
+            if bits == LINK_BITS {
+                link_item = item;
+            }
+        }
+    }
+}
 
-            // Fixup the item's position by its weight
-            max_weight = self.fixup_item_pos_by_weight(parent_idx, max_weight);
+/// What a lookup table entry resolves to
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default)]
+enum EntryKind {
+    /// Not resolvable from the table; walk the tree from the root
+    #[default]
+    Walk,
+    /// One or two literal bytes
+    Bytes,
+    /// A marker symbol stored in `target`
+    Symbol,
+    /// A code longer than the table; continue from tree item `target`
+    Subtree,
+}
 
-            // Continue from where we left off
-            // In StormLib, they just continue with pChildHi->pPrev
-            // The paired nodes are effectively out of consideration because they have parents
-            child_lo = next_child;
+#[derive(Debug, Clone, Copy, Default)]
+struct TableEntry {
+    kind: EntryKind,
+    /// Literal bytes, valid for `Bytes`
+    bytes: [u8; 2],
+    /// Number of bytes in `bytes`
+    count: u8,
+    /// Bits consumed by the whole entry
+    bits: u8,
+    /// Bits consumed by the first byte alone
+    first_bits: u8,
+    target: u16,
+}
 
-            log::trace!("Next iteration will start from: {child_lo:?}");
-        }
+/// The initial tree of one compression type and its lookup table
+struct InitialTree {
+    tree: HuffmanTree,
+    table: Box<[TableEntry]>,
+}
 
-        log::debug!(
-            "Tree building complete: {} total items ({} leaf + {} internal)",
-            self.items.len(),
-            self.items.len() - internal_nodes,
-            internal_nodes
-        );
+/// Initial trees by compression type, built on first use
+static INITIAL_TREES: [OnceLock<Result<InitialTree>>; WEIGHT_TABLES.len()] =
+    [const { OnceLock::new() }; WEIGHT_TABLES.len()];
 
-        // Initialize the MinValidValue to 1, which invalidates all quick-link items
-        self.min_valid_value = 1;
-        Ok(())
+impl InitialTree {
+    /// Get the shared initial tree for `compression_type`
+    fn for_type(compression_type: u32) -> Result<&'static InitialTree> {
+        let comp_type = (compression_type & 0x0F) as usize;
+        let slot = INITIAL_TREES
+            .get(comp_type)
+            .ok_or_else(|| Error::compression("Invalid Huffman compression type"))?;
+        slot.get_or_init(|| InitialTree::new(WEIGHT_TABLES[comp_type]))
+            .as_ref()
+            .map_err(|e| Error::compression(e.to_string()))
     }
 
-    fn decode_one_byte(&mut self, reader: &mut BitReader<'_>) -> Result<u32> {
-        // Try quick links first
-        let item_link_index = reader.peek_7_bits().unwrap_or(0) as usize;
-        let has_item_link = item_link_index < LINK_ITEM_COUNT;
+    fn new(weight_table: &[u8; 258]) -> Result<Self> {
+        let tree = HuffmanTree::build(weight_table)?;
+        let mut table = vec![TableEntry::default(); TABLE_SIZE].into_boxed_slice();
+        Self::fill(&tree, &mut table, tree.first(), 0, 0);
+        Self::pair_bytes(&mut table);
+        Ok(Self { tree, table })
+    }
 
-        // Check if quick link is valid
-        let mut item_idx = if has_item_link
-            && self.quick_links[item_link_index].valid_value >= self.min_valid_value
-        {
-            // If that item needs less than 7 bits, we can get decompressed value directly
-            if self.quick_links[item_link_index].valid_bits <= 7 {
-                reader.skip_bits(self.quick_links[item_link_index].valid_bits);
-                return Ok(self.quick_links[item_link_index].decompressed_value);
+    /// Fill the entries for every code passing through `item`, which is
+    /// reached by the `depth` low bits of `code`
+    fn fill(tree: &HuffmanTree, table: &mut [TableEntry], item: u16, code: usize, depth: u32) {
+        if item == LIST_HEAD {
+            // Broken tree; leave `Walk` entries, which report it when reached
+            return;
+        }
+        let current = &tree.items[item as usize];
+        let entry = match current.child_lo {
+            NO_ITEM if current.decompressed_value <= 0xFF => TableEntry {
+                kind: EntryKind::Bytes,
+                bytes: [current.decompressed_value as u8, 0],
+                count: 1,
+                bits: depth as u8,
+                first_bits: depth as u8,
+                target: 0,
+            },
+            NO_ITEM => TableEntry {
+                kind: EntryKind::Symbol,
+                bits: depth as u8,
+                target: current.decompressed_value,
+                ..TableEntry::default()
+            },
+            _ if depth == TABLE_BITS => TableEntry {
+                kind: EntryKind::Subtree,
+                bits: depth as u8,
+                target: item,
+                ..TableEntry::default()
+            },
+            child_lo => {
+                let child_hi = tree.items[child_lo as usize].prev;
+                Self::fill(tree, table, child_lo, code, depth + 1);
+                Self::fill(tree, table, child_hi, code | (1 << depth), depth + 1);
+                return;
             }
-
-            // Otherwise skip 7 bits and use the stored item
-            reader.skip_bits(7);
-            self.quick_links[item_link_index].item_index
-        } else {
-            // Start from the root (first item)
-            self.first
         };
 
-        // Check if we have a valid starting point
-        if item_idx.is_none() {
-            return Err(Error::compression("Empty Huffman tree"));
+        // Every index whose low `depth` bits equal `code`
+        for slot in table.iter_mut().skip(code).step_by(1 << depth) {
+            *slot = entry;
         }
+    }
 
-        let mut item_link: Option<usize> = None;
-        let mut bit_count = 0;
-
-        // Step down the tree until we find a terminal item
-        while let Some(idx) = item_idx {
-            let item = &self.items[idx];
-
-            // If this is a leaf node (no children), we found our value
-            if item.child_lo.is_none() {
-                break;
+    /// Merge entries whose remaining bits fully determine a second byte
+    fn pair_bytes(table: &mut [TableEntry]) {
+        let singles = table.to_vec();
+        for (index, entry) in table.iter_mut().enumerate() {
+            if entry.kind != EntryKind::Bytes || u32::from(entry.bits) >= TABLE_BITS {
+                continue;
             }
-
-            // Get next bit to decide which child to traverse
-            let bit_value = reader.get_bit()?;
-            bit_count += 1;
-
-            // In StormLib:
-            // If bit is 1: go to pItem->pChildLo->pPrev (higher weight child)
-            // If bit is 0: go to pItem->pChildLo (lower weight child)
-            let child_lo_idx = item.child_lo.unwrap();
-            item_idx = if bit_value != 0 {
-                // Get the previous sibling of child_lo (higher weight)
-                self.items[child_lo_idx].prev
-            } else {
-                // Get child_lo directly (lower weight)
-                Some(child_lo_idx)
-            };
-
-            // Remember item for quick link at depth 7
-            if bit_count == 7 {
-                item_link = item_idx;
+            let next = singles[index >> entry.bits];
+            if next.kind == EntryKind::Bytes && u32::from(entry.bits + next.bits) <= TABLE_BITS {
+                entry.bytes[1] = next.bytes[0];
+                entry.count = 2;
+                entry.bits += next.bits;
             }
         }
+    }
+}
 
-        // We should have a valid item now
-        let final_idx =
-            item_idx.ok_or_else(|| Error::compression("Invalid Huffman tree traversal"))?;
-        let decompressed_value = self.items[final_idx].decompressed_value;
-
-        // Update quick link if needed
-        if has_item_link && self.quick_links[item_link_index].valid_value < self.min_valid_value {
-            if bit_count > 7 {
-                // Store pointer to tree item for faster access
-                self.quick_links[item_link_index].valid_value = self.min_valid_value;
-                self.quick_links[item_link_index].valid_bits = bit_count;
-                self.quick_links[item_link_index].item_index = item_link;
-            } else if bit_count > 0 {
-                // Store decompressed value directly
-                let mut index = item_link_index;
-                if bit_count < 7 {
-                    index &= (0xFFFFFFFFu32 >> (32 - bit_count)) as usize;
-                }
+/// Quick link based on StormLib's TQuickLink
+#[derive(Debug, Clone, Copy, Default)]
+struct QuickLink {
+    /// Tree generation the link was made for; 0 is never current
+    generation: u32,
+    /// Bits of the code, or more than [`LINK_BITS`] for a partial link
+    bits: u32,
+    /// The decoded value, or the item reached after [`LINK_BITS`] bits
+    target: u16,
+}
 
-                while index < LINK_ITEM_COUNT {
-                    self.quick_links[index].valid_value = self.min_valid_value;
-                    self.quick_links[index].valid_bits = bit_count;
-                    self.quick_links[index].decompressed_value = decompressed_value;
-                    index += 1 << bit_count;
-                }
-            }
+/// Decode one value from a tree that has been reshaped
+fn decode_with_links(
+    tree: &HuffmanTree,
+    links: &mut [QuickLink; LINK_ITEM_COUNT],
+    reader: &mut BitReader<'_>,
+) -> Result<u16> {
+    reader.refill();
+    if reader.bit_count < LINK_BITS {
+        return Ok(tree.walk(tree.first(), reader)?.0);
+    }
+
+    // Generations start at 1 once the tree has changed
+    let index = reader.peek(LINK_BITS);
+    let link = links[index];
+    if link.generation == tree.generation {
+        if link.bits <= LINK_BITS {
+            reader.consume(link.bits);
+            return Ok(link.target);
         }
+        reader.consume(LINK_BITS);
+        return Ok(tree.walk(link.target, reader)?.0);
+    }
 
-        Ok(decompressed_value)
+    let (value, bits, link_item) = tree.walk(tree.first(), reader)?;
+    if bits > LINK_BITS {
+        links[index] = QuickLink {
+            generation: tree.generation,
+            bits,
+            target: link_item,
+        };
+    } else if bits > 0 {
+        // Every index sharing the code's low bits decodes to the same value
+        let link = QuickLink {
+            generation: tree.generation,
+            bits,
+            target: value,
+        };
+        let code = index & ((1 << bits) - 1);
+        for slot in links.iter_mut().skip(code).step_by(1 << bits) {
+            *slot = link;
+        }
     }
+    Ok(value)
 }
 
 /// Huffman decompression function following StormLib's algorithm
@@ -779,57 +766,77 @@ pub(crate) fn decompress(data: &[u8], expected_size: usize) -> Result<Vec<u8>> {
     );
 
     let mut reader = BitReader::new(data);
-    let mut output = Vec::with_capacity(expected_size);
+    let mut output = buffer_pool::global().take(expected_size);
 
     // Get compression type from the first byte
     let compression_type = reader.get_8_bits()?;
-
     log::debug!("Huffman compression type: 0x{compression_type:02X}");
 
-    // Build Huffman tree
-    let mut tree = HuffmanTree::new();
-    tree.build_tree(compression_type)?;
-
-    log::debug!("Huffman tree built with {} items", tree.items.len());
-
-    // Decompress data
-    let mut decoded_count = 0;
-    loop {
-        let decoded_value = tree.decode_one_byte(&mut reader)?;
-        decoded_count += 1;
-
-        log::trace!("Huffman decoded byte {decoded_count}: value=0x{decoded_value:03X}");
-
-        // Check for end of stream marker
-        if decoded_value == 0x100 {
-            log::debug!("Huffman hit end marker after {decoded_count} symbols");
-            break;
-        }
-
-        // Check for error
-        if decoded_value == HUFF_DECOMPRESS_ERROR {
-            return Err(Error::compression("Huffman decompression error"));
-        }
-
-        // Handle tree modification marker
-        if decoded_value == 0x101 {
-            // Read the next byte directly
-            let next_byte = reader.get_8_bits()?;
-            output.push(next_byte as u8);
-            // Tree modification would happen here in full implementation
-            continue;
-        }
-
-        // Regular data byte
-        if decoded_value > 255 {
-            return Err(Error::compression("Invalid Huffman decoded value"));
-        }
-
-        output.push(decoded_value as u8);
+    // Type 0 adjusts weights after every byte; the others only on escapes
+    let is_cmp0 = compression_type == 0;
+    let initial = InitialTree::for_type(compression_type)?;
+    let mut tree = Cow::Borrowed(&initial.tree);
+    let mut links = [QuickLink::default(); LINK_ITEM_COUNT];
+
+    while output.len() < expected_size {
+        let decoded_value = if tree.generation == 0 {
+            // Still the initial tree, so its table applies
+            reader.refill();
+            let entry = initial.table[reader.peek(TABLE_BITS)];
+            let available = reader.bit_count;
+            match entry.kind {
+                EntryKind::Bytes => {
+                    // Decoding a byte leaves the tree alone unless it is type 0
+                    if !is_cmp0
+                        && entry.count == 2
+                        && u32::from(entry.bits) <= available
+                        && output.len() + 2 <= expected_size
+                    {
+                        reader.consume(u32::from(entry.bits));
+                        output.extend_from_slice(&entry.bytes);
+                        continue;
+                    }
+                    if u32::from(entry.first_bits) > available {
+                        return Err(Error::compression("Unexpected end of Huffman data"));
+                    }
+                    reader.consume(u32::from(entry.first_bits));
+                    u16::from(entry.bytes[0])
+                }
+                EntryKind::Symbol if u32::from(entry.bits) <= available => {
+                    reader.consume(u32::from(entry.bits));
+                    entry.target
+                }
+                EntryKind::Subtree if TABLE_BITS <= available => {
+                    reader.consume(TABLE_BITS);
+                    tree.walk(entry.target, &mut reader)?.0
+                }
+                // Too close to the end of the input for a table lookup
+                _ => tree.walk(tree.first(), &mut reader)?.0,
+            }
+        } else {
+            decode_with_links(&tree, &mut links, &mut reader)?
+        };
 
-        // Stop if we've reached expected size
-        if output.len() >= expected_size {
-            break;
+        match decoded_value {
+            SYMBOL_END => {
+                log::debug!("Huffman hit end marker after {} bytes", output.len());
+                break;
+            }
+            SYMBOL_ESCAPE => {
+                // A byte the tree has no item for yet
+                let value = reader.get_8_bits()? as u16;
+                let tree = tree.to_mut();
+                tree.insert_new_branch_and_rebalance(value)?;
+                tree.inc_weights_and_rebalance(tree.items_by_byte[value as usize])?;
+                output.push(value as u8);
+            }
+            value => {
+                output.push(value as u8);
+                if is_cmp0 {
+                    let tree = tree.to_mut();
+                    tree.inc_weights_and_rebalance(tree.items_by_byte[value as usize])?;
+                }
+            }
         }
     }
 
@@ -874,4 +881,198 @@ mod tests {
         assert_eq!(reader.get_bit().unwrap(), 0); // bit 6
         assert_eq!(reader.get_bit().unwrap(), 1); // bit 7
     }
+
+    /// LSB-first bit writer
+    #[derive(Default)]
+    struct BitWriter {
+        output: Vec<u8>,
+        buffer: u64,
+        count: u32,
+    }
+
+    impl BitWriter {
+        fn put_bits(&mut self, bits: u64, count: u32) {
+            self.buffer |= bits << self.count;
+            self.count += count;
+            while self.count >= 8 {
+                self.output.push(self.buffer as u8);
+                self.buffer >>= 8;
+                self.count -= 8;
+            }
+        }
+
+        fn finish(mut self) -> Vec<u8> {
+            if self.count > 0 {
+                self.output.push(self.buffer as u8);
+            }
+            self.output
+        }
+    }
+
+    // StormLib's EncodeOneByte: the path from the root to `item`
+    fn encode_one_byte(tree: &HuffmanTree, writer: &mut BitWriter, mut item: u16) {
+        let (mut bits, mut count) = (0u64, 0);
+        let mut parent = tree.items[item as usize].parent;
+        while parent != NO_ITEM {
+            let bit = u64::from(tree.items[parent as usize].child_lo != item);
+            bits = (bits << 1) | bit;
+            count += 1;
+            item = parent;
+            parent = tree.items[parent as usize].parent;
+        }
+        writer.put_bits(bits, count);
+    }
+
+    /// StormLib's THuffmannTree::Compress, which the library does not ship
+    fn compress_like_stormlib(data: &[u8], compression_type: u8) -> Vec<u8> {
+        let is_cmp0 = compression_type == 0;
+        let mut tree = HuffmanTree::build(WEIGHT_TABLES[compression_type as usize]).unwrap();
+        let mut writer = BitWriter::default();
+        writer.put_bits(u64::from(compression_type), 8);
+
+        for &byte in data {
+            let item = tree.items_by_byte[byte as usize];
+            if item == NO_ITEM {
+                encode_one_byte(&tree, &mut writer, tree.items_by_byte[0x101]);
+                writer.put_bits(u64::from(byte), 8);
+                tree.insert_new_branch_and_rebalance(u16::from(byte))
+                    .unwrap();
+                let item = tree.items_by_byte[byte as usize];
+                tree.inc_weights_and_rebalance(item).unwrap();
+                continue;
+            }
+            encode_one_byte(&tree, &mut writer, item);
+            if is_cmp0 {
+                tree.inc_weights_and_rebalance(item).unwrap();
+            }
+        }
+
+        encode_one_byte(&tree, &mut writer, tree.items_by_byte[0x100]);
+        writer.finish()
+    }
+
+    fn pseudo_random_text(len: usize, seed: u32) -> Vec<u8> {
+        let words: [&[u8]; 6] = [
+            b"the ",
+            b"quick ",
+            b"huffman ",
+            b"tree\n",
+            b"MPQ ",
+            b"\x00\xff",
+        ];
+        let mut state = seed;
+        let mut data = Vec::with_capacity(len);
+        while data.len() < len {
+            state = state.wrapping_mul(1_103_515_245).wrapping_add(12_345);
+            if state >> 28 == 0 {
+                // Occasionally a byte the weight tables may not know
+                data.push((state >> 16) as u8);
+            } else {
+                data.extend_from_slice(words[(state >> 16) as usize % words.len()]);
+            }
+        }
+        data.truncate(len);
+        data
+    }
+
+    #[test]
+    fn test_round_trip_all_compression_types() {
+        for compression_type in 0..9u8 {
+            let data = pseudo_random_text(6000, u32::from(compression_type) + 1);
+            let compressed = compress_like_stormlib(&data, compression_type);
+
+            let decoded = decompress(&compressed, data.len()).unwrap();
+            assert_eq!(decoded, data, "compression type {compression_type}");
+
+            // The end marker stops decoding before a generous size limit
+            let decoded = decompress(&compressed, data.len() + 100).unwrap();
+            assert_eq!(decoded, data, "compression type {compression_type}");
+
+            // Stopping at the expected size must not overshoot with a pair
+            let decoded = decompress(&compressed, 4999).unwrap();
+            assert_eq!(decoded, data[..4999]);
+        }
+    }
+
+    /// Triangle wave as 16-bit little-endian PCM, like an uncompressed WAVE body
+    fn pcm_triangle(len: usize) -> Vec<u8> {
+        let (mut sample, mut step) = (0i16, 300i16);
+        let mut data = Vec::with_capacity(len);
+        while data.len() < len {
+            sample += step;
+            if !(-8000..=8000).contains(&sample) {
+                step = -step;
+            }
+            data.extend_from_slice(&sample.to_le_bytes());
+        }
+        data.truncate(len);
+        data
+    }
+
+    // StormLib is not linked into the test suite. These streams come from a
+    // line-by-line transliteration of its huff.cpp (THuffmannTree::Compress,
+    // 32-bit bit buffers included) and pin both the decoder and
+    // `compress_like_stormlib` to that output.
+    const FIXED_AAAA_BBBB: [u8; 11] = [
+        0x00, 0x08, 0x12, 0xE8, 0x3F, 0xCC, 0x42, 0x84, 0xB4, 0xFF, 0x06,
+    ];
+    const FIXED_TEXT: [u8; 32] = [
+        0x02, 0xB1, 0x43, 0x5A, 0x7A, 0xB8, 0xC0, 0x43, 0x59, 0xED, 0xD3, 0xB7, 0xAF, 0x5F, 0xDE,
+        0x52, 0x42, 0x9E, 0x9B, 0x7E, 0x42, 0x36, 0x71, 0x48, 0xE1, 0x2D, 0xAD, 0xEE, 0xF8, 0x9F,
+        0xE5, 0x02,
+    ];
+    const FIXED_HEADER: [u8; 14] = [
+        0x08, 0x71, 0x5A, 0xB1, 0xA6, 0x69, 0x9A, 0xA8, 0xFC, 0xC7, 0xB7, 0x7F, 0x5E, 0x07,
+    ];
+    const FIXED_PCM: [u8; 102] = [
+        0x00, 0x60, 0xF1, 0x00, 0xC2, 0xF2, 0x02, 0x8B, 0xB0, 0x0F, 0x24, 0xD8, 0x9F, 0x40, 0x71,
+        0xF3, 0x02, 0x84, 0xD0, 0x1F, 0x5C, 0x34, 0x6F, 0x07, 0x9B, 0x12, 0x7A, 0xC6, 0x4A, 0x21,
+        0xC7, 0x8D, 0x16, 0x7C, 0x72, 0x8B, 0x41, 0x87, 0x90, 0x1C, 0x78, 0x1E, 0xEA, 0x01, 0x47,
+        0x13, 0x10, 0xE5, 0x3F, 0xE2, 0x05, 0x7C, 0x97, 0x38, 0xB1, 0xEF, 0x27, 0x56, 0x18, 0xF3,
+        0x8A, 0x11, 0x51, 0xDF, 0xA2, 0x05, 0x57, 0xBF, 0x28, 0x71, 0x4E, 0x79, 0xE4, 0x54, 0x46,
+        0x9C, 0x3E, 0xA4, 0xE1, 0x07, 0x71, 0x71, 0xD8, 0x99, 0x4C, 0x1D, 0x7A, 0x3C, 0x95, 0x87,
+        0x9C, 0x54, 0xF4, 0xA1, 0x48, 0x86, 0xE6, 0x58, 0x81, 0x97, 0x44, 0x3C,
+    ];
+
+    #[test]
+    fn test_fixed_vectors() {
+        let vectors: [(u8, Vec<u8>, &[u8]); 4] = [
+            (0, b"AAAAAAAAAAAAAAAABBBBBBBB".to_vec(), &FIXED_AAAA_BBBB),
+            (
+                2,
+                b"The quick brown fox jumps over the lazy dog".to_vec(),
+                &FIXED_TEXT,
+            ),
+            (
+                8,
+                b"MPQ\x1a\x00\x00\x00\x00\xff\xfe".to_vec(),
+                &FIXED_HEADER,
+            ),
+            (0, pcm_triangle(64), &FIXED_PCM),
+        ];
+        for (compression_type, data, compressed) in vectors {
+            assert_eq!(
+                decompress(compressed, data.len()).unwrap(),
+                data,
+                "compression type {compression_type}"
+            );
+            assert_eq!(
+                compress_like_stormlib(&data, compression_type),
+                compressed,
+                "compression type {compression_type}"
+            );
+        }
+    }
+
+    #[test]
+    fn test_truncated_input_is_an_error() {
+        let data = pseudo_random_text(4000, 7);
+        let compressed = compress_like_stormlib(&data, 2);
+        assert!(decompress(&compressed[..compressed.len() / 2], data.len()).is_err());
+    }
+
+    #[test]
+    fn test_invalid_compression_type() {
+        assert!(decompress(&[0x0F, 0x00], 16).is_err());
+    }
 }
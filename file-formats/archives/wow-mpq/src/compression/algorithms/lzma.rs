@@ -1,6 +1,7 @@
 //! LZMA compression and decompression
 
 use crate::Result;
+use crate::buffer_pool;
 use crate::compression::error_helpers::{compression_error, decompression_error};
 use std::io::{BufReader, Cursor};
 
@@ -32,7 +33,7 @@ pub(crate) fn decompress(data: &[u8], expected_size: usize) -> Result<Vec<u8>> {
         let standard_lzma = &data[1..];
         let cursor = Cursor::new(standard_lzma);
         let mut input = BufReader::new(cursor);
-        let mut output = Vec::with_capacity(expected_size);
+        let mut output = buffer_pool::global().take(expected_size);
 
         match lzma_rs::lzma_decompress(&mut input, &mut output) {
             Ok(()) => {
@@ -55,7 +56,7 @@ pub(crate) fn decompress(data: &[u8], expected_size: usize) -> Result<Vec<u8>> {
     // Try standard LZMA format (data starts with props directly)
     let cursor = Cursor::new(data);
     let mut input = BufReader::new(cursor);
-    let mut output = Vec::with_capacity(expected_size);
+    let mut output = buffer_pool::global().take(expected_size);
 
     match lzma_rs::lzma_decompress(&mut input, &mut output) {
         Ok(()) => {
@@ -72,7 +73,7 @@ pub(crate) fn decompress(data: &[u8], expected_size: usize) -> Result<Vec<u8>> {
             // If LZMA fails, try XZ format
             let cursor = Cursor::new(data);
             let mut input = BufReader::new(cursor);
-            let mut output = Vec::with_capacity(expected_size);
+            let mut output = buffer_pool::global().take(expected_size);
 
             match lzma_rs::xz_decompress(&mut input, &mut output) {
                 Ok(()) => Ok(output),
@@ -1,6 +1,7 @@
 //! PKWare compression implementation using implode crate for MPQ archives
 
 use crate::Result;
+use crate::buffer_pool;
 use crate::compression::error_helpers::{compression_error, decompression_error};
 use implode::exploder::Exploder;
 use implode::symbol::DEFAULT_CODE_TABLE;
@@ -36,7 +37,7 @@ pub(crate) fn decompress(data: &[u8], expected_size: usize) -> Result<Vec<u8>> {
     // Use the implode crate for PKWare decompression in MPQ archives
     // Based on the working implementation in msierks/mpq-rust
     let mut exploder = Exploder::new(&DEFAULT_CODE_TABLE);
-    let mut output = Vec::with_capacity(expected_size);
+    let mut output = buffer_pool::global().take(expected_size);
     let mut input_pos = 0;
     let mut total_output = 0;
 
@@ -24,6 +24,27 @@ pub fn decompress(
     decompressed_size: usize,
     skip_header: bool,
 ) -> Result<Vec<u8>> {
+    let mut decompressed = Vec::new();
+    decompress_into(
+        compressed,
+        decompressed_size,
+        skip_header,
+        &mut decompressed,
+    )?;
+    Ok(decompressed)
+}
+
+/// Decompress RLE-compressed data into a reusable buffer
+///
+/// Same as [`decompress`], but `out` is cleared and resized to
+/// `decompressed_size` instead of allocating, so a caller decompressing many
+/// patches can keep one buffer.
+pub fn decompress_into(
+    compressed: &[u8],
+    decompressed_size: usize,
+    skip_header: bool,
+    out: &mut Vec<u8>,
+) -> Result<()> {
     let data = if skip_header {
         if compressed.len() < 4 {
             return Err(Error::compression("RLE data too short for header"));
@@ -36,7 +57,8 @@ pub fn decompress(
     };
 
     // Pre-fill with zeros
-    let mut decompressed = vec![0u8; decompressed_size];
+    out.clear();
+    out.resize(decompressed_size, 0);
 
     let mut src_pos = 0;
     let mut dst_pos = 0;
@@ -46,25 +68,22 @@ pub fn decompress(
         src_pos += 1;
 
         if one_byte & 0x80 != 0 {
-            // High bit set: copy literal bytes
+            // High bit set: copy literal bytes, truncated at either end
             let repeat_count = ((one_byte & 0x7F) + 1) as usize;
+            let count = repeat_count
+                .min(decompressed_size - dst_pos)
+                .min(data.len() - src_pos);
 
-            for _ in 0..repeat_count {
-                if dst_pos >= decompressed_size || src_pos >= data.len() {
-                    break;
-                }
-
-                decompressed[dst_pos] = data[src_pos];
-                dst_pos += 1;
-                src_pos += 1;
-            }
+            out[dst_pos..dst_pos + count].copy_from_slice(&data[src_pos..src_pos + count]);
+            dst_pos += count;
+            src_pos += count;
         } else {
             // High bit clear: skip zeros (already filled)
             dst_pos += (one_byte + 1) as usize;
         }
     }
 
-    Ok(decompressed)
+    Ok(())
 }
 
 #[cfg(test)]
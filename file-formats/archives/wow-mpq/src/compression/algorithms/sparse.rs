@@ -3,6 +3,7 @@
 //! This implements the exact sparse compression format used by StormLib and MPQ archives.
 //! Based on StormLib's src/sparse/sparse.cpp implementation.
 
+use crate::buffer_pool;
 use crate::{Error, Result};
 
 /// Decompress sparse/RLE compressed data (StormLib format)
@@ -28,7 +29,7 @@ pub(crate) fn decompress(data: &[u8], expected_size: usize) -> Result<Vec<u8>> {
         ));
     }
 
-    let mut output = Vec::with_capacity(cb_out_buffer as usize);
+    let mut output = buffer_pool::global().take(cb_out_buffer as usize);
     let mut pos = 4; // Skip the size header
     let mut cb_out_buffer_remaining = cb_out_buffer;
 
@@ -1,6 +1,7 @@
 //! Zlib compression and decompression
 
 use crate::Result;
+use crate::buffer_pool;
 use crate::compression::error_helpers::{compression_error, decompression_error};
 use flate2::Compression;
 use flate2::read::ZlibDecoder;
@@ -23,7 +24,7 @@ pub(crate) fn decompress(data: &[u8], expected_size: usize) -> Result<Vec<u8>> {
 
     // ZlibDecoder can handle both zlib-wrapped and raw deflate data
     let mut decoder = ZlibDecoder::new(data);
-    let mut decompressed = Vec::with_capacity(expected_size);
+    let mut decompressed = buffer_pool::global().take(expected_size);
 
     match decoder.read_to_end(&mut decompressed) {
         Ok(_) => {
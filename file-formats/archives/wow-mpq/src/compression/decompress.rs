@@ -6,9 +6,11 @@
 
 use super::algorithms;
 use super::methods::{CompressionMethod, flags};
+use crate::buffer_pool;
 use crate::security::{
     DecompressionMonitor, SecurityLimits, SessionTracker, validate_decompression_operation,
 };
+use crate::stats;
 use crate::{Error, Result};
 
 /// Decompress data using the specified compression method with security monitoring
@@ -44,7 +46,8 @@ pub fn decompress_secure(
     // Record successful decompression
     session_tracker.record_decompression(result.len() as u64);
 
-    Ok(result)
+    // The output is the caller's to keep, so trim it to its length
+    Ok(buffer_pool::global().detach(result))
 }
 
 /// Legacy decompress function for backwards compatibility
@@ -91,6 +94,8 @@ fn decompress_with_monitor(
 
     let compression = CompressionMethod::from_flags(method);
 
+    // Stages of multi-compressed data are recorded individually below
+    let start = std::time::Instant::now();
     let result = match compression {
         CompressionMethod::None => {
             monitor.check_progress(data.len() as u64)?;
@@ -145,7 +150,9 @@ fn decompress_with_monitor(
             log::debug!("Multiple compression with flags 0x{flags:02X}");
             decompress_multiple_with_monitor(data, flags, decompressed_size, monitor)
         }
-    }?;
+    };
+    stats::record_decompression(compression, data.len(), &result, start);
+    let result = result?;
 
     // Final validation of decompression result
     crate::security::validate_decompression_result(
@@ -266,7 +273,7 @@ fn decompress_multiple_internal(
 
     // Pre-allocate buffer with worst-case size to avoid reallocations
     let buffer_size = std::cmp::max(expected_size * 4, data.len() * 4);
-    let mut current_data = Vec::with_capacity(buffer_size);
+    let mut current_data = buffer_pool::global().take(buffer_size);
     current_data.extend_from_slice(data);
 
     // Check progress after initial setup
@@ -282,24 +289,39 @@ fn decompress_multiple_internal(
         );
         // For Huffman, we don't know the intermediate size, so we estimate conservatively
         let huffman_output_size = std::cmp::max(expected_size * 2, current_data.len() * 2);
-        current_data = algorithms::huffman::decompress(&current_data, huffman_output_size)?;
+        let next = stats::timed_decompress(CompressionMethod::Huffman, &current_data, |d| {
+            algorithms::huffman::decompress(d, huffman_output_size)
+        })?;
+        replace_stage(&mut current_data, next);
         monitor.check_progress(current_data.len() as u64)?;
         log::debug!("After Huffman: {} bytes", current_data.len());
     } else if has_zlib {
         log::debug!("Decompressing Zlib");
-        current_data = algorithms::zlib::decompress(&current_data, expected_size * 4)?;
+        let next = stats::timed_decompress(CompressionMethod::Zlib, &current_data, |d| {
+            algorithms::zlib::decompress(d, expected_size * 4)
+        })?;
+        replace_stage(&mut current_data, next);
         monitor.check_progress(current_data.len() as u64)?;
     } else if has_bzip2 {
         log::debug!("Decompressing BZip2");
-        current_data = algorithms::bzip2::decompress(&current_data, expected_size * 4)?;
+        let next = stats::timed_decompress(CompressionMethod::BZip2, &current_data, |d| {
+            algorithms::bzip2::decompress(d, expected_size * 4)
+        })?;
+        replace_stage(&mut current_data, next);
         monitor.check_progress(current_data.len() as u64)?;
     } else if has_sparse {
         log::debug!("Decompressing Sparse");
-        current_data = algorithms::sparse::decompress(&current_data, expected_size * 4)?;
+        let next = stats::timed_decompress(CompressionMethod::Sparse, &current_data, |d| {
+            algorithms::sparse::decompress(d, expected_size * 4)
+        })?;
+        replace_stage(&mut current_data, next);
         monitor.check_progress(current_data.len() as u64)?;
     } else if has_implode {
         log::debug!("Decompressing Implode");
-        current_data = algorithms::implode::decompress(&current_data, expected_size * 4)?;
+        let next = stats::timed_decompress(CompressionMethod::Implode, &current_data, |d| {
+            algorithms::implode::decompress(d, expected_size * 4)
+        })?;
+        replace_stage(&mut current_data, next);
         monitor.check_progress(current_data.len() as u64)?;
     }
 
@@ -308,18 +330,28 @@ fn decompress_multiple_internal(
         log::debug!("Decompressing PKWare");
         // PKWare expected size should be estimated based on current data size
         let pkware_output_size = std::cmp::max(expected_size, current_data.len() * 2);
-        current_data = algorithms::pkware::decompress(&current_data, pkware_output_size)?;
+        let next = stats::timed_decompress(CompressionMethod::PKWare, &current_data, |d| {
+            algorithms::pkware::decompress(d, pkware_output_size)
+        })?;
+        replace_stage(&mut current_data, next);
         monitor.check_progress(current_data.len() as u64)?;
     }
 
     // Step 3: Decompress ADPCM if present (applied last since it was first during compression)
     if let Some(adpcm_type) = adpcm_type {
         log::debug!("Decompressing ADPCM {adpcm_type}");
-        current_data = match adpcm_type {
-            "mono" => algorithms::adpcm::decompress_mono(&current_data, expected_size)?,
-            "stereo" => algorithms::adpcm::decompress_stereo(&current_data, expected_size)?,
+        let next = match adpcm_type {
+            "mono" => stats::timed_decompress(CompressionMethod::AdpcmMono, &current_data, |d| {
+                algorithms::adpcm::decompress_mono(d, expected_size)
+            })?,
+            "stereo" => {
+                stats::timed_decompress(CompressionMethod::AdpcmStereo, &current_data, |d| {
+                    algorithms::adpcm::decompress_stereo(d, expected_size)
+                })?
+            }
             _ => return Err(Error::compression("Unknown ADPCM type")),
         };
+        replace_stage(&mut current_data, next);
         monitor.check_progress(current_data.len() as u64)?;
     }
 
@@ -351,6 +383,11 @@ fn decompress_multiple_internal(
     Ok(current_data)
 }
 
+/// Move on to the next stage's output, handing the previous buffer to the pool
+fn replace_stage(current: &mut Vec<u8>, next: Vec<u8>) {
+    buffer_pool::global().recycle(std::mem::replace(current, next));
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
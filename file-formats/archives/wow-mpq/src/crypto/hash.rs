@@ -38,6 +38,66 @@ pub fn hash_string(filename: &str, hash_type: u32) -> u32 {
     seed1
 }
 
+/// The three hashes that locate a file name in a hash table
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct NameHashes {
+    /// `TABLE_OFFSET` hash, the first bucket to probe
+    pub offset: u32,
+    /// `NAME_A` hash
+    pub name_a: u32,
+    /// `NAME_B` hash
+    pub name_b: u32,
+}
+
+/// Hash many file names for hash table lookups
+///
+/// Computes the `TABLE_OFFSET`, `NAME_A` and `NAME_B` hashes of every name in
+/// one pass over its bytes, normalizing each byte once and running the three
+/// independent hash chains side by side. With the `simd` feature, AVX2 CPUs
+/// hash eight names at once. `out` is cleared and receives one entry per name.
+pub fn hash_names(names: &[&str], out: &mut Vec<NameHashes>) {
+    #[cfg(feature = "simd")]
+    crate::simd::SimdOps::new().hash_names(names, out);
+
+    #[cfg(not(feature = "simd"))]
+    {
+        out.clear();
+        out.extend(names.iter().map(|name| hash_name(name.as_bytes())));
+    }
+}
+
+/// `TABLE_OFFSET`, `NAME_A` and `NAME_B` hashes of one name
+pub(crate) fn hash_name(name: &[u8]) -> NameHashes {
+    use super::types::hash_type::{NAME_A, NAME_B, TABLE_OFFSET};
+
+    let mut seed1 = [0x7FED7FEDu32; 3];
+    let mut seed2 = [0xEEEEEEEEu32; 3];
+
+    for &byte in name {
+        let ch = if byte == b'/' {
+            b'\\'
+        } else {
+            ASCII_TO_UPPER[byte as usize]
+        } as u32;
+
+        for (k, hash_type) in [TABLE_OFFSET, NAME_A, NAME_B].into_iter().enumerate() {
+            seed1[k] =
+                ENCRYPTION_TABLE[(hash_type + ch) as usize] ^ seed1[k].wrapping_add(seed2[k]);
+            seed2[k] = ch
+                .wrapping_add(seed1[k])
+                .wrapping_add(seed2[k])
+                .wrapping_add(seed2[k] << 5)
+                .wrapping_add(3);
+        }
+    }
+
+    NameHashes {
+        offset: seed1[0],
+        name_a: seed1[1],
+        name_b: seed1[2],
+    }
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
@@ -159,4 +219,24 @@ mod tests {
         let key = hash_string(filename, hash_type::FILE_KEY);
         assert_eq!(key, 0xEC83B3A3);
     }
+
+    #[test]
+    fn test_hash_names_matches_hash_string() {
+        let names = [
+            "(listfile)",
+            "path/to/file",
+            "Units\\Human\\Footman.mdx",
+            "",
+            "a",
+        ];
+        let mut hashes = Vec::new();
+        hash_names(&names, &mut hashes);
+
+        assert_eq!(hashes.len(), names.len());
+        for (name, hashes) in names.iter().zip(&hashes) {
+            assert_eq!(hashes.offset, hash_string(name, hash_type::TABLE_OFFSET));
+            assert_eq!(hashes.name_a, hash_string(name, hash_type::NAME_A));
+            assert_eq!(hashes.name_b, hash_string(name, hash_type::NAME_B));
+        }
+    }
 }
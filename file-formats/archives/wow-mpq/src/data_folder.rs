@@ -0,0 +1,545 @@
+//! A client `Data` folder opened as one virtual file system
+//!
+//! A World of Warcraft client spreads its files over one or two dozen
+//! archives: base and expansion archives in `Data/`, locale and speech
+//! archives in `Data/<locale>/`, and numbered patches on top of both. Looking
+//! a name up by probing every archive in turn costs one hash table probe per
+//! archive. [`DataFolder`] opens the whole folder at once, in parallel, and
+//! merges the hash tables of all archives into a single index from name hash
+//! to the archive and block that win under the client's load order, so a
+//! lookup is one probe of that index however many archives there are.
+//!
+//! The index is locale-neutral: it is keyed by name hash alone. The client
+//! picks a locale by archive (the locale folders, or [`DataFolder::open_locale`]
+//! for one of them), and those archives override the base ones. Where a
+//! single archive holds several localized copies of a name, the neutral
+//! (locale 0) copy is indexed, falling back to the first in hash table order.
+//!
+//! Archives load in four tiers, each overriding the ones before it:
+//!
+//! 1. Base archives in `Data/` (`common.MPQ`, `expansion.MPQ`, ...)
+//! 2. Archives in locale folders (`locale-enUS.MPQ`, `speech-enUS.MPQ`, ...)
+//! 3. Patches in `Data/` (`patch.MPQ`, `patch-2.MPQ`, `wow-update-*.MPQ`)
+//! 4. Patches in locale folders (`patch-enUS.MPQ`, `patch-enUS-2.MPQ`, ...)
+//!
+//! Within a tier, archives of later expansions load after earlier ones and
+//! the rest in natural name order, so `patch-10.MPQ` overrides `patch-9.MPQ`.
+//!
+//! Patch archives that store PTCH binary patches (Cataclysm and later) need
+//! the base file to be patched rather than replaced; use a
+//! [`PatchChain`](crate::PatchChain) for those.
+
+use crate::crypto::{hash_names, hash_string, hash_type};
+use crate::{Archive, Error, FileStream, OpenOptions, Result};
+use std::cmp::Ordering;
+use std::collections::HashMap;
+use std::fs;
+use std::io::Read;
+use std::path::{Path, PathBuf};
+
+/// Where the winning copy of a file lives
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct FileLocation {
+    /// Index of the archive in [`DataFolder::archive_paths`]
+    pub archive: usize,
+    /// Block (or BET file) index within that archive
+    pub block: usize,
+}
+
+/// Load tier of an archive, lowest priority first
+#[derive(Debug, Clone, Copy, PartialEq, Eq, PartialOrd, Ord)]
+enum Tier {
+    Base,
+    Locale,
+    Patch,
+    LocalePatch,
+}
+
+/// All archives of a client data folder behind one merged file index
+///
+/// # Examples
+///
+/// ```no_run
+/// use std::io::Read;
+/// use wow_mpq::DataFolder;
+///
+/// # fn main() -> Result<(), wow_mpq::Error> {
+/// let data = DataFolder::open("World of Warcraft/Data")?;
+/// println!("{} archives, {} files", data.archive_count(), data.file_count());
+///
+/// if data.contains_file("DBFilesClient\\Spell.dbc") {
+///     let mut stream = data.open_file_stream("DBFilesClient\\Spell.dbc")?;
+///     let mut contents = Vec::new();
+///     stream.read_to_end(&mut contents)?;
+/// }
+/// # Ok(())
+/// # }
+/// ```
+#[derive(Debug)]
+pub struct DataFolder {
+    /// Archives in load order reversed, highest priority first
+    archives: Vec<(PathBuf, Archive)>,
+    /// (NAME_A, NAME_B) hash of each file name -> winning copy, any locale
+    index: HashMap<(u32, u32), FileLocation>,
+}
+
+impl DataFolder {
+    /// Open every archive of a data folder and all its locale folders
+    pub fn open<P: AsRef<Path>>(data_dir: P) -> Result<Self> {
+        Self::open_with_options(data_dir, None, OpenOptions::new())
+    }
+
+    /// Open a data folder with the archives of one locale folder only
+    pub fn open_locale<P: AsRef<Path>>(data_dir: P, locale: &str) -> Result<Self> {
+        Self::open_with_options(data_dir, Some(locale), OpenOptions::new())
+    }
+
+    /// Open a data folder, opening each archive with `options`
+    ///
+    /// With `locale` set, only that locale folder is searched; otherwise all
+    /// of them are. Tables are loaded even if `options` defers them, since the
+    /// merged index is built from them.
+    pub fn open_with_options<P: AsRef<Path>>(
+        data_dir: P,
+        locale: Option<&str>,
+        options: OpenOptions,
+    ) -> Result<Self> {
+        let paths = discover_archives(data_dir.as_ref(), locale)?;
+        if paths.is_empty() {
+            return Err(Error::FileNotFound(format!(
+                "No MPQ archives in {}",
+                data_dir.as_ref().display()
+            )));
+        }
+        Self::from_archives(&paths, options)
+    }
+
+    /// Open a list of archives given in load order, lowest priority first
+    ///
+    /// The archives are opened and their tables read in parallel; the
+    /// merged index is then built in one pass over the tables.
+    pub fn from_archives<P: AsRef<Path> + Sync>(paths: &[P], options: OpenOptions) -> Result<Self> {
+        use rayon::prelude::*;
+
+        let mut opened: Vec<(PathBuf, Archive, Vec<((u32, u32), usize)>)> = paths
+            .par_iter()
+            .map(|path| {
+                let path = path.as_ref();
+                let mut archive = options.clone().open(path)?;
+                if !archive.tables_loaded() {
+                    archive.load_tables()?;
+                }
+                let entries = index_entries(&mut archive);
+                Ok((path.to_path_buf(), archive, entries))
+            })
+            .collect::<Result<_>>()?;
+        opened.reverse();
+
+        let capacity = opened.iter().map(|(_, _, entries)| entries.len()).max();
+        let mut index = HashMap::with_capacity(capacity.unwrap_or(0));
+        let mut archives = Vec::with_capacity(opened.len());
+        for (archive_idx, (path, archive, entries)) in opened.into_iter().enumerate() {
+            for (key, block) in entries {
+                // Highest priority comes first, so the first copy seen wins
+                index.entry(key).or_insert(FileLocation {
+                    archive: archive_idx,
+                    block,
+                });
+            }
+            archives.push((path, archive));
+        }
+
+        Ok(Self { archives, index })
+    }
+
+    /// Number of archives in the folder
+    pub fn archive_count(&self) -> usize {
+        self.archives.len()
+    }
+
+    /// Number of distinct files across all archives
+    pub fn file_count(&self) -> usize {
+        self.index.len()
+    }
+
+    /// Archive paths, highest priority first
+    pub fn archive_paths(&self) -> impl Iterator<Item = &Path> {
+        self.archives.iter().map(|(path, _)| path.as_path())
+    }
+
+    /// Get an archive by its index in [`archive_paths`](Self::archive_paths)
+    pub fn archive(&self, index: usize) -> Option<&Archive> {
+        self.archives.get(index).map(|(_, archive)| archive)
+    }
+
+    /// Find the winning copy of a file
+    ///
+    /// The name is matched regardless of locale; see the
+    /// [module documentation](crate::data_folder) for which copy wins.
+    pub fn locate(&self, name: &str) -> Option<FileLocation> {
+        let key = (
+            hash_string(name, hash_type::NAME_A),
+            hash_string(name, hash_type::NAME_B),
+        );
+        self.index.get(&key).copied()
+    }
+
+    /// Locate many files at once
+    ///
+    /// Like [`locate`](Self::locate) for every name, with the names hashed in
+    /// one batch. `out` is cleared and receives one entry per name.
+    pub fn locate_batch(&self, names: &[&str], out: &mut Vec<Option<FileLocation>>) {
+        let mut hashes = Vec::with_capacity(names.len());
+        hash_names(names, &mut hashes);
+        out.clear();
+        out.extend(
+            hashes
+                .iter()
+                .map(|hashes| self.index.get(&(hashes.name_a, hashes.name_b)).copied()),
+        );
+    }
+
+    /// Check whether any archive in the folder contains a file
+    pub fn contains_file(&self, name: &str) -> bool {
+        self.locate(name).is_some()
+    }
+
+    /// Path of the archive serving a file
+    pub fn find_file_archive(&self, name: &str) -> Option<&Path> {
+        self.locate(name)
+            .map(|location| self.archives[location.archive].0.as_path())
+    }
+
+    /// Open the winning copy of a file for streaming reads
+    pub fn open_file_stream(&self, name: &str) -> Result<FileStream> {
+        let location = self
+            .locate(name)
+            .ok_or_else(|| Error::FileNotFound(name.to_string()))?;
+        self.archives[location.archive]
+            .1
+            .open_file_stream_by_block(name, location.block)
+    }
+
+    /// Read the winning copy of a file
+    pub fn read_file(&self, name: &str) -> Result<Vec<u8>> {
+        let mut stream = self.open_file_stream(name)?;
+        let mut data = Vec::with_capacity(stream.len() as usize);
+        stream.read_to_end(&mut data)?;
+        Ok(data)
+    }
+}
+
+/// Name hashes and block indices of the files in an archive
+///
+/// Classic hash tables carry both hashes of every name, so no listfile is
+/// needed; of several localized copies of a name the neutral one is kept.
+/// Archives with only HET/BET tables are indexed by the names in their
+/// listfile, which resolve to the neutral copy as well.
+fn index_entries(archive: &mut Archive) -> Vec<((u32, u32), usize)> {
+    // Flattened archives no longer keep the tables they were built from
+    let hashed: Option<Vec<((u32, u32), u16, usize)>> = match archive.flat_tables() {
+        Some(flat) if flat.has_hash_table() => Some(
+            flat.hash_entries()
+                .iter()
+                .map(|entry| {
+                    let key = ((entry.name_hash >> 32) as u32, entry.name_hash as u32);
+                    (key, entry.locale, entry.block_index)
+                })
+                .collect(),
+        ),
+        Some(_) => None,
+        None => match (archive.hash_table(), archive.block_table()) {
+            (Some(hash_table), Some(block_table)) => Some(
+                hash_table
+                    .entries()
+                    .iter()
+                    .filter(|entry| {
+                        entry.is_valid()
+                            && block_table
+                                .get(entry.block_index as usize)
+                                .is_some_and(|block| block.exists())
+                    })
+                    .map(|entry| {
+                        let key = (entry.name_1, entry.name_2);
+                        (key, entry.locale, entry.block_index as usize)
+                    })
+                    .collect(),
+            ),
+            _ => None,
+        },
+    };
+
+    if let Some(hashed) = hashed {
+        let mut entries: HashMap<(u32, u32), (u16, usize)> = HashMap::new();
+        for (key, locale, block_index) in hashed {
+            entries
+                .entry(key)
+                .and_modify(|kept| {
+                    if kept.0 != 0 && locale == 0 {
+                        *kept = (locale, block_index);
+                    }
+                })
+                .or_insert((locale, block_index));
+        }
+        return entries
+            .into_iter()
+            .map(|(key, (_, block))| (key, block))
+            .collect();
+    }
+
+    let names = archive.list().unwrap_or_default();
+    names
+        .into_iter()
+        .filter_map(|entry| {
+            let info = archive.find_file(&entry.name).ok()??;
+            let key = (
+                hash_string(&entry.name, hash_type::NAME_A),
+                hash_string(&entry.name, hash_type::NAME_B),
+            );
+            Some((key, info.block_index))
+        })
+        .collect()
+}
+
+/// Find the archives of a data folder, in load order (lowest priority first)
+///
+/// Archives directly in `data_dir` and in its locale folders (four-letter
+/// names such as `enUS`) are returned; with `locale` set, other locale
+/// folders are skipped.
+pub fn discover_archives(data_dir: &Path, locale: Option<&str>) -> Result<Vec<PathBuf>> {
+    let mut found = Vec::new();
+    for entry in fs::read_dir(data_dir)? {
+        let path = entry?.path();
+        if path.is_dir() {
+            let Some(dir_name) = path.file_name().and_then(|n| n.to_str()) else {
+                continue;
+            };
+            let wanted = match locale {
+                Some(locale) => dir_name.eq_ignore_ascii_case(locale),
+                None => is_locale_name(dir_name),
+            };
+            if wanted {
+                for sub_entry in fs::read_dir(&path)? {
+                    let sub_path = sub_entry?.path();
+                    if is_archive(&sub_path) {
+                        found.push((true, sub_path));
+                    }
+                }
+            }
+        } else if is_archive(&path) {
+            found.push((false, path));
+        }
+    }
+
+    let mut keyed: Vec<(Tier, u32, String, PathBuf)> = found
+        .into_iter()
+        .map(|(in_locale, path)| {
+            let stem = path
+                .file_stem()
+                .and_then(|s| s.to_str())
+                .unwrap_or_default()
+                .to_ascii_lowercase();
+            let patch = stem.starts_with("patch") || stem.starts_with("wow-update");
+            let tier = match (in_locale, patch) {
+                (false, false) => Tier::Base,
+                (true, false) => Tier::Locale,
+                (false, true) => Tier::Patch,
+                (true, true) => Tier::LocalePatch,
+            };
+            (tier, expansion_rank(&stem), stem, path)
+        })
+        .collect();
+    keyed.sort_by(|a, b| {
+        (a.0, a.1)
+            .cmp(&(b.0, b.1))
+            .then_with(|| natural_cmp(&a.2, &b.2))
+    });
+
+    Ok(keyed.into_iter().map(|(_, _, _, path)| path).collect())
+}
+
+/// Whether `path` is an MPQ archive by extension
+fn is_archive(path: &Path) -> bool {
+    path.is_file()
+        && path
+            .extension()
+            .and_then(|e| e.to_str())
+            .is_some_and(|e| e.eq_ignore_ascii_case("mpq"))
+}
+
+/// Whether a folder name looks like a locale (`enUS`, `deDE`, ...)
+fn is_locale_name(name: &str) -> bool {
+    let bytes = name.as_bytes();
+    bytes.len() == 4
+        && bytes[..2].iter().all(u8::is_ascii_lowercase)
+        && bytes[2..].iter().all(u8::is_ascii_uppercase)
+}
+
+/// Which expansion an archive belongs to, from its lowercase stem
+///
+/// `expansion-locale-enUS` has to load after `locale-enUS`, which plain name
+/// order would get wrong.
+fn expansion_rank(stem: &str) -> u32 {
+    if stem.starts_with("lichking") {
+        2
+    } else if stem.starts_with("expansion") {
+        1
+    } else {
+        0
+    }
+}
+
+/// Compare names with runs of digits ordered by value
+fn natural_cmp(a: &str, b: &str) -> Ordering {
+    let (mut a, mut b) = (a.as_bytes(), b.as_bytes());
+    loop {
+        match (a.first(), b.first()) {
+            (None, None) => return Ordering::Equal,
+            (None, Some(_)) => return Ordering::Less,
+            (Some(_), None) => return Ordering::Greater,
+            (Some(x), Some(y)) if x.is_ascii_digit() && y.is_ascii_digit() => {
+                let a_len = a.iter().take_while(|c| c.is_ascii_digit()).count();
+                let b_len = b.iter().take_while(|c| c.is_ascii_digit()).count();
+                let a_num = trim_zeros(&a[..a_len]);
+                let b_num = trim_zeros(&b[..b_len]);
+                let ord = a_num.len().cmp(&b_num.len()).then(a_num.cmp(b_num));
+                if ord != Ordering::Equal {
+                    return ord;
+                }
+                a = &a[a_len..];
+                b = &b[b_len..];
+            }
+            (Some(x), Some(y)) => {
+                let ord = x.cmp(y);
+                if ord != Ordering::Equal {
+                    return ord;
+                }
+                a = &a[1..];
+                b = &b[1..];
+            }
+        }
+    }
+}
+
+fn trim_zeros(digits: &[u8]) -> &[u8] {
+    let zeros = digits.iter().take_while(|&&c| c == b'0').count();
+    &digits[zeros..]
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::{ArchiveBuilder, ListfileOption};
+    use tempfile::TempDir;
+
+    fn create_archive(path: &Path, files: &[(&str, &[u8])]) {
+        let mut builder = ArchiveBuilder::new().listfile_option(ListfileOption::Generate);
+        for (name, data) in files {
+            builder = builder.add_file_data(data.to_vec(), name);
+        }
+        builder.build(path).unwrap();
+    }
+
+    #[test]
+    fn test_natural_order() {
+        let mut names = vec!["patch-10", "patch-2", "patch", "patch-x", "patch-3"];
+        names.sort_by(|a, b| natural_cmp(a, b));
+        assert_eq!(
+            names,
+            ["patch", "patch-2", "patch-3", "patch-10", "patch-x"]
+        );
+    }
+
+    #[test]
+    fn test_discover_load_order() -> Result<()> {
+        let temp = TempDir::new()?;
+        let data = temp.path();
+        fs::create_dir(data.join("enUS"))?;
+        fs::create_dir(data.join("deDE"))?;
+        fs::create_dir(data.join("Cache"))?;
+        for name in [
+            "patch-2.MPQ",
+            "lichking.MPQ",
+            "common-2.MPQ",
+            "patch.MPQ",
+            "expansion.MPQ",
+            "common.MPQ",
+            "enUS/patch-enUS-2.MPQ",
+            "enUS/lichking-locale-enUS.MPQ",
+            "enUS/locale-enUS.MPQ",
+            "enUS/expansion-locale-enUS.MPQ",
+            "enUS/patch-enUS.MPQ",
+            "deDE/locale-deDE.MPQ",
+            "Cache/ignored.MPQ",
+            "readme.txt",
+        ] {
+            fs::write(data.join(name), b"")?;
+        }
+
+        let names: Vec<String> = discover_archives(data, Some("enUS"))?
+            .iter()
+            .map(|p| p.file_name().unwrap().to_string_lossy().into_owned())
+            .collect();
+        assert_eq!(
+            names,
+            [
+                "common.MPQ",
+                "common-2.MPQ",
+                "expansion.MPQ",
+                "lichking.MPQ",
+                "locale-enUS.MPQ",
+                "expansion-locale-enUS.MPQ",
+                "lichking-locale-enUS.MPQ",
+                "patch.MPQ",
+                "patch-2.MPQ",
+                "patch-enUS.MPQ",
+                "patch-enUS-2.MPQ",
+            ]
+        );
+
+        // Without a locale every locale folder is searched
+        assert_eq!(discover_archives(data, None)?.len(), 12);
+        Ok(())
+    }
+
+    #[test]
+    fn test_merged_lookup_uses_highest_priority() -> Result<()> {
+        let temp = TempDir::new()?;
+        let data = temp.path();
+        fs::create_dir(data.join("enUS"))?;
+        create_archive(
+            &data.join("common.MPQ"),
+            &[
+                ("a.txt", b"common"),
+                ("b.txt", b"common"),
+                ("c.txt", b"common"),
+            ],
+        );
+        create_archive(&data.join("enUS/locale-enUS.MPQ"), &[("b.txt", b"locale")]);
+        create_archive(&data.join("patch.MPQ"), &[("a.txt", b"patch")]);
+        create_archive(&data.join("patch-2.MPQ"), &[("a.txt", b"patch-2")]);
+
+        let folder = DataFolder::open(data)?;
+        assert_eq!(folder.archive_count(), 4);
+        assert!(folder.contains_file("A.TXT"));
+        assert!(!folder.contains_file("missing.txt"));
+        assert_eq!(folder.read_file("a.txt")?, b"patch-2");
+        assert_eq!(folder.read_file("b.txt")?, b"locale");
+        assert_eq!(folder.read_file("c.txt")?, b"common");
+        assert_eq!(
+            folder.find_file_archive("a.txt"),
+            Some(data.join("patch-2.MPQ").as_path())
+        );
+
+        let mut stream = folder.open_file_stream("b.txt")?;
+        let mut contents = Vec::new();
+        std::io::Read::read_to_end(&mut stream, &mut contents)?;
+        assert_eq!(contents, b"locale");
+
+        assert!(matches!(
+            folder.read_file("missing.txt"),
+            Err(Error::FileNotFound(_))
+        ));
+        Ok(())
+    }
+}
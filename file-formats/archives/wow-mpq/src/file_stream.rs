@@ -0,0 +1,983 @@
+//! Streaming access to files stored in an MPQ archive
+//!
+//! [`FileStream`] decodes a file one sector at a time as it is read instead of
+//! decompressing the whole file up front. This keeps memory usage bounded for
+//! large files and makes opening a file cheap when only part of it is needed.
+//!
+//! Each stream owns its own handle to the archive file and uses positioned
+//! reads, so streams do not share a seek position with the [`Archive`] they
+//! were opened from. When the archive was opened with memory mapping enabled,
+//! streams read from the shared mapping instead, and stored files can be
+//! borrowed in place with [`FileStream::as_slice`].
+//!
+//! Sector buffers come from the global [`buffer_pool`](crate::buffer_pool) and
+//! are handed back when a sector is evicted or the stream is dropped. If the
+//! archive has a [`SectorCache`](crate::SectorCache), decoded sectors and
+//! single-unit files are looked up there first and shared with other streams.
+//!
+//! [`Archive`]: crate::Archive
+
+use crate::archive::{FileInfo, decode_unsectored_file, decompress_sector, decrypt_sector};
+use crate::buffer_pool;
+use crate::compression;
+#[cfg(feature = "mmap")]
+use crate::io::MemoryMappedArchive;
+use crate::sector_cache::SharedSectors;
+use crate::stats;
+use crate::{Error, Result};
+use std::collections::VecDeque;
+use std::fs::File;
+use std::io::{self, Read, Seek, SeekFrom};
+use std::sync::Arc;
+
+/// Number of decoded sectors kept per stream by default
+pub const DEFAULT_SECTOR_CACHE_SIZE: usize = 4;
+
+/// Where a stream reads archive bytes from
+pub(crate) enum StreamSource {
+    /// A private handle to the archive file, read with positioned reads
+    File(File),
+    /// The archive's shared memory mapping
+    #[cfg(feature = "mmap")]
+    Mapped(Arc<MemoryMappedArchive>),
+    /// Archive bytes read ahead of time, starting at archive offset `start`
+    Buffer { data: Arc<Vec<u8>>, start: u64 },
+}
+
+impl StreamSource {
+    /// Read exactly `buf.len()` bytes at `offset`
+    fn read_exact_at(&self, buf: &mut [u8], offset: u64) -> Result<()> {
+        match self {
+            StreamSource::File(file) => {
+                read_exact_at(file, buf, offset)?;
+                stats::record_disk_read(buf.len());
+                Ok(())
+            }
+            #[cfg(feature = "mmap")]
+            StreamSource::Mapped(mapping) => {
+                mapping.read_at(offset, buf)?;
+                stats::record_mapped_read(buf.len());
+                Ok(())
+            }
+            StreamSource::Buffer { .. } => {
+                let bytes = self
+                    .slice(offset, buf.len())
+                    .ok_or_else(|| Error::invalid_bounds("Read outside the buffered range"))?;
+                buf.copy_from_slice(bytes);
+                Ok(())
+            }
+        }
+    }
+
+    /// Open a second handle on the same source
+    fn try_clone(&self) -> Result<Self> {
+        match self {
+            StreamSource::File(file) => Ok(StreamSource::File(file.try_clone()?)),
+            #[cfg(feature = "mmap")]
+            StreamSource::Mapped(mapping) => Ok(StreamSource::Mapped(Arc::clone(mapping))),
+            StreamSource::Buffer { data, start } => Ok(StreamSource::Buffer {
+                data: Arc::clone(data),
+                start: *start,
+            }),
+        }
+    }
+
+    /// Borrow `len` bytes at `offset` if the source holds them in memory
+    fn slice(&self, offset: u64, len: usize) -> Option<&[u8]> {
+        match self {
+            StreamSource::File(_) => None,
+            #[cfg(feature = "mmap")]
+            StreamSource::Mapped(mapping) => mapping.get_slice(offset, len).ok(),
+            StreamSource::Buffer { data, start } => {
+                let begin = usize::try_from(offset.checked_sub(*start)?).ok()?;
+                data.get(begin..begin.checked_add(len)?)
+            }
+        }
+    }
+}
+
+/// How the file contents are obtained
+enum Layout {
+    /// Decoded contents held in memory, possibly shared through a sector cache
+    Resident(Arc<Vec<u8>>),
+    /// Uncompressed, unencrypted data read directly from the archive
+    Raw { source: StreamSource, data_pos: u64 },
+    /// Compressed sectored file, decoded on demand
+    Sectored {
+        source: StreamSource,
+        file_info: FileInfo,
+        key: u32,
+        sector_size: usize,
+        offsets: Vec<u32>,
+        /// Per-sector Adler-32 values, once checking has been enabled
+        crcs: Option<Vec<u32>>,
+        /// Sectors shared with other streams over the same file
+        shared: Option<SharedSectors>,
+    },
+}
+
+/// A readable, seekable view of a single file in an MPQ archive
+///
+/// Created by [`Archive::open_file_stream`](crate::Archive::open_file_stream).
+/// Compressed sectored files are decoded lazily with a small cache of recently
+/// used sectors; single-unit files and encrypted uncompressed files are
+/// decoded once when the stream is opened.
+///
+/// # Examples
+///
+/// ```no_run
+/// use std::io::Read;
+/// use wow_mpq::Archive;
+///
+/// # fn main() -> Result<(), Box<dyn std::error::Error>> {
+/// let archive = Archive::open("data.mpq")?;
+/// let mut stream = archive.open_file_stream("Interface\\FrameXML\\UIParent.lua")?;
+///
+/// let mut header = [0u8; 16];
+/// stream.read_exact(&mut header)?;
+/// println!("{} bytes total", stream.len());
+/// # Ok(())
+/// # }
+/// ```
+pub struct FileStream {
+    name: String,
+    size: u64,
+    position: u64,
+    layout: Layout,
+    /// Table entry and key the stream was opened from
+    entry: Option<(FileInfo, u32)>,
+    cache: VecDeque<(usize, Arc<Vec<u8>>)>,
+    cache_capacity: usize,
+}
+
+impl FileStream {
+    /// Open a stream for a file described by `file_info`
+    ///
+    /// `source` must read from the archive containing the file and `key` is
+    /// the file's decryption key (0 if unencrypted). Decoded data is shared
+    /// through `shared` when given.
+    pub(crate) fn open(
+        source: StreamSource,
+        name: &str,
+        file_info: FileInfo,
+        key: u32,
+        file_size: u64,
+        sector_size: usize,
+        shared: Option<SharedSectors>,
+    ) -> Result<Self> {
+        let entry = (file_info.clone(), key);
+        let layout = if file_size == 0 {
+            Layout::Resident(Arc::new(Vec::new()))
+        } else if file_info.is_single_unit() || !file_info.is_compressed() {
+            if !file_info.is_encrypted() && !file_info.is_compressed() {
+                Layout::Raw {
+                    source,
+                    data_pos: file_info.file_pos,
+                }
+            } else {
+                let decode = || {
+                    let mut data = buffer_pool::global().take(file_info.compressed_size as usize);
+                    data.resize(file_info.compressed_size as usize, 0);
+                    source.read_exact_at(&mut data, file_info.file_pos)?;
+
+                    // For single unit files, there's one CRC after the data
+                    let stored_crc = if file_info.has_sector_crc() && file_info.is_single_unit() {
+                        let mut crc_bytes = [0u8; 4];
+                        source.read_exact_at(
+                            &mut crc_bytes,
+                            file_info.file_pos + file_info.compressed_size,
+                        )?;
+                        Some(u32::from_le_bytes(crc_bytes))
+                    } else {
+                        None
+                    };
+
+                    decode_unsectored_file(data, stored_crc, &file_info, key, file_size, name)
+                        .map(|data| buffer_pool::global().detach(data))
+                };
+
+                Layout::Resident(match &shared {
+                    Some(shared) => shared.whole_file(decode)?,
+                    None => Arc::new(decode()?),
+                })
+            }
+        } else {
+            let sector_count = (file_size as usize).div_ceil(sector_size);
+            let mut offset_data = vec![0u8; (sector_count + 1) * 4];
+            source.read_exact_at(&mut offset_data, file_info.file_pos)?;
+            let offsets = crate::archive::parse_sector_offsets(
+                &mut offset_data,
+                &file_info,
+                key,
+                sector_count,
+            )?;
+
+            Layout::Sectored {
+                source,
+                file_info,
+                key,
+                sector_size,
+                offsets,
+                crcs: None,
+                shared,
+            }
+        };
+
+        let mut stream = Self::with_layout(name, file_size, layout);
+        stream.entry = Some(entry);
+        Ok(stream)
+    }
+
+    /// Create a stream over data that has already been decoded
+    pub fn from_vec(name: impl Into<String>, data: Vec<u8>) -> Self {
+        let size = data.len() as u64;
+        Self::with_layout(name, size, Layout::Resident(Arc::new(data)))
+    }
+
+    fn with_layout(name: impl Into<String>, size: u64, layout: Layout) -> Self {
+        Self {
+            name: name.into(),
+            size,
+            position: 0,
+            layout,
+            entry: None,
+            cache: VecDeque::new(),
+            cache_capacity: DEFAULT_SECTOR_CACHE_SIZE,
+        }
+    }
+
+    /// Name the stream was opened with
+    pub fn name(&self) -> &str {
+        &self.name
+    }
+
+    /// Table entry of the file the stream reads
+    ///
+    /// `None` for streams created from data that was already decoded, such
+    /// as patched files or pending changes of a mutable archive.
+    pub fn file_info(&self) -> Option<&FileInfo> {
+        self.entry.as_ref().map(|(file_info, _)| file_info)
+    }
+
+    /// Decryption key of the file, adjusted for `FIX_KEY` (0 if unencrypted)
+    ///
+    /// `None` whenever [`file_info`](Self::file_info) is.
+    pub fn key(&self) -> Option<u32> {
+        self.entry.as_ref().map(|(_, key)| *key)
+    }
+
+    /// Uncompressed size of the file in bytes
+    pub fn len(&self) -> u64 {
+        self.size
+    }
+
+    /// Whether the file is empty
+    pub fn is_empty(&self) -> bool {
+        self.size == 0
+    }
+
+    /// Whether the stream decodes sectors on demand
+    pub fn is_sectored(&self) -> bool {
+        matches!(self.layout, Layout::Sectored { .. })
+    }
+
+    /// Borrow the whole file contents without copying
+    ///
+    /// Returns `None` unless the contents are already contiguous in memory:
+    /// either decoded when the stream was opened, or a stored (uncompressed,
+    /// unencrypted) file in a memory-mapped archive. The slice stays valid for
+    /// as long as the stream is alive.
+    pub fn as_slice(&self) -> Option<&[u8]> {
+        match &self.layout {
+            Layout::Resident(data) => Some(data.as_slice()),
+            Layout::Raw { source, data_pos } => source.slice(*data_pos, self.size as usize),
+            Layout::Sectored { .. } => None,
+        }
+    }
+
+    /// Open an independent stream over the same file
+    ///
+    /// The new stream starts at position 0 with an empty sector cache and its
+    /// own handle to the archive file, so it can be read on another thread
+    /// while this one is in use. Contents decoded when this stream was
+    /// opened, the sector offset table and the sector cache settings are
+    /// shared or copied rather than read again.
+    pub fn try_clone(&self) -> Result<Self> {
+        let layout = match &self.layout {
+            Layout::Resident(data) => Layout::Resident(Arc::clone(data)),
+            Layout::Raw { source, data_pos } => Layout::Raw {
+                source: source.try_clone()?,
+                data_pos: *data_pos,
+            },
+            Layout::Sectored {
+                source,
+                file_info,
+                key,
+                sector_size,
+                offsets,
+                crcs,
+                shared,
+            } => Layout::Sectored {
+                source: source.try_clone()?,
+                file_info: file_info.clone(),
+                key: *key,
+                sector_size: *sector_size,
+                offsets: offsets.clone(),
+                crcs: crcs.clone(),
+                shared: shared.clone(),
+            },
+        };
+        let mut stream = Self::with_layout(self.name.clone(), self.size, layout);
+        stream.entry = self.entry.clone();
+        stream.cache_capacity = self.cache_capacity;
+        Ok(stream)
+    }
+
+    /// Set how many decoded sectors are kept in memory (minimum 1)
+    pub fn set_sector_cache_size(&mut self, sectors: usize) {
+        self.cache_capacity = sectors.max(1);
+        while self.cache.len() > self.cache_capacity {
+            if let Some((_, evicted)) = self.cache.pop_back() {
+                release(evicted);
+            }
+        }
+    }
+
+    /// Check sectors against the file's sector checksum table as they are decoded
+    ///
+    /// Returns whether the file has a checksum table; only sectored files
+    /// stored with the sector CRC flag do. Two layouts are recognised: the
+    /// one written by StormLib and Blizzard, where the offset table has an
+    /// extra entry and the (usually compressed) checksum table sits between
+    /// the last two offsets, after the sector data; and the one written by
+    /// [`ArchiveBuilder`](crate::ArchiveBuilder), with a plain table directly
+    /// after the offset table. Once enabled, reading a sector whose Adler-32
+    /// does not match fails with [`Error::ChecksumMismatch`]; sectors with a
+    /// stored value of 0 are not checked.
+    pub fn enable_sector_crc_check(&mut self) -> Result<bool> {
+        let Layout::Sectored {
+            source,
+            file_info,
+            key,
+            offsets,
+            crcs,
+            ..
+        } = &mut self.layout
+        else {
+            return Ok(false);
+        };
+        if crcs.is_some() {
+            return Ok(true);
+        }
+        if !file_info.has_sector_crc() {
+            return Ok(false);
+        }
+
+        let sector_count = offsets.len() - 1;
+        let table_size = sector_count * 4;
+        let table = match read_stormlib_crc_table(source, file_info, *key, offsets)? {
+            Some(table) => table,
+            None => {
+                let table_start = offsets.len() * 4;
+                if (offsets[0] as usize) < table_start + table_size {
+                    // No room for a table between the offsets and the first sector
+                    return Ok(false);
+                }
+                let mut table = vec![0u8; table_size];
+                source.read_exact_at(&mut table, file_info.file_pos + table_start as u64)?;
+                table
+            }
+        };
+        if table.len() != table_size {
+            return Ok(false);
+        }
+        *crcs = Some(
+            table
+                .chunks_exact(4)
+                .map(|b| u32::from_le_bytes([b[0], b[1], b[2], b[3]]))
+                .collect(),
+        );
+
+        // Sectors decoded so far were not checked
+        for (_, sector) in self.cache.drain(..) {
+            release(sector);
+        }
+        Ok(true)
+    }
+
+    /// Read bytes starting at `offset` without changing the stream position
+    ///
+    /// Returns the number of bytes read, which is less than `buf.len()` only
+    /// when the end of the file is reached.
+    pub fn read_at(&mut self, offset: u64, buf: &mut [u8]) -> Result<usize> {
+        if offset >= self.size || buf.is_empty() {
+            return Ok(0);
+        }
+
+        let len = (self.size - offset).min(buf.len() as u64) as usize;
+        let buf = &mut buf[..len];
+
+        match &self.layout {
+            Layout::Resident(data) => {
+                let start = offset as usize;
+                buf.copy_from_slice(&data[start..start + len]);
+            }
+            Layout::Raw { source, data_pos } => {
+                source.read_exact_at(buf, data_pos + offset)?;
+            }
+            Layout::Sectored { sector_size, .. } => {
+                let sector_size = *sector_size as u64;
+                let mut copied = 0;
+                while copied < len {
+                    let pos = offset + copied as u64;
+                    let index = (pos / sector_size) as usize;
+                    let within = (pos % sector_size) as usize;
+                    let sector = self.sector(index)?;
+                    let n = (sector.len() - within).min(len - copied);
+                    buf[copied..copied + n].copy_from_slice(&sector[within..within + n]);
+                    copied += n;
+                }
+            }
+        }
+
+        Ok(len)
+    }
+
+    /// Get a decoded sector, using the cache when possible
+    fn sector(&mut self, index: usize) -> Result<&[u8]> {
+        let cached = self.cache.iter().position(|(i, _)| *i == index);
+        stats::record_sector_lookup(cached.is_some());
+        if let Some(pos) = cached {
+            if pos != 0
+                && let Some(entry) = self.cache.remove(pos)
+            {
+                self.cache.push_front(entry);
+            }
+        } else {
+            let data = match &self.layout {
+                // Shared sectors were decoded without checksum checks
+                Layout::Sectored {
+                    shared: Some(shared),
+                    crcs: None,
+                    ..
+                } => shared.sector(index, || self.decode_sector(index))?,
+                _ => Arc::new(self.decode_sector(index)?),
+            };
+            if self.cache.len() >= self.cache_capacity
+                && let Some((_, evicted)) = self.cache.pop_back()
+            {
+                release(evicted);
+            }
+            self.cache.push_front((index, data));
+        }
+
+        Ok(&self.cache[0].1)
+    }
+
+    /// Read, decrypt and decompress a single sector
+    fn decode_sector(&self, index: usize) -> Result<Vec<u8>> {
+        let Layout::Sectored {
+            source,
+            file_info,
+            key,
+            sector_size,
+            offsets,
+            crcs,
+            ..
+        } = &self.layout
+        else {
+            return Err(Error::invalid_format("Stream is not sectored"));
+        };
+
+        let expected_size = (self.size - (index * sector_size) as u64).min(*sector_size as u64);
+        let expected_size = expected_size as usize;
+
+        let sector_start = offsets[index] as u64;
+        let sector_end = offsets[index + 1] as u64;
+        if sector_end < sector_start {
+            log::warn!(
+                "Invalid sector offsets detected: start={sector_start}, end={sector_end} for sector {index}. Using zeros."
+            );
+            return Ok(vec![0u8; expected_size]);
+        }
+
+        let pool = buffer_pool::global();
+        let mut sector_data = pool.take((sector_end - sector_start) as usize);
+        sector_data.resize((sector_end - sector_start) as usize, 0);
+        source.read_exact_at(&mut sector_data, file_info.file_pos + sector_start)?;
+        decrypt_sector(&mut sector_data, file_info, *key, index);
+
+        // Keep sector boundaries stable even if a sector decodes short
+        let mut sector = decompress_sector(&sector_data, file_info, index, expected_size);
+        pool.recycle(sector_data);
+        sector.resize(expected_size, 0);
+
+        if let Some(&expected) = crcs.as_ref().and_then(|crcs| crcs.get(index))
+            && expected != 0
+        {
+            let actual = adler2::adler32_slice(&sector);
+            if actual != expected {
+                pool.recycle(sector);
+                return Err(Error::ChecksumMismatch {
+                    file: format!("{} (sector {index})", self.name),
+                    expected,
+                    actual,
+                });
+            }
+        }
+        Ok(pool.detach(sector))
+    }
+}
+
+impl std::fmt::Debug for FileStream {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        let layout = match &self.layout {
+            Layout::Resident(_) => "resident",
+            Layout::Raw { .. } => "raw",
+            Layout::Sectored { .. } => "sectored",
+        };
+        f.debug_struct("FileStream")
+            .field("name", &self.name)
+            .field("size", &self.size)
+            .field("position", &self.position)
+            .field("layout", &layout)
+            .field("cached_sectors", &self.cache.len())
+            .finish()
+    }
+}
+
+impl Drop for FileStream {
+    fn drop(&mut self) {
+        for (_, sector) in self.cache.drain(..) {
+            release(sector);
+        }
+        if let Layout::Resident(data) = &mut self.layout {
+            release(std::mem::take(data));
+        }
+    }
+}
+
+/// Read the checksum table of the StormLib sector layout, if the file uses it
+///
+/// That layout stores one offset more than there are sectors, so sector data
+/// starts right after `sector_count + 2` offsets and the table spans the last
+/// two. The table is never encrypted and is compressed like a sector when
+/// that saves space.
+fn read_stormlib_crc_table(
+    source: &StreamSource,
+    file_info: &FileInfo,
+    key: u32,
+    offsets: &[u32],
+) -> Result<Option<Vec<u8>>> {
+    let sector_count = offsets.len() - 1;
+    let table_size = sector_count * 4;
+    if offsets[0] as usize != (sector_count + 2) * 4 {
+        return Ok(None);
+    }
+
+    // The extra offset has to be decrypted along with the rest of the table
+    let mut offset_data = vec![0u8; (sector_count + 2) * 4];
+    source.read_exact_at(&mut offset_data, file_info.file_pos)?;
+    let extended =
+        crate::archive::parse_sector_offsets(&mut offset_data, file_info, key, sector_count + 1)?;
+    let (table_start, table_end) = (extended[sector_count], extended[sector_count + 1]);
+    let stored_size = table_end.saturating_sub(table_start) as usize;
+    if stored_size == 0 || stored_size > table_size {
+        return Ok(None);
+    }
+
+    let mut stored = vec![0u8; stored_size];
+    source.read_exact_at(&mut stored, file_info.file_pos + u64::from(table_start))?;
+    if stored_size == table_size {
+        return Ok(Some(stored));
+    }
+    compression::decompress(&stored[1..], stored[0], table_size).map(Some)
+}
+
+/// Hand a buffer back to the pool unless another stream or a cache shares it
+fn release(buffer: Arc<Vec<u8>>) {
+    if let Ok(buffer) = Arc::try_unwrap(buffer) {
+        buffer_pool::global().recycle(buffer);
+    }
+}
+
+impl Read for FileStream {
+    fn read(&mut self, buf: &mut [u8]) -> io::Result<usize> {
+        let n = self.read_at(self.position, buf).map_err(io::Error::other)?;
+        self.position += n as u64;
+        Ok(n)
+    }
+}
+
+impl Seek for FileStream {
+    fn seek(&mut self, pos: SeekFrom) -> io::Result<u64> {
+        let new_pos = match pos {
+            SeekFrom::Start(offset) => Some(offset),
+            SeekFrom::End(offset) => self.size.checked_add_signed(offset),
+            SeekFrom::Current(offset) => self.position.checked_add_signed(offset),
+        };
+
+        match new_pos {
+            Some(pos) => {
+                self.position = pos;
+                Ok(pos)
+            }
+            None => Err(io::Error::new(
+                io::ErrorKind::InvalidInput,
+                "invalid seek to a negative position",
+            )),
+        }
+    }
+}
+
+/// Read exactly `buf.len()` bytes at `offset` without using the shared file cursor
+#[cfg(unix)]
+pub(crate) fn read_exact_at(file: &File, buf: &mut [u8], offset: u64) -> io::Result<()> {
+    use std::os::unix::fs::FileExt;
+    file.read_exact_at(buf, offset)
+}
+
+/// Read exactly `buf.len()` bytes at `offset` without using the shared file cursor
+#[cfg(windows)]
+pub(crate) fn read_exact_at(file: &File, mut buf: &mut [u8], mut offset: u64) -> io::Result<()> {
+    use std::os::windows::fs::FileExt;
+    while !buf.is_empty() {
+        match file.seek_read(buf, offset) {
+            Ok(0) => {
+                return Err(io::Error::new(
+                    io::ErrorKind::UnexpectedEof,
+                    "failed to fill whole buffer",
+                ));
+            }
+            Ok(n) => {
+                buf = &mut buf[n..];
+                offset += n as u64;
+            }
+            Err(e) if e.kind() == io::ErrorKind::Interrupted => {}
+            Err(e) => return Err(e),
+        }
+    }
+    Ok(())
+}
+
+/// Read exactly `buf.len()` bytes at `offset`
+#[cfg(not(any(unix, windows)))]
+pub(crate) fn read_exact_at(file: &File, buf: &mut [u8], offset: u64) -> io::Result<()> {
+    let mut file = file;
+    file.seek(SeekFrom::Start(offset))?;
+    file.read_exact(buf)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::{Archive, ArchiveBuilder};
+    use std::sync::atomic::Ordering;
+    use tempfile::TempDir;
+
+    fn patterned(len: usize) -> Vec<u8> {
+        (0..len).map(|i| (i * 7 + i / 251) as u8).collect()
+    }
+
+    #[test]
+    fn test_stream_matches_read_file() -> Result<()> {
+        let temp_dir = TempDir::new()?;
+        let path = temp_dir.path().join("stream.mpq");
+        let large = patterned(200_000);
+        let small = b"small file".to_vec();
+
+        ArchiveBuilder::new()
+            .add_file_data(large.clone(), "large.bin")
+            .add_file_data(small.clone(), "small.txt")
+            .build(&path)?;
+
+        let archive = Archive::open(&path)?;
+
+        let mut stream = archive.open_file_stream("large.bin")?;
+        assert_eq!(stream.len(), large.len() as u64);
+        let mut data = Vec::new();
+        stream.read_to_end(&mut data)?;
+        assert_eq!(data, large);
+
+        let mut stream = archive.open_file_stream("small.txt")?;
+        let mut data = Vec::new();
+        stream.read_to_end(&mut data)?;
+        assert_eq!(data, small);
+
+        Ok(())
+    }
+
+    #[test]
+    fn test_stream_seek_and_read_at() -> Result<()> {
+        let temp_dir = TempDir::new()?;
+        let path = temp_dir.path().join("seek.mpq");
+        let large = patterned(100_000);
+
+        ArchiveBuilder::new()
+            .add_file_data(large.clone(), "large.bin")
+            .build(&path)?;
+
+        let archive = Archive::open(&path)?;
+        let mut stream = archive.open_file_stream("large.bin")?;
+
+        // Read across a sector boundary
+        let mut buf = vec![0u8; 10_000];
+        let n = stream.read_at(4_000, &mut buf)?;
+        assert_eq!(n, buf.len());
+        assert_eq!(&buf[..], &large[4_000..14_000]);
+
+        // Short read at the end of the file
+        stream.seek(SeekFrom::End(-10))?;
+        let n = stream.read(&mut buf)?;
+        assert_eq!(n, 10);
+        assert_eq!(&buf[..10], &large[large.len() - 10..]);
+
+        // Reads past the end return nothing
+        assert_eq!(stream.read_at(large.len() as u64 + 1, &mut buf)?, 0);
+
+        Ok(())
+    }
+
+    #[test]
+    fn test_cloned_streams_read_in_parallel() -> Result<()> {
+        let temp_dir = TempDir::new()?;
+        let path = temp_dir.path().join("clone.mpq");
+        let large = patterned(150_000);
+        ArchiveBuilder::new()
+            .add_file_data(large.clone(), "large.bin")
+            .build(&path)?;
+
+        let archive = Archive::open(&path)?;
+        let mut stream = archive.open_file_stream("large.bin")?;
+        stream.seek(SeekFrom::Start(1234))?;
+
+        let chunk = 40_000;
+        std::thread::scope(|scope| {
+            let readers: Vec<_> = (0..large.len().div_ceil(chunk))
+                .map(|i| {
+                    let mut clone = stream.try_clone().unwrap();
+                    scope.spawn(move || {
+                        let mut buf = vec![0u8; chunk];
+                        let n = clone.read_at((i * chunk) as u64, &mut buf).unwrap();
+                        buf.truncate(n);
+                        (i, buf)
+                    })
+                })
+                .collect();
+            for reader in readers {
+                let (i, buf) = reader.join().unwrap();
+                let start = i * chunk;
+                assert_eq!(buf, large[start..(start + chunk).min(large.len())]);
+            }
+        });
+
+        // Clones start at 0 and leave the original's position alone
+        let mut clone = stream.try_clone()?;
+        let mut first = [0u8; 4];
+        clone.read_exact(&mut first)?;
+        assert_eq!(first, large[..4]);
+        assert_eq!(stream.stream_position()?, 1234);
+        Ok(())
+    }
+
+    #[test]
+    fn test_sector_buffers_are_recycled() -> Result<()> {
+        let temp_dir = TempDir::new()?;
+        let path = temp_dir.path().join("recycle.mpq");
+        let large = patterned(100_000);
+
+        ArchiveBuilder::new()
+            .add_file_data(large.clone(), "large.bin")
+            .build(&path)?;
+
+        let archive = Archive::open(&path)?;
+        let read_once = || -> Result<()> {
+            let mut stream = archive.open_file_stream("large.bin")?;
+            let mut data = Vec::new();
+            stream.read_to_end(&mut data)?;
+            assert_eq!(data, large);
+            Ok(())
+        };
+
+        // Other tests share the global pool, so only check that reuse happens
+        let hits = || {
+            buffer_pool::global()
+                .statistics()
+                .hits
+                .load(Ordering::Relaxed)
+        };
+        read_once()?;
+        let before = hits();
+        read_once()?;
+        assert!(hits() > before);
+
+        Ok(())
+    }
+
+    #[test]
+    fn test_from_vec() {
+        let mut stream = FileStream::from_vec("memory.txt", b"hello world".to_vec());
+        assert_eq!(stream.name(), "memory.txt");
+        assert!(!stream.is_sectored());
+
+        let mut buf = [0u8; 5];
+        stream.seek(SeekFrom::Start(6)).unwrap();
+        stream.read_exact(&mut buf).unwrap();
+        assert_eq!(&buf, b"world");
+        assert_eq!(stream.as_slice(), Some(&b"hello world"[..]));
+    }
+
+    #[test]
+    #[cfg(feature = "mmap")]
+    fn test_mapped_stored_file_is_borrowed() -> Result<()> {
+        use crate::OpenOptions;
+
+        let temp_dir = TempDir::new()?;
+        let path = temp_dir.path().join("mapped.mpq");
+        let stored = patterned(50_000);
+        let compressed = patterned(50_000);
+
+        ArchiveBuilder::new()
+            .add_file_data_with_options(stored.clone(), "stored.blp", 0, false, 0)
+            .add_file_data(compressed.clone(), "compressed.bin")
+            .build(&path)?;
+
+        let archive = OpenOptions::new().enable_memory_mapping().open(&path)?;
+        assert!(archive.is_memory_mapped());
+
+        let stream = archive.open_file_stream("stored.blp")?;
+        assert_eq!(stream.as_slice(), Some(&stored[..]));
+
+        let mut stream = archive.open_file_stream("compressed.bin")?;
+        assert!(stream.as_slice().is_none());
+        let mut data = Vec::new();
+        stream.read_to_end(&mut data)?;
+        assert_eq!(data, compressed);
+
+        Ok(())
+    }
+
+    #[test]
+    fn test_streams_share_sector_cache() -> Result<()> {
+        let temp_dir = TempDir::new()?;
+        let path = temp_dir.path().join("shared.mpq");
+        let large = patterned(100_000);
+        ArchiveBuilder::new()
+            .add_file_data(large.clone(), "large.bin")
+            .build(&path)?;
+
+        let cache = Arc::new(crate::SectorCache::new(1 << 20));
+        let archive = crate::OpenOptions::new()
+            .sector_cache(Arc::clone(&cache))
+            .open(&path)?;
+
+        let mut first = archive.open_file_stream("large.bin")?;
+        let mut data = Vec::new();
+        first.read_to_end(&mut data)?;
+        assert_eq!(data, large);
+        let sectors = archive.sector_cache_stats().unwrap().misses;
+        assert!(sectors > 1);
+
+        // A second stream decodes nothing and reads the same buffers
+        let mut second = archive.open_file_stream("large.bin")?;
+        let mut data = Vec::new();
+        second.read_to_end(&mut data)?;
+        assert_eq!(data, large);
+        let stats = archive.sector_cache_stats().unwrap();
+        assert_eq!((stats.hits, stats.misses), (sectors, sectors));
+        assert_eq!(stats.entries as u64, sectors);
+        assert_eq!(stats.bytes, large.len());
+
+        drop((first, second));
+        drop(archive);
+        assert_eq!(cache.stats().entries, 0);
+        Ok(())
+    }
+
+    #[test]
+    fn test_stormlib_sector_crc_layout() -> Result<()> {
+        use std::io::Write;
+
+        let temp_dir = TempDir::new()?;
+        let path = temp_dir.path().join("crc.mpq");
+        // Identical incompressible sectors: stored as-is, with checksums that
+        // compress well
+        let mut state = 0x2545_F491u32;
+        let sector: Vec<u8> = (0..4096)
+            .map(|_| {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                state as u8
+            })
+            .collect();
+        let sector_count = 25;
+        let data = sector.repeat(sector_count);
+        ArchiveBuilder::new()
+            .generate_crcs(true)
+            .add_file_data(data.clone(), "crc.bin")
+            .build(&path)?;
+
+        // Rewrite the file in place in the StormLib layout: one more offset,
+        // the sectors, then the compressed checksum table
+        let info = Archive::open(&path)?.find_file("crc.bin")?.unwrap();
+        let mut file = std::fs::OpenOptions::new()
+            .read(true)
+            .write(true)
+            .open(&path)?;
+        let mut offset_data = vec![0u8; (sector_count + 1) * 4];
+        file.seek(SeekFrom::Start(info.file_pos))?;
+        file.read_exact(&mut offset_data)?;
+        let offsets: Vec<u32> = offset_data
+            .chunks_exact(4)
+            .map(|b| u32::from_le_bytes([b[0], b[1], b[2], b[3]]))
+            .collect();
+        let mut region = vec![0u8; offsets[sector_count] as usize];
+        file.seek(SeekFrom::Start(info.file_pos))?;
+        file.read_exact(&mut region)?;
+        let sectors = &region[offsets[0] as usize..];
+        let table = &region[offsets.len() * 4..offsets[0] as usize];
+        let packed = compression::compress(table, compression::flags::ZLIB)?;
+        assert!(packed.len() < table.len());
+
+        let data_start = (sector_count + 2) * 4;
+        let mut rewritten = Vec::new();
+        for offset in &offsets {
+            let moved = (offset - offsets[0]) as usize + data_start;
+            rewritten.extend_from_slice(&(moved as u32).to_le_bytes());
+        }
+        let table_end = data_start + sectors.len() + packed.len();
+        rewritten.extend_from_slice(&(table_end as u32).to_le_bytes());
+        rewritten.extend_from_slice(sectors);
+        rewritten.extend_from_slice(&packed);
+        assert!(rewritten.len() <= region.len());
+        file.seek(SeekFrom::Start(info.file_pos))?;
+        file.write_all(&rewritten)?;
+        drop(file);
+
+        let archive = Archive::open(&path)?;
+        let mut stream = archive.open_file_stream("crc.bin")?;
+        assert!(stream.enable_sector_crc_check()?);
+        let mut read = Vec::new();
+        stream.read_to_end(&mut read)?;
+        assert_eq!(read, data);
+        drop(archive);
+
+        // Damage the second sector; the table catches it
+        let mut file = std::fs::OpenOptions::new().write(true).open(&path)?;
+        file.seek(SeekFrom::Start(info.file_pos + data_start as u64 + 5000))?;
+        file.write_all(&[!data[5000]])?;
+        drop(file);
+
+        let archive = Archive::open(&path)?;
+        let mut stream = archive.open_file_stream("crc.bin")?;
+        assert!(stream.enable_sector_crc_check()?);
+        let mut buf = vec![0u8; 16];
+        assert_eq!(stream.read_at(0, &mut buf)?, 16);
+        assert!(matches!(
+            stream.read_at(4096, &mut buf),
+            Err(Error::ChecksumMismatch { .. })
+        ));
+        Ok(())
+    }
+}
@@ -0,0 +1,500 @@
+//! Persistent on-disk cache of archive tables and listings
+//!
+//! Opening an archive decrypts its hash and block tables, and listing it
+//! parses `(listfile)` and resolves every name. Processes that open the same
+//! archives over and over can enable an [`IndexCache`] with
+//! [`OpenOptions::index_cache`](crate::OpenOptions::index_cache), which keeps
+//! the decrypted tables and the sorted listing in a sidecar file per archive
+//! and restores them on the next open instead of rebuilding them.
+//!
+//! An entry is keyed by the archive's canonical path, file size, modification
+//! time and the MD5 of its header bytes; if any of them changed, the entry is
+//! ignored and rewritten. Entries also carry an MD5 of their own contents, so
+//! a truncated or damaged file is treated as a miss rather than an error.
+//!
+//! Only archives with classic hash and block tables are cached. Archives that
+//! rely on HET/BET tables are loaded as usual.
+//!
+//! # Entry layout
+//!
+//! All integers are little-endian and every section starts on an 8-byte
+//! boundary, so an entry can be read in place from a mapping:
+//!
+//! | Section      | Contents                                                     |
+//! |--------------|--------------------------------------------------------------|
+//! | Header       | magic, version, flags, archive size, mtime, header MD5, counts |
+//! | Path         | canonical archive path (UTF-8)                               |
+//! | Hash table   | 16-byte entries, decrypted, in on-disk order                 |
+//! | Block table  | 16-byte entries, decrypted, in on-disk order                 |
+//! | Hi-block     | `u16` per block                                              |
+//! | Name records | 40 bytes per listed file, sorted like [`NameIndex`]          |
+//! | Name bytes   | concatenated file names                                      |
+//! | Checksum     | MD5 of everything before it                                  |
+
+use crate::archive::FileEntry;
+use crate::name_index::NameIndex;
+use crate::tables::{BlockTable, HashTable, HiBlockTable};
+use crate::{Archive, Result};
+use md5::{Digest, Md5};
+use std::fs::{self, File};
+use std::io::{Read, Seek, SeekFrom, Write};
+use std::path::{Path, PathBuf};
+use std::time::UNIX_EPOCH;
+
+/// Magic bytes at the start of every entry
+const MAGIC: &[u8; 8] = b"WMPQIDX\0";
+/// Version of the entry layout
+const VERSION: u32 = 1;
+/// File extension of cache entries
+const EXTENSION: &str = "mpqidx";
+/// Size of the fixed entry header
+const HEADER_SIZE: usize = 72;
+/// Size of one name record
+pub(crate) const NAME_RECORD_SIZE: usize = 40;
+/// The entry includes a listing
+const FLAG_HAS_LISTING: u32 = 0x1;
+/// Stored in a name record for a file without a block index
+const NO_BLOCK_INDEX: u32 = u32::MAX;
+
+/// Directory of cached archive indexes
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct IndexCache {
+    dir: PathBuf,
+}
+
+/// Tables and listing restored from a cache entry
+#[derive(Debug)]
+pub(crate) struct CachedIndex {
+    pub(crate) hash_table: HashTable,
+    pub(crate) block_table: BlockTable,
+    pub(crate) hi_block_table: Option<HiBlockTable>,
+    pub(crate) listing: Option<Vec<FileEntry>>,
+}
+
+/// What an entry must match to be used for an archive
+#[derive(Debug, PartialEq, Eq)]
+pub(crate) struct CacheKey {
+    pub(crate) path: String,
+    pub(crate) size: u64,
+    pub(crate) mtime: u64,
+    pub(crate) header_md5: [u8; 16],
+}
+
+impl IndexCache {
+    /// Use `dir` for cache entries
+    ///
+    /// The directory is created when the first entry is written.
+    pub fn new<P: Into<PathBuf>>(dir: P) -> Self {
+        Self { dir: dir.into() }
+    }
+
+    /// Directory holding the cache entries
+    pub fn dir(&self) -> &Path {
+        &self.dir
+    }
+
+    /// Path of the entry for the archive at `archive_path`
+    pub fn entry_path<P: AsRef<Path>>(&self, archive_path: P) -> PathBuf {
+        let path = archive_path.as_ref();
+        let canonical = fs::canonicalize(path).unwrap_or_else(|_| path.to_path_buf());
+        self.entry_path_for(&canonical.to_string_lossy())
+    }
+
+    fn entry_path_for(&self, canonical_path: &str) -> PathBuf {
+        let digest = Md5::digest(canonical_path.as_bytes());
+        self.dir
+            .join(format!("{}.{EXTENSION}", hex::encode(digest)))
+    }
+
+    /// Restore the tables of `archive`, or `None` if there is no valid entry
+    pub(crate) fn load(&self, archive: &Archive) -> Option<CachedIndex> {
+        let key = CacheKey::for_archive(archive).ok()?;
+        let path = self.entry_path_for(&key.path);
+        let data = fs::read(&path).ok()?;
+        match decode(&data, &key) {
+            Some(index) => {
+                log::debug!("Loaded index cache entry {}", path.display());
+                Some(index)
+            }
+            None => {
+                log::debug!("Ignoring stale index cache entry {}", path.display());
+                None
+            }
+        }
+    }
+
+    /// Write an entry for `archive`, whose tables have just been loaded
+    ///
+    /// Returns false if the archive cannot be cached because it has no
+    /// classic hash and block tables. The listing written into the entry is
+    /// kept on the archive, so the following [`Archive::list`] is answered
+    /// without parsing `(listfile)` again.
+    pub(crate) fn store(&self, archive: &mut Archive) -> Result<bool> {
+        if archive.het_table().is_some() || archive.bet_table().is_some() {
+            return Ok(false);
+        }
+        let (Some(hash_table), Some(block_table)) = (archive.hash_table(), archive.block_table())
+        else {
+            return Ok(false);
+        };
+        let key = CacheKey::for_archive(archive)?;
+        let mut data = encode_tables(&key, hash_table, block_table, archive.hi_block_table());
+
+        let listing = archive
+            .list()
+            .ok()
+            .map(|entries| NameIndex::new(entries).entries().to_vec());
+        encode_listing(&mut data, listing.as_deref());
+        archive.set_cached_listing(listing);
+
+        fs::create_dir_all(&self.dir)?;
+        let path = self.entry_path_for(&key.path);
+        write_atomically(&path, &data)?;
+        log::debug!("Wrote index cache entry {}", path.display());
+        Ok(true)
+    }
+}
+
+impl CacheKey {
+    pub(crate) fn for_archive(archive: &Archive) -> Result<Self> {
+        let canonical = fs::canonicalize(archive.path())?;
+        let metadata = fs::metadata(&canonical)?;
+        let mtime = metadata
+            .modified()
+            .ok()
+            .and_then(|time| time.duration_since(UNIX_EPOCH).ok())
+            .map_or(0, |since| since.as_nanos() as u64);
+
+        let mut header = vec![0u8; archive.header().header_size as usize];
+        let mut file = File::open(&canonical)?;
+        file.seek(SeekFrom::Start(archive.archive_offset()))?;
+        file.read_exact(&mut header)?;
+
+        Ok(Self {
+            path: canonical.to_string_lossy().into_owned(),
+            size: metadata.len(),
+            mtime,
+            header_md5: Md5::digest(&header).into(),
+        })
+    }
+}
+
+/// Write `data` to a temporary file next to `path`, then move it into place
+///
+/// Readers never see a partially written entry.
+pub(crate) fn write_atomically(path: &Path, data: &[u8]) -> Result<()> {
+    let mut temp_path = path.as_os_str().to_owned();
+    temp_path.push(format!(".{}.tmp", std::process::id()));
+    let temp_path = PathBuf::from(temp_path);
+    let result = File::create(&temp_path)
+        .and_then(|mut file| file.write_all(data))
+        .and_then(|()| fs::rename(&temp_path, path));
+    if result.is_err() {
+        let _ = fs::remove_file(&temp_path);
+    }
+    Ok(result?)
+}
+
+pub(crate) fn pad_to_8(data: &mut Vec<u8>) {
+    data.resize(data.len().next_multiple_of(8), 0);
+}
+
+/// Encode the header and tables; the counts of the listing are filled in by
+/// [`encode_listing`]
+fn encode_tables(
+    key: &CacheKey,
+    hash_table: &HashTable,
+    block_table: &BlockTable,
+    hi_block_table: Option<&HiBlockTable>,
+) -> Vec<u8> {
+    let hash_entries = hash_table.entries();
+    let block_entries = block_table.entries();
+    let hi_block_entries = hi_block_table.map_or(&[][..], HiBlockTable::entries);
+
+    let mut data = Vec::with_capacity(
+        HEADER_SIZE + key.path.len() + 16 * (hash_entries.len() + block_entries.len()) + 64,
+    );
+    data.extend_from_slice(MAGIC);
+    data.extend_from_slice(&VERSION.to_le_bytes());
+    data.extend_from_slice(&0u32.to_le_bytes()); // flags
+    data.extend_from_slice(&key.size.to_le_bytes());
+    data.extend_from_slice(&key.mtime.to_le_bytes());
+    data.extend_from_slice(&key.header_md5);
+    for count in [
+        key.path.len(),
+        hash_entries.len(),
+        block_entries.len(),
+        hi_block_entries.len(),
+        0, // names
+        0, // name bytes
+    ] {
+        data.extend_from_slice(&(count as u32).to_le_bytes());
+    }
+    debug_assert_eq!(data.len(), HEADER_SIZE);
+
+    data.extend_from_slice(key.path.as_bytes());
+    pad_to_8(&mut data);
+    for entry in hash_entries {
+        data.extend_from_slice(&entry.name_1.to_le_bytes());
+        data.extend_from_slice(&entry.name_2.to_le_bytes());
+        data.extend_from_slice(&entry.locale.to_le_bytes());
+        data.extend_from_slice(&entry.platform.to_le_bytes());
+        data.extend_from_slice(&entry.block_index.to_le_bytes());
+    }
+    for entry in block_entries {
+        data.extend_from_slice(&entry.file_pos.to_le_bytes());
+        data.extend_from_slice(&entry.compressed_size.to_le_bytes());
+        data.extend_from_slice(&entry.file_size.to_le_bytes());
+        data.extend_from_slice(&entry.flags.to_le_bytes());
+    }
+    for &high in hi_block_entries {
+        data.extend_from_slice(&high.to_le_bytes());
+    }
+    pad_to_8(&mut data);
+    data
+}
+
+/// Append the name records, name bytes and checksum
+fn encode_listing(data: &mut Vec<u8>, listing: Option<&[FileEntry]>) {
+    let entries = listing.unwrap_or_default();
+    let names_len = encode_name_records(data, entries);
+    pad_to_8(data);
+
+    let flags = if listing.is_some() {
+        FLAG_HAS_LISTING
+    } else {
+        0
+    };
+    data[12..16].copy_from_slice(&flags.to_le_bytes());
+    data[64..68].copy_from_slice(&(entries.len() as u32).to_le_bytes());
+    data[68..72].copy_from_slice(&(names_len as u32).to_le_bytes());
+
+    let checksum = Md5::digest(&data[..]);
+    data.extend_from_slice(&checksum);
+}
+
+/// Append a name record per entry followed by the concatenated names
+///
+/// Returns the length of the names.
+pub(crate) fn encode_name_records(data: &mut Vec<u8>, entries: &[FileEntry]) -> usize {
+    let mut names = Vec::new();
+    for entry in entries {
+        let (hash_index, block_index) = entry.table_indices.unwrap_or((0, None));
+        data.extend_from_slice(&(names.len() as u32).to_le_bytes());
+        data.extend_from_slice(&(entry.name.len() as u32).to_le_bytes());
+        data.extend_from_slice(&entry.size.to_le_bytes());
+        data.extend_from_slice(&entry.compressed_size.to_le_bytes());
+        data.extend_from_slice(&entry.flags.to_le_bytes());
+        data.extend_from_slice(&(hash_index as u32).to_le_bytes());
+        data.extend_from_slice(
+            &block_index
+                .map_or(NO_BLOCK_INDEX, |i| i as u32)
+                .to_le_bytes(),
+        );
+        data.extend_from_slice(&u32::from(entry.table_indices.is_some()).to_le_bytes());
+        names.extend_from_slice(entry.name.as_bytes());
+    }
+    data.extend_from_slice(&names);
+    names.len()
+}
+
+/// Decode `count` name records written by [`encode_name_records`]
+pub(crate) fn decode_name_records(
+    records: &[u8],
+    names: &[u8],
+    count: usize,
+) -> Option<Vec<FileEntry>> {
+    if records.len() != count.checked_mul(NAME_RECORD_SIZE)? {
+        return None;
+    }
+    let mut records = Reader {
+        data: records,
+        pos: 0,
+    };
+    let mut entries = Vec::with_capacity(count);
+    for _ in 0..count {
+        let name_off = records.u32()? as usize;
+        let name_len = records.u32()? as usize;
+        let size = records.u64()?;
+        let compressed_size = records.u64()?;
+        let flags = records.u32()?;
+        let hash_index = records.u32()? as usize;
+        let block_index = records.u32()?;
+        let has_indices = records.u32()? != 0;
+
+        let name = names.get(name_off..name_off.checked_add(name_len)?)?;
+        entries.push(FileEntry {
+            name: String::from_utf8(name.to_vec()).ok()?,
+            size,
+            compressed_size,
+            flags,
+            hashes: None,
+            table_indices: has_indices.then_some((
+                hash_index,
+                (block_index != NO_BLOCK_INDEX).then_some(block_index as usize),
+            )),
+        });
+    }
+    Some(entries)
+}
+
+/// Bounds-checked little-endian reader over an entry
+struct Reader<'a> {
+    data: &'a [u8],
+    pos: usize,
+}
+
+impl<'a> Reader<'a> {
+    fn bytes(&mut self, len: usize) -> Option<&'a [u8]> {
+        let bytes = self.data.get(self.pos..self.pos.checked_add(len)?)?;
+        self.pos += len;
+        Some(bytes)
+    }
+
+    fn u16(&mut self) -> Option<u16> {
+        self.bytes(2).map(|b| u16::from_le_bytes([b[0], b[1]]))
+    }
+
+    fn u32(&mut self) -> Option<u32> {
+        self.bytes(4)
+            .map(|b| u32::from_le_bytes(b.try_into().unwrap()))
+    }
+
+    fn u64(&mut self) -> Option<u64> {
+        self.bytes(8)
+            .map(|b| u64::from_le_bytes(b.try_into().unwrap()))
+    }
+
+    fn align(&mut self) {
+        self.pos = self.pos.next_multiple_of(8);
+    }
+}
+
+/// Decode an entry, or `None` if it is damaged or does not match `key`
+fn decode(data: &[u8], key: &CacheKey) -> Option<CachedIndex> {
+    let (body, checksum) = data.split_at_checked(data.len().checked_sub(16)?)?;
+    if Md5::digest(body)[..] != checksum[..] {
+        return None;
+    }
+
+    let mut reader = Reader { data: body, pos: 0 };
+    if reader.bytes(8)? != MAGIC || reader.u32()? != VERSION {
+        return None;
+    }
+    let flags = reader.u32()?;
+    let size = reader.u64()?;
+    let mtime = reader.u64()?;
+    let header_md5 = reader.bytes(16)?;
+    let path_len = reader.u32()? as usize;
+    let hash_count = reader.u32()?;
+    let block_count = reader.u32()?;
+    let hi_block_count = reader.u32()? as usize;
+    let name_count = reader.u32()? as usize;
+    let names_len = reader.u32()? as usize;
+
+    let path = std::str::from_utf8(reader.bytes(path_len)?).ok()?;
+    if path != key.path || size != key.size || mtime != key.mtime || header_md5 != key.header_md5 {
+        return None;
+    }
+    reader.align();
+
+    let hash_bytes = reader.bytes(hash_count as usize * 16)?;
+    let hash_table = HashTable::from_bytes_decrypted(hash_bytes, hash_count).ok()?;
+    let block_bytes = reader.bytes(block_count as usize * 16)?;
+    let block_table = BlockTable::from_bytes_decrypted(block_bytes, block_count).ok()?;
+    let hi_block_table = if hi_block_count > 0 {
+        let mut table = HiBlockTable::new(hi_block_count);
+        for i in 0..hi_block_count {
+            table.set(i, reader.u16()?);
+        }
+        Some(table)
+    } else {
+        None
+    };
+    reader.align();
+
+    let records = reader.bytes(name_count.checked_mul(NAME_RECORD_SIZE)?)?;
+    let names = reader.bytes(names_len)?;
+    let listing = if flags & FLAG_HAS_LISTING != 0 {
+        Some(decode_name_records(records, names, name_count)?)
+    } else {
+        None
+    };
+
+    Some(CachedIndex {
+        hash_table,
+        block_table,
+        hi_block_table,
+        listing,
+    })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::path::fold_mpq_path;
+    use crate::{ArchiveBuilder, OpenOptions};
+    use tempfile::TempDir;
+
+    #[test]
+    fn test_index_cache_round_trip_and_invalidation() -> Result<()> {
+        let temp_dir = TempDir::new()?;
+        let path = temp_dir.path().join("cached.mpq");
+        let cache = IndexCache::new(temp_dir.path().join("index"));
+
+        ArchiveBuilder::new()
+            .add_file_data(b"first".to_vec(), "Data\\b.txt")
+            .add_file_data(b"second file".to_vec(), "data\\A.txt")
+            .build(&path)?;
+
+        // The first open builds the tables and writes the entry
+        let options = OpenOptions::new().index_cache(cache.clone());
+        let mut archive = Archive::open_with_options(&path, options.clone())?;
+        let entry_path = cache.entry_path(&path);
+        assert!(entry_path.exists());
+        let expected = archive.list()?;
+        let folded: Vec<String> = expected.iter().map(|e| fold_mpq_path(&e.name)).collect();
+        assert!(folded.is_sorted());
+        assert!(folded.contains(&"DATA\\A.TXT".to_string()));
+
+        // The second open restores them from the entry
+        let key = CacheKey::for_archive(&archive)?;
+        let index = decode(&fs::read(&entry_path)?, &key).expect("valid entry");
+        assert_eq!(index.listing.as_ref().map(Vec::len), Some(expected.len()));
+        drop(archive);
+
+        let mut archive = Archive::open_with_options(&path, options.clone())?;
+        let listed = archive.list()?;
+        assert_eq!(listed.len(), expected.len());
+        for (a, b) in listed.iter().zip(&expected) {
+            assert_eq!(
+                (&a.name, a.size, a.compressed_size, a.flags, a.table_indices),
+                (&b.name, b.size, b.compressed_size, b.flags, b.table_indices)
+            );
+        }
+        assert_eq!(archive.read_file("data\\a.txt")?, b"second file");
+
+        // A damaged entry is a miss, not an error
+        let mut data = fs::read(&entry_path)?;
+        data[HEADER_SIZE] ^= 0xFF;
+        assert!(decode(&data, &key).is_none());
+
+        // Rebuilding the archive invalidates the entry and rewrites it
+        drop(archive);
+        ArchiveBuilder::new()
+            .add_file_data(b"replaced".to_vec(), "other.txt")
+            .build(&path)?;
+        let mut archive = Archive::open_with_options(&path, options)?;
+        assert!(archive.find_file("Data\\b.txt")?.is_none());
+        assert_eq!(archive.read_file("other.txt")?, b"replaced");
+        assert!(
+            archive
+                .list()?
+                .iter()
+                .any(|entry| entry.name == "other.txt")
+        );
+        let key = CacheKey::for_archive(&archive)?;
+        assert!(decode(&fs::read(&entry_path)?, &key).is_some());
+        Ok(())
+    }
+}
@@ -325,6 +325,37 @@ impl MemoryMappedArchive {
         Ok(&self.mmap[start..end])
     }
 
+    /// Hint that `len` bytes at `offset` will be read soon
+    ///
+    /// Asks the kernel to start paging the range in, so that reading it
+    /// later does not fault one page at a time. This is only a hint: the
+    /// range is clamped to the mapping, failures are ignored, and it does
+    /// nothing on non-Unix platforms.
+    pub fn advise_willneed(&self, offset: u64, len: usize) {
+        #[cfg(unix)]
+        {
+            let page_size = unsafe { libc::sysconf(libc::_SC_PAGESIZE) }.max(1) as u64;
+            let start = offset - offset % page_size;
+            let end = offset
+                .saturating_add(len as u64)
+                .min(self.mmap.len() as u64);
+            if start >= end {
+                return;
+            }
+            // SAFETY: the page-aligned range lies inside the mapping, and
+            // MADV_WILLNEED does not change its contents
+            unsafe {
+                libc::madvise(
+                    self.mmap.as_ptr().add(start as usize) as *mut libc::c_void,
+                    (end - start) as usize,
+                    libc::MADV_WILLNEED,
+                );
+            }
+        }
+        #[cfg(not(unix))]
+        let _ = (offset, len);
+    }
+
     /// Validate read bounds against memory mapping size
     fn validate_read_bounds(&self, offset: u64, len: usize) -> Result<()> {
         let start = offset;
@@ -43,20 +43,22 @@
 //!
 //! ### Memory-Mapped High Performance Access
 //!
-//! ```no_run,ignore
+//! ```no_run
 //! # #[cfg(feature = "mmap")]
-//! use wow_mpq::{Archive, OpenOptions};
+//! use wow_mpq::OpenOptions;
 //!
 //! # #[cfg(feature = "mmap")]
 //! # fn main() -> Result<(), wow_mpq::Error> {
 //! // Open archive with memory mapping enabled for better performance
-//! let mut archive = OpenOptions::new()
+//! let archive = OpenOptions::new()
 //!     .enable_memory_mapping()
 //!     .open("large_archive.mpq")?;
 //!
-//! // High-performance file reading using memory mapping
-//! let data = archive.read_file_mapped("large_file.m2")?;
-//! println!("Read {} bytes using memory mapping", data.len());
+//! // Stored (uncompressed) files can be borrowed straight from the mapping
+//! let stream = archive.open_file_stream("large_texture.blp")?;
+//! if let Some(data) = stream.as_slice() {
+//!     println!("Borrowed {} bytes without copying", data.len());
+//! }
 //! # Ok(())
 //! # }
 //! # #[cfg(not(feature = "mmap"))]
@@ -127,19 +129,30 @@ pub mod builder;
 pub mod compare;
 pub mod compression;
 pub mod crypto;
+pub mod data_folder;
 pub mod error;
+pub mod file_stream;
 pub mod header;
+pub mod index_cache;
 pub mod io;
+pub mod lookup_cache;
 pub mod modification;
+pub mod name_index;
 pub mod parallel;
 pub mod patch;
 pub mod patch_chain;
 pub mod path;
 pub mod rebuild;
+pub mod sector_cache;
 pub mod security;
+#[cfg(feature = "mmap")]
+#[cfg_attr(docsrs, doc(cfg(feature = "mmap")))]
+pub mod shared_index;
 pub mod single_archive_parallel;
 pub mod special_files;
+pub mod stats;
 pub mod tables;
+pub mod verify;
 
 // SIMD optimizations (optional feature)
 #[cfg(feature = "simd")]
@@ -153,8 +166,8 @@ pub mod debug;
 
 // Re-export commonly used types
 pub use archive::{
-    Archive, ArchiveInfo, FileEntry, FileInfo, Md5Status, OpenOptions, SignatureStatus, TableInfo,
-    UserDataInfo,
+    Archive, ArchiveInfo, FileEntry, FileInfo, FileMetadata, Md5Status, OpenOptions,
+    SignatureStatus, TableInfo, UserDataInfo,
 };
 pub use buffer_pool::{BufferPool, BufferSize, PoolConfig, PoolStatistics};
 pub use builder::{ArchiveBuilder, AttributesOption, ListfileOption};
@@ -162,17 +175,28 @@ pub use compare::{
     CompareOptions, ComparisonResult, ComparisonSummary, FileComparison, MetadataComparison,
     compare_archives,
 };
+pub use data_folder::{DataFolder, FileLocation};
 pub use error::{Error, Result};
+pub use file_stream::FileStream;
 pub use header::{FormatVersion, MpqHeader};
-pub use modification::{AddFileOptions, MutableArchive};
+pub use index_cache::IndexCache;
+pub use lookup_cache::LookupCacheStats;
+pub use modification::{AddFileOptions, CompactPhase, CompactProgress, MutableArchive};
+pub use name_index::{Glob, NameIndex};
 pub use patch_chain::{ChainInfo, PatchChain};
 pub use rebuild::{RebuildOptions, RebuildSummary, rebuild_archive};
-pub use tables::{BetFileInfo, BetTable, BlockEntry, BlockTable, HashEntry, HashTable, HetTable};
+pub use sector_cache::{SectorCache, SectorCacheStats};
+pub use tables::{
+    BetFileInfo, BetTable, BlockEntry, BlockTable, FlatTables, HashEntry, HashTable, HetTable,
+};
+pub use verify::{
+    FailedFile, FileVerification, VerifyFailure, VerifyOptions, VerifyReport, verify_files,
+};
 
 // Re-export crypto for CLI usage
 pub use crypto::{
-    calculate_het_hashes, calculate_mpq_hashes, decrypt_block, decrypt_dword, encrypt_block,
-    hash_string, hash_type, jenkins_hash,
+    NameHashes, calculate_het_hashes, calculate_mpq_hashes, decrypt_block, decrypt_dword,
+    encrypt_block, hash_names, hash_string, hash_type, jenkins_hash,
 };
 
 // Re-export compression for testing
@@ -192,6 +216,9 @@ pub use io::{
 #[cfg(feature = "mmap")]
 #[cfg_attr(docsrs, doc(cfg(feature = "mmap")))]
 pub use io::{MemoryMapConfig, MemoryMapManager, MemoryMapStats, MemoryMappedArchive};
+#[cfg(feature = "mmap")]
+#[cfg_attr(docsrs, doc(cfg(feature = "mmap")))]
+pub use shared_index::SharedIndex;
 
 // Re-export SIMD types when simd feature is enabled
 #[cfg(feature = "simd")]
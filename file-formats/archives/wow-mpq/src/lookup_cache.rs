@@ -0,0 +1,201 @@
+//! Cache of resolved file lookups
+//!
+//! Resolving a name in an archive hashes it several times (three passes for
+//! the classic hash table, Jenkins hashing for HET) and probes the tables.
+//! Applications that ask for the same names repeatedly can enable a
+//! [`LookupCache`] on an [`Archive`](crate::Archive), which remembers the
+//! resolved [`FileInfo`] for each name, including names that were not found.
+//!
+//! Names are cached by their normalized form: ASCII upper-cased with `/`
+//! converted to `\`, matching how MPQ name hashes treat case and separators.
+
+use crate::archive::FileInfo;
+use lru::LruCache;
+use parking_lot::Mutex;
+use std::num::NonZeroUsize;
+use std::sync::atomic::{AtomicU64, Ordering};
+
+/// Default number of names kept in a lookup cache
+pub const DEFAULT_LOOKUP_CACHE_SIZE: usize = 65_536;
+
+/// Snapshot of lookup cache counters
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct LookupCacheStats {
+    /// Lookups answered from the cache
+    pub hits: u64,
+    /// Lookups that had to probe the archive tables
+    pub misses: u64,
+    /// Names currently cached
+    pub entries: usize,
+    /// Maximum number of cached names
+    pub capacity: usize,
+}
+
+impl LookupCacheStats {
+    /// Hit rate as a fraction (0.0 to 1.0)
+    pub fn hit_rate(&self) -> f64 {
+        let total = self.hits + self.misses;
+        if total == 0 {
+            0.0
+        } else {
+            self.hits as f64 / total as f64
+        }
+    }
+}
+
+/// Bounded cache from normalized file name to lookup result
+pub struct LookupCache {
+    entries: Mutex<LruCache<String, Option<FileInfo>>>,
+    hits: AtomicU64,
+    misses: AtomicU64,
+}
+
+impl LookupCache {
+    /// Create a cache holding at most `capacity` names
+    pub(crate) fn new(capacity: NonZeroUsize) -> Self {
+        Self {
+            entries: Mutex::new(LruCache::new(capacity)),
+            hits: AtomicU64::new(0),
+            misses: AtomicU64::new(0),
+        }
+    }
+
+    /// Normalize a file name into its cache key
+    pub(crate) fn key(name: &str) -> String {
+        crate::path::fold_mpq_path(name)
+    }
+
+    /// Look up a cached result, counting a hit or a miss
+    ///
+    /// The outer `Option` is `None` on a miss; a cached entry of `Some(None)`
+    /// records that the name is not in the archive.
+    pub(crate) fn get(&self, name: &str) -> Option<Option<FileInfo>> {
+        let cached = self.entries.lock().get(&Self::key(name)).cloned();
+        match cached {
+            Some(found) => {
+                self.hits.fetch_add(1, Ordering::Relaxed);
+                // Report the name as it was asked for, like an uncached lookup
+                Some(found.map(|info| FileInfo {
+                    filename: name.to_string(),
+                    ..info
+                }))
+            }
+            None => {
+                self.misses.fetch_add(1, Ordering::Relaxed);
+                None
+            }
+        }
+    }
+
+    /// Record the result of looking up `name`
+    pub(crate) fn insert(&self, name: &str, found: Option<FileInfo>) {
+        self.entries.lock().put(Self::key(name), found);
+    }
+
+    /// Drop every cached entry, e.g. after the tables were reloaded
+    pub(crate) fn clear(&self) {
+        self.entries.lock().clear();
+    }
+
+    /// Current counters
+    pub fn stats(&self) -> LookupCacheStats {
+        let entries = self.entries.lock();
+        LookupCacheStats {
+            hits: self.hits.load(Ordering::Relaxed),
+            misses: self.misses.load(Ordering::Relaxed),
+            entries: entries.len(),
+            capacity: entries.cap().get(),
+        }
+    }
+}
+
+impl std::fmt::Debug for LookupCache {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_struct("LookupCache")
+            .field("stats", &self.stats())
+            .finish()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn info(name: &str) -> FileInfo {
+        FileInfo {
+            filename: name.to_string(),
+            hash_index: 1,
+            block_index: 2,
+            file_pos: 3,
+            compressed_size: 4,
+            file_size: 5,
+            flags: 0,
+            locale: 0,
+        }
+    }
+
+    #[test]
+    fn test_key_normalization() {
+        assert_eq!(
+            LookupCache::key("Interface/Glues/foo.blp"),
+            "INTERFACE\\GLUES\\FOO.BLP"
+        );
+    }
+
+    #[test]
+    fn test_hits_misses_and_eviction() {
+        let cache = LookupCache::new(NonZeroUsize::new(2).unwrap());
+        assert!(cache.get("a.txt").is_none());
+
+        cache.insert("a.txt", Some(info("a.txt")));
+        cache.insert("missing.txt", None);
+
+        // Different spelling of the same name hits and keeps the caller's name
+        let found = cache.get("A.TXT").unwrap().unwrap();
+        assert_eq!(found.filename, "A.TXT");
+        assert_eq!(found.block_index, 2);
+        assert!(matches!(cache.get("missing.txt"), Some(None)));
+
+        // Least recently used entry is evicted
+        cache.insert("b.txt", None);
+        assert!(cache.get("a.txt").is_none());
+
+        let stats = cache.stats();
+        assert_eq!(stats.hits, 2);
+        assert_eq!(stats.misses, 2);
+        assert_eq!(stats.entries, 2);
+        assert_eq!(stats.capacity, 2);
+        assert_eq!(stats.hit_rate(), 0.5);
+    }
+
+    #[test]
+    fn test_archive_lookup_cache() -> crate::Result<()> {
+        use crate::{Archive, ArchiveBuilder};
+
+        let temp_dir = tempfile::TempDir::new()?;
+        let path = temp_dir.path().join("lookup.mpq");
+        ArchiveBuilder::new()
+            .add_file_data(b"data".to_vec(), "Textures\\Foo.blp")
+            .build(&path)?;
+
+        let mut archive = Archive::open(&path)?;
+        assert!(archive.lookup_cache_stats().is_none());
+
+        let found = archive.prewarm_lookup_cache(["textures/foo.blp", "missing.blp"])?;
+        assert_eq!(found, 1);
+
+        let info = archive.find_file("TEXTURES\\FOO.BLP")?.unwrap();
+        assert_eq!(info.filename, "TEXTURES\\FOO.BLP");
+        assert!(archive.find_file("missing.blp")?.is_none());
+        assert!(archive.find_file("other.blp")?.is_none());
+        assert_eq!(archive.read_file("textures/foo.blp")?, b"data");
+
+        let stats = archive.lookup_cache_stats().unwrap();
+        assert_eq!(stats.hits, 3);
+        assert_eq!(stats.misses, 1);
+
+        archive.set_lookup_cache_capacity(0);
+        assert!(archive.lookup_cache_stats().is_none());
+        Ok(())
+    }
+}
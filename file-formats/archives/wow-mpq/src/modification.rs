@@ -5,24 +5,46 @@
 //! archives to reclaim space from deleted files.
 
 use crate::{
-    Archive, ArchiveBuilder, Error, ListfileOption, Result,
+    Archive, Error, Result,
     compression::{self, CompressionMethod, compress},
     crypto::{encrypt_block, hash_string, hash_type},
     header::FormatVersion,
+    single_archive_parallel::{ParallelConfig, build_thread_pool},
     special_files::{AttributeFlags, Attributes, FileAttributes},
     tables::{BetHeader, BlockEntry, BlockTable, HashEntry, HashTable, HetHeader, HiBlockTable},
 };
 use bytes::Bytes;
-use std::collections::HashMap;
+use rayon::prelude::*;
+use std::collections::{HashMap, HashSet};
 use std::fs::{File, OpenOptions};
 use std::io::{Read, Seek, SeekFrom, Write};
 use std::path::{Path, PathBuf};
 
+mod compact;
+
+pub use compact::{CompactPhase, CompactProgress};
+
+/// Files compressed per worker thread before a batch is written out
+const BATCH_FILES_PER_THREAD: usize = 16;
+
 /// Generate a generic filename for files without known names
 fn generate_anonymous_filename(hash: u32) -> String {
     format!("File{:08X}.unknown", hash)
 }
 
+/// File contents ready to be written to the archive
+#[derive(Debug)]
+struct PreparedFile {
+    /// Compressed and/or encrypted data as stored
+    data: Vec<u8>,
+    /// Block table flags
+    flags: u32,
+    /// Uncompressed size
+    file_size: usize,
+    /// CRC32 of the uncompressed data, for `(attributes)`
+    crc32: u32,
+}
+
 /// Options for adding files to an archive
 #[derive(Debug, Clone)]
 pub struct AddFileOptions {
@@ -116,14 +138,18 @@ pub struct MutableArchive {
     attributes_dirty: bool,
     /// Track modified blocks for CRC calculation (block_index -> filename)
     modified_blocks: HashMap<u32, String>,
+    /// CRC32 of files written in this session (block_index -> crc)
+    file_crcs: HashMap<u32, u32>,
     /// Updated HET table position for V3+ archives
     updated_het_pos: Option<u64>,
     /// Updated BET table position for V3+ archives  
     updated_bet_pos: Option<u64>,
-    /// Updated hash table position for V3+ archives
+    /// Updated hash table position, once the tables have moved
     updated_hash_table_pos: Option<u64>,
-    /// Updated block table position for V3+ archives
+    /// Updated block table position, once the tables have moved
     updated_block_table_pos: Option<u64>,
+    /// Block table entries that fit where the V1/V2 tables are written
+    table_block_capacity: u32,
 }
 
 impl MutableArchive {
@@ -148,6 +174,7 @@ impl MutableArchive {
 
         // Open file for read/write
         let file = OpenOptions::new().read(true).write(true).open(&path)?;
+        let table_block_capacity = archive.header().block_table_size;
 
         Ok(Self {
             _path: path,
@@ -161,10 +188,12 @@ impl MutableArchive {
             _special_file_blocks: HashMap::new(),
             attributes_dirty: false,
             modified_blocks: HashMap::new(),
+            file_crcs: HashMap::new(),
             updated_het_pos: None,
             updated_bet_pos: None,
             updated_hash_table_pos: None,
             updated_block_table_pos: None,
+            table_block_capacity,
         })
     }
 
@@ -331,14 +360,143 @@ impl MutableArchive {
         // Load tables if not already cached
         self.ensure_tables_loaded()?;
 
+        // Check if file exists and if we should replace it
+        if !options.replace_existing && self.find_file_entry(&archive_name)?.is_some() {
+            return Err(Error::FileExists(archive_name));
+        }
+
+        // Compress the file data if requested
+        let prepared = Self::prepare_file_data(data, &archive_name, &options)?;
+        self.write_prepared_file(&archive_name, prepared, &options)?;
+
+        // Update (listfile) if present (but not if we're updating a special file)
+        if archive_name != "(listfile)" && archive_name != "(attributes)" {
+            self.update_listfile(&[archive_name.as_str()])?;
+        }
+        Ok(())
+    }
+
+    /// Add many files from disk, reading and compressing them in parallel
+    ///
+    /// See [`add_files_data`](Self::add_files_data).
+    pub fn add_files<P: AsRef<Path> + Sync>(
+        &mut self,
+        files: &[(P, &str, AddFileOptions)],
+        config: &ParallelConfig,
+    ) -> Result<()> {
+        let names: Vec<String> = files
+            .iter()
+            .map(|(_, name, _)| name.replace('/', "\\"))
+            .collect();
+        let options: Vec<&AddFileOptions> = files.iter().map(|(_, _, options)| options).collect();
+        self.add_files_with(&names, &options, config, |i| {
+            let data = std::fs::read(files[i].0.as_ref())?;
+            Self::prepare_file_data(&data, &names[i], &files[i].2)
+        })
+    }
+
+    /// Add many files from memory, compressing them in parallel
+    ///
+    /// Files are compressed (and encrypted) on a thread pool configured by
+    /// `config`, a few batches at a time, and written in the order given, so
+    /// the resulting archive does not depend on the number of threads. The
+    /// `(listfile)` is updated once for the whole batch, and the tables and
+    /// `(attributes)` are written once by [`flush`](Self::flush).
+    ///
+    /// Name conflicts and hash table capacity are checked before anything is
+    /// written. If compressing a file fails, the files before it have
+    /// already been added.
+    pub fn add_files_data(
+        &mut self,
+        files: &[(&[u8], &str, AddFileOptions)],
+        config: &ParallelConfig,
+    ) -> Result<()> {
+        let names: Vec<String> = files
+            .iter()
+            .map(|(_, name, _)| name.replace('/', "\\"))
+            .collect();
+        let options: Vec<&AddFileOptions> = files.iter().map(|(_, _, options)| options).collect();
+        self.add_files_with(&names, &options, config, |i| {
+            Self::prepare_file_data(files[i].0, &names[i], &files[i].2)
+        })
+    }
+
+    /// Add a batch of files whose data is produced by `prepare`
+    fn add_files_with<F>(
+        &mut self,
+        names: &[String],
+        options: &[&AddFileOptions],
+        config: &ParallelConfig,
+        prepare: F,
+    ) -> Result<()>
+    where
+        F: Fn(usize) -> Result<PreparedFile> + Sync,
+    {
+        if names.is_empty() {
+            return Ok(());
+        }
+        self.ensure_tables_loaded()?;
+
+        // Check every name before writing anything
+        let mut seen = HashSet::with_capacity(names.len());
+        let mut new_files = 0usize;
+        for (name, options) in names.iter().zip(options) {
+            let exists = self.find_file_entry(name)?.is_some();
+            let repeated = !seen.insert(name.to_ascii_uppercase());
+            if (exists || repeated) && !options.replace_existing {
+                return Err(Error::FileExists(name.clone()));
+            }
+            if !exists && !repeated {
+                new_files += 1;
+            }
+        }
+        let free_slots = self.hash_table.as_ref().map_or(0, |table| {
+            table
+                .entries()
+                .iter()
+                .filter(|entry| entry.is_empty() || entry.is_deleted())
+                .count()
+        });
+        if new_files > free_slots {
+            return Err(Error::hash_table(format!(
+                "Hash table has room for {free_slots} more files, {new_files} were added"
+            )));
+        }
+
+        let pool = build_thread_pool(config)?;
+        let window = pool.current_num_threads().max(1) * BATCH_FILES_PER_THREAD;
+        for start in (0..names.len()).step_by(window) {
+            let end = (start + window).min(names.len());
+            let prepared: Vec<Result<PreparedFile>> =
+                pool.install(|| (start..end).into_par_iter().map(&prepare).collect());
+            for (i, file) in (start..end).zip(prepared) {
+                self.write_prepared_file(&names[i], file?, options[i])?;
+            }
+        }
+
+        let listed: Vec<&str> = names
+            .iter()
+            .map(String::as_str)
+            .filter(|name| *name != "(listfile)" && *name != "(attributes)")
+            .collect();
+        self.update_listfile(&listed)
+    }
+
+    /// Append prepared file data and enter it into the tables
+    fn write_prepared_file(
+        &mut self,
+        archive_name: &str,
+        prepared: PreparedFile,
+        options: &AddFileOptions,
+    ) -> Result<()> {
         // Check if we're updating a special file (listfile/attributes)
         let is_internal_update = archive_name == "(listfile)" || archive_name == "(attributes)";
 
         // Check if file exists and if we should replace it
         let existing_block_index =
-            if let Some((hash_index, entry)) = self.find_file_entry(&archive_name)? {
+            if let Some((hash_index, entry)) = self.find_file_entry(archive_name)? {
                 if !options.replace_existing {
-                    return Err(Error::FileExists(archive_name));
+                    return Err(Error::FileExists(archive_name.to_string()));
                 }
                 // Mark the existing entry as deleted for now
                 if let Some(hash_table) = &mut self.hash_table {
@@ -365,16 +523,12 @@ impl MutableArchive {
         // Find where to place the file (append to end for now)
         let file_offset = self.get_archive_end_offset()?;
 
-        // Compress the file data if requested
-        let (compressed_data, compressed_size, flags) =
-            self.prepare_file_data(data, &archive_name, &options)?;
-
         // Write the file data to the archive
         self.file.seek(SeekFrom::Start(file_offset))?;
-        self.file.write_all(&compressed_data)?;
+        self.file.write_all(&prepared.data)?;
 
         // Update next file offset for subsequent files in this session
-        let next_offset = file_offset + compressed_data.len() as u64;
+        let next_offset = file_offset + prepared.data.len() as u64;
         let aligned_next = (next_offset + 511) & !511; // Align to 512-byte boundary
         self.next_file_offset = Some(aligned_next);
 
@@ -382,9 +536,9 @@ impl MutableArchive {
         let relative_pos = (file_offset - self.archive.archive_offset()) as u32;
         let block_entry = BlockEntry {
             file_pos: relative_pos,
-            compressed_size: compressed_size as u32,
-            file_size: data.len() as u32, // Original unpadded size
-            flags,
+            compressed_size: prepared.data.len() as u32,
+            file_size: prepared.file_size as u32, // Original unpadded size
+            flags: prepared.flags,
         };
 
         // Add or update block table entry
@@ -395,39 +549,18 @@ impl MutableArchive {
                     *entry = block_entry;
                 }
             } else {
-                // Add new entry
-                let old_entries = block_table.entries();
-                let new_size = old_entries.len() + 1;
-                let mut new_table = BlockTable::new_mut(new_size)?;
-
-                // Copy old entries
-                for (i, entry) in old_entries.iter().enumerate() {
-                    if let Some(new_entry) = new_table.get_mut(i) {
-                        *new_entry = *entry;
-                    }
-                }
-
-                // Add new entry
-                if let Some(new_entry) = new_table.get_mut(new_size - 1) {
-                    *new_entry = block_entry;
-                }
-
-                *block_table = new_table;
+                block_table.push(block_entry);
             }
         }
 
         // Add to hash table
-        self.add_to_hash_table(&archive_name, block_index, options.locale)?;
+        self.add_to_hash_table(archive_name, block_index, options.locale)?;
 
         // Track this block as modified (for attributes CRC calculation)
         if archive_name != "(attributes)" {
             self.modified_blocks
-                .insert(block_index, archive_name.clone());
-        }
-
-        // Update (listfile) if present (but not if we're adding the listfile itself)
-        if archive_name != "(listfile)" && !is_internal_update {
-            self.update_listfile(&archive_name)?;
+                .insert(block_index, archive_name.to_string());
+            self.file_crcs.insert(block_index, prepared.crc32);
         }
 
         // Mark attributes as needing update (unless we're updating attributes itself)
@@ -542,7 +675,7 @@ impl MutableArchive {
 
         // Update (listfile)
         self.remove_from_listfile(&old_name)?;
-        self.update_listfile(&new_name)?;
+        self.update_listfile(&[new_name.as_str()])?;
 
         // Mark attributes as needing update
         self.attributes_dirty = true;
@@ -553,137 +686,11 @@ impl MutableArchive {
 
     /// Compact the archive to reclaim space from deleted files
     ///
-    /// This creates a new archive file with all active files copied over,
-    /// removing any gaps from deleted files.
+    /// Streams the live files into a new archive file without the gaps left by
+    /// deleted and replaced files. See
+    /// [`compact_with_progress`](Self::compact_with_progress) for details.
     pub fn compact(&mut self) -> Result<()> {
-        use std::fs;
-        use tempfile::NamedTempFile;
-
-        // Ensure tables are loaded
-        self.ensure_tables_loaded()?;
-
-        // Create a temporary file in the same directory as the archive
-        let archive_dir = self
-            ._path
-            .parent()
-            .ok_or_else(|| Error::InvalidFormat("Invalid archive path".to_string()))?;
-        let temp_file = NamedTempFile::new_in(archive_dir)?;
-        let temp_path = temp_file.path().to_path_buf();
-
-        // Get archive header info
-        let header = self.archive.header();
-        let format_version = header.format_version;
-
-        // Create a new archive builder
-        let mut builder = ArchiveBuilder::new()
-            .version(format_version)
-            .listfile_option(ListfileOption::Generate);
-
-        // First, get the list of files if available
-        let file_list = self.list().ok();
-
-        // Collect all active files
-        let mut files_to_copy = Vec::new();
-        if let Some(hash_table) = &self.hash_table {
-            for (hash_idx, entry) in hash_table.entries().iter().enumerate() {
-                if !entry.is_valid() || entry.is_deleted() {
-                    continue;
-                }
-
-                let block_idx = entry.block_index as usize;
-                if let Some(block_table) = &self.block_table
-                    && let Some(block) = block_table.entries().get(block_idx)
-                {
-                    // Find the file name from listfile or generate a placeholder
-                    let filename = if let Some(ref list) = file_list {
-                        list.iter()
-                            .find(|e| {
-                                // Match by verifying the hash values
-                                let name_hash1 = hash_string(&e.name, hash_type::NAME_A);
-                                let name_hash2 = hash_string(&e.name, hash_type::NAME_B);
-                                entry.name_1 == name_hash1 && entry.name_2 == name_hash2
-                            })
-                            .map(|e| e.name.clone())
-                    } else {
-                        None
-                    };
-
-                    let filename = filename.unwrap_or_else(|| {
-                        // Generate placeholder name if not found in listfile
-                        generate_anonymous_filename(
-                            ((entry.name_1 as u64) << 32 | entry.name_2 as u64) as u32,
-                        )
-                    });
-
-                    files_to_copy.push((hash_idx, block_idx, filename, *entry, *block));
-                }
-            }
-        }
-
-        // Add all active files to the new archive
-        for (_, _, filename, hash_entry, block_entry) in &files_to_copy {
-            // Skip internal files that will be handled automatically by the builder
-            if filename == "(listfile)" || filename == "(attributes)" || filename == "(signature)" {
-                continue;
-            }
-
-            // Read the file data
-            let file_data = match self.read_file(filename) {
-                Ok(data) => data,
-                Err(_) => {
-                    // Skip files we can't read
-                    log::warn!("Skipping file {filename} during compaction (read error)");
-                    continue;
-                }
-            };
-
-            // Determine compression and encryption from block flags
-            let compression = if block_entry.is_compressed() {
-                // Try to determine specific compression method
-                // For now, default to Zlib if compressed
-                compression::flags::ZLIB
-            } else {
-                0 // No compression
-            };
-
-            let encrypt = block_entry.is_encrypted();
-
-            // Add file to builder
-            builder = builder.add_file_data_with_options(
-                file_data,
-                filename,
-                compression,
-                encrypt,
-                hash_entry.locale,
-            );
-        }
-
-        // Build the new archive
-        builder.build(&temp_path)?;
-
-        // Close our current file handle by dropping the field (take ownership)
-        let _ = std::mem::replace(&mut self.file, File::open(&temp_path)?);
-
-        // Replace the original file with the compacted one
-        fs::rename(&temp_path, &self._path)?;
-
-        // Re-open the compacted archive
-        self.archive = Archive::open(&self._path)?;
-        self.file = OpenOptions::new()
-            .read(true)
-            .write(true)
-            .open(&self._path)?;
-
-        // Reset cached tables
-        self.hash_table = None;
-        self.block_table = None;
-        self._hi_block_table = None;
-        self.dirty = false;
-        self.next_file_offset = None;
-        self.attributes_dirty = false;
-        self.modified_blocks.clear();
-
-        Ok(())
+        self.compact_with_progress(|_| {})
     }
 
     /// Flush any pending changes to disk
@@ -789,17 +796,22 @@ impl MutableArchive {
 
             // Calculate CRC32 if enabled
             if attrs.flags.has_crc32() && filename != "(listfile)" {
-                // Read the uncompressed file data to calculate CRC
-                match self.read_current_file(&filename) {
-                    Ok(data) => {
-                        // Calculate CRC32 using standard algorithm
-                        let crc = crc32fast::hash(&data);
-                        attrs.file_attributes[block_idx].crc32 = Some(crc);
-                    }
-                    Err(_) => {
-                        // If we can't read the file, keep existing CRC or set to 0
-                        if attrs.file_attributes[block_idx].crc32.is_none() {
-                            attrs.file_attributes[block_idx].crc32 = Some(0);
+                // Files written in this session had their CRC taken while
+                // they were compressed; others are read back
+                if let Some(&crc) = self.file_crcs.get(&(block_idx as u32)) {
+                    attrs.file_attributes[block_idx].crc32 = Some(crc);
+                } else {
+                    match self.read_current_file(&filename) {
+                        Ok(data) => {
+                            // Calculate CRC32 using standard algorithm
+                            let crc = crc32fast::hash(&data);
+                            attrs.file_attributes[block_idx].crc32 = Some(crc);
+                        }
+                        Err(_) => {
+                            // If we can't read the file, keep existing CRC or set to 0
+                            if attrs.file_attributes[block_idx].crc32.is_none() {
+                                attrs.file_attributes[block_idx].crc32 = Some(0);
+                            }
                         }
                     }
                 }
@@ -983,11 +995,10 @@ impl MutableArchive {
 
     /// Prepare file data for writing (compress and encrypt if needed)
     fn prepare_file_data(
-        &self,
         data: &[u8],
         archive_name: &str,
         options: &AddFileOptions,
-    ) -> Result<(Vec<u8>, usize, u32)> {
+    ) -> Result<PreparedFile> {
         let mut flags = BlockEntry::FLAG_EXISTS;
         let mut output_data = data.to_vec();
 
@@ -1061,8 +1072,12 @@ impl MutableArchive {
         // Real implementation would handle multi-sector files
         flags |= BlockEntry::FLAG_SINGLE_UNIT;
 
-        let output_len = output_data.len();
-        Ok((output_data, output_len, flags))
+        Ok(PreparedFile {
+            data: output_data,
+            flags,
+            file_size: data.len(),
+            crc32: crc32fast::hash(data),
+        })
     }
 
     /// Add entry to hash table
@@ -1080,7 +1095,7 @@ impl MutableArchive {
         let mut index = table_offset & (table_size - 1);
 
         // Linear probing to find empty or deleted slot
-        loop {
+        for _ in 0..table_size {
             let entry = hash_table.get_mut(index as usize).ok_or_else(|| {
                 Error::InvalidFormat("Hash table index out of bounds".to_string())
             })?;
@@ -1094,18 +1109,24 @@ impl MutableArchive {
                     platform: 0, // Always 0 - platform codes are vestigial
                     block_index,
                 };
-                break;
+                return Ok(());
             }
 
             // Move to next slot
             index = (index + 1) & (table_size - 1);
         }
 
-        Ok(())
+        Err(Error::hash_table(format!(
+            "Hash table is full, cannot add {filename}"
+        )))
     }
 
-    /// Update the (listfile) with a new filename
-    fn update_listfile(&mut self, filename: &str) -> Result<()> {
+    /// Update the (listfile) with new filenames
+    fn update_listfile(&mut self, filenames: &[&str]) -> Result<()> {
+        if filenames.is_empty() {
+            return Ok(());
+        }
+
         // Check if (listfile) exists
         if self.archive.find_file("(listfile)")?.is_none() {
             return Ok(()); // No listfile to update
@@ -1117,15 +1138,21 @@ impl MutableArchive {
             Err(_) => String::new(), // If can't read, start fresh
         };
 
-        // Add new filename if not already present
-        let filename_line = filename.to_string();
-        if !current_content.contains(&filename_line) {
-            if !current_content.ends_with('\n') && !current_content.is_empty() {
+        // Add new filenames if not already present
+        let mut listed: HashSet<String> = current_content.lines().map(str::to_string).collect();
+        let mut changed = false;
+        for &filename in filenames {
+            if listed.insert(filename.to_string()) {
+                if !current_content.ends_with('\n') && !current_content.is_empty() {
+                    current_content.push('\n');
+                }
+                current_content.push_str(filename);
                 current_content.push('\n');
+                changed = true;
             }
-            current_content.push_str(&filename_line);
-            current_content.push('\n');
+        }
 
+        if changed {
             // Write updated listfile back
             let options = AddFileOptions::new()
                 .compression(CompressionMethod::None) // Keep listfile uncompressed
@@ -1186,10 +1213,33 @@ impl MutableArchive {
 
         // For V1/V2 archives, use the original simple approach
         let archive_offset = self.archive.archive_offset();
+        let hash_table_pos = self
+            .updated_hash_table_pos
+            .unwrap_or_else(|| header.get_hash_table_pos());
+        let block_table_pos = self
+            .updated_block_table_pos
+            .unwrap_or_else(|| header.get_block_table_pos());
+
+        // Files added since the tables were written follow them directly, so
+        // a block table that has outgrown its slot moves behind the data
+        let block_count = self.block_table.as_ref().map_or(0, |t| t.entries().len()) as u32;
+        let (hash_table_pos, block_table_pos) = if block_count > self.table_block_capacity {
+            let hash_table_size = self.hash_table.as_ref().map_or(0, |t| t.size()) as u64;
+            let hash_table_pos = self.get_archive_end_offset()? - archive_offset;
+            let block_table_pos = hash_table_pos + hash_table_size * 16;
+            let tables_end = archive_offset + block_table_pos + block_count as u64 * 16;
+            self.next_file_offset = Some((tables_end + 511) & !511);
+            self.table_block_capacity = block_count;
+            self.updated_hash_table_pos = Some(hash_table_pos);
+            self.updated_block_table_pos = Some(block_table_pos);
+            (hash_table_pos, block_table_pos)
+        } else {
+            (hash_table_pos, block_table_pos)
+        };
 
         // Write hash table
         if let Some(hash_table) = &self.hash_table {
-            let hash_table_pos = archive_offset + header.hash_table_pos as u64;
+            let hash_table_pos = archive_offset + hash_table_pos;
             self.file.seek(SeekFrom::Start(hash_table_pos))?;
 
             // Convert to bytes and encrypt
@@ -1218,7 +1268,7 @@ impl MutableArchive {
 
         // Write block table
         if let Some(block_table) = &self.block_table {
-            let block_table_pos = archive_offset + header.block_table_pos as u64;
+            let block_table_pos = archive_offset + block_table_pos;
             self.file.seek(SeekFrom::Start(block_table_pos))?;
 
             // Convert to bytes and encrypt
@@ -1656,6 +1706,7 @@ impl Drop for MutableArchive {
 #[cfg(test)]
 mod tests {
     use super::*;
+    use crate::ArchiveBuilder;
 
     #[test]
     fn test_add_file_options() {
@@ -1675,4 +1726,75 @@ mod tests {
         assert!(options.encrypt);
         assert!(options.fix_key);
     }
+
+    #[test]
+    fn test_add_files_data_is_deterministic() -> Result<()> {
+        let temp_dir = tempfile::TempDir::new()?;
+        let contents: Vec<(Vec<u8>, String)> = (0..100)
+            .map(|i| {
+                let data = format!("file {i} ").repeat(i * 50 + 1).into_bytes();
+                (data, format!("Data\\File{i:03}.txt"))
+            })
+            .collect();
+        let files: Vec<(&[u8], &str, AddFileOptions)> = contents
+            .iter()
+            .map(|(data, name)| (data.as_slice(), name.as_str(), AddFileOptions::new()))
+            .collect();
+
+        let mut outputs = Vec::new();
+        for threads in [1, 4] {
+            let path = temp_dir.path().join(format!("batch{threads}.mpq"));
+            ArchiveBuilder::new()
+                .hash_table_size(256)
+                .add_file_data(b"existing".to_vec(), "existing.txt")
+                .build(&path)?;
+
+            let mut archive = MutableArchive::open(&path)?;
+            let config = ParallelConfig::new().threads(threads);
+            archive.add_files_data(&files, &config)?;
+            archive.flush()?;
+            drop(archive);
+            outputs.push(std::fs::read(&path)?);
+
+            let mut archive = Archive::open(&path)?;
+            for (data, name) in &contents {
+                assert_eq!(&archive.read_file(name)?, data);
+            }
+            let listed: HashSet<String> = archive
+                .list()?
+                .into_iter()
+                .map(|entry| entry.name)
+                .collect();
+            assert!(listed.contains("existing.txt"));
+            assert!(listed.contains("Data\\File099.txt"));
+        }
+        assert_eq!(outputs[0], outputs[1]);
+
+        // Conflicts are reported before anything is written
+        let path = temp_dir.path().join("batch1.mpq");
+        let mut archive = MutableArchive::open(&path)?;
+        let options = AddFileOptions::new().replace_existing(false);
+        let result = archive.add_files_data(
+            &[
+                (b"new".as_slice(), "new.txt", options.clone()),
+                (b"again".as_slice(), "data\\file000.txt", options),
+            ],
+            &ParallelConfig::default(),
+        );
+        assert!(matches!(result, Err(Error::FileExists(_))));
+        assert!(archive.find_file("new.txt")?.is_none());
+
+        // So is a batch that does not fit in the hash table
+        let extra: Vec<(Vec<u8>, String)> = (0..200)
+            .map(|i| (vec![i as u8], format!("extra{i}.bin")))
+            .collect();
+        let extra: Vec<(&[u8], &str, AddFileOptions)> = extra
+            .iter()
+            .map(|(data, name)| (data.as_slice(), name.as_str(), AddFileOptions::new()))
+            .collect();
+        let result = archive.add_files_data(&extra, &ParallelConfig::default());
+        assert!(matches!(result, Err(Error::HashTable(_))));
+        assert!(archive.find_file("extra0.bin")?.is_none());
+        Ok(())
+    }
 }
@@ -0,0 +1,921 @@
+//! Streaming compaction for [`MutableArchive`]
+//!
+//! [`MutableArchive::compact_with_progress`] rewrites an archive without the
+//! space held by deleted and replaced files. Live blocks are copied into a
+//! temporary file next to the archive in the order they are stored, using
+//! large sequential reads and writes, and their compressed sectors are copied
+//! verbatim. Nothing is decompressed: only FIX_KEY files, whose key depends on
+//! their position, are decrypted and re-encrypted, and `(attributes)` is
+//! rewritten because its entries follow the block order. The temporary file
+//! replaces the archive once it is complete, so a failed compaction leaves the
+//! original untouched.
+
+use super::{AddFileOptions, MutableArchive};
+use crate::{
+    Archive, Error, Result,
+    archive::{FileInfo, decrypt_file_data, file_key, is_stormlib_crc_layout, stored_extent},
+    compression::CompressionMethod,
+    crypto::{encrypt_block, hash_string, hash_type},
+    header::FormatVersion,
+    special_files::Attributes,
+    tables::{BlockEntry, HashEntry},
+};
+use bytes::Bytes;
+use md5::{Digest, Md5};
+use std::collections::HashMap;
+use std::fs::File;
+use std::io::{BufWriter, Read, Seek, SeekFrom, Write};
+
+/// Bytes moved per read and write while copying file data
+const COMPACT_COPY_CHUNK: usize = 1024 * 1024;
+
+/// Stage of a running compaction
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum CompactPhase {
+    /// Collecting live blocks and laying out the new file
+    CheckingFiles,
+    /// Dropping deleted hash table entries that end a probe chain
+    CheckingHashTable,
+    /// Copying data stored in front of the MPQ header
+    CopyingNonMpqData,
+    /// Copying file data
+    CompactingFiles,
+    /// Writing the tables and replacing the archive
+    ClosingArchive,
+}
+
+/// Progress reported by [`MutableArchive::compact_with_progress`]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct CompactProgress {
+    /// Current stage
+    pub phase: CompactPhase,
+    /// Bytes processed in this stage so far
+    pub bytes_done: u64,
+    /// Bytes this stage processes in total
+    pub bytes_total: u64,
+}
+
+impl CompactProgress {
+    fn new(phase: CompactPhase, bytes_done: u64, bytes_total: u64) -> Self {
+        Self {
+            phase,
+            bytes_done,
+            bytes_total,
+        }
+    }
+}
+
+/// A block that survives compaction
+#[derive(Debug)]
+struct LiveBlock {
+    /// Index in the current block table
+    old_index: usize,
+    /// Absolute position in the current file
+    old_pos: u64,
+    /// Bytes stored, including the sector CRCs the block size leaves out
+    stored_len: u64,
+    /// Absolute position in the compacted file
+    new_pos: u64,
+    /// Entry for the new block table, without its position
+    entry: BlockEntry,
+    /// Contents written instead of the stored bytes
+    replacement: Option<Vec<u8>>,
+    /// Current and new key of a FIX_KEY file that moves
+    rekey: Option<(u32, u32)>,
+}
+
+impl LiveBlock {
+    /// Whether the stored bytes can be copied as they are
+    fn is_verbatim(&self) -> bool {
+        self.replacement.is_none() && self.rekey.is_none()
+    }
+}
+
+/// Table positions, relative to the archive offset, and their encoded bytes
+#[derive(Debug)]
+struct TableLayout {
+    hash_table: Vec<u8>,
+    block_table: Vec<u8>,
+    hi_block_table: Option<Vec<u8>>,
+    hash_table_pos: u64,
+    block_table_pos: u64,
+    hi_block_table_pos: Option<u64>,
+    block_count: u32,
+    archive_size: u64,
+}
+
+impl MutableArchive {
+    /// Compact the archive, reporting progress to `progress`
+    ///
+    /// Files still referenced by the hash table are streamed into a new file
+    /// in the order they are stored, leaving out the data of deleted and
+    /// replaced files and the old tables. Stored sectors are copied without
+    /// being decompressed; FIX_KEY files are re-encrypted for their new
+    /// position, which needs their names in `(listfile)`. Classic hash and
+    /// block tables are written for every format version, without HET/BET
+    /// tables.
+    ///
+    /// `progress` is called on the calling thread. A compaction that has to
+    /// run in the background can move the `MutableArchive` to a worker thread.
+    pub fn compact_with_progress<F>(&mut self, mut progress: F) -> Result<()>
+    where
+        F: FnMut(CompactProgress),
+    {
+        use tempfile::NamedTempFile;
+
+        self.ensure_tables_loaded()?;
+        if self.attributes_dirty {
+            self.update_attributes()?;
+        }
+
+        let archive_offset = self.archive.archive_offset();
+        let header = self.archive.header().clone();
+
+        progress(CompactProgress::new(CompactPhase::CheckingFiles, 0, 1));
+        let mut live = self.collect_live_blocks()?;
+        self.measure_sectored_blocks(&mut live, archive_offset)?;
+        self.reorder_attributes(&mut live)?;
+
+        let data_start = archive_offset + header.header_size as u64;
+        let mut data_end = data_start;
+        for block in &mut live {
+            block.new_pos = data_end;
+            data_end += block.stored_len;
+        }
+        self.plan_rekeys(&mut live, archive_offset)?;
+        progress(CompactProgress::new(CompactPhase::CheckingFiles, 1, 1));
+
+        progress(CompactProgress::new(CompactPhase::CheckingHashTable, 0, 1));
+        let tables = self.build_tables(&live, archive_offset, data_end, header.format_version)?;
+        progress(CompactProgress::new(CompactPhase::CheckingHashTable, 1, 1));
+
+        let mut header_bytes = vec![0u8; header.header_size as usize];
+        self.file.seek(SeekFrom::Start(archive_offset))?;
+        self.file.read_exact(&mut header_bytes)?;
+        patch_header(&mut header_bytes, header.format_version, &tables);
+
+        let archive_dir = self
+            ._path
+            .parent()
+            .ok_or_else(|| Error::InvalidFormat("Invalid archive path".to_string()))?;
+        let mut temp_file = NamedTempFile::new_in(archive_dir)?;
+
+        {
+            let mut out = BufWriter::with_capacity(COMPACT_COPY_CHUNK, temp_file.as_file_mut());
+            let mut buffer = vec![0u8; COMPACT_COPY_CHUNK];
+
+            // User data and anything else in front of the archive
+            progress(CompactProgress::new(
+                CompactPhase::CopyingNonMpqData,
+                0,
+                archive_offset,
+            ));
+            copy_range(
+                &mut self.file,
+                &mut out,
+                0,
+                archive_offset,
+                &mut buffer,
+                |done| {
+                    progress(CompactProgress::new(
+                        CompactPhase::CopyingNonMpqData,
+                        done,
+                        archive_offset,
+                    ))
+                },
+            )?;
+            out.write_all(&header_bytes)?;
+
+            let total = data_end - data_start;
+            let mut done = 0u64;
+            progress(CompactProgress::new(
+                CompactPhase::CompactingFiles,
+                0,
+                total,
+            ));
+
+            let mut i = 0;
+            while i < live.len() {
+                let block = &live[i];
+                if let Some(data) = &block.replacement {
+                    out.write_all(data)?;
+                    done += block.stored_len;
+                    progress(CompactProgress::new(
+                        CompactPhase::CompactingFiles,
+                        done,
+                        total,
+                    ));
+                    i += 1;
+                    continue;
+                }
+
+                if let Some((old_key, new_key)) = block.rekey {
+                    let mut data = vec![0u8; block.stored_len as usize];
+                    self.file.seek(SeekFrom::Start(block.old_pos))?;
+                    self.file.read_exact(&mut data)?;
+                    rekey_block(
+                        &mut data,
+                        &block.entry,
+                        header.sector_size(),
+                        old_key,
+                        new_key,
+                    )?;
+                    out.write_all(&data)?;
+                    done += block.stored_len;
+                    progress(CompactProgress::new(
+                        CompactPhase::CompactingFiles,
+                        done,
+                        total,
+                    ));
+                    i += 1;
+                    continue;
+                }
+
+                // Blocks that were already adjacent are copied as one run
+                let start = block.old_pos;
+                let mut end = start + block.stored_len;
+                let mut next = i + 1;
+                while next < live.len() && live[next].is_verbatim() && live[next].old_pos == end {
+                    end += live[next].stored_len;
+                    next += 1;
+                }
+
+                let run_start = done;
+                copy_range(
+                    &mut self.file,
+                    &mut out,
+                    start,
+                    end - start,
+                    &mut buffer,
+                    |copied| {
+                        progress(CompactProgress::new(
+                            CompactPhase::CompactingFiles,
+                            run_start + copied,
+                            total,
+                        ))
+                    },
+                )?;
+                done += end - start;
+                i = next;
+            }
+
+            let tables_len = tables.hash_table.len()
+                + tables.block_table.len()
+                + tables.hi_block_table.as_ref().map_or(0, Vec::len);
+            progress(CompactProgress::new(
+                CompactPhase::ClosingArchive,
+                0,
+                tables_len as u64,
+            ));
+            out.write_all(&tables.hash_table)?;
+            out.write_all(&tables.block_table)?;
+            if let Some(hi_block_table) = &tables.hi_block_table {
+                out.write_all(hi_block_table)?;
+            }
+            out.flush()?;
+        }
+        temp_file.as_file().sync_all()?;
+
+        // Swap the compacted file in and reload everything from it
+        self.file = temp_file
+            .persist(&self._path)
+            .map_err(|e| Error::Io(e.error))?;
+        self.archive = Archive::open(&self._path)?;
+
+        self.hash_table = None;
+        self.block_table = None;
+        self._hi_block_table = None;
+        self.dirty = false;
+        self.next_file_offset = None;
+        self.attributes_dirty = false;
+        self.modified_blocks.clear();
+        self.file_crcs.clear();
+        self.updated_het_pos = None;
+        self.updated_bet_pos = None;
+        self.updated_hash_table_pos = None;
+        self.updated_block_table_pos = None;
+        self.table_block_capacity = self.archive.header().block_table_size;
+
+        let size = tables.archive_size;
+        progress(CompactProgress::new(
+            CompactPhase::ClosingArchive,
+            size,
+            size,
+        ));
+        Ok(())
+    }
+
+    /// Blocks referenced by the hash table, in the order they are stored
+    fn collect_live_blocks(&self) -> Result<Vec<LiveBlock>> {
+        let hash_table = self
+            .hash_table
+            .as_ref()
+            .ok_or_else(|| Error::InvalidFormat("No hash table".to_string()))?;
+        let block_table = self
+            .block_table
+            .as_ref()
+            .ok_or_else(|| Error::InvalidFormat("No block table".to_string()))?;
+        let archive_offset = self.archive.archive_offset();
+        let hi_block_table = self.archive.hi_block_table();
+
+        let mut referenced = vec![false; block_table.entries().len()];
+        for entry in hash_table.entries() {
+            if entry.is_valid()
+                && let Some(slot) = referenced.get_mut(entry.block_index as usize)
+            {
+                *slot = true;
+            }
+        }
+
+        let mut live: Vec<LiveBlock> = block_table
+            .entries()
+            .iter()
+            .enumerate()
+            .filter(|&(index, entry)| referenced[index] && entry.exists())
+            .map(|(index, entry)| {
+                let high = hi_block_table.map_or(0, |t| t.get_file_pos_high(index));
+                let crc_len = if entry.is_single_unit() && entry.has_sector_crc() {
+                    4
+                } else {
+                    0
+                };
+                LiveBlock {
+                    old_index: index,
+                    old_pos: archive_offset + (high << 32 | entry.file_pos as u64),
+                    stored_len: entry.compressed_size as u64 + crc_len,
+                    new_pos: 0,
+                    entry: *entry,
+                    replacement: None,
+                    rekey: None,
+                }
+            })
+            .collect();
+
+        live.sort_by_key(|block| (block.old_pos, block.old_index));
+        Ok(live)
+    }
+
+    /// Size compressed sectored files with sector CRCs from their offset tables
+    ///
+    /// Their block size does not cover a CRC table stored between the offset
+    /// table and the first sector, so copying only that many bytes would cut
+    /// off the end of the last sector. Encrypted ones need their names from
+    /// `(listfile)` to read the table; without one they keep their block size.
+    fn measure_sectored_blocks(
+        &mut self,
+        live: &mut [LiveBlock],
+        archive_offset: u64,
+    ) -> Result<()> {
+        let sized = |block: &LiveBlock| {
+            block.entry.has_sector_crc()
+                && block.entry.is_compressed()
+                && !block.entry.is_single_unit()
+        };
+        let names = if live
+            .iter()
+            .any(|block| sized(block) && block.entry.is_encrypted())
+        {
+            self.listfile_names()?
+        } else {
+            HashMap::new()
+        };
+
+        let sector_size = self.archive.header().sector_size();
+        for block in live.iter_mut().filter(|block| sized(&**block)) {
+            let info = FileInfo {
+                filename: String::new(),
+                hash_index: 0,
+                block_index: block.old_index,
+                file_pos: block.old_pos,
+                compressed_size: block.entry.compressed_size as u64,
+                file_size: block.entry.file_size as u64,
+                flags: block.entry.flags,
+                locale: 0,
+            };
+            let key = match names.get(&block.old_index) {
+                Some(name) => Some(file_key(name, &info, archive_offset, block.entry.file_size)),
+                None if info.is_encrypted() => None,
+                None => Some(0),
+            };
+            block.stored_len = stored_extent(&self.file, &info, key, sector_size)?;
+        }
+        Ok(())
+    }
+
+    /// Names from `(listfile)` by the block they resolve to
+    fn listfile_names(&mut self) -> Result<HashMap<usize, String>> {
+        let listfile = self.read_current_file("(listfile)").unwrap_or_default();
+        let listfile = String::from_utf8_lossy(&listfile);
+        let mut names = HashMap::new();
+        for name in listfile
+            .lines()
+            .map(str::trim)
+            .filter(|name| !name.is_empty())
+        {
+            if let Some((_, entry)) = self.find_file_entry(name)? {
+                names
+                    .entry(entry.block_index as usize)
+                    .or_insert_with(|| name.to_string());
+            }
+        }
+        Ok(names)
+    }
+
+    /// Replace `(attributes)` with a copy whose entries follow the new block order
+    fn reorder_attributes(&mut self, live: &mut [LiveBlock]) -> Result<()> {
+        let Some((_, entry)) = self.find_file_entry("(attributes)")? else {
+            return Ok(());
+        };
+        let Some(position) = live
+            .iter()
+            .position(|block| block.old_index == entry.block_index as usize)
+        else {
+            return Ok(());
+        };
+
+        let block_count = self.block_table.as_ref().map_or(0, |t| t.entries().len());
+        let data = self.read_current_file("(attributes)")?;
+        let mut attrs = match Attributes::parse(&Bytes::from(data), block_count) {
+            Ok(attrs) => attrs,
+            Err(e) => {
+                log::warn!("Copying unparseable (attributes) unchanged during compaction: {e}");
+                return Ok(());
+            }
+        };
+
+        let old_attributes = std::mem::take(&mut attrs.file_attributes);
+        attrs.file_attributes = live
+            .iter()
+            .map(|block| {
+                old_attributes
+                    .get(block.old_index)
+                    .cloned()
+                    .unwrap_or_default()
+            })
+            .collect();
+
+        let options = AddFileOptions::new().compression(CompressionMethod::None);
+        let prepared = Self::prepare_file_data(&attrs.to_bytes()?, "(attributes)", &options)?;
+        let block = &mut live[position];
+        block.entry.compressed_size = prepared.data.len() as u32;
+        block.entry.file_size = prepared.file_size as u32;
+        block.entry.flags = prepared.flags;
+        block.stored_len = prepared.data.len() as u64;
+        block.replacement = Some(prepared.data);
+        Ok(())
+    }
+
+    /// Work out the keys of FIX_KEY files whose position changes
+    fn plan_rekeys(&mut self, live: &mut [LiveBlock], archive_offset: u64) -> Result<()> {
+        let moves = |block: &LiveBlock| {
+            block.entry.is_encrypted()
+                && block.entry.has_fix_key()
+                && block.new_pos != block.old_pos
+        };
+        if !live.iter().any(moves) {
+            return Ok(());
+        }
+
+        // The key is derived from the file name, which only (listfile) knows
+        let names = self.listfile_names()?;
+
+        for block in live.iter_mut().filter(|block| moves(&**block)) {
+            let name = names.get(&block.old_index).ok_or_else(|| {
+                Error::crypto(format!(
+                    "Cannot re-encrypt block {} for its new position: name not in (listfile)",
+                    block.old_index
+                ))
+            })?;
+            if block.entry.is_patch_file() {
+                return Err(Error::UnsupportedFeature(format!(
+                    "Moving FIX_KEY patch file {name}"
+                )));
+            }
+
+            let base_key = hash_string(name, hash_type::FILE_KEY);
+            let file_size = block.entry.file_size;
+            let fixed_key =
+                |pos: u64| base_key.wrapping_add((pos - archive_offset) as u32) ^ file_size;
+            block.rekey = Some((fixed_key(block.old_pos), fixed_key(block.new_pos)));
+        }
+        Ok(())
+    }
+
+    /// Encode the compacted hash, block and hi-block tables
+    fn build_tables(
+        &self,
+        live: &[LiveBlock],
+        archive_offset: u64,
+        data_end: u64,
+        format_version: FormatVersion,
+    ) -> Result<TableLayout> {
+        let old_hash_table = self
+            .hash_table
+            .as_ref()
+            .ok_or_else(|| Error::InvalidFormat("No hash table".to_string()))?;
+
+        let new_index: HashMap<u32, u32> = live
+            .iter()
+            .enumerate()
+            .map(|(new, block)| (block.old_index as u32, new as u32))
+            .collect();
+
+        let mut hash_entries = old_hash_table.entries().to_vec();
+        for entry in &mut hash_entries {
+            if entry.is_valid() {
+                entry.block_index = new_index
+                    .get(&entry.block_index)
+                    .copied()
+                    .unwrap_or(HashEntry::EMPTY_DELETED);
+            }
+        }
+        clear_deleted_chain_ends(&mut hash_entries);
+
+        let mut hash_table = Vec::with_capacity(hash_entries.len() * 16);
+        for entry in &hash_entries {
+            hash_table.extend_from_slice(&entry.name_1.to_le_bytes());
+            hash_table.extend_from_slice(&entry.name_2.to_le_bytes());
+            hash_table.extend_from_slice(&entry.locale.to_le_bytes());
+            hash_table.extend_from_slice(&entry.platform.to_le_bytes());
+            hash_table.extend_from_slice(&entry.block_index.to_le_bytes());
+        }
+        encrypt_table(&mut hash_table, "(hash table)");
+
+        let mut block_table = Vec::with_capacity(live.len() * 16);
+        let mut hi_block_table = Vec::with_capacity(live.len() * 2);
+        for block in live {
+            let pos = block.new_pos - archive_offset;
+            block_table.extend_from_slice(&(pos as u32).to_le_bytes());
+            block_table.extend_from_slice(&block.entry.compressed_size.to_le_bytes());
+            block_table.extend_from_slice(&block.entry.file_size.to_le_bytes());
+            block_table.extend_from_slice(&block.entry.flags.to_le_bytes());
+            hi_block_table.extend_from_slice(&((pos >> 32) as u16).to_le_bytes());
+        }
+        encrypt_table(&mut block_table, "(block table)");
+
+        let hash_table_pos = data_end - archive_offset;
+        let block_table_pos = hash_table_pos + hash_table.len() as u64;
+        let mut archive_size = block_table_pos + block_table.len() as u64;
+
+        let needs_hi_block = live
+            .iter()
+            .any(|block| block.new_pos - archive_offset > u32::MAX as u64)
+            || archive_size > u32::MAX as u64;
+        let (hi_block_table, hi_block_table_pos) = if needs_hi_block {
+            if format_version < FormatVersion::V2 {
+                return Err(Error::CapacityExceeded(
+                    "Compacted archive exceeds 4 GiB in a v1 archive".to_string(),
+                ));
+            }
+            let pos = archive_size;
+            archive_size += hi_block_table.len() as u64;
+            (Some(hi_block_table), Some(pos))
+        } else {
+            (None, None)
+        };
+
+        Ok(TableLayout {
+            hash_table,
+            block_table,
+            hi_block_table,
+            hash_table_pos,
+            block_table_pos,
+            hi_block_table_pos,
+            block_count: live.len() as u32,
+            archive_size,
+        })
+    }
+}
+
+/// Turn deleted hash entries that are directly followed by a free slot back
+/// into free slots, since no probe chain runs through them any more
+fn clear_deleted_chain_ends(entries: &mut [HashEntry]) {
+    let len = entries.len();
+    let Some(free) = entries.iter().position(HashEntry::is_empty) else {
+        return;
+    };
+
+    // Walk backwards from a free slot so each chain end is seen before the
+    // entries in front of it
+    let mut clearing = true;
+    for step in 1..len {
+        let entry = &mut entries[(free + len - step) % len];
+        if entry.is_empty() {
+            clearing = true;
+        } else if entry.is_deleted() && clearing {
+            *entry = HashEntry::empty();
+        } else {
+            clearing = false;
+        }
+    }
+}
+
+/// Encrypt an encoded hash or block table in place
+fn encrypt_table(data: &mut [u8], key_name: &str) {
+    let mut words: Vec<u32> = data
+        .chunks_exact(4)
+        .map(|chunk| u32::from_le_bytes([chunk[0], chunk[1], chunk[2], chunk[3]]))
+        .collect();
+    encrypt_block(&mut words, hash_string(key_name, hash_type::FILE_KEY));
+    for (chunk, word) in data.chunks_exact_mut(4).zip(words) {
+        chunk.copy_from_slice(&word.to_le_bytes());
+    }
+}
+
+/// Encrypt file data in place, the inverse of [`decrypt_file_data`]
+fn encrypt_file_data(data: &mut [u8], key: u32) {
+    if data.is_empty() || key == 0 {
+        return;
+    }
+
+    let chunks = data.len() / 4;
+    let mut words: Vec<u32> = data
+        .chunks_exact(4)
+        .map(|chunk| u32::from_le_bytes([chunk[0], chunk[1], chunk[2], chunk[3]]))
+        .collect();
+    encrypt_block(&mut words, key);
+    for (chunk, word) in data.chunks_exact_mut(4).zip(words) {
+        chunk.copy_from_slice(&word.to_le_bytes());
+    }
+
+    // A trailing partial dword is encrypted as if padded with zeros
+    let remainder = data.len() % 4;
+    if remainder > 0 {
+        let offset = chunks * 4;
+        let mut last = [0u8; 4];
+        last[..remainder].copy_from_slice(&data[offset..]);
+        let mut word = u32::from_le_bytes(last);
+        encrypt_block(
+            std::slice::from_mut(&mut word),
+            key.wrapping_add(chunks as u32),
+        );
+        data[offset..].copy_from_slice(&word.to_le_bytes()[..remainder]);
+    }
+}
+
+/// Re-encrypt a stored FIX_KEY file for a new key
+///
+/// Follows the layout the reader expects: single-unit and uncompressed files
+/// are encrypted in one piece, sectored files have an encrypted sector offset
+/// table and one key per sector. `data` holds the whole stored extent. Sector
+/// CRC tables are stored unencrypted and are left as they are; the extra
+/// offset of the StormLib layout is re-encrypted with the rest of the table.
+fn rekey_block(
+    data: &mut [u8],
+    entry: &BlockEntry,
+    sector_size: usize,
+    old_key: u32,
+    new_key: u32,
+) -> Result<()> {
+    let rekey = |part: &mut [u8], old: u32, new: u32| {
+        decrypt_file_data(part, old);
+        encrypt_file_data(part, new);
+    };
+
+    let stored = (entry.compressed_size as usize).min(data.len());
+    if entry.is_single_unit() || !entry.is_compressed() {
+        rekey(&mut data[..stored], old_key, new_key);
+        return Ok(());
+    }
+
+    let stored = data.len();
+    let sector_count = (entry.file_size as usize).div_ceil(sector_size);
+    let mut table_len = (sector_count + 1) * 4;
+    if table_len > stored {
+        return Err(Error::invalid_format(
+            "Sector offset table exceeds file data",
+        ));
+    }
+
+    // The StormLib layout adds an offset ending the CRC table after the
+    // sectors; decrypting the longer prefix gives the same leading offsets
+    if entry.has_sector_crc() && table_len + 4 <= stored {
+        let mut extended = data[..table_len + 4].to_vec();
+        decrypt_file_data(&mut extended, old_key.wrapping_sub(1));
+        let word = |i: usize| {
+            u32::from_le_bytes([
+                extended[i * 4],
+                extended[i * 4 + 1],
+                extended[i * 4 + 2],
+                extended[i * 4 + 3],
+            ]) as usize
+        };
+        if is_stormlib_crc_layout(
+            word(0),
+            word(sector_count),
+            word(sector_count + 1),
+            sector_count,
+        ) {
+            table_len += 4;
+        }
+    }
+
+    decrypt_file_data(&mut data[..table_len], old_key.wrapping_sub(1));
+    let offsets: Vec<usize> = data[..(sector_count + 1) * 4]
+        .chunks_exact(4)
+        .map(|chunk| u32::from_le_bytes([chunk[0], chunk[1], chunk[2], chunk[3]]) as usize)
+        .collect();
+    encrypt_file_data(&mut data[..table_len], new_key.wrapping_sub(1));
+
+    for (i, bounds) in offsets.windows(2).enumerate() {
+        let (start, end) = (bounds[0], bounds[1]);
+        if start > end || end > stored {
+            return Err(Error::invalid_format("Sector offset out of range"));
+        }
+        rekey(
+            &mut data[start..end],
+            old_key.wrapping_add(i as u32),
+            new_key.wrapping_add(i as u32),
+        );
+    }
+    Ok(())
+}
+
+/// Copy `len` bytes starting at `offset` of `source` to `out`
+///
+/// `progress` receives the number of bytes copied so far after each chunk.
+fn copy_range<W: Write>(
+    source: &mut File,
+    out: &mut W,
+    offset: u64,
+    len: u64,
+    buffer: &mut [u8],
+    mut progress: impl FnMut(u64),
+) -> Result<()> {
+    source.seek(SeekFrom::Start(offset))?;
+    let mut copied = 0u64;
+    while copied < len {
+        let chunk = (len - copied).min(buffer.len() as u64) as usize;
+        source.read_exact(&mut buffer[..chunk])?;
+        out.write_all(&buffer[..chunk])?;
+        copied += chunk as u64;
+        progress(copied);
+    }
+    Ok(())
+}
+
+/// Point a copy of the original header at the compacted tables
+///
+/// HET/BET positions are cleared, as only classic tables are written. V4
+/// headers get their table sizes and MD5s recomputed.
+fn patch_header(header: &mut [u8], format_version: FormatVersion, tables: &TableLayout) {
+    fn put(header: &mut [u8], offset: usize, bytes: &[u8]) {
+        if let Some(field) = header.get_mut(offset..offset + bytes.len()) {
+            field.copy_from_slice(bytes);
+        }
+    }
+    let md5 = |data: &[u8]| -> [u8; 16] { Md5::digest(data).into() };
+
+    let archive_size_32 = tables.archive_size.min(u32::MAX as u64) as u32;
+    put(header, 8, &archive_size_32.to_le_bytes());
+    put(header, 16, &(tables.hash_table_pos as u32).to_le_bytes());
+    put(header, 20, &(tables.block_table_pos as u32).to_le_bytes());
+    put(header, 28, &tables.block_count.to_le_bytes());
+
+    if format_version >= FormatVersion::V2 {
+        put(
+            header,
+            32,
+            &tables.hi_block_table_pos.unwrap_or(0).to_le_bytes(),
+        );
+        put(
+            header,
+            40,
+            &((tables.hash_table_pos >> 32) as u16).to_le_bytes(),
+        );
+        put(
+            header,
+            42,
+            &((tables.block_table_pos >> 32) as u16).to_le_bytes(),
+        );
+    }
+
+    if format_version >= FormatVersion::V3 {
+        put(header, 44, &tables.archive_size.to_le_bytes());
+        put(header, 52, &0u64.to_le_bytes()); // BET table
+        put(header, 60, &0u64.to_le_bytes()); // HET table
+
+        if header.len() >= 208 {
+            let hi_block_table = tables.hi_block_table.as_deref();
+            put(header, 68, &(tables.hash_table.len() as u64).to_le_bytes());
+            put(header, 76, &(tables.block_table.len() as u64).to_le_bytes());
+            put(
+                header,
+                84,
+                &(hi_block_table.map_or(0, <[u8]>::len) as u64).to_le_bytes(),
+            );
+            put(header, 92, &0u64.to_le_bytes());
+            put(header, 100, &0u64.to_le_bytes());
+            put(header, 112, &md5(&tables.block_table));
+            put(header, 128, &md5(&tables.hash_table));
+            put(header, 144, &hi_block_table.map_or([0u8; 16], md5));
+            put(header, 160, &[0u8; 16]);
+            put(header, 176, &[0u8; 16]);
+            let header_md5 = md5(&header[..192]);
+            put(header, 192, &header_md5);
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::{ArchiveBuilder, AttributesOption, ListfileOption};
+    use tempfile::TempDir;
+
+    #[test]
+    fn test_compact_copies_live_files() -> Result<()> {
+        let temp_dir = TempDir::new()?;
+        let path = temp_dir.path().join("compact.mpq");
+
+        let text: Vec<u8> = b"compressible text ".repeat(4000);
+        let keyed: Vec<u8> = (0..20_000u32).map(|i| (i * 7 % 251) as u8).collect();
+        let sectors: Vec<u8> = (0..30_000u32).map(|i| (i * 13 % 256) as u8).collect();
+        ArchiveBuilder::new()
+            .version(FormatVersion::V2)
+            .listfile_option(ListfileOption::Generate)
+            .attributes_option(AttributesOption::GenerateCrc32)
+            .generate_crcs(true)
+            .add_file_data(vec![0xAB; 50_000], "removed.bin")
+            .add_file_data(text.clone(), "text.txt")
+            .add_file_data(sectors.clone(), "sectors.bin")
+            .add_file_data_with_encryption(keyed.clone(), "keyed.bin", 0x02, true, 0)
+            .build(&path)?;
+
+        {
+            let mut archive = MutableArchive::open(&path)?;
+            archive.remove_file("removed.bin")?;
+            archive.flush()?;
+        }
+        let size_before = std::fs::metadata(&path)?.len();
+
+        let mut phases = Vec::new();
+        let mut archive = MutableArchive::open(&path)?;
+        archive.compact_with_progress(|p| {
+            assert!(p.bytes_done <= p.bytes_total);
+            if phases.last() != Some(&p.phase) {
+                phases.push(p.phase);
+            }
+        })?;
+        drop(archive);
+
+        assert!(std::fs::metadata(&path)?.len() < size_before);
+        assert_eq!(
+            phases,
+            [
+                CompactPhase::CheckingFiles,
+                CompactPhase::CheckingHashTable,
+                CompactPhase::CopyingNonMpqData,
+                CompactPhase::CompactingFiles,
+                CompactPhase::ClosingArchive,
+            ]
+        );
+
+        let mut archive = Archive::open(&path)?;
+        assert!(archive.find_file("removed.bin")?.is_none());
+        assert_eq!(archive.read_file("text.txt")?, text);
+        assert_eq!(archive.read_file("keyed.bin")?, keyed);
+        assert_eq!(archive.read_file("sectors.bin")?, sectors);
+
+        // Sector CRC tables are copied whole, unencrypted and unchanged
+        for (name, expected) in [
+            ("text.txt", &text),
+            ("sectors.bin", &sectors),
+            ("keyed.bin", &keyed),
+        ] {
+            let mut stream = archive.open_file_stream(name)?;
+            assert!(stream.enable_sector_crc_check()?, "{name}");
+            let mut data = Vec::new();
+            stream.read_to_end(&mut data)?;
+            assert_eq!(&data, expected, "{name}");
+        }
+
+        // (attributes) follows the blocks to their new indices
+        archive.load_attributes()?;
+        let info = archive.find_file("keyed.bin")?.unwrap();
+        let crc = archive
+            .get_file_attributes(info.block_index)
+            .and_then(|a| a.crc32);
+        assert_eq!(crc, Some(crc32fast::hash(&keyed)));
+        Ok(())
+    }
+
+    #[test]
+    fn test_clear_deleted_chain_ends() {
+        let deleted = HashEntry {
+            block_index: HashEntry::EMPTY_DELETED,
+            ..HashEntry::empty()
+        };
+        let used = HashEntry {
+            block_index: 0,
+            ..HashEntry::empty()
+        };
+        let mut entries = vec![deleted, used, deleted, deleted, HashEntry::empty()];
+        clear_deleted_chain_ends(&mut entries);
+        assert!(entries[0].is_deleted());
+        assert!(entries[1].is_valid());
+        assert!(entries[2].is_empty());
+        assert!(entries[3].is_empty());
+        assert!(entries[4].is_empty());
+    }
+}
@@ -0,0 +1,206 @@
+//! Sorted index of archive file names with glob queries
+//!
+//! [`NameIndex`] keeps file entries sorted by their folded name (see
+//! [`fold_mpq_path`]). A [`Glob`] pattern can then be answered by binary
+//! searching for the entries that share its literal prefix and matching only
+//! those, so `World\Maps\Azeroth\*.adt` never looks at names outside
+//! `WORLD\MAPS\AZEROTH\`.
+//!
+//! Matching is case-insensitive and treats `/` and `\` alike, like MPQ name
+//! lookups. `*` matches any run of characters, including path separators,
+//! and `?` matches exactly one byte.
+
+use crate::archive::FileEntry;
+use crate::path::fold_mpq_path;
+use std::ops::Range;
+
+/// A compiled `*`/`?` wildcard pattern
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct Glob {
+    /// Folded pattern
+    pattern: String,
+    /// Length of the literal prefix before the first wildcard
+    prefix_len: usize,
+}
+
+impl Glob {
+    /// Compile a pattern
+    ///
+    /// `*.*` is accepted as a synonym for `*`, as on Windows.
+    pub fn new(pattern: &str) -> Self {
+        let pattern = if pattern == "*.*" { "*" } else { pattern };
+        let pattern = fold_mpq_path(pattern);
+        let prefix_len = pattern.find(['*', '?']).unwrap_or(pattern.len());
+        Self {
+            pattern,
+            prefix_len,
+        }
+    }
+
+    /// Literal prefix every matching name starts with (folded)
+    pub fn prefix(&self) -> &str {
+        &self.pattern[..self.prefix_len]
+    }
+
+    /// Whether a name matches the pattern
+    pub fn matches(&self, name: &str) -> bool {
+        self.matches_folded(&fold_mpq_path(name))
+    }
+
+    /// Whether an already folded name matches the pattern
+    fn matches_folded(&self, name: &str) -> bool {
+        let pattern = self.pattern.as_bytes();
+        let text = name.as_bytes();
+        let (mut p, mut t) = (0, 0);
+        // Position after the last `*` and the text position it was tried at
+        let mut backtrack: Option<(usize, usize)> = None;
+
+        while t < text.len() {
+            match pattern.get(p) {
+                Some(b'*') => {
+                    p += 1;
+                    backtrack = Some((p, t));
+                }
+                Some(&c) if c == b'?' || c == text[t] => {
+                    p += 1;
+                    t += 1;
+                }
+                _ => match backtrack {
+                    // Let the last `*` absorb one more character
+                    Some((star_p, star_t)) => {
+                        p = star_p;
+                        t = star_t + 1;
+                        backtrack = Some((star_p, star_t + 1));
+                    }
+                    None => return false,
+                },
+            }
+        }
+
+        pattern[p..].iter().all(|&c| c == b'*')
+    }
+}
+
+/// File entries sorted by folded name
+#[derive(Debug, Default)]
+pub struct NameIndex {
+    /// Folded names, sorted; parallel to `entries`
+    keys: Vec<String>,
+    entries: Vec<FileEntry>,
+}
+
+impl NameIndex {
+    /// Build an index from a file listing
+    pub fn new(entries: Vec<FileEntry>) -> Self {
+        let mut keyed: Vec<(String, FileEntry)> = entries
+            .into_iter()
+            .map(|entry| (fold_mpq_path(&entry.name), entry))
+            .collect();
+        keyed.sort_unstable_by(|a, b| a.0.cmp(&b.0));
+
+        let (keys, entries) = keyed.into_iter().unzip();
+        Self { keys, entries }
+    }
+
+    /// Number of indexed files
+    pub fn len(&self) -> usize {
+        self.entries.len()
+    }
+
+    /// Whether the index is empty
+    pub fn is_empty(&self) -> bool {
+        self.entries.is_empty()
+    }
+
+    /// All entries in sorted order
+    pub fn entries(&self) -> &[FileEntry] {
+        &self.entries
+    }
+
+    /// Index range of the entries whose folded name starts with `prefix`
+    ///
+    /// `prefix` must already be folded, e.g. from [`Glob::prefix`].
+    pub fn prefix_range(&self, prefix: &str) -> Range<usize> {
+        let start = self.keys.partition_point(|key| key.as_str() < prefix);
+        let len = self.keys[start..].partition_point(|key| key.starts_with(prefix));
+        start..start + len
+    }
+
+    /// Whether the entry at `index` matches `glob`
+    pub fn matches_at(&self, index: usize, glob: &Glob) -> bool {
+        self.keys
+            .get(index)
+            .is_some_and(|key| glob.matches_folded(key))
+    }
+
+    /// Iterate over the entries matching `glob`, in sorted order
+    pub fn matching<'a>(&'a self, glob: &'a Glob) -> impl Iterator<Item = &'a FileEntry> + 'a {
+        self.prefix_range(glob.prefix())
+            .filter(move |&i| glob.matches_folded(&self.keys[i]))
+            .map(move |i| &self.entries[i])
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn entry(name: &str) -> FileEntry {
+        FileEntry {
+            name: name.to_string(),
+            size: 0,
+            compressed_size: 0,
+            flags: 0,
+            hashes: None,
+            table_indices: None,
+        }
+    }
+
+    #[test]
+    fn test_glob_matching() {
+        let glob = Glob::new("World\\Maps\\*\\*.adt");
+        assert_eq!(glob.prefix(), "WORLD\\MAPS\\");
+        assert!(glob.matches("world/maps/Azeroth/Azeroth_32_48.ADT"));
+        assert!(!glob.matches("World\\Maps\\Azeroth\\Azeroth.wdt"));
+        assert!(!glob.matches("World\\Maps.adt"));
+
+        let glob = Glob::new("file_??.txt");
+        assert!(glob.matches("FILE_01.TXT"));
+        assert!(!glob.matches("file_1.txt"));
+        assert!(!glob.matches("file_001.txt"));
+
+        assert!(Glob::new("*").matches(""));
+        assert!(Glob::new("*.*").matches("no_extension"));
+        assert!(Glob::new("a*b*c").matches("aXbYbZc"));
+        assert!(!Glob::new("a*b*c").matches("aXbYbZ"));
+        assert!(Glob::new("exact.txt").matches("EXACT.txt"));
+        assert!(!Glob::new("exact.txt").matches("exact.txt2"));
+    }
+
+    #[test]
+    fn test_prefix_range_and_matching() {
+        let index = NameIndex::new(vec![
+            entry("World\\Maps\\Azeroth\\Azeroth_32_48.adt"),
+            entry("Interface\\Glues\\logo.blp"),
+            entry("world\\maps\\azeroth\\azeroth.wdt"),
+            entry("World\\Maps\\Kalimdor\\Kalimdor_1_1.adt"),
+            entry("World\\Maps\\Azeroth\\Azeroth_32_49.adt"),
+        ]);
+        assert_eq!(index.len(), 5);
+
+        let glob = Glob::new("World/Maps/Azeroth/*.adt");
+        assert_eq!(index.prefix_range(glob.prefix()).len(), 3);
+
+        let names: Vec<&str> = index.matching(&glob).map(|e| e.name.as_str()).collect();
+        assert_eq!(
+            names,
+            [
+                "World\\Maps\\Azeroth\\Azeroth_32_48.adt",
+                "World\\Maps\\Azeroth\\Azeroth_32_49.adt",
+            ]
+        );
+
+        assert_eq!(index.matching(&Glob::new("*")).count(), 5);
+        assert_eq!(index.matching(&Glob::new("Sound\\*")).count(), 0);
+    }
+}
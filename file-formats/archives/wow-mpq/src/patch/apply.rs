@@ -1,6 +1,7 @@
 //! Patch application logic
 //!
-//! This module implements patch application for both COPY and BSD0 patch types.
+//! This module implements patch application for both COPY and BSD0 patch types,
+//! for single patches and for chains of patches applied to one base file.
 
 use super::header::{PatchFile, PatchType};
 use crate::{Error, Result};
@@ -24,37 +25,115 @@ use crate::{Error, Result};
 /// - Patched result MD5 doesn't match expected hash
 /// - Unsupported patch type (BSD0 not yet implemented)
 pub fn apply_patch(patch: &PatchFile, base_data: &[u8]) -> Result<Vec<u8>> {
-    // Verify base file MD5 before patching
-    patch.verify_base(base_data)?;
-
-    // Apply patch based on type
-    let patched_data = match patch.header.patch_type {
-        PatchType::Copy => apply_copy_patch(patch, base_data)?,
-        PatchType::Bsd0 => apply_bsd0_patch(patch, base_data)?,
-    };
-
-    // Verify patched result MD5
-    patch.verify_patched(&patched_data)?;
-
+    let mut patched_data = Vec::new();
+    apply_step(patch, base_data, &mut patched_data, &mut Vec::new(), true)?;
     Ok(patched_data)
 }
 
-/// Apply a COPY patch
+/// Apply a chain of patches to base data
 ///
-/// COPY patches are simple file replacements - the patch data is the complete
-/// new file content. We ignore the base data entirely.
+/// `patches` are applied in order, each to the result of the previous one.
+/// Intermediate results live in two buffers that are allocated once, sized
+/// for the largest `size_after` in the chain, and swapped after every step,
+/// so a chain of any length costs two full-size allocations.
 ///
-/// # Arguments
+/// A COPY patch replaces the whole file, so every step before the last COPY
+/// patch is skipped and the chain continues from that patch's data.
 ///
-/// * `patch` - The parsed COPY patch file
-/// * `base_data` - The original file data (used for size verification only)
+/// With `verify_md5`, the state before and after every applied step is checked
+/// against the MD5 hashes in its PTCH header. Sizes are always checked.
 ///
-/// # Returns
+/// # Errors
+///
+/// Returns error if any applied step fails, see [`apply_patch`].
+pub fn apply_patch_chain(
+    base_data: &[u8],
+    patches: &[&PatchFile],
+    verify_md5: bool,
+) -> Result<Vec<u8>> {
+    // Everything before the last full replacement is overwritten anyway
+    let (start, steps) = match patches
+        .iter()
+        .rposition(|patch| patch.header.patch_type == PatchType::Copy)
+    {
+        Some(last_copy) => {
+            let copy = patches[last_copy];
+            check_copy_patch(copy, None)?;
+            if verify_md5 {
+                copy.verify_patched(&copy.data)?;
+            }
+            if last_copy > 0 {
+                log::debug!("Skipping {last_copy} patches replaced by a COPY patch");
+            }
+            (copy.data.as_slice(), &patches[last_copy + 1..])
+        }
+        None => (base_data, patches),
+    };
+
+    let capacity = steps
+        .iter()
+        .map(|patch| patch.header.size_after as usize)
+        .max()
+        .unwrap_or(0);
+    let scratch_capacity = steps
+        .iter()
+        .filter(|patch| patch.header.patch_type == PatchType::Bsd0)
+        .map(|patch| patch.header.patch_data_size as usize)
+        .max()
+        .unwrap_or(0);
+
+    // `front` holds the current state once the first step has run, `back`
+    // receives the next one
+    let mut front = Vec::with_capacity(capacity);
+    let mut back = Vec::with_capacity(capacity);
+    let mut scratch = Vec::with_capacity(scratch_capacity);
+    let mut in_front = false;
+
+    for patch in steps {
+        let current: &[u8] = if in_front { &front } else { start };
+        apply_step(patch, current, &mut back, &mut scratch, verify_md5)?;
+        std::mem::swap(&mut front, &mut back);
+        in_front = true;
+    }
+
+    Ok(if in_front { front } else { start.to_vec() })
+}
+
+/// Apply one patch, writing the result into `out`
 ///
-/// The complete new file data (from patch.data)
-fn apply_copy_patch(patch: &PatchFile, base_data: &[u8]) -> Result<Vec<u8>> {
+/// `scratch` receives the decompressed BSD0 data.
+fn apply_step(
+    patch: &PatchFile,
+    base_data: &[u8],
+    out: &mut Vec<u8>,
+    scratch: &mut Vec<u8>,
+    verify_md5: bool,
+) -> Result<()> {
+    // Verify base file MD5 before patching
+    if verify_md5 {
+        patch.verify_base(base_data)?;
+    }
+
+    // Apply patch based on type
+    match patch.header.patch_type {
+        PatchType::Copy => apply_copy_patch(patch, base_data, out)?,
+        PatchType::Bsd0 => apply_bsd0_patch(patch, base_data, out, scratch)?,
+    }
+
+    // Verify patched result MD5
+    if verify_md5 {
+        patch.verify_patched(out)?;
+    }
+
+    Ok(())
+}
+
+/// Check the sizes of a COPY patch, and of its base when one is given
+fn check_copy_patch(patch: &PatchFile, base_data: Option<&[u8]>) -> Result<()> {
     // Verify base file size matches expected
-    if base_data.len() != patch.header.size_before as usize {
+    if let Some(base_data) = base_data
+        && base_data.len() != patch.header.size_before as usize
+    {
         return Err(Error::invalid_format(format!(
             "Base file size mismatch: expected {}, got {}",
             patch.header.size_before,
@@ -71,6 +150,22 @@ fn apply_copy_patch(patch: &PatchFile, base_data: &[u8]) -> Result<Vec<u8>> {
         )));
     }
 
+    Ok(())
+}
+
+/// Apply a COPY patch
+///
+/// COPY patches are simple file replacements - the patch data is the complete
+/// new file content. We ignore the base data entirely.
+///
+/// # Arguments
+///
+/// * `patch` - The parsed COPY patch file
+/// * `base_data` - The original file data (used for size verification only)
+/// * `out` - Receives the complete new file data (from patch.data)
+fn apply_copy_patch(patch: &PatchFile, base_data: &[u8], out: &mut Vec<u8>) -> Result<()> {
+    check_copy_patch(patch, Some(base_data))?;
+
     log::debug!(
         "Applying COPY patch: {} -> {} bytes",
         base_data.len(),
@@ -78,7 +173,19 @@ fn apply_copy_patch(patch: &PatchFile, base_data: &[u8]) -> Result<Vec<u8>> {
     );
 
     // COPY patch: patch data IS the complete new file
-    Ok(patch.data.clone())
+    out.clear();
+    out.extend_from_slice(&patch.data);
+    Ok(())
+}
+
+/// Read the little-endian u64 at `offset`
+fn read_u64(data: &[u8], offset: usize) -> u64 {
+    u64::from_le_bytes(data[offset..offset + 8].try_into().unwrap())
+}
+
+/// Read the little-endian u32 at `offset`
+fn read_u32(data: &[u8], offset: usize) -> u32 {
+    u32::from_le_bytes(data[offset..offset + 4].try_into().unwrap())
 }
 
 /// Apply a BSD0 (bsdiff40) patch
@@ -90,14 +197,14 @@ fn apply_copy_patch(patch: &PatchFile, base_data: &[u8]) -> Result<Vec<u8>> {
 ///
 /// * `patch` - The parsed BSD0 patch file
 /// * `base_data` - The original file data
-///
-/// # Returns
-///
-/// The patched file data
-fn apply_bsd0_patch(patch: &PatchFile, base_data: &[u8]) -> Result<Vec<u8>> {
-    use byteorder::{LittleEndian, ReadBytesExt};
-    use std::io::Cursor;
-
+/// * `out` - Receives the patched file data
+/// * `scratch` - Buffer for the decompressed patch data
+fn apply_bsd0_patch(
+    patch: &PatchFile,
+    base_data: &[u8],
+    out: &mut Vec<u8>,
+    scratch: &mut Vec<u8>,
+) -> Result<()> {
     // Verify base file size
     if base_data.len() != patch.header.size_before as usize {
         return Err(Error::invalid_format(format!(
@@ -114,11 +221,13 @@ fn apply_bsd0_patch(patch: &PatchFile, base_data: &[u8]) -> Result<Vec<u8>> {
         patch.data.len()
     );
 
-    let bsdiff_data = crate::compression::rle::decompress(
+    crate::compression::rle::decompress_into(
         &patch.data,
         patch.header.patch_data_size as usize,
         true, // skip 4-byte size header
+        scratch,
     )?;
+    let bsdiff_data = scratch.as_slice();
 
     log::debug!(
         "RLE decompression complete: {} bytes → {} bytes",
@@ -126,10 +235,14 @@ fn apply_bsd0_patch(patch: &PatchFile, base_data: &[u8]) -> Result<Vec<u8>> {
         bsdiff_data.len()
     );
 
-    let mut reader = Cursor::new(&bsdiff_data);
-
     // Parse Bsdiff40 header (32 bytes)
-    let signature = reader.read_u64::<LittleEndian>()?;
+    if bsdiff_data.len() < 32 {
+        return Err(Error::invalid_format(format!(
+            "BSD0 patch data too small for header: {} bytes",
+            bsdiff_data.len()
+        )));
+    }
+    let signature = read_u64(bsdiff_data, 0);
     if signature != 0x3034464649445342 {
         // 'BSDIFF40'
         return Err(Error::invalid_format(format!(
@@ -137,9 +250,9 @@ fn apply_bsd0_patch(patch: &PatchFile, base_data: &[u8]) -> Result<Vec<u8>> {
         )));
     }
 
-    let ctrl_block_size = reader.read_u64::<LittleEndian>()? as usize;
-    let data_block_size = reader.read_u64::<LittleEndian>()? as usize;
-    let new_file_size = reader.read_u64::<LittleEndian>()? as usize;
+    let ctrl_block_size = read_u64(bsdiff_data, 8) as usize;
+    let data_block_size = read_u64(bsdiff_data, 16) as usize;
+    let new_file_size = read_u64(bsdiff_data, 24) as usize;
 
     // Verify new file size matches header
     if new_file_size != patch.header.size_after as usize {
@@ -158,9 +271,9 @@ fn apply_bsd0_patch(patch: &PatchFile, base_data: &[u8]) -> Result<Vec<u8>> {
     );
 
     // Calculate block positions
-    let ctrl_start = 32; // After bsdiff header
-    let data_start = ctrl_start + ctrl_block_size;
-    let extra_start = data_start + data_block_size;
+    let ctrl_start = 32usize; // After bsdiff header
+    let data_start = ctrl_start.saturating_add(ctrl_block_size);
+    let extra_start = data_start.saturating_add(data_block_size);
 
     // Validate block sizes
     if extra_start > bsdiff_data.len() {
@@ -178,8 +291,10 @@ fn apply_bsd0_patch(patch: &PatchFile, base_data: &[u8]) -> Result<Vec<u8>> {
     // Number of control blocks (each is 12 bytes: 3x u32)
     let num_ctrl_blocks = ctrl_block_size / 12;
 
-    // Allocate output buffer
-    let mut new_data = vec![0u8; new_file_size];
+    // Size the output buffer, reusing its allocation
+    out.clear();
+    out.resize(new_file_size, 0);
+    let new_data = out.as_mut_slice();
 
     // Process control blocks
     let mut new_offset = 0usize;
@@ -188,18 +303,11 @@ fn apply_bsd0_patch(patch: &PatchFile, base_data: &[u8]) -> Result<Vec<u8>> {
     let mut extra_ptr = 0usize;
 
     for i in 0..num_ctrl_blocks {
-        let ctrl_offset = i * 12;
-        if ctrl_offset + 12 > ctrl_block.len() {
-            return Err(Error::invalid_format(
-                "Control block extends beyond ctrl_block_size".to_string(),
-            ));
-        }
-
         // Read control block
-        let mut ctrl_reader = Cursor::new(&ctrl_block[ctrl_offset..ctrl_offset + 12]);
-        let add_data_length = ctrl_reader.read_u32::<LittleEndian>()? as usize;
-        let mov_data_length = ctrl_reader.read_u32::<LittleEndian>()? as usize;
-        let old_move_length_raw = ctrl_reader.read_u32::<LittleEndian>()?;
+        let ctrl_offset = i * 12;
+        let add_data_length = read_u32(ctrl_block, ctrl_offset) as usize;
+        let mov_data_length = read_u32(ctrl_block, ctrl_offset + 4) as usize;
+        let old_move_length_raw = read_u32(ctrl_block, ctrl_offset + 8);
 
         // Step 1: Copy from data block and combine with old data
         if new_offset + add_data_length > new_file_size {
@@ -216,20 +324,14 @@ fn apply_bsd0_patch(patch: &PatchFile, base_data: &[u8]) -> Result<Vec<u8>> {
         }
 
         // Copy from data block
-        new_data[new_offset..new_offset + add_data_length]
-            .copy_from_slice(&data_block[data_ptr..data_ptr + add_data_length]);
+        let added = &mut new_data[new_offset..new_offset + add_data_length];
+        added.copy_from_slice(&data_block[data_ptr..data_ptr + add_data_length]);
         data_ptr += add_data_length;
 
-        // Combine with old data (wrapping addition)
-        let combine_size = if old_offset + add_data_length >= base_data.len() {
-            base_data.len().saturating_sub(old_offset)
-        } else {
-            add_data_length
-        };
-
-        for j in 0..combine_size {
-            new_data[new_offset + j] =
-                new_data[new_offset + j].wrapping_add(base_data[old_offset + j]);
+        // Combine with old data (wrapping addition), as far as it reaches
+        let old = base_data.get(old_offset..).unwrap_or_default();
+        for (new_byte, old_byte) in added.iter_mut().zip(old) {
+            *new_byte = new_byte.wrapping_add(*old_byte);
         }
 
         new_offset += add_data_length;
@@ -276,7 +378,7 @@ fn apply_bsd0_patch(patch: &PatchFile, base_data: &[u8]) -> Result<Vec<u8>> {
 
     log::debug!("BSD0 patch applied successfully: {} bytes", new_data.len());
 
-    Ok(new_data)
+    Ok(())
 }
 
 #[cfg(test)]
@@ -545,6 +647,92 @@ mod tests {
         assert_eq!(result, new_data);
     }
 
+    /// Build a one-control-block BSD0 patch turning `old_data` into `new_data`
+    fn create_bsd0_diff(old_data: &[u8], new_data: &[u8]) -> PatchFile {
+        let add = old_data.len().min(new_data.len());
+        let mov = new_data.len() - add;
+
+        let mut patch_data = Vec::new();
+        patch_data.extend_from_slice(&0x3034464649445342u64.to_le_bytes());
+        patch_data.extend_from_slice(&12u64.to_le_bytes());
+        patch_data.extend_from_slice(&(add as u64).to_le_bytes());
+        patch_data.extend_from_slice(&(new_data.len() as u64).to_le_bytes());
+        patch_data.extend_from_slice(&(add as u32).to_le_bytes());
+        patch_data.extend_from_slice(&(mov as u32).to_le_bytes());
+        patch_data.extend_from_slice(&0u32.to_le_bytes());
+        patch_data.extend(
+            new_data[..add]
+                .iter()
+                .zip(old_data)
+                .map(|(new, old)| new.wrapping_sub(*old)),
+        );
+        patch_data.extend_from_slice(&new_data[add..]);
+
+        create_bsd0_patch(old_data, new_data, patch_data)
+    }
+
+    #[test]
+    fn test_patch_chain_matches_sequential() {
+        let v0 = vec![0x10u8; 300];
+        let v1: Vec<u8> = (0..400).map(|i| i as u8).collect();
+        let v2: Vec<u8> = (0..250).map(|i| (i * 7) as u8).collect();
+        let v3: Vec<u8> = (0..500).map(|i| (i * 3 + 1) as u8).collect();
+        let patches = [
+            create_bsd0_diff(&v0, &v1),
+            create_bsd0_diff(&v1, &v2),
+            create_bsd0_diff(&v2, &v3),
+        ];
+        let steps: Vec<&PatchFile> = patches.iter().collect();
+
+        let mut sequential = v0.clone();
+        for patch in &patches {
+            sequential = apply_patch(patch, &sequential).unwrap();
+        }
+
+        assert_eq!(sequential, v3);
+        assert_eq!(apply_patch_chain(&v0, &steps, false).unwrap(), v3);
+        assert_eq!(apply_patch_chain(&v0, &steps, true).unwrap(), v3);
+        assert_eq!(apply_patch_chain(&v0, &[], true).unwrap(), v0);
+    }
+
+    #[test]
+    fn test_patch_chain_skips_steps_before_copy() {
+        let base = vec![0u8; 100];
+        let replaced = b"replacement contents".to_vec();
+        let last = b"replacement contents, patched".to_vec();
+
+        // The first patch doesn't apply to the base at all, but a COPY patch
+        // replaces its result anyway
+        let mut broken = create_bsd0_diff(&[1, 2, 3], &[4, 5, 6]);
+        broken.data.truncate(4);
+        let patches = [
+            broken,
+            create_copy_patch(7, replaced.clone()),
+            create_bsd0_diff(&replaced, &last),
+        ];
+        let steps: Vec<&PatchFile> = patches.iter().collect();
+
+        assert_eq!(apply_patch_chain(&base, &steps, true).unwrap(), last);
+        assert_eq!(
+            apply_patch_chain(&base, &steps[..2], true).unwrap(),
+            replaced
+        );
+    }
+
+    #[test]
+    fn test_patch_chain_md5_only_when_requested() {
+        let v0 = vec![0x10u8; 64];
+        let v1 = vec![0x20u8; 64];
+        let mut patch = create_bsd0_diff(&v0, &v1);
+        patch.header.md5_after = [0; 16];
+
+        assert_eq!(apply_patch_chain(&v0, &[&patch], false).unwrap(), v1);
+        assert!(apply_patch_chain(&v0, &[&patch], true).is_err());
+
+        // Sizes are checked either way
+        assert!(apply_patch_chain(&v0[..10], &[&patch], false).is_err());
+    }
+
     #[test]
     fn test_bsd0_invalid_signature() {
         let old_data = vec![0x10u8];
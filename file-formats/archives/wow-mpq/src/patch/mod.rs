@@ -53,9 +53,13 @@
 //! let patched = apply_patch(&patch, &base_data)?;
 //! # Ok::<(), wow_mpq::Error>(())
 //! ```
+//!
+//! A whole chain of patches is applied with [`apply_patch_chain`], which
+//! reuses two buffers for the intermediate states and checks MD5 hashes only
+//! when asked to.
 
 mod apply;
 mod header;
 
-pub use apply::apply_patch;
+pub use apply::{apply_patch, apply_patch_chain};
 pub use header::{PatchFile, PatchHeader, PatchType};
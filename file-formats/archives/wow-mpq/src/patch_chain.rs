@@ -4,10 +4,16 @@
 //! where files in higher-priority archives override those in lower-priority ones.
 //! This is essential for World of Warcraft's patching system.
 
-use crate::{Archive, Error, FileEntry, Result};
+use crate::patch::PatchFile;
+use crate::{Archive, Error, FileEntry, FileInfo, FileStream, Result};
+use lru::LruCache;
 use std::collections::HashMap;
+use std::io::Read;
 use std::path::{Path, PathBuf};
 
+/// Default memory budget for memoized patched files (64 MiB)
+pub const DEFAULT_PATCH_CACHE_BYTES: usize = 64 * 1024 * 1024;
+
 /// A chain of MPQ archives with priority ordering
 ///
 /// `PatchChain` manages multiple MPQ archives where files in higher-priority
@@ -22,9 +28,12 @@ use std::path::{Path, PathBuf};
 ///
 /// - Files with the `MPQ_FILE_PATCH_FILE` flag are automatically recognized
 /// - Base file is located in lower-priority archives
-/// - Patches are applied in order (lowest to highest priority)
-/// - Both COPY (replacement) and BSD0 (binary diff) patches are supported
-/// - MD5 verification ensures patch integrity
+/// - Patches are applied in order (lowest to highest priority), reusing two
+///   buffers for the intermediate states
+/// - Both COPY (replacement) and BSD0 (binary diff) patches are supported;
+///   steps before a COPY patch are skipped
+/// - Sizes are always checked; MD5 verification of every step is enabled with
+///   [`set_verify_patches`](Self::set_verify_patches)
 ///
 /// # Examples
 ///
@@ -52,8 +61,13 @@ use std::path::{Path, PathBuf};
 pub struct PatchChain {
     /// Archives ordered by priority (highest first)
     archives: Vec<ChainEntry>,
-    /// Cache of file locations for quick lookup
-    file_map: HashMap<String, usize>,
+    /// Merged file index: normalized name -> every version of the file,
+    /// highest priority first
+    file_map: HashMap<String, Vec<ChainLocation>>,
+    /// Memoized results of applying patch files
+    patch_cache: PatchCache,
+    /// Check patch steps against the MD5 hashes in their headers
+    verify_patches: bool,
 }
 
 #[derive(Debug)]
@@ -64,6 +78,145 @@ struct ChainEntry {
     priority: i32,
     /// Path to the archive file
     path: PathBuf,
+    /// Files of the archive, resolved once on open
+    files: Vec<IndexedFile>,
+}
+
+/// A file of a chain archive, as resolved when the archive was opened
+#[derive(Debug)]
+struct IndexedFile {
+    /// Normalized name
+    key: String,
+    /// Block (or BET file) index
+    block: usize,
+    /// Whether the file is a PTCH patch
+    patch: bool,
+}
+
+/// One version of a file in the chain
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+struct ChainLocation {
+    /// Index of the archive in the chain, highest priority first
+    archive: usize,
+    /// Block (or BET file) index within that archive
+    block: usize,
+    /// Whether this version is a patch of the versions below it
+    patch: bool,
+}
+
+impl ChainEntry {
+    /// Open an archive and resolve the blocks of its files
+    fn open(path: &Path, priority: i32) -> Result<Self> {
+        let mut archive = Archive::open(path)?;
+
+        let names: Vec<String> = match archive.list() {
+            Ok(files) => files,
+            // Try list_all if no listfile
+            Err(_) => archive.list_all().unwrap_or_default(),
+        }
+        .into_iter()
+        .map(|file| file.name)
+        .collect();
+        let refs: Vec<&str> = names.iter().map(String::as_str).collect();
+        let mut blocks = Vec::with_capacity(refs.len());
+        archive.find_files_batch(&refs, &mut blocks)?;
+
+        // MPQ hashing is case-insensitive, so normalize keys to uppercase
+        let files = names
+            .iter()
+            .zip(blocks)
+            .filter_map(|(name, block)| {
+                let info = archive.find_file_by_block(name, block?)?;
+                Some(IndexedFile {
+                    key: normalize_key(name),
+                    block: info.block_index,
+                    patch: info.is_patch_file(),
+                })
+            })
+            .collect();
+
+        Ok(Self {
+            archive,
+            priority,
+            path: path.to_path_buf(),
+            files,
+        })
+    }
+}
+
+/// Normalize a file name for chain lookups
+fn normalize_key(filename: &str) -> String {
+    crate::path::normalize_mpq_path(filename).to_uppercase()
+}
+
+/// Read a whole file from a stream
+fn read_stream(mut stream: FileStream) -> Result<Vec<u8>> {
+    let mut data = Vec::with_capacity(stream.len() as usize);
+    stream.read_to_end(&mut data)?;
+    Ok(data)
+}
+
+/// Byte-bounded LRU cache of fully patched file contents
+struct PatchCache {
+    entries: LruCache<String, Vec<u8>>,
+    bytes: usize,
+    limit: usize,
+}
+
+impl PatchCache {
+    fn new(limit: usize) -> Self {
+        Self {
+            entries: LruCache::unbounded(),
+            bytes: 0,
+            limit,
+        }
+    }
+
+    fn get(&mut self, key: &str) -> Option<Vec<u8>> {
+        self.entries.get(key).cloned()
+    }
+
+    fn insert(&mut self, key: String, data: Vec<u8>) {
+        // Files larger than the whole budget are not worth caching
+        if data.len() > self.limit {
+            return;
+        }
+
+        self.bytes += data.len();
+        if let Some(old) = self.entries.put(key, data) {
+            self.bytes -= old.len();
+        }
+        self.evict();
+    }
+
+    fn set_limit(&mut self, limit: usize) {
+        self.limit = limit;
+        self.evict();
+    }
+
+    fn evict(&mut self) {
+        while self.bytes > self.limit {
+            match self.entries.pop_lru() {
+                Some((_, data)) => self.bytes -= data.len(),
+                None => break,
+            }
+        }
+    }
+
+    fn clear(&mut self) {
+        self.entries.clear();
+        self.bytes = 0;
+    }
+}
+
+impl std::fmt::Debug for PatchCache {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_struct("PatchCache")
+            .field("entries", &self.entries.len())
+            .field("bytes", &self.bytes)
+            .field("limit", &self.limit)
+            .finish()
+    }
 }
 
 impl PatchChain {
@@ -72,6 +225,8 @@ impl PatchChain {
         Self {
             archives: Vec::new(),
             file_map: HashMap::new(),
+            patch_cache: PatchCache::new(DEFAULT_PATCH_CACHE_BYTES),
+            verify_patches: false,
         }
     }
 
@@ -89,16 +244,9 @@ impl PatchChain {
     /// - 100-999: Official patches (patch.MPQ, patch-2.MPQ, etc.)
     /// - 1000+: Custom patches or mods
     pub fn add_archive<P: AsRef<Path>>(&mut self, path: P, priority: i32) -> Result<()> {
-        let path = path.as_ref();
-        let archive = Archive::open(path)?;
+        let entry = ChainEntry::open(path.as_ref(), priority)?;
 
         // Insert in sorted order (highest priority first)
-        let entry = ChainEntry {
-            archive,
-            priority,
-            path: path.to_path_buf(),
-        };
-
         let insert_pos = self
             .archives
             .iter()
@@ -130,6 +278,7 @@ impl PatchChain {
     pub fn clear(&mut self) {
         self.archives.clear();
         self.file_map.clear();
+        self.patch_cache.clear();
     }
 
     /// Get the number of archives in the chain
@@ -137,6 +286,28 @@ impl PatchChain {
         self.archives.len()
     }
 
+    /// Set the memory budget for memoized patched files
+    ///
+    /// A limit of 0 disables caching. Least recently used entries are evicted
+    /// once the budget is exceeded.
+    pub fn set_patch_cache_limit(&mut self, bytes: usize) {
+        self.patch_cache.set_limit(bytes);
+    }
+
+    /// Verify the MD5 hashes of patched files
+    ///
+    /// When enabled, the state before and after every applied patch step is
+    /// checked against the hashes in its PTCH header, which hashes each
+    /// intermediate file twice. Disabled by default.
+    pub fn set_verify_patches(&mut self, verify: bool) {
+        self.verify_patches = verify;
+    }
+
+    /// Drop all memoized patched files
+    pub fn clear_patch_cache(&mut self) {
+        self.patch_cache.clear();
+    }
+
     /// Read a file from the chain
     ///
     /// Returns the file from the highest-priority archive that contains it.
@@ -144,28 +315,73 @@ impl PatchChain {
     /// 1. Find the base file in lower-priority archives
     /// 2. Apply all patches in priority order
     /// 3. Return the fully patched result
+    ///
+    /// Patched results are memoized, so repeated reads of the same file do
+    /// not re-run the patch application.
     pub fn read_file(&mut self, filename: &str) -> Result<Vec<u8>> {
         // Normalize filename and convert to uppercase for case-insensitive lookup
         // This matches MPQ hashing behavior which is always case-insensitive
-        let lookup_key = crate::path::normalize_mpq_path(filename).to_uppercase();
-
-        if let Some(&archive_idx) = self.file_map.get(&lookup_key) {
-            // Check if this is a patch file by examining the file info
-            let file_info = self.archives[archive_idx]
-                .archive
-                .find_file(filename)?
-                .ok_or_else(|| Error::FileNotFound(filename.to_string()))?;
-
-            if file_info.is_patch_file() {
-                // This is a patch file - need to find base and apply patches
-                self.read_patched_file(filename, archive_idx)
-            } else {
-                // Regular file - read normally
-                self.archives[archive_idx].archive.read_file(filename)
-            }
-        } else {
-            Err(Error::FileNotFound(filename.to_string()))
+        let lookup_key = normalize_key(filename);
+
+        if let Some(stream) = self.open_file_stream(filename)? {
+            // Regular file - read normally
+            return read_stream(stream);
         }
+
+        if let Some(data) = self.patch_cache.get(&lookup_key) {
+            return Ok(data);
+        }
+
+        // This is a patch file - need to find base and apply patches
+        let data = self.read_patched_file(filename, &lookup_key)?;
+        self.patch_cache.insert(lookup_key, data.clone());
+        Ok(data)
+    }
+
+    /// Open a stream on a file that no patch in the chain modifies
+    ///
+    /// The file is resolved through the chain's index and streamed from the
+    /// archive holding its highest-priority version, without looking the
+    /// name up again in that archive. Only shared access is needed, so
+    /// several threads can stream files from one chain at once.
+    ///
+    /// Returns `Ok(None)` if the highest-priority version is a patch file;
+    /// [`read_file`](Self::read_file) applies those.
+    pub fn open_file_stream(&self, filename: &str) -> Result<Option<FileStream>> {
+        let location = self
+            .locate(filename)
+            .ok_or_else(|| Error::FileNotFound(filename.to_string()))?;
+        if location.patch {
+            return Ok(None);
+        }
+        self.archives[location.archive]
+            .archive
+            .open_file_stream_by_block(filename, location.block)
+            .map(Some)
+    }
+
+    /// Find the highest-priority version of a file
+    ///
+    /// The file information comes from the block resolved when its archive
+    /// was added, so the hash index and locale are reported as 0.
+    pub fn find_file(&self, filename: &str) -> Option<FileInfo> {
+        let location = self.locate(filename)?;
+        self.archives[location.archive]
+            .archive
+            .find_file_by_block(filename, location.block)
+    }
+
+    /// Check whether reading a file applies patches
+    pub fn is_patched_file(&self, filename: &str) -> bool {
+        self.locate(filename).is_some_and(|location| location.patch)
+    }
+
+    /// Highest-priority version of a file
+    fn locate(&self, filename: &str) -> Option<ChainLocation> {
+        self.file_map
+            .get(&normalize_key(filename))
+            .and_then(|locations| locations.first())
+            .copied()
     }
 
     /// Read a patch file and apply it to the base file
@@ -174,72 +390,32 @@ impl PatchChain {
     /// 1. Find the base file (non-patch version) in lower-priority archives
     /// 2. Read all patches for this file in priority order
     /// 3. Apply patches sequentially to produce the final result
-    fn read_patched_file(&mut self, filename: &str, _patch_idx: usize) -> Result<Vec<u8>> {
-        use crate::patch::{apply_patch, PatchFile};
-
-        // Step 1: Find the base file (search lower priority archives)
-        let mut base_data: Option<Vec<u8>> = None;
-        let mut patches = Vec::new();
-
-        // Collect all versions of this file in priority order (highest first)
-        for (idx, entry) in self.archives.iter_mut().enumerate() {
-            if let Ok(Some(file_info)) = entry.archive.find_file(filename) {
-                if file_info.is_patch_file() {
-                    // This is a patch - read it raw (bypass the read_file check)
-                    match entry.archive.read_patch_file_raw(filename) {
-                        Ok(patch_data) => {
-                            // Parse the patch
-                            match PatchFile::parse(&patch_data) {
-                                Ok(patch) => patches.push((idx, patch)),
-                                Err(e) => {
-                                    log::warn!(
-                                        "Failed to parse patch file '{}' in archive {} (priority {}): {}",
-                                        filename,
-                                        entry.path.display(),
-                                        entry.priority,
-                                        e
-                                    );
-                                }
-                            }
-                        }
-                        Err(e) => {
-                            log::warn!(
-                                "Failed to read patch file '{}' in archive {} (priority {}): {}",
-                                filename,
-                                entry.path.display(),
-                                entry.priority,
-                                e
-                            );
-                        }
-                    }
-                } else if base_data.is_none() {
-                    // This is a regular file - use as base if we haven't found one yet
-                    match entry.archive.read_file(filename) {
-                        Ok(data) => {
-                            log::debug!(
-                                "Found base file '{}' in archive {} (priority {})",
-                                filename,
-                                entry.path.display(),
-                                entry.priority
-                            );
-                            base_data = Some(data);
-                        }
-                        Err(e) => {
-                            log::warn!(
-                                "Failed to read base file '{}' in archive {} (priority {}): {}",
-                                filename,
-                                entry.path.display(),
-                                entry.priority,
-                                e
-                            );
-                        }
-                    }
-                }
-            }
+    fn read_patched_file(&mut self, filename: &str, lookup_key: &str) -> Result<Vec<u8>> {
+        use crate::patch::apply_patch_chain;
+
+        // Step 1: Collect all versions of this file. Only archives listed in
+        // the file index need to be visited.
+        let candidates = self.file_map.get(lookup_key).cloned().unwrap_or_default();
+        let (mut base_data, mut patches) = self.collect_versions(filename, &candidates);
+
+        if base_data.is_none() && candidates.len() < self.archives.len() {
+            // The base file may be stored without a listfile entry, so fall
+            // back to probing every archive in the chain
+            let all: Vec<ChainLocation> = (0..self.archives.len())
+                .filter_map(|archive| {
+                    let info = self.archives[archive].archive.find_file(filename).ok()??;
+                    Some(ChainLocation {
+                        archive,
+                        block: info.block_index,
+                        patch: info.is_patch_file(),
+                    })
+                })
+                .collect();
+            (base_data, patches) = self.collect_versions(filename, &all);
         }
 
         // Step 2: Verify we have a base file
-        let mut current_data = base_data.ok_or_else(|| {
+        let base_data = base_data.ok_or_else(|| {
             Error::FileNotFound(format!(
                 "No base file found for patch file '{filename}' in patch chain"
             ))
@@ -248,34 +424,109 @@ impl PatchChain {
         // Step 3: Apply patches in reverse priority order (lowest to highest)
         // This ensures patches are applied in the correct sequence
         patches.reverse();
-        for (idx, patch) in patches {
+        for (idx, _) in &patches {
             log::debug!(
                 "Applying patch '{}' from archive {} (priority {})",
                 filename,
-                self.archives[idx].path.display(),
-                self.archives[idx].priority
+                self.archives[*idx].path.display(),
+                self.archives[*idx].priority
             );
+        }
+
+        let steps: Vec<&PatchFile> = patches.iter().map(|(_, patch)| patch).collect();
+        apply_patch_chain(&base_data, &steps, self.verify_patches)
+    }
 
-            current_data = apply_patch(&patch, &current_data)?;
+    /// Read the base file and every patch for `filename` from the given
+    /// versions (in priority order, highest first)
+    fn collect_versions(
+        &mut self,
+        filename: &str,
+        locations: &[ChainLocation],
+    ) -> (Option<Vec<u8>>, Vec<(usize, PatchFile)>) {
+        let mut base_data: Option<Vec<u8>> = None;
+        let mut patches = Vec::new();
+
+        for &ChainLocation {
+            archive: idx,
+            block,
+            patch,
+        } in locations
+        {
+            let entry = &mut self.archives[idx];
+            if patch {
+                // This is a patch - read it raw (bypass the read_file check)
+                match entry.archive.read_patch_file_raw(filename, block) {
+                    Ok(patch_data) => {
+                        // Parse the patch
+                        match PatchFile::parse(&patch_data) {
+                            Ok(patch) => patches.push((idx, patch)),
+                            Err(e) => {
+                                log::warn!(
+                                    "Failed to parse patch file '{}' in archive {} (priority {}): {}",
+                                    filename,
+                                    entry.path.display(),
+                                    entry.priority,
+                                    e
+                                );
+                            }
+                        }
+                    }
+                    Err(e) => {
+                        log::warn!(
+                            "Failed to read patch file '{}' in archive {} (priority {}): {}",
+                            filename,
+                            entry.path.display(),
+                            entry.priority,
+                            e
+                        );
+                    }
+                }
+            } else if base_data.is_none() {
+                // This is a regular file - use as base if we haven't found one yet
+                let data = entry
+                    .archive
+                    .open_file_stream_by_block(filename, block)
+                    .and_then(read_stream);
+                match data {
+                    Ok(data) => {
+                        log::debug!(
+                            "Found base file '{}' in archive {} (priority {})",
+                            filename,
+                            entry.path.display(),
+                            entry.priority
+                        );
+                        base_data = Some(data);
+                    }
+                    Err(e) => {
+                        log::warn!(
+                            "Failed to read base file '{}' in archive {} (priority {}): {}",
+                            filename,
+                            entry.path.display(),
+                            entry.priority,
+                            e
+                        );
+                    }
+                }
+            }
         }
 
-        Ok(current_data)
+        (base_data, patches)
     }
 
     /// Check if a file exists in the chain
     pub fn contains_file(&self, filename: &str) -> bool {
-        let lookup_key = crate::path::normalize_mpq_path(filename).to_uppercase();
-        self.file_map.contains_key(&lookup_key)
+        self.file_map.contains_key(&normalize_key(filename))
     }
 
     /// Find which archive contains a file
     ///
     /// Returns the path to the archive containing the file, or None if not found.
     pub fn find_file_archive(&self, filename: &str) -> Option<&Path> {
-        let lookup_key = crate::path::normalize_mpq_path(filename).to_uppercase();
         self.file_map
-            .get(&lookup_key)
-            .map(|&idx| self.archives[idx].path.as_path())
+            .get(&normalize_key(filename))
+            .and_then(|locations| locations.first())
+            .map(|location| self.archives[location.archive].path.as_path())
     }
 
     /// List all files in the chain
@@ -335,28 +586,26 @@ impl PatchChain {
     }
 
     /// Rebuild the internal file map
+    ///
+    /// Merges the names indexed when each archive was opened, so no archive
+    /// needs to be listed again. Memoized patch results are dropped since the
+    /// chain they were built from has changed.
     fn rebuild_file_map(&mut self) -> Result<()> {
         self.file_map.clear();
+        self.patch_cache.clear();
 
         // Process archives in priority order (highest first)
-        for (idx, entry) in self.archives.iter_mut().enumerate() {
-            // Try to get file list
-            let files = match entry.archive.list() {
-                Ok(files) => files,
-                Err(_) => {
-                    // Try list_all if no listfile
-                    match entry.archive.list_all() {
-                        Ok(files) => files,
-                        Err(_) => continue, // Skip this archive
-                    }
+        for (idx, entry) in self.archives.iter().enumerate() {
+            for file in &entry.files {
+                let locations = self.file_map.entry(file.key.clone()).or_default();
+                // Listfiles may contain duplicate names
+                if locations.last().map(|location| location.archive) != Some(idx) {
+                    locations.push(ChainLocation {
+                        archive: idx,
+                        block: file.block,
+                        patch: file.patch,
+                    });
                 }
-            };
-
-            // Add files to map (only if not already present from higher priority)
-            // MPQ hashing is case-insensitive, so normalize keys to uppercase
-            for file in files {
-                let normalized_key = crate::path::normalize_mpq_path(&file.name).to_uppercase();
-                self.file_map.entry(normalized_key).or_insert(idx);
             }
         }
 
@@ -424,14 +673,7 @@ impl PatchChain {
         // Load all archives in parallel
         let loaded_archives: Result<Vec<_>> = archives
             .par_iter()
-            .map(|(path, priority)| {
-                let path_ref = path.as_ref();
-                Archive::open(path_ref).map(|archive| ChainEntry {
-                    archive,
-                    priority: *priority,
-                    path: path_ref.to_path_buf(),
-                })
-            })
+            .map(|(path, priority)| ChainEntry::open(path.as_ref(), *priority))
             .collect();
 
         let mut loaded_archives = loaded_archives?;
@@ -441,7 +683,7 @@ impl PatchChain {
 
         let mut chain = Self {
             archives: loaded_archives,
-            file_map: HashMap::new(),
+            ..Self::new()
         };
 
         // Build the file map
@@ -463,14 +705,7 @@ impl PatchChain {
         // Load new archives in parallel
         let new_archives: Result<Vec<_>> = archives
             .par_iter()
-            .map(|(path, priority)| {
-                let path_ref = path.as_ref();
-                Archive::open(path_ref).map(|archive| ChainEntry {
-                    archive,
-                    priority: *priority,
-                    path: path_ref.to_path_buf(),
-                })
-            })
+            .map(|(path, priority)| ChainEntry::open(path.as_ref(), *priority))
             .collect();
 
         let new_archives = new_archives?;
@@ -809,4 +1044,60 @@ mod integration_tests {
         let result = PatchChain::from_archives_parallel(archives);
         assert!(result.is_err());
     }
+
+    #[test]
+    fn test_file_index_tracks_all_versions() {
+        let temp = TempDir::new().unwrap();
+        let base = create_test_archive(temp.path(), "base.mpq", &[("shared.txt", b"base")]);
+        let patch1 = create_test_archive(temp.path(), "patch1.mpq", &[("shared.txt", b"one")]);
+        let patch2 = create_test_archive(temp.path(), "patch2.mpq", &[("other.txt", b"two")]);
+
+        let mut chain = PatchChain::new();
+        chain.add_archive(&base, 0).unwrap();
+        chain.add_archive(&patch2, 200).unwrap();
+        chain.add_archive(&patch1, 100).unwrap();
+
+        // Highest priority first: patch2 (0), patch1 (1), base (2)
+        let archives =
+            |key: &str| -> Vec<usize> { chain.file_map[key].iter().map(|l| l.archive).collect() };
+        assert_eq!(archives("SHARED.TXT"), vec![1, 2]);
+        assert_eq!(archives("OTHER.TXT"), vec![0]);
+        assert_eq!(chain.read_file("Shared.txt").unwrap(), b"one");
+
+        // Unpatched files stream from the winning archive by block
+        assert!(!chain.is_patched_file("shared.txt"));
+        let info = chain.find_file("SHARED.TXT").unwrap();
+        assert_eq!(info.file_size, 3);
+        let mut data = Vec::new();
+        chain
+            .open_file_stream("shared.txt")
+            .unwrap()
+            .unwrap()
+            .read_to_end(&mut data)
+            .unwrap();
+        assert_eq!(data, b"one");
+        assert!(chain.open_file_stream("missing.txt").is_err());
+    }
+
+    #[test]
+    fn test_patch_cache_eviction() {
+        let mut cache = PatchCache::new(10);
+        cache.insert("A".to_string(), vec![0; 4]);
+        cache.insert("B".to_string(), vec![1; 4]);
+        assert_eq!(cache.get("A"), Some(vec![0; 4]));
+
+        // Exceeding the budget evicts the least recently used entry
+        cache.insert("C".to_string(), vec![2; 4]);
+        assert_eq!(cache.bytes, 8);
+        assert!(cache.get("B").is_none());
+        assert!(cache.get("A").is_some());
+
+        // Entries larger than the budget are not cached
+        cache.insert("D".to_string(), vec![3; 11]);
+        assert!(cache.get("D").is_none());
+
+        cache.set_limit(0);
+        assert_eq!(cache.bytes, 0);
+        assert!(cache.get("A").is_none());
+    }
 }
@@ -63,6 +63,31 @@ pub fn normalize_mpq_path(path: &str) -> String {
     path.replace('/', "\\")
 }
 
+/// Fold a file path into the form MPQ name hashing compares
+///
+/// Name hashes are case-insensitive and treat `/` and `\` alike, so two
+/// paths refer to the same file exactly when their folded forms are equal.
+/// This converts separators to backslashes and upper-cases ASCII letters.
+///
+/// # Examples
+///
+/// ```
+/// use wow_mpq::path::fold_mpq_path;
+///
+/// assert_eq!(fold_mpq_path("World/Maps/azeroth.wdt"), "WORLD\\MAPS\\AZEROTH.WDT");
+/// ```
+pub fn fold_mpq_path(path: &str) -> String {
+    path.chars()
+        .map(|c| {
+            if c == '/' {
+                '\\'
+            } else {
+                c.to_ascii_uppercase()
+            }
+        })
+        .collect()
+}
+
 /// Convert an MPQ path to a system path
 ///
 /// On Windows, this is a no-op since Windows uses backslashes.
@@ -123,6 +148,12 @@ mod tests {
         );
     }
 
+    #[test]
+    fn test_fold_mpq_path() {
+        assert_eq!(fold_mpq_path("path/To\\file.txt"), "PATH\\TO\\FILE.TXT");
+        assert_eq!(fold_mpq_path(""), "");
+    }
+
     #[test]
     fn test_mpq_path_to_system() {
         let mpq_path = "dir\\subdir\\file.txt";
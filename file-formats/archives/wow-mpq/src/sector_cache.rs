@@ -0,0 +1,403 @@
+//! Decoded sectors shared between file streams
+//!
+//! Each [`FileStream`](crate::FileStream) keeps a few decoded sectors of its
+//! own, so several streams over the same hot file each decompress it again.
+//! A [`SectorCache`] attached to an archive (see
+//! [`Archive::set_sector_cache`](crate::Archive::set_sector_cache)) holds
+//! decoded sectors and single-unit files as reference-counted, immutable
+//! buffers keyed by archive, block index and sector index, so repeated and
+//! concurrent opens share one decoded copy. When two streams miss on the same
+//! sector at once, one decodes it and the other waits for the result.
+//!
+//! The cache is bounded by a byte budget, charged by buffer capacity, and
+//! evicts the least recently used entries first. One cache can serve many
+//! archives; hit and miss counters are kept per archive and an archive's
+//! entries are dropped with it.
+
+use crate::Result;
+use lru::LruCache;
+use parking_lot::{Condvar, Mutex};
+use std::collections::{HashMap, HashSet};
+use std::sync::Arc;
+use std::sync::atomic::{AtomicU64, Ordering};
+
+/// Sector index used for files that are decoded as a single unit
+const WHOLE_FILE: u32 = u32::MAX;
+
+/// Next archive id; ids are never reused, so stale entries cannot be hit
+static NEXT_ARCHIVE_ID: AtomicU64 = AtomicU64::new(1);
+
+/// Snapshot of sector cache counters
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct SectorCacheStats {
+    /// Lookups answered from the cache
+    pub hits: u64,
+    /// Lookups that had to decode the sector
+    pub misses: u64,
+    /// Buffers currently cached
+    pub entries: usize,
+    /// Bytes allocated by the cached buffers
+    pub bytes: usize,
+}
+
+impl SectorCacheStats {
+    /// Hit rate as a fraction (0.0 to 1.0)
+    pub fn hit_rate(&self) -> f64 {
+        let total = self.hits + self.misses;
+        if total == 0 {
+            0.0
+        } else {
+            self.hits as f64 / total as f64
+        }
+    }
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+struct SectorKey {
+    archive: u64,
+    block: usize,
+    sector: u32,
+}
+
+struct Inner {
+    entries: LruCache<SectorKey, Arc<Vec<u8>>>,
+    /// Keys some stream is decoding right now
+    pending: HashSet<SectorKey>,
+    bytes: usize,
+    budget: usize,
+    archives: HashMap<u64, SectorCacheStats>,
+}
+
+impl Inner {
+    fn counters(&mut self, archive: u64) -> &mut SectorCacheStats {
+        self.archives.entry(archive).or_default()
+    }
+
+    fn insert(&mut self, key: SectorKey, data: Arc<Vec<u8>>) {
+        let len = data.capacity();
+        if len > self.budget {
+            return;
+        }
+        while self.bytes + len > self.budget {
+            if !self.evict_one() {
+                break;
+            }
+        }
+        if let Some(old) = self.entries.put(key, data) {
+            self.bytes -= old.capacity();
+            self.counters(key.archive).bytes -= old.capacity();
+        } else {
+            self.counters(key.archive).entries += 1;
+        }
+        self.bytes += len;
+        self.counters(key.archive).bytes += len;
+    }
+
+    /// Drop the least recently used entry, returning false if there was none
+    fn evict_one(&mut self) -> bool {
+        let Some((key, data)) = self.entries.pop_lru() else {
+            return false;
+        };
+        self.bytes -= data.capacity();
+        if let Some(counters) = self.archives.get_mut(&key.archive) {
+            counters.bytes -= data.capacity();
+            counters.entries -= 1;
+        }
+        true
+    }
+}
+
+/// Byte-bounded cache of decoded sectors, shared by many streams and archives
+///
+/// # Examples
+///
+/// ```no_run
+/// use std::sync::Arc;
+/// use wow_mpq::{OpenOptions, SectorCache};
+///
+/// # fn main() -> Result<(), wow_mpq::Error> {
+/// let cache = Arc::new(SectorCache::new(64 * 1024 * 1024));
+/// let archive = OpenOptions::new()
+///     .sector_cache(Arc::clone(&cache))
+///     .open("common.MPQ")?;
+///
+/// // Both streams share the decoded sectors of the file
+/// let first = archive.open_file_stream("Spells\\Spell.dbc")?;
+/// let second = archive.open_file_stream("Spells\\Spell.dbc")?;
+/// # drop((first, second));
+/// println!("hit rate {:.2}", cache.stats().hit_rate());
+/// # Ok(())
+/// # }
+/// ```
+pub struct SectorCache {
+    inner: Mutex<Inner>,
+    /// Signalled whenever a pending decode finishes
+    decoded: Condvar,
+}
+
+impl SectorCache {
+    /// Create a cache whose buffers allocate at most `budget` bytes
+    ///
+    /// A budget of 0 caches nothing; every lookup decodes and counts a miss.
+    pub fn new(budget: usize) -> Self {
+        Self {
+            inner: Mutex::new(Inner {
+                entries: LruCache::unbounded(),
+                pending: HashSet::new(),
+                bytes: 0,
+                budget,
+                archives: HashMap::new(),
+            }),
+            decoded: Condvar::new(),
+        }
+    }
+
+    /// Current byte budget
+    pub fn budget(&self) -> usize {
+        self.inner.lock().budget
+    }
+
+    /// Change the byte budget, evicting entries until the cache fits
+    pub fn set_budget(&self, budget: usize) {
+        let mut inner = self.inner.lock();
+        inner.budget = budget;
+        while inner.bytes > budget && inner.evict_one() {}
+    }
+
+    /// Drop every cached buffer; counters are kept
+    pub fn clear(&self) {
+        let mut inner = self.inner.lock();
+        while inner.evict_one() {}
+    }
+
+    /// Counters summed over the attached archives
+    pub fn stats(&self) -> SectorCacheStats {
+        let inner = self.inner.lock();
+        let mut total = SectorCacheStats {
+            entries: inner.entries.len(),
+            bytes: inner.bytes,
+            ..SectorCacheStats::default()
+        };
+        for archive in inner.archives.values() {
+            total.hits += archive.hits;
+            total.misses += archive.misses;
+        }
+        total
+    }
+
+    /// Counters for one archive
+    fn archive_stats(&self, archive: u64) -> SectorCacheStats {
+        self.inner
+            .lock()
+            .archives
+            .get(&archive)
+            .copied()
+            .unwrap_or_default()
+    }
+
+    /// Forget an archive's entries and counters
+    fn remove_archive(&self, archive: u64) {
+        let mut inner = self.inner.lock();
+        inner.archives.remove(&archive);
+        let stale: Vec<SectorKey> = inner
+            .entries
+            .iter()
+            .map(|(key, _)| *key)
+            .filter(|key| key.archive == archive)
+            .collect();
+        for key in stale {
+            if let Some(data) = inner.entries.pop(&key) {
+                inner.bytes -= data.capacity();
+            }
+        }
+    }
+
+    /// Return the cached buffer for `key`, decoding it with `load` on a miss
+    fn get_or_load(
+        &self,
+        key: SectorKey,
+        load: impl FnOnce() -> Result<Vec<u8>>,
+    ) -> Result<Arc<Vec<u8>>> {
+        let mut inner = self.inner.lock();
+        loop {
+            if let Some(data) = inner.entries.get(&key).cloned() {
+                inner.counters(key.archive).hits += 1;
+                return Ok(data);
+            }
+            if inner.budget == 0 || !inner.pending.contains(&key) {
+                break;
+            }
+            self.decoded.wait(&mut inner);
+        }
+        inner.counters(key.archive).misses += 1;
+        if inner.budget == 0 {
+            drop(inner);
+            return load().map(Arc::new);
+        }
+        inner.pending.insert(key);
+        drop(inner);
+
+        // Clears the pending mark and wakes waiters even if `load` panics;
+        // after a failure the next waiter decodes the sector itself
+        let _pending = PendingGuard { cache: self, key };
+        let data = Arc::new(load()?);
+        self.inner.lock().insert(key, Arc::clone(&data));
+        Ok(data)
+    }
+}
+
+impl std::fmt::Debug for SectorCache {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_struct("SectorCache")
+            .field("budget", &self.budget())
+            .field("stats", &self.stats())
+            .finish()
+    }
+}
+
+struct PendingGuard<'a> {
+    cache: &'a SectorCache,
+    key: SectorKey,
+}
+
+impl Drop for PendingGuard<'_> {
+    fn drop(&mut self) {
+        self.cache.inner.lock().pending.remove(&self.key);
+        self.cache.decoded.notify_all();
+    }
+}
+
+/// An archive's registration with a [`SectorCache`]
+///
+/// Dropping it, which happens when the archive is dropped or switches cache,
+/// removes the archive's entries.
+#[derive(Debug)]
+pub(crate) struct CacheAttachment {
+    cache: Arc<SectorCache>,
+    archive: u64,
+}
+
+impl CacheAttachment {
+    pub(crate) fn new(cache: Arc<SectorCache>) -> Self {
+        Self {
+            cache,
+            archive: NEXT_ARCHIVE_ID.fetch_add(1, Ordering::Relaxed),
+        }
+    }
+
+    /// Counters for this archive
+    pub(crate) fn stats(&self) -> SectorCacheStats {
+        self.cache.archive_stats(self.archive)
+    }
+
+    /// Where a stream over the file at `block` looks up its sectors
+    pub(crate) fn file(&self, block: usize) -> SharedSectors {
+        SharedSectors {
+            cache: Arc::clone(&self.cache),
+            archive: self.archive,
+            block,
+        }
+    }
+}
+
+impl Drop for CacheAttachment {
+    fn drop(&mut self) {
+        self.cache.remove_archive(self.archive);
+    }
+}
+
+/// The shared cache as seen by a stream over one file
+#[derive(Debug, Clone)]
+pub(crate) struct SharedSectors {
+    cache: Arc<SectorCache>,
+    archive: u64,
+    block: usize,
+}
+
+impl SharedSectors {
+    /// Get sector `index`, decoding it with `load` on a miss
+    pub(crate) fn sector(
+        &self,
+        index: usize,
+        load: impl FnOnce() -> Result<Vec<u8>>,
+    ) -> Result<Arc<Vec<u8>>> {
+        self.cache.get_or_load(self.key(index as u32), load)
+    }
+
+    /// Get the contents of a single-unit file, decoding them on a miss
+    pub(crate) fn whole_file(
+        &self,
+        load: impl FnOnce() -> Result<Vec<u8>>,
+    ) -> Result<Arc<Vec<u8>>> {
+        self.cache.get_or_load(self.key(WHOLE_FILE), load)
+    }
+
+    fn key(&self, sector: u32) -> SectorKey {
+        SectorKey {
+            archive: self.archive,
+            block: self.block,
+            sector,
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::sync::atomic::AtomicUsize;
+    use std::thread;
+
+    #[test]
+    fn test_budget_evicts_least_recently_used() {
+        let cache = Arc::new(SectorCache::new(250));
+        let attachment = CacheAttachment::new(Arc::clone(&cache));
+        let file = attachment.file(0);
+
+        for index in 0..3 {
+            file.sector(index, || Ok(vec![index as u8; 100])).unwrap();
+        }
+        // Sector 0 was evicted to make room for sector 2
+        assert_eq!(cache.stats().entries, 2);
+        assert_eq!(cache.stats().bytes, 200);
+        let decoded = file.sector(0, || Ok(vec![9; 100])).unwrap();
+        assert_eq!(decoded[0], 9);
+        let cached = file.sector(2, || unreachable!()).unwrap();
+        assert_eq!(cached[0], 2);
+
+        let stats = attachment.stats();
+        assert_eq!((stats.hits, stats.misses), (1, 4));
+
+        cache.set_budget(100);
+        assert_eq!(cache.stats().entries, 1);
+        drop(attachment);
+        assert_eq!(cache.stats().entries, 0);
+        assert_eq!(cache.stats().bytes, 0);
+    }
+
+    #[test]
+    fn test_concurrent_misses_decode_once() {
+        let cache = Arc::new(SectorCache::new(1 << 20));
+        let attachment = CacheAttachment::new(Arc::clone(&cache));
+        let loads = Arc::new(AtomicUsize::new(0));
+
+        let threads: Vec<_> = (0..8)
+            .map(|_| {
+                let file = attachment.file(7);
+                let loads = Arc::clone(&loads);
+                thread::spawn(move || {
+                    file.whole_file(|| {
+                        loads.fetch_add(1, Ordering::SeqCst);
+                        thread::sleep(std::time::Duration::from_millis(20));
+                        Ok(vec![1; 1000])
+                    })
+                    .unwrap()
+                })
+            })
+            .collect();
+        let buffers: Vec<_> = threads.into_iter().map(|t| t.join().unwrap()).collect();
+
+        assert_eq!(loads.load(Ordering::SeqCst), 1);
+        assert!(buffers.iter().all(|b| Arc::ptr_eq(b, &buffers[0])));
+        assert_eq!(attachment.stats().hits, 7);
+    }
+}
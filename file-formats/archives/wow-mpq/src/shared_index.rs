@@ -0,0 +1,369 @@
+//! Archive lookup indexes shared between processes through mappings
+//!
+//! Every process that opens an archive reads and decrypts its tables and
+//! builds its own lookup structures, so a pool of worker processes serving
+//! the same archives keeps one private copy of them per worker. With a
+//! [`SharedIndex`] set through
+//! [`OpenOptions::shared_index`](crate::OpenOptions::shared_index), the first
+//! process to open an archive writes its [flattened tables](crate::FlatTables)
+//! and sorted listing into an entry file. Every later open, in that process
+//! or any other, maps the entry read-only and looks files up directly in the
+//! mapping: the tables are not read, the pages are shared through the page
+//! cache, and the listing is only decoded when [`Archive::list`] is called.
+//! Placing the directory on a RAM-backed file system such as `/dev/shm`
+//! keeps the entries in shared memory.
+//!
+//! Entries are keyed like [`IndexCache`](crate::IndexCache) entries, by the
+//! archive's canonical path, size, modification time and header MD5, and a
+//! stale entry is replaced when the archive is next opened. Entries are only
+//! ever replaced by renaming a complete file over them, never modified in
+//! place, which keeps existing mappings valid; do not edit or truncate them
+//! by other means while they are in use.
+//!
+//! An archive opened from a shared entry has no [`hash_table`] or
+//! [`block_table`] of its own: lookups, reads and listing work from the
+//! entry, and so do [`Archive::list_all`], [`Archive::file_metadata`] and
+//! [`Archive::get_info`], which walk the flattened tables instead.
+//!
+//! [`hash_table`]: Archive::hash_table
+//! [`block_table`]: Archive::block_table
+//!
+//! # Entry layout
+//!
+//! Integers are in the byte order of the machine that wrote the entry, which
+//! is recorded so that other machines ignore it, and the tables start on an
+//! 8-byte boundary so that they are read in place:
+//!
+//! | Section      | Contents                                                   |
+//! |--------------|------------------------------------------------------------|
+//! | Header       | magic, version, byte order, flags, archive key, counts     |
+//! | Path         | canonical archive path (UTF-8)                             |
+//! | Tables       | flattened hash/block and HET/BET arrays                    |
+//! | Name records | 40 bytes per listed file, as in an index cache entry       |
+//! | Name bytes   | concatenated file names                                    |
+
+use crate::archive::FileEntry;
+use crate::index_cache::{
+    CacheKey, NAME_RECORD_SIZE, decode_name_records, encode_name_records, pad_to_8,
+    write_atomically,
+};
+use crate::name_index::NameIndex;
+use crate::tables::FlatTables;
+use crate::{Archive, Result};
+use md5::{Digest, Md5};
+use memmap2::Mmap;
+use std::fs::{self, File};
+use std::ops::Range;
+use std::path::{Path, PathBuf};
+use std::sync::Arc;
+
+/// Magic bytes at the start of every entry
+const MAGIC: &[u8; 8] = b"WMPQSHM\0";
+/// Version of the entry layout
+const VERSION: u32 = 2;
+/// Written in native byte order to recognize entries from other machines
+const BYTE_ORDER: u32 = 0x0102_0304;
+/// File extension of shared index entries
+const EXTENSION: &str = "mpqshm";
+/// Size of the fixed entry header
+const HEADER_SIZE: usize = 80;
+/// The entry includes a listing
+const FLAG_HAS_LISTING: u32 = 0x1;
+
+/// Directory of archive indexes shared between processes
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct SharedIndex {
+    dir: PathBuf,
+}
+
+/// Tables and listing of an archive attached from a shared entry
+#[derive(Debug)]
+pub(crate) struct AttachedIndex {
+    pub(crate) tables: FlatTables,
+    pub(crate) listing: Option<SharedListing>,
+}
+
+/// Listing left encoded in a shared entry until it is asked for
+#[derive(Debug)]
+pub(crate) struct SharedListing {
+    map: Arc<Mmap>,
+    records: Range<usize>,
+    names: Range<usize>,
+    count: usize,
+}
+
+impl SharedIndex {
+    /// Use `dir` for shared index entries
+    ///
+    /// The directory is created when the first entry is written.
+    pub fn new<P: Into<PathBuf>>(dir: P) -> Self {
+        Self { dir: dir.into() }
+    }
+
+    /// Directory holding the shared index entries
+    pub fn dir(&self) -> &Path {
+        &self.dir
+    }
+
+    /// Path of the entry for the archive at `archive_path`
+    pub fn entry_path<P: AsRef<Path>>(&self, archive_path: P) -> PathBuf {
+        let path = archive_path.as_ref();
+        let canonical = fs::canonicalize(path).unwrap_or_else(|_| path.to_path_buf());
+        self.entry_path_for(&canonical.to_string_lossy())
+    }
+
+    fn entry_path_for(&self, canonical_path: &str) -> PathBuf {
+        let digest = Md5::digest(canonical_path.as_bytes());
+        self.dir
+            .join(format!("{}.{EXTENSION}", hex::encode(digest)))
+    }
+
+    /// Map the entry of `archive`, or `None` if there is no valid entry
+    pub(crate) fn attach(&self, archive: &Archive) -> Option<AttachedIndex> {
+        let key = CacheKey::for_archive(archive).ok()?;
+        let path = self.entry_path_for(&key.path);
+        let file = File::open(&path).ok()?;
+        // SAFETY: entries are only replaced by renaming, never modified in
+        // place, so the mapped file keeps its contents (see the module docs)
+        let map = Arc::new(unsafe { Mmap::map(&file) }.ok()?);
+        match decode(&map, &key) {
+            Some(index) => {
+                log::debug!("Attached shared index entry {}", path.display());
+                Some(index)
+            }
+            None => {
+                log::debug!("Ignoring stale shared index entry {}", path.display());
+                None
+            }
+        }
+    }
+
+    /// Write an entry for `archive`, whose tables have just been flattened
+    ///
+    /// Returns false if the archive has no flattened tables to share. The
+    /// listing written into the entry is kept on the archive, so the
+    /// following [`Archive::list`] is answered without parsing `(listfile)`
+    /// again.
+    pub(crate) fn store(&self, archive: &mut Archive) -> Result<bool> {
+        let Some(tables) = archive.flat_tables() else {
+            return Ok(false);
+        };
+        if !tables.has_hash_table() && !tables.has_het_bet() {
+            return Ok(false);
+        }
+        let key = CacheKey::for_archive(archive)?;
+        let mut data = encode_header(&key);
+        tables.encode(&mut data);
+
+        let listing = archive
+            .list()
+            .ok()
+            .map(|entries| NameIndex::new(entries).entries().to_vec());
+        encode_listing(&mut data, listing.as_deref());
+        archive.set_cached_listing(listing);
+
+        fs::create_dir_all(&self.dir)?;
+        let path = self.entry_path_for(&key.path);
+        write_atomically(&path, &data)?;
+        log::debug!("Wrote shared index entry {}", path.display());
+        Ok(true)
+    }
+}
+
+impl SharedListing {
+    /// Decode the listing, or `None` if the entry is damaged
+    pub(crate) fn decode(&self) -> Option<Vec<FileEntry>> {
+        decode_name_records(
+            &self.map[self.records.clone()],
+            &self.map[self.names.clone()],
+            self.count,
+        )
+    }
+}
+
+/// Encode the header and path; the flags, counts and length are filled in
+/// by [`encode_listing`]
+fn encode_header(key: &CacheKey) -> Vec<u8> {
+    let mut data = Vec::with_capacity(HEADER_SIZE + key.path.len() + 8);
+    data.extend_from_slice(MAGIC);
+    data.extend_from_slice(&VERSION.to_ne_bytes());
+    data.extend_from_slice(&BYTE_ORDER.to_ne_bytes());
+    data.extend_from_slice(&0u32.to_ne_bytes()); // flags
+    data.extend_from_slice(&(key.path.len() as u32).to_ne_bytes());
+    data.extend_from_slice(&key.size.to_ne_bytes());
+    data.extend_from_slice(&key.mtime.to_ne_bytes());
+    data.extend_from_slice(&key.header_md5);
+    data.extend_from_slice(&[0; 24]); // names, name bytes, entry length
+    debug_assert_eq!(data.len(), HEADER_SIZE);
+
+    data.extend_from_slice(key.path.as_bytes());
+    pad_to_8(&mut data);
+    data
+}
+
+/// Append the name records and name bytes, and complete the header
+fn encode_listing(data: &mut Vec<u8>, listing: Option<&[FileEntry]>) {
+    let entries = listing.unwrap_or_default();
+    let names_len = encode_name_records(data, entries);
+    pad_to_8(data);
+
+    let flags = if listing.is_some() {
+        FLAG_HAS_LISTING
+    } else {
+        0
+    };
+    let entry_len = data.len() as u64;
+    data[16..20].copy_from_slice(&flags.to_ne_bytes());
+    data[56..64].copy_from_slice(&(entries.len() as u64).to_ne_bytes());
+    data[64..72].copy_from_slice(&(names_len as u64).to_ne_bytes());
+    data[72..80].copy_from_slice(&entry_len.to_ne_bytes());
+}
+
+/// Attach a mapped entry, or `None` if it is damaged or does not match `key`
+fn decode(map: &Arc<Mmap>, key: &CacheKey) -> Option<AttachedIndex> {
+    let header = map.get(..HEADER_SIZE)?;
+    let u32_at = |pos: usize| u32::from_ne_bytes(header[pos..pos + 4].try_into().unwrap());
+    let u64_at = |pos: usize| u64::from_ne_bytes(header[pos..pos + 8].try_into().unwrap());
+    if &header[..8] != MAGIC || u32_at(8) != VERSION || u32_at(12) != BYTE_ORDER {
+        return None;
+    }
+    let flags = u32_at(16);
+    let path_len = u32_at(20) as usize;
+    let name_count = usize::try_from(u64_at(56)).ok()?;
+    let names_len = usize::try_from(u64_at(64)).ok()?;
+    if u64_at(72) != map.len() as u64
+        || u64_at(24) != key.size
+        || u64_at(32) != key.mtime
+        || header[40..56] != key.header_md5
+    {
+        return None;
+    }
+
+    let path = map.get(HEADER_SIZE..HEADER_SIZE.checked_add(path_len)?)?;
+    if path != key.path.as_bytes() {
+        return None;
+    }
+
+    let tables_start = (HEADER_SIZE + path_len).next_multiple_of(8);
+    let (tables, tables_end) = FlatTables::decode_mapped(map, tables_start)?;
+
+    let records = tables_end..tables_end.checked_add(name_count.checked_mul(NAME_RECORD_SIZE)?)?;
+    let names = records.end..records.end.checked_add(names_len)?;
+    if names.end > map.len() {
+        return None;
+    }
+    let listing = (flags & FLAG_HAS_LISTING != 0).then(|| SharedListing {
+        map: Arc::clone(map),
+        records,
+        names,
+        count: name_count,
+    });
+
+    Some(AttachedIndex { tables, listing })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::{ArchiveBuilder, FormatVersion, OpenOptions};
+    use tempfile::TempDir;
+
+    #[test]
+    fn test_shared_index_attach_and_invalidation() -> Result<()> {
+        let temp_dir = TempDir::new()?;
+        let shared = SharedIndex::new(temp_dir.path().join("shm"));
+
+        for version in [FormatVersion::V1, FormatVersion::V3] {
+            let path = temp_dir.path().join(format!("shared_{version:?}.mpq"));
+            ArchiveBuilder::new()
+                .version(version)
+                .add_file_data(b"first".to_vec(), "Data\\b.txt")
+                .add_file_data(b"second file".to_vec(), "data\\A.txt")
+                .build(&path)?;
+
+            // The first open reads the tables and writes the entry
+            let options = OpenOptions::new().shared_index(shared.clone());
+            let mut archive = Archive::open_with_options(&path, options.clone())?;
+            assert!(shared.entry_path(&path).exists());
+            assert!(archive.flat_tables().is_some());
+            let expected = archive.list()?;
+            let expected_info = archive.find_file("Data\\B.TXT")?.expect("file present");
+            drop(archive);
+
+            // Table walks of an archive opened without the index
+            let mut plain = Archive::open(&path)?;
+            let expected_metadata = plain.file_metadata();
+            let expected_all = plain.list_all()?;
+            let (hash_index, block_index) = expected_all[0].table_indices.unwrap();
+            let expected_first = plain.read_file_by_indices(hash_index, block_index)?;
+            let expected_file_count = plain.get_info()?.file_count;
+            drop(plain);
+
+            // Later opens look files up in the mapped entry
+            let mut archive = Archive::open_with_options(&path, options.clone())?;
+            assert!(archive.hash_table().is_none() && archive.het_table().is_none());
+            let tables = archive.flat_tables().expect("attached tables");
+            assert_eq!(tables.memory_usage(), 0);
+            let info = archive.find_file("Data\\B.TXT")?.expect("file present");
+            assert_eq!(
+                (info.file_pos, info.file_size, info.block_index),
+                (
+                    expected_info.file_pos,
+                    expected_info.file_size,
+                    expected_info.block_index
+                )
+            );
+            assert!(archive.find_file("missing.txt")?.is_none());
+            assert_eq!(archive.read_file("data\\a.txt")?, b"second file");
+            let mut found = Vec::new();
+            archive.find_files_batch(&["data\\b.txt", "missing.txt"], &mut found)?;
+            assert_eq!(found, [Some(info.block_index), None]);
+
+            let listed = archive.list()?;
+            assert_eq!(listed.len(), expected.len());
+            for (a, b) in listed.iter().zip(&expected) {
+                assert_eq!(
+                    (&a.name, a.size, a.flags, a.table_indices),
+                    (&b.name, b.size, b.flags, b.table_indices)
+                );
+            }
+
+            // Table walks read the flattened tables of the entry
+            assert_eq!(archive.file_metadata(), expected_metadata);
+            let all = archive.list_all()?;
+            assert_eq!(all.len(), expected_all.len());
+            for (a, b) in all.iter().zip(&expected_all) {
+                assert_eq!(
+                    (&a.name, a.size, a.flags, a.table_indices),
+                    (&b.name, b.size, b.flags, b.table_indices)
+                );
+            }
+            let (hash_index, block_index) = all[0].table_indices.unwrap();
+            assert_eq!(
+                archive.read_file_by_indices(hash_index, block_index)?,
+                expected_first
+            );
+            let info = archive.get_info()?;
+            assert_eq!(info.file_count, expected_file_count);
+            assert!(!info.hash_table_info.failed_to_load);
+            drop(archive);
+
+            // Rebuilding the archive invalidates the entry and rewrites it
+            ArchiveBuilder::new()
+                .version(version)
+                .add_file_data(b"replaced".to_vec(), "other.txt")
+                .build(&path)?;
+            let mut archive = Archive::open_with_options(&path, options.clone())?;
+            let tables = archive.flat_tables().expect("flattened tables");
+            assert!(tables.memory_usage() > 0);
+            assert!(archive.find_file("Data\\b.txt")?.is_none());
+            assert_eq!(archive.read_file("other.txt")?, b"replaced");
+            drop(archive);
+
+            let mut archive = Archive::open_with_options(&path, options)?;
+            assert!(archive.hash_table().is_none() && archive.het_table().is_none());
+            assert_eq!(archive.read_file("other.txt")?, b"replaced");
+        }
+        Ok(())
+    }
+}
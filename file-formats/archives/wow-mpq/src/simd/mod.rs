@@ -39,6 +39,8 @@ mod x86_64;
 
 pub mod scalar; // Fallback implementations
 
+use crate::crypto::{NameHashes, hash_name};
+
 /// CPU capabilities detected at runtime
 #[derive(Debug, Clone)]
 pub struct CpuFeatures {
@@ -144,6 +146,28 @@ impl SimdOps {
         results
     }
 
+    /// Batch MPQ name hashing for hash table lookups
+    ///
+    /// Computes the `TABLE_OFFSET`, `NAME_A` and `NAME_B` hashes of every
+    /// name, see [`crate::crypto::hash_names`]. With AVX2, eight names are
+    /// normalized and hashed per step, one per vector lane. `out` is cleared
+    /// and receives one entry per name.
+    pub fn hash_names(&self, names: &[&str], out: &mut Vec<NameHashes>) {
+        out.clear();
+
+        #[cfg(target_arch = "x86_64")]
+        {
+            if self.features.has_avx2 && names.len() >= 8 {
+                out.resize(names.len(), NameHashes::default());
+                unsafe { x86_64::hash_names_avx2(names, out) };
+                return;
+            }
+        }
+
+        // Process one by one with scalar fallback
+        out.extend(names.iter().map(|name| hash_name(name.as_bytes())));
+    }
+
     /// Check if any SIMD optimizations are available
     pub fn has_simd_support(&self) -> bool {
         self.features.has_sse42
@@ -303,6 +327,35 @@ mod tests {
         }
     }
 
+    #[test]
+    fn test_hash_names_matches_scalar() {
+        use crate::crypto::{hash_string, hash_type};
+
+        let simd = SimdOps::new();
+        // Mixed lengths and cases so lanes finish at different steps
+        let owned: Vec<String> = (0..37)
+            .map(|i| match i % 4 {
+                0 => format!("World/Maps/Azeroth/Azeroth_{i}_{}.adt", i * 3),
+                1 => format!("x{i}"),
+                2 => "Interface\\Glue\\MainMenu\\MainMenuBackgroundPandaria.blp".repeat(i % 3 + 1),
+                _ => String::new(),
+            })
+            .collect();
+        let names: Vec<&str> = owned.iter().map(String::as_str).collect();
+
+        for count in [0, 5, 8, 37] {
+            let mut hashes = Vec::new();
+            simd.hash_names(&names[..count], &mut hashes);
+            assert_eq!(hashes.len(), count);
+
+            for (name, hashes) in names.iter().zip(&hashes) {
+                assert_eq!(hashes.offset, hash_string(name, hash_type::TABLE_OFFSET));
+                assert_eq!(hashes.name_a, hash_string(name, hash_type::NAME_A));
+                assert_eq!(hashes.name_b, hash_string(name, hash_type::NAME_B));
+            }
+        }
+    }
+
     #[test]
     fn test_empty_input_handling() {
         let simd = SimdOps::new();
@@ -16,7 +16,7 @@
 #[cfg(target_arch = "x86_64")]
 use std::arch::x86_64::*;
 
-use crate::crypto::{ASCII_TO_UPPER, ENCRYPTION_TABLE};
+use crate::crypto::{ASCII_TO_UPPER, ENCRYPTION_TABLE, NameHashes, hash_name};
 
 /// SSE4.2 accelerated CRC32 calculation
 ///
@@ -155,6 +155,95 @@ pub(super) unsafe fn jenkins_hash_batch_avx2(filenames: &[&str]) -> Vec<u64> {
     results
 }
 
+/// AVX2 batch MPQ name hashing, eight names per step
+///
+/// Each 32-bit lane carries one name. Per byte position, the bytes of the
+/// eight names are normalized together (`/` to `\`, `a`-`z` to uppercase)
+/// and the `TABLE_OFFSET`, `NAME_A` and `NAME_B` chains advance with one
+/// gather from the encryption table each. Lanes whose name has ended keep
+/// their seeds. Names left over after the last full group of eight are
+/// hashed with the scalar kernel.
+///
+/// # Safety
+///
+/// This function must only be called when AVX2 support has been
+/// verified through runtime detection. `out` must be as long as `names`.
+#[target_feature(enable = "avx2")]
+pub(super) unsafe fn hash_names_avx2(names: &[&str], out: &mut [NameHashes]) {
+    use crate::crypto::hash_type::{NAME_A, NAME_B, TABLE_OFFSET};
+
+    debug_assert_eq!(names.len(), out.len());
+    let table = ENCRYPTION_TABLE.as_ptr() as *const i32;
+    let mut groups = names.chunks_exact(8);
+
+    for (group, out) in (&mut groups).zip(out.chunks_exact_mut(8)) {
+        let mut lengths = [0i32; 8];
+        for (length, name) in lengths.iter_mut().zip(group) {
+            *length = name.len() as i32;
+        }
+        let max_len = group.iter().map(|name| name.len()).max().unwrap_or(0);
+        let lengths = _mm256_loadu_si256(lengths.as_ptr() as *const __m256i);
+
+        let offsets = [
+            _mm256_set1_epi32(TABLE_OFFSET as i32),
+            _mm256_set1_epi32(NAME_A as i32),
+            _mm256_set1_epi32(NAME_B as i32),
+        ];
+        let mut seed1 = [_mm256_set1_epi32(0x7FED7FED); 3];
+        let mut seed2 = [_mm256_set1_epi32(0xEEEEEEEEu32 as i32); 3];
+
+        let mut lane_bytes = [0i32; 8];
+        for pos in 0..max_len {
+            // Transpose one byte of every name into its lane (0 past the end)
+            for (byte, name) in lane_bytes.iter_mut().zip(group) {
+                *byte = name.as_bytes().get(pos).copied().unwrap_or(0) as i32;
+            }
+            let ch = _mm256_loadu_si256(lane_bytes.as_ptr() as *const __m256i);
+
+            // Convert forward slashes to backslashes
+            let is_forward_slash = _mm256_cmpeq_epi32(ch, _mm256_set1_epi32(b'/' as i32));
+            let ch = _mm256_blendv_epi8(ch, _mm256_set1_epi32(b'\\' as i32), is_forward_slash);
+
+            // Convert to uppercase, like ASCII_TO_UPPER
+            let is_lowercase = _mm256_and_si256(
+                _mm256_cmpgt_epi32(ch, _mm256_set1_epi32(b'a' as i32 - 1)),
+                _mm256_cmpgt_epi32(_mm256_set1_epi32(b'z' as i32 + 1), ch),
+            );
+            let ch = _mm256_sub_epi32(ch, _mm256_and_si256(is_lowercase, _mm256_set1_epi32(32)));
+
+            let active = _mm256_cmpgt_epi32(lengths, _mm256_set1_epi32(pos as i32));
+            for k in 0..3 {
+                let index = _mm256_add_epi32(offsets[k], ch);
+                let entry = _mm256_i32gather_epi32::<4>(table, index);
+                let next1 = _mm256_xor_si256(entry, _mm256_add_epi32(seed1[k], seed2[k]));
+                let next2 = _mm256_add_epi32(
+                    _mm256_add_epi32(_mm256_add_epi32(ch, next1), seed2[k]),
+                    _mm256_add_epi32(_mm256_slli_epi32::<5>(seed2[k]), _mm256_set1_epi32(3)),
+                );
+                seed1[k] = _mm256_blendv_epi8(seed1[k], next1, active);
+                seed2[k] = _mm256_blendv_epi8(seed2[k], next2, active);
+            }
+        }
+
+        let mut results = [[0u32; 8]; 3];
+        for (result, seed) in results.iter_mut().zip(&seed1) {
+            _mm256_storeu_si256(result.as_mut_ptr() as *mut __m256i, *seed);
+        }
+        for (lane, hashes) in out.iter_mut().enumerate() {
+            *hashes = NameHashes {
+                offset: results[0][lane],
+                name_a: results[1][lane],
+                name_b: results[2][lane],
+            };
+        }
+    }
+
+    let done = names.len() - groups.remainder().len();
+    for (name, hashes) in groups.remainder().iter().zip(&mut out[done..]) {
+        *hashes = hash_name(name.as_bytes());
+    }
+}
+
 /// Optimized scalar Jenkins hash with AVX2-aware processing
 ///
 /// Uses SIMD for character normalization but processes the hash serially.
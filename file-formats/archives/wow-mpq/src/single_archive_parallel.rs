@@ -3,11 +3,38 @@
 //! This module provides utilities for reading multiple files from a single MPQ archive
 //! in parallel. This is achieved by cloning file handles for each thread, allowing
 //! concurrent reads without seek conflicts.
+//!
+//! Extraction to disk can also follow an [`ExtractionPlan`], which reads the
+//! archive front to back in large coalesced reads instead of one read per
+//! file in the order the files were asked for.
 
-use crate::{Archive, Error, Result};
+use crate::archive::{file_key, stored_extent};
+use crate::file_stream::{StreamSource, read_exact_at};
+use crate::{Archive, Error, FileStream, Result, stats};
 use rayon::prelude::*;
+use std::collections::BTreeMap;
+use std::fs::{self, File};
+use std::io::{self, Read};
 use std::path::{Path, PathBuf};
-use std::sync::Arc;
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::{Arc, Condvar, Mutex, mpsc};
+use std::thread;
+
+/// Largest coalesced read of an [`ExtractionPlan`] by default
+pub const DEFAULT_COALESCED_READ_SIZE: usize = 8 * 1024 * 1024;
+
+/// Largest gap between two files that are still read in one request
+///
+/// Reading a few unneeded bytes is cheaper than a second request on storage
+/// where every request pays a seek or a round trip.
+const MAX_READ_GAP: u64 = 64 * 1024;
+
+/// Decoded bytes held back for writing in plan order before decoding waits
+///
+/// Files decoded ahead of the next one to write wait in memory; past this,
+/// workers only decode the next file until the writer catches up. Each
+/// worker may overshoot by the file it is decoding.
+const MAX_PENDING_BYTES: usize = 64 * 1024 * 1024;
 
 /// A thread-safe wrapper around an MPQ archive for parallel operations
 ///
@@ -178,6 +205,9 @@ pub struct ParallelConfig {
     pub batch_size: usize,
     /// Whether to skip files that fail to extract
     pub skip_errors: bool,
+    /// Whether extraction to disk reads files in on-disk order through an
+    /// [`ExtractionPlan`]
+    pub sequential_io: bool,
 }
 
 impl Default for ParallelConfig {
@@ -186,6 +216,7 @@ impl Default for ParallelConfig {
             num_threads: None,
             batch_size: 10,
             skip_errors: false,
+            sequential_io: false,
         }
     }
 }
@@ -213,6 +244,127 @@ impl ParallelConfig {
         self.skip_errors = skip;
         self
     }
+
+    /// Set whether extraction to disk reads files in on-disk order
+    ///
+    /// See [`ExtractionPlan`]. Meant for storage where seeks are expensive,
+    /// such as spinning disks and network file systems.
+    pub fn sequential_io(mut self, sequential: bool) -> Self {
+        self.sequential_io = sequential;
+        self
+    }
+}
+
+/// Files to extract, grouped into large reads in on-disk order
+///
+/// Extracting files in listfile or name order jumps around the archive, so
+/// on spinning disks and network storage every file costs a random read.
+/// A plan sorts the files by their position in the archive and merges files
+/// that lie close together into coalesced reads of up to
+/// [`DEFAULT_COALESCED_READ_SIZE`] bytes, so the archive is read front to
+/// back in a few large requests. Files that cannot be planned (missing,
+/// empty, patch files, or larger than one read) are extracted file by file.
+#[derive(Debug, Clone)]
+pub struct ExtractionPlan {
+    /// Coalesced reads in ascending archive offset
+    reads: Vec<PlannedRead>,
+    /// Indices of the names left to per-file extraction
+    unplanned: Vec<usize>,
+}
+
+/// One coalesced read and the files stored in it
+#[derive(Debug, Clone)]
+struct PlannedRead {
+    /// Offset of the first byte in the archive file
+    offset: u64,
+    len: usize,
+    /// Indices of the names whose data the read covers, in on-disk order
+    files: Vec<usize>,
+}
+
+impl ExtractionPlan {
+    /// Plan reading `names` from `archive`
+    pub fn new(archive: &Archive, names: &[&str]) -> Self {
+        Self::with_read_size(archive, names, DEFAULT_COALESCED_READ_SIZE)
+    }
+
+    /// Plan reading `names` with coalesced reads of at most `read_size` bytes
+    pub fn with_read_size(archive: &Archive, names: &[&str], read_size: usize) -> Self {
+        let mut extents = Vec::with_capacity(names.len());
+        let mut unplanned = Vec::new();
+        let file = archive.clone_file().ok();
+        let sector_size = archive.header().sector_size();
+        for (index, name) in names.iter().enumerate() {
+            let extent = match (archive.find_file(name), &file) {
+                (Ok(Some(info)), Some(file))
+                    if info.compressed_size > 0 && !info.is_patch_file() =>
+                {
+                    // Sector CRCs may lie outside the block size
+                    let key =
+                        file_key(name, &info, archive.archive_offset(), info.file_size as u32);
+                    stored_extent(file, &info, Some(key), sector_size)
+                        .ok()
+                        .map(|len| (info.file_pos, len))
+                }
+                _ => None,
+            };
+            match extent {
+                Some((offset, len)) if len <= read_size as u64 => {
+                    extents.push((offset, len, index));
+                }
+                _ => unplanned.push(index),
+            }
+        }
+        extents.sort_unstable_by_key(|&(offset, _, index)| (offset, index));
+
+        let mut reads: Vec<PlannedRead> = Vec::new();
+        for (offset, len, index) in extents {
+            if let Some(read) = reads.last_mut() {
+                let read_end = read.offset + read.len as u64;
+                let end = read_end.max(offset + len);
+                if offset <= read_end + MAX_READ_GAP && end - read.offset <= read_size as u64 {
+                    read.len = (end - read.offset) as usize;
+                    read.files.push(index);
+                    continue;
+                }
+            }
+            reads.push(PlannedRead {
+                offset,
+                len: len as usize,
+                files: vec![index],
+            });
+        }
+
+        Self { reads, unplanned }
+    }
+
+    /// Number of coalesced reads
+    pub fn read_count(&self) -> usize {
+        self.reads.len()
+    }
+
+    /// Bytes covered by the coalesced reads, gaps between files included
+    pub fn read_bytes(&self) -> u64 {
+        self.reads.iter().map(|read| read.len as u64).sum()
+    }
+
+    /// Number of files left to per-file extraction
+    pub fn unplanned_count(&self) -> usize {
+        self.unplanned.len()
+    }
+}
+
+/// Build the thread pool described by `config`
+pub(crate) fn build_thread_pool(config: &ParallelConfig) -> Result<rayon::ThreadPool> {
+    let mut builder = rayon::ThreadPoolBuilder::new();
+    if let Some(threads) = config.num_threads {
+        builder = builder.num_threads(threads);
+    }
+    builder.build().map_err(|e| {
+        Error::Io(std::io::Error::other(format!(
+            "Failed to create thread pool: {e}"
+        )))
+    })
 }
 
 /// Extract files with custom configuration
@@ -254,18 +406,7 @@ fn extract_with_config_batched<P: AsRef<Path>>(
     };
 
     // Configure thread pool if specified
-    let pool = if let Some(threads) = config.num_threads {
-        rayon::ThreadPoolBuilder::new()
-            .num_threads(threads)
-            .build()
-            .map_err(|e| {
-                Error::Io(std::io::Error::other(format!(
-                    "Failed to create thread pool: {e}"
-                )))
-            })?
-    } else {
-        rayon::ThreadPoolBuilder::new().build().unwrap()
-    };
+    let pool = build_thread_pool(&config)?;
 
     // Execute batched extraction in the configured thread pool
     pool.install(|| {
@@ -311,18 +452,7 @@ fn extract_with_config_unbatched<P: AsRef<Path>>(
     let archive = ParallelArchive::open(archive_path)?;
 
     // Configure thread pool if specified
-    let pool = if let Some(threads) = config.num_threads {
-        rayon::ThreadPoolBuilder::new()
-            .num_threads(threads)
-            .build()
-            .map_err(|e| {
-                Error::Io(std::io::Error::other(format!(
-                    "Failed to create thread pool: {e}"
-                )))
-            })?
-    } else {
-        rayon::ThreadPoolBuilder::new().build().unwrap()
-    };
+    let pool = build_thread_pool(&config)?;
 
     // Execute in the configured thread pool
     pool.install(|| {
@@ -349,17 +479,345 @@ fn extract_with_config_unbatched<P: AsRef<Path>>(
     })
 }
 
+/// Extract files from an archive straight to disk in parallel
+///
+/// `jobs` pairs each archive file name with its destination path. The archive
+/// is opened once and its tables are shared by all workers; each file is read
+/// through its own [`FileStream`](crate::FileStream), so sectors are
+/// decompressed and written out as they are read instead of buffering whole
+/// files. Missing parent directories are created.
+///
+/// Returns the number of bytes written for each job, in input order.
+pub fn extract_to_disk<P: AsRef<Path>>(
+    archive_path: P,
+    jobs: &[(&str, &Path)],
+    config: ParallelConfig,
+) -> Result<Vec<(String, Result<u64>)>> {
+    let archive = Archive::open(archive_path)?;
+    extract_archive_to_disk(&archive, jobs, &config)
+}
+
+/// Extract files from an already opened archive straight to disk in parallel
+///
+/// See [`extract_to_disk`]. When `config.skip_errors` is false the first
+/// failure aborts the whole batch. With `config.sequential_io` the files are
+/// read in on-disk order through an [`ExtractionPlan`] and written as whole
+/// files.
+pub fn extract_archive_to_disk(
+    archive: &Archive,
+    jobs: &[(&str, &Path)],
+    config: &ParallelConfig,
+) -> Result<Vec<(String, Result<u64>)>> {
+    if config.sequential_io {
+        return extract_planned(archive, jobs, config);
+    }
+    let pool = build_thread_pool(config)?;
+
+    pool.install(|| {
+        if config.skip_errors {
+            Ok(jobs
+                .par_iter()
+                .map(|&(name, dest)| (name.to_string(), extract_file_to(archive, name, dest)))
+                .collect())
+        } else {
+            jobs.par_iter()
+                .map(|&(name, dest)| {
+                    let written = extract_file_to(archive, name, dest)?;
+                    Ok((name.to_string(), Ok(written)))
+                })
+                .collect()
+        }
+    })
+}
+
+/// Extract files following an [`ExtractionPlan`]
+///
+/// One thread issues the coalesced reads in order, hinting the kernel about
+/// the next read before waiting on the current one; with a memory-mapped
+/// archive it only issues the hints. The thread pool of `config` decodes
+/// the files of each read, and the calling thread writes them out in plan
+/// order. Decoding stops running ahead of the writer once
+/// [`MAX_PENDING_BYTES`] of decoded files are waiting to be written.
+/// Unplanned files are extracted file by file afterwards.
+fn extract_planned(
+    archive: &Archive,
+    jobs: &[(&str, &Path)],
+    config: &ParallelConfig,
+) -> Result<Vec<(String, Result<u64>)>> {
+    let names: Vec<&str> = jobs.iter().map(|&(name, _)| name).collect();
+    let plan = ExtractionPlan::new(archive, &names);
+    let pool = build_thread_pool(config)?;
+    let workers = pool.current_num_threads();
+    let file = archive.clone_file()?;
+
+    let mut results: Vec<Option<Result<u64>>> = jobs.iter().map(|_| None).collect();
+    let mut first_error = None;
+    let abort = AtomicBool::new(false);
+
+    // Reads waiting to be decoded, with the plan position of their first file
+    let (read_tx, read_rx) =
+        mpsc::sync_channel::<(usize, &PlannedRead, Option<StreamSource>)>(workers);
+    let read_rx = Mutex::new(read_rx);
+
+    // Plan position of the next file to write and the decoded bytes waiting
+    let pending_state = Mutex::new((0usize, 0usize));
+    let written = Condvar::new();
+
+    thread::scope(|scope| {
+        let (file_tx, file_rx) = mpsc::sync_channel::<(usize, usize, Result<Vec<u8>>)>(workers);
+
+        let (plan, names, abort, file) = (&plan, &names, &abort, &file);
+        scope.spawn(move || {
+            let mut position = 0;
+            for (index, read) in plan.reads.iter().enumerate() {
+                if abort.load(Ordering::Relaxed) {
+                    break;
+                }
+                if let Some(next) = plan.reads.get(index + 1) {
+                    advise_willneed(archive, file, next);
+                }
+                let source = buffer_read(archive, file, read);
+                if read_tx.send((position, read, source)).is_err() {
+                    break;
+                }
+                position += read.files.len();
+            }
+        });
+
+        let read_rx = &read_rx;
+        let pool = &pool;
+        let (pending_state, written) = (&pending_state, &written);
+        scope.spawn(move || {
+            pool.scope(|s| {
+                for _ in 0..workers {
+                    let file_tx = file_tx.clone();
+                    s.spawn(move |_| {
+                        loop {
+                            let Ok((position, read, source)) = read_rx.lock().unwrap().recv()
+                            else {
+                                break;
+                            };
+                            for (offset, &job) in read.files.iter().enumerate() {
+                                // The next file to write is always decoded
+                                let mut state = pending_state.lock().unwrap();
+                                while position + offset > state.0
+                                    && state.1 >= MAX_PENDING_BYTES
+                                    && !abort.load(Ordering::Relaxed)
+                                {
+                                    state = written.wait(state).unwrap();
+                                }
+                                drop(state);
+
+                                let data = if abort.load(Ordering::Relaxed) {
+                                    Err(Error::invalid_format("Extraction aborted"))
+                                } else {
+                                    decode_file(archive, names[job], source.as_ref())
+                                };
+                                if let Ok(data) = &data {
+                                    pending_state.lock().unwrap().1 += data.len();
+                                }
+                                if file_tx.send((position + offset, job, data)).is_err() {
+                                    return;
+                                }
+                            }
+                        }
+                    });
+                }
+            });
+        });
+
+        // Write in plan order, holding back files decoded ahead of their turn
+        let mut pending = BTreeMap::new();
+        let mut next = 0;
+        for (position, job, data) in file_rx {
+            pending.insert(position, (job, data));
+            while let Some((job, data)) = pending.remove(&next) {
+                next += 1;
+                let held = data.as_ref().map_or(0, Vec::len);
+                let result = data.and_then(|data| write_file(jobs[job].1, &data));
+                match result {
+                    Err(e) if !config.skip_errors => {
+                        if first_error.is_none() {
+                            abort.store(true, Ordering::Relaxed);
+                            first_error = Some(e);
+                        }
+                    }
+                    result => results[job] = Some(result),
+                }
+
+                let mut state = pending_state.lock().unwrap();
+                *state = (next, state.1 - held);
+                drop(state);
+                written.notify_all();
+            }
+        }
+    });
+
+    if let Some(e) = first_error {
+        return Err(e);
+    }
+
+    let unplanned = pool.install(|| {
+        plan.unplanned
+            .par_iter()
+            .map(|&job| (job, extract_file_to(archive, jobs[job].0, jobs[job].1)))
+            .collect::<Vec<_>>()
+    });
+    for (job, result) in unplanned {
+        match result {
+            Err(e) if !config.skip_errors => return Err(e),
+            result => results[job] = Some(result),
+        }
+    }
+
+    Ok(jobs
+        .iter()
+        .zip(results)
+        .map(|(&(name, _), result)| {
+            let result = result.unwrap_or_else(|| Err(Error::FileNotFound(name.to_string())));
+            (name.to_string(), result)
+        })
+        .collect())
+}
+
+/// Read the bytes of a planned read, or `None` to stream its files instead
+///
+/// Memory-mapped archives are read from the mapping, which the read-ahead
+/// hints have already paged in.
+fn buffer_read(archive: &Archive, file: &File, read: &PlannedRead) -> Option<StreamSource> {
+    #[cfg(feature = "mmap")]
+    if archive.mapping().is_some() {
+        return None;
+    }
+    #[cfg(not(feature = "mmap"))]
+    let _ = archive;
+
+    let mut data = vec![0u8; read.len];
+    match read_exact_at(file, &mut data, read.offset) {
+        Ok(()) => {
+            stats::record_disk_read(data.len());
+            Some(StreamSource::Buffer {
+                data: Arc::new(data),
+                start: read.offset,
+            })
+        }
+        Err(e) => {
+            log::debug!(
+                "Coalesced read of {} bytes at {} failed, reading its files one by one: {e}",
+                read.len,
+                read.offset
+            );
+            None
+        }
+    }
+}
+
+/// Ask the kernel to start fetching `read` in the background
+fn advise_willneed(archive: &Archive, file: &File, read: &PlannedRead) {
+    #[cfg(feature = "mmap")]
+    if let Some(mapping) = archive.mapping() {
+        mapping.advise_willneed(read.offset, read.len);
+        return;
+    }
+
+    #[cfg(all(feature = "mmap", target_os = "linux"))]
+    {
+        use std::os::unix::io::AsRawFd;
+        // SAFETY: only a hint about a range of an open file descriptor
+        unsafe {
+            libc::posix_fadvise(
+                file.as_raw_fd(),
+                read.offset as libc::off_t,
+                read.len as libc::off_t,
+                libc::POSIX_FADV_WILLNEED,
+            );
+        }
+    }
+    #[cfg(not(all(feature = "mmap", target_os = "linux")))]
+    let _ = (archive, file, read);
+}
+
+/// Decode a whole file, from `source` if it holds the file's bytes
+///
+/// A file whose bytes turn out to reach past the buffered read is read on
+/// its own instead.
+fn decode_file(archive: &Archive, name: &str, source: Option<&StreamSource>) -> Result<Vec<u8>> {
+    if let Some(StreamSource::Buffer { data, start }) = source {
+        let buffered = archive
+            .open_file_stream_from(
+                name,
+                StreamSource::Buffer {
+                    data: Arc::clone(data),
+                    start: *start,
+                },
+            )
+            .and_then(decode_stream);
+        match buffered {
+            Ok(data) => return Ok(data),
+            Err(e) => log::debug!("Decoding {name} from its coalesced read failed: {e}"),
+        }
+    }
+    decode_stream(archive.open_file_stream(name)?)
+}
+
+/// Read a whole stream into memory
+fn decode_stream(mut stream: FileStream) -> Result<Vec<u8>> {
+    if let Some(data) = stream.as_slice() {
+        return Ok(data.to_vec());
+    }
+    let mut data =
+        Vec::with_capacity(stream.len().min(DEFAULT_COALESCED_READ_SIZE as u64) as usize);
+    stream.read_to_end(&mut data)?;
+    Ok(data)
+}
+
+/// Write decoded file contents to `dest`
+fn write_file(dest: &Path, data: &[u8]) -> Result<u64> {
+    create_parent_dir(dest)?;
+    fs::write(dest, data)?;
+    Ok(data.len() as u64)
+}
+
+/// Create the missing parent directories of `dest`
+fn create_parent_dir(dest: &Path) -> Result<()> {
+    if let Some(parent) = dest.parent()
+        && !parent.as_os_str().is_empty()
+    {
+        fs::create_dir_all(parent)?;
+    }
+    Ok(())
+}
+
+/// Stream a single file from `archive` to `dest`
+fn extract_file_to(archive: &Archive, name: &str, dest: &Path) -> Result<u64> {
+    let mut stream = archive.open_file_stream(name)?;
+    create_parent_dir(dest)?;
+
+    // Stored files in a mapped archive can be written without decoding
+    if let Some(data) = stream.as_slice() {
+        fs::write(dest, data)?;
+        return Ok(data.len() as u64);
+    }
+
+    let mut output = File::create(dest)?;
+    Ok(io::copy(&mut stream, &mut output)?)
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
-    use crate::ArchiveBuilder;
+    use crate::{ArchiveBuilder, OpenOptions};
     use tempfile::TempDir;
 
     fn create_test_archive() -> (TempDir, PathBuf) {
+        create_test_archive_with_crcs(false)
+    }
+
+    fn create_test_archive_with_crcs(generate_crcs: bool) -> (TempDir, PathBuf) {
         let temp = TempDir::new().unwrap();
         let path = temp.path().join("test.mpq");
 
-        let mut builder = ArchiveBuilder::new();
+        let mut builder = ArchiveBuilder::new().generate_crcs(generate_crcs);
 
         // Add multiple files for parallel testing
         for i in 0..20 {
@@ -447,4 +905,150 @@ mod tests {
         assert!(results[1].1.is_err());
         assert!(results[2].1.is_ok());
     }
+
+    #[test]
+    fn test_extract_to_disk() {
+        let (temp, archive_path) = create_test_archive();
+        let out_dir = temp.path().join("out");
+
+        let names = ["file_00.txt", "nonexistent.txt", "file_07.txt"];
+        let dests: Vec<PathBuf> = names
+            .iter()
+            .map(|name| out_dir.join("nested").join(name))
+            .collect();
+        let jobs: Vec<(&str, &Path)> = names
+            .iter()
+            .zip(&dests)
+            .map(|(name, dest)| (*name, dest.as_path()))
+            .collect();
+
+        let config = ParallelConfig::new().threads(2).skip_errors(true);
+        let results = extract_to_disk(&archive_path, &jobs, config).unwrap();
+        assert_eq!(results.len(), 3);
+        assert!(results[1].1.is_err());
+
+        let mut archive = Archive::open(&archive_path).unwrap();
+        for i in [0, 2] {
+            let expected = archive.read_file(names[i]).unwrap();
+            assert_eq!(*results[i].1.as_ref().unwrap(), expected.len() as u64);
+            assert_eq!(fs::read(&dests[i]).unwrap(), expected);
+        }
+
+        // Without skip_errors the missing file fails the batch
+        let config = ParallelConfig::new().threads(2);
+        assert!(extract_to_disk(&archive_path, &jobs, config).is_err());
+    }
+
+    #[test]
+    fn test_extraction_plan() {
+        let (_temp, archive_path) = create_test_archive();
+        let archive = Archive::open(&archive_path).unwrap();
+
+        let names: Vec<String> = (0..20).rev().map(|i| format!("file_{i:02}.txt")).collect();
+        let mut names: Vec<&str> = names.iter().map(String::as_str).collect();
+        names.push("nonexistent.txt");
+
+        // The files are stored back to back, so they fit in one read
+        let plan = ExtractionPlan::new(&archive, &names);
+        assert_eq!(plan.read_count(), 1);
+        assert_eq!(plan.unplanned_count(), 1);
+        let read = &plan.reads[0];
+        assert_eq!(read.files.len(), 20);
+        // In archive order, which is the reverse of the requested order
+        assert_eq!(read.files[0], 19);
+        assert_eq!(read.files[19], 0);
+        let first = archive.find_file("file_00.txt").unwrap().unwrap();
+        assert_eq!(read.offset, first.file_pos);
+
+        // Small reads split the files over several reads
+        let largest = names[..20]
+            .iter()
+            .map(|name| archive.find_file(name).unwrap().unwrap().compressed_size)
+            .max()
+            .unwrap();
+        let plan = ExtractionPlan::with_read_size(&archive, &names, 2 * largest as usize);
+        assert!(plan.read_count() >= 10);
+        assert!(
+            plan.reads
+                .iter()
+                .all(|read| read.len <= 2 * largest as usize)
+        );
+        assert_eq!(
+            plan.reads
+                .iter()
+                .map(|read| read.files.len())
+                .sum::<usize>(),
+            20
+        );
+        assert!(plan.reads.windows(2).all(|w| w[0].offset < w[1].offset));
+    }
+
+    #[test]
+    fn test_sequential_extract_to_disk() {
+        for generate_crcs in [false, true] {
+            sequential_extract_to_disk(generate_crcs);
+        }
+    }
+
+    fn sequential_extract_to_disk(generate_crcs: bool) {
+        let (temp, archive_path) = create_test_archive_with_crcs(generate_crcs);
+
+        let names: Vec<String> = (0..20).rev().map(|i| format!("file_{i:02}.txt")).collect();
+        let mut names: Vec<&str> = names.iter().map(String::as_str).collect();
+        names.insert(3, "nonexistent.txt");
+
+        // The read covers the sector CRC tables the block sizes leave out,
+        // up to the (listfile) stored after the last file
+        let archive = Archive::open(&archive_path).unwrap();
+        let plan = ExtractionPlan::new(&archive, &names);
+        assert_eq!(plan.read_count(), 1);
+        let listfile = archive.find_file("(listfile)").unwrap().unwrap();
+        assert_eq!(
+            plan.reads[0].offset + plan.reads[0].len as u64,
+            listfile.file_pos
+        );
+        drop(archive);
+
+        #[cfg_attr(not(feature = "mmap"), allow(unused_mut))]
+        let mut options = vec![OpenOptions::new()];
+        #[cfg(feature = "mmap")]
+        options.push(OpenOptions::new().enable_memory_mapping());
+
+        for (run, options) in options.into_iter().enumerate() {
+            let out_dir = temp.path().join(format!("out{run}"));
+            let dests: Vec<PathBuf> = names
+                .iter()
+                .map(|name| out_dir.join("nested").join(name))
+                .collect();
+            let jobs: Vec<(&str, &Path)> = names
+                .iter()
+                .zip(&dests)
+                .map(|(name, dest)| (*name, dest.as_path()))
+                .collect();
+
+            let archive = options.open(&archive_path).unwrap();
+            let config = ParallelConfig::new()
+                .threads(2)
+                .skip_errors(true)
+                .sequential_io(true);
+            let results = extract_archive_to_disk(&archive, &jobs, &config).unwrap();
+            assert_eq!(results.len(), names.len());
+
+            let mut reader = Archive::open(&archive_path).unwrap();
+            for (i, (name, result)) in results.iter().enumerate() {
+                assert_eq!(name, names[i]);
+                if names[i] == "nonexistent.txt" {
+                    assert!(result.is_err());
+                    continue;
+                }
+                let expected = reader.read_file(names[i]).unwrap();
+                assert_eq!(*result.as_ref().unwrap(), expected.len() as u64);
+                assert_eq!(fs::read(&dests[i]).unwrap(), expected);
+            }
+
+            // Without skip_errors the missing file fails the batch
+            let config = ParallelConfig::new().threads(2).sequential_io(true);
+            assert!(extract_archive_to_disk(&archive, &jobs, &config).is_err());
+        }
+    }
 }
@@ -0,0 +1,303 @@
+//! Process-wide I/O and decompression counters
+//!
+//! Every archive reader counts the bytes it pulls from disk, the sector cache
+//! of each [`FileStream`](crate::FileStream) counts its hits and misses, and
+//! the decompressor records calls, byte counts and time per algorithm. The
+//! counters are relaxed atomics shared by all archives in the process, so they
+//! are cheap enough to leave on and can be read at any time with [`snapshot`].
+//!
+//! Stages of a multi-compressed sector are recorded under their own algorithm,
+//! so a Huffman + ADPCM sector counts once for each.
+
+use crate::compression::CompressionMethod;
+use std::fs::File;
+use std::io::{self, Read, Seek, SeekFrom};
+use std::ops::Deref;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::time::Instant;
+
+/// Number of algorithms tracked, see [`ALGORITHMS`]
+pub const ALGORITHM_COUNT: usize = 9;
+
+/// Tracked algorithms, in the order of [`Statistics::decompression`]
+pub const ALGORITHMS: [CompressionMethod; ALGORITHM_COUNT] = [
+    CompressionMethod::Huffman,
+    CompressionMethod::Zlib,
+    CompressionMethod::Implode,
+    CompressionMethod::PKWare,
+    CompressionMethod::BZip2,
+    CompressionMethod::Sparse,
+    CompressionMethod::AdpcmMono,
+    CompressionMethod::AdpcmStereo,
+    CompressionMethod::Lzma,
+];
+
+/// Counters for one decompression algorithm
+#[derive(Debug)]
+struct AlgorithmCounters {
+    calls: AtomicU64,
+    failures: AtomicU64,
+    bytes_in: AtomicU64,
+    bytes_out: AtomicU64,
+    nanos: AtomicU64,
+}
+
+#[derive(Debug)]
+struct Counters {
+    disk_bytes_read: AtomicU64,
+    disk_reads: AtomicU64,
+    mapped_bytes_read: AtomicU64,
+    sector_cache_hits: AtomicU64,
+    sector_cache_misses: AtomicU64,
+    decompression: [AlgorithmCounters; ALGORITHM_COUNT],
+}
+
+static COUNTERS: Counters = Counters {
+    disk_bytes_read: AtomicU64::new(0),
+    disk_reads: AtomicU64::new(0),
+    mapped_bytes_read: AtomicU64::new(0),
+    sector_cache_hits: AtomicU64::new(0),
+    sector_cache_misses: AtomicU64::new(0),
+    decompression: [const {
+        AlgorithmCounters {
+            calls: AtomicU64::new(0),
+            failures: AtomicU64::new(0),
+            bytes_in: AtomicU64::new(0),
+            bytes_out: AtomicU64::new(0),
+            nanos: AtomicU64::new(0),
+        }
+    }; ALGORITHM_COUNT],
+};
+
+/// Decompression totals for one algorithm
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct AlgorithmStats {
+    /// Buffers (sectors or single-unit files) decompressed
+    pub calls: u64,
+    /// Calls that returned an error
+    pub failures: u64,
+    /// Compressed bytes consumed
+    pub bytes_in: u64,
+    /// Decompressed bytes produced
+    pub bytes_out: u64,
+    /// Wall time spent in the decompressor, in nanoseconds
+    pub nanos: u64,
+}
+
+/// A point-in-time copy of the process-wide counters
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct Statistics {
+    /// Bytes read from archive files through file handles
+    pub disk_bytes_read: u64,
+    /// Read calls issued on archive files
+    pub disk_reads: u64,
+    /// Bytes copied out of memory-mapped archives
+    pub mapped_bytes_read: u64,
+    /// Sectors served from a stream's decoded-sector cache
+    pub sector_cache_hits: u64,
+    /// Sectors that had to be read and decoded
+    pub sector_cache_misses: u64,
+    /// Per-algorithm totals, indexed like [`ALGORITHMS`]
+    pub decompression: [AlgorithmStats; ALGORITHM_COUNT],
+}
+
+impl Statistics {
+    /// Totals for `method`, or `None` if it is not tracked
+    pub fn algorithm(&self, method: CompressionMethod) -> Option<&AlgorithmStats> {
+        algorithm_index(method).map(|i| &self.decompression[i])
+    }
+
+    /// Fraction of sector lookups served from the cache (0.0 to 1.0)
+    pub fn sector_cache_hit_rate(&self) -> f64 {
+        let total = self.sector_cache_hits + self.sector_cache_misses;
+        if total == 0 {
+            0.0
+        } else {
+            self.sector_cache_hits as f64 / total as f64
+        }
+    }
+}
+
+/// Read the current counter values
+pub fn snapshot() -> Statistics {
+    let load = |counter: &AtomicU64| counter.load(Ordering::Relaxed);
+    let mut stats = Statistics {
+        disk_bytes_read: load(&COUNTERS.disk_bytes_read),
+        disk_reads: load(&COUNTERS.disk_reads),
+        mapped_bytes_read: load(&COUNTERS.mapped_bytes_read),
+        sector_cache_hits: load(&COUNTERS.sector_cache_hits),
+        sector_cache_misses: load(&COUNTERS.sector_cache_misses),
+        ..Statistics::default()
+    };
+    for (out, counters) in stats.decompression.iter_mut().zip(&COUNTERS.decompression) {
+        *out = AlgorithmStats {
+            calls: load(&counters.calls),
+            failures: load(&counters.failures),
+            bytes_in: load(&counters.bytes_in),
+            bytes_out: load(&counters.bytes_out),
+            nanos: load(&counters.nanos),
+        };
+    }
+    stats
+}
+
+/// Set every counter back to zero
+///
+/// Updates racing with the reset may survive it; the counters are meant for
+/// monitoring, not accounting.
+pub fn reset() {
+    let clear = |counter: &AtomicU64| counter.store(0, Ordering::Relaxed);
+    clear(&COUNTERS.disk_bytes_read);
+    clear(&COUNTERS.disk_reads);
+    clear(&COUNTERS.mapped_bytes_read);
+    clear(&COUNTERS.sector_cache_hits);
+    clear(&COUNTERS.sector_cache_misses);
+    for counters in &COUNTERS.decompression {
+        clear(&counters.calls);
+        clear(&counters.failures);
+        clear(&counters.bytes_in);
+        clear(&counters.bytes_out);
+        clear(&counters.nanos);
+    }
+}
+
+/// Position of `method` in [`ALGORITHMS`]
+fn algorithm_index(method: CompressionMethod) -> Option<usize> {
+    ALGORITHMS.iter().position(|&m| m == method)
+}
+
+/// Run one decompression stage and record it under `method`
+pub(crate) fn timed_decompress<F>(
+    method: CompressionMethod,
+    data: &[u8],
+    decompress: F,
+) -> crate::Result<Vec<u8>>
+where
+    F: FnOnce(&[u8]) -> crate::Result<Vec<u8>>,
+{
+    let start = Instant::now();
+    let result = decompress(data);
+    record_decompression(method, data.len(), &result, start);
+    result
+}
+
+/// Record a decompression of `input_len` bytes that began at `start`
+///
+/// Untracked methods (no compression, or a combination whose stages are
+/// recorded separately) are ignored.
+pub(crate) fn record_decompression(
+    method: CompressionMethod,
+    input_len: usize,
+    result: &crate::Result<Vec<u8>>,
+    start: Instant,
+) {
+    let Some(index) = algorithm_index(method) else {
+        return;
+    };
+    let counters = &COUNTERS.decompression[index];
+    counters
+        .nanos
+        .fetch_add(start.elapsed().as_nanos() as u64, Ordering::Relaxed);
+    counters.calls.fetch_add(1, Ordering::Relaxed);
+    counters
+        .bytes_in
+        .fetch_add(input_len as u64, Ordering::Relaxed);
+    match result {
+        Ok(output) => {
+            counters
+                .bytes_out
+                .fetch_add(output.len() as u64, Ordering::Relaxed);
+        }
+        Err(_) => {
+            counters.failures.fetch_add(1, Ordering::Relaxed);
+        }
+    }
+}
+
+/// Record a read of `len` bytes from an archive file
+#[inline]
+pub(crate) fn record_disk_read(len: usize) {
+    COUNTERS
+        .disk_bytes_read
+        .fetch_add(len as u64, Ordering::Relaxed);
+    COUNTERS.disk_reads.fetch_add(1, Ordering::Relaxed);
+}
+
+/// Record `len` bytes copied out of a memory mapping
+#[inline]
+pub(crate) fn record_mapped_read(len: usize) {
+    COUNTERS
+        .mapped_bytes_read
+        .fetch_add(len as u64, Ordering::Relaxed);
+}
+
+/// Record a sector cache lookup
+#[inline]
+pub(crate) fn record_sector_lookup(hit: bool) {
+    let counter = if hit {
+        &COUNTERS.sector_cache_hits
+    } else {
+        &COUNTERS.sector_cache_misses
+    };
+    counter.fetch_add(1, Ordering::Relaxed);
+}
+
+/// An archive file whose reads are added to [`Statistics::disk_bytes_read`]
+///
+/// Derefs to the underlying [`File`] for metadata and cloning.
+#[derive(Debug)]
+pub(crate) struct CountedFile(File);
+
+impl CountedFile {
+    pub(crate) fn new(file: File) -> Self {
+        Self(file)
+    }
+}
+
+impl Deref for CountedFile {
+    type Target = File;
+
+    fn deref(&self) -> &File {
+        &self.0
+    }
+}
+
+impl Read for CountedFile {
+    fn read(&mut self, buf: &mut [u8]) -> io::Result<usize> {
+        let n = self.0.read(buf)?;
+        record_disk_read(n);
+        Ok(n)
+    }
+}
+
+impl Seek for CountedFile {
+    fn seek(&mut self, pos: SeekFrom) -> io::Result<u64> {
+        self.0.seek(pos)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::compression::{algorithms, flags};
+
+    #[test]
+    fn test_decompression_is_counted_per_algorithm() {
+        let original = vec![7u8; 4096];
+        let compressed = algorithms::zlib::compress(&original).unwrap();
+
+        let before = snapshot();
+        let output = crate::compression::decompress(&compressed, flags::ZLIB, original.len())
+            .expect("Decompression failed");
+        assert_eq!(output, original);
+        let after = snapshot();
+
+        // Other tests decompress concurrently, so only check for growth
+        let zlib_before = before.algorithm(CompressionMethod::Zlib).unwrap();
+        let zlib_after = after.algorithm(CompressionMethod::Zlib).unwrap();
+        assert!(zlib_after.calls > zlib_before.calls);
+        assert!(zlib_after.bytes_in >= zlib_before.bytes_in + compressed.len() as u64);
+        assert!(zlib_after.bytes_out >= zlib_before.bytes_out + original.len() as u64);
+        assert!(after.algorithm(CompressionMethod::None).is_none());
+    }
+}
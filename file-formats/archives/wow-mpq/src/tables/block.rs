@@ -242,6 +242,11 @@ impl BlockTable {
         &mut self.entries
     }
 
+    /// Append an entry
+    pub fn push(&mut self, entry: BlockEntry) {
+        self.entries.push(entry);
+    }
+
     /// Clear all entries
     pub fn clear(&mut self) {
         for entry in &mut self.entries {
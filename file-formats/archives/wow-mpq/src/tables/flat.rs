@@ -0,0 +1,936 @@
+//! Flattened copy of the file tables for lookup-heavy workloads
+//!
+//! [`HashTable`] keeps 16-byte entries, so a probe pulls in locale, platform
+//! and block index along with the two name hashes it compares. [`BetTable`]
+//! keeps its file records bit-packed, and every HET/BET lookup unpacks the
+//! file index, the BET hash and the file record again. [`FlatTables`] is a
+//! read-only struct-of-arrays copy built once after loading: the name hashes
+//! of both tables sit in their own contiguous arrays, compared several slots
+//! at a time, and the position, sizes and flags of every file are unpacked
+//! into a dense array.
+//!
+//! With the `mmap` feature the arrays can also live in a read-only mapping
+//! of a shared index entry instead of the heap, so processes attached to the
+//! same entry share one copy of them.
+
+use super::{BetTable, BlockEntry, BlockTable, HashEntry, HashTable, HetTable, HiBlockTable};
+use crate::crypto::{NameHashes, het_hash};
+use crate::{Error, Result};
+use std::fmt;
+use std::ops::Deref;
+#[cfg(feature = "mmap")]
+use std::sync::Arc;
+
+/// Hash table slots compared per probe step
+const HASH_PROBE_WIDTH: usize = 8;
+
+/// HET table slots compared per probe step
+const HET_PROBE_WIDTH: usize = 16;
+
+/// HET name hash of an empty slot
+const HET_EMPTY: u8 = 0xFF;
+
+/// Position, sizes and flags of a file, unpacked
+#[repr(C)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct FlatBlock {
+    /// Offset of the file data relative to the archive start
+    pub file_pos: u64,
+    /// Compressed size
+    pub compressed_size: u64,
+    /// Uncompressed size
+    pub file_size: u64,
+    /// File flags
+    pub flags: u32,
+}
+
+impl FlatBlock {
+    /// Stands in for a BET record that could not be unpacked
+    const MISSING: Self = Self {
+        file_pos: u64::MAX,
+        compressed_size: 0,
+        file_size: 0,
+        flags: 0,
+    };
+}
+
+/// A file found in [`FlatTables`]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct FlatEntry {
+    /// Hash table index (0 for files found through HET/BET)
+    pub hash_index: usize,
+    /// Block table index, or BET file index
+    pub block_index: usize,
+    /// Locale of the hash table entry (0 for HET/BET)
+    pub locale: u16,
+    /// `NAME_A << 32 | NAME_B` of the hash table entry, or the BET hash
+    pub name_hash: u64,
+    /// The file's block information
+    pub block: FlatBlock,
+}
+
+/// Lookup-optimized, read-only copy of an archive's file tables
+///
+/// Lookups give the same results as the tables it was built from for the
+/// default locale. Tables modified afterwards are not reflected.
+#[derive(Debug, Clone, Default)]
+pub struct FlatTables {
+    classic: Option<FlatHashTable>,
+    het_bet: Option<FlatHetBet>,
+}
+
+/// The classic tables are present in an encoded copy
+#[cfg(feature = "mmap")]
+const SECTION_CLASSIC: u32 = 0x1;
+/// The HET/BET tables are present in an encoded copy
+#[cfg(feature = "mmap")]
+const SECTION_HET_BET: u32 = 0x2;
+
+/// Element types of the flattened arrays
+///
+/// # Safety
+///
+/// Every bit pattern must be a valid value, so that arrays can be read in
+/// place from a mapping.
+unsafe trait Plain: Copy {
+    /// Append the value in native byte order, padding included (as zeros)
+    fn put(&self, out: &mut Vec<u8>);
+}
+
+macro_rules! impl_plain {
+    ($($ty:ty),*) => {$(
+        unsafe impl Plain for $ty {
+            fn put(&self, out: &mut Vec<u8>) {
+                out.extend_from_slice(&self.to_ne_bytes());
+            }
+        }
+    )*};
+}
+impl_plain!(u8, u16, u32, u64);
+
+unsafe impl Plain for FlatBlock {
+    fn put(&self, out: &mut Vec<u8>) {
+        self.file_pos.put(out);
+        self.compressed_size.put(out);
+        self.file_size.put(out);
+        self.flags.put(out);
+        out.extend_from_slice(&[0; 4]);
+    }
+}
+
+/// One array of the flattened tables, on the heap or in a shared mapping
+#[derive(Clone)]
+enum Column<T> {
+    Owned(Vec<T>),
+    /// `len` elements starting `offset` bytes into `map`
+    #[cfg(feature = "mmap")]
+    Mapped {
+        map: Arc<memmap2::Mmap>,
+        offset: usize,
+        len: usize,
+    },
+}
+
+impl<T: Plain> Column<T> {
+    /// Bytes of the array held on the heap
+    fn heap_bytes(&self) -> usize {
+        match self {
+            Column::Owned(values) => values.len() * size_of::<T>(),
+            #[cfg(feature = "mmap")]
+            Column::Mapped { .. } => 0,
+        }
+    }
+}
+
+#[cfg(feature = "mmap")]
+impl<T: Plain> Column<T> {
+    /// Append the array on an 8-byte boundary
+    fn encode(&self, out: &mut Vec<u8>) {
+        pad_to_8(out);
+        out.reserve(self.len() * size_of::<T>());
+        for value in self.iter() {
+            value.put(out);
+        }
+    }
+}
+
+impl<T> From<Vec<T>> for Column<T> {
+    fn from(values: Vec<T>) -> Self {
+        Column::Owned(values)
+    }
+}
+
+impl<T: Plain> Deref for Column<T> {
+    type Target = [T];
+
+    fn deref(&self) -> &[T] {
+        match self {
+            Column::Owned(values) => values,
+            // SAFETY: `MapReader::column` checked that the range lies inside the
+            // mapping and is aligned for `T`, and any bytes are a valid `T`
+            #[cfg(feature = "mmap")]
+            Column::Mapped { map, offset, len } => unsafe {
+                std::slice::from_raw_parts(map.as_ptr().add(*offset).cast::<T>(), *len)
+            },
+        }
+    }
+}
+
+impl<T: Plain + fmt::Debug> fmt::Debug for Column<T> {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        fmt::Debug::fmt(&**self, f)
+    }
+}
+
+/// Classic hash table as parallel arrays, with the block table unpacked
+#[derive(Debug, Clone)]
+struct FlatHashTable {
+    mask: usize,
+    name_1: Column<u32>,
+    name_2: Column<u32>,
+    block_index: Column<u32>,
+    locale: Column<u16>,
+    blocks: Column<FlatBlock>,
+}
+
+/// HET table with unpacked file indices, and BET hashes and records
+#[derive(Debug, Clone)]
+struct FlatHetBet {
+    hash_entry_size: u32,
+    bet_hash_size: u32,
+    /// Maximum file count from the HET header
+    max_file_count: u32,
+    /// Number of slots probing wraps around at
+    slot_count: usize,
+    /// 8-bit name hash of each slot, [`HET_EMPTY`] for empty slots
+    name_hashes: Column<u8>,
+    /// File index of each slot, `u32::MAX` if unreadable or out of range
+    file_indices: Column<u32>,
+    /// BET hash of each file
+    bet_hashes: Column<u64>,
+    /// Record of each file, [`FlatBlock::MISSING`] if it could not be unpacked
+    blocks: Column<FlatBlock>,
+}
+
+impl FlatTables {
+    /// Build the flattened copy of an archive's tables
+    ///
+    /// The classic tables are flattened if both the hash and block tables
+    /// are present, HET/BET if both are present and not empty.
+    pub fn new(
+        hash_table: Option<&HashTable>,
+        block_table: Option<&BlockTable>,
+        hi_block_table: Option<&HiBlockTable>,
+        het_table: Option<&HetTable>,
+        bet_table: Option<&BetTable>,
+    ) -> Self {
+        let classic = match (hash_table, block_table) {
+            (Some(hash_table), Some(block_table)) => {
+                Some(FlatHashTable::new(hash_table, block_table, hi_block_table))
+            }
+            _ => None,
+        };
+        let het_bet = match (het_table, bet_table) {
+            (Some(het), Some(bet))
+                if het.header.max_file_count > 0 && bet.header.file_count > 0 =>
+            {
+                Some(FlatHetBet::new(het, bet))
+            }
+            _ => None,
+        };
+        Self { classic, het_bet }
+    }
+
+    /// Whether the classic hash and block tables were flattened
+    pub fn has_hash_table(&self) -> bool {
+        self.classic.is_some()
+    }
+
+    /// Whether the HET and BET tables were flattened
+    pub fn has_het_bet(&self) -> bool {
+        self.het_bet.is_some()
+    }
+
+    /// Find a file in the classic hash table by its name hashes
+    ///
+    /// # Errors
+    /// `Error::BlockTable` if the matching entry points past the block table.
+    pub fn find_hashed(&self, hashes: &NameHashes) -> Result<Option<FlatEntry>> {
+        let Some(table) = &self.classic else {
+            return Ok(None);
+        };
+        let Some(slot) = table.probe(hashes) else {
+            return Ok(None);
+        };
+
+        let block_index = table.block_index[slot] as usize;
+        let block = table
+            .blocks
+            .get(block_index)
+            .ok_or_else(|| Error::block_table("Invalid block index"))?;
+        Ok(Some(table.entry(slot, *block)))
+    }
+
+    /// Find many files in the classic hash table by their name hashes
+    ///
+    /// Writes the entry of each file to `out`, or `None` if it is not in the
+    /// table, probing in the order of the first bucket like
+    /// [`HashTable::find_hashed_batch`].
+    ///
+    /// # Errors
+    /// `Error::BlockTable` if a matching entry points past the block table.
+    pub fn find_hashed_batch(
+        &self,
+        hashes: &[NameHashes],
+        out: &mut Vec<Option<FlatEntry>>,
+    ) -> Result<()> {
+        out.clear();
+        out.resize(hashes.len(), None);
+        let Some(table) = &self.classic else {
+            return Ok(());
+        };
+
+        let mut order: Vec<u64> = hashes
+            .iter()
+            .enumerate()
+            .map(|(i, h)| (((h.offset as usize & table.mask) as u64) << 32) | i as u64)
+            .collect();
+        order.sort_unstable();
+
+        for key in order {
+            let i = key as u32 as usize;
+            out[i] = self.find_hashed(&hashes[i])?;
+        }
+        Ok(())
+    }
+
+    /// Find a file in the HET/BET tables
+    pub fn find_het_bet(&self, filename: &str) -> Option<FlatEntry> {
+        let tables = self.het_bet.as_ref()?;
+        let (file_index, _) = tables.find(filename)?;
+        tables.entry(file_index)
+    }
+
+    /// Block information of a block table entry, or of a BET file
+    ///
+    /// Block table entries take precedence, like in lookups of special
+    /// files. Returns `None` for indices past the tables and for BET records
+    /// that could not be unpacked.
+    pub fn block(&self, block_index: usize) -> Option<FlatBlock> {
+        let block = match (&self.classic, &self.het_bet) {
+            (Some(table), _) => table.blocks.get(block_index),
+            (None, Some(tables)) => tables.blocks.get(block_index),
+            (None, None) => None,
+        }?;
+        (*block != FlatBlock::MISSING).then_some(*block)
+    }
+
+    /// Valid hash table entries whose block exists, in slot order
+    ///
+    /// A block referenced by several entries is listed once per entry.
+    pub fn hash_entries(&self) -> Vec<FlatEntry> {
+        let Some(table) = &self.classic else {
+            return Vec::new();
+        };
+        (0..table.block_index.len())
+            .filter_map(|slot| table.existing(slot))
+            .collect()
+    }
+
+    /// The hash table entry in `slot`, if it is valid and its block exists
+    pub fn hash_entry(&self, slot: usize) -> Option<FlatEntry> {
+        self.classic.as_ref()?.existing(slot)
+    }
+
+    /// HET/BET files that exist, in file index order
+    pub fn bet_entries(&self) -> Vec<FlatEntry> {
+        let Some(tables) = &self.het_bet else {
+            return Vec::new();
+        };
+        (0..tables.blocks.len())
+            .filter_map(|file_index| tables.entry(file_index))
+            .filter(|entry| entry.block.flags & BlockEntry::FLAG_EXISTS != 0)
+            .collect()
+    }
+
+    /// The HET/BET file `file_index`, if its record could be unpacked
+    pub fn bet_entry(&self, file_index: usize) -> Option<FlatEntry> {
+        self.het_bet.as_ref()?.entry(file_index)
+    }
+
+    /// Block table entries, or BET records without a block table
+    ///
+    /// Records that could not be unpacked read as a block at `u64::MAX`
+    /// without flags.
+    pub fn blocks(&self) -> &[FlatBlock] {
+        match (&self.classic, &self.het_bet) {
+            (Some(table), _) => &table.blocks,
+            (None, Some(tables)) => &tables.blocks,
+            (None, None) => &[],
+        }
+    }
+
+    /// Maximum and stored file counts of the HET/BET tables
+    pub fn het_bet_counts(&self) -> Option<(u32, usize)> {
+        let tables = self.het_bet.as_ref()?;
+        Some((tables.max_file_count, tables.blocks.len()))
+    }
+
+    /// Append the arrays in native byte order, each on an 8-byte boundary
+    ///
+    /// `out` must start on an 8-byte boundary of the file it is written to,
+    /// so that [`decode_mapped`](Self::decode_mapped) can read the arrays in
+    /// place.
+    #[cfg(feature = "mmap")]
+    pub(crate) fn encode(&self, out: &mut Vec<u8>) {
+        let mut sections = 0;
+        if self.classic.is_some() {
+            sections |= SECTION_CLASSIC;
+        }
+        if self.het_bet.is_some() {
+            sections |= SECTION_HET_BET;
+        }
+        sections.put(out);
+        0u32.put(out);
+
+        if let Some(table) = &self.classic {
+            (table.name_1.len() as u64).put(out);
+            (table.blocks.len() as u64).put(out);
+            table.name_1.encode(out);
+            table.name_2.encode(out);
+            table.block_index.encode(out);
+            table.locale.encode(out);
+            table.blocks.encode(out);
+        }
+        if let Some(tables) = &self.het_bet {
+            pad_to_8(out);
+            tables.hash_entry_size.put(out);
+            tables.bet_hash_size.put(out);
+            tables.max_file_count.put(out);
+            0u32.put(out);
+            (tables.slot_count as u64).put(out);
+            (tables.name_hashes.len() as u64).put(out);
+            (tables.bet_hashes.len() as u64).put(out);
+            (tables.blocks.len() as u64).put(out);
+            tables.name_hashes.encode(out);
+            tables.file_indices.encode(out);
+            tables.bet_hashes.encode(out);
+            tables.blocks.encode(out);
+        }
+        pad_to_8(out);
+    }
+
+    /// Read tables written by [`encode`](Self::encode) in place from `map`
+    ///
+    /// Returns the tables and the offset just past them, or `None` if the
+    /// encoded copy is truncated or inconsistent.
+    #[cfg(feature = "mmap")]
+    pub(crate) fn decode_mapped(map: &Arc<memmap2::Mmap>, offset: usize) -> Option<(Self, usize)> {
+        let mut reader = MapReader { map, pos: offset };
+        let sections = reader.u32()?;
+        reader.u32()?;
+
+        let classic = if sections & SECTION_CLASSIC != 0 {
+            let slots = reader.count()?;
+            let blocks = reader.count()?;
+            if slots != 0 && !slots.is_power_of_two() {
+                return None;
+            }
+            Some(FlatHashTable {
+                mask: slots.saturating_sub(1),
+                name_1: reader.column(slots)?,
+                name_2: reader.column(slots)?,
+                block_index: reader.column(slots)?,
+                locale: reader.column(slots)?,
+                blocks: reader.column(blocks)?,
+            })
+        } else {
+            None
+        };
+
+        let het_bet = if sections & SECTION_HET_BET != 0 {
+            reader.align();
+            let hash_entry_size = reader.u32()?;
+            let bet_hash_size = reader.u32()?;
+            let max_file_count = reader.u32()?;
+            reader.u32()?;
+            let slot_count = reader.count()?;
+            let name_hash_count = reader.count()?;
+            let bet_hash_count = reader.count()?;
+            let block_count = reader.count()?;
+            // het_hash needs at least the 8 bits of the name hash
+            if !(8..=64).contains(&hash_entry_size)
+                || !(8..=64).contains(&bet_hash_size)
+                || name_hash_count > slot_count
+            {
+                return None;
+            }
+            Some(FlatHetBet {
+                hash_entry_size,
+                bet_hash_size,
+                max_file_count,
+                slot_count,
+                name_hashes: reader.column(name_hash_count)?,
+                file_indices: reader.column(name_hash_count)?,
+                bet_hashes: reader.column(bet_hash_count)?,
+                blocks: reader.column(block_count)?,
+            })
+        } else {
+            None
+        };
+        reader.align();
+
+        Some((Self { classic, het_bet }, reader.pos))
+    }
+
+    /// Number of block table entries, or of BET files without a block table
+    pub fn block_count(&self) -> Option<usize> {
+        match (&self.classic, &self.het_bet) {
+            (Some(table), _) => Some(table.blocks.len()),
+            (None, Some(tables)) => Some(tables.blocks.len()),
+            (None, None) => None,
+        }
+    }
+
+    /// Heap memory used by the flattened tables, in bytes
+    ///
+    /// Arrays read in place from a shared index mapping are not counted.
+    pub fn memory_usage(&self) -> usize {
+        let classic = self.classic.as_ref().map_or(0, |table| {
+            table.name_1.heap_bytes()
+                + table.name_2.heap_bytes()
+                + table.block_index.heap_bytes()
+                + table.locale.heap_bytes()
+                + table.blocks.heap_bytes()
+        });
+        let het_bet = self.het_bet.as_ref().map_or(0, |tables| {
+            tables.name_hashes.heap_bytes()
+                + tables.file_indices.heap_bytes()
+                + tables.bet_hashes.heap_bytes()
+                + tables.blocks.heap_bytes()
+        });
+        classic + het_bet
+    }
+}
+
+impl FlatHashTable {
+    fn new(
+        hash_table: &HashTable,
+        block_table: &BlockTable,
+        hi_block_table: Option<&HiBlockTable>,
+    ) -> Self {
+        let entries = hash_table.entries();
+        let blocks = block_table
+            .entries()
+            .iter()
+            .enumerate()
+            .map(|(index, block)| {
+                let high_bits = hi_block_table.map_or(0, |hi| hi.get_file_pos_high(index));
+                FlatBlock {
+                    file_pos: (high_bits << 32) | block.file_pos as u64,
+                    compressed_size: block.compressed_size as u64,
+                    file_size: block.file_size as u64,
+                    flags: block.flags,
+                }
+            })
+            .collect::<Vec<_>>();
+
+        Self {
+            mask: entries.len().saturating_sub(1),
+            name_1: Column::from(entries.iter().map(|entry| entry.name_1).collect::<Vec<_>>()),
+            name_2: Column::from(entries.iter().map(|entry| entry.name_2).collect::<Vec<_>>()),
+            block_index: Column::from(
+                entries
+                    .iter()
+                    .map(|entry| entry.block_index)
+                    .collect::<Vec<_>>(),
+            ),
+            locale: Column::from(entries.iter().map(|entry| entry.locale).collect::<Vec<_>>()),
+            blocks: blocks.into(),
+        }
+    }
+
+    /// The entry in `slot`, with its block
+    fn entry(&self, slot: usize, block: FlatBlock) -> FlatEntry {
+        FlatEntry {
+            hash_index: slot,
+            block_index: self.block_index[slot] as usize,
+            locale: self.locale[slot],
+            name_hash: ((self.name_1[slot] as u64) << 32) | self.name_2[slot] as u64,
+            block,
+        }
+    }
+
+    /// The entry in `slot`, if it is valid and its block exists
+    fn existing(&self, slot: usize) -> Option<FlatEntry> {
+        let block_index = *self.block_index.get(slot)?;
+        if block_index >= HashEntry::EMPTY_DELETED {
+            return None;
+        }
+        let block = *self.blocks.get(block_index as usize)?;
+        (block.flags & BlockEntry::FLAG_EXISTS != 0).then(|| self.entry(slot, block))
+    }
+
+    /// Slot of the first valid entry with matching name hashes before an
+    /// unused slot, probing from the slot picked by the offset hash
+    fn probe(&self, hashes: &NameHashes) -> Option<usize> {
+        let size = self.name_1.len();
+        let mut index = hashes.offset as usize & self.mask;
+        let mut probed = 0;
+
+        while probed < size {
+            if index + HASH_PROBE_WIDTH <= size {
+                let range = index..index + HASH_PROBE_WIDTH;
+                let matches =
+                    slot_mask::<u32, HASH_PROBE_WIDTH>(&self.name_1[range.clone()], hashes.name_a)
+                        & slot_mask::<u32, HASH_PROBE_WIDTH>(
+                            &self.name_2[range.clone()],
+                            hashes.name_b,
+                        );
+                let unused = slot_mask::<u32, HASH_PROBE_WIDTH>(
+                    &self.block_index[range],
+                    HashEntry::EMPTY_NEVER_USED,
+                );
+
+                // Visit the interesting slots in probe order
+                let mut pending = matches | unused;
+                while pending != 0 {
+                    let lane = pending.trailing_zeros();
+                    let slot = index + lane as usize;
+                    if matches & (1 << lane) != 0
+                        && self.block_index[slot] < HashEntry::EMPTY_DELETED
+                    {
+                        return Some(slot);
+                    }
+                    if unused & (1 << lane) != 0 {
+                        return None;
+                    }
+                    pending &= pending - 1;
+                }
+
+                index = (index + HASH_PROBE_WIDTH) & self.mask;
+                probed += HASH_PROBE_WIDTH;
+            } else {
+                // Fewer slots than one step left before the end of the table
+                let block_index = self.block_index[index];
+                if self.name_1[index] == hashes.name_a
+                    && self.name_2[index] == hashes.name_b
+                    && block_index < HashEntry::EMPTY_DELETED
+                {
+                    return Some(index);
+                }
+                if block_index == HashEntry::EMPTY_NEVER_USED {
+                    return None;
+                }
+
+                index = (index + 1) & self.mask;
+                probed += 1;
+            }
+        }
+        None
+    }
+}
+
+impl FlatHetBet {
+    fn new(het: &HetTable, bet: &BetTable) -> Self {
+        let slot_count = het.header.hash_table_size as usize;
+        let max_file_count = het.header.max_file_count;
+        let name_hashes = het.hash_table[..slot_count.min(het.hash_table.len())].to_vec();
+        let file_indices = (0..name_hashes.len())
+            .map(|slot| match het.read_file_index(slot) {
+                Some(file_index) if file_index < max_file_count => file_index,
+                _ => u32::MAX,
+            })
+            .collect::<Vec<_>>();
+
+        let blocks = (0..bet.header.file_count)
+            .map(|file_index| match bet.get_file_info(file_index) {
+                Some(info) => FlatBlock {
+                    file_pos: info.file_pos,
+                    compressed_size: info.compressed_size,
+                    file_size: info.file_size,
+                    flags: info.flags,
+                },
+                None => FlatBlock::MISSING,
+            })
+            .collect::<Vec<_>>();
+
+        Self {
+            hash_entry_size: het.header.hash_entry_size,
+            bet_hash_size: bet.header.bet_hash_size,
+            max_file_count,
+            slot_count,
+            name_hashes: name_hashes.into(),
+            file_indices: file_indices.into(),
+            bet_hashes: bet.bet_hashes.clone().into(),
+            blocks: blocks.into(),
+        }
+    }
+
+    /// The file `file_index`, if its record could be unpacked
+    fn entry(&self, file_index: usize) -> Option<FlatEntry> {
+        let block = *self.blocks.get(file_index)?;
+        (block != FlatBlock::MISSING).then(|| FlatEntry {
+            hash_index: 0,
+            block_index: file_index,
+            locale: 0,
+            name_hash: self.bet_hashes.get(file_index).copied().unwrap_or(0),
+            block,
+        })
+    }
+
+    /// File index and record of the first candidate confirmed by its BET hash
+    fn find(&self, filename: &str) -> Option<(usize, FlatBlock)> {
+        if self.slot_count == 0 {
+            return None;
+        }
+
+        let (hash, name_hash) = het_hash(filename, self.hash_entry_size);
+        let (bet_hash, _) = het_hash(filename, self.bet_hash_size);
+        let bet_hash = if self.bet_hash_size >= 64 {
+            bet_hash
+        } else {
+            bet_hash & ((1u64 << self.bet_hash_size) - 1)
+        };
+
+        // A candidate slot: its file must carry the full BET hash too
+        let confirm = |slot: usize| {
+            let file_index = self.file_indices[slot] as usize;
+            if self.bet_hashes.get(file_index) != Some(&bet_hash) {
+                return None;
+            }
+            self.blocks
+                .get(file_index)
+                .filter(|block| **block != FlatBlock::MISSING)
+                .map(|block| (file_index, *block))
+        };
+
+        let start = (hash % self.slot_count as u64) as usize;
+        let mut probed = 0;
+        while probed < self.slot_count {
+            let index = (start + probed) % self.slot_count;
+            if index >= self.name_hashes.len() {
+                break;
+            }
+
+            if index + HET_PROBE_WIDTH <= self.name_hashes.len()
+                && probed + HET_PROBE_WIDTH <= self.slot_count
+            {
+                let range = index..index + HET_PROBE_WIDTH;
+                let empty =
+                    slot_mask::<u8, HET_PROBE_WIDTH>(&self.name_hashes[range.clone()], HET_EMPTY);
+                let matches = slot_mask::<u8, HET_PROBE_WIDTH>(&self.name_hashes[range], name_hash);
+
+                // Candidates up to the first empty slot, in probe order
+                let before_empty = if empty == 0 {
+                    u32::MAX
+                } else {
+                    (1 << empty.trailing_zeros()) - 1
+                };
+                let mut candidates = matches & before_empty;
+                while candidates != 0 {
+                    let slot = index + candidates.trailing_zeros() as usize;
+                    if self.file_indices[slot] != u32::MAX
+                        && let Some(found) = confirm(slot)
+                    {
+                        return Some(found);
+                    }
+                    candidates &= candidates - 1;
+                }
+                if empty != 0 {
+                    return None;
+                }
+
+                probed += HET_PROBE_WIDTH;
+            } else {
+                let stored = self.name_hashes[index];
+                if stored == HET_EMPTY {
+                    return None;
+                }
+                if stored == name_hash
+                    && self.file_indices[index] != u32::MAX
+                    && let Some(found) = confirm(index)
+                {
+                    return Some(found);
+                }
+
+                probed += 1;
+            }
+        }
+        None
+    }
+}
+
+#[cfg(feature = "mmap")]
+fn pad_to_8(data: &mut Vec<u8>) {
+    data.resize(data.len().next_multiple_of(8), 0);
+}
+
+/// Bounds-checked reader of an encoded copy in a mapping
+#[cfg(feature = "mmap")]
+struct MapReader<'a> {
+    map: &'a Arc<memmap2::Mmap>,
+    pos: usize,
+}
+
+#[cfg(feature = "mmap")]
+impl MapReader<'_> {
+    fn bytes<const N: usize>(&mut self) -> Option<[u8; N]> {
+        let bytes = self.map.get(self.pos..self.pos.checked_add(N)?)?;
+        self.pos += N;
+        bytes.try_into().ok()
+    }
+
+    fn u32(&mut self) -> Option<u32> {
+        self.bytes().map(u32::from_ne_bytes)
+    }
+
+    /// A `u64` element count
+    fn count(&mut self) -> Option<usize> {
+        self.bytes().map(u64::from_ne_bytes)?.try_into().ok()
+    }
+
+    fn align(&mut self) {
+        self.pos = self.pos.next_multiple_of(8);
+    }
+
+    /// `len` elements on the next 8-byte boundary, left in the mapping
+    fn column<T: Plain>(&mut self, len: usize) -> Option<Column<T>> {
+        self.align();
+        let end = self.pos.checked_add(len.checked_mul(size_of::<T>())?)?;
+        if end > self.map.len() || (self.map.as_ptr() as usize + self.pos) % align_of::<T>() != 0 {
+            return None;
+        }
+        let column = Column::Mapped {
+            map: Arc::clone(self.map),
+            offset: self.pos,
+            len,
+        };
+        self.pos = end;
+        Some(column)
+    }
+}
+
+/// Bit mask of the `N` slots equal to `value`, lowest bit first
+///
+/// Written over a fixed-size array so the comparison compiles to a few
+/// vector compares and a mask extraction.
+#[inline(always)]
+fn slot_mask<T: Copy + PartialEq, const N: usize>(slots: &[T], value: T) -> u32 {
+    let slots: &[T; N] = slots.try_into().expect("probe step of N slots");
+    let mut mask = 0u32;
+    for (lane, &slot) in slots.iter().enumerate() {
+        mask |= ((slot == value) as u32) << lane;
+    }
+    mask
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::crypto::{hash_string, hash_type};
+    use crate::tables::BlockEntry;
+
+    fn hashes(name: &str) -> NameHashes {
+        NameHashes {
+            offset: hash_string(name, hash_type::TABLE_OFFSET),
+            name_a: hash_string(name, hash_type::NAME_A),
+            name_b: hash_string(name, hash_type::NAME_B),
+        }
+    }
+
+    /// Crowded table: long probe runs across step and wrap boundaries
+    fn crowded_tables() -> (HashTable, BlockTable, Vec<String>) {
+        let mut hash_table = HashTable::new_mut(64).unwrap();
+        let mut block_table = BlockTable::new_mut(60).unwrap();
+        let names: Vec<String> = (0..60).map(|i| format!("Dir\\file{i}.dat")).collect();
+        for (block, name) in names.iter().enumerate() {
+            let hashes = hashes(name);
+            let mut index = hashes.offset as usize & 63;
+            while !hash_table.get(index).unwrap().is_empty() {
+                index = (index + 1) & 63;
+            }
+            let entry = hash_table.get_mut(index).unwrap();
+            entry.name_1 = hashes.name_a;
+            entry.name_2 = hashes.name_b;
+            entry.block_index = block as u32;
+            *block_table.get_mut(block).unwrap() = BlockEntry {
+                file_pos: block as u32 * 100,
+                compressed_size: 10,
+                file_size: 20,
+                flags: BlockEntry::FLAG_EXISTS,
+            };
+        }
+        // A deleted entry must be skipped, not end the probe
+        let deleted = hash_table.find_file(&names[3], 0).unwrap().0;
+        hash_table.get_mut(deleted).unwrap().block_index = HashEntry::EMPTY_DELETED;
+        (hash_table, block_table, names)
+    }
+
+    #[test]
+    fn test_flat_hash_table_matches_hash_table() {
+        let (hash_table, block_table, names) = crowded_tables();
+        let flat = FlatTables::new(Some(&hash_table), Some(&block_table), None, None, None);
+        assert!(flat.has_hash_table() && !flat.has_het_bet());
+
+        let lookups = names
+            .iter()
+            .map(String::as_str)
+            .chain(["missing", "other\\x"]);
+        for name in lookups {
+            let expected = hash_table.find_file(name, 0);
+            let found = flat.find_hashed(&hashes(name)).unwrap();
+            assert_eq!(
+                found.map(|entry| (entry.hash_index, entry.block_index)),
+                expected.map(|(index, entry)| (index, entry.block_index as usize)),
+                "{name}"
+            );
+            if let Some(entry) = found {
+                assert_eq!(entry.block.file_pos, entry.block_index as u64 * 100);
+            }
+        }
+    }
+
+    #[cfg(feature = "mmap")]
+    #[test]
+    fn test_decode_mapped_round_trip() {
+        use std::io::Write;
+
+        let (hash_table, block_table, names) = crowded_tables();
+        let flat = FlatTables::new(Some(&hash_table), Some(&block_table), None, None, None);
+
+        // Start past a prefix, like the tables section of a shared index entry
+        let mut data = vec![0xAA; 16];
+        flat.encode(&mut data);
+        data.extend_from_slice(b"trailer!");
+        let mut file = tempfile::tempfile().unwrap();
+        file.write_all(&data).unwrap();
+        let map = Arc::new(unsafe { memmap2::Mmap::map(&file) }.unwrap());
+
+        let (mapped, end) = FlatTables::decode_mapped(&map, 16).unwrap();
+        assert_eq!(&map[end..], b"trailer!");
+        assert!(mapped.has_hash_table() && !mapped.has_het_bet());
+        assert_eq!(mapped.block_count(), Some(names.len()));
+        assert_eq!(mapped.memory_usage(), 0);
+        for name in names.iter().map(String::as_str).chain(["missing"]) {
+            assert_eq!(
+                mapped.find_hashed(&hashes(name)).unwrap(),
+                flat.find_hashed(&hashes(name)).unwrap(),
+                "{name}"
+            );
+        }
+
+        // A truncated copy is rejected
+        drop((mapped, map));
+        file.set_len(end as u64 - 16).unwrap();
+        let map = Arc::new(unsafe { memmap2::Mmap::map(&file) }.unwrap());
+        assert!(FlatTables::decode_mapped(&map, 16).is_none());
+    }
+
+    #[test]
+    fn test_slot_mask() {
+        let slots = [1u8, 2, 1, 0xFF, 1, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 2];
+        assert_eq!(slot_mask::<u8, 16>(&slots, 2), 0b1000_0000_0000_0010);
+        assert_eq!(slot_mask::<u8, 16>(&slots, 0xFF), 0b1000);
+    }
+}
@@ -1,6 +1,6 @@
 //! Hash table implementation for MPQ archives
 
-use crate::crypto::{decrypt_block, hash_string, hash_type};
+use crate::crypto::{NameHashes, decrypt_block, hash_string, hash_type};
 use crate::{Error, Result};
 use byteorder::{LittleEndian, ReadBytesExt};
 use std::io::{Read, Seek, SeekFrom};
@@ -221,12 +221,17 @@ impl HashTable {
 
     /// Find a file in the hash table
     pub fn find_file(&self, filename: &str, locale: u16) -> Option<(usize, &HashEntry)> {
-        // Calculate hash values
-        let name_a = hash_string(filename, hash_type::NAME_A);
-        let name_b = hash_string(filename, hash_type::NAME_B);
-        let start_index = hash_string(filename, hash_type::TABLE_OFFSET) as usize;
+        let hashes = NameHashes {
+            offset: hash_string(filename, hash_type::TABLE_OFFSET),
+            name_a: hash_string(filename, hash_type::NAME_A),
+            name_b: hash_string(filename, hash_type::NAME_B),
+        };
+        self.find_hashed(&hashes, locale)
+    }
 
-        let mut index = start_index & self.mask;
+    /// Find a file by its precomputed name hashes
+    pub fn find_hashed(&self, hashes: &NameHashes, locale: u16) -> Option<(usize, &HashEntry)> {
+        let mut index = hashes.offset as usize & self.mask;
         let end_index = index;
 
         // Linear probing to find the file
@@ -234,7 +239,7 @@ impl HashTable {
             let entry = &self.entries[index];
 
             // Check if this is our file
-            if entry.name_1 == name_a && entry.name_2 == name_b {
+            if entry.name_1 == hashes.name_a && entry.name_2 == hashes.name_b {
                 // Check locale (0 = default/any locale)
                 if (locale == 0 || entry.locale == 0 || entry.locale == locale) && entry.is_valid()
                 {
@@ -257,6 +262,34 @@ impl HashTable {
         }
     }
 
+    /// Find many files by their precomputed name hashes
+    ///
+    /// Writes the hash table index of each file to `out`, or `None` if it is
+    /// not in the table. Lookups run in the order of their first bucket
+    /// rather than the order of `hashes`, so a large batch walks the table
+    /// front to back instead of jumping around it.
+    pub fn find_hashed_batch(
+        &self,
+        hashes: &[NameHashes],
+        locale: u16,
+        out: &mut Vec<Option<usize>>,
+    ) {
+        out.clear();
+        out.resize(hashes.len(), None);
+
+        let mut order: Vec<u64> = hashes
+            .iter()
+            .enumerate()
+            .map(|(i, h)| ((h.offset as usize & self.mask) as u64) << 32 | i as u64)
+            .collect();
+        order.sort_unstable();
+
+        for key in order {
+            let i = key as u32 as usize;
+            out[i] = self.find_hashed(&hashes[i], locale).map(|(index, _)| index);
+        }
+    }
+
     /// Create a new hash table with mutable entries
     pub fn new_mut(size: usize) -> Result<Self> {
         // Validate size is power of 2
@@ -335,4 +368,49 @@ mod tests {
         assert!(HashTable::new(100).is_err());
         assert!(HashTable::new(0).is_err());
     }
+
+    #[test]
+    fn test_find_hashed_batch_matches_find_file() {
+        let stored = [
+            "(listfile)",
+            "Units\\Human\\Footman.mdx",
+            "war3map.j",
+            "a",
+            "b",
+            "c",
+        ];
+        let mut table = HashTable::new_mut(8).unwrap();
+        for (block, name) in stored.iter().enumerate() {
+            let mut index = hash_string(name, hash_type::TABLE_OFFSET) as usize & 7;
+            while !table.entries[index].is_empty() {
+                index = (index + 1) & 7;
+            }
+            table.entries[index] = HashEntry {
+                name_1: hash_string(name, hash_type::NAME_A),
+                name_2: hash_string(name, hash_type::NAME_B),
+                locale: 0,
+                platform: 0,
+                block_index: block as u32,
+            };
+        }
+
+        let queries = [
+            "c",
+            "missing.txt",
+            "units/human/footman.mdx",
+            "(listfile)",
+            "d",
+            "a",
+        ];
+        let mut hashes = Vec::new();
+        crate::crypto::hash_names(&queries, &mut hashes);
+        let mut found = Vec::new();
+        table.find_hashed_batch(&hashes, 0, &mut found);
+
+        assert_eq!(found.len(), queries.len());
+        for (name, index) in queries.iter().zip(&found) {
+            assert_eq!(*index, table.find_file(name, 0).map(|(index, _)| index));
+        }
+        assert_eq!(found.iter().filter(|index| index.is_some()).count(), 4);
+    }
 }
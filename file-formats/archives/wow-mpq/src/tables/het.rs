@@ -329,7 +329,7 @@ impl HetTable {
     }
 
     /// Read a file index from the bit-packed file indices array
-    fn read_file_index(&self, index: usize) -> Option<u32> {
+    pub(super) fn read_file_index(&self, index: usize) -> Option<u32> {
         let index_size = self.header.index_size as usize;
         let bit_offset = index * index_size;
         let byte_offset = bit_offset / 8;
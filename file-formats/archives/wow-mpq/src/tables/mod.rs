@@ -1,14 +1,16 @@
-//! MPQ table structures (hash, block, HET, BET)
+//! MPQ table structures (hash, block, HET, BET) and their flattened lookup copy
 
 mod bet;
 mod block;
 mod common;
+mod flat;
 mod hash;
 mod het;
 
 // Re-export all public types
 pub use bet::{BetFileInfo, BetHeader, BetTable};
 pub use block::{BlockEntry, BlockTable, HiBlockTable};
+pub use flat::{FlatBlock, FlatEntry, FlatTables};
 pub use hash::{HashEntry, HashTable};
 pub use het::{HetHeader, HetTable};
 
@@ -0,0 +1,440 @@
+//! Parallel verification of archive contents
+//!
+//! [`verify_files`] checks files against the checksums stored for them: the
+//! per-sector Adler-32 values of files written with sector CRCs, and the CRC32
+//! and MD5 recorded in `(attributes)`. Each file is streamed through a
+//! [`FileStream`](crate::FileStream) in fixed-size chunks instead of being
+//! decoded into memory, and files are spread over a rayon pool; every stream
+//! owns its own handle to the archive, so workers do not contend on a shared
+//! reader.
+//!
+//! `(attributes)` must be loaded with [`Archive::load_attributes`] beforehand
+//! for the CRC32 and MD5 checks to apply.
+
+use crate::buffer_pool;
+use crate::single_archive_parallel::{ParallelConfig, build_thread_pool};
+use crate::tables::BlockEntry;
+use crate::{Archive, Error, FileEntry, FileInfo, Result};
+use md5::{Digest, Md5};
+use rayon::prelude::*;
+use std::collections::HashMap;
+use std::sync::atomic::{AtomicUsize, Ordering};
+
+/// Bytes hashed per read while streaming a file
+const VERIFY_CHUNK_SIZE: usize = 256 * 1024;
+
+/// Which checks to run
+#[derive(Debug, Clone)]
+pub struct VerifyOptions {
+    /// Check per-sector Adler-32 values where the file has them
+    pub sector_crc: bool,
+    /// Check the CRC32 from `(attributes)`
+    pub file_crc: bool,
+    /// Check the MD5 from `(attributes)`
+    pub file_md5: bool,
+    /// Number of worker threads (None = use rayon default)
+    pub num_threads: Option<usize>,
+}
+
+impl Default for VerifyOptions {
+    fn default() -> Self {
+        Self {
+            sector_crc: true,
+            file_crc: true,
+            file_md5: true,
+            num_threads: None,
+        }
+    }
+}
+
+/// Why a file failed verification
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub enum VerifyFailure {
+    /// A sector (or a single-unit file) did not match its stored Adler-32
+    SectorChecksum,
+    /// The file's CRC32 did not match `(attributes)`
+    Crc32 {
+        /// Value from `(attributes)`
+        expected: u32,
+        /// Value computed from the file contents
+        actual: u32,
+    },
+    /// The file's MD5 did not match `(attributes)`
+    Md5 {
+        /// Value from `(attributes)`
+        expected: [u8; 16],
+        /// Value computed from the file contents
+        actual: [u8; 16],
+    },
+    /// The file could not be opened or decoded
+    Unreadable(String),
+}
+
+/// Result of verifying a single file
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub enum FileVerification {
+    /// Every available checksum matched
+    Verified,
+    /// The file has no checksums to compare against, or was not checked
+    Unchecked,
+    /// A checksum did not match or the file could not be read
+    Failed(VerifyFailure),
+}
+
+/// A file that failed verification
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct FailedFile {
+    /// Name of the file
+    pub name: String,
+    /// Block table index of the file, if it was found
+    pub block_index: Option<usize>,
+    /// What went wrong
+    pub failure: VerifyFailure,
+}
+
+/// Summary of a verification run
+#[derive(Debug, Clone, Default)]
+pub struct VerifyReport {
+    /// Files whose checksums were compared
+    pub verified: usize,
+    /// Files that were skipped: special files, patch files, unnamed encrypted
+    /// files, or files without checksums
+    pub unchecked: usize,
+    /// Files that failed, in listing order
+    pub failures: Vec<FailedFile>,
+}
+
+impl VerifyReport {
+    /// Whether no file failed
+    pub fn is_ok(&self) -> bool {
+        self.failures.is_empty()
+    }
+}
+
+/// Verify one file of `archive`
+pub fn verify_file(archive: &Archive, name: &str, options: &VerifyOptions) -> FileVerification {
+    let result = match archive.find_file(name) {
+        Ok(Some(info)) => check_file(archive, name, &info, options),
+        Ok(None) => Err(VerifyFailure::Unreadable(format!("{name} not found"))),
+        Err(e) => Err(unreadable(e)),
+    };
+    match result {
+        Ok(true) => FileVerification::Verified,
+        Ok(false) => FileVerification::Unchecked,
+        Err(failure) => FileVerification::Failed(failure),
+    }
+}
+
+/// Verify every file stored in `archive` in parallel
+///
+/// Files are taken from the block table (or the BET table), so files missing
+/// from `entries` are checked too. `entries` only supplies names: they are
+/// used in the report and to derive the keys of encrypted files. Unnamed
+/// files are reported as `File<block index>.xxx`, and unnamed encrypted
+/// files cannot be decrypted and count as unchecked.
+///
+/// `progress` is called from the worker threads after each file with the
+/// number of files done so far and the total. Special files such as
+/// `(listfile)` and patch files are counted as unchecked.
+pub fn verify_files<F>(
+    archive: &Archive,
+    entries: &[FileEntry],
+    options: &VerifyOptions,
+    progress: F,
+) -> Result<VerifyReport>
+where
+    F: Fn(usize, usize) + Sync,
+{
+    let pool = build_thread_pool(&ParallelConfig {
+        num_threads: options.num_threads,
+        ..ParallelConfig::default()
+    })?;
+
+    // Special files are usually missing from the listing but must still be
+    // recognised as such
+    let special = SPECIAL_FILES.iter().copied();
+    let mut names = HashMap::new();
+    for name in entries
+        .iter()
+        .map(|entry| entry.name.as_str())
+        .chain(special)
+    {
+        if let Ok(Some(info)) = archive.find_file(name) {
+            names.entry(info.block_index).or_insert(name);
+        }
+    }
+
+    let files = archive.file_metadata();
+    let total = files.len();
+    let done = AtomicUsize::new(0);
+    let results: Vec<FileVerification> = pool.install(|| {
+        files
+            .par_iter()
+            .map(|file| {
+                let name = names.get(&file.block_index).copied();
+                let result = if is_verifiable(name, file.flags) {
+                    verify_block(archive, name, file.block_index, options)
+                } else {
+                    FileVerification::Unchecked
+                };
+                progress(done.fetch_add(1, Ordering::Relaxed) + 1, total);
+                result
+            })
+            .collect()
+    });
+
+    let mut report = VerifyReport::default();
+    for (file, result) in files.iter().zip(results) {
+        match result {
+            FileVerification::Verified => report.verified += 1,
+            FileVerification::Unchecked => report.unchecked += 1,
+            FileVerification::Failed(failure) => report.failures.push(FailedFile {
+                name: names
+                    .get(&file.block_index)
+                    .map_or_else(|| unnamed_file(file.block_index), |name| name.to_string()),
+                block_index: Some(file.block_index),
+                failure,
+            }),
+        }
+    }
+    Ok(report)
+}
+
+/// Names of the special files an archive may hold
+const SPECIAL_FILES: [&str; 4] = ["(listfile)", "(attributes)", "(signature)", "(user data)"];
+
+/// Name used for files whose name is not known
+fn unnamed_file(block_index: usize) -> String {
+    format!("File{block_index:08}.xxx")
+}
+
+/// Whether a stored file is a regular file with contents to check
+fn is_verifiable(name: Option<&str>, flags: u32) -> bool {
+    if flags & BlockEntry::FLAG_PATCH_FILE != 0 {
+        return false;
+    }
+    match name {
+        Some(name) => {
+            let special = name.starts_with('(') && name.ends_with(')');
+            let directory = name.ends_with('/') || name.ends_with('\\');
+            !special && !directory
+        }
+        // The key of an encrypted file is derived from its name
+        None => flags & BlockEntry::FLAG_ENCRYPTED == 0,
+    }
+}
+
+/// Verify the file stored at `block_index`
+fn verify_block(
+    archive: &Archive,
+    name: Option<&str>,
+    block_index: usize,
+    options: &VerifyOptions,
+) -> FileVerification {
+    let name = name.map_or_else(|| unnamed_file(block_index), str::to_string);
+    let result = match archive.find_file_by_block(&name, block_index) {
+        Some(info) => check_file(archive, &name, &info, options),
+        None => Err(VerifyFailure::Unreadable(format!("{name} not found"))),
+    };
+    match result {
+        Ok(true) => FileVerification::Verified,
+        Ok(false) => FileVerification::Unchecked,
+        Err(failure) => FileVerification::Failed(failure),
+    }
+}
+
+/// Classify an error raised while opening or reading a file
+fn unreadable(e: Error) -> VerifyFailure {
+    match e {
+        Error::ChecksumMismatch { .. } => VerifyFailure::SectorChecksum,
+        e => VerifyFailure::Unreadable(e.to_string()),
+    }
+}
+
+/// Stream a file and compare it against its checksums
+///
+/// Returns `Ok(false)` if there was nothing to compare against.
+fn check_file(
+    archive: &Archive,
+    name: &str,
+    info: &FileInfo,
+    options: &VerifyOptions,
+) -> std::result::Result<bool, VerifyFailure> {
+    let attributes = archive.get_file_attributes(info.block_index);
+    let expected_crc = attributes
+        .and_then(|a| a.crc32)
+        .filter(|_| options.file_crc);
+    let expected_md5 = attributes.and_then(|a| a.md5).filter(|_| options.file_md5);
+
+    // Single-unit files check their checksum while the stream is opened
+    let mut stream = archive
+        .open_file_stream_by_block(name, info.block_index)
+        .map_err(unreadable)?;
+    let sector_checked = options.sector_crc
+        && (info.is_single_unit() && info.has_sector_crc()
+            || stream.enable_sector_crc_check().map_err(unreadable)?);
+    if !sector_checked && expected_crc.is_none() && expected_md5.is_none() {
+        return Ok(false);
+    }
+
+    let mut crc = crc32fast::Hasher::new();
+    let mut md5 = Md5::new();
+    let mut hash = |data: &[u8]| {
+        if expected_crc.is_some() {
+            crc.update(data);
+        }
+        if expected_md5.is_some() {
+            md5.update(data);
+        }
+    };
+
+    if let Some(data) = stream.as_slice() {
+        hash(data);
+    } else {
+        let mut buffer = buffer_pool::global().take(VERIFY_CHUNK_SIZE);
+        buffer.resize(VERIFY_CHUNK_SIZE, 0);
+        let mut offset = 0u64;
+        let read_result = loop {
+            match stream.read_at(offset, &mut buffer) {
+                Ok(0) => break Ok(()),
+                Ok(n) => {
+                    hash(&buffer[..n]);
+                    offset += n as u64;
+                }
+                Err(e) => break Err(unreadable(e)),
+            }
+        };
+        buffer_pool::global().recycle(buffer);
+        read_result?;
+    }
+
+    if let Some(expected) = expected_crc {
+        let actual = crc.finalize();
+        if actual != expected {
+            return Err(VerifyFailure::Crc32 { expected, actual });
+        }
+    }
+    if let Some(expected) = expected_md5 {
+        let actual: [u8; 16] = md5.finalize().into();
+        if actual != expected {
+            return Err(VerifyFailure::Md5 { expected, actual });
+        }
+    }
+    Ok(true)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::{ArchiveBuilder, AttributesOption, ListfileOption};
+    use std::fs::OpenOptions;
+    use std::io::{Seek, SeekFrom, Write};
+    use tempfile::TempDir;
+
+    #[test]
+    fn test_verify_files_reports_corruption() -> Result<()> {
+        let temp_dir = TempDir::new()?;
+        let path = temp_dir.path().join("verify.mpq");
+        // Incompressible, so sectors are stored as-is and a flipped byte
+        // decodes to wrong data rather than a decompression error
+        let mut state = 0x2545_F491u32;
+        let large: Vec<u8> = (0..100_000)
+            .map(|_| {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                state as u8
+            })
+            .collect();
+
+        ArchiveBuilder::new()
+            .generate_crcs(true)
+            .attributes_option(AttributesOption::GenerateFull)
+            .add_file_data(large, "large.bin")
+            .add_file_data(b"small file".to_vec(), "small.txt")
+            .build(&path)?;
+
+        let mut archive = Archive::open(&path)?;
+        archive.load_attributes()?;
+        let entries = archive.list()?;
+
+        let calls = AtomicUsize::new(0);
+        let report = verify_files(
+            &archive,
+            &entries,
+            &VerifyOptions::default(),
+            |done, total| {
+                assert!(done <= total);
+                calls.fetch_add(1, Ordering::Relaxed);
+            },
+        )?;
+        assert!(report.is_ok(), "{:?}", report.failures);
+        assert_eq!(report.verified, 2);
+        assert_eq!(
+            calls.load(Ordering::Relaxed),
+            report.verified + report.unchecked
+        );
+
+        // Flip a byte in the middle of large.bin's data
+        let info = archive.find_file("large.bin")?.unwrap();
+        drop(archive);
+        let mut file = OpenOptions::new().read(true).write(true).open(&path)?;
+        file.seek(SeekFrom::Start(info.file_pos + info.compressed_size / 2))?;
+        file.write_all(&[0xA5])?;
+        drop(file);
+
+        let mut archive = Archive::open(&path)?;
+        archive.load_attributes()?;
+        let report = verify_files(&archive, &entries, &VerifyOptions::default(), |_, _| {})?;
+        assert_eq!(report.verified, 1);
+        assert_eq!(report.failures.len(), 1);
+        assert_eq!(report.failures[0].name, "large.bin");
+        assert_eq!(report.failures[0].block_index, Some(info.block_index));
+        assert_eq!(report.failures[0].failure, VerifyFailure::SectorChecksum);
+
+        // Without sector checks the damage still shows up in the file checksums
+        let options = VerifyOptions {
+            sector_crc: false,
+            ..VerifyOptions::default()
+        };
+        assert!(matches!(
+            verify_file(&archive, "large.bin", &options),
+            FileVerification::Failed(VerifyFailure::Crc32 { .. })
+        ));
+        Ok(())
+    }
+
+    #[test]
+    fn test_verify_files_checks_unnamed_files() -> Result<()> {
+        let temp_dir = TempDir::new()?;
+        let path = temp_dir.path().join("unnamed.mpq");
+        let data: Vec<u8> = (0..50_000u32).map(|i| (i * 31 + i / 97) as u8).collect();
+        ArchiveBuilder::new()
+            .generate_crcs(true)
+            .listfile_option(ListfileOption::None)
+            .add_file_data(data, "hidden.bin")
+            .add_file_data(b"another hidden file".to_vec(), "hidden.txt")
+            .build(&path)?;
+
+        // No listing at all: every block is still checked by its sector CRCs
+        let archive = Archive::open(&path)?;
+        let report = verify_files(&archive, &[], &VerifyOptions::default(), |_, _| {})?;
+        assert!(report.is_ok(), "{:?}", report.failures);
+        assert_eq!(report.verified, 2);
+
+        let info = archive.find_file("hidden.bin")?.unwrap();
+        drop(archive);
+        let mut file = OpenOptions::new().read(true).write(true).open(&path)?;
+        file.seek(SeekFrom::Start(info.file_pos + info.compressed_size / 2))?;
+        file.write_all(&[0x5A, 0xA5, 0x5A, 0xA5])?;
+        drop(file);
+
+        let archive = Archive::open(&path)?;
+        let report = verify_files(&archive, &[], &VerifyOptions::default(), |_, _| {})?;
+        assert_eq!(report.failures.len(), 1);
+        let failed = &report.failures[0];
+        assert_eq!(failed.block_index, Some(info.block_index));
+        assert_eq!(failed.name, format!("File{:08}.xxx", info.block_index));
+        Ok(())
+    }
+}
@@ -81,6 +81,7 @@ mod schema_loader;
 mod stringblock;
 mod types;
 mod versions;
+mod view;
 mod writer;
 
 #[cfg(feature = "mmap")]
@@ -119,6 +120,7 @@ pub use mmap::MmapDbcFile;
 pub use parallel::parse_records_parallel;
 
 pub use versions::{DbcVersion, Wdb2Header, Wdb5Header};
+pub use view::{DbcLayout, DbcView, IdIndex};
 pub use writer::DbcWriter;
 
 /// Result type used throughout the library
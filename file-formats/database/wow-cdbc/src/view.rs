@@ -0,0 +1,358 @@
+//! Zero-copy access to DBC records
+//!
+//! [`DbcParser`](crate::DbcParser) copies the file and decodes every record
+//! into [`Value`](crate::Value)s, which is convenient but costs an allocation
+//! per field. [`DbcView`] instead borrows the file bytes, from a memory
+//! mapping or a buffer read out of an archive, and reads fields in place:
+//! opening a table only parses its header, and a field read is a bounds check
+//! and an unaligned load. [`IdIndex`] maps record IDs to rows so lookups by
+//! ID do not scan the table.
+//!
+//! Fields are addressed as 32-bit columns, which covers WDBC and WDB2 files.
+//! Tables with packed fields can still be read through [`DbcView::record`].
+
+use crate::{DbcHeader, DbcVersion, Error, Result, StringRef, Wdb2Header, Wdb5Header};
+use std::collections::HashMap;
+use std::io::Cursor;
+
+/// Where the parts of a DBC file are, parsed from its header
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct DbcLayout {
+    /// The file format version
+    pub version: DbcVersion,
+    /// Number of records in the file
+    pub record_count: u32,
+    /// Number of fields in each record
+    pub field_count: u32,
+    /// Size of each record in bytes
+    pub record_size: u32,
+    /// Size of the string block in bytes
+    pub string_block_size: u32,
+    /// Offset of the first record
+    pub record_data_offset: u64,
+    /// Offset of the string block
+    pub string_block_offset: u64,
+}
+
+impl DbcLayout {
+    /// Parse the header at the start of `data`
+    pub fn parse(data: &[u8]) -> Result<Self> {
+        let mut cursor = Cursor::new(data);
+        let version = DbcVersion::detect(&mut cursor)?;
+
+        // Same offsets as DbcParser, so both read the same records
+        let (header, record_data_offset, string_block_offset) = match version {
+            DbcVersion::WDBC => {
+                let header = DbcHeader::parse(&mut cursor)?;
+                let string_offset = header.string_block_offset();
+                (header, DbcHeader::SIZE as u64, string_offset)
+            }
+            DbcVersion::WDB2 => {
+                let header = Wdb2Header::parse(&mut cursor)?;
+                let record_offset = header.record_data_offset();
+                let string_offset = header.string_block_offset();
+                (header.to_dbc_header(), record_offset, string_offset)
+            }
+            DbcVersion::WDB5 => {
+                let header = Wdb5Header::parse(&mut cursor)?;
+                let string_offset = header.string_block_offset();
+                (header.to_dbc_header(), Wdb5Header::SIZE as u64, string_offset)
+            }
+            _ => {
+                return Err(Error::InvalidHeader(format!(
+                    "Unsupported DBC version: {version:?}"
+                )));
+            }
+        };
+
+        Ok(Self {
+            version,
+            record_count: header.record_count,
+            field_count: header.field_count,
+            record_size: header.record_size,
+            string_block_size: header.string_block_size,
+            record_data_offset,
+            string_block_offset,
+        })
+    }
+
+    /// Size of the file described by the header
+    pub fn total_size(&self) -> u64 {
+        self.string_block_offset + self.string_block_size as u64
+    }
+}
+
+/// A DBC file read in place
+///
+/// # Examples
+///
+/// ```no_run
+/// use wow_cdbc::{DbcView, IdIndex};
+///
+/// # fn main() -> Result<(), wow_cdbc::Error> {
+/// let data = std::fs::read("Spell.dbc")?;
+/// let view = DbcView::new(&data)?;
+/// let index = IdIndex::build(&view, 0)?;
+///
+/// if let Some(row) = index.get(133) {
+///     println!("Spell 133: {}", view.get_string(row, 136)?);
+/// }
+/// # Ok(())
+/// # }
+/// ```
+#[derive(Debug, Clone, Copy)]
+pub struct DbcView<'a> {
+    data: &'a [u8],
+    layout: DbcLayout,
+}
+
+impl<'a> DbcView<'a> {
+    /// Parse the header of `data` and check the file is complete
+    pub fn new(data: &'a [u8]) -> Result<Self> {
+        Self::with_layout(data, DbcLayout::parse(data)?)
+    }
+
+    /// Use a layout parsed earlier from the same bytes
+    pub fn with_layout(data: &'a [u8], layout: DbcLayout) -> Result<Self> {
+        if layout.total_size() > data.len() as u64 {
+            return Err(Error::OutOfBounds(format!(
+                "DBC file is truncated: header describes {} bytes, got {}",
+                layout.total_size(),
+                data.len()
+            )));
+        }
+        Ok(Self { data, layout })
+    }
+
+    /// The parsed header
+    pub fn layout(&self) -> &DbcLayout {
+        &self.layout
+    }
+
+    /// Number of records
+    pub fn record_count(&self) -> u32 {
+        self.layout.record_count
+    }
+
+    /// Number of fields in each record
+    pub fn field_count(&self) -> u32 {
+        self.layout.field_count
+    }
+
+    /// Size of each record in bytes
+    pub fn record_size(&self) -> u32 {
+        self.layout.record_size
+    }
+
+    /// The bytes of all records, `record_size` bytes apart
+    pub fn records(&self) -> &'a [u8] {
+        let start = self.layout.record_data_offset as usize;
+        &self.data[start..self.layout.string_block_offset as usize]
+    }
+
+    /// The bytes of the record at `row`
+    pub fn record(&self, row: u32) -> Option<&'a [u8]> {
+        if row >= self.layout.record_count {
+            return None;
+        }
+        let size = self.layout.record_size as usize;
+        let start = row as usize * size;
+        Some(&self.records()[start..start + size])
+    }
+
+    /// Read the 32-bit column `field` of the record at `row`
+    pub fn get_u32(&self, row: u32, field: u32) -> Option<u32> {
+        let start = field as usize * 4;
+        let bytes = self.record(row)?.get(start..start + 4)?;
+        Some(u32::from_le_bytes(bytes.try_into().unwrap()))
+    }
+
+    /// Read the 32-bit column `field` of the record at `row` as signed
+    pub fn get_i32(&self, row: u32, field: u32) -> Option<i32> {
+        self.get_u32(row, field).map(|value| value as i32)
+    }
+
+    /// Read the 32-bit column `field` of the record at `row` as a float
+    pub fn get_f32(&self, row: u32, field: u32) -> Option<f32> {
+        self.get_u32(row, field).map(f32::from_bits)
+    }
+
+    /// The raw string block
+    pub fn string_block(&self) -> &'a [u8] {
+        let start = self.layout.string_block_offset as usize;
+        &self.data[start..start + self.layout.string_block_size as usize]
+    }
+
+    /// The bytes of the string at `string_ref`, without the NUL terminator
+    pub fn string_bytes(&self, string_ref: StringRef) -> Option<&'a [u8]> {
+        let tail = self.string_block().get(string_ref.offset() as usize..)?;
+        let end = tail.iter().position(|&b| b == 0).unwrap_or(tail.len());
+        Some(&tail[..end])
+    }
+
+    /// Read the string referenced by column `field` of the record at `row`
+    pub fn get_string(&self, row: u32, field: u32) -> Result<&'a str> {
+        let offset = self.get_u32(row, field).ok_or_else(|| {
+            Error::OutOfBounds(format!("Field {field} of row {row} is out of bounds"))
+        })?;
+        let bytes = self.string_bytes(StringRef(offset)).ok_or_else(|| {
+            Error::OutOfBounds(format!(
+                "String reference offset out of bounds: {} (max: {})",
+                offset, self.layout.string_block_size
+            ))
+        })?;
+        std::str::from_utf8(bytes)
+            .map_err(|e| Error::TypeConversion(format!("Invalid UTF-8 string: {e}")))
+    }
+}
+
+/// IDs spanning at most this many slots per record use a dense table
+const DENSE_SLOTS_PER_RECORD: u64 = 4;
+
+/// Row marker for IDs without a record in a dense table
+const NO_ROW: u32 = u32::MAX;
+
+/// Precomputed map from record ID to row
+///
+/// Most tables number their records almost contiguously, so the index is a
+/// flat array from `id - min_id` to row when the IDs are dense enough, and a
+/// hash map otherwise. Like [`RecordSet`](crate::RecordSet), a duplicate ID
+/// maps to its last record.
+#[derive(Debug, Clone)]
+pub struct IdIndex {
+    rows: Rows,
+    len: usize,
+}
+
+#[derive(Debug, Clone)]
+enum Rows {
+    Dense { min_id: u32, rows: Vec<u32> },
+    Sparse(HashMap<u32, u32>),
+}
+
+impl IdIndex {
+    /// Index the records of `view` by the 32-bit column `field`
+    pub fn build(view: &DbcView<'_>, field: u32) -> Result<Self> {
+        if (field as u64 + 1) * 4 > view.record_size() as u64 {
+            return Err(Error::OutOfBounds(format!(
+                "Key field {field} is outside records of {} bytes",
+                view.record_size()
+            )));
+        }
+
+        let count = view.record_count();
+        let ids = (0..count).map(|row| view.get_u32(row, field).unwrap_or_default());
+        let (min_id, max_id) = ids
+            .clone()
+            .fold((u32::MAX, 0), |(lo, hi), id| (lo.min(id), hi.max(id)));
+
+        let rows = if count == 0 {
+            Rows::Sparse(HashMap::new())
+        } else if (max_id - min_id) as u64 + 1 <= count as u64 * DENSE_SLOTS_PER_RECORD {
+            let mut rows = vec![NO_ROW; (max_id - min_id) as usize + 1];
+            for (row, id) in ids.enumerate() {
+                rows[(id - min_id) as usize] = row as u32;
+            }
+            Rows::Dense { min_id, rows }
+        } else {
+            let mut rows = HashMap::with_capacity(count as usize);
+            for (row, id) in ids.enumerate() {
+                rows.insert(id, row as u32);
+            }
+            Rows::Sparse(rows)
+        };
+
+        let len = match &rows {
+            Rows::Dense { rows, .. } => rows.iter().filter(|&&row| row != NO_ROW).count(),
+            Rows::Sparse(rows) => rows.len(),
+        };
+        Ok(Self { rows, len })
+    }
+
+    /// Row of the record with `id`
+    #[inline]
+    pub fn get(&self, id: u32) -> Option<u32> {
+        match &self.rows {
+            Rows::Dense { min_id, rows } => {
+                let row = *rows.get(id.checked_sub(*min_id)? as usize)?;
+                (row != NO_ROW).then_some(row)
+            }
+            Rows::Sparse(rows) => rows.get(&id).copied(),
+        }
+    }
+
+    /// Number of distinct IDs
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    /// Whether the table has no records
+    pub fn is_empty(&self) -> bool {
+        self.len == 0
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn create_dbc(ids: &[u32]) -> Vec<u8> {
+        let strings = b"\0First\0Second\0";
+        let mut data = Vec::new();
+        data.extend_from_slice(b"WDBC");
+        data.extend_from_slice(&(ids.len() as u32).to_le_bytes());
+        data.extend_from_slice(&3u32.to_le_bytes());
+        data.extend_from_slice(&12u32.to_le_bytes());
+        data.extend_from_slice(&(strings.len() as u32).to_le_bytes());
+        for (row, id) in ids.iter().enumerate() {
+            data.extend_from_slice(&id.to_le_bytes());
+            data.extend_from_slice(&(if row % 2 == 0 { 1u32 } else { 7 }).to_le_bytes());
+            data.extend_from_slice(&(row as f32 * 0.5).to_bits().to_le_bytes());
+        }
+        data.extend_from_slice(strings);
+        data
+    }
+
+    #[test]
+    fn test_view_reads_fields_in_place() {
+        let data = create_dbc(&[10, 11, 12]);
+        let view = DbcView::new(&data).unwrap();
+
+        assert_eq!(view.record_count(), 3);
+        assert_eq!(view.record_size(), 12);
+        assert_eq!(view.records().as_ptr(), data[20..].as_ptr());
+        assert_eq!(view.get_u32(1, 0), Some(11));
+        assert_eq!(view.get_f32(2, 2), Some(1.0));
+        assert_eq!(view.get_string(0, 1).unwrap(), "First");
+        assert_eq!(view.get_string(1, 1).unwrap(), "Second");
+        assert_eq!(view.get_u32(3, 0), None);
+        assert_eq!(view.get_u32(0, 3), None);
+
+        // A truncated string block is rejected up front
+        assert!(DbcView::new(&data[..data.len() - 1]).is_err());
+    }
+
+    #[test]
+    fn test_id_index_dense_and_sparse() {
+        let data = create_dbc(&[5, 3, 9, 3]);
+        let view = DbcView::new(&data).unwrap();
+        let index = IdIndex::build(&view, 0).unwrap();
+        assert!(matches!(index.rows, Rows::Dense { .. }));
+        assert_eq!(index.len(), 3);
+        assert_eq!(index.get(5), Some(0));
+        assert_eq!(index.get(3), Some(3));
+        assert_eq!(index.get(9), Some(2));
+        assert_eq!(index.get(4), None);
+        assert_eq!(index.get(2), None);
+        assert_eq!(index.get(u32::MAX), None);
+
+        let data = create_dbc(&[1, 1_000_000, 40]);
+        let view = DbcView::new(&data).unwrap();
+        let index = IdIndex::build(&view, 0).unwrap();
+        assert!(matches!(index.rows, Rows::Sparse(_)));
+        assert_eq!(index.get(1_000_000), Some(1));
+        assert_eq!(index.get(2), None);
+
+        assert!(IdIndex::build(&view, 3).is_err());
+    }
+}
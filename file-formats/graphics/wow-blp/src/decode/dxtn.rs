@@ -0,0 +1,246 @@
+//! DXT1/3/5 block decoding
+//!
+//! Each 4x4 block is expanded through small lookup tables: the four colors,
+//! and for DXT5 the eight alpha values, are computed once per block and every
+//! pixel is then a single indexed load with no per-pixel branches. Blocks are
+//! decoded into a 64 byte tile that is copied to the output one row at a time.
+//! The fixed-size loops unroll and vectorize without needing unsafe code.
+//! Results match texpresso, which [`crate::convert`] uses.
+
+use crate::types::DxtnFormat;
+
+/// Decoded pixels of one block, RGBA in row-major order
+type Tile = [[u8; 4]; 16];
+
+/// Expand an RGB565 color to 8 bits per channel
+fn unpack_565(value: u16) -> [u8; 3] {
+    let red = ((value >> 11) & 0x1F) as u8;
+    let green = ((value >> 5) & 0x3F) as u8;
+    let blue = (value & 0x1F) as u8;
+    [
+        (red << 3) | (red >> 2),
+        (green << 2) | (green >> 4),
+        (blue << 3) | (blue >> 2),
+    ]
+}
+
+/// Build the four colors of a color block
+///
+/// DXT1 blocks whose first endpoint is not greater than the second use three
+/// colors and transparent black; DXT3 and DXT5 color blocks always use four.
+fn color_table(block: &[u8], allow_transparent: bool) -> [[u8; 4]; 4] {
+    let value0 = u16::from_le_bytes([block[0], block[1]]);
+    let value1 = u16::from_le_bytes([block[2], block[3]]);
+    let c0 = unpack_565(value0);
+    let c1 = unpack_565(value1);
+
+    let mut table = [[0, 0, 0, 255]; 4];
+    let three_colors = allow_transparent && value0 <= value1;
+    for i in 0..3 {
+        let (a, b) = (u16::from(c0[i]), u16::from(c1[i]));
+        table[0][i] = c0[i];
+        table[1][i] = c1[i];
+        if three_colors {
+            table[2][i] = ((a + b) / 2) as u8;
+        } else {
+            table[2][i] = ((2 * a + b) / 3) as u8;
+            table[3][i] = ((a + 2 * b) / 3) as u8;
+        }
+    }
+    if three_colors {
+        table[3] = [0; 4];
+    }
+    table
+}
+
+/// Decode the color half of a block, setting every pixel's RGB and alpha
+fn decode_colors(block: &[u8], allow_transparent: bool, tile: &mut Tile) {
+    let table = color_table(block, allow_transparent);
+    let indices = u32::from_le_bytes([block[4], block[5], block[6], block[7]]);
+    for (i, pixel) in tile.iter_mut().enumerate() {
+        *pixel = table[((indices >> (2 * i)) & 3) as usize];
+    }
+}
+
+/// Apply DXT3 explicit 4-bit alpha
+fn decode_explicit_alpha(block: &[u8], tile: &mut Tile) {
+    for (pair, &byte) in tile.chunks_exact_mut(2).zip(&block[..8]) {
+        let low = byte & 0x0F;
+        let high = byte & 0xF0;
+        pair[0][3] = low | (low << 4);
+        pair[1][3] = high | (high >> 4);
+    }
+}
+
+/// Apply DXT5 interpolated alpha
+fn decode_interpolated_alpha(block: &[u8], tile: &mut Tile) {
+    let (alpha0, alpha1) = (u16::from(block[0]), u16::from(block[1]));
+    let mut table = [0u8; 8];
+    table[0] = block[0];
+    table[1] = block[1];
+    if alpha0 <= alpha1 {
+        for i in 1..5 {
+            table[1 + i] = (((5 - i as u16) * alpha0 + i as u16 * alpha1) / 5) as u8;
+        }
+        table[6] = 0;
+        table[7] = 255;
+    } else {
+        for i in 1..7 {
+            table[1 + i] = (((7 - i as u16) * alpha0 + i as u16 * alpha1) / 7) as u8;
+        }
+    }
+
+    let mut bits = [0u8; 8];
+    bits[..6].copy_from_slice(&block[2..8]);
+    let indices = u64::from_le_bytes(bits);
+    for (i, pixel) in tile.iter_mut().enumerate() {
+        pixel[3] = table[((indices >> (3 * i)) & 7) as usize];
+    }
+}
+
+/// Decode one block of `format`
+fn decode_block(block: &[u8], format: DxtnFormat, tile: &mut Tile) {
+    match format {
+        DxtnFormat::Dxt1 => decode_colors(block, true, tile),
+        DxtnFormat::Dxt3 => {
+            decode_colors(&block[8..], false, tile);
+            decode_explicit_alpha(block, tile);
+        }
+        DxtnFormat::Dxt5 => {
+            decode_colors(&block[8..], false, tile);
+            decode_interpolated_alpha(block, tile);
+        }
+    }
+}
+
+/// Size of a `width` x `height` image compressed as `format`
+pub(super) fn compressed_size(format: DxtnFormat, width: u32, height: u32) -> usize {
+    let blocks_x = (width as usize).div_ceil(4);
+    let blocks_y = (height as usize).div_ceil(4);
+    blocks_x * blocks_y * format.block_size()
+}
+
+/// Decode `data` to RGBA8 into `out`, which holds exactly `width * height` pixels
+///
+/// Blocks missing from the end of `data` decode as if they were zero, like
+/// the zero padding `convert` applies to undersized mipmaps.
+pub(super) fn decode_dxtn(
+    data: &[u8],
+    format: DxtnFormat,
+    width: u32,
+    height: u32,
+    out: &mut [u8],
+) {
+    let (width, height) = (width as usize, height as usize);
+    let block_size = format.block_size();
+    let blocks_x = width.div_ceil(4);
+    let row_stride = width * 4;
+    let mut tile: Tile = [[0; 4]; 16];
+    let mut padded = [0u8; 16];
+
+    for by in 0..height.div_ceil(4) {
+        for bx in 0..blocks_x {
+            let start = (by * blocks_x + bx) * block_size;
+            let block = match data.get(start..start + block_size) {
+                Some(block) => block,
+                None => {
+                    let available = data.get(start..).unwrap_or_default();
+                    padded[..block_size].fill(0);
+                    padded[..available.len()].copy_from_slice(available);
+                    &padded[..block_size]
+                }
+            };
+            decode_block(block, format, &mut tile);
+
+            let x = bx * 4;
+            let columns = (width - x).min(4);
+            for (row, pixels) in tile.chunks_exact(4).enumerate() {
+                let y = by * 4 + row;
+                if y >= height {
+                    break;
+                }
+                let offset = y * row_stride + x * 4;
+                for (dst, pixel) in out[offset..offset + columns * 4]
+                    .chunks_exact_mut(4)
+                    .zip(pixels)
+                {
+                    dst.copy_from_slice(pixel);
+                }
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_unpack_565_full_range() {
+        assert_eq!(unpack_565(0xFFFF), [255, 255, 255]);
+        assert_eq!(unpack_565(0x0000), [0, 0, 0]);
+        assert_eq!(unpack_565(0xF800), [255, 0, 0]);
+        assert_eq!(unpack_565(0x07E0), [0, 255, 0]);
+    }
+
+    #[test]
+    fn test_dxt1_four_and_three_color_modes() {
+        // White then black endpoints: four colors, index 2 is 2/3 white
+        let block = [0xFF, 0xFF, 0x00, 0x00, 0b1110_0100, 0, 0, 0];
+        let mut out = vec![0u8; 4 * 4 * 4];
+        decode_dxtn(&block, DxtnFormat::Dxt1, 4, 4, &mut out);
+        assert_eq!(&out[0..4], &[255, 255, 255, 255]);
+        assert_eq!(&out[4..8], &[0, 0, 0, 255]);
+        assert_eq!(&out[8..12], &[170, 170, 170, 255]);
+        assert_eq!(&out[12..16], &[85, 85, 85, 255]);
+
+        // Swapped endpoints: midpoint and transparent black
+        let block = [0x00, 0x00, 0xFF, 0xFF, 0b1110_0100, 0, 0, 0];
+        decode_dxtn(&block, DxtnFormat::Dxt1, 4, 4, &mut out);
+        assert_eq!(&out[8..12], &[127, 127, 127, 255]);
+        assert_eq!(&out[12..16], &[0, 0, 0, 0]);
+    }
+
+    #[test]
+    fn test_dxt3_and_dxt5_alpha() {
+        let mut block = [0u8; 16];
+        block[0] = 0xF0; // pixel 0 alpha 0, pixel 1 alpha 255
+        block[8..10].copy_from_slice(&0xFFFFu16.to_le_bytes());
+        let mut out = vec![0u8; 16 * 4];
+        decode_dxtn(&block, DxtnFormat::Dxt3, 4, 4, &mut out);
+        assert_eq!(&out[0..4], &[255, 255, 255, 0]);
+        assert_eq!(&out[4..8], &[255, 255, 255, 255]);
+
+        // Eight-value mode: index 1 is alpha1, index 2 is 6/7 alpha0 + 1/7 alpha1
+        let mut block = [0u8; 16];
+        block[0] = 210;
+        block[1] = 0;
+        block[2] = 0b0001_0001;
+        decode_dxtn(&block, DxtnFormat::Dxt5, 4, 4, &mut out);
+        assert_eq!(out[3], 0);
+        assert_eq!(out[7], 180);
+
+        // Six-value mode: indices 6 and 7 are 0 and 255
+        block[0] = 0;
+        block[1] = 100;
+        block[2] = 0b0011_1110;
+        decode_dxtn(&block, DxtnFormat::Dxt5, 4, 4, &mut out);
+        assert_eq!(out[3], 0);
+        assert_eq!(out[7], 255);
+    }
+
+    #[test]
+    fn test_partial_blocks_and_missing_data() {
+        // 6x2 image: two blocks wide, rows and columns past the edge are dropped
+        let mut data = vec![0u8; 8];
+        data[0..2].copy_from_slice(&0xFFFFu16.to_le_bytes());
+        let mut out = vec![1u8; 6 * 2 * 4];
+        decode_dxtn(&data, DxtnFormat::Dxt1, 6, 2, &mut out);
+        assert!(out[..16].chunks(4).all(|p| p == [255, 255, 255, 255]));
+        // Second block is missing and decodes as zero: three color mode, index 0
+        assert!(out[16..24].chunks(4).all(|p| p == [0, 0, 0, 255]));
+        assert!(out[24..40].chunks(4).all(|p| p == [255, 255, 255, 255]));
+        assert_eq!(compressed_size(DxtnFormat::Dxt1, 6, 2), 16);
+        assert_eq!(compressed_size(DxtnFormat::Dxt5, 1, 1), 16);
+    }
+}
@@ -0,0 +1,33 @@
+use ::image::error::ImageError;
+use thiserror::Error;
+
+/// Errors that can occur when decoding a single mipmap level
+#[derive(Debug, Error)]
+pub enum Error {
+    /// The BLP header or mipmap table is malformed
+    #[error("Parsing error: {0}")]
+    Parse(#[from] crate::parser::Error),
+    /// Mipmaps are stored in external files (BLP0)
+    #[error("Mipmaps of BLP0 images are stored in external files")]
+    ExternalMipmaps,
+    /// The mipmap level holds fewer bytes than its size requires
+    #[error("Mipmap {0} is truncated")]
+    Truncated(usize),
+    /// Invalid alpha bit depth for Raw1 format (only 0, 1, 4, or 8 are valid)
+    #[error("There are invalid alpha bits for the Raw1 format. Got {0}, expected: 0, 1, 4, 8.")]
+    Raw1InvalidAlphaBits(u32),
+    /// The output buffer cannot hold the decoded mipmap
+    #[error("Output buffer of {actual} bytes is too small, {needed} bytes needed")]
+    BufferTooSmall {
+        /// Bytes the decoded mipmap takes
+        needed: usize,
+        /// Bytes in the buffer that was passed
+        actual: usize,
+    },
+    /// Decoded JPEG dimensions differ from the header
+    #[error("Header sizes for mipmap {0} are {1}x{2}, but the JPEG is {3}x{4}")]
+    MismatchSizes(usize, u32, u32, u32, u32),
+    /// Error while decoding JPEG content
+    #[error("JPEG decoding error: {0}")]
+    Jpeg(#[from] ImageError),
+}
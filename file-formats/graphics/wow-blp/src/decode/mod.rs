@@ -0,0 +1,421 @@
+//! Decoding single mipmap levels into caller-provided buffers
+//!
+//! [`parse_blp`](crate::parser::parse_blp) copies every mipmap out of the file
+//! and [`blp_to_image`](crate::convert::blp_to_image) allocates a new image on
+//! each call. For bulk work such as thumbnail generation, [`BlpMipmaps`] reads
+//! only the header, locates the one level that is wanted and decodes it
+//! straight from the file bytes into a buffer the caller owns. The other
+//! levels are never touched. DXT levels can also be copied out still
+//! compressed, ready for upload to a GPU.
+//!
+//! ```no_run
+//! use wow_blp::decode::{BlpMipmaps, OutputFormat};
+//!
+//! # let bytes: Vec<u8> = vec![];
+//! let mipmaps = BlpMipmaps::new(&bytes).expect("Failed to read header");
+//! let level = mipmaps.select_level(3);
+//! let mut pixels = vec![0; mipmaps.output_size(level, OutputFormat::Rgba8)];
+//! let decoded = mipmaps
+//!     .decode_into(level, OutputFormat::Rgba8, &mut pixels)
+//!     .expect("Failed to decode");
+//! println!("{}x{}", decoded.width, decoded.height);
+//! ```
+
+mod dxtn;
+/// Decoding error types
+pub mod error;
+mod raw;
+
+use crate::parser::parse_header;
+use crate::types::*;
+use ::image::{ImageFormat, ImageReader};
+pub use error::Error;
+use std::io::Cursor;
+
+/// How the pixels of a BLP file are stored
+#[derive(Debug, Clone, Copy, PartialEq, Eq, PartialOrd, Ord, Hash)]
+pub enum MipmapEncoding {
+    /// 256 color palette with 0, 1, 4 or 8 bits of alpha
+    Raw1,
+    /// Uncompressed BGRA
+    Raw3,
+    /// JPEG with a header shared by all levels
+    Jpeg,
+    /// S3TC blocks
+    Dxtn(DxtnFormat),
+}
+
+/// What [`BlpMipmaps::decode_into`] writes
+#[derive(Debug, Clone, Copy, PartialEq, Eq, PartialOrd, Ord, Hash, Default)]
+pub enum OutputFormat {
+    /// Always decode to 8-bit RGBA
+    #[default]
+    Rgba8,
+    /// Copy DXT blocks unchanged; other encodings are decoded to RGBA
+    KeepDxtn,
+}
+
+/// Layout of a decoded mipmap
+#[derive(Debug, Clone, Copy, PartialEq, Eq, PartialOrd, Ord, Hash)]
+pub enum PixelFormat {
+    /// 8-bit RGBA, `width * height * 4` bytes
+    Rgba8,
+    /// DXT blocks, `ceil(width / 4) * ceil(height / 4)` blocks
+    Dxtn(DxtnFormat),
+}
+
+/// Result of decoding a mipmap
+#[derive(Debug, Clone, Copy, PartialEq, Eq, PartialOrd, Ord, Hash)]
+pub struct DecodedMipmap {
+    /// Level that was decoded
+    pub level: usize,
+    /// Width in pixels
+    pub width: u32,
+    /// Height in pixels
+    pub height: u32,
+    /// Layout of the bytes written
+    pub format: PixelFormat,
+    /// Number of bytes written
+    pub len: usize,
+}
+
+/// Header and mipmap table of a BLP file, borrowing the file bytes
+#[derive(Debug, Clone)]
+pub struct BlpMipmaps<'a> {
+    input: &'a [u8],
+    header: BlpHeader,
+    encoding: MipmapEncoding,
+    offsets: [u32; 16],
+    sizes: [u32; 16],
+    levels: usize,
+}
+
+impl<'a> BlpMipmaps<'a> {
+    /// Parse the header of the BLP file in `input`
+    ///
+    /// Only the header is read, no mipmap is copied or decoded. BLP0 files,
+    /// whose mipmaps live in separate files, are not supported.
+    pub fn new(input: &'a [u8]) -> Result<Self, Error> {
+        let header = parse_header(input)?;
+        let encoding = match (header.content, &header.flags) {
+            (BlpContentTag::Jpeg, _) => MipmapEncoding::Jpeg,
+            (
+                BlpContentTag::Direct,
+                BlpFlags::Blp2 {
+                    compression,
+                    alpha_type,
+                    ..
+                },
+            ) => match (compression, alpha_type) {
+                (Compression::Jpeg, _) => {
+                    return Err(crate::parser::Error::Blp2UnexpectedJpegCompression.into());
+                }
+                (Compression::Raw1, _) => MipmapEncoding::Raw1,
+                (Compression::Raw3, _) => MipmapEncoding::Raw3,
+                (Compression::Dxtc, AlphaType::None) => MipmapEncoding::Dxtn(DxtnFormat::Dxt1),
+                (Compression::Dxtc, AlphaType::OneBit) => MipmapEncoding::Dxtn(DxtnFormat::Dxt3),
+                (Compression::Dxtc, AlphaType::Enhanced) => MipmapEncoding::Dxtn(DxtnFormat::Dxt5),
+                (Compression::Dxtc, alpha_type) => {
+                    return Err(
+                        crate::parser::Error::Blp2UnknownAlphaType((*alpha_type).into()).into(),
+                    );
+                }
+            },
+            (BlpContentTag::Direct, BlpFlags::Old { .. }) => MipmapEncoding::Raw1,
+        };
+        let (offsets, sizes) = header.internal_mipmaps().ok_or(Error::ExternalMipmaps)?;
+
+        // Same level count as the parser: stop at the first empty level
+        let max_levels = if header.has_mipmaps() {
+            (header.mipmaps_count() + 1).min(16)
+        } else {
+            1
+        };
+        let levels = 1 + sizes[1..max_levels]
+            .iter()
+            .take_while(|&&size| size != 0)
+            .count();
+
+        Ok(Self {
+            input,
+            header,
+            encoding,
+            offsets,
+            sizes,
+            levels,
+        })
+    }
+
+    /// The parsed header
+    pub fn header(&self) -> &BlpHeader {
+        &self.header
+    }
+
+    /// How the pixels are stored
+    pub fn encoding(&self) -> MipmapEncoding {
+        self.encoding
+    }
+
+    /// Number of levels stored in the file, at least 1
+    pub fn level_count(&self) -> usize {
+        self.levels
+    }
+
+    /// The stored level closest to `level`
+    ///
+    /// Levels past the smallest mipmap in the file select that mipmap, so a
+    /// thumbnail request for level 4 of a texture without mipmaps decodes the
+    /// full image. The other methods take levels through this as well.
+    pub fn select_level(&self, level: usize) -> usize {
+        level.min(self.levels - 1)
+    }
+
+    /// Width and height of `level`
+    pub fn level_size(&self, level: usize) -> (u32, u32) {
+        self.header.mipmap_size(self.select_level(level))
+    }
+
+    /// What decoding with `format` produces
+    pub fn pixel_format(&self, format: OutputFormat) -> PixelFormat {
+        match (self.encoding, format) {
+            (MipmapEncoding::Dxtn(dxtn), OutputFormat::KeepDxtn) => PixelFormat::Dxtn(dxtn),
+            _ => PixelFormat::Rgba8,
+        }
+    }
+
+    /// Bytes needed to decode `level` with `format`
+    pub fn output_size(&self, level: usize, format: OutputFormat) -> usize {
+        let (width, height) = self.level_size(level);
+        match self.pixel_format(format) {
+            PixelFormat::Rgba8 => width as usize * height as usize * 4,
+            PixelFormat::Dxtn(dxtn) => dxtn::compressed_size(dxtn, width, height),
+        }
+    }
+
+    /// Encoded bytes of `level`, which must be a stored level
+    fn level_bytes(&self, level: usize) -> Result<&'a [u8], Error> {
+        let offset = self.offsets[level] as usize;
+        let size = self.sizes[level] as usize;
+        self.input
+            .get(offset..offset + size)
+            .ok_or_else(|| crate::parser::Error::OutOfBounds { offset, size }.into())
+    }
+
+    /// Decode `level` into `out`
+    ///
+    /// `out` must hold at least [`output_size`](Self::output_size) bytes; only
+    /// that many are written. DXT levels smaller than their dimensions need
+    /// are zero padded, as [`crate::convert`] does.
+    pub fn decode_into(
+        &self,
+        level: usize,
+        format: OutputFormat,
+        out: &mut [u8],
+    ) -> Result<DecodedMipmap, Error> {
+        let level = self.select_level(level);
+        let (width, height) = self.header.mipmap_size(level);
+        let needed = self.output_size(level, format);
+        if out.len() < needed {
+            return Err(Error::BufferTooSmall {
+                needed,
+                actual: out.len(),
+            });
+        }
+        let out = &mut out[..needed];
+        let data = self.level_bytes(level)?;
+        let pixels = width as usize * height as usize;
+        let pixel_format = self.pixel_format(format);
+
+        match (self.encoding, pixel_format) {
+            (MipmapEncoding::Dxtn(_), PixelFormat::Dxtn(_)) => {
+                let copied = data.len().min(needed);
+                out[..copied].copy_from_slice(&data[..copied]);
+                out[copied..].fill(0);
+            }
+            (MipmapEncoding::Dxtn(dxtn), PixelFormat::Rgba8) => {
+                dxtn::decode_dxtn(data, dxtn, width, height, out);
+            }
+            (MipmapEncoding::Raw3, _) => {
+                let data = data.get(..pixels * 4).ok_or(Error::Truncated(level))?;
+                raw::decode_raw3(data, out);
+            }
+            (MipmapEncoding::Raw1, _) => {
+                let alpha_bits = self.header.alpha_bits();
+                if !matches!(alpha_bits, 0 | 1 | 4 | 8) {
+                    return Err(Error::Raw1InvalidAlphaBits(alpha_bits));
+                }
+                let palette_start = BlpHeader::size(self.header.version);
+                let cmap = self
+                    .input
+                    .get(palette_start..palette_start + 256 * 4)
+                    .ok_or(crate::parser::Error::UnexpectedEof)?;
+                let alpha_len = (pixels * alpha_bits as usize).div_ceil(8);
+                if data.len() < pixels + alpha_len {
+                    return Err(Error::Truncated(level));
+                }
+                let (indices, alpha) = data.split_at(pixels);
+                raw::decode_raw1(
+                    &raw::palette_table(cmap),
+                    indices,
+                    &alpha[..alpha_len],
+                    alpha_bits,
+                    out,
+                );
+            }
+            (MipmapEncoding::Jpeg, _) => self.decode_jpeg(level, data, out)?,
+        }
+
+        Ok(DecodedMipmap {
+            level,
+            width,
+            height,
+            format: pixel_format,
+            len: needed,
+        })
+    }
+
+    /// Decode a JPEG level, joined to the shared JPEG header, into RGBA `out`
+    fn decode_jpeg(&self, level: usize, data: &[u8], out: &mut [u8]) -> Result<(), Error> {
+        let start = BlpHeader::size(self.header.version);
+        let header_size = self
+            .input
+            .get(start..start + 4)
+            .map(|bytes| u32::from_le_bytes([bytes[0], bytes[1], bytes[2], bytes[3]]) as usize)
+            .ok_or(crate::parser::Error::UnexpectedEof)?;
+        let jpeg_header = self
+            .input
+            .get(start + 4..start + 4 + header_size)
+            .ok_or(crate::parser::Error::UnexpectedEof)?;
+
+        let mut jpeg = Vec::with_capacity(jpeg_header.len() + data.len());
+        jpeg.extend_from_slice(jpeg_header);
+        jpeg.extend_from_slice(data);
+        let rgba = ImageReader::with_format(Cursor::new(jpeg), ImageFormat::Jpeg)
+            .decode()?
+            .into_rgba8();
+
+        let (width, height) = self.header.mipmap_size(level);
+        if rgba.dimensions() != (width, height) {
+            return Err(Error::MismatchSizes(
+                level,
+                width,
+                height,
+                rgba.width(),
+                rgba.height(),
+            ));
+        }
+        // BLP JPEGs hold BGRA
+        for (dst, bgra) in out.chunks_exact_mut(4).zip(rgba.as_raw().chunks_exact(4)) {
+            dst.copy_from_slice(&[bgra[2], bgra[1], bgra[0], bgra[3]]);
+        }
+        Ok(())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::convert::{
+        AlphaBits, Blp2Format, BlpOldFormat, BlpTarget, DxtAlgorithm, FilterType, blp_to_image,
+        image_to_blp,
+    };
+    use crate::encode::encode_blp;
+    use crate::parser::parse_blp;
+    use ::image::{DynamicImage, Rgba, RgbaImage};
+
+    fn test_image() -> DynamicImage {
+        let mut image = RgbaImage::new(64, 32);
+        for (x, y, pixel) in image.enumerate_pixels_mut() {
+            *pixel = Rgba([
+                (x * 4) as u8,
+                (y * 8) as u8,
+                ((x + y) * 3) as u8,
+                (x * y) as u8,
+            ]);
+        }
+        DynamicImage::ImageRgba8(image)
+    }
+
+    fn encode(target: BlpTarget) -> Vec<u8> {
+        let blp = image_to_blp(test_image(), true, target, FilterType::Nearest).unwrap();
+        encode_blp(&blp).unwrap()
+    }
+
+    /// Decoding any level must give the same pixels as the full parse and convert
+    fn assert_matches_convert(bytes: &[u8]) {
+        let parsed = parse_blp(bytes).unwrap();
+        let mipmaps = BlpMipmaps::new(bytes).unwrap();
+        assert!(mipmaps.level_count() > 1);
+
+        for level in [0, 2, mipmaps.level_count() - 1] {
+            let expected = blp_to_image(&parsed, level).unwrap().into_rgba8();
+            let mut out = vec![0; mipmaps.output_size(level, OutputFormat::Rgba8)];
+            let decoded = mipmaps
+                .decode_into(level, OutputFormat::Rgba8, &mut out)
+                .unwrap();
+            assert_eq!(decoded.level, level);
+            assert_eq!((decoded.width, decoded.height), expected.dimensions());
+            assert_eq!(out, expected.into_raw(), "level {level}");
+        }
+    }
+
+    #[test]
+    fn test_dxtn_matches_convert() {
+        let compress_algorithm = DxtAlgorithm::RangeFit;
+        for format in [
+            Blp2Format::Dxt1 {
+                has_alpha: true,
+                compress_algorithm,
+            },
+            Blp2Format::Dxt3 {
+                has_alpha: true,
+                compress_algorithm,
+            },
+            Blp2Format::Dxt5 {
+                has_alpha: true,
+                compress_algorithm,
+            },
+        ] {
+            assert_matches_convert(&encode(BlpTarget::Blp2(format)));
+        }
+    }
+
+    #[test]
+    fn test_raw_matches_convert() {
+        for alpha_bits in [AlphaBits::Bit1, AlphaBits::Bit4, AlphaBits::Bit8] {
+            assert_matches_convert(&encode(BlpTarget::Blp2(Blp2Format::Raw1 { alpha_bits })));
+            assert_matches_convert(&encode(BlpTarget::Blp1(BlpOldFormat::Raw1 { alpha_bits })));
+        }
+        assert_matches_convert(&encode(BlpTarget::Blp2(Blp2Format::Raw3)));
+    }
+
+    #[test]
+    fn test_level_selection_and_passthrough() {
+        let bytes = encode(BlpTarget::Blp2(Blp2Format::Dxt5 {
+            has_alpha: true,
+            compress_algorithm: DxtAlgorithm::RangeFit,
+        }));
+        let mipmaps = BlpMipmaps::new(&bytes).unwrap();
+        let last = mipmaps.level_count() - 1;
+        assert_eq!(mipmaps.select_level(100), last);
+        assert_eq!(mipmaps.level_size(1), (32, 16));
+
+        // Blocks are copied out unchanged
+        let size = mipmaps.output_size(1, OutputFormat::KeepDxtn);
+        assert_eq!(size, 8 * 4 * 16);
+        let mut out = vec![0; size];
+        let decoded = mipmaps
+            .decode_into(1, OutputFormat::KeepDxtn, &mut out)
+            .unwrap();
+        assert_eq!(decoded.format, PixelFormat::Dxtn(DxtnFormat::Dxt5));
+        let (offsets, _) = mipmaps.header().internal_mipmaps().unwrap();
+        let start = offsets[1] as usize;
+        assert_eq!(out, &bytes[start..start + size]);
+
+        let mut small = vec![0; size - 1];
+        assert!(matches!(
+            mipmaps.decode_into(1, OutputFormat::KeepDxtn, &mut small),
+            Err(Error::BufferTooSmall { needed, .. }) if needed == size
+        ));
+    }
+}
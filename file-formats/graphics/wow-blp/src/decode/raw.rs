@@ -0,0 +1,116 @@
+//! Palettized (RAW1) and uncompressed (RAW3) decoding
+//!
+//! The 256 palette entries are converted to RGBA once per image, so every
+//! RAW1 pixel is one table load. Alpha is merged in groups of pixels that
+//! share an alpha byte, keeping the inner loops free of per-pixel division.
+
+/// RGBA colors of a BLP palette
+pub(super) type Palette = [[u8; 4]; 256];
+
+/// Convert the on-disk palette (BGRX words) to opaque RGBA
+pub(super) fn palette_table(cmap: &[u8]) -> Palette {
+    let mut table = [[0, 0, 0, 255]; 256];
+    for (entry, bgrx) in table.iter_mut().zip(cmap.chunks_exact(4)) {
+        *entry = [bgrx[2], bgrx[1], bgrx[0], 255];
+    }
+    table
+}
+
+/// Decode palette `indices` with `alpha_bits` of alpha per pixel into `out`
+///
+/// `out` holds `indices.len()` RGBA pixels and `alpha` at least
+/// `ceil(indices.len() * alpha_bits / 8)` bytes. `alpha_bits` must be 0, 1,
+/// 4 or 8; without alpha every pixel is opaque.
+pub(super) fn decode_raw1(
+    palette: &Palette,
+    indices: &[u8],
+    alpha: &[u8],
+    alpha_bits: u32,
+    out: &mut [u8],
+) {
+    for (dst, &index) in out.chunks_exact_mut(4).zip(indices) {
+        dst.copy_from_slice(&palette[index as usize]);
+    }
+
+    match alpha_bits {
+        1 => {
+            for (pixels, &bits) in out.chunks_mut(8 * 4).zip(alpha) {
+                for (i, pixel) in pixels.chunks_exact_mut(4).enumerate() {
+                    pixel[3] = ((bits >> i) & 1) * 255;
+                }
+            }
+        }
+        4 => {
+            for (pixels, &nibbles) in out.chunks_mut(2 * 4).zip(alpha) {
+                for (i, pixel) in pixels.chunks_exact_mut(4).enumerate() {
+                    let nibble = (nibbles >> (4 * i)) & 0x0F;
+                    pixel[3] = (nibble << 4) | nibble;
+                }
+            }
+        }
+        8 => {
+            for (pixel, &value) in out.chunks_exact_mut(4).zip(alpha) {
+                pixel[3] = value;
+            }
+        }
+        _ => {}
+    }
+}
+
+/// Decode RAW3 pixels (BGRA bytes) into RGBA `out` of the same length
+pub(super) fn decode_raw3(pixels: &[u8], out: &mut [u8]) {
+    for (dst, bgra) in out.chunks_exact_mut(4).zip(pixels.chunks_exact(4)) {
+        dst.copy_from_slice(&[bgra[2], bgra[1], bgra[0], bgra[3]]);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn test_palette() -> Palette {
+        let mut cmap = vec![0u8; 256 * 4];
+        // Entry 1 is 0x00RRGGBB = 0x00112233
+        cmap[4..8].copy_from_slice(&0x0011_2233u32.to_le_bytes());
+        palette_table(&cmap)
+    }
+
+    #[test]
+    fn test_palette_is_bgrx() {
+        let palette = test_palette();
+        assert_eq!(palette[1], [0x11, 0x22, 0x33, 255]);
+        assert_eq!(palette[0], [0, 0, 0, 255]);
+    }
+
+    #[test]
+    fn test_raw1_alpha_depths() {
+        let palette = test_palette();
+        let indices = [1u8; 10];
+        let mut out = vec![0u8; 10 * 4];
+
+        decode_raw1(&palette, &indices, &[], 0, &mut out);
+        assert!(out.chunks(4).all(|p| p == [0x11, 0x22, 0x33, 255]));
+
+        decode_raw1(&palette, &indices, &[0b0000_0101, 0b10], 1, &mut out);
+        let alphas: Vec<u8> = out.chunks(4).map(|p| p[3]).collect();
+        assert_eq!(alphas, [255, 0, 255, 0, 0, 0, 0, 0, 0, 255]);
+
+        decode_raw1(&palette, &indices, &[0xF0, 0x08, 0, 0, 0x01], 4, &mut out);
+        let alphas: Vec<u8> = out.chunks(4).map(|p| p[3]).collect();
+        assert_eq!(alphas, [0, 255, 0x88, 0, 0, 0, 0, 0, 0x11, 0]);
+
+        let alpha: Vec<u8> = (0..10).collect();
+        decode_raw1(&palette, &indices, &alpha, 8, &mut out);
+        let alphas: Vec<u8> = out.chunks(4).map(|p| p[3]).collect();
+        assert_eq!(alphas, alpha);
+        assert_eq!(&out[..3], &[0x11, 0x22, 0x33]);
+    }
+
+    #[test]
+    fn test_raw3_swaps_red_and_blue() {
+        let pixels = 0x8011_2233u32.to_le_bytes();
+        let mut out = [0u8; 4];
+        decode_raw3(&pixels, &mut out);
+        assert_eq!(out, [0x11, 0x22, 0x33, 0x80]);
+    }
+}
@@ -56,6 +56,8 @@
 
 /// Conversion utilities to/from DynamicImage
 pub mod convert;
+/// Decoding single mipmap levels into caller-provided buffers
+pub mod decode;
 /// Encoding BLP format into stream of bytes
 pub mod encode;
 /// Decoding BLP format from raw bytes
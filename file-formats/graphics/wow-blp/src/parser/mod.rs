@@ -14,7 +14,7 @@ use super::types::*;
 use crate::path::make_mipmap_path;
 use direct::parse_direct_content;
 pub use error::{Error, LoadError};
-use header::parse_header;
+pub(crate) use header::parse_header;
 use jpeg::parse_jpeg_content;
 use std::path::{Path, PathBuf};
 use types::ParseResult;
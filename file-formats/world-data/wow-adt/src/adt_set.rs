@@ -127,10 +127,51 @@ impl AdtSet {
         // Discover split file paths
         let file_set = SplitFileSet::discover(root_path);
 
-        // Load root (required)
+        // Root is required, split files are omitted when they don't exist
         let root_data = fs::read(&file_set.root)?;
-        let mut cursor = Cursor::new(root_data);
-        let root = match parse_adt(&mut cursor)? {
+        let tex_data = read_if_exists(file_set.tex0.as_deref())?;
+        let obj_data = read_if_exists(file_set.obj0.as_deref())?;
+        let lod_data = read_if_exists(file_set.lod.as_deref())?;
+
+        Self::from_bytes(root_data, tex_data, obj_data, lod_data)
+    }
+
+    /// Parse an ADT set from file contents already in memory.
+    ///
+    /// This is the counterpart of [`load_from_path`](Self::load_from_path) for
+    /// files read from an MPQ archive or any other source. Split files that
+    /// parse as a different file type are ignored, like when loading from disk.
+    ///
+    /// # Arguments
+    ///
+    /// * `root` - Contents of the root ADT file
+    /// * `tex0` - Contents of the `_tex0` file, if present
+    /// * `obj0` - Contents of the `_obj0` file, if present
+    /// * `lod` - Contents of the `_lod` file, if present
+    ///
+    /// # Errors
+    ///
+    /// Returns error if the root is not a root ADT or any file fails to parse.
+    ///
+    /// # Examples
+    ///
+    /// ```no_run
+    /// use wow_adt::adt_set::AdtSet;
+    ///
+    /// # fn example() -> Result<(), Box<dyn std::error::Error>> {
+    /// let root = std::fs::read("Azeroth_30_30.adt")?;
+    /// let adt_set = AdtSet::from_bytes(root, None, None, None)?;
+    /// assert!(!adt_set.is_complete());
+    /// # Ok(())
+    /// # }
+    /// ```
+    pub fn from_bytes(
+        root: Vec<u8>,
+        tex0: Option<Vec<u8>>,
+        obj0: Option<Vec<u8>>,
+        lod: Option<Vec<u8>>,
+    ) -> Result<Self> {
+        let root = match parse_adt(&mut Cursor::new(root))? {
             ParsedAdt::Root(r) => *r,
             _ => {
                 return Err(crate::error::AdtError::ChunkParseError {
@@ -142,39 +183,30 @@ impl AdtSet {
         };
 
         // Load texture (optional but expected for Cataclysm+)
-        let texture = if let Some(tex_path) = &file_set.tex0 {
-            let tex_data = fs::read(tex_path)?;
-            let mut cursor = Cursor::new(tex_data);
-            match parse_adt(&mut cursor)? {
+        let texture = match tex0 {
+            Some(data) => match parse_adt(&mut Cursor::new(data))? {
                 ParsedAdt::Tex0(t) => Some(t),
                 _ => None,
-            }
-        } else {
-            None
+            },
+            None => None,
         };
 
         // Load object (optional but expected for Cataclysm+)
-        let object = if let Some(obj_path) = &file_set.obj0 {
-            let obj_data = fs::read(obj_path)?;
-            let mut cursor = Cursor::new(obj_data);
-            match parse_adt(&mut cursor)? {
+        let object = match obj0 {
+            Some(data) => match parse_adt(&mut Cursor::new(data))? {
                 ParsedAdt::Obj0(o) => Some(o),
                 _ => None,
-            }
-        } else {
-            None
+            },
+            None => None,
         };
 
         // Load LOD (optional, Legion+)
-        let lod = if let Some(lod_path) = &file_set.lod {
-            let lod_data = fs::read(lod_path)?;
-            let mut cursor = Cursor::new(lod_data);
-            match parse_adt(&mut cursor)? {
+        let lod = match lod {
+            Some(data) => match parse_adt(&mut Cursor::new(data))? {
                 ParsedAdt::Lod(l) => Some(l),
                 _ => None,
-            }
-        } else {
-            None
+            },
+            None => None,
         };
 
         Ok(AdtSet {
@@ -270,6 +302,16 @@ impl AdtSet {
     }
 }
 
+/// Read a split file, returning `None` if there is no path or no such file
+fn read_if_exists(path: Option<&Path>) -> Result<Option<Vec<u8>>> {
+    match path.map(fs::read) {
+        Some(Ok(data)) => Ok(Some(data)),
+        Some(Err(e)) if e.kind() == std::io::ErrorKind::NotFound => Ok(None),
+        Some(Err(e)) => Err(e.into()),
+        None => Ok(None),
+    }
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
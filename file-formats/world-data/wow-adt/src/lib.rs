@@ -157,6 +157,7 @@
 //! - [`builder`] - Fluent builder API for constructing ADT files
 //! - [`merger`] - Utilities for merging split files into unified structures
 //! - [`split_set`] - Split file discovery and path management
+//! - [`tile_stream`] - Background loading of the tiles around a moving position
 //! - [`chunk_discovery`] - Discovery phase for fast chunk enumeration
 //! - [`chunk_header`] - ChunkHeader binrw structure (8-byte magic + size)
 //! - [`chunk_id`] - ChunkId type with reversed magic constants
@@ -185,6 +186,7 @@ pub mod error;
 pub mod file_type;
 pub mod merger;
 pub mod split_set;
+pub mod tile_stream;
 pub mod version;
 
 // Internal parser modules
@@ -204,6 +206,7 @@ pub use chunk_id::ChunkId;
 pub use combined_alpha_map::CombinedAlphaMap;
 pub use error::{AdtError, Result};
 pub use file_type::AdtFileType;
+pub use tile_stream::{StreamerConfig, TileCoord, TileSource, TileStreamer};
 pub use version::AdtVersion;
 
 // Chunk structure re-exports
@@ -0,0 +1,685 @@
+//! Streaming loader for the ADT tiles around a moving position.
+//!
+//! A [`TileStreamer`] keeps the tiles of one map resident around a point,
+//! typically a player or camera. Each call to
+//! [`update_position`](TileStreamer::update_position) queues the tiles within
+//! the configured radius, nearest first, and a small pool of worker threads
+//! reads and parses them, along with their `_tex0`, `_obj0` and `_lod` split
+//! files, through a [`TileSource`]. Parsed tiles are kept in a cache bounded
+//! by a memory budget; when it is exceeded the least recently used tiles
+//! outside the prefetch window are dropped.
+//!
+//! ## Quick Start
+//!
+//! ```no_run
+//! use std::io;
+//! use std::time::Duration;
+//! use wow_adt::tile_stream::{StreamerConfig, TileCoord, TileSource, TileStreamer};
+//!
+//! struct Directory(std::path::PathBuf);
+//!
+//! impl TileSource for Directory {
+//!     fn read_file(&self, path: &str) -> io::Result<Option<Vec<u8>>> {
+//!         match std::fs::read(self.0.join(path)) {
+//!             Ok(data) => Ok(Some(data)),
+//!             Err(e) if e.kind() == io::ErrorKind::NotFound => Ok(None),
+//!             Err(e) => Err(e),
+//!         }
+//!     }
+//! }
+//!
+//! # fn example() -> Result<(), Box<dyn std::error::Error>> {
+//! // Tiles present in the map, usually taken from its WDT
+//! let tiles = (28..36).flat_map(|x| (28..36).map(move |y| TileCoord::new(x, y)));
+//! let streamer = TileStreamer::new(
+//!     Directory("World/Maps/Azeroth".into()),
+//!     "Azeroth",
+//!     tiles,
+//!     StreamerConfig::default(),
+//! );
+//!
+//! let center = streamer.update_position(-8949.95, -132.49);
+//! if let Some(tile) = streamer.wait(center, Some(Duration::from_secs(5)))? {
+//!     println!("Tile {:?}: {} MCNK chunks", tile.coord, tile.adt.root.mcnk_chunks.len());
+//! }
+//! # Ok(())
+//! # }
+//! ```
+
+use std::collections::{HashMap, HashSet, VecDeque};
+use std::io;
+use std::sync::{Arc, Condvar, Mutex, MutexGuard};
+use std::thread::{self, JoinHandle};
+use std::time::{Duration, Instant};
+
+use crate::adt_set::AdtSet;
+use crate::error::{AdtError, Result};
+
+/// Number of tiles along each side of a map
+pub const MAP_TILES: u32 = 64;
+
+/// Size of one tile in world units (yards)
+pub const TILE_SIZE: f32 = 533.333_3;
+
+/// Read access to the files of a map.
+///
+/// Implemented over a directory, an MPQ archive or any other virtual file
+/// system. Reads happen on the streamer's worker threads.
+pub trait TileSource: Send + Sync + 'static {
+    /// Read a file in full, returning `Ok(None)` if it does not exist
+    fn read_file(&self, path: &str) -> io::Result<Option<Vec<u8>>>;
+}
+
+/// Tile coordinates on the 64×64 map grid, as used in ADT file names
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub struct TileCoord {
+    /// Column, the first number of `Map_X_Y.adt`
+    pub x: u32,
+    /// Row, the second number of `Map_X_Y.adt`
+    pub y: u32,
+}
+
+impl TileCoord {
+    /// Create tile coordinates
+    pub fn new(x: u32, y: u32) -> Self {
+        Self { x, y }
+    }
+
+    /// Tile containing a world position.
+    ///
+    /// World X runs north and selects the row, world Y runs west and selects
+    /// the column. Positions off the map are clamped to the edge tiles.
+    pub fn from_world(world_x: f32, world_y: f32) -> Self {
+        let offset = 32.0 * TILE_SIZE;
+        let column = ((offset - world_y) / TILE_SIZE) as u32;
+        let row = ((offset - world_x) / TILE_SIZE) as u32;
+        Self::new(column.min(MAP_TILES - 1), row.min(MAP_TILES - 1))
+    }
+
+    /// Distance in tiles, the larger of the column and row differences
+    pub fn distance(&self, other: TileCoord) -> u32 {
+        self.x.abs_diff(other.x).max(self.y.abs_diff(other.y))
+    }
+
+    fn index(&self) -> usize {
+        (self.y * MAP_TILES + self.x) as usize
+    }
+}
+
+/// Configuration of a [`TileStreamer`]
+#[derive(Debug, Clone)]
+pub struct StreamerConfig {
+    /// Tiles kept loaded in each direction around the current one; 1 is a
+    /// 3×3 window
+    pub radius: u32,
+    /// Bytes of source files to keep cached; tiles within the window are
+    /// kept even if they alone exceed it
+    pub memory_budget: usize,
+    /// Worker threads reading and parsing tiles, at least one
+    pub worker_threads: usize,
+}
+
+impl Default for StreamerConfig {
+    fn default() -> Self {
+        Self {
+            radius: 1,
+            memory_budget: 256 * 1024 * 1024,
+            worker_threads: 2,
+        }
+    }
+}
+
+/// A parsed tile held by the streamer
+#[derive(Debug)]
+pub struct StreamedTile {
+    /// Position of the tile on the map grid
+    pub coord: TileCoord,
+    /// Root file and whichever split files the tile has
+    pub adt: AdtSet,
+    /// Combined size of the files the tile was parsed from
+    pub file_size: usize,
+}
+
+/// Where a tile is in the streaming pipeline
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum TileState {
+    /// The map has no ADT for this tile
+    Absent,
+    /// Not loaded and not queued
+    Unloaded,
+    /// Queued or being read and parsed
+    Pending,
+    /// Parsed and cached
+    Ready,
+    /// Loading failed; [`TileStreamer::wait`] returns the error
+    Failed,
+}
+
+/// Counters of a [`TileStreamer`]
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct StreamerStats {
+    /// Tiles currently cached
+    pub resident_tiles: usize,
+    /// Source bytes of the cached tiles, compared against the budget
+    pub resident_bytes: usize,
+    /// Tiles queued or being loaded
+    pub pending_tiles: usize,
+    /// Tiles loaded since the streamer was created
+    pub loaded: u64,
+    /// Tiles dropped from the cache to stay within the budget
+    pub evicted: u64,
+    /// Tiles that failed to load
+    pub failed: u64,
+}
+
+struct CachedTile {
+    tile: Arc<StreamedTile>,
+    last_used: u64,
+}
+
+struct State {
+    center: TileCoord,
+    /// Tiles waiting for a worker, nearest to `center` first
+    queue: VecDeque<TileCoord>,
+    /// Tiles a worker is reading or parsing
+    loading: HashSet<TileCoord>,
+    cache: HashMap<TileCoord, CachedTile>,
+    failures: HashMap<TileCoord, AdtError>,
+    /// Counter stamping cache accesses for LRU eviction
+    clock: u64,
+    stats: StreamerStats,
+    shutdown: bool,
+}
+
+impl State {
+    fn touch(&mut self, coord: TileCoord) -> Option<Arc<StreamedTile>> {
+        self.clock += 1;
+        let clock = self.clock;
+        self.cache.get_mut(&coord).map(|cached| {
+            cached.last_used = clock;
+            Arc::clone(&cached.tile)
+        })
+    }
+
+    fn is_pending(&self, coord: TileCoord) -> bool {
+        self.loading.contains(&coord) || self.queue.contains(&coord)
+    }
+
+    /// Drop least recently used tiles outside the window until within budget
+    fn evict(&mut self, radius: u32, budget: usize) {
+        while self.stats.resident_bytes > budget {
+            let center = self.center;
+            let victim = self
+                .cache
+                .iter()
+                .filter(|(coord, _)| coord.distance(center) > radius)
+                .min_by_key(|(_, cached)| cached.last_used)
+                .map(|(coord, _)| *coord);
+            let Some(victim) = victim else {
+                break;
+            };
+            if let Some(cached) = self.cache.remove(&victim) {
+                self.stats.resident_bytes -= cached.tile.file_size;
+                self.stats.evicted += 1;
+            }
+        }
+        self.stats.resident_tiles = self.cache.len();
+    }
+}
+
+struct Shared {
+    source: Box<dyn TileSource>,
+    /// Path of the map's files without the `_X_Y.adt` suffix
+    prefix: String,
+    /// Tiles the map has, indexed by [`TileCoord::index`]
+    present: Vec<bool>,
+    radius: u32,
+    memory_budget: usize,
+    state: Mutex<State>,
+    /// Signalled when tiles are queued or on shutdown
+    work: Condvar,
+    /// Signalled when a tile finishes loading or fails
+    done: Condvar,
+}
+
+impl Shared {
+    fn lock(&self) -> MutexGuard<'_, State> {
+        self.state.lock().unwrap()
+    }
+
+    fn has_tile(&self, coord: TileCoord) -> bool {
+        coord.x < MAP_TILES && coord.y < MAP_TILES && self.present[coord.index()]
+    }
+
+    fn worker(&self) {
+        loop {
+            let coord = {
+                let mut state = self.lock();
+                loop {
+                    if state.shutdown {
+                        return;
+                    }
+                    if let Some(coord) = state.queue.pop_front() {
+                        state.loading.insert(coord);
+                        break coord;
+                    }
+                    state = self.work.wait(state).unwrap();
+                }
+            };
+
+            let result = load_tile(self.source.as_ref(), &self.prefix, coord);
+
+            let mut state = self.lock();
+            state.loading.remove(&coord);
+            match result {
+                Ok(tile) => {
+                    state.clock += 1;
+                    state.stats.resident_bytes += tile.file_size;
+                    state.stats.loaded += 1;
+                    let last_used = state.clock;
+                    let tile = Arc::new(tile);
+                    if let Some(old) = state.cache.insert(coord, CachedTile { tile, last_used }) {
+                        state.stats.resident_bytes -= old.tile.file_size;
+                    }
+                    state.evict(self.radius, self.memory_budget);
+                }
+                Err(e) => {
+                    log::warn!("Failed to load ADT tile {}_{}: {e}", coord.x, coord.y);
+                    state.stats.failed += 1;
+                    state.failures.insert(coord, e);
+                }
+            }
+            state.stats.pending_tiles = state.queue.len() + state.loading.len();
+            drop(state);
+            self.done.notify_all();
+        }
+    }
+}
+
+/// Read and parse one tile with its split files
+fn load_tile(source: &dyn TileSource, prefix: &str, coord: TileCoord) -> Result<StreamedTile> {
+    let base = format!("{prefix}_{}_{}", coord.x, coord.y);
+    let root_name = format!("{base}.adt");
+    let root = source.read_file(&root_name)?.ok_or_else(|| {
+        AdtError::Io(io::Error::new(
+            io::ErrorKind::NotFound,
+            format!("{root_name} not found"),
+        ))
+    })?;
+    let tex0 = source.read_file(&format!("{base}_tex0.adt"))?;
+    let obj0 = source.read_file(&format!("{base}_obj0.adt"))?;
+    let lod = source.read_file(&format!("{base}_lod.adt"))?;
+
+    let file_size = root.len()
+        + tex0.as_ref().map_or(0, Vec::len)
+        + obj0.as_ref().map_or(0, Vec::len)
+        + lod.as_ref().map_or(0, Vec::len);
+    let adt = AdtSet::from_bytes(root, tex0, obj0, lod)?;
+
+    Ok(StreamedTile {
+        coord,
+        adt,
+        file_size,
+    })
+}
+
+/// Background loader keeping the tiles around a position parsed.
+///
+/// Tiles are handed out as `Arc`s, so a tile stays usable after the streamer
+/// evicts it; only the cache's reference counts against the budget. Dropping
+/// the streamer stops its workers once their current tile is done.
+pub struct TileStreamer {
+    shared: Arc<Shared>,
+    workers: Vec<JoinHandle<()>>,
+}
+
+impl TileStreamer {
+    /// Create a streamer over the tiles of one map.
+    ///
+    /// # Arguments
+    ///
+    /// * `source` - Where the ADT files are read from
+    /// * `prefix` - Path of the map's files up to the tile numbers, e.g.
+    ///   `World\Maps\Azeroth\Azeroth`; tiles are read from `{prefix}_X_Y.adt`
+    /// * `tiles` - Tiles the map has, usually those with an ADT in its WDT
+    /// * `config` - Window radius, memory budget and worker count
+    ///
+    /// Nothing is loaded until the first
+    /// [`update_position`](Self::update_position) or [`wait`](Self::wait).
+    pub fn new(
+        source: impl TileSource,
+        prefix: impl Into<String>,
+        tiles: impl IntoIterator<Item = TileCoord>,
+        config: StreamerConfig,
+    ) -> Self {
+        let mut present = vec![false; (MAP_TILES * MAP_TILES) as usize];
+        for coord in tiles {
+            if coord.x < MAP_TILES && coord.y < MAP_TILES {
+                present[coord.index()] = true;
+            }
+        }
+
+        let shared = Arc::new(Shared {
+            source: Box::new(source),
+            prefix: prefix.into(),
+            present,
+            radius: config.radius,
+            memory_budget: config.memory_budget,
+            state: Mutex::new(State {
+                center: TileCoord::new(MAP_TILES / 2, MAP_TILES / 2),
+                queue: VecDeque::new(),
+                loading: HashSet::new(),
+                cache: HashMap::new(),
+                failures: HashMap::new(),
+                clock: 0,
+                stats: StreamerStats::default(),
+                shutdown: false,
+            }),
+            work: Condvar::new(),
+            done: Condvar::new(),
+        });
+
+        let workers = (0..config.worker_threads.max(1))
+            .map(|i| {
+                let shared = Arc::clone(&shared);
+                thread::Builder::new()
+                    .name(format!("adt-stream-{i}"))
+                    .spawn(move || shared.worker())
+                    .expect("failed to spawn ADT streaming thread")
+            })
+            .collect();
+
+        Self { shared, workers }
+    }
+
+    /// Move the window to the tile containing a world position.
+    ///
+    /// See [`set_center`](Self::set_center); returns the new center tile.
+    pub fn update_position(&self, world_x: f32, world_y: f32) -> TileCoord {
+        let center = TileCoord::from_world(world_x, world_y);
+        self.set_center(center);
+        center
+    }
+
+    /// Move the window to a tile and queue the tiles around it.
+    ///
+    /// Queued tiles that left the window are dropped from the queue, and the
+    /// missing ones in the window are added, nearest first. Tiles that failed
+    /// are not retried until their error has been taken with
+    /// [`wait`](Self::wait).
+    pub fn set_center(&self, center: TileCoord) {
+        let radius = self.shared.radius;
+        let mut state = self.shared.lock();
+        state.center = center;
+        state.queue.retain(|coord| coord.distance(center) <= radius);
+
+        let min_x = center.x.saturating_sub(radius);
+        let min_y = center.y.saturating_sub(radius);
+        let max_x = center.x.saturating_add(radius).min(MAP_TILES - 1);
+        let max_y = center.y.saturating_add(radius).min(MAP_TILES - 1);
+        for y in min_y..=max_y {
+            for x in min_x..=max_x {
+                let coord = TileCoord::new(x, y);
+                if self.shared.has_tile(coord)
+                    && !state.cache.contains_key(&coord)
+                    && !state.failures.contains_key(&coord)
+                    && !state.is_pending(coord)
+                {
+                    state.queue.push_back(coord);
+                }
+            }
+        }
+
+        // Square distance first, then straight-line distance within a ring
+        let key = |coord: &TileCoord| {
+            let (dx, dy) = (coord.x.abs_diff(center.x), coord.y.abs_diff(center.y));
+            (dx.max(dy), dx * dx + dy * dy)
+        };
+        state.queue.make_contiguous().sort_by_key(key);
+        state.stats.pending_tiles = state.queue.len() + state.loading.len();
+        state.evict(radius, self.shared.memory_budget);
+        drop(state);
+        self.shared.work.notify_all();
+    }
+
+    /// Get a tile if it is cached, without waiting
+    pub fn get(&self, coord: TileCoord) -> Option<Arc<StreamedTile>> {
+        self.shared.lock().touch(coord)
+    }
+
+    /// Get a tile, loading it ahead of the queue and waiting for it.
+    ///
+    /// Returns `Ok(None)` if the map has no such tile or `timeout` elapses
+    /// first; `None` waits without a limit. If loading failed the error is
+    /// returned once, and the tile is queued again by later calls.
+    pub fn wait(
+        &self,
+        coord: TileCoord,
+        timeout: Option<Duration>,
+    ) -> Result<Option<Arc<StreamedTile>>> {
+        if !self.shared.has_tile(coord) {
+            return Ok(None);
+        }
+
+        let deadline = timeout.map(|timeout| Instant::now() + timeout);
+        let mut state = self.shared.lock();
+        loop {
+            if let Some(tile) = state.touch(coord) {
+                return Ok(Some(tile));
+            }
+            if let Some(e) = state.failures.remove(&coord) {
+                return Err(e);
+            }
+            if !state.is_pending(coord) {
+                state.queue.push_front(coord);
+                state.stats.pending_tiles = state.queue.len() + state.loading.len();
+                self.shared.work.notify_one();
+            }
+
+            state = match deadline {
+                None => self.shared.done.wait(state).unwrap(),
+                Some(deadline) => {
+                    let now = Instant::now();
+                    if now >= deadline {
+                        return Ok(None);
+                    }
+                    self.shared
+                        .done
+                        .wait_timeout(state, deadline - now)
+                        .unwrap()
+                        .0
+                }
+            };
+        }
+    }
+
+    /// Where a tile is in the pipeline
+    pub fn state(&self, coord: TileCoord) -> TileState {
+        if !self.shared.has_tile(coord) {
+            return TileState::Absent;
+        }
+        let state = self.shared.lock();
+        if state.cache.contains_key(&coord) {
+            TileState::Ready
+        } else if state.failures.contains_key(&coord) {
+            TileState::Failed
+        } else if state.is_pending(coord) {
+            TileState::Pending
+        } else {
+            TileState::Unloaded
+        }
+    }
+
+    /// Current center of the window
+    pub fn center(&self) -> TileCoord {
+        self.shared.lock().center
+    }
+
+    /// Whether the map has an ADT for a tile
+    pub fn has_tile(&self, coord: TileCoord) -> bool {
+        self.shared.has_tile(coord)
+    }
+
+    /// Cache and loading counters
+    pub fn stats(&self) -> StreamerStats {
+        self.shared.lock().stats
+    }
+}
+
+impl Drop for TileStreamer {
+    fn drop(&mut self) {
+        self.shared.lock().shutdown = true;
+        self.shared.work.notify_all();
+        for worker in self.workers.drain(..) {
+            let _ = worker.join();
+        }
+    }
+}
+
+impl std::fmt::Debug for TileStreamer {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_struct("TileStreamer")
+            .field("prefix", &self.shared.prefix)
+            .field("radius", &self.shared.radius)
+            .field("memory_budget", &self.shared.memory_budget)
+            .field("stats", &self.stats())
+            .finish()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::builder::AdtBuilder;
+    use std::sync::atomic::{AtomicUsize, Ordering};
+
+    /// In-memory map counting the root files read
+    struct MemorySource {
+        files: HashMap<String, Vec<u8>>,
+        root_reads: Arc<AtomicUsize>,
+    }
+
+    impl TileSource for MemorySource {
+        fn read_file(&self, path: &str) -> io::Result<Option<Vec<u8>>> {
+            if !path.contains("_tex0") && !path.contains("_obj0") && !path.contains("_lod") {
+                self.root_reads.fetch_add(1, Ordering::SeqCst);
+            }
+            Ok(self.files.get(path).cloned())
+        }
+    }
+
+    fn test_map(tiles: &[TileCoord]) -> (MemorySource, Arc<AtomicUsize>) {
+        let root = AdtBuilder::new()
+            .add_texture("terrain/grass.blp")
+            .build()
+            .unwrap()
+            .to_bytes()
+            .unwrap();
+        let files = tiles
+            .iter()
+            .map(|t| (format!("Test_{}_{}.adt", t.x, t.y), root.clone()))
+            .collect();
+        let root_reads = Arc::new(AtomicUsize::new(0));
+        let source = MemorySource {
+            files,
+            root_reads: Arc::clone(&root_reads),
+        };
+        (source, root_reads)
+    }
+
+    fn grid(range: std::ops::Range<u32>) -> Vec<TileCoord> {
+        range
+            .clone()
+            .flat_map(|x| range.clone().map(move |y| TileCoord::new(x, y)))
+            .collect()
+    }
+
+    fn wait_for_queue(streamer: &TileStreamer) {
+        let deadline = Instant::now() + Duration::from_secs(10);
+        while streamer.stats().pending_tiles > 0 && Instant::now() < deadline {
+            thread::sleep(Duration::from_millis(5));
+        }
+    }
+
+    #[test]
+    fn test_world_to_tile() {
+        assert_eq!(TileCoord::from_world(0.0, 0.0), TileCoord::new(32, 32));
+        assert_eq!(
+            TileCoord::from_world(-TILE_SIZE * 0.5, TILE_SIZE * 1.5),
+            TileCoord::new(30, 32)
+        );
+        assert_eq!(TileCoord::from_world(1e9, -1e9), TileCoord::new(63, 0));
+        assert_eq!(TileCoord::new(3, 7).distance(TileCoord::new(5, 6)), 2);
+    }
+
+    #[test]
+    fn test_prefetches_window() {
+        let tiles = grid(30..35);
+        let (source, root_reads) = test_map(&tiles);
+        let streamer = TileStreamer::new(source, "Test", tiles, StreamerConfig::default());
+
+        streamer.set_center(TileCoord::new(32, 32));
+        let tile = streamer
+            .wait(TileCoord::new(32, 32), Some(Duration::from_secs(10)))
+            .unwrap()
+            .expect("center tile");
+        assert_eq!(tile.coord, TileCoord::new(32, 32));
+        assert!(!tile.adt.root.mcnk_chunks.is_empty());
+
+        wait_for_queue(&streamer);
+        for coord in grid(31..34) {
+            assert_eq!(streamer.state(coord), TileState::Ready);
+        }
+        assert_eq!(streamer.state(TileCoord::new(30, 30)), TileState::Unloaded);
+        assert_eq!(streamer.state(TileCoord::new(0, 0)), TileState::Absent);
+        assert_eq!(root_reads.load(Ordering::SeqCst), 9);
+
+        // Moving one tile over only loads the new column
+        streamer.set_center(TileCoord::new(33, 32));
+        wait_for_queue(&streamer);
+        assert_eq!(root_reads.load(Ordering::SeqCst), 12);
+        assert_eq!(streamer.stats().loaded, 12);
+    }
+
+    #[test]
+    fn test_evicts_outside_window() {
+        let tiles = grid(0..8);
+        let (source, _) = test_map(&tiles);
+        let tile_size = source.files.values().next().unwrap().len();
+        let config = StreamerConfig {
+            radius: 0,
+            memory_budget: tile_size * 2,
+            worker_threads: 1,
+        };
+        let streamer = TileStreamer::new(source, "Test", tiles, config);
+
+        for x in 0..4 {
+            let coord = TileCoord::new(x, 0);
+            streamer.set_center(coord);
+            streamer.wait(coord, None).unwrap().expect("tile");
+        }
+
+        let stats = streamer.stats();
+        assert_eq!(stats.resident_tiles, 2);
+        assert_eq!(stats.resident_bytes, tile_size * 2);
+        assert_eq!(stats.evicted, 2);
+        assert!(streamer.get(TileCoord::new(3, 0)).is_some());
+        assert!(streamer.get(TileCoord::new(0, 0)).is_none());
+    }
+
+    #[test]
+    fn test_failed_tile_reports_once() {
+        let tiles = [TileCoord::new(1, 1)];
+        let (mut source, _) = test_map(&[]);
+        source
+            .files
+            .insert("Test_1_1.adt".to_string(), b"not an adt".to_vec());
+        let streamer = TileStreamer::new(source, "Test", tiles, StreamerConfig::default());
+
+        let coord = TileCoord::new(1, 1);
+        assert!(streamer.wait(coord, None).is_err());
+        assert_eq!(streamer.state(coord), TileState::Unloaded);
+        assert_eq!(streamer.stats().failed, 1);
+        assert!(streamer.wait(TileCoord::new(2, 2), None).unwrap().is_none());
+    }
+}
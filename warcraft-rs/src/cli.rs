@@ -86,6 +86,13 @@ pub enum Commands {
         command: crate::commands::wdl::WdlCommands,
     },
 
+    /// Whole-map terrain and collision extraction
+    #[cfg(feature = "maps")]
+    Maps {
+        #[command(subcommand)]
+        command: crate::commands::maps::MapsCommands,
+    },
+
     /// Generate shell completions
     Completions {
         /// Shell to generate completions for
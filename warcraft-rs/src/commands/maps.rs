@@ -0,0 +1,897 @@
+//! Map extraction command implementations
+//!
+//! `maps extract` turns the terrain and collision data of whole maps into
+//! compact files for server-side height, liquid and line-of-sight queries.
+//! Tiles are spread over a work-stealing thread pool. Each worker reads one
+//! ADT with its split files, extracts heights, holes, liquids and model
+//! placements, and resolves the referenced M2 and WMO models through a
+//! content cache. Every unique model is read and decoded once, by the first
+//! tile that needs it, while tiles referencing it later wait for that result.
+//! Encoded files go through a bounded channel to a single writer thread, so
+//! output is streamed to disk while extraction continues and memory stays
+//! bounded when the disk is the bottleneck.
+//!
+//! ## Output
+//!
+//! All values are little-endian.
+//!
+//! `maps/<Map>_<X>_<Y>.map`, one per tile:
+//!
+//! | Field | Type |
+//! |-------|------|
+//! | magic `WRMT`, version | `[u8; 4]`, `u32` |
+//! | tile x, tile y | `u32`, `u32` |
+//! | absolute heights, 145 per chunk for 256 chunks in row-major chunk order | `[f32; 37120]` |
+//! | low-resolution hole masks | `[u16; 256]` |
+//! | area IDs | `[u32; 256]` |
+//! | liquid layer count, then per layer: chunk index `u16`, source (0 MH2O, 1 MCLQ) `u8`, pad `u8`, liquid type `u16`, x/y offset and width/height `[u8; 4]`, min/max level `[f32; 2]`, exists mask `u64`, `(width + 1) * (height + 1)` vertex heights as stored | |
+//! | placement count, then per placement: kind (0 M2, 1 WMO) `u32`, model ID `u32`, unique ID `u32`, position `[f32; 3]`, rotation `[f32; 3]`, scale `f32` | |
+//!
+//! `models/<ID>.col`, one per model with collision geometry:
+//!
+//! | Field | Type |
+//! |-------|------|
+//! | magic `WRCM`, version | `[u8; 4]`, `u32` |
+//! | kind (0 M2, 1 WMO), group count | `u32`, `u32` |
+//! | per group: vertex, triangle, BSP node and BSP reference counts | `[u32; 4]` |
+//! | vertices | `[f32; 3]` per vertex |
+//! | triangles | `[u16; 3]` per triangle |
+//! | collides (1) or not (0) | `u8` per triangle |
+//! | BSP nodes: flags `u16`, negative and positive child `i16`, face count `u16`, first face `u32`, plane distance `f32` | |
+//! | BSP face references | `u16` per reference |
+//!
+//! `models.idx` lists `<ID>\t<kind>\t<name>` for every model that was written.
+
+use anyhow::{Context, Result, bail};
+use clap::Subcommand;
+use rayon::prelude::*;
+use std::collections::HashMap;
+use std::fs;
+use std::io::{Cursor, Read, Write};
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::mpsc::{Receiver, SyncSender, sync_channel};
+use std::sync::{Arc, Mutex, OnceLock};
+use std::thread;
+use std::time::{Duration, Instant};
+
+use wow_adt::chunks::mh2o::VertexDataArray;
+use wow_adt::{AdtSet, McnkChunk, RootAdt};
+use wow_m2::header::M2Header;
+use wow_mpq::{Archive, DataFolder};
+use wow_wdt::WdtReader;
+use wow_wdt::version::WowVersion;
+use wow_wmo::group_parser::WmoGroup;
+use wow_wmo::{ParsedWmo, parse_wmo};
+
+use crate::utils::format::format_bytes;
+use crate::utils::progress::create_progress_bar;
+use crate::utils::table::{add_table_row, create_table};
+
+#[derive(Subcommand)]
+pub enum MapsCommands {
+    /// Extract terrain, liquid and collision data of whole maps
+    Extract {
+        /// Client Data folder or a single MPQ archive
+        data: String,
+
+        /// Output directory
+        #[arg(short, long)]
+        output: String,
+
+        /// Map directory name, e.g. Azeroth (repeatable)
+        #[arg(short, long, required = true)]
+        map: Vec<String>,
+
+        /// Number of worker threads (default: one per CPU)
+        #[arg(short, long)]
+        threads: Option<usize>,
+
+        /// Skip M2 and WMO collision geometry
+        #[arg(long)]
+        no_models: bool,
+    },
+}
+
+pub fn execute(command: MapsCommands) -> Result<()> {
+    match command {
+        MapsCommands::Extract {
+            data,
+            output,
+            map,
+            threads,
+            no_models,
+        } => execute_extract(&data, &output, &map, threads, no_models),
+    }
+}
+
+const TILE_MAGIC: &[u8; 4] = b"WRMT";
+const MODEL_MAGIC: &[u8; 4] = b"WRCM";
+const FORMAT_VERSION: u32 = 1;
+
+const KIND_M2: u32 = 0;
+const KIND_WMO: u32 = 1;
+
+const CHUNKS_PER_TILE: usize = 256;
+const HEIGHTS_PER_CHUNK: usize = 145;
+
+// MOPY material flags deciding whether a WMO triangle collides
+const WMO_MATERIAL_DETAIL: u8 = 0x04;
+const WMO_MATERIAL_COLLISION: u8 = 0x08;
+const WMO_MATERIAL_RENDER: u8 = 0x20;
+
+/// Files of the client, read concurrently by the workers
+enum ClientData {
+    Folder(DataFolder),
+    Archive(Archive),
+}
+
+impl ClientData {
+    fn open(path: &Path) -> Result<Self> {
+        if path.is_dir() {
+            let folder = DataFolder::open(path)
+                .with_context(|| format!("Failed to open data folder: {}", path.display()))?;
+            Ok(ClientData::Folder(folder))
+        } else {
+            let archive = Archive::open(path)
+                .with_context(|| format!("Failed to open archive: {}", path.display()))?;
+            Ok(ClientData::Archive(archive))
+        }
+    }
+
+    /// Read a file in full, `None` if it does not exist
+    fn read(&self, name: &str) -> Result<Option<Vec<u8>>> {
+        let stream = match self {
+            ClientData::Folder(folder) => folder.open_file_stream(name),
+            ClientData::Archive(archive) => archive.open_file_stream(name),
+        };
+        let mut stream = match stream {
+            Ok(stream) => stream,
+            Err(wow_mpq::Error::FileNotFound(_)) => return Ok(None),
+            Err(e) => return Err(e).with_context(|| format!("Failed to open {name}")),
+        };
+        let mut data = Vec::with_capacity(stream.len() as usize);
+        stream
+            .read_to_end(&mut data)
+            .with_context(|| format!("Failed to read {name}"))?;
+        Ok(Some(data))
+    }
+}
+
+/// Items, bytes and time spent in one pipeline stage, summed over threads
+#[derive(Default)]
+struct StageStats {
+    items: AtomicU64,
+    bytes: AtomicU64,
+    nanos: AtomicU64,
+}
+
+impl StageStats {
+    /// Run `f` and account its time to this stage
+    fn time<T>(&self, f: impl FnOnce() -> T) -> T {
+        let start = Instant::now();
+        let result = f();
+        self.nanos
+            .fetch_add(start.elapsed().as_nanos() as u64, Ordering::Relaxed);
+        result
+    }
+
+    fn add(&self, items: u64, bytes: u64) {
+        self.items.fetch_add(items, Ordering::Relaxed);
+        self.bytes.fetch_add(bytes, Ordering::Relaxed);
+    }
+
+    fn busy(&self) -> Duration {
+        Duration::from_nanos(self.nanos.load(Ordering::Relaxed))
+    }
+}
+
+#[derive(Default)]
+struct PipelineStats {
+    /// Reading ADT and model files from the archives
+    read: StageStats,
+    /// Parsing ADT files
+    parse: StageStats,
+    /// Building tile heights, liquids and placements
+    terrain: StageStats,
+    /// Decoding M2 and WMO collision geometry
+    models: StageStats,
+    /// Writing output files
+    write: StageStats,
+    failed_tiles: AtomicU64,
+    failed_models: AtomicU64,
+}
+
+/// A file for the writer thread, relative to the output directory
+struct OutputFile {
+    path: PathBuf,
+    data: Vec<u8>,
+}
+
+/// One collision mesh: a whole M2, or one WMO group
+#[derive(Default)]
+struct CollisionMesh {
+    vertices: Vec<[f32; 3]>,
+    triangles: Vec<[u16; 3]>,
+    collides: Vec<u8>,
+    bsp_nodes: Vec<[u8; 16]>,
+    bsp_refs: Vec<u16>,
+}
+
+/// Models decoded so far, by normalized file name
+///
+/// Each name maps to a cell initialized by the first worker that needs it;
+/// later workers block on the cell until that decode is done. Decoding never
+/// starts nested parallel work, so a blocked worker cannot be asked to run
+/// the decode it is waiting for.
+#[derive(Default)]
+struct ModelCache {
+    entries: Mutex<HashMap<String, Arc<OnceLock<Option<u32>>>>>,
+    /// IDs handed out so far, with kind and name for the index
+    index: Mutex<Vec<(u32, String)>>,
+}
+
+impl ModelCache {
+    /// ID of a model's collision file, decoding and queueing it on first use
+    ///
+    /// Returns `None` for models without collision geometry or that failed.
+    fn resolve(&self, kind: u32, name: &str, ctx: &Pipeline<'_>) -> Option<u32> {
+        let key = name.to_ascii_lowercase();
+        let cell = {
+            let mut entries = self.entries.lock().unwrap();
+            Arc::clone(entries.entry(key).or_default())
+        };
+        *cell.get_or_init(|| {
+            let meshes = match decode_model(kind, name, ctx) {
+                Ok(meshes) => meshes,
+                Err(e) => {
+                    log::warn!("{e:#}");
+                    ctx.stats.failed_models.fetch_add(1, Ordering::Relaxed);
+                    return None;
+                }
+            };
+            if meshes.iter().all(|mesh| mesh.triangles.is_empty()) {
+                return None;
+            }
+
+            let id = {
+                let mut index = self.index.lock().unwrap();
+                let id = index.len() as u32;
+                index.push((kind, name.to_string()));
+                id
+            };
+            let data = encode_model(kind, &meshes);
+            ctx.send(PathBuf::from("models").join(format!("{id:08}.col")), data);
+            Some(id)
+        })
+    }
+}
+
+/// State shared by all workers
+struct Pipeline<'a> {
+    client: &'a ClientData,
+    stats: &'a PipelineStats,
+    models: Option<&'a ModelCache>,
+    output: SyncSender<OutputFile>,
+}
+
+impl Pipeline<'_> {
+    fn read(&self, name: &str) -> Result<Option<Vec<u8>>> {
+        let data = self.stats.read.time(|| self.client.read(name))?;
+        if let Some(data) = &data {
+            self.stats.read.add(1, data.len() as u64);
+        }
+        Ok(data)
+    }
+
+    fn send(&self, path: PathBuf, data: Vec<u8>) {
+        // The writer only hangs up after a write error, which it reports
+        let _ = self.output.send(OutputFile { path, data });
+    }
+}
+
+/// A tile to extract
+struct TileJob {
+    map: String,
+    x: u32,
+    y: u32,
+}
+
+fn execute_extract(
+    data: &str,
+    output: &str,
+    maps: &[String],
+    threads: Option<usize>,
+    no_models: bool,
+) -> Result<()> {
+    let client = ClientData::open(Path::new(data))?;
+    let output_dir = PathBuf::from(output);
+    fs::create_dir_all(output_dir.join("maps"))
+        .with_context(|| format!("Failed to create output directory: {output}"))?;
+    fs::create_dir_all(output_dir.join("models"))?;
+
+    let mut jobs = Vec::new();
+    for map in maps {
+        let tiles = map_tiles(&client, map)?;
+        println!("{map}: {} tiles", tiles.len());
+        jobs.extend(tiles.into_iter().map(|(x, y)| TileJob {
+            map: map.clone(),
+            x,
+            y,
+        }));
+    }
+    if jobs.is_empty() {
+        bail!("No ADT tiles found in the selected maps");
+    }
+
+    let threads = threads.unwrap_or_else(|| {
+        thread::available_parallelism()
+            .map(|n| n.get())
+            .unwrap_or(1)
+    });
+    let pool = rayon::ThreadPoolBuilder::new()
+        .num_threads(threads)
+        .thread_name(|i| format!("extract-{i}"))
+        .build()
+        .context("Failed to create thread pool")?;
+
+    let stats = PipelineStats::default();
+    let cache = ModelCache::default();
+    let (sender, receiver) = sync_channel(threads * 4);
+    let progress = create_progress_bar(jobs.len() as u64, "Extracting tiles");
+    let start = Instant::now();
+
+    thread::scope(|scope| -> Result<()> {
+        let writer = scope.spawn(|| write_outputs(&output_dir, receiver, &stats.write));
+
+        let ctx = Pipeline {
+            client: &client,
+            stats: &stats,
+            models: (!no_models).then_some(&cache),
+            output: sender,
+        };
+        pool.install(|| {
+            jobs.par_iter().for_each(|job| {
+                if let Err(e) = extract_tile(job, &ctx) {
+                    log::warn!("{}_{}_{}: {e:#}", job.map, job.x, job.y);
+                    stats.failed_tiles.fetch_add(1, Ordering::Relaxed);
+                }
+                progress.inc(1);
+            })
+        });
+        drop(ctx);
+
+        writer.join().expect("writer thread panicked")
+    })?;
+    progress.finish_and_clear();
+
+    let index = cache.index.into_inner().unwrap();
+    let mut listing = String::new();
+    for (id, (kind, name)) in index.iter().enumerate() {
+        let kind = if *kind == KIND_WMO { "wmo" } else { "m2" };
+        listing.push_str(&format!("{id:08}\t{kind}\t{name}\n"));
+    }
+    fs::write(output_dir.join("models.idx"), listing)?;
+
+    print_report(&stats, jobs.len(), index.len(), start.elapsed(), threads);
+    Ok(())
+}
+
+/// Tiles with an ADT according to a map's WDT
+fn map_tiles(client: &ClientData, map: &str) -> Result<Vec<(u32, u32)>> {
+    let name = format!("World\\Maps\\{map}\\{map}.wdt");
+    let data = client
+        .read(&name)?
+        .with_context(|| format!("{name} not found"))?;
+    // The version is only a hint, the reader detects it from the chunks
+    let wdt = WdtReader::new(Cursor::new(data), WowVersion::WotLK)
+        .read()
+        .with_context(|| format!("Failed to parse {name}"))?;
+    if wdt.is_wmo_only() {
+        log::warn!("{map} is a WMO-only map and has no terrain tiles");
+    }
+
+    let mut tiles = Vec::new();
+    for y in 0..64 {
+        for x in 0..64 {
+            if wdt.get_tile(x, y).is_some_and(|tile| tile.has_adt) {
+                tiles.push((x as u32, y as u32));
+            }
+        }
+    }
+    Ok(tiles)
+}
+
+/// Read, parse and encode one tile, resolving the models it places
+fn extract_tile(job: &TileJob, ctx: &Pipeline<'_>) -> Result<()> {
+    let base = format!(
+        "World\\Maps\\{map}\\{map}_{x}_{y}",
+        map = job.map,
+        x = job.x,
+        y = job.y
+    );
+    let root = ctx
+        .read(&format!("{base}.adt"))?
+        .with_context(|| format!("{base}.adt not found"))?;
+    let tex0 = ctx.read(&format!("{base}_tex0.adt"))?;
+    let obj0 = ctx.read(&format!("{base}_obj0.adt"))?;
+
+    let size = root.len() + obj0.as_ref().map_or(0, Vec::len);
+    let adt = ctx
+        .stats
+        .parse
+        .time(|| -> Result<RootAdt> { Ok(AdtSet::from_bytes(root, tex0, obj0, None)?.merge()?) })?;
+    ctx.stats.parse.add(1, size as u64);
+
+    // Models are resolved first so the tile can refer to them by ID
+    let mut placements = Vec::new();
+    if let Some(models) = ctx.models {
+        for doodad in &adt.doodad_placements {
+            let Some(name) = adt.models.get(doodad.name_id as usize) else {
+                continue;
+            };
+            if let Some(id) = models.resolve(KIND_M2, &m2_file_name(name), ctx) {
+                placements.push(Placement {
+                    kind: KIND_M2,
+                    id,
+                    unique_id: doodad.unique_id,
+                    position: doodad.position,
+                    rotation: doodad.rotation,
+                    scale: doodad.get_scale(),
+                });
+            }
+        }
+        for wmo in &adt.wmo_placements {
+            let Some(name) = adt.wmos.get(wmo.name_id as usize) else {
+                continue;
+            };
+            if let Some(id) = models.resolve(KIND_WMO, name, ctx) {
+                placements.push(Placement {
+                    kind: KIND_WMO,
+                    id,
+                    unique_id: wmo.unique_id,
+                    position: wmo.position,
+                    rotation: wmo.rotation,
+                    // Before Legion the field is unused and zero
+                    scale: if wmo.scale == 0 { 1.0 } else { wmo.get_scale() },
+                });
+            }
+        }
+    }
+
+    let data = ctx
+        .stats
+        .terrain
+        .time(|| encode_tile(job, &adt, &placements));
+    ctx.stats.terrain.add(1, data.len() as u64);
+    let file_name = format!("{}_{}_{}.map", job.map, job.x, job.y);
+    ctx.send(PathBuf::from("maps").join(file_name), data);
+    Ok(())
+}
+
+/// ADTs name doodads `.mdx` or `.mdl`; the files in the archives are `.m2`
+fn m2_file_name(name: &str) -> String {
+    let lower = name.to_ascii_lowercase();
+    match lower.rfind('.') {
+        Some(dot) if matches!(&lower[dot..], ".mdx" | ".mdl") => {
+            format!("{}.m2", &name[..dot])
+        }
+        _ => name.to_string(),
+    }
+}
+
+struct Placement {
+    kind: u32,
+    id: u32,
+    unique_id: u32,
+    position: [f32; 3],
+    rotation: [f32; 3],
+    scale: f32,
+}
+
+fn put_u16(out: &mut Vec<u8>, value: u16) {
+    out.extend_from_slice(&value.to_le_bytes());
+}
+
+fn put_u32(out: &mut Vec<u8>, value: u32) {
+    out.extend_from_slice(&value.to_le_bytes());
+}
+
+fn put_f32(out: &mut Vec<u8>, value: f32) {
+    out.extend_from_slice(&value.to_le_bytes());
+}
+
+/// Slot of a chunk in row-major order, falling back to its file position
+fn chunk_slot(chunk: &McnkChunk, position: usize) -> usize {
+    let (x, y) = (chunk.header.index_x, chunk.header.index_y);
+    if x < 16 && y < 16 {
+        (y * 16 + x) as usize
+    } else {
+        position
+    }
+}
+
+fn encode_tile(job: &TileJob, adt: &RootAdt, placements: &[Placement]) -> Vec<u8> {
+    let mut heights = vec![0.0f32; CHUNKS_PER_TILE * HEIGHTS_PER_CHUNK];
+    let mut holes = [0u16; CHUNKS_PER_TILE];
+    let mut area_ids = [0u32; CHUNKS_PER_TILE];
+    for (i, chunk) in adt.mcnk_chunks.iter().enumerate() {
+        let slot = chunk_slot(chunk, i);
+        if slot >= CHUNKS_PER_TILE {
+            continue;
+        }
+        let base = chunk.header.position[0];
+        let dst = &mut heights[slot * HEIGHTS_PER_CHUNK..(slot + 1) * HEIGHTS_PER_CHUNK];
+        dst.fill(base);
+        if let Some(mcvt) = &chunk.heights {
+            for (dst, height) in dst.iter_mut().zip(&mcvt.heights) {
+                *dst = base + height;
+            }
+        }
+        holes[slot] = chunk.header.holes_low_res;
+        area_ids[slot] = chunk.header.area_id;
+    }
+
+    let mut out = Vec::with_capacity(16 + heights.len() * 4 + CHUNKS_PER_TILE * 6);
+    out.extend_from_slice(TILE_MAGIC);
+    put_u32(&mut out, FORMAT_VERSION);
+    put_u32(&mut out, job.x);
+    put_u32(&mut out, job.y);
+    for height in heights {
+        put_f32(&mut out, height);
+    }
+    for mask in holes {
+        put_u16(&mut out, mask);
+    }
+    for area_id in area_ids {
+        put_u32(&mut out, area_id);
+    }
+
+    let mut liquids = Vec::new();
+    let layers = encode_liquids(adt, &mut liquids);
+    put_u32(&mut out, layers);
+    out.extend_from_slice(&liquids);
+
+    put_u32(&mut out, placements.len() as u32);
+    for placement in placements {
+        put_u32(&mut out, placement.kind);
+        put_u32(&mut out, placement.id);
+        put_u32(&mut out, placement.unique_id);
+        for value in placement.position.iter().chain(&placement.rotation) {
+            put_f32(&mut out, *value);
+        }
+        put_f32(&mut out, placement.scale);
+    }
+    out
+}
+
+/// Append the liquid layers of a tile, returning how many there are
+///
+/// MH2O (WotLK+) layers are used when the tile has them, otherwise the MCLQ
+/// liquid of each chunk.
+fn encode_liquids(adt: &RootAdt, out: &mut Vec<u8>) -> u32 {
+    let mut layers = 0;
+    if let Some(water) = &adt.water_data {
+        for (chunk, entry) in water.entries.iter().enumerate() {
+            for (i, instance) in entry.instances.iter().enumerate() {
+                let (width, height) = (instance.width.min(8), instance.height.min(8));
+                layer_header(out, chunk, 0, instance.liquid_type);
+                layers += 1;
+                out.extend_from_slice(&[instance.x_offset, instance.y_offset, width, height]);
+                put_f32(out, instance.min_height_level);
+                put_f32(out, instance.max_height_level);
+
+                let full_mask = if width == 8 && height == 8 {
+                    u64::MAX
+                } else {
+                    (1u64 << (u32::from(width) * u32::from(height))) - 1
+                };
+                let mask = entry.exists_bitmaps.get(i).copied().flatten();
+                out.extend_from_slice(&mask.unwrap_or(full_mask).to_le_bytes());
+
+                let vertices = entry.vertex_data.get(i).and_then(Option::as_ref);
+                for y in 0..=usize::from(height) {
+                    for x in 0..=usize::from(width) {
+                        let grid_x = usize::from(instance.x_offset) + x;
+                        let grid_y = usize::from(instance.y_offset) + y;
+                        let stored = vertices.and_then(|v| mh2o_height(v, grid_y * 9 + grid_x));
+                        put_f32(out, stored.unwrap_or(instance.min_height_level));
+                    }
+                }
+            }
+        }
+        return layers;
+    }
+
+    for (i, chunk) in adt.mcnk_chunks.iter().enumerate() {
+        let Some(liquid) = &chunk.liquid else {
+            continue;
+        };
+        layer_header(out, chunk_slot(chunk, i), 1, liquid.liquid_type as u16);
+        layers += 1;
+        out.extend_from_slice(&[0, 0, 8, 8]);
+        put_f32(out, liquid.min_height);
+        put_f32(out, liquid.max_height);
+
+        // Tiles whose low nibble is 0xF have no liquid
+        let mask = liquid
+            .tile_flags
+            .iter()
+            .enumerate()
+            .filter(|(_, flags)| **flags & 0x0F != 0x0F)
+            .fold(0u64, |mask, (bit, _)| mask | (1 << bit));
+        out.extend_from_slice(&mask.to_le_bytes());
+        for vertex in 0..81 {
+            let height = liquid.vertices.get(vertex).map(|v| v.height);
+            put_f32(out, height.unwrap_or(liquid.min_height));
+        }
+    }
+    layers
+}
+
+/// Chunk index, source and liquid type that start every liquid layer
+fn layer_header(out: &mut Vec<u8>, chunk: usize, source: u8, kind: u16) {
+    put_u16(out, chunk as u16);
+    out.push(source);
+    out.push(0);
+    put_u16(out, kind);
+}
+
+/// Height of one vertex of the 9x9 MH2O grid, if the format stores heights
+fn mh2o_height(vertices: &VertexDataArray, index: usize) -> Option<f32> {
+    match vertices {
+        VertexDataArray::HeightDepth(v) => v.get(index)?.as_ref().map(|v| v.height),
+        VertexDataArray::HeightUv(v) => v.get(index)?.as_ref().map(|v| v.height),
+        VertexDataArray::HeightUvDepth(v) => v.get(index)?.as_ref().map(|v| v.height),
+        VertexDataArray::DepthOnly(_) => None,
+    }
+}
+
+/// Read and decode the collision meshes of a model
+fn decode_model(kind: u32, name: &str, ctx: &Pipeline<'_>) -> Result<Vec<CollisionMesh>> {
+    let data = ctx
+        .read(name)?
+        .with_context(|| format!("Model {name} not found"))?;
+    if kind == KIND_M2 {
+        let mesh = ctx.stats.models.time(|| m2_collision(&data));
+        ctx.stats.models.add(1, data.len() as u64);
+        return Ok(vec![
+            mesh.with_context(|| format!("Failed to decode {name}"))?,
+        ]);
+    }
+
+    let root = ctx.stats.models.time(|| parse_wmo(&mut Cursor::new(&data)));
+    let group_count = match root.with_context(|| format!("Failed to parse {name}"))? {
+        ParsedWmo::Root(root) => root.n_groups,
+        ParsedWmo::Group(_) => bail!("{name} is a WMO group, not a root file"),
+    };
+    let mut bytes = data.len() as u64;
+
+    let stem = name.strip_suffix(".wmo").unwrap_or(name);
+    let mut meshes = Vec::with_capacity(group_count as usize);
+    for i in 0..group_count {
+        let group_name = format!("{stem}_{i:03}.wmo");
+        // An empty mesh keeps the group count and indices of the root
+        let Some(group_data) = ctx.read(&group_name)? else {
+            log::warn!("WMO group {group_name} not found");
+            meshes.push(CollisionMesh::default());
+            continue;
+        };
+        bytes += group_data.len() as u64;
+        let parsed = ctx
+            .stats
+            .models
+            .time(|| parse_wmo(&mut Cursor::new(&group_data)));
+        match parsed.with_context(|| format!("Failed to parse {group_name}"))? {
+            ParsedWmo::Group(group) => meshes.push(ctx.stats.models.time(|| wmo_collision(&group))),
+            ParsedWmo::Root(_) => bail!("{group_name} is a WMO root, not a group file"),
+        }
+    }
+    ctx.stats.models.add(1, bytes);
+    Ok(meshes)
+}
+
+/// Collision mesh of an M2: its bounding triangles and vertices
+///
+/// Only the header is parsed; the two arrays are read straight from the
+/// file bytes.
+fn m2_collision(data: &[u8]) -> Result<CollisionMesh> {
+    // Chunked (Legion+) files wrap the MD20 data in an MD21 chunk
+    let md20 = if data.starts_with(b"MD21") {
+        data.get(8..).unwrap_or_default()
+    } else {
+        data
+    };
+    let header = M2Header::parse(&mut Cursor::new(md20))?;
+
+    let array = |count: u32, offset: u32, size: usize| -> Result<&[u8]> {
+        let start = offset as usize;
+        let end = start + count as usize * size;
+        md20.get(start..end)
+            .context("Collision data extends past the end of the file")
+    };
+    let vertices = array(
+        header.bounding_vertices.count,
+        header.bounding_vertices.offset,
+        12,
+    )?;
+    let indices = array(
+        header.bounding_triangles.count,
+        header.bounding_triangles.offset,
+        2,
+    )?;
+
+    let vertices: Vec<[f32; 3]> = vertices
+        .chunks_exact(12)
+        .map(|v| {
+            let value = |i: usize| f32::from_le_bytes([v[i], v[i + 1], v[i + 2], v[i + 3]]);
+            [value(0), value(4), value(8)]
+        })
+        .collect();
+    let triangles: Vec<[u16; 3]> = indices
+        .chunks_exact(6)
+        .map(|t| {
+            let index = |i: usize| u16::from_le_bytes([t[i], t[i + 1]]);
+            [index(0), index(2), index(4)]
+        })
+        .filter(|t| t.iter().all(|&i| usize::from(i) < vertices.len()))
+        .collect();
+
+    Ok(CollisionMesh {
+        collides: vec![1; triangles.len()],
+        vertices,
+        triangles,
+        ..Default::default()
+    })
+}
+
+/// Collision mesh of a WMO group, keeping all triangles so BSP face
+/// references stay valid
+fn wmo_collision(group: &WmoGroup) -> CollisionMesh {
+    let vertices = group
+        .vertex_positions
+        .iter()
+        .map(|v| [v.x, v.y, v.z])
+        .collect();
+    let triangles: Vec<[u16; 3]> = group
+        .vertex_indices
+        .chunks_exact(3)
+        .map(|t| [t[0], t[1], t[2]])
+        .collect();
+    let collides = (0..triangles.len())
+        .map(|i| {
+            let flags = group.material_info.get(i).map_or(0, |m| m.flags);
+            let render = flags & WMO_MATERIAL_RENDER != 0 && flags & WMO_MATERIAL_DETAIL == 0;
+            u8::from(flags & WMO_MATERIAL_COLLISION != 0 || render)
+        })
+        .collect();
+    let bsp_nodes = group
+        .bsp_nodes
+        .iter()
+        .map(|node| {
+            let mut bytes = [0u8; 16];
+            bytes[0..2].copy_from_slice(&node.flags.to_le_bytes());
+            bytes[2..4].copy_from_slice(&node.neg_child.to_le_bytes());
+            bytes[4..6].copy_from_slice(&node.pos_child.to_le_bytes());
+            bytes[6..8].copy_from_slice(&node.n_faces.to_le_bytes());
+            bytes[8..12].copy_from_slice(&node.face_start.to_le_bytes());
+            bytes[12..16].copy_from_slice(&node.plane_distance.to_le_bytes());
+            bytes
+        })
+        .collect();
+
+    CollisionMesh {
+        vertices,
+        triangles,
+        collides,
+        bsp_nodes,
+        bsp_refs: group.bsp_face_indices.clone(),
+    }
+}
+
+fn encode_model(kind: u32, meshes: &[CollisionMesh]) -> Vec<u8> {
+    let mut out = Vec::new();
+    out.extend_from_slice(MODEL_MAGIC);
+    put_u32(&mut out, FORMAT_VERSION);
+    put_u32(&mut out, kind);
+    put_u32(&mut out, meshes.len() as u32);
+    for mesh in meshes {
+        put_u32(&mut out, mesh.vertices.len() as u32);
+        put_u32(&mut out, mesh.triangles.len() as u32);
+        put_u32(&mut out, mesh.bsp_nodes.len() as u32);
+        put_u32(&mut out, mesh.bsp_refs.len() as u32);
+        for value in mesh.vertices.iter().flatten() {
+            put_f32(&mut out, *value);
+        }
+        for index in mesh.triangles.iter().flatten() {
+            put_u16(&mut out, *index);
+        }
+        out.extend_from_slice(&mesh.collides);
+        for node in &mesh.bsp_nodes {
+            out.extend_from_slice(node);
+        }
+        for face in &mesh.bsp_refs {
+            put_u16(&mut out, *face);
+        }
+    }
+    out
+}
+
+/// Write files as they arrive until every worker is done
+fn write_outputs(dir: &Path, files: Receiver<OutputFile>, stats: &StageStats) -> Result<()> {
+    for file in files {
+        let path = dir.join(&file.path);
+        stats.time(|| -> Result<()> {
+            let mut handle = fs::File::create(&path)
+                .with_context(|| format!("Failed to create {}", path.display()))?;
+            handle
+                .write_all(&file.data)
+                .with_context(|| format!("Failed to write {}", path.display()))
+        })?;
+        stats.add(1, file.data.len() as u64);
+    }
+    Ok(())
+}
+
+fn print_report(
+    stats: &PipelineStats,
+    tiles: usize,
+    models: usize,
+    elapsed: Duration,
+    threads: usize,
+) {
+    println!();
+    println!("Map Extraction Summary");
+    println!("======================");
+    println!(
+        "Tiles: {tiles} ({} failed), models: {models} ({} failed)",
+        stats.failed_tiles.load(Ordering::Relaxed),
+        stats.failed_models.load(Ordering::Relaxed)
+    );
+    println!(
+        "Elapsed: {:.2}s on {threads} threads",
+        elapsed.as_secs_f64()
+    );
+    println!();
+
+    // Busy time is summed over the threads running a stage, so busy
+    // throughput is per thread and wall throughput is for the whole run
+    let mut table = create_table(vec![
+        "Stage",
+        "Items",
+        "Bytes",
+        "Busy",
+        "Per thread",
+        "Overall",
+    ]);
+    let stages = [
+        ("Read", &stats.read),
+        ("Parse ADT", &stats.parse),
+        ("Terrain", &stats.terrain),
+        ("Models", &stats.models),
+        ("Write", &stats.write),
+    ];
+    let rate = |bytes: u64, time: Duration| {
+        let seconds = time.as_secs_f64();
+        if seconds > 0.0 {
+            format!("{}/s", format_bytes((bytes as f64 / seconds) as u64))
+        } else {
+            "-".to_string()
+        }
+    };
+    for (name, stage) in stages {
+        let bytes = stage.bytes.load(Ordering::Relaxed);
+        add_table_row(
+            &mut table,
+            vec![
+                name.to_string(),
+                stage.items.load(Ordering::Relaxed).to_string(),
+                format_bytes(bytes),
+                format!("{:.2}s", stage.busy().as_secs_f64()),
+                rate(bytes, stage.busy()),
+                rate(bytes, elapsed),
+            ],
+        );
+    }
+    table.printstd();
+}
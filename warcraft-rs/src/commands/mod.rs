@@ -26,3 +26,6 @@ pub mod wdt;
 
 #[cfg(feature = "wdl")]
 pub mod wdl;
+
+#[cfg(feature = "maps")]
+pub mod maps;
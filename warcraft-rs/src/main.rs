@@ -62,6 +62,9 @@ async fn main() -> Result<()> {
         #[cfg(feature = "wdl")]
         Commands::Wdl { command } => commands::wdl::execute(command),
 
+        #[cfg(feature = "maps")]
+        Commands::Maps { command } => commands::maps::execute(command),
+
         Commands::Completions { shell } => {
             print_completions(shell, &mut Cli::command());
             Ok(())
@@ -0,0 +1,338 @@
+//! CLI integration tests for map extraction
+//!
+//! These tests build a small map archive with the format crates' writers,
+//! run `maps extract` on it and check the files it produces.
+
+#![cfg(feature = "maps")]
+
+use anyhow::{Context, Result};
+use std::fs;
+use std::io::Cursor;
+use std::path::Path;
+use std::process::Command;
+use tempfile::TempDir;
+use wow_adt::AdtVersion;
+use wow_adt::builder::AdtBuilder;
+use wow_adt::chunks::{
+    DoodadPlacement, McnkChunk, McnkFlags, McnkHeader, McvtChunk, Mh2oChunk, Mh2oEntry, Mh2oHeader,
+    Mh2oInstance,
+};
+use wow_m2::M2Model;
+use wow_mpq::ArchiveBuilder;
+use wow_wdt::version::WowVersion;
+use wow_wdt::{WdtFile, WdtWriter};
+
+const MAP: &str = "TestMap";
+const TILE_X: usize = 32;
+const TILE_Y: usize = 31;
+const MODEL: &str = "world/test/box.m2";
+
+/// Offset of the liquid layer count in a tile file
+const LIQUIDS_OFFSET: usize = 16 + 256 * 145 * 4 + 256 * 2 + 256 * 4;
+
+/// Get the path to the warcraft-rs binary
+fn get_binary_path() -> Result<std::path::PathBuf> {
+    // Check if we're running under cargo-llvm-cov (code coverage)
+    if let Ok(target_dir) = std::env::var("CARGO_TARGET_DIR") {
+        let coverage_binary = std::path::Path::new(&target_dir).join("debug/warcraft-rs");
+        if coverage_binary.exists() {
+            return Ok(coverage_binary);
+        }
+    }
+
+    let manifest_dir = env!("CARGO_MANIFEST_DIR");
+    let target_dir = std::path::Path::new(manifest_dir).join("../target");
+
+    // Try debug build first, then release
+    let debug_binary = target_dir.join("debug/warcraft-rs");
+    let release_binary = target_dir.join("release/warcraft-rs");
+
+    if debug_binary.exists() {
+        Ok(debug_binary)
+    } else if release_binary.exists() {
+        Ok(release_binary)
+    } else {
+        let output = std::process::Command::new("cargo")
+            .args(["build", "--bin", "warcraft-rs"])
+            .current_dir(manifest_dir)
+            .output()?;
+
+        if !output.status.success() {
+            return Err(anyhow::anyhow!(
+                "Failed to build warcraft-rs binary: {}",
+                String::from_utf8_lossy(&output.stderr)
+            ));
+        }
+
+        if debug_binary.exists() {
+            Ok(debug_binary)
+        } else {
+            Err(anyhow::anyhow!(
+                "warcraft-rs binary not found even after building"
+            ))
+        }
+    }
+}
+
+/// Base height of a chunk slot, so every chunk is distinguishable
+fn chunk_base(slot: usize) -> f32 {
+    slot as f32 * 10.0
+}
+
+/// MCNK chunk at grid position (x, y) with heights `base + 0.5 * vertex`
+fn create_mcnk(x: u32, y: u32) -> McnkChunk {
+    let slot = (y * 16 + x) as usize;
+    let header = McnkHeader {
+        flags: McnkFlags { value: 0 },
+        index_x: x,
+        index_y: y,
+        n_layers: 0,
+        n_doodad_refs: 0,
+        multipurpose_field: McnkHeader::multipurpose_from_offsets(0, 0),
+        ofs_layer: 0,
+        ofs_refs: 0,
+        ofs_alpha: 0,
+        size_alpha: 0,
+        ofs_shadow: 0,
+        size_shadow: 0,
+        area_id: 1000 + slot as u32,
+        n_map_obj_refs: 0,
+        holes_low_res: 0,
+        unknown_but_used: 0,
+        pred_tex: [0; 8],
+        no_effect_doodad: [0; 8],
+        unknown_8bytes: [0; 8],
+        ofs_snd_emitters: 0,
+        n_snd_emitters: 0,
+        ofs_liquid: 0,
+        size_liquid: 0,
+        // position[0] is the vertical base of the chunk
+        position: [chunk_base(slot), 0.0, 0.0],
+        ofs_mccv: 0,
+        ofs_mclv: 0,
+        unused: 0,
+        _padding: [0; 8],
+    };
+
+    McnkChunk {
+        header,
+        heights: Some(McvtChunk {
+            heights: (0..145).map(|i| i as f32 * 0.5).collect(),
+        }),
+        normals: None,
+        layers: None,
+        materials: None,
+        refs: None,
+        doodad_refs: None,
+        wmo_refs: None,
+        alpha: None,
+        shadow: None,
+        vertex_colors: None,
+        vertex_lighting: None,
+        sound_emitters: None,
+        liquid: None,
+        doodad_disable: None,
+        blend_batches: None,
+    }
+}
+
+/// Root ADT with terrain in every chunk, water in chunk 17 and one doodad
+fn create_adt() -> Result<Vec<u8>> {
+    let mut water = Mh2oChunk::new();
+    water.entries[17] = Mh2oEntry {
+        header: Mh2oHeader {
+            offset_instances: 0,
+            layer_count: 1,
+            offset_attributes: 0,
+        },
+        instances: vec![Mh2oInstance {
+            liquid_type: 5,
+            liquid_object_or_lvf: 0,
+            min_height_level: 50.0,
+            max_height_level: 52.0,
+            x_offset: 0,
+            y_offset: 0,
+            width: 8,
+            height: 8,
+            offset_exists_bitmap: 0,
+            offset_vertex_data: 0,
+        }],
+        vertex_data: vec![None],
+        exists_bitmaps: vec![None],
+        attributes: None,
+    };
+
+    let mut builder = AdtBuilder::new()
+        .with_version(AdtVersion::WotLK)
+        .add_texture("tileset/test/grass.blp")
+        .add_model(MODEL)
+        .add_doodad_placement(DoodadPlacement {
+            name_id: 0,
+            unique_id: 7,
+            position: [100.0, 200.0, 300.0],
+            rotation: [0.0, 90.0, 0.0],
+            scale: 1024,
+            flags: 0,
+        })
+        .add_water_data(water);
+    for y in 0..16 {
+        for x in 0..16 {
+            builder = builder.add_mcnk_chunk(create_mcnk(x, y));
+        }
+    }
+    Ok(builder.build()?.to_bytes()?)
+}
+
+/// M2 with a two-triangle collision quad
+fn create_m2() -> Result<Vec<u8>> {
+    let mut model = M2Model::default();
+    let vertices: [[f32; 3]; 4] = [
+        [0.0, 0.0, 0.0],
+        [1.0, 0.0, 0.0],
+        [1.0, 1.0, 0.0],
+        [0.0, 1.0, 0.0],
+    ];
+    model.raw_data.bounding_vertices = vertices
+        .iter()
+        .flatten()
+        .flat_map(|v| v.to_le_bytes())
+        .collect();
+    model.raw_data.bounding_triangles = [0u16, 1, 2, 0, 2, 3]
+        .iter()
+        .flat_map(|i| i.to_le_bytes())
+        .collect();
+
+    let mut data = Cursor::new(Vec::new());
+    model.write(&mut data)?;
+    Ok(data.into_inner())
+}
+
+/// WDT with a single tile
+fn create_wdt() -> Result<Vec<u8>> {
+    let mut wdt = WdtFile::new(WowVersion::WotLK);
+    wdt.main.get_mut(TILE_X, TILE_Y).unwrap().set_has_adt(true);
+    wdt.mwmo = Some(wow_wdt::chunks::MwmoChunk::new());
+
+    let mut buffer = Vec::new();
+    WdtWriter::new(&mut buffer).write(&wdt)?;
+    Ok(buffer)
+}
+
+/// Build the test map archive
+fn create_map_archive(path: &Path) -> Result<()> {
+    ArchiveBuilder::new()
+        .add_file_data(create_wdt()?, &format!("World\\Maps\\{MAP}\\{MAP}.wdt"))
+        .add_file_data(
+            create_adt()?,
+            &format!("World\\Maps\\{MAP}\\{MAP}_{TILE_X}_{TILE_Y}.adt"),
+        )
+        .add_file_data(create_m2()?, &MODEL.replace('/', "\\"))
+        .build(path)
+        .context("Failed to build map archive")
+}
+
+fn u32_at(data: &[u8], offset: usize) -> u32 {
+    u32::from_le_bytes(data[offset..offset + 4].try_into().unwrap())
+}
+
+fn f32_at(data: &[u8], offset: usize) -> f32 {
+    f32::from_le_bytes(data[offset..offset + 4].try_into().unwrap())
+}
+
+/// Test map extraction of a built map through the CLI
+#[test]
+fn test_cli_maps_extract() -> Result<()> {
+    let binary_path = get_binary_path()?;
+    let temp_dir = TempDir::new().context("Failed to create temp directory")?;
+    let archive_path = temp_dir.path().join("map.mpq");
+    let output_dir = temp_dir.path().join("out");
+    create_map_archive(&archive_path)?;
+
+    let output = Command::new(&binary_path)
+        .args([
+            "maps",
+            "extract",
+            archive_path.to_str().unwrap(),
+            "--output",
+            output_dir.to_str().unwrap(),
+            "--map",
+            MAP,
+            "--threads",
+            "2",
+        ])
+        .output()
+        .context("Failed to execute maps extract command")?;
+
+    if !output.status.success() {
+        return Err(anyhow::anyhow!(
+            "Maps extract command failed with exit code {}: {}",
+            output.status.code().unwrap_or(-1),
+            String::from_utf8_lossy(&output.stderr)
+        ));
+    }
+    let stdout = String::from_utf8_lossy(&output.stdout);
+    assert!(
+        stdout.contains("Tiles: 1 (0 failed), models: 1 (0 failed)"),
+        "Unexpected summary: {stdout}"
+    );
+
+    // Tile header, heights and area IDs
+    let tile = fs::read(output_dir.join(format!("maps/{MAP}_{TILE_X}_{TILE_Y}.map")))?;
+    assert_eq!(&tile[0..4], b"WRMT");
+    assert_eq!(u32_at(&tile, 4), 1);
+    assert_eq!(u32_at(&tile, 8), TILE_X as u32);
+    assert_eq!(u32_at(&tile, 12), TILE_Y as u32);
+    for (slot, vertex) in [(0, 0), (17, 144), (255, 72)] {
+        let height = f32_at(&tile, 16 + (slot * 145 + vertex) * 4);
+        assert_eq!(height, chunk_base(slot) + vertex as f32 * 0.5);
+    }
+    let area_ids = 16 + 256 * 145 * 4 + 256 * 2;
+    assert_eq!(u32_at(&tile, area_ids + 17 * 4), 1017);
+
+    // One MH2O layer covering chunk 17 at its minimum level
+    let mut offset = LIQUIDS_OFFSET;
+    assert_eq!(u32_at(&tile, offset), 1);
+    offset += 4;
+    assert_eq!(u16::from_le_bytes([tile[offset], tile[offset + 1]]), 17);
+    assert_eq!(tile[offset + 2], 0, "source should be MH2O");
+    assert_eq!(u16::from_le_bytes([tile[offset + 4], tile[offset + 5]]), 5);
+    assert_eq!(&tile[offset + 6..offset + 10], &[0, 0, 8, 8]);
+    assert_eq!(f32_at(&tile, offset + 10), 50.0);
+    assert_eq!(f32_at(&tile, offset + 14), 52.0);
+    assert_eq!(&tile[offset + 18..offset + 26], &u64::MAX.to_le_bytes());
+    offset += 26;
+    for vertex in 0..81 {
+        assert_eq!(f32_at(&tile, offset + vertex * 4), 50.0);
+    }
+    offset += 81 * 4;
+
+    // The doodad placement, referring to model 0
+    assert_eq!(u32_at(&tile, offset), 1);
+    offset += 4;
+    assert_eq!(u32_at(&tile, offset), 0, "kind should be M2");
+    assert_eq!(u32_at(&tile, offset + 4), 0);
+    assert_eq!(u32_at(&tile, offset + 8), 7);
+    let values: Vec<f32> = (0..7).map(|i| f32_at(&tile, offset + 12 + i * 4)).collect();
+    assert_eq!(values, [100.0, 200.0, 300.0, 0.0, 90.0, 0.0, 1.0]);
+    assert_eq!(tile.len(), offset + 40);
+
+    // Model index and the collision file it names
+    let index = fs::read_to_string(output_dir.join("models.idx"))?;
+    assert_eq!(index, format!("00000000\tm2\t{MODEL}\n"));
+
+    let model = fs::read(output_dir.join("models/00000000.col"))?;
+    assert_eq!(&model[0..4], b"WRCM");
+    assert_eq!(u32_at(&model, 4), 1);
+    assert_eq!(u32_at(&model, 8), 0, "kind should be M2");
+    assert_eq!(u32_at(&model, 12), 1, "an M2 has one group");
+    let counts: Vec<u32> = (0..4).map(|i| u32_at(&model, 16 + i * 4)).collect();
+    assert_eq!(counts, [4, 2, 0, 0]);
+    let triangles = 32 + 4 * 12;
+    let indices: Vec<u16> = (0..6)
+        .map(|i| u16::from_le_bytes([model[triangles + i * 2], model[triangles + i * 2 + 1]]))
+        .collect();
+    assert_eq!(indices, [0, 1, 2, 0, 2, 3]);
+    assert_eq!(&model[triangles + 12..], &[1, 1]);
+
+    Ok(())
+}